@@ -0,0 +1,452 @@
+;	CPU accounting per bank and console for MP/M
+;
+;	Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+;
+;	CPUACCT		show the shares of the CPU time
+;	CPUACCT /S	start the PC profiler, which clears the counts
+;	CPUACCT /E	end the PC profiler and show the shares
+;
+;	The PC profiler of the firmware samples the PC and the selected
+;	bank 2000 times a second. Under MP/M the user processes run in
+;	their own banks, and a bank belongs to the console whose port was
+;	used last with it selected, so the shares per bank and per console
+;	show which user runs the process eating the CPU. The counts are
+;	read from the performance counters of the hardware control port.
+;
+	title	'CPU accounting per bank and console'
+
+	.8080
+	aseg
+	org	100h
+
+bdos	equ	5
+tbuf	equ	80h
+
+conout	equ	2		; BDOS functions
+prstr	equ	9
+
+hwctl	equ	0a0h		; hardware control port
+hwunlk	equ	0aah		; unlock it
+hwext	equ	0		; extended command follows
+hwctr	equ	6		; latch performance counter n
+profon	equ	2		; start PC profiler
+profoff	equ	1		; stop PC profiler
+
+ctotal	equ	31		; counter of all samples
+cbank	equ	32		; counters of the samples in bank n
+ccons	equ	48		; counters of the samples of console n
+cowner	equ	64		; counters of the console of bank n
+nbanks	equ	16
+ncons	equ	6		; none, SIO1 - SIO5
+
+	lxi	sp,stack
+	lxi	h,tbuf		; look for an option
+	mov	b,m
+opt:	mov	a,b
+	ora	a
+	jz	show
+	dcr	b
+	inx	h
+	mov	a,m
+	cpi	'/'
+	jnz	opt
+	mov	a,b
+	ora	a
+	jz	usage
+	inx	h
+	mov	a,m
+	cpi	'S'
+	jz	start
+	cpi	'E'
+	jnz	usage
+	mvi	a,profoff	; end the profiler, then show the shares
+	call	hwcmd
+	jmp	show
+
+start:	mvi	a,profon
+	call	hwcmd
+	lxi	d,mstart
+	jmp	msg
+
+usage:	lxi	d,musage
+msg:	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+;	show the shares of the banks and the consoles
+
+show:	mvi	a,ctotal
+	call	getctr
+	lxi	h,ctr
+	lxi	d,total
+	call	cpy32
+	lxi	h,total
+	call	zero32
+	lxi	d,mnone
+	jz	msg
+	lxi	h,msmp
+	call	puts
+	lxi	h,total
+	lxi	d,num
+	call	cpy32
+	mvi	a,1
+	call	putnum
+	lxi	h,mbank
+	call	puts
+	xra	a
+	sta	index
+bank1:	adi	cbank
+	call	getctr
+	lxi	h,ctr
+	call	zero32
+	jz	bank2
+	lxi	h,ctr
+	lxi	d,smp
+	call	cpy32
+	lda	index
+	adi	cowner
+	call	getctr
+	lda	index
+	call	setnum
+	mvi	a,4
+	call	putnum
+	lxi	h,mpad
+	call	puts
+	lda	ctr
+	call	putcon
+	call	putpct
+bank2:	lda	index
+	inr	a
+	sta	index
+	cpi	nbanks
+	jc	bank1
+
+	lxi	h,mcons
+	call	puts
+	xra	a
+	sta	index
+cons1:	adi	ccons
+	call	getctr
+	lxi	h,ctr
+	call	zero32
+	jz	cons2
+	lxi	h,ctr
+	lxi	d,smp
+	call	cpy32
+	lda	index
+	call	putcon
+	call	putpct
+cons2:	lda	index
+	inr	a
+	sta	index
+	cpi	ncons
+	jc	cons1
+	jmp	0
+
+;	print the share of the samples in smp of total, in tenths of
+;	a percent, and the end of the line
+
+putpct:	lxi	h,total
+	lxi	d,den
+	call	cpy32
+	lxi	h,smp
+	lxi	d,num
+	call	cpy32
+pct1:	lda	den+3		; both below 2^22, so that * 1000 fits
+	ora	a
+	jnz	pct2
+	lda	den+2
+	cpi	40h
+	jc	pct3
+pct2:	lxi	h,den
+	call	shr32
+	lxi	h,num
+	call	shr32
+	jmp	pct1
+pct3:	call	mul1k
+	call	div32		; tenths of a percent
+	lxi	h,ten
+	lxi	d,den
+	call	cpy32
+	call	div32
+	lda	rem
+	push	psw
+	mvi	a,6
+	call	putnum
+	mvi	a,'.'
+	call	putc
+	pop	psw
+	adi	'0'
+	call	putc
+	lxi	h,mpct
+	jmp	puts
+
+;	print console a, 0 is none
+
+putcon:	lxi	h,mnocon
+	ora	a
+	jz	puts
+	push	psw
+	lxi	h,msio
+	call	puts
+	pop	psw
+	adi	'0'
+	jmp	putc
+
+;	latch the performance counter a and read it into ctr
+
+getctr:	push	psw
+	call	unlock
+	mvi	a,hwext
+	out	hwctl
+	mvi	a,hwctr
+	out	hwctl
+	pop	psw
+	out	hwctl
+	lxi	h,ctr		; low byte first
+	mvi	b,4
+getc1:	in	hwctl
+	mov	m,a
+	inx	h
+	dcr	b
+	jnz	getc1
+	ret
+
+;	output the command a to the hardware control port
+
+hwcmd:	push	psw
+	call	unlock
+	pop	psw
+	out	hwctl
+	ret
+
+unlock:	in	hwctl		; check if hardware control port is unlocked
+	ora	a
+	rz
+	mvi	a,hwunlk	; unlock hardware control port
+	out	hwctl
+	ret
+
+;	print num in decimal, right aligned in a columns
+
+putnum:	sta	width
+	lxi	h,numend
+	shld	nump
+pnum1:	lxi	h,ten		; the digits from the lowest one
+	lxi	d,den
+	call	cpy32
+	call	div32
+	lhld	nump
+	dcx	h
+	lda	rem
+	adi	'0'
+	mov	m,a
+	shld	nump
+	lxi	h,num
+	call	zero32
+	jnz	pnum1
+	lhld	nump		; b = number of digits
+	lxi	d,numend
+	mov	a,e
+	sub	l
+	mov	b,a
+	lda	width
+	sub	b
+	jc	pnum3
+	jz	pnum3
+	mov	c,a
+pnum2:	mvi	a,' '
+	call	putc
+	dcr	c
+	jnz	pnum2
+pnum3:	mov	a,m
+	call	putc
+	inx	h
+	dcr	b
+	jnz	pnum3
+	ret
+
+;	num = a
+
+setnum:	lxi	h,num
+	mov	m,a
+	xra	a
+	inx	h
+	mov	m,a
+	inx	h
+	mov	m,a
+	inx	h
+	mov	m,a
+	ret
+
+;	num = num * 1000, as num * 1024 - num * 16 - num * 8
+
+mul1k:	lxi	h,num
+	lxi	d,t8
+	call	cpy32
+	mvi	c,3
+mul1:	lxi	h,t8
+	call	shl32
+	dcr	c
+	jnz	mul1
+	lxi	h,t8
+	lxi	d,t16
+	call	cpy32
+	lxi	h,t16
+	call	shl32
+	mvi	c,10
+mul2:	lxi	h,num
+	call	shl32
+	dcr	c
+	jnz	mul2
+	lxi	h,num
+	lxi	d,t16
+	call	sub32
+	lxi	h,num
+	lxi	d,t8
+	jmp	sub32
+
+;	num = num / den, the remainder in rem
+
+div32:	lxi	h,0
+	shld	rem
+	shld	rem+2
+	mvi	c,32
+div1:	lxi	h,num
+	call	shl32
+	lxi	h,rem
+	call	rl32
+	lxi	h,rem
+	lxi	d,den
+	call	sub32
+	jnc	div2
+	lxi	h,rem		; too big, add it back
+	lxi	d,den
+	call	add32
+	jmp	div3
+div2:	lxi	h,num		; a bit of the quotient
+	mov	a,m
+	ori	1
+	mov	m,a
+div3:	dcr	c
+	jnz	div1
+	ret
+
+;	32 bit numbers at hl, low byte first
+
+shl32:	ora	a		; shift left
+rl32:	mvi	b,4		; rotate left through the carry
+rl1:	mov	a,m
+	ral
+	mov	m,a
+	inx	h
+	dcr	b
+	jnz	rl1
+	ret
+
+shr32:	inx	h		; shift right
+	inx	h
+	inx	h
+	ora	a
+	mvi	b,4
+shr1:	mov	a,m
+	rar
+	mov	m,a
+	dcx	h
+	dcr	b
+	jnz	shr1
+	ret
+
+add32:	ora	a		; add the number at de
+	mvi	b,4
+add1:	ldax	d
+	adc	m
+	mov	m,a
+	inx	h
+	inx	d
+	dcr	b
+	jnz	add1
+	ret
+
+sub32:	ora	a		; subtract the number at de, carry if below
+	mvi	b,4
+sub1:	mov	a,m
+	xchg
+	sbb	m
+	xchg
+	mov	m,a
+	inx	h
+	inx	d
+	dcr	b
+	jnz	sub1
+	ret
+
+cpy32:	mvi	b,4		; copy to de
+cpy1:	mov	a,m
+	stax	d
+	inx	h
+	inx	d
+	dcr	b
+	jnz	cpy1
+	ret
+
+zero32:	mov	a,m		; zero flag if 0
+	inx	h
+	ora	m
+	inx	h
+	ora	m
+	inx	h
+	ora	m
+	ret
+
+;	print the string at hl
+
+puts:	mov	a,m
+	ora	a
+	rz
+	call	putc
+	inx	h
+	jmp	puts
+
+putc:	push	h
+	push	d
+	push	b
+	mov	e,a
+	mvi	c,conout
+	call	bdos
+	pop	b
+	pop	d
+	pop	h
+	ret
+
+musage:	db	'Usage: CPUACCT [/S|/E]',13,10
+	db	'/S starts the PC profiler, /E ends it',13,10,'$'
+mstart:	db	'PC profiler started',13,10,'$'
+mnone:	db	'No PC samples, start the profiler with CPUACCT /S',13,10,'$'
+msmp:	db	'PC samples ',0
+mbank:	db	13,10,'Bank  Cons      CPU',13,10,0
+mcons:	db	'Cons      CPU',13,10,0
+mpad:	db	'  ',0
+mnocon:	db	'none',0
+msio:	db	'SIO',0
+mpct:	db	'%'
+mcrlf:	db	13,10,0
+
+ten:	dw	10,0
+ctr:	ds	4		; counter read from the port
+total:	ds	4		; all samples
+smp:	ds	4		; samples of the bank or console
+num:	ds	4		; arithmetic
+den:	ds	4
+rem:	ds	4
+t8:	ds	4
+t16:	ds	4
+index:	db	0		; bank or console
+width:	db	0		; columns of putnum
+nump:	dw	0		; next digit of putnum
+numbuf:	ds	10
+numend:
+	ds	64
+stack:
+
+	end
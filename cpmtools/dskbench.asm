@@ -0,0 +1,574 @@
+;	Disk throughput benchmark at the BDOS level
+;
+;	Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+;
+;	DSKBENCH [drives] [/B]	measure the drives, e.g. DSKBENCH ABC,
+;				without drives the current one
+;
+;	For every drive a file DSKBENCH.$$$ of up to 128 KB is written
+;	sequentially, then read sequentially, then read and written
+;	with random records, each test for 4 seconds timed with the RTC.
+;	The results are in KB/s. With /B they are also written into the
+;	file DSKBENCH.TXT on the current drive, so that a batch job can
+;	collect them for comparing firmware builds and configurations.
+;
+	title	'Disk throughput benchmark'
+
+	.8080
+	aseg
+	org	100h
+
+bdos	equ	5
+tbuf	equ	80h
+
+conout	equ	2		; BDOS functions
+prstr	equ	9
+open	equ	15
+close	equ	16
+delete	equ	19
+rdseq	equ	20
+wrseq	equ	21
+make	equ	22
+curdsk	equ	25
+setdma	equ	26
+rdrnd	equ	33
+wrrnd	equ	34
+
+clkcmd	equ	41h		; RTC command
+clkdat	equ	42h		; RTC data
+getsec	equ	0		; get seconds from RTC
+
+tsecs	equ	4		; seconds each test runs
+maxrec	equ	1024		; max. records of the test file
+
+	lxi	sp,stack
+	lxi	h,tbuf		; get the drives and options
+	mov	b,m
+	inx	h
+	lxi	d,drives
+parse:	mov	a,b
+	ora	a
+	jz	parsed
+	dcr	b
+	mov	a,m
+	inx	h
+	cpi	'/'
+	jz	option
+	cpi	'A'		; skip blanks and colons
+	jc	parse
+	cpi	'P'+1
+	jnc	usage
+	sui	'A'-1		; drive code for the FCB
+	stax	d
+	inx	d
+	jmp	parse
+option:	mov	a,b
+	ora	a
+	jz	usage
+	dcr	b
+	mov	a,m
+	inx	h
+	cpi	'B'
+	jnz	usage
+	sta	batch
+	jmp	parse
+parsed:	xra	a		; end of the list
+	stax	d
+	lda	drives
+	ora	a
+	jnz	start
+	mvi	c,curdsk	; no drives, the current one
+	call	bdos
+	inr	a
+	sta	drives
+	xra	a
+	sta	drives+1
+
+start:	lxi	h,mhead
+	call	puts
+	lxi	h,drives
+drvlp:	mov	a,m
+	ora	a
+	jz	fin
+	inx	h
+	shld	drvp
+	call	bench
+	lhld	drvp
+	jmp	drvlp
+
+;	write the output into DSKBENCH.TXT with /B
+
+fin:	lda	batch
+	ora	a
+	jz	0
+	lhld	outp		; pad the last record with ^Z
+	mvi	b,128
+pad:	mvi	m,1ah
+	inx	h
+	dcr	b
+	jnz	pad
+	xra	a		; on the current drive
+	sta	fcb
+	lxi	h,txtnam
+	call	fcbset
+	lxi	d,fcb
+	mvi	c,delete
+	call	bdos
+	lxi	d,fcb
+	mvi	c,make
+	call	bdos
+	inr	a
+	lxi	d,mdir
+	jz	error
+	lxi	h,outbuf
+wrlp:	xchg
+	push	d
+	mvi	c,setdma
+	call	bdos
+	lxi	d,fcb
+	mvi	c,wrseq
+	call	bdos
+	pop	h
+	ora	a
+	lxi	d,mdfull
+	jnz	error
+	lxi	d,128
+	dad	d
+	xchg			; more records until outp
+	lhld	outp
+	mov	a,e
+	sub	l
+	mov	a,d
+	sbb	h
+	xchg
+	jc	wrlp
+	lxi	d,fcb
+	mvi	c,close
+	call	bdos
+	lxi	d,mdone
+	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+usage:	lxi	d,musage
+error:	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+;	run the tests on drive a and print the results
+
+bench:	sta	fcb		; drive of the test file
+	adi	'A'-1
+	call	putc
+	lxi	h,mdrv
+	call	puts
+	lxi	h,tstnam
+	call	fcbset
+	lxi	d,fcb
+	mvi	c,delete
+	call	bdos
+	lxi	d,fcb
+	mvi	c,make
+	call	bdos
+	inr	a
+	lxi	h,mnodir
+	jz	bfail
+	lxi	d,buf
+	mvi	c,setdma
+	call	bdos
+	lxi	h,0
+	shld	pos
+	shld	nrec
+	lxi	h,maxrec
+	shld	lim
+	lxi	h,seqwr
+	call	timed
+	jc	bfail
+	call	result
+	call	rewind		; close the file written, for reading it
+	jc	bfail
+	lxi	h,seqrd
+	call	timed
+	jc	bfail
+	call	result
+	call	mkmask
+	lxi	h,rndrd
+	call	timed
+	jc	bfail
+	call	result
+	lxi	h,rndwr
+	call	timed
+	jc	bfail
+	call	result
+	lxi	h,mcrlf
+bfail:	call	puts		; end of the line or the error
+	lxi	d,fcb		; remove the test file
+	mvi	c,close
+	call	bdos
+	lxi	h,tstnam
+	call	fcbset
+	lxi	d,fcb
+	mvi	c,delete
+	jmp	bdos
+
+;	call the test at hl for tsecs seconds, counting the calls.
+;	The tests return with carry set and the message in hl on errors.
+
+timed:	shld	test+1
+	call	second		; start with a new second
+	mov	b,a
+timed1:	call	second
+	cmp	b
+	jz	timed1
+	sta	last
+	mvi	a,tsecs
+	sta	left
+	xra	a
+	sta	count
+	sta	count+1
+	sta	count+2
+timed2:	call	test
+	rc
+	lxi	h,count		; count the record
+	inr	m
+	jnz	timed3
+	inx	h
+	inr	m
+	jnz	timed3
+	inx	h
+	inr	m
+timed3:	call	second
+	lxi	h,last
+	cmp	m
+	jz	timed2
+	mov	m,a
+	lxi	h,left
+	dcr	m
+	jnz	timed2
+	ora	a
+	ret
+test:	jmp	0
+
+second:	mvi	a,getsec	; seconds of the RTC
+	out	clkcmd
+	in	clkdat
+	ret
+
+;	write the next record, the file grows up to lim records,
+;	or until the disk is full, then it is written again
+
+seqwr:	lxi	d,fcb
+	mvi	c,wrseq
+	call	bdos
+	ora	a
+	jnz	seqwr2
+	lhld	pos
+	inx	h
+	shld	pos
+	xchg			; the file has max(nrec, pos) records
+	lhld	nrec
+	mov	a,l
+	sub	e
+	mov	a,h
+	sbb	d
+	jnc	seqwr1
+	xchg
+	shld	nrec
+	xchg
+seqwr1:	lhld	lim		; at the end start again
+	mov	a,l
+	sub	e
+	mov	l,a
+	mov	a,h
+	sbb	d
+	ora	l
+	jz	rewind
+	ret
+seqwr2:	lhld	pos		; disk full, the file ends here
+	mov	a,h
+	ora	l
+	lxi	h,mfull
+	stc
+	rz
+	lhld	pos
+	shld	lim
+	jmp	rewind
+
+;	read the next record, at the end of the file start again
+
+seqrd:	lxi	d,fcb
+	mvi	c,rdseq
+	call	bdos
+	ora	a
+	rz
+	call	rewind
+	rc
+	jmp	seqrd
+
+;	read and write a random record of the file
+
+rndrd:	call	rndrec
+	lxi	d,fcb
+	mvi	c,rdrnd
+	call	bdos
+	ora	a
+	rz
+	lxi	h,mread
+	stc
+	ret
+
+rndwr:	call	rndrec
+	lxi	d,fcb
+	mvi	c,wrrnd
+	call	bdos
+	ora	a
+	rz
+	lxi	h,mfull
+	stc
+	ret
+
+;	close and open the file, for reading it from the start
+
+rewind:	lxi	d,fcb
+	mvi	c,close
+	call	bdos
+	call	fcbclr
+	lxi	d,fcb
+	mvi	c,open
+	call	bdos
+	inr	a
+	lxi	h,mopen
+	stc
+	rz
+	lxi	h,0
+	shld	pos
+	ora	a
+	ret
+
+;	put a random record number below nrec into the FCB
+
+rndrec:	mvi	b,8		; 8 steps of the LFSR for each
+rndr1:	call	rand
+	dcr	b
+	jnz	rndr1
+	lda	mask
+	ana	l
+	mov	e,a
+	lda	mask+1
+	ana	h
+	mov	d,a
+	lhld	nrec		; again if not below nrec
+	mov	a,e
+	sub	l
+	mov	a,d
+	sbb	h
+	jnc	rndrec
+	xchg
+	shld	fcb+33
+	xra	a
+	sta	fcb+35
+	ret
+
+rand:	lhld	seed		; 16 bit Galois LFSR
+	ora	a
+	mov	a,h
+	rar
+	mov	h,a
+	mov	a,l
+	rar
+	mov	l,a
+	jnc	rand1
+	mov	a,h
+	xri	0b4h
+	mov	h,a
+rand1:	shld	seed
+	ret
+
+;	mask of the bits of the record numbers below nrec
+
+mkmask:	lhld	nrec
+	dcx	h
+	xchg
+	lxi	h,0
+mkm1:	mov	a,l
+	sub	e
+	mov	a,h
+	sbb	d
+	jnc	mkm2
+	dad	h
+	inx	h
+	jmp	mkm1
+mkm2:	shld	mask
+	ret
+
+;	print the KB/s of the records counted in tsecs seconds
+
+result:	lhld	count		; tenths of KB/s = count * 5 / 16
+	lda	count+2
+	mov	c,a
+	mov	b,a
+	push	h
+	dad	h
+	mov	a,c
+	ral
+	mov	c,a
+	dad	h
+	mov	a,c
+	ral
+	mov	c,a
+	pop	d
+	dad	d
+	mov	a,c
+	adc	b
+	mov	c,a
+	mvi	b,4
+res1:	ora	a
+	mov	a,c
+	rar
+	mov	c,a
+	mov	a,h
+	rar
+	mov	h,a
+	mov	a,l
+	rar
+	mov	l,a
+	dcr	b
+	jnz	res1
+	mov	a,c
+	ora	a
+	jz	res2
+	lxi	h,0ffffh	; more than shown
+res2:	lxi	d,numbuf	; the digits of hl
+	lxi	b,-10000
+	call	digit
+	lxi	b,-1000
+	call	digit
+	lxi	b,-100
+	call	digit
+	lxi	b,-10
+	call	digit
+	mov	a,l
+	adi	'0'
+	stax	d
+	lxi	h,numbuf	; leading zeros to blanks
+	mvi	b,3
+res3:	mov	a,m
+	cpi	'0'
+	jnz	res4
+	mvi	m,' '
+	inx	h
+	dcr	b
+	jnz	res3
+res4:	lxi	h,mpad
+	call	puts
+	lxi	h,numbuf
+	mvi	b,4
+res5:	mov	a,m
+	call	putc
+	inx	h
+	dcr	b
+	jnz	res5
+	mvi	a,'.'
+	call	putc
+	mov	a,m
+	jmp	putc
+
+digit:	mvi	a,'0'-1		; digit of hl for the power of 10 in -bc
+dig1:	inr	a
+	dad	b
+	jc	dig1
+	push	psw
+	mov	a,l
+	sub	c
+	mov	l,a
+	mov	a,h
+	sbb	b
+	mov	h,a
+	pop	psw
+	stax	d
+	inx	d
+	ret
+
+;	copy the 11 characters of the file name at hl into the FCB
+;	and clear the rest of it
+
+fcbset:	lxi	d,fcb+1
+	mvi	b,11
+fcbs1:	mov	a,m
+	stax	d
+	inx	h
+	inx	d
+	dcr	b
+	jnz	fcbs1
+	jmp	fcbs2
+
+fcbclr:	lxi	d,fcb+12
+fcbs2:	xra	a
+	mvi	b,24
+fcbs3:	stax	d
+	inx	d
+	dcr	b
+	jnz	fcbs3
+	ret
+
+;	print the string at hl, with a copy for DSKBENCH.TXT
+
+puts:	mov	a,m
+	ora	a
+	rz
+	call	putc
+	inx	h
+	jmp	puts
+
+putc:	push	h
+	push	d
+	push	b
+	lhld	outp
+	mov	m,a
+	inx	h
+	shld	outp
+	mov	e,a
+	mvi	c,conout
+	call	bdos
+	pop	b
+	pop	d
+	pop	h
+	ret
+
+musage:	db	'Usage: DSKBENCH [drives] [/B], e.g. DSKBENCH AB /B',13,10
+	db	'/B also writes the results into DSKBENCH.TXT',13,10,'$'
+mdir:	db	'Directory full',13,10,'$'
+mdfull:	db	'Disk full',13,10,'$'
+mnodir:	db	' Directory full',13,10,0
+mfull:	db	' Disk full',13,10,0
+mread:	db	' Read error',13,10,0
+mopen:	db	' Cannot open the test file',13,10,0
+mdone:	db	'Results written to DSKBENCH.TXT',13,10,'$'
+mhead:	db	'Drive Seq write  Seq read  Rnd read Rnd write  (KB/s)'
+mcrlf:	db	13,10,0
+mdrv:	db	':   ',0
+mpad:	db	'    ',0
+
+tstnam:	db	'DSKBENCH$$$'
+txtnam:	db	'DSKBENCHTXT'
+
+batch:	db	0		; write DSKBENCH.TXT
+seed:	dw	1		; state of the LFSR
+outp:	dw	outbuf		; end of the output
+drvp:	dw	0		; next drive
+pos:	dw	0		; record of the sequential tests
+nrec:	dw	0		; records in the test file
+lim:	dw	0		; max. records of the test file
+mask:	dw	0		; bits of the record numbers
+count:	db	0,0,0		; records in the test time
+last:	db	0		; seconds of the RTC at the last check
+left:	db	0		; seconds left of the test
+numbuf:	ds	5
+fcb:	ds	36
+drives:	ds	128		; drive codes, 0 ends
+	ds	64
+stack:
+buf:	ds	128
+outbuf:	ds	2048
+
+	end
@@ -0,0 +1,163 @@
+;	Terminal for TCP connections over the network bridge
+;
+;	Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+;
+;	NET host:port		connect to host:port, ^] disconnects
+;
+;	The connection is made by the gateway srcnetgw/netgw on the
+;	host, which is connected to the serial UART of the Pico.
+;
+	title	'Terminal for the network bridge'
+
+	.8080
+	aseg
+	org	100h
+
+bdos	equ	5
+tbuf	equ	80h
+
+dircon	equ	6		; BDOS functions
+prstr	equ	9
+
+net	equ	17		; network bridge port
+nadr	equ	10h		; set address of command bytes
+nconn	equ	20h		; connect
+nrecv	equ	30h		; receive data
+nsend	equ	40h		; send data
+nclose	equ	50h		; close connection
+
+rxrdy	equ	01h		; status bits
+txrdy	equ	02h
+conn	equ	04h
+pend	equ	08h
+closed	equ	10h
+err	equ	80h
+
+quit	equ	1dh		; ^] disconnects
+
+	lxi	sp,stack
+	lxi	h,tbuf		; copy the command tail without blanks
+	mov	b,m
+	inx	h
+	lxi	d,name
+cptail:	mov	a,b
+	ora	a
+	jz	cpend
+	dcr	b
+	mov	a,m
+	inx	h
+	cpi	' '
+	jz	cptail
+	stax	d
+	inx	d
+	jmp	cptail
+cpend:	xra	a
+	stax	d
+	lda	name
+	ora	a
+	lxi	d,musage
+	jz	error
+
+	mvi	a,nadr		; tell device where the command bytes are
+	out	net
+	lxi	h,cmd
+	mov	a,l
+	out	net
+	mov	a,h
+	out	net
+	lxi	h,name
+	shld	cmd+1
+	mvi	a,nconn
+	out	net
+	in	net
+	ani	err
+	lxi	d,mnonet
+	jnz	error
+wconn:	in	net		; wait for the gateway
+	mov	b,a
+	ani	pend
+	jnz	wconn
+	mov	a,b
+	ani	conn
+	lxi	d,mfail
+	jz	error
+	lxi	d,mconn
+	mvi	c,prstr
+	call	bdos
+
+loop:	in	net
+	mov	b,a
+	ani	closed
+	jnz	rclose
+	mov	a,b
+	ani	rxrdy
+	cnz	recv
+	mvi	c,dircon	; key pressed?
+	mvi	e,0ffh
+	call	bdos
+	ora	a
+	jz	loop
+	cpi	quit
+	jz	lclose
+	sta	key
+wsend:	in	net		; send it
+	ani	txrdy
+	jz	wsend
+	mvi	a,1
+	sta	cmd
+	lxi	h,key
+	shld	cmd+1
+	mvi	a,nsend
+	out	net
+	jmp	loop
+
+recv:	mvi	a,255		; receive what is there
+	sta	cmd
+	lxi	h,buf
+	shld	cmd+1
+	mvi	a,nrecv
+	out	net
+	lda	cmd
+	ora	a
+	rz
+	mov	b,a
+	lxi	h,buf
+recv1:	mov	a,m		; and print it
+	ani	7fh
+	mov	e,a
+	push	b
+	push	h
+	mvi	c,dircon
+	call	bdos
+	pop	h
+	pop	b
+	inx	h
+	dcr	b
+	jnz	recv1
+	ret
+
+rclose:	lxi	d,mrclos
+	jmp	done
+lclose:	lxi	d,mlclos
+done:	mvi	a,nclose
+	out	net
+error:	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+musage:	db	'Usage: NET host:port',13,10,'$'
+mnonet:	db	'Network bridge not enabled',13,10,'$'
+mfail:	db	'Connection failed',13,10,'$'
+mconn:	db	'Connected, ^] disconnects',13,10,'$'
+mrclos:	db	13,10,'Connection closed by the remote',13,10,'$'
+mlclos:	db	13,10,'Disconnected',13,10,'$'
+
+cmd:	db	0		; number of bytes
+	dw	0		; DMA address
+key:	db	0		; key to send
+name:	ds	128		; host:port
+	ds	64
+stack:
+buf:	ds	256
+
+	end
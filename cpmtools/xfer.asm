@@ -0,0 +1,293 @@
+;	Transfer files from and to the MicroSD card directory XFER80
+;
+;	Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+;
+;	XFER G [d:]file.ext	get the file from /XFER80
+;	XFER P [d:]file.ext	put the file into /XFER80
+;	XFER D [file.ext]	list the files in /XFER80, ? and *
+;				match like with DIR
+;
+;	The records are moved with the DMA file transfer device,
+;	the files are copied from and to the host with the mass
+;	storage mode of the configuration dialog.
+;
+	title	'Transfer files from and to the MicroSD card'
+
+	.8080
+	aseg
+	org	100h
+
+bdos	equ	5
+fcb1	equ	5ch
+fcb2	equ	6ch
+
+conout	equ	2		; BDOS functions
+prstr	equ	9
+open	equ	15
+close	equ	16
+delete	equ	19
+rdseq	equ	20
+wrseq	equ	21
+make	equ	22
+setdma	equ	26
+
+xfer	equ	16		; file transfer device port
+xadr	equ	10h		; set address of command bytes
+xopen	equ	20h		; open file for reading
+xcreat	equ	21h		; create file for writing
+xread	equ	30h		; read records
+xwrite	equ	40h		; write records
+xclose	equ	50h		; close file
+xfind	equ	60h		; search first file
+xnext	equ	61h		; search next file
+
+nrec	equ	64		; records per transfer
+
+	lxi	sp,stack
+	lxi	h,fcb2		; copy drive and file name into our FCB
+	lxi	d,fcb
+	mvi	b,12
+cpfcb:	mov	a,m
+	stax	d
+	inx	h
+	inx	d
+	dcr	b
+	jnz	cpfcb
+	xra	a		; and clear the rest of it
+	mvi	b,24
+clfcb:	stax	d
+	inx	d
+	dcr	b
+	jnz	clfcb
+
+	lxi	h,fcb+1		; make NAME.EXT for the host
+	lxi	d,name
+	mvi	b,8
+	call	cpname
+	lda	fcb+9
+	ani	7fh
+	cpi	' '
+	jz	nmend
+	mvi	a,'.'
+	stax	d
+	inx	d
+	lxi	h,fcb+9
+	mvi	b,3
+	call	cpname
+nmend:	xra	a
+	stax	d
+
+	mvi	a,xadr		; tell device where the command bytes are
+	out	xfer
+	lxi	h,cmd
+	mov	a,l
+	out	xfer
+	mov	a,h
+	out	xfer
+	lxi	h,name		; for open and create
+	shld	cmd+1
+
+	lda	fcb1+1
+	cpi	'D'
+	jz	dir
+	mov	b,a
+	lda	fcb+1		; get and put need a file name
+	cpi	' '
+	jz	usage
+	mov	a,b
+	cpi	'G'
+	jz	get
+	cpi	'P'
+	jz	put
+usage:	lxi	d,musage
+	jmp	error
+
+;	get file from the host
+
+get:	mvi	a,xopen
+	out	xfer
+	in	xfer
+	ora	a
+	lxi	d,mnohst
+	jnz	error
+	lxi	d,fcb
+	mvi	c,delete
+	call	bdos
+	lxi	d,fcb
+	mvi	c,make
+	call	bdos
+	inr	a
+	lxi	d,mdir
+	jz	errcl
+getlp:	mvi	a,nrec		; read a buffer full from the host
+	sta	cmd
+	lxi	h,buf
+	shld	cmd+1
+	mvi	a,xread
+	out	xfer
+	in	xfer
+	ora	a
+	lxi	d,mhrd
+	jnz	errcl
+	lda	cmd		; records read
+	ora	a
+	jz	getend
+	mov	b,a
+	lxi	h,buf
+getwr:	push	b		; and write them to disk
+	push	h
+	xchg
+	mvi	c,setdma
+	call	bdos
+	lxi	d,fcb
+	mvi	c,wrseq
+	call	bdos
+	pop	h
+	pop	b
+	ora	a
+	lxi	d,mdsk
+	jnz	errcl
+	lxi	d,128
+	dad	d
+	dcr	b
+	jnz	getwr
+	lda	cmd		; full buffer, there is more
+	cpi	nrec
+	jz	getlp
+getend:	lxi	d,fcb
+	mvi	c,close
+	call	bdos
+	jmp	done
+
+;	put file to the host
+
+put:	lxi	d,fcb
+	mvi	c,open
+	call	bdos
+	inr	a
+	lxi	d,mnofil
+	jz	error
+	mvi	a,xcreat
+	out	xfer
+	in	xfer
+	ora	a
+	lxi	d,mhcr
+	jnz	error
+putlp:	mvi	b,0		; read a buffer full from disk
+	lxi	h,buf
+putrd:	push	b
+	push	h
+	xchg
+	mvi	c,setdma
+	call	bdos
+	lxi	d,fcb
+	mvi	c,rdseq
+	call	bdos
+	pop	h
+	pop	b
+	ora	a
+	jnz	puteof
+	lxi	d,128
+	dad	d
+	inr	b
+	mov	a,b
+	cpi	nrec
+	jnz	putrd
+	call	hwrite		; and write them to the host
+	jmp	putlp
+puteof:	call	hwrite
+	jmp	done
+
+hwrite:	mov	a,b		; write b records from the buffer
+	ora	a
+	rz
+	sta	cmd
+	lxi	h,buf
+	shld	cmd+1
+	mvi	a,xwrite
+	out	xfer
+	in	xfer
+	ora	a
+	rz
+	lxi	d,mhwr
+	jmp	errcl
+
+;	list the files in /XFER80
+
+dir:	mvi	a,xfind
+dirlp:	out	xfer
+	in	xfer
+	ora	a
+	jnz	dirend
+	sta	found
+	lxi	h,name		; print the name found
+dirpr:	mov	a,m
+	ora	a
+	jz	dirnl
+	push	h
+	mov	e,a
+	mvi	c,conout
+	call	bdos
+	pop	h
+	inx	h
+	jmp	dirpr
+dirnl:	lxi	d,mcrlf
+	mvi	c,prstr
+	call	bdos
+	mvi	a,xnext
+	jmp	dirlp
+dirend:	lda	found
+	ora	a
+	jz	0
+	lxi	d,mnohst
+	jmp	error
+
+;	copy b characters of the file name from hl to de without blanks
+
+cpname:	mov	a,m
+	ani	7fh
+	cpi	' '
+	jz	cpnm1
+	stax	d
+	inx	d
+cpnm1:	inx	h
+	dcr	b
+	jnz	cpname
+	ret
+
+done:	mvi	a,xclose
+	out	xfer
+	lxi	d,mdone
+	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+errcl:	mvi	a,xclose
+	out	xfer
+error:	mvi	c,prstr
+	call	bdos
+	jmp	0
+
+musage:	db	'Usage: XFER G|P [d:]file.ext or XFER D [file.ext]',13,10
+	db	'G gets the file from /XFER80, P puts it there',13,10
+	db	'D lists the files in /XFER80',13,10,'$'
+mnohst:	db	'File not found in /XFER80',13,10,'$'
+mnofil:	db	'File not found',13,10,'$'
+mdir:	db	'Directory full',13,10,'$'
+mdsk:	db	'Disk full',13,10,'$'
+mhrd:	db	'Read error on the MicroSD card',13,10,'$'
+mhcr:	db	'Cannot create the file in /XFER80',13,10,'$'
+mhwr:	db	'Write error on the MicroSD card',13,10,'$'
+mdone:	db	'Done',13,10,'$'
+mcrlf:	db	13,10,'$'
+
+found:	db	0ffh		; cleared when a file was listed
+cmd:	db	0		; number of records
+	dw	0		; DMA address
+name:	ds	13		; host file name
+fcb:	ds	36
+	ds	64
+stack:
+buf:	ds	nrec*128
+
+	end
@@ -27,9 +27,21 @@
 #include "sd_card.h"
 
 /** Initialize the SD card.
+ * A baud_rate above 25 MHz switches the card to high speed mode, and
+ * the fastest clock up to it that reads reliably is used.
  * \return true for success or false for failure.
  */
 bool sd_sdio_begin(sd_card_t *sd_card_p);
+/** \return The SDIO bus clock in use, it is lowered after CRC errors. */
+uint32_t sd_sdio_clockHz(sd_card_t *sd_card_p);
+/** \return true if the card was switched to high speed mode. */
+bool sd_sdio_highSpeed(sd_card_t *sd_card_p);
+/** \return The counters of commands, transfers and errors since the
+ * start or sd_sdio_clearStats(). The blocks of the *Start() transfers
+ * are counted, their time is not.
+ */
+const sdio_stats_t *sd_sdio_stats(sd_card_t *sd_card_p);
+void sd_sdio_clearStats(sd_card_t *sd_card_p);
 /** CMD6 Switch mode: Check Function Set Function.
  * \param[in] arg CMD6 argument.
  * \param[out] status return status data.
@@ -209,6 +221,58 @@ bool sd_sdio_writeStart(sd_card_t *sd_card_p, uint32_t sector, uint32_t count);
  */
 bool sd_sdio_writeStop(sd_card_t *sd_card_p);
 
+/** Start reading multiple 512 byte sectors and return while the DMA
+ * transfers them, so that the caller can work on the previous data.
+ *
+ * \param[in] sector Logical sector to be read.
+ * \param[in] ns Number of sectors to be read.
+ * \param[out] dst Word aligned location that will receive the data.
+ * \param[in] cb Called once from the DMA IRQ when the data has arrived,
+ * or NULL. It must not call the driver, only signal the caller.
+ * \param[in] arg Passed to cb.
+ * \note Any other transfer waits for it to finish first. The result is
+ * returned by waitPending(), the data is valid after it.
+ *
+ * \return true if the transfer was started.
+ */
+bool sd_sdio_readSectorsStart(sd_card_t *sd_card_p, uint32_t sector, uint8_t *dst, size_t ns,
+                              sdio_callback_t cb, void *arg);
+/** Start writing multiple 512 byte sectors and return while the DMA
+ * transfers them. Consecutive writes continue the same multiple block
+ * write, like writeSectors().
+ *
+ * \param[in] sector Logical sector to be written.
+ * \param[in] ns Number of sectors to be written.
+ * \param[in] src Word aligned data, which must not change until the
+ * transfer is done.
+ * \param[in] cb Called once from the DMA IRQ when the card took the
+ * data or failed, or NULL. It must not call the driver.
+ * \param[in] arg Passed to cb.
+ *
+ * \return true if the transfer was started.
+ */
+bool sd_sdio_writeSectorsStart(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *src, size_t ns,
+                               sdio_callback_t cb, void *arg);
+/** Poll a transfer started with readSectorsStart() or writeSectorsStart().
+ *
+ * \return true while its data is still moving, waitPending() would
+ * wait then.
+ */
+bool sd_sdio_pendingBusy(sd_card_t *sd_card_p);
+/** Wait for the transfer started with readSectorsStart() or
+ * writeSectorsStart().
+ *
+ * \return false if it failed, also when another transfer waited for it.
+ */
+bool sd_sdio_waitPending(sd_card_t *sd_card_p);
+
+/** Stop a multiple block write left open by writeSector() and
+ * writeSectors(), if nothing was written for idle_ms milliseconds.
+ *
+ * \return true for success or false for failure.
+ */
+bool sd_sdio_closeIdle(sd_card_t *sd_card_p, uint32_t idle_ms);
+
 void sd_sdio_ctor(sd_card_t *sd_card_p);
 
 #endif  // sd_sdio_h
@@ -161,6 +161,7 @@ static void sdio_send_command(const sd_card_t *sd_card_p, uint8_t command, uint3
     word1 |= crc << 8;
     
     // Transmit command
+    STATE.stats.commands++;
     pio_sm_clear_fifos(SDIO_PIO, SDIO_CMD_SM);
     pio_sm_put(SDIO_PIO, SDIO_CMD_SM, word0);
     pio_sm_put(SDIO_PIO, SDIO_CMD_SM, word1);
@@ -403,6 +404,23 @@ sdio_status_t rp2040_sdio_rx_start(sd_card_t *sd_card_p, uint8_t *buffer, uint32
     // This gives more leeway for the DMA block switching
     SDIO_PIO->sm[SDIO_DATA_SM].shiftctrl |= PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS;
 
+    // With a callback the IRQ checks for the end of the transfer
+    if (STATE.pending_cb)
+    {
+        switch (sd_card_p->sdio_if_p->DMA_IRQ_num) {
+            case DMA_IRQ_0:
+                dma_hw->ints0 = 1 << SDIO_DMA_CHB;
+                dma_channel_set_irq0_enabled(SDIO_DMA_CHB, true);
+                break;
+            case DMA_IRQ_1:
+                dma_hw->ints1 = 1 << SDIO_DMA_CHB;
+                dma_channel_set_irq1_enabled(SDIO_DMA_CHB, true);
+                break;
+            default:
+                assert(false);
+        }
+    }
+
     // Start PIO and DMA
     dma_channel_start(SDIO_DMA_CHB);
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, true);
@@ -438,6 +456,33 @@ static void sdio_verify_rx_checksums(sd_card_t *sd_card_p, uint32_t maxcount, si
     }
 }
 
+// Number of DMA control blocks consumed by a reception, it is done
+// when all STATE.total_blocks * 2 + 1 are
+static inline uint32_t sdio_rx_ctrl_blocks(sd_card_t *sd_card_p)
+{
+    return (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&STATE.dma_blocks) /
+        sizeof(STATE.dma_blocks[0]);
+}
+
+bool rp2040_sdio_busy(sd_card_t *sd_card_p)
+{
+    if (STATE.transfer_state == SDIO_RX)
+        return sdio_rx_ctrl_blocks(sd_card_p) < STATE.total_blocks * 2 + 1;
+    return STATE.transfer_state != SDIO_IDLE;
+}
+
+// Call the completion callback once
+static void sdio_notify(sd_card_t *sd_card_p)
+{
+    sdio_callback_t cb = STATE.pending_cb;
+
+    if (cb)
+    {
+        STATE.pending_cb = NULL;
+        cb(sd_card_p, STATE.pending_arg);
+    }
+}
+
 sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
 {
     // Was everything done when the previous rx_poll() finished?
@@ -451,8 +496,7 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
         sdio_verify_rx_checksums(sd_card_p, 4, block_size_words);
 
         // Check how many DMA control blocks have been consumed
-        uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&STATE.dma_blocks);
-        dma_ctrl_block_count /= sizeof(STATE.dma_blocks[0]);
+        uint32_t dma_ctrl_block_count = sdio_rx_ctrl_blocks(sd_card_p);
 
         // Compute how many complete SDIO blocks have been transferred
         // When transfer ends, dma_ctrl_block_count == STATE.total_blocks * 2 + 1
@@ -471,8 +515,8 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
 
         if (STATE.checksum_errors == 0)
             return SDIO_OK;
-        else
-            return SDIO_ERR_DATA_CRC;
+        STATE.stats.rd_crc_errors++;
+        return SDIO_ERR_DATA_CRC;
     }
     else if (millis() - STATE.transfer_start_time >= sd_timeouts.rp2040_sdio_rx_poll)
     {
@@ -482,6 +526,7 @@ sdio_status_t rp2040_sdio_rx_poll(sd_card_t *sd_card_p, size_t block_size_words)
             " TXF: ", (int)pio_sm_get_tx_fifo_level(SDIO_PIO, SDIO_DATA_SM),
             " DMA CNT: ", dma_hw->ch[SDIO_DMA_CH].al2_transfer_count);
         rp2040_sdio_stop(sd_card_p);
+        STATE.stats.timeouts++;
         return SDIO_ERR_DATA_TIMEOUT;
     }
 
@@ -574,6 +619,7 @@ sdio_status_t rp2040_sdio_tx_start(sd_card_t *sd_card_p, const uint8_t *buffer,
     STATE.total_blocks = num_blocks;
     STATE.blocks_checksumed = 0;
     STATE.checksum_errors = 0;
+    STATE.wr_status = SDIO_OK;
 
     // Compute first block checksum
     sdio_compute_next_tx_checksum(sd_card_p);
@@ -627,6 +673,26 @@ static sdio_status_t check_sdio_write_response(uint32_t card_response)
 
 // When a block finishes, this IRQ handler starts the next one
 void sdio_irq_handler(sd_card_t *sd_card_p) {
+    if (STATE.transfer_state == SDIO_RX)
+    {
+        // Only enabled with a callback, the checksums are verified by rx_poll()
+        if (!rp2040_sdio_busy(sd_card_p))
+        {
+            switch (sd_card_p->sdio_if_p->DMA_IRQ_num) {
+            case DMA_IRQ_0:
+                dma_channel_set_irq0_enabled(SDIO_DMA_CHB, false);
+                break;
+            case DMA_IRQ_1:
+                dma_channel_set_irq1_enabled(SDIO_DMA_CHB, false);
+                break;
+            default:
+                break;
+            }
+            sdio_notify(sd_card_p);
+        }
+        return;
+    }
+
     if (STATE.transfer_state == SDIO_TX)
     {
         if (!dma_channel_is_busy(SDIO_DMA_CH) && !dma_channel_is_busy(SDIO_DMA_CHB))
@@ -658,10 +724,13 @@ void sdio_irq_handler(sd_card_t *sd_card_p) {
         if (!dma_channel_is_busy(SDIO_DMA_CHB))
         {
             STATE.wr_status = check_sdio_write_response(STATE.card_response);
+            if (STATE.wr_status == SDIO_ERR_WRITE_CRC)
+                STATE.stats.wr_crc_errors++;
 
             if (STATE.wr_status != SDIO_OK)
             {
                 rp2040_sdio_stop(sd_card_p);
+                sdio_notify(sd_card_p);
                 return;
             }
 
@@ -681,6 +750,7 @@ void sdio_irq_handler(sd_card_t *sd_card_p) {
             else
             {
                 rp2040_sdio_stop(sd_card_p);
+                sdio_notify(sd_card_p);
             }
         }    
     }
@@ -721,6 +791,7 @@ sdio_status_t rp2040_sdio_tx_poll(sd_card_t *sd_card_p, uint32_t *bytes_complete
             dma_hw->ch[SDIO_DMA_CH].al2_transfer_count
         );
         rp2040_sdio_stop(sd_card_p);
+        STATE.stats.timeouts++;
         return SDIO_ERR_DATA_TIMEOUT;
     }
 
@@ -36,6 +36,24 @@ enum sdio_status_t {
 
 typedef enum sdio_transfer_state_t { SDIO_IDLE, SDIO_RX, SDIO_TX, SDIO_TX_WAIT_IDLE} sdio_transfer_state_t;
 
+// Called from the DMA IRQ when the data of a transfer has been moved
+typedef void (*sdio_callback_t)(sd_card_t *sd_card_p, void *arg);
+
+// Counters for finding slow or failing cards, see sd_sdio_stats()
+typedef struct sdio_stats_t {
+    uint32_t commands; // Commands sent
+    uint32_t cmd_errors; // Response timeouts and CRC errors
+    uint32_t rd_blocks; // Blocks read
+    uint32_t wr_blocks; // Blocks written
+    uint64_t rd_us; // Time spent in blocking reads
+    uint64_t wr_us; // Time spent in blocking writes
+    uint32_t rd_crc_errors; // Data CRC errors of reads
+    uint32_t wr_crc_errors; // CRC errors the card reported for writes
+    uint32_t timeouts; // Data timeouts
+    uint32_t retries; // Transfers tried again at a lower clock
+    uint64_t busy_us; // Waiting for the card after multiple block writes
+} sdio_stats_t;
+
 typedef struct sd_sdio_if_state_t {
     bool resources_claimed;
 
@@ -73,6 +91,21 @@ typedef struct sd_sdio_if_state_t {
     // Variables for extended block writes
     bool ongoing_wr_mlt_blk;
     uint32_t wr_mlt_blk_cnt_sector;
+    uint32_t wr_mlt_blk_time; // millis() of the last write
+
+    // Variables for transfers left running by the *Start() functions
+    bool pending_rx;
+    bool pending_tx;
+    bool pending_failed;
+    sdio_callback_t pending_cb; // Called once when the DMA is done
+    void *pending_arg;
+
+    // Variables for the bus clock
+    bool high_speed; // Switched to high speed mode with CMD6
+    float clk_div; // PIO clock divider in use
+    float clk_div_max; // Slowest divider a CRC error falls back to
+
+    sdio_stats_t stats;
     
     // Variables for block reads
     // This is used to perform DMA into data buffers and checksum buffers separately.
@@ -110,6 +143,9 @@ sdio_status_t rp2040_sdio_tx_start(sd_card_t *sd_card_p, const uint8_t *buffer,
 // Check if transmission is complete
 sdio_status_t rp2040_sdio_tx_poll(sd_card_t *sd_card_p, uint32_t *bytes_complete /* = nullptr */);
 
+// Check without side effects if the data of a transfer is still moving
+bool rp2040_sdio_busy(sd_card_t *sd_card_p);
+
 // (Re)initialize the SDIO interface
 bool rp2040_sdio_init(sd_card_t *sd_card_p, float clk_div);
 
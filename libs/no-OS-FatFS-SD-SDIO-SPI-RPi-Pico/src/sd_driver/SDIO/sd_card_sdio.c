@@ -70,6 +70,8 @@ static char const *errstr(sdio_status_t error) {
 static bool logSDError(sd_card_t *sd_card_p, int line)
 {
     STATE.error_line = line;
+    if (STATE.error >= SDIO_ERR_RESPONSE_TIMEOUT && STATE.error <= SDIO_ERR_RESPONSE_CODE)
+        STATE.stats.cmd_errors++;
     EMSG_PRINTF("%s at line %d; error code %d\n", 
         errstr(STATE.error), line, (int)STATE.error);
     return false;
@@ -90,10 +92,120 @@ static float calculate_clk_div(uint baud) {
     return div;
 }
 
+/* Bus clock
+
+    Up to 25 MHz is the default speed of every card, faster needs the
+    high speed mode of CMD6 and up to 50 MHz works, if the wiring allows.
+    So sd_sdio_begin() tries the dividers from the fastest down to the
+    one for 25 MHz, and a CRC error later falls back one step.
+*/
+#define SDIO_DEFAULT_SPEED_HZ (25 * 1000 * 1000)
+#define SDIO_HIGH_SPEED_HZ (50 * 1000 * 1000)
+#define SDIO_CLK_DIV_STEP 0.25f
+#define SDIO_TUNE_SECTORS 8 // Read to test a divider
+#define SDIO_TUNE_ROUNDS 4
+
+// Like calculate_clk_div(), but the PIO can't go faster than div 1
+static float clk_div_for(uint baud) {
+    float div = (float)clock_get_hz(clk_sys) / (CLKDIV * baud);
+    return div < 1 ? 1 : div;
+}
+
+static bool setClkDiv(sd_card_t *sd_card_p, float div)
+{
+    if (!rp2040_sdio_init(sd_card_p, div))
+        return false;
+    STATE.clk_div = div;
+    return true;
+}
+
+// Switch to high speed mode, the card then takes up to 50 MHz
+static bool switchHighSpeed(sd_card_t *sd_card_p)
+{
+    uint32_t status[16];
+    uint8_t *s = (uint8_t *)status;
+
+    // Mode 0 checks if group 1 (access mode) supports function 1
+    if (!sd_sdio_cardCMD6(sd_card_p, 0x00FFFFF1, s) || !(s[13] & 0x02))
+        return false;
+    // Mode 1 switches, group 1 then reports function 1
+    if (!sd_sdio_cardCMD6(sd_card_p, 0x80FFFFF1, s) || (s[16] & 0x0F) != 1)
+        return false;
+    return true;
+}
+
+static uint32_t sectorSum(const uint32_t *p)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < SDIO_WORDS_PER_BLOCK; i++)
+        sum = (sum << 5 | sum >> 27) ^ p[i];
+    return sum;
+}
+
+// Use the fastest divider that reads the first sectors a few times
+// without CRC errors and with the same data as the slowest one
+static bool tuneClock(sd_card_t *sd_card_p, float fastest, float slowest)
+{
+    uint32_t sums[SDIO_TUNE_SECTORS];
+    uint32_t *buf = STATE.dma_buf;
+
+    if (!setClkDiv(sd_card_p, slowest))
+        return false;
+    for (uint32_t i = 0; i < SDIO_TUNE_SECTORS; i++)
+    {
+        if (!sd_sdio_readSectors(sd_card_p, i, (uint8_t *)buf, 1))
+            return false;
+        sums[i] = sectorSum(buf);
+    }
+
+    for (float div = fastest; div < slowest; div += SDIO_CLK_DIV_STEP)
+    {
+        if (!setClkDiv(sd_card_p, div))
+            return false;
+        bool ok = true;
+        for (int r = 0; ok && r < SDIO_TUNE_ROUNDS; r++)
+            for (uint32_t i = 0; ok && i < SDIO_TUNE_SECTORS; i++)
+                ok = sd_sdio_readSectors(sd_card_p, i, (uint8_t *)buf, 1) &&
+                     sectorSum(buf) == sums[i];
+        if (ok)
+        {
+            DBG_PRINTF("SDIO clock divider %f\n", div);
+            return true;
+        }
+        // Make sure the card isn't left sending at the next divider
+        setClkDiv(sd_card_p, slowest);
+        sd_sdio_stopTransmission(sd_card_p, true);
+    }
+    return setClkDiv(sd_card_p, slowest);
+}
+
+// Go one step slower after a CRC error, true if the transfer
+// should be tried again
+static bool clockFallback(sd_card_t *sd_card_p)
+{
+    if (STATE.clk_div >= STATE.clk_div_max)
+        return false;
+    float div = STATE.clk_div + SDIO_CLK_DIV_STEP;
+    if (div > STATE.clk_div_max)
+        div = STATE.clk_div_max;
+    if (STATE.ongoing_wr_mlt_blk)
+        sd_sdio_stopTransmission(sd_card_p, true);
+    if (!setClkDiv(sd_card_p, div))
+        return false;
+    STATE.stats.retries++;
+    EMSG_PRINTF("SDIO CRC error, clock lowered to %lu Hz\n",
+        (unsigned long)sd_sdio_clockHz(sd_card_p));
+    return true;
+}
+
 bool sd_sdio_begin(sd_card_t *sd_card_p)
 {
     uint32_t reply;
     sdio_status_t status;
+
+    // Nothing may be left running when the clock is changed
+    if (STATE.pending_rx || STATE.pending_tx)
+        sd_sdio_waitPending(sd_card_p);
     
     // Initialize at 400 kHz clock speed
     if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(400 * 1000)))
@@ -207,10 +319,44 @@ bool sd_sdio_begin(sd_card_t *sd_card_p)
     // Increase to high clock rate
     if (!sd_card_p->sdio_if_p->baud_rate)
         sd_card_p->sdio_if_p->baud_rate = clock_get_hz(clk_sys) / 12; // Default
-    if (!rp2040_sdio_init(sd_card_p, calculate_clk_div(sd_card_p->sdio_if_p->baud_rate)))
-        return false; 
+    uint baud = sd_card_p->sdio_if_p->baud_rate;
+    STATE.high_speed = false;
+    if (baud <= SDIO_DEFAULT_SPEED_HZ)
+    {
+        STATE.clk_div_max = clk_div_for(baud);
+        return setClkDiv(sd_card_p, STATE.clk_div_max);
+    }
+
+    // Faster needs high speed mode, and the divider is found by trying
+    STATE.high_speed = switchHighSpeed(sd_card_p);
+    if (!STATE.high_speed)
+        baud = SDIO_DEFAULT_SPEED_HZ;
+    else if (baud > SDIO_HIGH_SPEED_HZ)
+        baud = SDIO_HIGH_SPEED_HZ;
+    STATE.clk_div_max = clk_div_for(SDIO_DEFAULT_SPEED_HZ);
+    return tuneClock(sd_card_p, clk_div_for(baud), STATE.clk_div_max);
+}
 
-    return true;
+uint32_t sd_sdio_clockHz(sd_card_t *sd_card_p)
+{
+    if (!STATE.clk_div)
+        return 0;
+    return (uint32_t)(clock_get_hz(clk_sys) / (CLKDIV * STATE.clk_div));
+}
+
+bool sd_sdio_highSpeed(sd_card_t *sd_card_p)
+{
+    return STATE.high_speed;
+}
+
+const sdio_stats_t *sd_sdio_stats(sd_card_t *sd_card_p)
+{
+    return &STATE.stats;
+}
+
+void sd_sdio_clearStats(sd_card_t *sd_card_p)
+{
+    memset(&STATE.stats, 0, sizeof(STATE.stats));
 }
 
 uint8_t sd_sdio_errorCode(sd_card_t *sd_card_p) // const
@@ -268,7 +414,9 @@ bool sd_sdio_stopTransmission(sd_card_t *sd_card_p, bool blocking)
     else
     {
         uint32_t start = millis();
+        uint64_t t0 = time_us_64();
         while (millis() - start < 200 && sd_sdio_isBusy(sd_card_p));
+        STATE.stats.busy_us += time_us_64() - t0;
         if (sd_sdio_isBusy(sd_card_p))
         {
             EMSG_PRINTF("sd_sdio_stopTransmission() timeout\n");
@@ -289,44 +437,150 @@ uint8_t sd_sdio_type(sd_card_t *sd_card_p) // const
         return SDCARD_V2;
 }
 
+/* Transfers left running */
 
-/* Writing and reading */
+// Wait for a transfer left running by sd_sdio_readSectorsStart() or
+// sd_sdio_writeSectorsStart(). Every other transfer calls this first,
+// a failure is remembered for sd_sdio_waitPending().
+static bool finishPending(sd_card_t *sd_card_p)
+{
+    uint32_t bytes_done;
+
+    STATE.pending_cb = NULL;
+    if (STATE.pending_rx) {
+        STATE.pending_rx = false;
+        do {
+            STATE.error = rp2040_sdio_rx_poll(sd_card_p, SDIO_WORDS_PER_BLOCK);
+        } while (STATE.error == SDIO_BUSY);
+        if (STATE.error != SDIO_OK) {
+            EMSG_PRINTF("sd_sdio_readSectorsStart() failed: %s (%d)\n",
+                errstr(STATE.error), (int)STATE.error);
+            sd_sdio_stopTransmission(sd_card_p, true);
+            STATE.pending_failed = true;
+        } else if (!sd_sdio_stopTransmission(sd_card_p, true)) {
+            STATE.pending_failed = true;
+        }
+    } else if (STATE.pending_tx) {
+        STATE.pending_tx = false;
+        do {
+            STATE.error = rp2040_sdio_tx_poll(sd_card_p, &bytes_done);
+        } while (STATE.error == SDIO_BUSY);
+        if (STATE.error != SDIO_OK) {
+            EMSG_PRINTF("sd_sdio_writeSectorsStart() failed: %s (%d)\n",
+                errstr(STATE.error), (int)STATE.error);
+            sd_sdio_stopTransmission(sd_card_p, true);
+            STATE.pending_failed = true;
+        }
+    }
+    return !STATE.pending_failed;
+}
 
-bool sd_sdio_writeSector(sd_card_t *sd_card_p, uint32_t sector, const uint8_t* src)
+bool sd_sdio_waitPending(sd_card_t *sd_card_p)
+{
+    bool ok = finishPending(sd_card_p);
+    STATE.pending_failed = false;
+    return ok;
+}
+
+bool sd_sdio_pendingBusy(sd_card_t *sd_card_p)
+{
+    return (STATE.pending_rx || STATE.pending_tx) && rp2040_sdio_busy(sd_card_p);
+}
+
+bool sd_sdio_readSectorsStart(sd_card_t *sd_card_p, uint32_t sector, uint8_t *dst, size_t n,
+                              sdio_callback_t cb, void *arg)
 {
+    finishPending(sd_card_p);
     if (STATE.ongoing_wr_mlt_blk)
-        // Stop any ongoing write transmission
+        // Stop any ongoing transmission
         if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
 
-    if (((uint32_t)src & 3) != 0) {
-        // Buffer is not aligned, need to memcpy() the data to a temporary buffer.
-        memcpy(STATE.dma_buf, src, sizeof(STATE.dma_buf));
-        src = (uint8_t*)STATE.dma_buf;
-    }
+    // Only the simple case, readSectors() does the others
+    if (((uint32_t)dst & 3) != 0 || n > SDIO_MAX_BLOCKS || sector + n >= sd_card_p->state.sectors)
+        return false;
 
     uint32_t reply;
-    if (/* !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, 16, 512, &reply)) || // SET_BLOCKLEN */
-        !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD24_WRITE_BLOCK, sector, &reply)) || // WRITE_BLOCK
-        !checkReturnOk(rp2040_sdio_tx_start(sd_card_p, src, 1))) // Start transmission
+    STATE.pending_cb = cb;
+    STATE.pending_arg = arg;
+    if (!checkReturnOk(rp2040_sdio_rx_start(sd_card_p, dst, n, SDIO_BLOCK_SIZE)) || // Prepare for reception
+        !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD18_READ_MULTIPLE_BLOCK, sector, &reply))) // READ_MULTIPLE_BLOCK
     {
+        STATE.pending_cb = NULL;
         return false;
     }
+    STATE.pending_rx = true;
+    STATE.stats.rd_blocks += n;
+    return true;
+}
 
-    do {
-        uint32_t bytes_done;
-        STATE.error = rp2040_sdio_tx_poll(sd_card_p, &bytes_done);
-    } while (STATE.error == SDIO_BUSY);
+bool sd_sdio_writeSectorsStart(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *src, size_t n,
+                               sdio_callback_t cb, void *arg)
+{
+    finishPending(sd_card_p);
+    if (((uint32_t)src & 3) != 0 || n > SDIO_MAX_BLOCKS)
+        return false;
 
-    if (STATE.error != SDIO_OK)
-    {
-        EMSG_PRINTF("sd_sdio_writeSector(%lu) failed: %s (%d)\n", 
-            sector, errstr(STATE.error), (int)STATE.error);
+    STATE.pending_cb = cb;
+    STATE.pending_arg = arg;
+
+    if (STATE.ongoing_wr_mlt_blk && sector == STATE.wr_mlt_blk_cnt_sector) {
+        /* Continue a multiblock write */
+        if (!checkReturnOk(rp2040_sdio_tx_start(sd_card_p, src, n)))  // Start transmission
+        {
+            STATE.pending_cb = NULL;
+            return false;
+        }
+    } else {
+        // Stop any previous transmission
+        if (STATE.ongoing_wr_mlt_blk) {
+            if (!sd_sdio_stopTransmission(sd_card_p, true)) {
+                STATE.pending_cb = NULL;
+                return false;
+            }
+        }
+        uint32_t reply;
+        if (!checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD25_WRITE_MULTIPLE_BLOCK, sector, &reply)) ||
+            !checkReturnOk(rp2040_sdio_tx_start(sd_card_p, src, n)))  // Start transmission
+        {
+            STATE.pending_cb = NULL;
+            return false;
+        }
     }
+    STATE.wr_mlt_blk_cnt_sector = sector + n;
+    STATE.wr_mlt_blk_time = millis();
+    STATE.ongoing_wr_mlt_blk = true;
+    STATE.pending_tx = true;
+    STATE.stats.wr_blocks += n;
+    return true;
+}
 
-    return STATE.error == SDIO_OK;
+bool sd_sdio_closeIdle(sd_card_t *sd_card_p, uint32_t idle_ms)
+{
+    if (!STATE.ongoing_wr_mlt_blk || STATE.pending_tx ||
+        millis() - STATE.wr_mlt_blk_time < idle_ms)
+        return true;
+    return sd_sdio_stopTransmission(sd_card_p, true);
+}
+
+/* Writing and reading */
+
+bool sd_sdio_writeSector(sd_card_t *sd_card_p, uint32_t sector, const uint8_t* src)
+{
+    if (((uint32_t)src & 3) != 0) {
+        // Buffer is not aligned, need to memcpy() the data to a temporary buffer.
+        memcpy(STATE.dma_buf, src, sizeof(STATE.dma_buf));
+        src = (uint8_t*)STATE.dma_buf;
+    }
+
+    /* A single sector is written with CMD25 too, so that a write of the
+    next sector continues it instead of paying for another command and
+    busy wait. The transmission is stopped by the next read, a sync, a
+    write elsewhere or sd_sdio_closeIdle(). */
+    return sd_sdio_writeSectors(sd_card_p, sector, src, 1);
 }
 
 bool sd_sdio_writeSectors(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *src, size_t n) {
+    finishPending(sd_card_p);
     if (((uint32_t)src & 3) != 0) {
         // Unaligned write, execute sector-by-sector
         for (size_t i = 0; i < n; i++) {
@@ -364,6 +618,7 @@ bool sd_sdio_writeSectors(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *
         return false;
     } else {
         STATE.wr_mlt_blk_cnt_sector = sector + n;
+        STATE.wr_mlt_blk_time = millis();
         STATE.ongoing_wr_mlt_blk = true;
         return true;
     }
@@ -380,6 +635,7 @@ bool sd_sdio_writeSectors(sd_card_t *sd_card_p, uint32_t sector, const uint8_t *
 
 bool sd_sdio_readSector(sd_card_t *sd_card_p, uint32_t sector, uint8_t* dst)
 {
+    finishPending(sd_card_p);
     if (STATE.ongoing_wr_mlt_blk)
         // Stop any ongoing transmission
         if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
@@ -418,6 +674,7 @@ bool sd_sdio_readSector(sd_card_t *sd_card_p, uint32_t sector, uint8_t* dst)
 
 bool sd_sdio_readSectors(sd_card_t *sd_card_p, uint32_t sector, uint8_t* dst, size_t n)
 {
+    finishPending(sd_card_p);
     if (STATE.ongoing_wr_mlt_blk)
         // Stop any ongoing transmission
         if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
@@ -460,9 +717,41 @@ bool sd_sdio_readSectors(sd_card_t *sd_card_p, uint32_t sector, uint8_t* dst, si
     }
 }
 
+// CMD6 returns a 512 bit (64 byte) status on the DAT bus, like ACMD13
+bool sd_sdio_cardCMD6(sd_card_t *sd_card_p, uint32_t arg, uint8_t *status)
+{
+    uint32_t reply;
+
+    finishPending(sd_card_p);
+    if (STATE.ongoing_wr_mlt_blk)
+        // Stop any ongoing transmission
+        if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
+
+    if (!checkReturnOk(rp2040_sdio_rx_start(sd_card_p, status, 1, 64)) || // Prepare for reception
+        !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD6_SWITCH_FUNC, arg, &reply)))
+    {
+        EMSG_PRINTF("CMD6 failed\n");
+        return false;
+    }
+    do {
+        STATE.error = rp2040_sdio_rx_poll(sd_card_p, 64 / 4);
+    } while (STATE.error == SDIO_BUSY);
+
+    if (STATE.error != SDIO_OK)
+    {
+        EMSG_PRINTF("CMD6 failed: %s (%d)\n", errstr(STATE.error), STATE.error);
+        return false;
+    }
+    return true;
+}
+
 // Get 512 bit (64 byte) SD Status
 bool rp2040_sdio_get_sd_status(sd_card_t *sd_card_p, uint8_t response[64]) {
     uint32_t reply;
+    finishPending(sd_card_p);
+    if (STATE.ongoing_wr_mlt_blk)
+        // Stop any ongoing transmission
+        if (!sd_sdio_stopTransmission(sd_card_p, true)) return false;
     if (!checkReturnOk(rp2040_sdio_rx_start(sd_card_p, response, 1, 64)) || // Prepare for reception
         !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, CMD55_APP_CMD, STATE.rca, &reply)) ||  // APP_CMD
         !checkReturnOk(rp2040_sdio_command_R1(sd_card_p, ACMD13_SD_STATUS, 0, &reply))) // SD Status
@@ -597,10 +886,16 @@ static block_dev_err_t sd_sdio_write_blocks(sd_card_t *sd_card_p, const uint8_t
 
     sd_lock(sd_card_p);
 
-    if (1 == blockCnt)
-        ok = sd_sdio_writeSector(sd_card_p, ulSectorNumber, buffer);
-    else
-        ok = sd_sdio_writeSectors(sd_card_p, ulSectorNumber, buffer, blockCnt);
+    uint64_t t0 = time_us_64();
+    do {
+        if (1 == blockCnt)
+            ok = sd_sdio_writeSector(sd_card_p, ulSectorNumber, buffer);
+        else
+            ok = sd_sdio_writeSectors(sd_card_p, ulSectorNumber, buffer, blockCnt);
+    } while (!ok && STATE.wr_status == SDIO_ERR_WRITE_CRC && clockFallback(sd_card_p));
+    STATE.stats.wr_us += time_us_64() - t0;
+    if (ok)
+        STATE.stats.wr_blocks += blockCnt;
 
     sd_unlock(sd_card_p);
 
@@ -615,10 +910,16 @@ static block_dev_err_t sd_sdio_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer
 
     sd_lock(sd_card_p);
 
-    if (1 == ulSectorCount)
-        ok = sd_sdio_readSector(sd_card_p, ulSectorNumber, buffer);
-    else
-        ok = sd_sdio_readSectors(sd_card_p, ulSectorNumber, buffer, ulSectorCount);
+    uint64_t t0 = time_us_64();
+    do {
+        if (1 == ulSectorCount)
+            ok = sd_sdio_readSector(sd_card_p, ulSectorNumber, buffer);
+        else
+            ok = sd_sdio_readSectors(sd_card_p, ulSectorNumber, buffer, ulSectorCount);
+    } while (!ok && STATE.checksum_errors && clockFallback(sd_card_p));
+    STATE.stats.rd_us += time_us_64() - t0;
+    if (ok)
+        STATE.stats.rd_blocks += ulSectorCount;
 
     sd_unlock(sd_card_p);
 
@@ -630,6 +931,7 @@ static block_dev_err_t sd_sdio_read_blocks(sd_card_t *sd_card_p, uint8_t *buffer
 static block_dev_err_t sd_sync(sd_card_t *sd_card_p) {
     sd_lock(sd_card_p);
     block_dev_err_t err = SD_BLOCK_DEVICE_ERROR_NONE;
+    finishPending(sd_card_p);
     if (STATE.ongoing_wr_mlt_blk)
         if (!sd_sdio_stopTransmission(sd_card_p, true))
             err = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
@@ -30,6 +30,71 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
 
+#include <string.h>
+
+/*-----------------------------------------------------------------------*/
+/* FAT sector cache                                                      */
+/*-----------------------------------------------------------------------*/
+/* FatFs has one window for the FAT and directory sectors of a volume,   */
+/* so following the cluster chains of several large files re-reads the  */
+/* same FAT sectors over and over. Single sector reads from the range    */
+/* given with disk_cache_fat() are kept in a small LRU cache, writes     */
+/* update the cached copies.                                             */
+
+#ifndef FF_FAT_CACHE_SECTORS
+#define FF_FAT_CACHE_SECTORS 0  // Number of FAT sectors kept, 0 = off
+#endif
+
+#if FF_FAT_CACHE_SECTORS > 0
+static struct {
+    BYTE pdrv;
+    LBA_t start, count;  // The FAT, count 0 if not set
+    struct {
+        LBA_t sector;
+        uint32_t used;  // For LRU, 0 if empty
+    } ent[FF_FAT_CACHE_SECTORS];
+    uint32_t clock;
+    uint32_t __attribute__((aligned(4))) buf[FF_FAT_CACHE_SECTORS][FF_MAX_SS / 4];
+} fat_cache;
+
+void disk_cache_fat(BYTE pdrv, LBA_t start, LBA_t count) {
+    fat_cache.pdrv = pdrv;
+    fat_cache.start = start;
+    fat_cache.count = count;
+    memset(fat_cache.ent, 0, sizeof fat_cache.ent);
+    fat_cache.clock = 0;
+}
+
+static bool fat_cached(BYTE pdrv, LBA_t sector) {
+    return fat_cache.count && pdrv == fat_cache.pdrv &&
+           sector >= fat_cache.start && sector - fat_cache.start < fat_cache.count;
+}
+
+static int fat_find(LBA_t sector) {
+    for (int i = 0; i < FF_FAT_CACHE_SECTORS; i++)
+        if (fat_cache.ent[i].used && fat_cache.ent[i].sector == sector)
+            return i;
+    return -1;
+}
+
+static int fat_victim(void) {
+    int v = 0;
+    for (int i = 0; i < FF_FAT_CACHE_SECTORS; i++) {
+        if (!fat_cache.ent[i].used)
+            return i;
+        if (fat_cache.ent[i].used < fat_cache.ent[v].used)
+            v = i;
+    }
+    return v;
+}
+#else
+void disk_cache_fat(BYTE pdrv, LBA_t start, LBA_t count) {
+    (void)pdrv;
+    (void)start;
+    (void)count;
+}
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -99,6 +164,22 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive number to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
+#if FF_FAT_CACHE_SECTORS > 0
+    if (1 == count && fat_cached(pdrv, sector)) {
+        int i = fat_find(sector);
+        if (i < 0) {
+            i = fat_victim();
+            fat_cache.ent[i].used = 0;
+            int rc = sd_card_p->read_blocks(sd_card_p, (uint8_t *)fat_cache.buf[i], sector, 1);
+            if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
+                return sdrc2dresult(rc);
+            fat_cache.ent[i].sector = sector;
+        }
+        fat_cache.ent[i].used = ++fat_cache.clock;
+        memcpy(buff, fat_cache.buf[i], FF_MAX_SS);
+        return RES_OK;
+    }
+#endif
     int rc = sd_card_p->read_blocks(sd_card_p, buff, sector, count);
     return sdrc2dresult(rc);
 }
@@ -118,6 +199,18 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive number to identify the drive */
     sd_card_t *sd_card_p = sd_get_by_num(pdrv);
     if (!sd_card_p) return RES_PARERR;
     int rc = sd_card_p->write_blocks(sd_card_p, buff, sector, count);
+#if FF_FAT_CACHE_SECTORS > 0
+    // Keep the cached copies of the sectors written
+    for (UINT n = 0; n < count; n++) {
+        if (!fat_cached(pdrv, sector + n)) continue;
+        int i = fat_find(sector + n);
+        if (i < 0) continue;
+        if (rc == SD_BLOCK_DEVICE_ERROR_NONE)
+            memcpy(fat_cache.buf[i], buff + n * FF_MAX_SS, FF_MAX_SS);
+        else
+            fat_cache.ent[i].used = 0;
+    }
+#endif
     return sdrc2dresult(rc);
 }
 
@@ -118,6 +118,25 @@
 #define STDIO_MSC_USB_CONNECTION_WITHOUT_DTR 1
 #endif
 
+// PICO_CONFIG: STDIO_MSC_USB_EXTRA_CONSOLES, Number of additional console CDC interfaces, type=int, default=0, min=0, max=2, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_EXTRA_CONSOLES
+#define STDIO_MSC_USB_EXTRA_CONSOLES 0
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES < 0 || STDIO_MSC_USB_EXTRA_CONSOLES > 2
+#error STDIO_MSC_USB_EXTRA_CONSOLES must be 0, 1, or 2
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES && STDIO_MSC_USB_DISABLE_STDIO
+#error STDIO_MSC_USB_EXTRA_CONSOLES requires stdio support
+#endif
+
+// PICO_CONFIG: STDIO_MSC_USB_REMOTE, Add a CDC interface for a remote control channel after the consoles, type=bool, default=0, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_REMOTE
+#define STDIO_MSC_USB_REMOTE 0
+#endif
+#if STDIO_MSC_USB_REMOTE && STDIO_MSC_USB_DISABLE_STDIO
+#error STDIO_MSC_USB_REMOTE requires stdio support
+#endif
+
 // PICO_CONFIG: STDIO_MSC_USB_CONNECTION_WITHOUT_DTR, Disable use of DTR for connection checking meaning connection is assumed to be valid, type=bool, default=0, group=stdio_msc_usb
 #ifndef STDIO_MSC_USB_CONNECTION_WITHOUT_DTR
 #define STDIO_MSC_USB_CONNECTION_WITHOUT_DTR 0
@@ -133,6 +152,34 @@
 #define STDIO_MSC_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK 1
 #endif
 
+// PICO_CONFIG: STDIO_MSC_USB_PIPELINE, Overlap the SDIO transfers with the USB transfers in exclusive mass storage mode, type=bool, default=1, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_PIPELINE
+#define STDIO_MSC_USB_PIPELINE 1
+#endif
+
+// PICO_CONFIG: STDIO_MSC_USB_IMAGE_LUNS, Number of additional read-only LUNs with raw images provided by the application in live mode, type=int, default=0, min=0, max=7, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_IMAGE_LUNS
+#define STDIO_MSC_USB_IMAGE_LUNS 0
+#endif
+#if STDIO_MSC_USB_IMAGE_LUNS < 0 || STDIO_MSC_USB_IMAGE_LUNS > 7
+#error STDIO_MSC_USB_IMAGE_LUNS must be between 0 and 7
+#endif
+
+// PICO_CONFIG: STDIO_MSC_USB_TASK_HOOKS, Call stdio_msc_usb_task_enter() and stdio_msc_usb_task_exit() provided by the application around the background tud_task(), type=bool, default=0, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_TASK_HOOKS
+#define STDIO_MSC_USB_TASK_HOOKS 0
+#endif
+
+// PICO_CONFIG: STDIO_MSC_USB_TASK_CORE1, Let the application run tud_task() on the other core with stdio_msc_usb_task() after stdio_msc_usb_task_core1(true), the background IRQ then only wakes it, type=bool, default=0, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_TASK_CORE1
+#define STDIO_MSC_USB_TASK_CORE1 0
+#endif
+
+// PICO_CONFIG: STDIO_MSC_USB_PIPELINE_BUF, Use the buffer of CFG_TUD_MSC_EP_BUFSIZE bytes returned by stdio_msc_usb_pipeline_buf() provided by the application for the pipelined transfers, it is only used during stdio_msc_usb_do_msc(), type=bool, default=0, group=stdio_msc_usb
+#ifndef STDIO_MSC_USB_PIPELINE_BUF
+#define STDIO_MSC_USB_PIPELINE_BUF 0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -171,6 +218,24 @@ void stdio_msc_usb_enable_irq_tud_task(void);
 void stdio_msc_usb_disable_irq_tud_task(void);
 
 void stdio_msc_usb_do_msc(void);
+void stdio_msc_usb_live_msc(bool on);
+bool stdio_msc_usb_live_active(void);
+bool stdio_msc_usb_try_lock(void);
+void stdio_msc_usb_unlock(void);
+uint32_t stdio_msc_usb_image_blocks(uint8_t n);
+bool stdio_msc_usb_image_read(uint8_t n, uint32_t lba, void *buffer,
+			      uint32_t blockcnt);
+#if STDIO_MSC_USB_TASK_CORE1
+void stdio_msc_usb_task_core1(bool on);
+bool stdio_msc_usb_task(void);
+#endif
+#if STDIO_MSC_USB_PIPELINE && STDIO_MSC_USB_PIPELINE_BUF
+void *stdio_msc_usb_pipeline_buf(void);
+#endif
+#if STDIO_MSC_USB_TASK_HOOKS
+int stdio_msc_usb_task_enter(void);
+void stdio_msc_usb_task_exit(int state);
+#endif
 
 #ifdef __cplusplus
 }
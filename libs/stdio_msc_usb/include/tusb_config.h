@@ -37,10 +37,19 @@
 #define STDIO_MSC_USB_CONSOLE2_ITF 0
 #define STDIO_MSC_USB_PRINTER_ITF 1
 #else
-#define CFG_TUD_CDC             (3)
+#define CFG_TUD_CDC             (3 + STDIO_MSC_USB_EXTRA_CONSOLES + STDIO_MSC_USB_REMOTE)
 #define STDIO_MSC_USB_CONSOLE_ITF 0
 #define STDIO_MSC_USB_CONSOLE2_ITF 1
 #define STDIO_MSC_USB_PRINTER_ITF 2
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+#define STDIO_MSC_USB_CONSOLE3_ITF 3
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+#define STDIO_MSC_USB_CONSOLE4_ITF 4
+#endif
+#if STDIO_MSC_USB_REMOTE
+#define STDIO_MSC_USB_REMOTE_ITF (3 + STDIO_MSC_USB_EXTRA_CONSOLES)
+#endif
 #endif
 
 // CDC FIFO size of TX and RX
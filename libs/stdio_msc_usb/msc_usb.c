@@ -24,10 +24,14 @@
  *
  */
 
+#include "pico.h"
 #include "tusb.h"
 #include "hw_config.h"
 #include "sd_card.h"
 #include "stdio_msc_usb.h"
+#if STDIO_MSC_USB_PIPELINE
+#include "SDIO/SdioCard.h"
+#endif
 
 typedef enum {
 	SCSI_CMD_VERIFY_10		= 0x2f,
@@ -35,30 +39,207 @@ typedef enum {
 } scsi_cmd_type_2_t;
 
 // whether mass storage interface is active
-static bool msc_ejected = true;
+static volatile bool msc_ejected = true;
+// read-only access while the application keeps using the medium
+static volatile bool msc_live;
+#if STDIO_MSC_USB_PIPELINE
+// With SDIO the transfer of the next chunk from or to the card runs
+// while the USB transfers the current one. Reads are started for the
+// chunk following the one read, writes return when they are started
+// and fail with the next write or sync if they didn't succeed.
+static enum { MSC_BUF_IDLE, MSC_BUF_READ, MSC_BUF_WRITE } msc_buf_state;
+#if STDIO_MSC_USB_PIPELINE_BUF
+// the application's buffer, which it doesn't use in exclusive mode
+static uint32_t *msc_buf;
+#else
+static uint32_t __aligned(4) msc_buf[CFG_TUD_MSC_EP_BUFSIZE / 4];
+#endif
+static uint32_t msc_buf_lba;	// first block read ahead into msc_buf
+static bool msc_wr_err;		// a started write failed
+#endif
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+// size of the images the host was told about
+static uint32_t msc_image_blocks[STDIO_MSC_USB_IMAGE_LUNS];
+#endif
+
+#if STDIO_MSC_USB_PIPELINE
+// whether the transfers of the card are overlapped
+static inline bool msc_pipelined(sd_card_t *sd_card_p)
+{
+#if STDIO_MSC_USB_PIPELINE_BUF
+	if (msc_buf == NULL)
+		return false;
+#endif
+	return !msc_live && sd_card_p->type == SD_IF_SDIO;
+}
+
+// Wait for the transfer left running with msc_buf, returns false if
+// it was a read which failed. A failed write is kept in msc_wr_err.
+static bool msc_finish(sd_card_t *sd_card_p)
+{
+	bool ok;
+
+	if (msc_buf_state == MSC_BUF_IDLE)
+		return true;
+
+	sd_lock(sd_card_p);
+	ok = sd_sdio_waitPending(sd_card_p);
+	sd_unlock(sd_card_p);
+	if (msc_buf_state == MSC_BUF_WRITE && !ok) {
+		msc_wr_err = true;
+		ok = true;
+	}
+	msc_buf_state = MSC_BUF_IDLE;
+
+	return ok;
+}
+
+// start reading the chunk at lba into msc_buf
+static void msc_read_ahead(sd_card_t *sd_card_p, uint32_t lba)
+{
+	const uint32_t n = CFG_TUD_MSC_EP_BUFSIZE / 512;
+	bool ok;
+
+	if (lba + n >= sd_card_p->get_num_sectors(sd_card_p))
+		return;
+
+	sd_lock(sd_card_p);
+	ok = sd_sdio_readSectorsStart(sd_card_p, lba, (uint8_t *) msc_buf, n,
+				      NULL, NULL);
+	sd_unlock(sd_card_p);
+	if (ok) {
+		msc_buf_lba = lba;
+		msc_buf_state = MSC_BUF_READ;
+	}
+}
+#endif
+
+// Wait for the running transfers and end an open multiple block write,
+// returns false if a write failed since the last sync.
+static bool msc_sync(void)
+{
+	sd_card_t *sd_card_p = sd_get_by_num(0);
+	bool ok = true;
+
+	if (sd_card_p == NULL || msc_live)
+		return true;
+
+#if STDIO_MSC_USB_PIPELINE
+	msc_finish(sd_card_p);
+	ok = !msc_wr_err;
+	msc_wr_err = false;
+#endif
+	if (sd_card_p->sync(sd_card_p) != SD_BLOCK_DEVICE_ERROR_NONE)
+		ok = false;
+
+	return ok;
+}
 
 void stdio_msc_usb_do_msc(void)
 {
 	stdio_msc_usb_disable_irq_tud_task();
+#if STDIO_MSC_USB_PIPELINE && STDIO_MSC_USB_PIPELINE_BUF
+	msc_buf = stdio_msc_usb_pipeline_buf();
+#endif
 	msc_ejected = false;
 	while (!msc_ejected)
 		tud_task();
+	msc_sync();
+#if STDIO_MSC_USB_PIPELINE && STDIO_MSC_USB_PIPELINE_BUF
+	msc_buf = NULL;
+#endif
 	stdio_msc_usb_enable_irq_tud_task();
 }
 
+// Give the host read-only access from the background task, the
+// application keeps using the medium. The host sees it as it was
+// when it read the sectors and should eject it before it expects
+// to see changes.
+void stdio_msc_usb_live_msc(bool on)
+{
+	msc_live = on;
+	msc_ejected = !on;
+}
+
+bool stdio_msc_usb_live_active(void)
+{
+	return msc_live && !msc_ejected;
+}
+
+// The application provides these to lock out its own accesses to the
+// medium while the host reads it in live mode. They are called from
+// the background task and must not block.
+bool __weak stdio_msc_usb_try_lock(void)
+{
+	return true;
+}
+
+void __weak stdio_msc_usb_unlock(void)
+{
+}
+
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+// The application provides the images for LUN 1 and up with these,
+// an image with 0 blocks is reported as no medium. The read is done
+// with the lock held.
+uint32_t __weak stdio_msc_usb_image_blocks(uint8_t n)
+{
+	(void) n;
+
+	return 0;
+}
+
+bool __weak stdio_msc_usb_image_read(uint8_t n, uint32_t lba, void *buffer,
+				     uint32_t blockcnt)
+{
+	(void) n;
+	(void) lba;
+	(void) buffer;
+	(void) blockcnt;
+
+	return false;
+}
+
+// number of blocks of the image for lun, 0 if there is none
+static uint32_t image_blocks(uint8_t lun)
+{
+	if (msc_ejected || !msc_live)
+		return 0;
+
+	return stdio_msc_usb_image_blocks(lun - 1);
+}
+
+// Invoked to determine the number of LUNs
+uint8_t tud_msc_get_maxlun_cb(void)
+{
+	return 1 + STDIO_MSC_USB_IMAGE_LUNS;
+}
+#endif
+
 // Invoked when received SCSI_CMD_INQUIRY
 // Application fill vendor id, product id and revision with string up
 // to 8, 16, 4 characters respectively
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
 			uint8_t product_id[16], uint8_t product_rev[4])
 {
+#if STDIO_MSC_USB_IMAGE_LUNS == 0
 	(void) lun;
+#endif
 
 	const char vid[] = "Z80pack";
 	const char pid[] = "Mass Storage";
 	const char rev[] = "1.0";
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	char ipid[] = "Disk image A";
+#endif
 
 	memcpy(vendor_id, vid, strlen(vid));
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	if (lun > 0) {
+		ipid[strlen(ipid) - 1] += lun - 1;
+		memcpy(product_id, ipid, strlen(ipid));
+	} else
+#endif
 	memcpy(product_id, pid, strlen(pid));
 	memcpy(product_rev, rev, strlen(rev));
 }
@@ -67,7 +248,27 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
 // return true allowing host to read/write this LUN e.g SD card inserted
 bool tud_msc_test_unit_ready_cb(uint8_t lun)
 {
-	(void) lun;
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	uint32_t blocks;
+
+	if (lun > 0) {
+		// tell the host when the image was changed
+		blocks = image_blocks(lun);
+		if (blocks != msc_image_blocks[lun - 1]) {
+			msc_image_blocks[lun - 1] = blocks;
+			// Additional Sense 28-00 is MEDIUM MAY HAVE CHANGED
+			tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION,
+					  0x28, 0x00);
+			return false;
+		}
+		if (blocks == 0) {
+			tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY,
+					  0x3a, 0x00);
+			return false;
+		}
+		return true;
+	}
+#endif
 
 	if (msc_ejected) {
 		// Additional Sense 3A-00 is NOT_FOUND
@@ -86,7 +287,15 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count,
 {
 	sd_card_t *sd_card_p = sd_get_by_num(0);
 
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	if (lun > 0) {
+		*block_count = image_blocks(lun);
+		*block_size = *block_count ? 512 : 0;
+		return;
+	}
+#else
 	(void) lun;
+#endif
 
 	if (sd_card_p == NULL || msc_ejected) {
 		*block_count = 0;
@@ -103,15 +312,16 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count,
 bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start,
 			   bool load_eject)
 {
-	(void) lun;
 	(void) power_condition;
 
 	if (load_eject) {
 		if (start) {
 			// load disk storage
-		} else {
-			// unload disk storage
+		} else if (lun == 0) {
+			// unload disk storage, the images go with it
+			msc_sync();
 			msc_ejected = true;
+			msc_live = false;
 		}
 	}
 
@@ -139,19 +349,65 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
 	sd_card_t *sd_card_p = sd_get_by_num(0);
 	uint32_t blockcnt;
 	block_dev_err_t rc;
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	uint32_t blocks;
+	bool ok;
+#endif
 
-	(void) lun;
 	(void) offset;
 
+	blockcnt = bufsize / 512;
+
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+	if (lun > 0) {
+		blocks = image_blocks(lun);
+		if (blocks == 0 || lba >= blocks || blockcnt > blocks - lba)
+			return -1;
+		if (!stdio_msc_usb_try_lock()) {
+			tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY,
+					  0x04, 0x01);
+			return -1;
+		}
+		ok = stdio_msc_usb_image_read(lun - 1, lba, buffer, blockcnt);
+		stdio_msc_usb_unlock();
+		return ok ? (int32_t) (blockcnt * 512) : -1;
+	}
+#endif
+
 	if (sd_card_p == NULL || msc_ejected)
 		return -1;
 
 	if (lba >= sd_card_p->get_num_sectors(sd_card_p))
 		return -1;
 
-	blockcnt = bufsize / 512;
-
-	rc = sd_card_p->read_blocks(sd_card_p, buffer, lba, blockcnt);
+	if (msc_live) {
+		// returning 0 would retry at once and never let the
+		// owner of the lock go on, so the host has to retry
+		if (!stdio_msc_usb_try_lock()) {
+			// Additional Sense 04-01 is becoming ready
+			tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY,
+					  0x04, 0x01);
+			return -1;
+		}
+		rc = sd_card_p->read_blocks(sd_card_p, buffer, lba, blockcnt);
+		stdio_msc_usb_unlock();
+#if STDIO_MSC_USB_PIPELINE
+	} else if (msc_pipelined(sd_card_p)) {
+		// take the chunk from the read ahead, if it was this one
+		if (msc_buf_state == MSC_BUF_READ && lba == msc_buf_lba &&
+		    msc_finish(sd_card_p)) {
+			memcpy(buffer, msc_buf, blockcnt * 512);
+			rc = SD_BLOCK_DEVICE_ERROR_NONE;
+		} else {
+			msc_finish(sd_card_p);
+			rc = sd_card_p->read_blocks(sd_card_p, buffer, lba,
+						    blockcnt);
+		}
+		if (rc == SD_BLOCK_DEVICE_ERROR_NONE)
+			msc_read_ahead(sd_card_p, lba + blockcnt);
+#endif
+	} else
+		rc = sd_card_p->read_blocks(sd_card_p, buffer, lba, blockcnt);
 	if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
 		return -1;
 	else
@@ -160,9 +416,11 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
 
 bool tud_msc_is_writable_cb (uint8_t lun)
 {
-	(void) lun;
+	// the images are only ever read
+	if (lun > 0)
+		return false;
 
-	return sd_get_by_num(0) != NULL;
+	return sd_get_by_num(0) != NULL && !msc_live;
 }
 
 // Callback invoked when received WRITE10 command.
@@ -174,17 +432,44 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
 	uint32_t blockcnt;
 	block_dev_err_t rc;
 
-	(void) lun;
 	(void) offset;
 
 	if (sd_card_p == NULL || msc_ejected)
 		return -1;
 
+	if (msc_live || lun > 0) {
+		// Additional Sense 27-00 is WRITE PROTECTED
+		tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+		return -1;
+	}
+
 	if (lba >= sd_card_p->get_num_sectors(sd_card_p))
 		return -1;
 
 	blockcnt = bufsize / 512;
 
+#if STDIO_MSC_USB_PIPELINE
+	if (msc_pipelined(sd_card_p)) {
+		msc_finish(sd_card_p);
+		if (msc_wr_err) {
+			msc_wr_err = false;
+			return -1;
+		}
+		// the USB needs the buffer for the next chunk
+		memcpy(msc_buf, buffer, blockcnt * 512);
+		sd_lock(sd_card_p);
+		if (!sd_sdio_writeSectorsStart(sd_card_p, lba,
+					       (uint8_t *) msc_buf, blockcnt,
+					       NULL, NULL)) {
+			sd_unlock(sd_card_p);
+			return -1;
+		}
+		sd_unlock(sd_card_p);
+		msc_buf_state = MSC_BUF_WRITE;
+		return blockcnt * 512;
+	}
+#endif
+
 	rc = sd_card_p->write_blocks(sd_card_p, buffer, lba, blockcnt);
 	if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
 		return -1;
@@ -217,7 +502,12 @@ int32_t tud_msc_scsi_cb (uint8_t lun, uint8_t const scsi_cmd[16],
 	case SCSI_CMD_SYNCHRONIZE_CACHE_10:
 		if (msc_ejected)
 			resplen = -1;
-		else
+		else if (!msc_sync()) {
+			// Additional Sense 0C-00 is WRITE ERROR
+			tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR,
+					  0x0c, 0x00);
+			resplen = -1;
+		} else
 			resplen = 0;		// report success
 		break;
 
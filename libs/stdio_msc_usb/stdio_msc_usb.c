@@ -36,6 +36,13 @@ static uint8_t low_priority_irq_num;
 
 static volatile bool irq_tud_task_enabled;
 
+#if STDIO_MSC_USB_TASK_CORE1
+// while set the low priority IRQ only flags the work and wakes the other
+// core, which runs tud_task() from stdio_msc_usb_task()
+static volatile bool task_core1;
+static volatile bool task_pending;
+#endif
+
 void stdio_msc_usb_enable_irq_tud_task(void) {
     irq_tud_task_enabled = true;
 }
@@ -69,6 +76,16 @@ static int64_t timer_task(__unused alarm_id_t id, __unused void *user_data) {
 }
 
 static void low_priority_worker_irq(void) {
+#if STDIO_MSC_USB_TASK_CORE1
+    if (task_core1) {
+        task_pending = true;
+        __sev();
+        return;
+    }
+#endif
+#if STDIO_MSC_USB_TASK_HOOKS
+    int hook_state = stdio_msc_usb_task_enter();
+#endif
     if (mutex_try_enter(&stdio_msc_usb_mutex, NULL)) {
         if (irq_tud_task_enabled) {
             tud_task();
@@ -102,12 +119,43 @@ static void low_priority_worker_irq(void) {
             }
         }
     }
+#if STDIO_MSC_USB_TASK_HOOKS
+    stdio_msc_usb_task_exit(hook_state);
+#endif
 }
 
 static void usb_irq(void) {
     irq_set_pending(low_priority_irq_num);
 }
 
+#if STDIO_MSC_USB_TASK_CORE1
+// called on the core which inited, hands tud_task() over to the other
+// core or takes it back, pending the IRQ so no work is lost
+void stdio_msc_usb_task_core1(bool on) {
+    task_core1 = on;
+    if (!on) {
+        irq_set_pending(low_priority_irq_num);
+    }
+}
+
+// called on the other core, returns true if there was work to do
+bool stdio_msc_usb_task(void) {
+    bool pending = task_pending;
+    task_pending = false;
+    if (mutex_try_enter(&stdio_msc_usb_mutex, NULL)) {
+        if (irq_tud_task_enabled) {
+            pending |= tud_task_event_ready();
+            tud_task();
+        }
+        mutex_exit(&stdio_msc_usb_mutex);
+    } else {
+        // the owner runs tud_task() itself, but look again soon
+        pending = true;
+    }
+    return pending;
+}
+#endif
+
 #if !STDIO_MSC_USB_DISABLE_STDIO
 static void stdio_msc_usb_out_chars(const char *buf, int length) {
     static uint64_t last_avail_time;
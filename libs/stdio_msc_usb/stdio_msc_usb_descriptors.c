@@ -60,9 +60,9 @@
 #endif
 #else // !STDIO_MSC_USB_DISABLE_STDIO
 #if !STDIO_MSC_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + 3 * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + (3 + STDIO_MSC_USB_EXTRA_CONSOLES + STDIO_MSC_USB_REMOTE) * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
 #else
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + 3 * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN + TUD_RPI_RESET_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + (3 + STDIO_MSC_USB_EXTRA_CONSOLES + STDIO_MSC_USB_REMOTE) * TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN + TUD_RPI_RESET_DESC_LEN)
 #endif
 #endif // !STDIO_MSC_USB_DISABLE_STDIO
 #if !STDIO_MSC_USB_DEVICE_SELF_POWERED
@@ -106,11 +106,17 @@
 #define USBD_ITF_CDC_CONSOLE2 (2) // needs 2 interfaces
 #define USBD_ITF_CDC_PRINTER (4) // needs 2 interfaces
 #define USBD_ITF_MSC       (6)
+// the extra consoles follow the MSC, so that its number doesn't change
+#define USBD_ITF_CDC_CONSOLE3 (7) // needs 2 interfaces
+#define USBD_ITF_CDC_CONSOLE4 (9) // needs 2 interfaces
+// and the remote control channel follows them
+#define USBD_ITF_CDC_REMOTE (7 + 2 * STDIO_MSC_USB_EXTRA_CONSOLES) // needs 2 interfaces
+#define USBD_ITF_EXTRA     (2 * (STDIO_MSC_USB_EXTRA_CONSOLES + STDIO_MSC_USB_REMOTE))
 #if !STDIO_MSC_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
-#define USBD_ITF_MAX       (7)
+#define USBD_ITF_MAX       (7 + USBD_ITF_EXTRA)
 #else
-#define USBD_ITF_RPI_RESET (7)
-#define USBD_ITF_MAX       (8)
+#define USBD_ITF_RPI_RESET (7 + USBD_ITF_EXTRA)
+#define USBD_ITF_MAX       (8 + USBD_ITF_EXTRA)
 #endif
 
 #define USBD_CDC_CONSOLE_EP_CMD (0x81)
@@ -128,6 +134,18 @@
 #define USBD_MSC_EP_OUT (0x07)
 #define USBD_MSC_EP_IN (0x87)
 
+#define USBD_CDC_CONSOLE3_EP_CMD (0x88)
+#define USBD_CDC_CONSOLE3_EP_OUT (0x09)
+#define USBD_CDC_CONSOLE3_EP_IN (0x89)
+
+#define USBD_CDC_CONSOLE4_EP_CMD (0x8a)
+#define USBD_CDC_CONSOLE4_EP_OUT (0x0b)
+#define USBD_CDC_CONSOLE4_EP_IN (0x8b)
+
+#define USBD_CDC_REMOTE_EP_CMD (0x8c)
+#define USBD_CDC_REMOTE_EP_OUT (0x0d)
+#define USBD_CDC_REMOTE_EP_IN (0x8d)
+
 #define USBD_STR_CDC_CONSOLE (0x04)
 #define USBD_STR_CDC_CONSOLE2 (0x05)
 #define USBD_STR_CDC_PRINTER (0x06)
@@ -135,6 +153,9 @@
 #if STDIO_MSC_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
 #define USBD_STR_RPI_RESET (0x08)
 #endif
+#define USBD_STR_CDC_CONSOLE3 (0x09)
+#define USBD_STR_CDC_CONSOLE4 (0x0a)
+#define USBD_STR_CDC_REMOTE (0x0b)
 #endif // !STDIO_MSC_USB_DISABLE_STDIO
 
 #define USBD_CDC_CMD_MAX_SIZE (8)
@@ -196,6 +217,21 @@ static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
     TUD_MSC_DESCRIPTOR(USBD_ITF_MSC, USBD_STR_MSC, USBD_MSC_EP_OUT,
         USBD_MSC_EP_IN, USBD_MSC_IN_OUT_MAX_SIZE),
 
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_CONSOLE3, USBD_STR_CDC_CONSOLE3, USBD_CDC_CONSOLE3_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_CONSOLE3_EP_OUT, USBD_CDC_CONSOLE3_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+#endif
+
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_CONSOLE4, USBD_STR_CDC_CONSOLE4, USBD_CDC_CONSOLE4_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_CONSOLE4_EP_OUT, USBD_CDC_CONSOLE4_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+#endif
+
+#if STDIO_MSC_USB_REMOTE
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_REMOTE, USBD_STR_CDC_REMOTE, USBD_CDC_REMOTE_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_REMOTE_EP_OUT, USBD_CDC_REMOTE_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+#endif
+
 #if STDIO_MSC_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
     TUD_RPI_RESET_DESCRIPTOR(USBD_ITF_RPI_RESET, USBD_STR_RPI_RESET)
 #endif
@@ -216,6 +252,15 @@ static const char *const usbd_desc_str[] = {
 #if STDIO_MSC_USB_ENABLE_RESET_VIA_VENDOR_INTERFACE
     [USBD_STR_RPI_RESET] = "Reset",
 #endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+    [USBD_STR_CDC_CONSOLE3] = "Console 3",
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+    [USBD_STR_CDC_CONSOLE4] = "Console 4",
+#endif
+#if STDIO_MSC_USB_REMOTE
+    [USBD_STR_CDC_REMOTE] = "Remote",
+#endif
 };
 
 const uint8_t *tud_descriptor_device_cb(void) {
@@ -4,14 +4,24 @@
 ;	on all our CPU's
 ;
 ;	Copyright (C) 2024 by Udo Munk
+;
+;	History:
+;	14-OCT-2026 direct load of systems with a header in the boot sector
 ;
 	ORG	0FF00H		;ROM in upper most memory page
 ;
 ;	I/O ports
 ;
 FDC	EQU	4		;FDC port
+XFDC	EQU	9		;extended FDC port, multi sector transfers
 ;
 FDCMD	EQU	0F000H		;command bytes for the FDC
+;
+;	direct load header at the end of the boot sector
+;
+HDMAG	EQU	0076H		;magic 'DL'
+HDENT	EQU	0078H		;entry of the loaded system
+HDCMD	EQU	007AH		;command bytes for the extended FDC
 ;
 	DI			;disable interrupts
 ;
@@ -33,10 +43,38 @@ FDCMD	EQU	0F000H		;command bytes for the FDC
 	OUT	(FDC),A
 	IN	A,(FDC)		;get FDC result
 	OR	A		;zero ?
-	JP	Z,0		;if yes jump to boot code loaded @ 0
+	JP	Z,DIRECT	;if yes look for a direct load header
 ;
 	CP	2		;some problem, lets see, no disk in drive?
 	JP	Z,0		;yes, so hopefully they loaded some code
 	HALT			;if not there is some serious problem
+;
+;	with a header load the whole system with one command of the
+;	extended FDC, else run the boot code loaded @ 0
+;
+DIRECT:	LD	HL,(HDMAG)	;check magic
+	LD	A,L
+	CP	'D'
+	JP	NZ,0		;no header, run the boot code
+	LD	A,H
+	CP	'L'
+	JP	NZ,0
+;
+	LD	A,10H		;setup command for extended FDC
+	OUT	(XFDC),A
+	LD	A,HDCMD AND 0FFH
+	OUT	(XFDC),A
+	LD	A,HDCMD SHR 8
+	OUT	(XFDC),A
+;
+	LD	A,20H		;read the system from drive 0
+	OUT	(XFDC),A
+	IN	A,(XFDC)	;get FDC result
+	OR	A		;zero ?
+	JP	NZ,0		;no, let the boot code try it
+;
+	LD	SP,00FFH	;stack like the boot code
+	LD	HL,(HDENT)	;and jump to the entry of the system
+	JP	(HL)
 ;
 	END			;of ROM
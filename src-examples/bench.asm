@@ -0,0 +1,678 @@
+;
+; Example program for the Pico Z80
+; Classic compute benchmarks for the 8080 and Z80, timed with the
+; cycle and time counter at I/O port 68. An OUT latches the T-states
+; and the microseconds since power on, the next sixteen INs return
+; them, 8 bytes each, low byte first.
+;
+; For every kernel the T-states, the microseconds, the emulated clock
+; and the passes per second are printed, for comparing firmware builds
+; and settings with a stable yardstick:
+;	Sieve	the BYTE sieve of Eratosthenes with 8191 flags, 1899 primes
+;	Intmix	a Dhrystone-like mix of calls, multiply, divide, records
+;		and strings
+;	Move	4096 byte block move, with LDIR on a Z80
+;	BCD	8 digit BCD additions with DAA
+;
+; Udo Munk & Thomas Eberhardt, October 2026
+;
+
+	IFNDEF	ONCPM
+ONCPM	EQU	1	;1 = RUNS ON CPM, 0 = BARE EMULATOR/MACHINE
+	ENDIF
+
+	IF	ONCPM
+	ORG	0100H
+	ELSE
+	ORG	0000H
+	ENDIF
+
+BDOS	EQU	5		; BDOS entry of CP/M
+TTYSTA	EQU	0		; tty status port (bare)
+TTYDAT	EQU	1		; tty data port (bare)
+CYCCTR	EQU	68		; cycle and time counter port
+CR	EQU	13
+LF	EQU	10
+
+SIZE	EQU	8191		; flags of the sieve
+MOVSZ	EQU	4096		; bytes of the block move
+
+NSIEVE	EQU	10		; passes of the kernels
+NMIX	EQU	5000
+NMOVE	EQU	50
+NBCD	EQU	50000
+
+	LXI	SP,STACK
+	LXI	H,HELLO
+	CALL	MSG
+	XRA	A		; find the CPU, DCR A gives an odd
+	DCR	A		; parity on the 8080, an overflow
+	JPE	IS8080		; on the Z80
+	MVI	A,1
+	STA	ISZ80
+	LXI	H,SZ80
+	JMP	CPUMSG
+IS8080:	LXI	H,S8080
+CPUMSG:	CALL	MSG
+
+	LXI	H,KSIEVE	; run the kernels
+	CALL	RUN
+	LXI	H,KMIX
+	CALL	RUN
+	LXI	H,KMOVE
+	CALL	RUN
+	LXI	H,KBCD
+	CALL	RUN
+
+	LXI	H,SPRIME	; check the results
+	CALL	MSG
+	LHLD	COUNT
+	SHLD	DVD
+	LXI	H,0
+	SHLD	DVD+2
+	CALL	PRDEC
+	LXI	H,SBCDR
+	CALL	MSG
+	LXI	H,NUM1+3	; the BCD sum, high byte first
+	MVI	B,4
+PRBCD:	MOV	A,M
+	CALL	PRHEX
+	DCX	H
+	DCR	B
+	JNZ	PRBCD
+	CALL	CRLF
+
+	IF	ONCPM
+	JMP	0
+	ELSE
+	HLT
+	ENDIF
+
+;
+; run the kernel of the table at HL: address of the code, of the
+; name and the passes * 1000 as 32 bit number
+;
+RUN:	MOV	E,M		; get the code address
+	INX	H
+	MOV	D,M
+	INX	H
+	XCHG
+	SHLD	KADDR
+	XCHG
+	MOV	E,M		; get the name
+	INX	H
+	MOV	D,M
+	INX	H
+	PUSH	H
+	XCHG
+	CALL	MSG
+	POP	H
+	LXI	D,KPASS		; get the passes * 1000
+	CALL	CPY4
+
+	LXI	H,CTR0		; time the kernel
+	CALL	RDCTR
+	CALL	KCALL
+	LXI	H,CTR1
+	CALL	RDCTR
+	LXI	D,CTR1		; T-states
+	LXI	H,CTR0
+	CALL	SUB32
+	LXI	D,CTR1+4	; microseconds
+	LXI	H,CTR0+4
+	CALL	SUB32
+
+	LXI	H,CTR1		; print the T-states
+	LXI	D,DVD
+	CALL	CPY4
+	CALL	PRDEC
+	LXI	H,STST
+	CALL	MSG
+	LXI	H,CTR1+4	; and the microseconds
+	LXI	D,DVD
+	CALL	CPY4
+	CALL	PRDEC
+	LXI	H,SUS
+	CALL	MSG
+
+	LXI	H,CTR1+4	; clock * 100 = T-states / (us / 100)
+	LXI	D,DVD
+	CALL	CPY4
+	LXI	H,100
+	CALL	DIVW
+	CALL	DVDDVS
+	JZ	RUN1		; too short
+	LXI	H,CTR1
+	LXI	D,DVD
+	CALL	CPY4
+	CALL	DIV32
+	CALL	PRFIX
+	LXI	H,SMHZ
+	CALL	MSG
+
+	LXI	H,CTR1+4	; passes / s = passes * 1000 / (us / 1000)
+	LXI	D,DVD
+	CALL	CPY4
+	LXI	H,1000
+	CALL	DIVW
+	CALL	DVDDVS
+	JZ	RUN1
+	LXI	H,KPASS
+	LXI	D,DVD
+	CALL	CPY4
+	CALL	DIV32
+	CALL	PRDEC
+	LXI	H,SPASS
+	CALL	MSG
+RUN1:	JMP	CRLF
+
+KCALL:	LHLD	KADDR		; call the kernel, it returns to RUN
+	PCHL
+
+;
+; latch the counters and store the low 32 bits of the T-states and
+; the microseconds at HL
+;
+RDCTR:	OUT	CYCCTR
+	MVI	B,4		; T-states, low 32 bits
+RDC1:	IN	CYCCTR
+	MOV	M,A
+	INX	H
+	DCR	B
+	JNZ	RDC1
+	MVI	B,4		; skip the high 32 bits
+RDC2:	IN	CYCCTR
+	DCR	B
+	JNZ	RDC2
+	MVI	B,4		; microseconds, low 32 bits
+RDC3:	IN	CYCCTR
+	MOV	M,A
+	INX	H
+	DCR	B
+	JNZ	RDC3
+	MVI	B,4		; skip the high 32 bits
+RDC4:	IN	CYCCTR
+	DCR	B
+	JNZ	RDC4
+	RET
+
+;
+; 32 bit arithmetic on numbers in memory, low byte first
+;
+; (DE) = (DE) - (HL), CY = borrow
+SUB32:	MVI	C,4
+	ORA	A
+SUB1:	LDAX	D
+	SBB	M
+	STAX	D
+	INX	D
+	INX	H
+	DCR	C
+	JNZ	SUB1
+	RET
+
+; copy 4 bytes from (HL) to (DE)
+CPY4:	MVI	C,4
+CPY1:	MOV	A,M
+	STAX	D
+	INX	D
+	INX	H
+	DCR	C
+	JNZ	CPY1
+	RET
+
+; rotate (HL) left through CY
+RAL32:	MVI	C,4
+RAL1:	MOV	A,M
+	RAL
+	MOV	M,A
+	INX	H
+	DCR	C
+	JNZ	RAL1
+	RET
+
+; DVD = DVD / DVS, REM = DVD % DVS
+DIV32:	LXI	H,0
+	SHLD	REM
+	SHLD	REM+2
+	MVI	B,32
+DIV1:	ORA	A		; shift the next bit of DVD into REM
+	LXI	H,DVD
+	CALL	RAL32
+	LXI	H,REM
+	CALL	RAL32
+	LXI	H,REM		; try REM - DVS
+	LXI	D,TMP
+	CALL	CPY4
+	LXI	D,TMP
+	LXI	H,DVS
+	CALL	SUB32
+	JC	DIV2		; doesn't fit
+	LXI	H,TMP
+	LXI	D,REM
+	CALL	CPY4
+	LDA	DVD		; quotient bit is 1
+	ORI	1
+	STA	DVD
+DIV2:	DCR	B
+	JNZ	DIV1
+	RET
+
+; DVD = DVD / HL
+DIVW:	SHLD	DVS
+	LXI	H,0
+	SHLD	DVS+2
+	JMP	DIV32
+
+; DVS = DVD, Z set if it is 0
+DVDDVS:	LXI	H,DVD
+	LXI	D,DVS
+	CALL	CPY4
+	LHLD	DVS
+	MOV	A,H
+	ORA	L
+	LHLD	DVS+2
+	ORA	H
+	ORA	L
+	RET
+
+; print DVD in decimal
+PRDEC:	MVI	A,0
+	STA	NDIG
+PRD1:	LXI	H,10		; next digit from the right
+	CALL	DIVW
+	LDA	REM
+	PUSH	PSW
+	LDA	NDIG
+	INR	A
+	STA	NDIG
+	LHLD	DVD
+	MOV	A,H
+	ORA	L
+	LHLD	DVD+2
+	ORA	H
+	ORA	L
+	JNZ	PRD1
+PRD2:	POP	PSW		; print them from the left
+	ADI	'0'
+	CALL	OUTCH
+	LDA	NDIG
+	DCR	A
+	STA	NDIG
+	JNZ	PRD2
+	RET
+
+; print DVD / 100 with two decimals
+PRFIX:	LXI	H,100
+	CALL	DIVW
+	LDA	REM
+	PUSH	PSW
+	CALL	PRDEC
+	MVI	A,'.'
+	CALL	OUTCH
+	POP	PSW
+	MVI	B,'0'-1		; tens
+PRF1:	INR	B
+	SUI	10
+	JNC	PRF1
+	ADI	10+'0'
+	PUSH	PSW
+	MOV	A,B
+	CALL	OUTCH
+	POP	PSW
+	JMP	OUTCH
+
+; print A in hex
+PRHEX:	PUSH	PSW
+	RRC
+	RRC
+	RRC
+	RRC
+	CALL	PRNIB
+	POP	PSW
+PRNIB:	ANI	0FH
+	ADI	'0'
+	CPI	'9'+1
+	JC	OUTCH
+	ADI	'A'-'9'-1
+	JMP	OUTCH
+
+;
+; console output
+;
+CRLF:	MVI	A,CR
+	CALL	OUTCH
+	MVI	A,LF
+	JMP	OUTCH
+
+; print the string at HL, terminated by 0
+MSG:	MOV	A,M
+	ORA	A
+	RZ
+	CALL	OUTCH
+	INX	H
+	JMP	MSG
+
+; output the character in A
+OUTCH:	PUSH	PSW
+	PUSH	B
+	PUSH	D
+	PUSH	H
+	IF	ONCPM
+	MOV	E,A
+	MVI	C,2
+	CALL	BDOS
+	ELSE
+	MOV	C,A
+OUTCH1:	IN	TTYSTA		; wait until the tty is ready
+	RLC
+	JC	OUTCH1
+	MOV	A,C
+	OUT	TTYDAT
+	ENDIF
+	POP	H
+	POP	D
+	POP	B
+	POP	PSW
+	RET
+
+;
+; the kernels
+;
+KSIEVE:	DW	SIEVE,SSIEVE,NSIEVE*1000 AND 0FFFFH,0
+KMIX:	DW	INTMIX,SMIX,4B40H,004CH		; NMIX * 1000
+KMOVE:	DW	MOVE,SMOVE,NMOVE*1000 AND 0FFFFH,0
+KBCD:	DW	BCD,SBCD,0F080H,02FAH		; NBCD * 1000
+
+;
+; sieve of Eratosthenes, the count of primes is left in COUNT
+;
+SIEVE:	MVI	A,NSIEVE
+	STA	PASSC
+SV0:	LXI	H,FLAGS		; all flags true
+	LXI	B,SIZE
+SV1:	MVI	M,1
+	INX	H
+	DCX	B
+	MOV	A,B
+	ORA	C
+	JNZ	SV1
+	LXI	H,0
+	SHLD	COUNT
+	LXI	B,0		; BC = i
+SV2:	LXI	H,FLAGS
+	DAD	B
+	MOV	A,M
+	ORA	A
+	JZ	SV5
+	MOV	H,B		; DE = prime = i + i + 3
+	MOV	L,C
+	DAD	H
+	INX	H
+	INX	H
+	INX	H
+	XCHG
+	MOV	H,B		; HL = address of flag i + prime
+	MOV	L,C
+	DAD	D
+	PUSH	D
+	LXI	D,FLAGS
+	DAD	D
+	POP	D
+SV3:	MOV	A,L		; while below the end clear the flags
+	SUI	FLAGSE AND 0FFH
+	MOV	A,H
+	SBI	FLAGSE SHR 8
+	JNC	SV4
+	MVI	M,0
+	DAD	D
+	JMP	SV3
+SV4:	LHLD	COUNT
+	INX	H
+	SHLD	COUNT
+SV5:	INX	B
+	MOV	A,C
+	CPI	SIZE AND 0FFH
+	JNZ	SV2
+	MOV	A,B
+	CPI	SIZE SHR 8
+	JNZ	SV2
+	LDA	PASSC
+	DCR	A
+	STA	PASSC
+	JNZ	SV0
+	RET
+
+;
+; Dhrystone-like integer mix: a record is updated through a pointer
+; by a chain of procedures, a number is multiplied and divided, and
+; a string is copied and compared
+;
+INTMIX:	LXI	H,NMIX
+	SHLD	PASSW
+MIX1:	LXI	H,REC		; Proc1: update the record
+	CALL	PROC1
+	LHLD	PASSW		; multiply the pass by 13
+	XCHG
+	LXI	B,13
+	CALL	MUL16
+	LXI	B,7		; and divide it by 7
+	CALL	DIV16
+	SHLD	MIXRES
+	LXI	H,STR1		; copy and compare the strings
+	LXI	D,STR2
+	CALL	STRCPY
+	LXI	H,STR1
+	LXI	D,STR2
+	CALL	STRCMP
+	JNZ	MIX2
+	LHLD	MIXEQ		; count the equal strings
+	INX	H
+	SHLD	MIXEQ
+MIX2:	LHLD	PASSW
+	DCX	H
+	SHLD	PASSW
+	MOV	A,H
+	ORA	L
+	JNZ	MIX1
+	RET
+
+; record at HL: int comp, int value, byte enum
+PROC1:	PUSH	H
+	CALL	PROC2
+	POP	H
+	MOV	A,M		; comp = comp + value
+	INX	H
+	INX	H
+	ADD	M
+	DCX	H
+	DCX	H
+	MOV	M,A
+	INX	H
+	MOV	A,M
+	INX	H
+	INX	H
+	ADC	M
+	DCX	H
+	DCX	H
+	MOV	M,A
+	RET
+
+PROC2:	INX	H		; value = value + 1
+	INX	H
+	INR	M
+	JNZ	PROC3
+	INX	H
+	INR	M
+	DCX	H
+PROC3:	INX	H		; enum = enum + 1 mod 5
+	INX	H
+	MOV	A,M
+	INR	A
+	CPI	5
+	JC	PROC4
+	XRA	A
+PROC4:	MOV	M,A
+	RET
+
+; HL = DE * BC
+MUL16:	LXI	H,0
+	MVI	A,16
+MUL1:	DAD	H
+	XCHG
+	DAD	H
+	XCHG
+	JNC	MUL2
+	DAD	B
+MUL2:	DCR	A
+	JNZ	MUL1
+	RET
+
+; HL = HL / BC, DE = HL % BC
+DIV16:	XCHG
+	LXI	H,0
+	MVI	A,16
+DV1:	PUSH	PSW
+	XCHG			; shift the next bit of DE into HL
+	DAD	H
+	XCHG
+	MOV	A,L
+	RAL
+	MOV	L,A
+	MOV	A,H
+	RAL
+	MOV	H,A
+	MOV	A,L		; try HL - BC
+	SUB	C
+	MOV	L,A
+	MOV	A,H
+	SBB	B
+	MOV	H,A
+	JNC	DV2
+	DAD	B		; doesn't fit
+	JMP	DV3
+DV2:	INX	D		; quotient bit is 1
+DV3:	POP	PSW
+	DCR	A
+	JNZ	DV1
+	XCHG
+	RET
+
+; copy the string at HL to DE, terminated by 0
+STRCPY:	MOV	A,M
+	STAX	D
+	INX	H
+	INX	D
+	ORA	A
+	JNZ	STRCPY
+	RET
+
+; compare the strings at HL and DE, Z set if equal
+STRCMP:	LDAX	D
+	CMP	M
+	RNZ
+	ORA	A
+	RZ
+	INX	H
+	INX	D
+	JMP	STRCMP
+
+;
+; block move of MOVSZ bytes from BUF1 to BUF2
+;
+MOVE:	MVI	A,NMOVE
+	STA	PASSC
+MV1:	LXI	H,BUF1
+	LXI	D,BUF2
+	LXI	B,MOVSZ
+	LDA	ISZ80
+	ORA	A
+	JZ	MV2
+	DB	0EDH,0B0H	; LDIR
+	JMP	MV3
+MV2:	MOV	A,M
+	STAX	D
+	INX	H
+	INX	D
+	DCX	B
+	MOV	A,B
+	ORA	C
+	JNZ	MV2
+MV3:	LDA	PASSC
+	DCR	A
+	STA	PASSC
+	JNZ	MV1
+	RET
+
+;
+; 8 digit BCD additions, NUM1 = NUM1 + NUM2
+;
+BCD:	LXI	H,0
+	SHLD	NUM1
+	SHLD	NUM1+2
+	LXI	H,NBCD
+	SHLD	PASSW
+BCD1:	LXI	H,NUM2
+	LXI	D,NUM1
+	MVI	B,4
+	ORA	A
+BCD2:	LDAX	D
+	ADC	M
+	DAA
+	STAX	D
+	INX	H
+	INX	D
+	DCR	B
+	JNZ	BCD2
+	LHLD	PASSW
+	DCX	H
+	SHLD	PASSW
+	MOV	A,H
+	ORA	L
+	JNZ	BCD1
+	RET
+
+HELLO:	DB	'Benchmarks, CPU ',0
+S8080:	DB	'8080',CR,LF,0
+SZ80:	DB	'Z80',CR,LF,0
+SSIEVE:	DB	'Sieve  ',0
+SMIX:	DB	'Intmix ',0
+SMOVE:	DB	'Move   ',0
+SBCD:	DB	'BCD    ',0
+STST:	DB	' T-states ',0
+SUS:	DB	' us ',0
+SMHZ:	DB	' MHz ',0
+SPASS:	DB	' passes/s',0
+SPRIME:	DB	'Primes ',0
+SBCDR:	DB	', BCD sum ',0
+STR1:	DB	'DHRYSTONE PROGRAM, SOME STRING',0
+STR2:	DS	31
+NUM2:	DB	78H,56H,34H,12H	; 12345678
+
+ISZ80:	DB	0		; 1 if the CPU is a Z80
+KADDR:	DS	2		; code of the kernel run
+KPASS:	DS	4		; its passes * 1000
+CTR0:	DS	8		; counters at the start
+CTR1:	DS	8		; and the end, then the differences
+DVD:	DS	4		; dividend and quotient
+DVS:	DS	4		; divisor
+REM:	DS	4		; remainder
+TMP:	DS	4
+NDIG:	DS	1		; digits to print
+PASSC:	DS	1		; pass counters
+PASSW:	DS	2
+COUNT:	DS	2		; primes found
+REC:	DW	0,0,0		; record of the integer mix
+MIXRES:	DS	2
+MIXEQ:	DW	0
+NUM1:	DS	4
+
+	DS	64		; stack
+STACK:
+
+FLAGS:	DS	SIZE
+FLAGSE:
+BUF1:	DS	MOVSZ
+BUF2:	DS	MOVSZ
+
+	END
@@ -3,6 +3,10 @@
 ;
 ;	Copyright (C) 2024-2025 by Udo Munk
 ;
+; History:
+; 14-OCT-2026 4 MB hard disks in drives 2 and 3
+; 14-OCT-2026 register SECTRAN, READ and WRITE as BIOS function traps
+;
 MSIZE	EQU	64		;CP/M memory size in kilobytes
 ;
 ;	"bias" is address offset from 3400H for memory systems
@@ -21,6 +25,8 @@ DDTRK	EQU	0		;offset for track
 DDSEC	EQU	1		;offset for sector
 DDLDMA	EQU	2		;offset for DMA address low
 DDHDMA	EQU	3		;offset for DMA address high
+DSKHD	EQU	1		;disk type 4 MB hard disk
+DSKFDL	EQU	2		;disk type floppy with logical sector order
 ;
 ;	I/O ports
 ;
@@ -31,7 +37,14 @@ TTY3DA	EQU	8		;tty 3 data
 PRTSTA	EQU	5		;printer status port
 PRTDAT	EQU	6		;printer data port
 FDC	EQU	4		;port for the FDC
+XFDC	EQU	9		;port for the extended FDC
+HWCTL	EQU	160		;hardware control port
 LEDS	EQU	0FFH		;frontpanel LED's
+;
+HWUNLK	EQU	0AAH		;unlocks the hardware control port
+TRPSEC	EQU	2		;trap type SECTRAN
+TRPRD	EQU	3		;trap type READ
+TRPWR	EQU	4		;trap type WRITE
 ;
 	ORG	BIOS		;origin of BIOS
 ;
@@ -61,6 +74,16 @@ SIGNON	DB	MSIZE / 10 + '0',MSIZE MOD 10 + '0'
 	DB	'K CP/M 2.2 VERS B03',13,10,0
 BOOTERR	DB	13,10,'BOOT ERROR',13,10,0
 ;
+;	BIOS function traps: unlock, extended command 07H, type,
+;	address and parameter
+TRAPS	DB	HWUNLK,0,7,TRPSEC
+	DW	SECTRAN,0
+	DB	HWUNLK,0,7,TRPRD
+	DW	READ,DSKNO
+	DB	HWUNLK,0,7,TRPWR
+	DW	WRITE,DSKNO
+TRAPSZ	EQU	$-TRAPS
+;
 ;	disk parameter header for disk 0
 DPBASE	DW	TRANS,0000H
 	DW	0000H,0000H
@@ -103,6 +126,19 @@ DPBLK	DW	26		;sectors per track
 	DW	16		;check size
 	DW	2		;track offset
 ;
+;	disk parameter block for 4 MB hard disks, 4 KB blocks
+;	so that the allocation vector fits into high memory
+DPBHD	DW	128		;sectors per track
+	DB	5		;block shift factor
+	DB	31		;block mask
+	DB	1		;extent mask
+	DW	1019		;disk size-1
+	DW	1023		;directory max
+	DB	255		;alloc 0
+	DB	0		;alloc 1
+	DW	0		;check size, fixed disk
+	DW	0		;track offset
+;
 ;	print a message to the console
 ;	pointer to string in hl
 ;
@@ -130,6 +166,67 @@ BOOT	LXI	SP,80H		;use space below buffer for stack
 	OUT	FDC
 	MVI	A,FDCCMD SHR 8
 	OUT	FDC
+;
+;	no sector translation for floppy disks with logical sector
+;	order and hard disks, the disk type stays 0 without the
+;	extended FDC, hard disks are used in drives 2 and 3 only
+;
+	MVI	A,10H		;setup extended FDC command
+	OUT	XFDC
+	MVI	A,FDCCMD AND 0FFH
+	OUT	XFDC
+	MVI	A,FDCCMD SHR 8
+	OUT	XFDC
+	LXI	H,DPBASE	;HL = translation table of disk 0
+	MVI	B,0		;disk 0
+BOOT1	XRA	A		;clear disk type
+	STA	FDCCMD+DDTRK
+	MOV	A,B
+	ORI	50H		;mask in get disk type command
+	OUT	XFDC
+	LDA	FDCCMD+DDTRK	;get disk type
+	CPI	DSKFDL		;logical sector order?
+	JZ	BOOT3		;yes
+	CPI	DSKHD		;hard disk?
+	JNZ	BOOT2		;no
+	MOV	A,B
+	CPI	2		;in drive 2 or 3?
+	JC	BOOT2		;no
+	PUSH	H
+	LXI	D,10		;offset DPB in disk parameter header
+	DAD	D
+	LXI	D,DPBHD		;use hard disk parameter block
+	MOV	M,E
+	INX	H
+	MOV	M,D
+	POP	H
+BOOT3	MVI	M,0		;no translation table
+	INX	H
+	MVI	M,0
+	DCX	H
+BOOT2	LXI	D,16		;next disk parameter header
+	DAD	D
+	INR	B
+	MOV	A,B
+	CPI	4		;all disks done?
+	JC	BOOT1		;no
+;
+;	let the firmware do the disk functions natively, ignored
+;	if it is built without BIOS function traps
+;
+	LXI	H,TRAPS
+	MVI	B,TRAPSZ
+	IN	HWCTL		;hardware control port locked?
+	ORA	A
+	JNZ	BOOT4		;yes, start with the unlock
+	INX	H		;no, skip it
+	DCR	B
+BOOT4	MOV	A,M		;send the trap registrations
+	OUT	HWCTL
+	INX	H
+	DCR	B
+	JNZ	BOOT4
+;
 	STC			;flag for cold start
 	CMC
 	JMP	GOCPM		;initialize and go to CP/M
@@ -431,7 +528,14 @@ WRITE	LDA	DSKNO		;get disk #
 ;	translate the sector given by BC using
 ;	the translation table given by DE
 ;
-SECTRAN	XCHG			;HL=.TRANS
+SECTRAN	MOV	A,D		;do we have a translation table?
+	ORA	E
+	JNZ	SECT1		;yes, translate
+	MOV	L,C		;no, return untranslated
+	MOV	H,B
+	INX	H		;sector no. start with 1
+	RET
+SECT1	XCHG			;HL=.TRANS
 	DAD	B		;HL=.TRANS(SECTOR)
 	XCHG
 	LDAX	D
@@ -451,8 +555,8 @@ DSKNO	DS	1		;selected disk
 DIRBF	DS	128		;scratch directory area
 ALL00	DS	31		;allocation vector 0
 ALL01	DS	31		;allocation vector 1
-ALL02	DS	31		;allocation vector 2
-ALL03	DS	31		;allocation vector 3
+ALL02	DS	128		;allocation vector 2, floppy or hard disk
+ALL03	DS	128		;allocation vector 3, floppy or hard disk
 CHK00	DS	16		;check vector 0
 CHK01	DS	16		;check vector 1
 CHK02	DS	16		;check vector 2
@@ -11,6 +11,11 @@
 ; 09-JUN-2025 implemented second console
 ; 09-JUN-2025 implemented auxiliary device using serial UART
 ; 10-JUN-2025 implemented printer device
+; 14-OCT-2026 no sector translation for disks with logical sector order
+; 14-OCT-2026 directory hashing and data buffers allocated by GENCPM
+; 14-OCT-2026 register MOVE as BIOS function trap
+; 14-OCT-2026 MOVE and XMOVE with the memory DMA device
+; 14-OCT-2026 4 MB hard disks in drive 2 and 3
 ;
 WARM	EQU	0		; BIOS warm start
 BDOS	EQU	5		; BDOS entry
@@ -57,11 +62,20 @@ TTY3S	EQU	07H		; tty 3 status
 PRTDAT	EQU	06H		; printer data port
 PRTSTA	EQU	05H		; printer status port
 FDC	EQU	04H		; FDC
+XFDC	EQU	09H		; extended FDC
 MMUSEL	EQU	40H		; MMU bank select
 CLKCMD	EQU	41H		; RTC command
 CLKDAT	EQU	42H		; RTC data
+MEMDMA	EQU	13H		; memory DMA
+HWCTL	EQU	0A0H		; hardware control
 LEDS	EQU	0FFH		; frontpanel LED's
 ;
+HWUNLK	EQU	0AAH		; unlocks the hardware control port
+TRPMOV	EQU	5		; trap type MOVE
+;
+DSKHD	EQU	1		; disk type 4 MB hard disk
+DSKFDL	EQU	2		; disk type floppy with logical sector order
+;
 ;	external references in SCB
 ;
 	EXTRN	@civec, @covec, @aovec, @aivec, @lovec, @bnkbf
@@ -125,7 +139,9 @@ DRIVES:	DW	DPH0
 	DW	0
 	DW	0
 ;
-;	disk parameter headers for IBM 3740 8" SD disks
+;	disk parameter headers for IBM 3740 8" SD disks, GENCPM allocates
+;	the checksum and allocation vectors, the directory and data buffers
+;	and the hash tables, their number and banks are asked by GENCPM
 ;
 DPH0:	DW	TRANS		; sector translate table
 	DB	0,0,0,0		; BDOS scratch area
@@ -135,8 +151,8 @@ DPH0:	DW	TRANS		; sector translate table
 	DW	0FFFEH		; checksum vector
 	DW	0FFFEH		; allocation vector
 	DW	0FFFEH		; directory buffer control block
-	DW	0FFFFH		; DTABCB not used
-	DW	0FFFFH		; hashing not used
+	DW	0FFFEH		; data buffer control block
+	DW	0FFFEH		; hash table
 	DB	0		; hash bank
 DPH1:	DW	TRANS		; sector translate table
 	DB	0,0,0,0		; BDOS scratch area
@@ -146,8 +162,8 @@ DPH1:	DW	TRANS		; sector translate table
 	DW	0FFFEH		; checksum vector
 	DW	0FFFEH		; allocation vector
 	DW	0FFFEH		; directory buffer control block
-	DW	0FFFFH		; DTABCB not used
-	DW	0FFFFH		; hashing not used
+	DW	0FFFEH		; data buffer control block
+	DW	0FFFEH		; hash table
 	DB	0		; hash bank
 DPH2:	DW	TRANS		; sector translate table
 	DB	0,0,0,0		; BDOS scratch area
@@ -157,8 +173,8 @@ DPH2:	DW	TRANS		; sector translate table
 	DW	0FFFEH		; checksum vector
 	DW	0FFFEH		; allocation vector
 	DW	0FFFEH		; directory buffer control block
-	DW	0FFFFH		; DTABCB not used
-	DW	0FFFFH		; hashing not used
+	DW	0FFFEH		; data buffer control block
+	DW	0FFFEH		; hash table
 	DB	0		; hash bank
 DPH3:	DW	TRANS		; sector translate table
 	DB	0,0,0,0		; BDOS scratch area
@@ -168,8 +184,8 @@ DPH3:	DW	TRANS		; sector translate table
 	DW	0FFFEH		; checksum vector
 	DW	0FFFEH		; allocation vector
 	DW	0FFFEH		; directory buffer control block
-	DW	0FFFFH		; DTABCB not used
-	DW	0FFFFH		; hashing not used
+	DW	0FFFEH		; data buffer control block
+	DW	0FFFEH		; hash table
 	DB	0		; hash bank
 ;
 ;	sector translate table for IBM 3740 8" SD disk
@@ -196,6 +212,21 @@ DPBFD:	DW	26		; sectors per track
 	DW	2		; track offset
 	DB	0,0		; physical sector size and shift
 ;
+;	disk parameter block for the 4 MB hard disk, 255 tracks with
+;	128 sectors of 128 bytes, same layout as the CP/M 2.2 BIOS uses
+;
+DPBHD:	DW	128		; sectors per track
+	DB	5		; block shift factor
+	DB	31		; block mask
+	DB	1		; extend mask
+	DW	1019		; disk size - 1
+	DW	1023		; directory max
+	DB	255		; alloc 0
+	DB	0		; alloc 1
+	DW	8000H		; check size, permanently mounted
+	DW	0		; track offset
+	DB	0,0		; physical sector size and shift
+;
 ;	FDC command bytes
 ;
 CMD:	DS	4
@@ -234,6 +265,9 @@ OPNERR:	DB	'Open error CCP.COM',13,10,'$'
 RDRERR:	DB	'Read error CCP.COM',13,10,'$'
 ;
 BANK:	DB	0		; bank to select for DMA
+MDMA:	DB	0		; memory DMA device available
+MDBNK:	DB	0FFH,0FFH	; source and destination bank of next MOVE
+MDCMD:	DS	8		; memory DMA command bytes
 SDISK:	DB	0		; selected disk
 ;
 	DS	32		; small stack
@@ -267,6 +301,75 @@ BOOT:	LXI	SP,STACK
 	OUT	FDC
 	MOV	A,H
 	OUT	FDC
+;
+;	no sector translation for floppy disks with logical sector
+;	order, hard disks in drive 2 and 3 get their own disk parameter
+;	block, the disk type stays 0 without the extended FDC
+;
+	MVI	A,10H		; setup extended FDC command
+	OUT	XFDC
+	LXI	H,CMD
+	MOV	A,L
+	OUT	XFDC
+	MOV	A,H
+	OUT	XFDC
+	LXI	H,DPH0		; HL = translation table of disk 0
+	MVI	B,0		; disk 0
+BOOT3:	XRA	A		; clear disk type
+	STA	DDTRK
+	MOV	A,B
+	ORI	50H		; mask in get disk type command
+	OUT	XFDC
+	LDA	DDTRK		; get disk type
+	CPI	DSKFDL		; logical sector order ?
+	JZ	BOOT7		; yes
+	CPI	DSKHD		; hard disk ?
+	JNZ	BOOT4		; no
+	MOV	A,B
+	CPI	2		; in drive 2 or 3 ?
+	JC	BOOT4		; no
+	CALL	HDDPH		; set up disk parameter header for it
+BOOT7:	MVI	M,0		; no translation table
+	INX	H
+	MVI	M,0
+	DCX	H
+BOOT4:	LXI	D,DPH1-DPH0	; next disk parameter header
+	DAD	D
+	INR	B
+	MOV	A,B
+	CPI	4		; all disks done ?
+	JC	BOOT3		; no
+;
+;	use the memory DMA device, if the port reads 00H
+;
+	IN	MEMDMA		; get memory DMA status
+	ORA	A		; is it there ?
+	JNZ	BOOT6		; no
+	MVI	A,10H		; setup memory DMA command
+	OUT	MEMDMA
+	LXI	H,MDCMD
+	MOV	A,L
+	OUT	MEMDMA
+	MOV	A,H
+	OUT	MEMDMA
+	MVI	A,0FFH
+	STA	MDMA
+;
+;	let the firmware do MOVE natively, ignored if it is built
+;	without BIOS function traps
+;
+BOOT6:	LXI	H,TRAPS
+	MVI	B,TRAPSZ
+	IN	HWCTL		; hardware control port locked ?
+	ORA	A
+	JNZ	BOOT5		; yes, start with the unlock
+	INX	H		; no, skip it
+	DCR	B
+BOOT5:	MOV	A,M		; send the trap registrations
+	OUT	HWCTL
+	INX	H
+	DCR	B
+	JNZ	BOOT5
 ;
 	LXI	H,SIGNON	; print signon
 BOOT1:	MOV	A,M		; get next message bye
@@ -280,6 +383,11 @@ BOOT1:	MOV	A,M		; get next message bye
 	JMP	BOOT1
 ;
 BOOT2:	JMP	WBOOT
+;
+;	unlock, extended command 07H, type, address and parameter
+TRAPS:	DB	HWUNLK,0,7,TRPMOV
+	DW	MVLOOP,0
+TRAPSZ	EQU	$-TRAPS
 ;
 	CSEG
 ;
@@ -590,6 +698,40 @@ DRVTBL:	LXI	H,DRIVES	; return address of disk drive table
 ;
 	DSEG
 ;
+;	set up the disk parameter header in HL for a hard disk in
+;	drive B, the vectors GENCPM allocated are sized for the
+;	floppy disk, so use own allocation vectors, large enough for
+;	double allocation vectors, and no directory hashing
+;
+HDDPH:	PUSH	H
+	LXI	D,12		; offset DPB in disk parameter header
+	DAD	D
+	LXI	D,DPBHD		; use hard disk parameter block
+	MOV	M,E
+	INX	H
+	MOV	M,D
+	INX	H		; skip checksum vector, not used
+	INX	H
+	INX	H
+	LXI	D,ALVHD2	; allocation vector of drive 2
+	MOV	A,B
+	CPI	2		; drive 2 ?
+	JZ	HDDPH1		; yes
+	LXI	D,ALVHD3	; no, allocation vector of drive 3
+HDDPH1:	MOV	M,E
+	INX	H
+	MOV	M,D
+	LXI	D,5		; offset hash table
+	DAD	D
+	MVI	M,0FFH		; no directory hashing
+	INX	H
+	MVI	M,0FFH
+	POP	H
+	RET
+;
+ALVHD2:	DS	256		; hard disk allocation vector drive 2
+ALVHD3:	DS	256		; hard disk allocation vector drive 3
+;
 ;	move to track 0 position of current drive
 ;
 HOME:	MVI	C,0		; select track 0
@@ -715,14 +857,40 @@ FLUSH:	XRA	A		; no user deblocking
 ;	DE = source address
 ;	BC = count
 ;
-MOVE:	LDAX	D
+MOVE:	LDA	MDMA		; memory DMA device available ?
+	ORA	A
+	JZ	MVLOOP		; no, let the CPU move it
+	XCHG
+	SHLD	MDCMD		; source address
+	XCHG
+	SHLD	MDCMD+3		; destination address
+	MOV	L,C
+	MOV	H,B
+	SHLD	MDCMD+6		; count
+	LHLD	MDBNK		; banks set by XMOVE
+	MOV	A,L
+	STA	MDCMD+2		; source bank
+	MOV	A,H
+	STA	MDCMD+5		; destination bank
+	LXI	H,0FFFFH	; next MOVE in the selected bank again
+	SHLD	MDBNK
+	MVI	A,20H		; move the block
+	OUT	MEMDMA
+	LHLD	MDCMD		; DE = source + count
+	DAD	B
+	XCHG
+	LHLD	MDCMD+3		; HL = destination + count
+	DAD	B
+	RET
+;
+MVLOOP:	LDAX	D
 	MOV	M,A
 	INX	D
 	INX	H
 	DCX	B
 	MOV	A,B
 	ORA	C
-	JNZ	MOVE
+	JNZ	MVLOOP
 	RET
 ;
 ;	select memory bank
@@ -737,7 +905,10 @@ SETBNK:	STA	BANK
 ;
 ;	set banks for following MOVE
 ;
-XMOVE: RET			; no memory to memory DMA available
+XMOVE:	MOV	L,C		; source bank
+	MOV	H,B		; destination bank
+	SHLD	MDBNK		; for the next MOVE, with memory DMA only
+	RET
 ;
 ;	get/set time
 ;
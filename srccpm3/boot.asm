@@ -5,6 +5,8 @@
 ;
 ; History:
 ; 30-JUN-2024 first public release
+; 14-OCT-2026 load cpmldr with one command of the extended FDC
+; 14-OCT-2026 direct load header for the boot ROM
 ;
 	ORG	0		; memory base of boot
 ;
@@ -13,44 +15,40 @@ SECTS	EQU	25		; # of sectors to load
 ;
 ;	I/O ports
 ;
-FDC	EQU	4		;FDC port
+XFDC	EQU	9		;extended FDC port, multi sector transfers
 ;
 	DI			;disable interrupts
 	LXI	SP,0FFH		;some space for stack
 	MVI	A,10H		;setup command for FDC
-	OUT	FDC
+	OUT	XFDC
 	MVI	A,CMD AND 0FFH
-	OUT	FDC
+	OUT	XFDC
 	MVI	A,CMD SHR 8
-	OUT	FDC
-	LXI	B,2		;B=track 0, C=sector 2
-	MVI	D,SECTS		;D=# sectors to load
+	OUT	XFDC
 ;
-; load the next sector
+; load all sectors with one command
 ;
-LSECT	MVI	A,20H		;tell FDC to read sector on drive 0
-	OUT	FDC
-	IN	FDC		;get result from FDC
+	MVI	A,20H		;tell FDC to read sectors on drive 0
+	OUT	XFDC
+	IN	XFDC		;get result from FDC
 	ORA	A
-	JZ	BOOT1
-	HLT			;read error, halt CPU
-BOOT1	DCR	D		;SECTS=SECTS-1
 	JZ	BOOT		;all done, head for cpmldr
-	INR	C		;sector = sector + 1
-	MOV	A,C
-	STA	CMD+1		;save sector
-	PUSH	D
-	LHLD	CMD+2		;get DMA address
-	LXI	D,80H		;and increase it by 128
-	DAD	D
-	POP	D
-	SHLD	CMD+2		;set new dma address
-	JMP	LSECT		;for next sector
+	HLT			;read error, halt CPU
+;
+; direct load header at the end of the boot sector, the boot ROM
+; reads the system with the command bytes itself and jumps to the
+; entry, without running this loader
+;
+	DS	76H-$
+	DB	'DL'		;magic
+	DW	BOOT		;entry
 ;
 ; command bytes for the FDC
 CMD	DB	00H		;track 0
 	DB	02H		;sector 2
 	DB	BOOT AND 0FFH	;DMA address low
 	DB	BOOT SHR 8	;DMA address high
+	DB	SECTS		;# of sectors
+	DB	0
 
 	END			;of boot loader
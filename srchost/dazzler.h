@@ -0,0 +1,20 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Headless Cromemco Dazzler of the host build
+ */
+
+#ifndef DAZZLER_INC
+#define DAZZLER_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+extern void dazzler_ctl_out(BYTE data), dazzler_format_out(BYTE data);
+extern BYTE dazzler_flags_in(void);
+extern BYTE dazzler_ctl(void), dazzler_format(void);
+extern void dazzler_draw_stats(uint32_t *frames, uint64_t *us);
+
+#endif /* !DAZZLER_INC */
@@ -0,0 +1,42 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Disk drives of the host build, with the disk images in files
+ * of the host instead of the MicroSD card.
+ */
+
+#ifndef DISKS_INC
+#define DISKS_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define NUMDISK	16		/* number of disk drives, A: to P: */
+#define DISKLEN	255		/* path length of a disk image */
+
+/* disk types */
+#define DISK_FD	0		/* 8" IBM 3740 floppy disk, 77 tracks, 26 sectors */
+#define DISK_HD	1		/* 4 MB hard disk */
+#define HD_TRK	255		/* number of tracks of a hard disk */
+#define HD_SPT	128		/* sectors per track of a hard disk */
+
+typedef struct disk_stats {
+	uint32_t reads;		/* sectors read */
+	uint32_t writes;	/* sectors written */
+} disk_stats_t;
+
+extern char disks[NUMDISK][DISKLEN+1];
+extern BYTE disk_type[NUMDISK];
+extern disk_stats_t disk_stats[NUMDISK];
+
+extern bool mount_disk(int drive, const char *name);
+extern void exit_disks(void);
+extern void print_disk_stats(void);
+
+extern BYTE read_sec(int drive, int track, int sector, WORD addr);
+extern BYTE write_sec(int drive, int track, int sector, WORD addr);
+extern void get_fdccmd(BYTE *cmd, WORD addr);
+
+#endif /* !DISK_INC */
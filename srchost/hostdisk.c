@@ -0,0 +1,183 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * The disk drives of the host build, substitutes disks.c. The disk
+ * images are files of the host with the same layout as on the MicroSD
+ * card: the sectors of 128 bytes in the order of the tracks, 26 per
+ * track. Images larger than a floppy disk are hard disks, addressed
+ * with 128 sectors per track.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ * 14-OCT-2026 up to 16 drives like the firmware
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simmem.h"
+
+#include "sd-fdc.h"
+#include "disks.h"
+
+#define FD_SIZE	(77L * 26 * SEC_SZ)	/* size of a floppy disk image */
+
+static const struct {
+	int maxtrk;		/* highest track */
+	int spt;		/* sectors per track */
+} geom[] = {
+	[DISK_FD] = { 76, 26 },
+	[DISK_HD] = { HD_TRK - 1, HD_SPT }
+};
+
+char disks[NUMDISK][DISKLEN+1];	/* paths of the disk images */
+BYTE disk_type[NUMDISK];
+disk_stats_t disk_stats[NUMDISK];
+static FILE *disk_fp[NUMDISK];
+static bool disk_ro[NUMDISK];	/* image is read-only */
+
+/*
+ * put the disk image name into drive, false if it can't be opened
+ */
+bool mount_disk(int drive, const char *name)
+{
+	FILE *fp;
+	long size;
+
+	if (strlen(name) > DISKLEN) {
+		fprintf(stderr, "%s: path too long\n", name);
+		return false;
+	}
+	disk_ro[drive] = false;
+	if ((fp = fopen(name, "r+b")) == NULL) {
+		if ((fp = fopen(name, "rb")) == NULL) {
+			perror(name);
+			return false;
+		}
+		disk_ro[drive] = true;
+	}
+	fseek(fp, 0L, SEEK_END);
+	size = ftell(fp);
+
+	if (disk_fp[drive] != NULL)
+		fclose(disk_fp[drive]);
+	disk_fp[drive] = fp;
+	disk_type[drive] = size > FD_SIZE ? DISK_HD : DISK_FD;
+	strcpy(disks[drive], name);
+
+	return true;
+}
+
+void exit_disks(void)
+{
+	register int i;
+
+	for (i = 0; i < NUMDISK; i++)
+		if (disk_fp[i] != NULL) {
+			fclose(disk_fp[i]);
+			disk_fp[i] = NULL;
+		}
+}
+
+void print_disk_stats(void)
+{
+	register int i;
+
+	for (i = 0; i < NUMDISK; i++)
+		if (disks[i][0] != '\0')
+			printf("Disk %c: %lu sectors read, %lu written\n",
+			       'A' + i, (unsigned long) disk_stats[i].reads,
+			       (unsigned long) disk_stats[i].writes);
+}
+
+/*
+ * check the parameters like the firmware and seek to the sector
+ */
+static BYTE prep_io(int drive, int track, int sector, WORD addr)
+{
+	long ofs;
+
+	/* check if drive in range */
+	if ((drive < 0) || (drive >= NUMDISK))
+		return FDC_STAT_DISK;
+
+	/* check if track and sector in range */
+	if (track > geom[disk_type[drive]].maxtrk)
+		return FDC_STAT_TRACK;
+	if ((sector < 1) || (sector > geom[disk_type[drive]].spt))
+		return FDC_STAT_SEC;
+
+	/* check if DMA address in range */
+	if (addr > 0xff7f)
+		return FDC_STAT_DMAADR;
+
+	/* check if disk in drive */
+	if (disk_fp[drive] == NULL)
+		return FDC_STAT_NODISK;
+
+	ofs = ((long) track * geom[disk_type[drive]].spt + sector - 1)
+	      * SEC_SZ;
+	if (fseek(disk_fp[drive], ofs, SEEK_SET) != 0)
+		return FDC_STAT_SEEK;
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * read from drive a sector on track into memory @ addr
+ */
+BYTE read_sec(int drive, int track, int sector, WORD addr)
+{
+	BYTE buf[SEC_SZ], stat;
+
+	if ((stat = prep_io(drive, track, sector, addr)) != FDC_STAT_OK)
+		return stat;
+
+	/* sectors beyond the end of the image read as empty */
+	memset(buf, 0xe5, SEC_SZ);
+	clearerr(disk_fp[drive]);
+	if (fread(buf, 1, SEC_SZ, disk_fp[drive]) != SEC_SZ
+	    && ferror(disk_fp[drive]))
+		return FDC_STAT_READ;
+
+	dma_write_block(addr, buf, SEC_SZ);
+	disk_stats[drive].reads++;
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * write to drive a sector on track from memory @ addr
+ */
+BYTE write_sec(int drive, int track, int sector, WORD addr)
+{
+	BYTE buf[SEC_SZ], stat;
+
+	if ((stat = prep_io(drive, track, sector, addr)) != FDC_STAT_OK)
+		return stat;
+	if (disk_ro[drive])
+		return FDC_STAT_WRITE;
+
+	dma_read_block(addr, buf, SEC_SZ);
+	if (fwrite(buf, 1, SEC_SZ, disk_fp[drive]) != SEC_SZ
+	    || fflush(disk_fp[drive]) != 0)
+		return FDC_STAT_WRITE;
+	disk_stats[drive].writes++;
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * get FDC command from CPU memory
+ */
+void get_fdccmd(BYTE *cmd, WORD addr)
+{
+	register int i;
+
+	for (i = 0; i < 4; i++)
+		cmd[i] = dma_read(addr + i);
+}
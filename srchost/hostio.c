@@ -0,0 +1,307 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * The I/O devices of the host build, substitutes simio.c. The console
+ * SIO1 is stdin/stdout, which can be a terminal or pipes, so that a
+ * test can feed the input and compare the output. The other devices
+ * of the firmware, which need the Pico hardware, aren't there.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ * 14-OCT-2026 empty int_service() for the memory read hooks
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simcore.h"
+#include "simio.h"
+
+#include "sd-fdc.h"
+#include "dazzler.h"
+#include "disks.h"
+
+static BYTE sio1s_in(void), sio1d_in(void), mmu_in(void), hwctl_in(void);
+static BYTE fpsw_in(void);
+static void sio1d_out(BYTE data), mmu_out(BYTE data), hwctl_out(BYTE data);
+static void fpsw_out(BYTE data), fpled_out(BYTE data);
+
+static BYTE sio1_last;	/* last character received on SIO1 */
+static bool sio1_eof;	/* end of the input on SIO1 */
+       BYTE fp_value;	/* port 255 value */
+static BYTE hwctl_lock = 0xff; /* lock status hardware control port */
+int cons_data_bits = 7;	/* output to consoles is 7 or 8 bits */
+
+static struct termios old_term;	/* terminal settings before init_io() */
+static bool term_raw;		/* stdin is a terminal in raw mode */
+
+/* headless Dazzler, only the registers */
+static BYTE dazzler_ctl_reg, dazzler_format_reg;
+
+/*
+ *	This array contains function pointers for every input
+ *	I/O port (0 - 255), to do the required I/O.
+ */
+in_func_t *const port_in[256] = {
+	[  0] = sio1s_in,	/* SIO1 status */
+	[  1] = sio1d_in,	/* SIO1 read data */
+	[  4] = fdc_in,		/* FDC status */
+	[ 14] = dazzler_flags_in, /* Cromemco Dazzler flags */
+	[ 64] = mmu_in,		/* MMU */
+	[160] = hwctl_in,	/* virtual hardware control */
+	[254] = fpsw_in,	/* mirror of port 255 */
+	[255] = fpsw_in		/* read from front panel switches */
+};
+
+/*
+ *	This array contains function pointers for every output
+ *	I/O port (0 - 255), to do the required I/O.
+ */
+out_func_t *const port_out[256] = {
+	[  1] = sio1d_out,	/* SIO1 write data */
+	[  4] = fdc_out,	/* FDC command */
+	[ 14] = dazzler_ctl_out, /* Cromemco Dazzler control */
+	[ 15] = dazzler_format_out, /* Cromemco Dazzler format */
+	[ 64] = mmu_out,	/* MMU */
+	[160] = hwctl_out,	/* virtual hardware control */
+	[254] = fpsw_out,	/* write to front panel switches */
+	[255] = fpled_out	/* write to front panel lights */
+};
+
+/*
+ *	Switch a terminal on stdin into raw mode, ^C still stops the
+ *	emulation.
+ */
+void init_io(void)
+{
+	struct termios t;
+
+	if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &old_term) == 0) {
+		t = old_term;
+		t.c_iflag &= ~(ICRNL | INLCR | IXON);
+		t.c_lflag &= ~(ICANON | ECHO);
+		t.c_cc[VMIN] = 1;
+		t.c_cc[VTIME] = 0;
+		term_raw = tcsetattr(STDIN_FILENO, TCSANOW, &t) == 0;
+	}
+}
+
+void exit_io(void)
+{
+	fflush(stdout);
+	if (term_raw) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &old_term);
+		term_raw = false;
+	}
+}
+
+/*
+ *	no interrupt sources, mem_attn.on.intr is never set
+ */
+void int_service(void)
+{
+}
+
+/*
+ *	true if a character can be read from stdin
+ */
+static bool sio1_avail(void)
+{
+	struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+
+	if (sio1_eof)
+		return false;
+	return poll(&p, 1, 0) > 0 && (p.revents & (POLLIN | POLLHUP));
+}
+
+/*
+ *	I/O handler for read SIO1 status:
+ *	bit 0 = 0, character available for input from tty
+ *	bit 7 = 0, transmitter ready to write character to tty
+ */
+static BYTE sio1s_in(void)
+{
+	register BYTE stat = 0b00000001; /* output always ready */
+
+	if (sio1_avail())
+		stat &= 0b11111110;
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO1 data, the last character again
+ *	if there is no new one.
+ */
+static BYTE sio1d_in(void)
+{
+	BYTE c;
+
+	if (sio1_avail()) {
+		fflush(stdout);
+		if (read(STDIN_FILENO, &c, 1) == 1)
+			sio1_last = c;
+		else
+			sio1_eof = true;
+	}
+
+	return sio1_last;
+}
+
+/*
+ *	Write byte to stdout.
+ */
+static void sio1d_out(BYTE data)
+{
+	if (cons_data_bits == 7)
+		data &= 0x7f;	/* strip parity, some software won't */
+	putchar((int) data);
+}
+
+/*
+ *	read MMU register
+ *	returns maximum bank in upper nibble
+ *	and currently selected bank in lower nibble
+ */
+static BYTE mmu_in(void)
+{
+	return (numseg << 4) | selbnk;
+}
+
+/*
+ *	write MMU register
+ */
+static void mmu_out(BYTE data)
+{
+	if (data > numseg) {
+		fprintf(stderr, "%04x: trying to select non-existing bank %d\n",
+			PC, data);
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
+		return;
+	}
+	if (data != selbnk)
+		select_bank(data);
+}
+
+/*
+ *	Input from virtual hardware control port
+ *	returns lock status of the port
+ */
+static BYTE hwctl_in(void)
+{
+	return hwctl_lock;
+}
+
+/*
+ *	Port is locked until magic number 0xaa is received!
+ *
+ *	Virtual hardware control output, of the firmware functions
+ *	only these:
+ *
+ *	bit 7 = 1	halt emulation via I/O
+ *	bit 5 = 1	switch CPU model to Z80
+ *	bit 4 = 1	switch CPU model to 8080
+ */
+static void hwctl_out(BYTE data)
+{
+	/* if port is locked do nothing */
+	if (hwctl_lock && (data != 0xaa))
+		return;
+
+	/* unlock port ? */
+	if (hwctl_lock && (data == 0xaa)) {
+		hwctl_lock = 0;
+		return;
+	}
+
+	/* process output to unlocked port */
+	/* but first lock port again */
+	hwctl_lock = 0xff;
+
+	if (data & 128) {
+		cpu_error = IOHALT;
+		cpu_state = ST_STOPPED;
+		return;
+	}
+
+#if !defined (EXCLUDE_I8080) && !defined(EXCLUDE_Z80)
+	if (data & 32) {		/* switch cpu model to Z80 */
+		switch_cpu(Z80);
+		return;
+	}
+
+	if (data & 16) {		/* switch cpu model to 8080 */
+		switch_cpu(I8080);
+		return;
+	}
+#endif
+}
+
+/*
+ *	Read virtual front panel switches state
+ */
+static BYTE fpsw_in(void)
+{
+	return fp_value;
+}
+
+/*
+ *	Write virtual front panel switches state
+ */
+static void fpsw_out(BYTE data)
+{
+	fp_value = data;
+}
+
+/*
+ *	Write output to front panel lights
+ */
+static void fpled_out(BYTE data)
+{
+	fp_led_output = data;
+}
+
+/*
+ *	The headless Dazzler keeps the registers and draws nothing,
+ *	so that programs for it run, with the flags of a picture which
+ *	is always outside of the vertical blank.
+ */
+void dazzler_ctl_out(BYTE data)
+{
+	dazzler_ctl_reg = data;
+}
+
+void dazzler_format_out(BYTE data)
+{
+	dazzler_format_reg = data;
+}
+
+BYTE dazzler_flags_in(void)
+{
+	return 0xff;
+}
+
+BYTE dazzler_ctl(void)
+{
+	return dazzler_ctl_reg;
+}
+
+BYTE dazzler_format(void)
+{
+	return dazzler_format_reg;
+}
+
+void dazzler_draw_stats(uint32_t *frames, uint64_t *us)
+{
+	*frames = 0;
+	*us = 0;
+}
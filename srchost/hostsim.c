@@ -0,0 +1,291 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * This is the main program of the host build of the emulator,
+ * substitutes picosim.c. It runs the CPU cores, the memory and the
+ * FDC of the firmware on a workstation, for benchmarks and for tests
+ * of the CPU cores, which compare the console output with the
+ * expected one.
+ *
+ * Usage: hostsim [-8] [-f MHz] [-t seconds] [-x file [-o addr]]
+ *		  [-i | -B] [disk image ...]
+ *
+ * The disk images go into the drives A to D. Without -x the boot
+ * ROM boots from drive A. -B runs the benchmark kernels of the ICE
+ * and -i starts the ICE. The exit status is 0 if the CPU was halted
+ * by the program, with HALT or the hardware control port.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "pico/time.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simcore.h"
+#include "simport.h"
+#include "simio.h"
+#ifdef WANT_ICE
+#include "simice.h"
+#endif
+
+#include "bench.h"
+#include "disks.h"
+
+#define BS  0x08 /* ASCII backspace */
+#define DEL 0x7f /* ASCII delete */
+
+/*
+ * SIGINT and the -t alarm stop the CPU like the user interrupt
+ * of the ICE
+ */
+static void stop_cpu(int sig)
+{
+	UNUSED(sig);
+
+	cpu_error = USERINT;
+	cpu_state = ST_STOPPED;
+}
+
+static int64_t timeout(alarm_id_t id, void *user_data)
+{
+	UNUSED(id);
+	UNUSED(user_data);
+
+	stop_cpu(SIGALRM);
+	return 0;
+}
+
+/*
+ * load a binary file into memory at addr
+ */
+static bool load_bin(const char *name, WORD addr)
+{
+	FILE *fp;
+	int c;
+
+	if ((fp = fopen(name, "rb")) == NULL) {
+		perror(name);
+		return false;
+	}
+	while ((c = getc(fp)) != EOF)
+		putmem(addr++, (BYTE) c);
+	fclose(fp);
+
+	return true;
+}
+
+#ifdef WANT_ICE
+static void hostsim_ice_cmd(char *cmd, WORD *wrk_addr)
+{
+	UNUSED(wrk_addr);
+
+	switch (tolower((unsigned char) *cmd)) {
+	case 'b':
+		run_bench();
+		break;
+	case 'd':
+		print_disk_stats();
+		break;
+	default:
+		puts("what??");
+		break;
+	}
+}
+
+static void hostsim_ice_help(void)
+{
+	puts("! b                        run the benchmark kernels");
+	puts("! d                        show disk statistics");
+}
+#endif
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-8] [-f MHz] [-t seconds] "
+		"[-x file [-o addr]] [-i | -B] [disk image ...]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = NULL;
+	WORD addr = 0;
+	int speed = CPU_SPEED, secs = 0, c, i;
+	bool i8080 = false, ice = false, bench = false;
+
+	while ((c = getopt(argc, argv, "8f:t:x:o:iB")) != -1) {
+		switch (c) {
+		case '8':
+			i8080 = true;
+			break;
+		case 'f':
+			speed = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'x':
+			file = optarg;
+			break;
+		case 'o':
+			addr = (WORD) strtoul(optarg, NULL, 16);
+			break;
+		case 'i':
+			ice = true;
+			break;
+		case 'B':
+			bench = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind > NUMDISK)
+		usage(argv[0]);
+#ifndef WANT_ICE
+	if (ice || bench) {
+		fputs("the ICE is not compiled in\n", stderr);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	printf("%s release %s\n", USR_COM, USR_REL);
+	printf("%s\n\n", USR_CPR);
+
+	init_cpu();		/* initialize CPU */
+	PC = 0xff00;		/* power on jump into the boot ROM */
+	init_memory();		/* initialize memory configuration */
+	for (i = 0; optind < argc; i++)
+		if (!mount_disk(i, argv[optind++]))
+			return EXIT_FAILURE;
+#if !defined (EXCLUDE_I8080) && !defined(EXCLUDE_Z80)
+	if (i8080)
+		switch_cpu(I8080);
+#else
+	UNUSED(i8080);
+#endif
+	if (file != NULL) {
+		if (!load_bin(file, addr))
+			return EXIT_FAILURE;
+		PC = addr;
+	}
+
+	f_value = speed;	/* setup speed of the CPU */
+	if (f_value)
+		tmax = speed * 10000;	/* theoretically */
+	else
+		tmax = 100000;	/* for periodic CPU accounting updates */
+
+	signal(SIGINT, stop_cpu);
+	init_io();		/* initialize I/O devices */
+	if (secs > 0)
+		add_alarm_in_ms(secs * 1000, timeout, NULL, true);
+
+#ifdef SIMPLEPANEL
+	fp_led_address = PC;
+	fp_led_data = getmem(PC);
+	cpu_bus = CPU_WO | CPU_M1 | CPU_MEMR;
+#endif
+
+#ifdef WANT_ICE
+	if (bench) {
+		exit_io();
+		run_bench();
+		exit_disks();
+		return EXIT_SUCCESS;
+	}
+	if (ice) {
+		ice_cust_cmd = hostsim_ice_cmd;
+		ice_cust_help = hostsim_ice_help;
+		ice_cmd_loop(0);
+	} else
+#endif
+		run_cpu();
+
+	exit_io();		/* stop I/O devices */
+	exit_disks();		/* stop disk drives */
+
+	if (!ice) {
+		putchar('\n');
+		report_cpu_error();	/* check for CPU emulation errors */
+		report_cpu_stats();	/* print some execution statistics */
+		print_disk_stats();
+	}
+
+	return cpu_error == OPHALT || cpu_error == IOHALT ? EXIT_SUCCESS
+							  : EXIT_FAILURE;
+}
+
+/*
+ * Sleep of the CPU speed throttle, without the drift correction
+ * and turbo of the firmware.
+ */
+void throttle_sleep_us(unsigned long time)
+{
+	sleep_us((uint64_t) time);
+}
+
+/*
+ * Sleep of the CPU cores in HALT.
+ */
+void halt_sleep_ms(unsigned time)
+{
+	sleep_ms(time);
+}
+
+/*
+ * Read an ICE command line of maximum length len - 1 from stdin,
+ * echoed if it is the terminal in raw mode. For single character
+ * requests (len == 2), returns immediately after input is received.
+ */
+bool get_cmdline(char *buf, int len)
+{
+	bool echo = isatty(STDIN_FILENO);
+	int i = 0;
+	char c;
+
+	fflush(stdout);
+	while (true) {
+		/* unbuffered like the console input of the CPU */
+		if (read(STDIN_FILENO, &c, 1) != 1) {
+			if (i == 0)
+				return false;
+			break;
+		}
+		if ((c == BS) || (c == DEL)) {
+			if (i >= 1) {
+				if (echo)
+					fputs("\b \b", stdout);
+				i--;
+			}
+		} else if (c != '\r' && c != '\n') {
+			if (i < len - 1) {
+				buf[i++] = c;
+				if (echo)
+					putchar(c);
+				if (len == 2)
+					break;
+			}
+		} else {
+			break;
+		}
+		fflush(stdout);
+	}
+	buf[i] = '\0';
+	if (echo)
+		putchar('\n');
+	return true;
+}
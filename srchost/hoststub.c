@@ -0,0 +1,94 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * The time functions of the Pico SDK for the host build. There is
+ * one alarm at a time, like the emulator uses them, it runs in the
+ * handler of SIGALRM.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "pico/time.h"
+
+static alarm_callback_t alarm_cb;	/* callback of the pending alarm */
+static void *alarm_data;
+static alarm_id_t alarm_id;
+
+uint64_t time_us_64(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) (us / 1000000);
+	ts.tv_nsec = (long) (us % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static void set_timer(uint64_t us)
+{
+	struct itimerval it;
+
+	memset(&it, 0, sizeof(it));
+	it.it_value.tv_sec = (time_t) (us / 1000000);
+	it.it_value.tv_usec = (suseconds_t) (us % 1000000);
+	setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void alarm_handler(int sig)
+{
+	alarm_callback_t cb = alarm_cb;
+	int64_t next;
+
+	(void) sig;
+	if (cb == NULL)
+		return;
+	alarm_cb = NULL;
+	next = cb(alarm_id, alarm_data);
+	if (next != 0) {	/* reschedule in |next| us */
+		alarm_cb = cb;
+		set_timer((uint64_t) (next < 0 ? -next : next));
+	}
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+			   void *user_data, bool fire_if_past)
+{
+	struct sigaction sa;
+
+	(void) fire_if_past;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = alarm_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	alarm_cb = callback;
+	alarm_data = user_data;
+	set_timer(ms ? (uint64_t) ms * 1000 : 1);
+	return ++alarm_id;
+}
+
+bool cancel_alarm(alarm_id_t id)
+{
+	if (id != alarm_id || alarm_cb == NULL)
+		return false;
+	alarm_cb = NULL;
+	set_timer(0);
+	return true;
+}
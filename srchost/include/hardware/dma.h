@@ -0,0 +1,93 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * DMA functions of the Pico SDK for the host build. The memory to
+ * memory transfers used by simmem.c are done by the CPU when the
+ * channel is started, so they are finished when it returns.
+ */
+
+#ifndef HARDWARE_DMA_H
+#define HARDWARE_DMA_H
+
+#include <string.h>
+
+#include "pico.h"
+
+enum dma_channel_transfer_size {
+	DMA_SIZE_8 = 0,
+	DMA_SIZE_16 = 1,
+	DMA_SIZE_32 = 2
+};
+
+typedef struct {
+	uint size;
+	bool read_incr, write_incr;
+} dma_channel_config;
+
+static inline int dma_claim_unused_channel(bool required)
+{
+	(void) required;
+	return 0;
+}
+
+static inline void dma_channel_unclaim(uint channel)
+{
+	(void) channel;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel)
+{
+	dma_channel_config c = { DMA_SIZE_32, true, false };
+
+	(void) channel;
+	return c;
+}
+
+static inline void channel_config_set_transfer_data_size(
+	dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+	c->size = (uint) size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c,
+						     bool incr)
+{
+	c->read_incr = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c,
+						      bool incr)
+{
+	c->write_incr = incr;
+}
+
+static inline void dma_channel_configure(uint channel,
+					 const dma_channel_config *c,
+					 volatile void *write_addr,
+					 const volatile void *read_addr,
+					 uint transfer_count, bool trigger)
+{
+	uint8_t *w = (uint8_t *) write_addr;
+	const uint8_t *r = (const uint8_t *) read_addr;
+	size_t n = (size_t) 1 << c->size;
+
+	(void) channel;
+	if (!trigger)
+		return;
+	while (transfer_count--) {
+		memcpy(w, r, n);
+		if (c->write_incr)
+			w += n;
+		if (c->read_incr)
+			r += n;
+	}
+}
+
+static inline void dma_channel_wait_for_finish_blocking(uint channel)
+{
+	(void) channel;
+}
+
+#endif /* !HARDWARE_DMA_H */
@@ -0,0 +1,35 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Interrupt and core functions of the Pico SDK for the host build,
+ * the emulation runs in a single thread
+ */
+
+#ifndef HARDWARE_SYNC_H
+#define HARDWARE_SYNC_H
+
+#include "pico.h"
+
+static inline uint32_t save_and_disable_interrupts(void)
+{
+	return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+	(void) status;
+}
+
+static inline uint get_core_num(void)
+{
+	return 0;
+}
+
+static inline void __dmb(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif /* !HARDWARE_SYNC_H */
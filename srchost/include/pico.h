@@ -0,0 +1,29 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Minimal replacement of the Pico SDK base header for the host build
+ */
+
+#ifndef PICO_H
+#define PICO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define __aligned(x)			__attribute__((aligned(x)))
+#define __not_in_flash(group)
+#define __not_in_flash_func(func)	func
+#define __no_inline_not_in_flash_func(func) __attribute__((noinline)) func
+#define __uninitialized_ram(var)	var
+#define __force_inline			inline __attribute__((always_inline))
+
+#ifndef count_of
+#define count_of(a)	(sizeof(a) / sizeof((a)[0]))
+#endif
+
+#endif /* !PICO_H */
@@ -0,0 +1,16 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Minimal replacement of the Pico SDK stdlib for the host build
+ */
+
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#endif /* !PICO_STDLIB_H */
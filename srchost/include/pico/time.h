@@ -0,0 +1,46 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Time functions of the Pico SDK for the host build, implemented
+ * in hoststub.c with the monotonic clock and one interval timer
+ */
+
+#ifndef PICO_TIME_H
+#define PICO_TIME_H
+
+#include "pico.h"
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+extern uint64_t time_us_64(void);
+extern void sleep_us(uint64_t us);
+extern alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+				  void *user_data, bool fire_if_past);
+extern bool cancel_alarm(alarm_id_t id);
+
+static inline absolute_time_t get_absolute_time(void)
+{
+	return time_us_64();
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+	return t;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from,
+					    absolute_time_t to)
+{
+	return (int64_t) (to - from);
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+	sleep_us((uint64_t) ms * 1000);
+}
+
+#endif /* !PICO_TIME_H */
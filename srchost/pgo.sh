@@ -0,0 +1,38 @@
+#!/bin/bash
+# Profile guided optimized build of hostsim. Builds an instrumented
+# binary, runs the workloads below with it, rebuilds with the profile
+# and compares the benchmark kernels of a plain and the optimized build.
+#	./pgo.sh [build directory]
+set -e
+cd "$(dirname "$0")"
+B=${1:-build-pgo}
+D=../disks
+T=20		# seconds of each workload
+
+cmake -S . -B $B-ref
+cmake --build $B-ref -j
+
+rm -rf $B/pgo
+cmake -S . -B $B -DPGO=gen
+cmake --build $B -j
+
+# the workloads, CP/M 3 and MP/M boots with some commands, CP/M 2 with
+# the Dazzler kaleidoscope, and the benchmark kernels of both CPUs
+printf 'dir\rtype readme.txt\r' | \
+	$B/hostsim -t $T $D/cpm3-1.dsk $D/cpm3-2.dsk > /dev/null || true
+printf '\rdir\r' | \
+	$B/hostsim -t $T $D/mpm-1.dsk $D/mpm-2.dsk > /dev/null || true
+printf 'b:\rkscope\r' | \
+	$B/hostsim -t $T $D/cpm22.dsk $D/dazzler.dsk > /dev/null || true
+$B/hostsim -B > /dev/null
+$B/hostsim -8 -B > /dev/null
+
+cmake -S . -B $B -DPGO=use
+cmake --build $B -j
+
+for b in $B-ref $B
+do
+	echo "== $b"
+	$b/hostsim -B
+	$b/hostsim -8 -B
+done
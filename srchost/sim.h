@@ -0,0 +1,43 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * This is the configuration for the host build of the emulator
+ */
+
+#ifndef SIM_INC
+#define SIM_INC
+
+#define DEF_CPU Z80	/* default CPU (Z80 or I8080) */
+//#define EXCLUDE_I8080	/* we want both CPU's */
+#define CPU_SPEED 0	/* CPU speed 0=unlimited */
+/*#define ALT_I8080*/	/* use alt. 8080 sim. primarily optimized for size */
+/*#define ALT_Z80*/	/* use alt. Z80 sim. primarily optimized for size */
+#define UNDOC_INST	/* compile undocumented instrs. (required by ALT_*) */
+#ifndef EXCLUDE_Z80
+/*#define FAST_BLOCK*/	/* much faster but not accurate Z80 block instr. */
+#endif
+#define SIMPLEPANEL	/* the benchmark saves the front panel LEDs */
+#define IOPANEL		/* like the firmware */
+
+#define WANT_ICE	/* the ICE runs the benchmark kernels */
+#ifdef WANT_ICE
+#define BAREMETAL	/* same ICE commands as the firmware */
+#define WANT_TIM	/* count t-states */
+#define HISIZE	100	/* number of entries in history */
+#define SBSIZE	4	/* number of software breakpoints */
+#define WANT_HB		/* hardware breakpoint */
+#endif
+
+#define MODEL "host"
+
+#define USR_COM "Z80/8080 emulator of the RP2xxx-GEEK, host build"
+#define USR_REL "1.8"
+#define USR_CPR "Copyright (C) 2024-2026 by Udo Munk & Thomas Eberhardt"
+
+#ifndef PRIu64
+#define PRIu64 "llu"
+#endif
+
+#endif
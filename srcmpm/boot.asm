@@ -6,6 +6,8 @@
 ;
 ; History:
 ; 12-MAR-2025 first public release based on cpmsim/srcmpm and RP2xxx/srccpm3
+; 14-OCT-2026 load mpmldr with one command of the extended FDC
+; 14-OCT-2026 direct load header for the boot ROM
 ;
 	ORG	0		;mem base of boot
 ;
@@ -15,7 +17,7 @@ SECTS	EQU	51		;# of sectors to load (26 * 2 - 1)
 ;	I/O ports
 ;
 CONDAT	EQU	1		;console data port
-FDC	EQU	4		;FDC
+XFDC	EQU	9		;extended FDC, multi sector transfers
 ;
 	JP	COLD
 ;
@@ -25,21 +27,19 @@ ERRMSG:	DEFM	'BOOT: error booting'
 ;	begin the load operation
 ;
 COLD:	LD	A,10H		;setup command for FDC
-	OUT	(FDC),A
+	OUT	(XFDC),A
 	LD	A,CMD AND 0FFH
-	OUT	(FDC),A
+	OUT	(XFDC),A
 	LD	A,CMD SHR 8
-	OUT	(FDC),A
-	LD	BC,2		;b=track 0, c=sector 2
-	LD	D,SECTS		;d=# sectors to load
+	OUT	(XFDC),A
 ;
-;	load the next sector
+;	load all sectors, they continue with sector 1 of the next track
 ;
-LSECT	LD	A,20H		;tell FDC to read sector on drive 0
-	OUT	(FDC),A
-	IN	A,(FDC)		;get status of FDC
+	LD	A,20H		;tell FDC to read sectors on drive 0
+	OUT	(XFDC),A
+	IN	A,(XFDC)	;get status of FDC
 	OR	A		;read successful ?
-	JP	Z,CONT		;yes, continue
+	JP	Z,BOOT		;yes, head for the bios
 	LD	HL,ERRMSG	;no, print error
 PRTMSG:	LD	A,(HL)
 	OR	A
@@ -50,37 +50,13 @@ PRTMSG:	LD	A,(HL)
 STOP:	DI
 	HALT			;and halt cpu
 ;
-CONT:
-				;go to next sector if load is incomplete
-	DEC	D		;sects=sects-1
-	JP	Z,BOOT		;head for the bios
-
+;	direct load header at the end of the boot sector, the boot ROM
+;	reads the system with the command bytes itself and jumps to the
+;	entry, without running this loader
 ;
-;	more sectors to load
-;
-;	we aren't using a stack, so use <sp> as scratch register
-;	to hold the load address increment
-;
-	LD	HL,(CMD+2)	;get DMA address
-	LD	SP,128		;128 bytes per sector
-	ADD	HL,SP		;<hl> = <hl> + 128
-	LD	(CMD+2),HL	;set new DMA address
-;
-	INC	C		;sector = sector + 1
-	LD	A,C
-	LD	(CMD+1),A	;save sector
-	CP	27		;last sector of track ?
-	JP	C,LSECT		;no, go read another
-;
-;	end of track, increment to next track
-;
-	LD	C,1		;sector = 1
-	LD	A,C
-	LD	(CMD+1),A	;save sector
-	INC	B		;track = track + 1
-	LD	A,B
-	LD	(CMD),A		;save track
-	JP	LSECT		;for another group
+	DEFS	76H-$
+	DEFM	'DL'		;magic
+	DEFW	BOOT		;entry
 ;
 ;	command bytes for the FDC
 ;
@@ -88,5 +64,7 @@ CMD	DEFB	00H		;track 0
 	DEFB	02H		;sector 2
 	DEFB	BOOT AND 0FFH	;DMA address low
 	DEFB	BOOT SHR 8	;DMA address high
+	DEFB	SECTS		;# of sectors
+	DEFB	0
 ;
 	END			;of boot loader
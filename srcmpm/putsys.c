@@ -8,6 +8,7 @@
  * 08-DEC-2006 cloned from the version for CP/M 3
  * 03-APR-2016 disk drive name drivea.dsk
  * 27-APR-2024 improve error handling
+ * 14-OCT-2026 show the direct load header of the boot loader
  */
 
 #include <unistd.h>
@@ -49,6 +50,12 @@ int main(void)
 		perror("boot.bin");
 		exit(EXIT_FAILURE);
 	}
+	/* show the direct load header for the boot ROM, if there is one */
+	if (sector[0x76] == 'D' && sector[0x77] == 'L')
+		printf("boot.bin: direct load of %d sectors to %04XH, "
+		       "entry %04XH\n", sector[0x7e],
+		       sector[0x7c] | (sector[0x7d] << 8),
+		       sector[0x78] | (sector[0x79] << 8));
 	/* and write it to disk in drive A */
 	if ((n = write(drivea, (char *) sector, 128)) != 128) {
 		fprintf(stderr, DISK ": %s\n",
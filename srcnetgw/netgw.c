@@ -0,0 +1,306 @@
+/*
+ * Gateway on the host for the network bridge device of picosim
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Reads the SLIP frames from the serial UART of the Pico, makes the
+ * TCP connection the guest asks for and moves the data between the
+ * socket and the UART. The frame types are described in srcsim/net.c.
+ *
+ * Usage: netgw device [baud]
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#define SLIP_END	0xc0	/* SLIP frame end */
+#define SLIP_ESC	0xdb	/* SLIP escape */
+#define SLIP_ESC_END	0xdc	/* escaped frame end */
+#define SLIP_ESC_ESC	0xdd	/* escaped escape */
+
+#define FRAME	257		/* max. frame length, type and 256 bytes */
+
+static int tty = -1;		/* serial UART of the Pico */
+static int sock = -1;		/* TCP connection */
+static int stopped;		/* guest told us to stop sending */
+
+static const struct {
+	long baud;
+	speed_t speed;
+} bauds[] = {
+	{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+	{ 57600, B57600 }, { 115200, B115200 },
+#ifdef B230400
+	{ 230400, B230400 },
+#endif
+#ifdef B460800
+	{ 460800, B460800 },
+#endif
+#ifdef B921600
+	{ 921600, B921600 },
+#endif
+};
+
+/*
+ * write all bytes to the serial UART
+ */
+static void tty_write(const unsigned char *p, size_t n)
+{
+	ssize_t w;
+
+	while (n > 0) {
+		if ((w = write(tty, p, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write tty");
+			exit(EXIT_FAILURE);
+		}
+		p += w;
+		n -= (size_t) w;
+	}
+}
+
+/*
+ * send a frame to the guest
+ */
+static void send_frame(unsigned char type, const unsigned char *p, size_t n)
+{
+	unsigned char buf[2 * FRAME + 2];
+	size_t len = 0;
+
+	buf[len++] = SLIP_END;
+	buf[len++] = type;
+	while (n-- > 0) {
+		if (*p == SLIP_END) {
+			buf[len++] = SLIP_ESC;
+			buf[len++] = SLIP_ESC_END;
+		} else if (*p == SLIP_ESC) {
+			buf[len++] = SLIP_ESC;
+			buf[len++] = SLIP_ESC_ESC;
+		} else
+			buf[len++] = *p;
+		p++;
+	}
+	buf[len++] = SLIP_END;
+	tty_write(buf, len);
+}
+
+static void close_sock(void)
+{
+	if (sock >= 0) {
+		close(sock);
+		sock = -1;
+	}
+	stopped = 0;
+}
+
+/*
+ * connect to host:port, the answer to the guest is 0 if connected
+ */
+static void do_connect(const unsigned char *p, size_t n)
+{
+	char name[64], *port;
+	struct addrinfo hints, *res, *ai;
+	unsigned char stat = 1;
+
+	close_sock();
+	if (n >= sizeof(name))
+		n = sizeof(name) - 1;
+	memcpy(name, p, n);
+	name[n] = '\0';
+
+	if ((port = strrchr(name, ':')) != NULL) {
+		*port++ = '\0';
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(name, port, &hints, &res) == 0) {
+			for (ai = res; ai != NULL; ai = ai->ai_next) {
+				sock = socket(ai->ai_family, ai->ai_socktype,
+					      ai->ai_protocol);
+				if (sock < 0)
+					continue;
+				if (connect(sock, ai->ai_addr,
+					    ai->ai_addrlen) == 0)
+					break;
+				close(sock);
+				sock = -1;
+			}
+			freeaddrinfo(res);
+		}
+	}
+
+	if (sock >= 0) {
+		stat = 0;
+		printf("connected to %s:%s\n", name, port);
+	} else
+		printf("connect to %s failed\n", name);
+	send_frame('c', &stat, 1);
+}
+
+/*
+ * process a frame from the guest
+ */
+static void do_frame(const unsigned char *p, size_t n)
+{
+	ssize_t w;
+
+	switch (p[0]) {
+	case 'C':
+		do_connect(p + 1, n - 1);
+		break;
+
+	case 'D':
+		p++;
+		n--;
+		while (sock >= 0 && n > 0) {
+			if ((w = write(sock, p, n)) < 0) {
+				if (errno == EINTR)
+					continue;
+				close_sock();
+				send_frame('x', NULL, 0);
+				break;
+			}
+			p += w;
+			n -= (size_t) w;
+		}
+		break;
+
+	case 'X':
+		if (sock >= 0)
+			puts("connection closed");
+		close_sock();
+		break;
+
+	case 'S':
+		stopped = 1;
+		break;
+
+	case 'G':
+		stopped = 0;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void open_tty(const char *dev, long baud)
+{
+	struct termios t;
+	size_t i;
+
+	for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+		if (bauds[i].baud == baud)
+			break;
+	if (i == sizeof(bauds) / sizeof(bauds[0])) {
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((tty = open(dev, O_RDWR | O_NOCTTY)) < 0) {
+		perror(dev);
+		exit(EXIT_FAILURE);
+	}
+	if (tcgetattr(tty, &t) < 0) {
+		perror("tcgetattr");
+		exit(EXIT_FAILURE);
+	}
+	cfmakeraw(&t);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	cfsetispeed(&t, bauds[i].speed);
+	cfsetospeed(&t, bauds[i].speed);
+	if (tcsetattr(tty, TCSANOW, &t) < 0) {
+		perror("tcsetattr");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char buf[256], frame[FRAME];
+	size_t flen = 0;
+	int esc = 0, over = 0, max;
+	ssize_t n, i;
+	fd_set fds;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s device [baud]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	open_tty(argv[1], argc == 3 ? atol(argv[2]) : 115200L);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	for (;;) {
+		FD_ZERO(&fds);
+		FD_SET(tty, &fds);
+		max = tty;
+		if (sock >= 0 && !stopped) {
+			FD_SET(sock, &fds);
+			if (sock > max)
+				max = sock;
+		}
+		if (select(max + 1, &fds, NULL, NULL, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("select");
+			return EXIT_FAILURE;
+		}
+
+		if (FD_ISSET(tty, &fds)) {
+			if ((n = read(tty, buf, sizeof(buf))) <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+				fputs("tty closed\n", stderr);
+				return EXIT_FAILURE;
+			}
+			for (i = 0; i < n; i++) {
+				if (buf[i] == SLIP_END) {
+					if (flen > 0 && !over)
+						do_frame(frame, flen);
+					flen = 0;
+					esc = over = 0;
+				} else if (buf[i] == SLIP_ESC)
+					esc = 1;
+				else {
+					if (esc) {
+						if (buf[i] == SLIP_ESC_END)
+							buf[i] = SLIP_END;
+						else if (buf[i] == SLIP_ESC_ESC)
+							buf[i] = SLIP_ESC;
+						esc = 0;
+					}
+					if (flen < FRAME)
+						frame[flen++] = buf[i];
+					else
+						over = 1;
+				}
+			}
+		}
+
+		if (sock >= 0 && !stopped && FD_ISSET(sock, &fds)) {
+			if ((n = read(sock, buf, sizeof(buf))) <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+				puts("connection closed by the remote");
+				close_sock();
+				send_frame('x', NULL, 0);
+			} else
+				send_frame('d', buf, (size_t) n);
+		}
+	}
+}
@@ -0,0 +1,345 @@
+/*
+ * Hot spot report from the samples of the PC profiler of picosim
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Reads the profile /CONF80/PCPROF.DAT written by the PC profiler and
+ * the listings of the z80asm assembler for the programs, and prints
+ * the labels and the source lines where the most samples were taken.
+ * The format of the profile is described in srcsim/disks.c.
+ *
+ * Usage: pcprof [-b bank] [-n lines] profile [listing ...]
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define LIS_LOC		0	/* column of the address in a listing */
+#define LIS_OBJ		6	/* column of the object code */
+#define LIS_OBJLEN	14	/* width of the object code */
+#define LIS_SRC		32	/* column of the source code */
+
+typedef struct entry {
+	unsigned addr;		/* address of the line */
+	unsigned len;		/* bytes of object code */
+	char *text;		/* source line */
+	char *label;		/* label defined in the line, or NULL */
+	unsigned long cnt;	/* samples in the line */
+	size_t seq;		/* order in the listings */
+} entry_t;
+
+static unsigned long samples[65536];	/* samples per address */
+static unsigned long banks[256];	/* samples per bank */
+static entry_t *ents;
+static size_t nents, maxents;
+
+static void *xalloc(void *p, size_t n)
+{
+	if ((p = realloc(p, n)) == NULL) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static char *xstrdup(const char *s)
+{
+	return strcpy(xalloc(NULL, strlen(s) + 1), s);
+}
+
+/*
+ * read the samples, with bank >= 0 only those of this bank
+ */
+static unsigned long read_profile(const char *name, int bank,
+				  unsigned long *hz)
+{
+	unsigned char hdr[8], s[4];
+	unsigned long n = 0;
+	FILE *fp;
+
+	if ((fp = fopen(name, "rb")) == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)
+	    || memcmp(hdr, "PCP1", 4) != 0) {
+		fprintf(stderr, "%s: not a PC profile\n", name);
+		exit(EXIT_FAILURE);
+	}
+	*hz = hdr[4] | (hdr[5] << 8) | ((unsigned long) hdr[6] << 16)
+	      | ((unsigned long) hdr[7] << 24);
+
+	while (fread(s, 1, sizeof(s), fp) == sizeof(s)) {
+		banks[s[2]]++;
+		if (bank >= 0 && s[2] != bank)
+			continue;
+		samples[s[0] | (s[1] << 8)]++;
+		n++;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+/*
+ * add the lines with an address of a listing, continuation lines
+ * of the object code get the source of the line before
+ */
+static void read_listing(const char *name)
+{
+	char line[512], *p, *q;
+	const char *text = "";
+	unsigned addr, len;
+	size_t n;
+	FILE *fp;
+	int i;
+
+	if ((fp = fopen(name, "r")) == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (strncmp(line, "Symbol table", 12) == 0)
+			break;
+		line[strcspn(line, "\r\n")] = '\0';
+		for (i = 0; i < 4; i++)
+			if (!isxdigit((unsigned char) line[LIS_LOC + i]))
+				break;
+		if (i < 4 || line[LIS_LOC + 4] != ' ')
+			continue;
+		n = strlen(line);
+		if (n > LIS_OBJ && line[LIS_OBJ] == '=')
+			continue;	/* EQU */
+		addr = (unsigned) strtoul(line, NULL, 16);
+
+		len = 0;
+		for (p = &line[LIS_OBJ]; p < &line[LIS_OBJ + LIS_OBJLEN]
+		     && p + 1 < &line[n]; p += 3)
+			if (isxdigit((unsigned char) p[0])
+			    && isxdigit((unsigned char) p[1]))
+				len++;
+
+		if (nents == maxents) {
+			maxents = maxents ? 2 * maxents : 1024;
+			ents = xalloc(ents, maxents * sizeof(entry_t));
+		}
+		ents[nents].addr = addr;
+		ents[nents].len = len;
+		ents[nents].label = NULL;
+		ents[nents].cnt = 0;
+		ents[nents].seq = nents;
+		if (n > LIS_SRC) {
+			text = xstrdup(&line[LIS_SRC]);
+			p = &line[LIS_SRC];
+			if (isalpha((unsigned char) *p) || *p == '_'
+			    || *p == '.' || *p == '$' || *p == '?') {
+				for (q = p; *q && !isspace((unsigned char) *q)
+				     && *q != ':' && *q != ';'; q++)
+					;
+				*q = '\0';
+				ents[nents].label = xstrdup(p);
+			}
+		}
+		ents[nents++].text = (char *) text;
+	}
+	fclose(fp);
+}
+
+static int cmp_addr(const void *a, const void *b)
+{
+	const entry_t *x = a, *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	/* keep the order of the listings */
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/*
+ * the line with the object code at addr, or NULL
+ */
+static entry_t *find_line(unsigned addr)
+{
+	size_t lo = 0, hi = nents, m;
+	entry_t *e;
+
+	while (lo < hi) {
+		m = (lo + hi) / 2;
+		if (ents[m].addr <= addr)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	while (lo-- > 0) {
+		e = &ents[lo];
+		if (addr < e->addr + e->len)
+			return e;
+		if (e->len)	/* last code before addr doesn't cover it */
+			return NULL;
+	}
+	return NULL;
+}
+
+/*
+ * the label of the code at entry e
+ */
+static const char *find_label(const entry_t *e)
+{
+	size_t i = (size_t) (e - ents) + 1;
+
+	while (i-- > 0)
+		if (ents[i].label != NULL)
+			return ents[i].label;
+	return "?";
+}
+
+typedef struct sym {
+	const char *name;
+	unsigned addr;
+	unsigned long cnt;
+} sym_t;
+
+static int cmp_cnt(const void *a, const void *b)
+{
+	const sym_t *x = a, *y = b;
+
+	if (x->cnt != y->cnt)
+		return x->cnt > y->cnt ? -1 : 1;
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static int cmp_ent_cnt(const void *a, const void *b)
+{
+	const entry_t *x = *(const entry_t *const *) a;
+	const entry_t *y = *(const entry_t *const *) b;
+
+	if (x->cnt != y->cnt)
+		return x->cnt > y->cnt ? -1 : 1;
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+ * without listings print the addresses with the most samples
+ */
+static void hot_addrs(unsigned long total, int lines)
+{
+	unsigned long max;
+	unsigned a, best;
+	int i;
+
+	puts("\nAddr     Samples       %");
+	for (i = 0; i < lines; i++) {
+		max = best = 0;
+		for (a = 0; a < 65536; a++)
+			if (samples[a] > max) {
+				max = samples[a];
+				best = a;
+			}
+		if (max == 0)
+			break;
+		printf("%04X %11lu %7.2f\n", best, max, 100.0 * max / total);
+		samples[best] = 0;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b bank] [-n lines] profile "
+		"[listing ...]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long total, hz, other = 0;
+	int bank = -1, lines = 20, c;
+	size_t i, nsyms = 0, nlines = 0;
+	entry_t *e, **hot;
+	sym_t *syms;
+	const char *l;
+	unsigned a;
+
+	while ((c = getopt(argc, argv, "b:n:")) != -1) {
+		switch (c) {
+		case 'b':
+			bank = atoi(optarg);
+			break;
+		case 'n':
+			lines = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0]);
+
+	total = read_profile(argv[optind++], bank, &hz);
+	while (optind < argc)
+		read_listing(argv[optind++]);
+	qsort(ents, nents, sizeof(entry_t), cmp_addr);
+
+	printf("%lu samples", total);
+	if (hz)
+		printf(" at %lu Hz, %.1f s", hz, (double) total / hz);
+	putchar('\n');
+	if (total == 0)
+		return EXIT_SUCCESS;
+	for (c = 0; c < 256; c++)
+		if (banks[c] && (bank < 0 || bank == c))
+			printf("bank %d: %lu samples\n", c, banks[c]);
+
+	if (nents == 0) {
+		hot_addrs(total, lines);
+		return EXIT_SUCCESS;
+	}
+
+	/* samples of the lines and the labels */
+	syms = xalloc(NULL, (nents + 1) * sizeof(sym_t));
+	for (a = 0; a < 65536; a++) {
+		if (samples[a] == 0)
+			continue;
+		if ((e = find_line(a)) == NULL) {
+			other += samples[a];
+			continue;
+		}
+		e->cnt += samples[a];
+		l = find_label(e);
+		for (i = 0; i < nsyms; i++)
+			if (syms[i].name == l)
+				break;
+		if (i == nsyms) {
+			syms[nsyms].name = l;
+			syms[nsyms].addr = a;
+			syms[nsyms++].cnt = 0;
+		}
+		syms[i].cnt += samples[a];
+	}
+
+	qsort(syms, nsyms, sizeof(sym_t), cmp_cnt);
+	puts("\nLabel                Samples       %");
+	for (i = 0; i < nsyms && (int) i < lines; i++)
+		printf("%-16s %11lu %7.2f\n", syms[i].name, syms[i].cnt,
+		       100.0 * syms[i].cnt / total);
+	if (other)
+		printf("%-16s %11lu %7.2f\n", "(no listing)", other,
+		       100.0 * other / total);
+
+	hot = xalloc(NULL, (nents + 1) * sizeof(entry_t *));
+	for (i = 0; i < nents; i++)
+		if (ents[i].cnt)
+			hot[nlines++] = &ents[i];
+	qsort(hot, nlines, sizeof(entry_t *), cmp_ent_cnt);
+	puts("\nAddr     Samples       %  Source");
+	for (i = 0; i < nlines && (int) i < lines; i++)
+		printf("%04X %11lu %7.2f  %s\n", hot[i]->addr, hot[i]->cnt,
+		       100.0 * hot[i]->cnt / total, hot[i]->text);
+
+	return EXIT_SUCCESS;
+}
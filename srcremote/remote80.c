@@ -0,0 +1,367 @@
+/*
+ * Host client for the remote control channel of picosim
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Talks to the "Remote" USB CDC interface of a firmware built with
+ * -D REMOTE80=1. The frames are described in srcsim/remote.c.
+ *
+ * Usage: remote80 device command [args]
+ *	info				show the machine
+ *	load file addr [bank]		write a file into memory
+ *	dump file addr len [bank]	read memory into a file
+ *	regs				show the registers
+ *	pc addr				set the PC, while stopped
+ *	stop				stop the CPU
+ *	go				continue at the ICE prompt
+ *	break addr [len]		stop on an access of the range
+ *	clear				remove all breakpoints
+ *	perf				show the T-states and the speed
+ * Addresses and lengths are hex, the bank defaults to the one selected
+ * by the CPU.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <termios.h>
+#include <sys/types.h>
+#include <sys/select.h>
+
+#define SLIP_END	0xc0	/* SLIP frame end */
+#define SLIP_ESC	0xdb	/* SLIP escape */
+#define SLIP_ESC_END	0xdc	/* escaped frame end */
+#define SLIP_ESC_ESC	0xdd	/* escaped escape */
+
+#define MAXDATA		1024	/* max. data length of a read or write */
+#define FRAME		(4 + MAXDATA) /* max. frame length */
+#define REGS		28	/* length of the registers */
+#define CURBNK		0xff	/* the bank selected by the CPU */
+#define TIMEOUT		2	/* seconds to wait for an answer */
+
+static int tty = -1;		/* remote CDC interface of the Pico */
+static unsigned char ans[FRAME]; /* answer received */
+static size_t alen;		/* its length */
+
+static const char *const errs[] = {
+	"ok", "bad command", "no such bank", "CPU is running",
+	"not supported by the firmware"
+};
+
+/*
+ * write all bytes to the device
+ */
+static void tty_write(const unsigned char *p, size_t n)
+{
+	ssize_t w;
+
+	while (n > 0) {
+		if ((w = write(tty, p, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write tty");
+			exit(EXIT_FAILURE);
+		}
+		p += w;
+		n -= (size_t) w;
+	}
+}
+
+/*
+ * send a command and wait for its answer, exits on errors
+ */
+static void command(const unsigned char *p, size_t n)
+{
+	unsigned char buf[2 * FRAME + 2], type = p[0];
+	size_t len = 0;
+	int esc = 0, over = 0;
+	struct timeval tv;
+	fd_set fds;
+	ssize_t r, i;
+
+	buf[len++] = SLIP_END;
+	while (n-- > 0) {
+		if (*p == SLIP_END) {
+			buf[len++] = SLIP_ESC;
+			buf[len++] = SLIP_ESC_END;
+		} else if (*p == SLIP_ESC) {
+			buf[len++] = SLIP_ESC;
+			buf[len++] = SLIP_ESC_ESC;
+		} else
+			buf[len++] = *p;
+		p++;
+	}
+	buf[len++] = SLIP_END;
+	tty_write(buf, len);
+
+	alen = 0;
+	for (;;) {
+		FD_ZERO(&fds);
+		FD_SET(tty, &fds);
+		tv.tv_sec = TIMEOUT;
+		tv.tv_usec = 0;
+		if ((r = select(tty + 1, &fds, NULL, NULL, &tv)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("select");
+			exit(EXIT_FAILURE);
+		}
+		if (r == 0) {
+			fputs("no answer from the machine\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		if ((r = read(tty, buf, sizeof(buf))) <= 0) {
+			if (r < 0 && errno == EINTR)
+				continue;
+			fputs("tty closed\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < r; i++) {
+			if (buf[i] == SLIP_END) {
+				if (alen >= 2 && !over && ans[0] == type)
+					goto done;
+				alen = 0;
+				esc = over = 0;
+			} else if (buf[i] == SLIP_ESC)
+				esc = 1;
+			else {
+				if (esc) {
+					if (buf[i] == SLIP_ESC_END)
+						buf[i] = SLIP_END;
+					else if (buf[i] == SLIP_ESC_ESC)
+						buf[i] = SLIP_ESC;
+					esc = 0;
+				}
+				if (alen < FRAME)
+					ans[alen++] = buf[i];
+				else
+					over = 1;
+			}
+		}
+	}
+done:
+	if (ans[1] != 0) {
+		fprintf(stderr, "command %c: %s\n", type,
+			ans[1] < sizeof(errs) / sizeof(errs[0]) ?
+			errs[ans[1]] : "error");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static unsigned get_word(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned char *put_word(unsigned char *p, unsigned w)
+{
+	*p++ = w & 0xff;
+	*p++ = (w >> 8) & 0xff;
+	return p;
+}
+
+static unsigned hex(const char *s)
+{
+	char *end;
+	unsigned long v = strtoul(s, &end, 16);
+
+	if (*s == '\0' || *end != '\0') {
+		fprintf(stderr, "bad hex number %s\n", s);
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned) v;
+}
+
+static void open_tty(const char *dev)
+{
+	struct termios t;
+
+	if ((tty = open(dev, O_RDWR | O_NOCTTY)) < 0) {
+		perror(dev);
+		exit(EXIT_FAILURE);
+	}
+	if (tcgetattr(tty, &t) < 0) {
+		perror("tcgetattr");
+		exit(EXIT_FAILURE);
+	}
+	cfmakeraw(&t);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	if (tcsetattr(tty, TCSANOW, &t) < 0) {
+		perror("tcsetattr");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * write the file to addr in bank, in blocks of MAXDATA bytes
+ */
+static void do_load(const char *name, unsigned addr, unsigned bank)
+{
+	unsigned char cmd[FRAME];
+	unsigned long total = 0;
+	size_t n;
+	FILE *fp;
+
+	if ((fp = fopen(name, "rb")) == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	while ((n = fread(&cmd[4], 1, MAXDATA, fp)) > 0) {
+		cmd[0] = 'w';
+		cmd[1] = bank;
+		put_word(&cmd[2], addr);
+		command(cmd, 4 + n);
+		addr += (unsigned) n;
+		total += n;
+	}
+	fclose(fp);
+	printf("%lu bytes loaded\n", total);
+}
+
+/*
+ * read len bytes from addr in bank into the file
+ */
+static void do_dump(const char *name, unsigned addr, unsigned len,
+		    unsigned bank)
+{
+	unsigned char cmd[6];
+	unsigned n;
+	FILE *fp;
+
+	if ((fp = fopen(name, "wb")) == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	while (len > 0) {
+		n = len < MAXDATA ? len : MAXDATA;
+		cmd[0] = 'r';
+		cmd[1] = bank;
+		put_word(&cmd[2], addr);
+		put_word(&cmd[4], n);
+		command(cmd, sizeof(cmd));
+		if (fwrite(&ans[2], 1, alen - 2, fp) != alen - 2) {
+			perror(name);
+			exit(EXIT_FAILURE);
+		}
+		addr += n;
+		len -= n;
+	}
+	fclose(fp);
+}
+
+static void do_regs(void)
+{
+	static const char *const names[] = {
+		"AF", "BC", "DE", "HL", "AF'", "BC'", "DE'", "HL'",
+		"IX", "IY", "SP", "PC"
+	};
+	unsigned char cmd = 'g';
+	const unsigned char *r;
+	int i;
+
+	command(&cmd, 1);
+	r = &ans[2];
+	for (i = 0; i < 12; i++)
+		printf("%s=%04X%c", names[i], get_word(&r[2 * i]),
+		       i % 4 == 3 ? '\n' : ' ');
+	printf("I=%02X R=%02X IFF=%u IM=%u\n", r[24], r[25], r[26], r[27]);
+}
+
+static void do_pc(unsigned pc)
+{
+	unsigned char cmd[1 + REGS];
+
+	cmd[0] = 'g';
+	command(cmd, 1);
+	memcpy(&cmd[1], &ans[2], REGS);
+	cmd[0] = 's';
+	put_word(&cmd[1 + 22], pc);
+	command(cmd, sizeof(cmd));
+}
+
+static void do_perf(void)
+{
+	unsigned char cmd = 'p';
+	uint64_t t, us;
+	int i;
+
+	command(&cmd, 1);
+	t = us = 0;
+	for (i = 7; i >= 0; i--) {
+		t = (t << 8) | ans[2 + i];
+		us = (us << 8) | ans[10 + i];
+	}
+	printf("T-states %llu, host time %llu us, speed %u MHz\n",
+	       (unsigned long long) t, (unsigned long long) us,
+	       get_word(&ans[18]));
+	printf("CPU state %u, error %u\n", ans[20], ans[21]);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s device info|regs|stop|go|clear|perf\n"
+		"       %s device load file addr [bank]\n"
+		"       %s device dump file addr len [bank]\n"
+		"       %s device pc addr\n"
+		"       %s device break addr [len]\n",
+		prog, prog, prog, prog, prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char cmd[8];
+	const char *c;
+
+	if (argc < 3)
+		usage(argv[0]);
+	open_tty(argv[1]);
+	c = argv[2];
+
+	if (strcmp(c, "info") == 0 && argc == 3) {
+		cmd[0] = 'i';
+		command(cmd, 1);
+		printf("protocol %u, %u banks of %u bytes, CPU %u, "
+		       "max. %u bytes per frame\n", ans[2], ans[3],
+		       get_word(&ans[4]), ans[6], get_word(&ans[7]));
+	} else if (strcmp(c, "load") == 0 && (argc == 5 || argc == 6))
+		do_load(argv[3], hex(argv[4]),
+			argc == 6 ? hex(argv[5]) : CURBNK);
+	else if (strcmp(c, "dump") == 0 && (argc == 6 || argc == 7))
+		do_dump(argv[3], hex(argv[4]), hex(argv[5]),
+			argc == 7 ? hex(argv[6]) : CURBNK);
+	else if (strcmp(c, "regs") == 0 && argc == 3)
+		do_regs();
+	else if (strcmp(c, "pc") == 0 && argc == 4)
+		do_pc(hex(argv[3]));
+	else if (strcmp(c, "stop") == 0 && argc == 3) {
+		cmd[0] = 'h';
+		command(cmd, 1);
+	} else if (strcmp(c, "go") == 0 && argc == 3) {
+		cmd[0] = 'c';
+		command(cmd, 1);
+	} else if (strcmp(c, "break") == 0 && (argc == 4 || argc == 5)) {
+		cmd[0] = 'b';
+		put_word(&cmd[1], hex(argv[3]));
+		put_word(&cmd[3], argc == 5 ? hex(argv[4]) : 1);
+		command(cmd, 5);
+	} else if (strcmp(c, "clear") == 0 && argc == 3) {
+		cmd[0] = 'x';
+		command(cmd, 1);
+	} else if (strcmp(c, "perf") == 0 && argc == 3)
+		do_perf();
+	else
+		usage(argv[0]);
+
+	close(tty);
+	return EXIT_SUCCESS;
+}
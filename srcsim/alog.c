@@ -0,0 +1,115 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Asynchronous logging. The messages are formatted on core 0 into
+ * the lines of a ring buffer, without a lock, there is only one
+ * writer and one reader. alog_task() on core 1 writes the lines to
+ * the DEBUG port with DEBUG80, or else to the console. The writer
+ * must not be an interrupt handler, which could interrupt a message
+ * being formatted.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "sim.h"
+#include "simdefs.h"
+
+#include "alog.h"
+#ifdef DEBUG80
+#include "debug.h"
+#endif
+
+#if ALOG80
+
+#ifndef ALOG_LINES
+#define ALOG_LINES	16	/* lines in the ring buffer, a power of 2 */
+#endif
+#define ALOG_LEN	96	/* max. length of a line */
+#define ALOG_FLUSH_MS	200	/* alog_flush() waits that long at most */
+
+static char alog_ring[ALOG_LINES][ALOG_LEN];
+static volatile uint32_t alog_head;	/* lines written (W0 R1) */
+static volatile uint32_t alog_tail;	/* lines output (W1 R0) */
+static volatile uint32_t alog_lost;	/* lines dropped (W0 R1) */
+
+/*
+ * format a message into the next line of the ring, on core 0
+ */
+void __not_in_flash_func(alog)(int level, const char *tag,
+			       const char *fmt, ...)
+{
+	const uint32_t head = alog_head;
+	char *p;
+	va_list ap;
+	int n;
+
+	if (head - alog_tail >= ALOG_LINES) {
+		alog_lost++;
+		return;
+	}
+	p = alog_ring[head % ALOG_LINES];
+	n = snprintf(p, ALOG_LEN, "%c %s: ",
+		     "?EWID"[level >= ALOG_ERROR && level <= ALOG_DEBUG ?
+			     level : 0], tag);
+	if (n > 0 && n < ALOG_LEN) {
+		va_start(ap, fmt);
+		vsnprintf(p + n, ALOG_LEN - n, fmt, ap);
+		va_end(ap);
+	}
+	__dmb();		/* the line before the head */
+	alog_head = head + 1;
+	__sev();		/* wake up core 1 */
+}
+
+/*
+ * output the lines in the ring, on core 1
+ */
+void alog_task(void)
+{
+	static uint32_t lost;
+	uint32_t tail = alog_tail, n;
+	char buf[48];
+
+	while (tail != alog_head) {
+		__dmb();	/* the line after the head */
+#ifdef DEBUG80
+		debug_puts(alog_ring[tail % ALOG_LINES]);
+#else
+		printf("%s\n", alog_ring[tail % ALOG_LINES]);
+#endif
+		alog_tail = ++tail;
+	}
+
+	if ((n = alog_lost) != lost) {
+		snprintf(buf, sizeof(buf), "W LOG: %lu messages dropped",
+			 (unsigned long) (n - lost));
+		lost = n;
+#ifdef DEBUG80
+		debug_puts(buf);
+#else
+		printf("%s\n", buf);
+#endif
+	}
+}
+
+/*
+ * wait until core 1 wrote the lines, so that the messages of a
+ * CPU error come before its report, called when the CPU stopped
+ */
+void alog_flush(void)
+{
+	const absolute_time_t t = make_timeout_time_ms(ALOG_FLUSH_MS);
+
+	while (alog_tail != alog_head && !time_reached(t))
+		sleep_us(100);
+}
+
+#endif /* ALOG80 */
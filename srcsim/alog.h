@@ -0,0 +1,68 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Asynchronous logging through a ring buffer
+ */
+
+#ifndef ALOG_INC
+#define ALOG_INC
+
+#include <stdbool.h>
+
+/*
+ * With ALOG80 the LOGE(), LOGW(), LOGI() and LOGD() of the modules
+ * which include this header after log.h are formatted into a ring
+ * buffer, which core 1 writes to the DEBUG port with DEBUG80 or else
+ * to the console, so that a guest provoking messages doesn't stall
+ * the CPU emulation in the output. Messages above ALOG_LEVEL are
+ * left out when compiling, messages which don't fit into the ring
+ * are dropped and counted.
+ */
+#ifndef ALOG80
+#define ALOG80		0	/* log through the ring buffer */
+#endif
+
+#define ALOG_ERROR	1
+#define ALOG_WARN	2
+#define ALOG_INFO	3
+#define ALOG_DEBUG	4
+
+#if ALOG80
+
+#ifndef ALOG_LEVEL
+#define ALOG_LEVEL	ALOG_INFO	/* highest level logged */
+#endif
+
+extern void alog(int level, const char *tag, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+extern void alog_task(void), alog_flush(void);
+
+#undef LOGE
+#undef LOGW
+#undef LOGI
+#undef LOGD
+#define ALOG_AT(level, tag, fmt, ...)				\
+	do {							\
+		if (ALOG_LEVEL >= (level))			\
+			alog(level, tag, fmt, ##__VA_ARGS__);	\
+	} while (0)
+#define LOGE(tag, fmt, ...) ALOG_AT(ALOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define LOGW(tag, fmt, ...) ALOG_AT(ALOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define LOGI(tag, fmt, ...) ALOG_AT(ALOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define LOGD(tag, fmt, ...) ALOG_AT(ALOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+#else /* !ALOG80 */
+
+static inline void alog_task(void)
+{
+}
+
+static inline void alog_flush(void)
+{
+}
+
+#endif /* !ALOG80 */
+
+#endif /* !ALOG_INC */
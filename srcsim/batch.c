@@ -0,0 +1,409 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Unattended batch jobs, for nightly regression runs and builds
+ * without a terminal. If BATCH_FILE exists the script in it is run
+ * once after the power on, a command per line:
+ *
+ *	# text		comment
+ *	expect text	wait until text is output to the console SIO1
+ *	send text	type text and a CR into the console
+ *	type text	type text without the CR
+ *	timeout n	an expect waits n seconds at most, 0 is forever
+ *	speed n		CPU speed in kHz, 0 is unlimited
+ *	log text	note in the log
+ *	halt		stop the machine
+ *
+ * The text may have the escapes \r, \n, \t, \e (ESC), \\ and \xHH.
+ * The typed characters are returned by the console input, one per
+ * read, the next command follows when all were read. An expect
+ * matches only output after it was reached. The machine runs at an
+ * unlimited speed unless the script sets one, and the console is
+ * always ready for output, so it runs without a terminal attached,
+ * the machine has to be configured with autoboot. The run ends with
+ * a halt from the script, the hardware control port or a CPU error,
+ * or when an expect times out. Then the steps with the seconds and
+ * T-states since the start, and the result with the emulated clock,
+ * are written into BATCH_LOG.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "pico/stdlib.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+#include "batch.h"
+#include "picosim.h"
+#include "sched.h"
+
+#if BATCH80
+
+#ifndef BATCH_TIMEOUT
+#define BATCH_TIMEOUT	600	/* seconds an expect waits by default */
+#endif
+#define BATCH_TEXT	128	/* max. length of an expect or send text */
+#define BATCH_CHECK_T	1000000	/* T-states between timeout checks */
+
+#define BS_OFF		0	/* no batch job */
+#define BS_RUN		1	/* running the next commands */
+#define BS_TYPE		2	/* typing the text */
+#define BS_EXPECT	3	/* waiting for the text */
+#define BS_DONE		4	/* script done, the machine runs on */
+
+static bool ran;		/* the script was run since the power on */
+static int state = BS_OFF;
+static char script[BATCH_SIZE + 1];
+static size_t spos, slen;	/* next line, length of the script */
+static int line;		/* number of the current line */
+
+static char text[BATCH_TEXT];	/* decoded text of the command */
+static size_t text_len, text_pos;
+
+static char tail[BATCH_TEXT];	/* the last console output */
+static uint32_t tail_n;		/* bytes output to the console */
+
+static uint64_t start_us, due_us; /* start, end of the expect or 0 */
+static uint64_t timeout_us;
+static Tstates_t start_T;
+static bool timed_out;
+
+static char logbuf[BATCH_LOG_SIZE];
+static size_t log_len;
+
+/*
+ * append to the log, the line starts with the seconds and T-states
+ * since the start
+ */
+static void batch_log(const char *fmt, ...)
+{
+	uint64_t us = time_us_64() - start_us;
+	va_list ap;
+	int n;
+
+	if (log_len >= sizeof(logbuf) - 1)
+		return;
+	n = snprintf(&logbuf[log_len], sizeof(logbuf) - log_len,
+		     "%6lu.%03lu %14llu ", (unsigned long) (us / 1000000),
+		     (unsigned long) (us / 1000 % 1000),
+		     (unsigned long long) (T - start_T));
+	if (n > 0)
+		log_len += n;
+	if (log_len < sizeof(logbuf) - 1) {
+		va_start(ap, fmt);
+		n = vsnprintf(&logbuf[log_len], sizeof(logbuf) - log_len,
+			      fmt, ap);
+		va_end(ap);
+		if (n > 0)
+			log_len += n;
+	}
+	if (log_len > sizeof(logbuf) - 2)
+		log_len = sizeof(logbuf) - 2;
+	logbuf[log_len++] = '\n';
+}
+
+/*
+ * append a character to the log line, escaped if not printable
+ */
+static void batch_log_char(char c)
+{
+	char s[5];
+
+	if (c == '\r')
+		strcpy(s, "\\r");
+	else if (c == '\n')
+		strcpy(s, "\\n");
+	else if (c == '\\')
+		strcpy(s, "\\\\");
+	else if (isprint((unsigned char) c)) {
+		s[0] = c;
+		s[1] = '\0';
+	} else
+		snprintf(s, sizeof(s), "\\x%02X", (unsigned char) c);
+	if (log_len + strlen(s) < sizeof(logbuf) - 1) {
+		memcpy(&logbuf[log_len], s, strlen(s));
+		log_len += strlen(s);
+	}
+}
+
+/*
+ * decode the text of a command with its escapes
+ */
+static void decode(const char *s)
+{
+	char c, hex[3];
+
+	text_len = 0;
+	while ((c = *s++) != '\0' && text_len < sizeof(text) - 1) {
+		if (c == '\\' && *s != '\0') {
+			switch (c = *s++) {
+			case 'r':
+				c = '\r';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'e':
+				c = 0x1b;
+				break;
+			case 'x':
+				hex[0] = *s;
+				hex[1] = hex[0] ? s[1] : '\0';
+				hex[2] = '\0';
+				c = (char) strtoul(hex, NULL, 16);
+				s += strlen(hex);
+				break;
+			default:	/* \\ and all others */
+				break;
+			}
+		}
+		text[text_len++] = c;
+	}
+}
+
+/*
+ * stop the machine, like the halt of the hardware control port
+ */
+static void batch_halt(void)
+{
+	cpu_error = IOHALT;
+	cpu_state = ST_STOPPED;
+	state = BS_DONE;
+}
+
+/*
+ * run the commands of the script until one has to wait
+ */
+static void batch_step(void)
+{
+	char *p, *cmd, *eol;
+
+	while (state == BS_RUN) {
+		if (spos >= slen) {
+			batch_log("script done");
+			state = BS_DONE;
+			return;
+		}
+		p = &script[spos];
+		if ((eol = strchr(p, '\n')) != NULL) {
+			*eol = '\0';
+			spos = eol - script + 1;
+		} else
+			spos = slen;
+		if ((eol = strchr(p, '\r')) != NULL)
+			*eol = '\0';
+		line++;
+
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p == '\0' || *p == '#')
+			continue;
+		cmd = p;
+		while (*p != '\0' && !isspace((unsigned char) *p))
+			p++;
+		if (*p != '\0')
+			*p++ = '\0';
+		while (isspace((unsigned char) *p))
+			p++;
+
+		if (!strcmp(cmd, "expect")) {
+			decode(p);
+			if (text_len == 0)
+				continue;
+			due_us = timeout_us ? time_us_64() + timeout_us : 0;
+			state = BS_EXPECT;
+		} else if (!strcmp(cmd, "send") || !strcmp(cmd, "type")) {
+			decode(p);
+			if (cmd[0] == 's' && text_len < sizeof(text))
+				text[text_len++] = '\r';
+			text_pos = 0;
+			if (text_len > 0)
+				state = BS_TYPE;
+		} else if (!strcmp(cmd, "timeout"))
+			timeout_us = strtoull(p, NULL, 10) * 1000000;
+		else if (!strcmp(cmd, "speed"))
+			set_speed_khz(atoi(p));
+		else if (!strcmp(cmd, "log"))
+			batch_log("line %d: %s", line, p);
+		else if (!strcmp(cmd, "halt")) {
+			batch_log("line %d: halt", line);
+			batch_halt();
+		} else
+			batch_log("line %d: unknown command %s", line, cmd);
+	}
+}
+
+/*
+ * end the run if the expect waited too long, the last output
+ * is logged
+ */
+static void batch_check(void)
+{
+	uint32_t i, n;
+
+	if (state != BS_EXPECT || due_us == 0 || time_us_64() < due_us)
+		return;
+
+	batch_log("line %d: timeout, the last output:", line);
+	n = tail_n < BATCH_TEXT ? tail_n : BATCH_TEXT;
+	for (i = tail_n - n; i != tail_n; i++)
+		batch_log_char(tail[i % BATCH_TEXT]);
+	if (log_len < sizeof(logbuf))
+		logbuf[log_len++] = '\n';
+	timed_out = true;
+	batch_halt();
+}
+
+/*
+ * event of the scheduler for the timeouts, also if the program
+ * doesn't use the console
+ */
+static void batch_tick(void)
+{
+	batch_check();
+	if (state != BS_DONE && state != BS_OFF)
+		sched_post(T + BATCH_CHECK_T, batch_tick);
+}
+
+bool batch_active(void)
+{
+	return state != BS_OFF;
+}
+
+/*
+ * console status: the output is always ready, input is available
+ * while the text is typed
+ */
+BYTE batch_status(BYTE stat)
+{
+	if (state == BS_OFF)
+		return stat;
+	batch_check();
+	stat &= 0b01111111;
+	if (state == BS_TYPE)
+		stat &= 0b11111110;
+	return stat;
+}
+
+/*
+ * next character typed for the console, -1 if none
+ */
+int batch_in(void)
+{
+	int c;
+
+	if (state != BS_TYPE)
+		return -1;
+	c = (unsigned char) text[text_pos++];
+	if (text_pos == text_len) {
+		state = BS_RUN;
+		batch_step();
+	}
+	return c;
+}
+
+/*
+ * console output, checked for the text of an expect
+ */
+void batch_out(BYTE data)
+{
+	register size_t i;
+
+	if (state == BS_OFF)
+		return;
+	tail[tail_n++ % BATCH_TEXT] = (char) data;
+	if (state != BS_EXPECT) {
+		batch_check();
+		return;
+	}
+
+	if ((char) data == text[text_len - 1] && tail_n >= text_len) {
+		for (i = 1; i < text_len; i++)
+			if (tail[(tail_n - 1 - i) % BATCH_TEXT]
+			    != text[text_len - 1 - i])
+				break;
+		if (i == text_len) {
+			batch_log("line %d: expect ok", line);
+			state = BS_RUN;
+			batch_step();
+			return;
+		}
+	}
+	batch_check();
+}
+
+/*
+ * load BATCH_FILE and start the script, only the first time
+ * after the power on, called when the machine starts
+ */
+void batch_start(void)
+{
+	if (ran)
+		return;
+	ran = true;
+	if ((slen = batch_load(script, BATCH_SIZE)) == 0)
+		return;
+	script[slen] = '\0';
+
+	spos = 0;
+	line = 0;
+	tail_n = 0;
+	log_len = 0;
+	timed_out = false;
+	timeout_us = (uint64_t) BATCH_TIMEOUT * 1000000;
+	start_us = time_us_64();
+	start_T = T;
+	printf("Running the batch job %s\n", BATCH_FILE);
+	batch_log("start %s, %u bytes", BATCH_FILE, (unsigned) slen);
+
+	set_speed_khz(0);	/* at full speed unless the script sets one */
+	state = BS_RUN;
+	batch_step();
+	sched_post(T + BATCH_CHECK_T, batch_tick);
+}
+
+/*
+ * write the log with the result, called when the machine stops
+ */
+void batch_stop(void)
+{
+	uint64_t us;
+	Tstates_t t;
+
+	if (state == BS_OFF)
+		return;
+	sched_cancel(batch_tick);
+
+	if (timed_out)
+		batch_log("end: timeout");
+	else if (cpu_error == IOHALT)
+		batch_log("end: halted by I/O");
+	else
+		batch_log("end: stopped, CPU error %d", cpu_error);
+	us = time_us_64() - start_us;
+	t = T - start_T;
+	batch_log("clock %lu.%02lu MHz",
+		  (unsigned long) (us ? t / us : 0),
+		  (unsigned long) (us ? t * 100 / us % 100 : 0));
+	state = BS_OFF;
+
+	if (batch_save(logbuf, log_len))
+		printf("Batch job log written to %s\n", BATCH_LOG);
+	else
+		printf("can't write %s\n", BATCH_LOG);
+}
+
+#endif /* BATCH80 */
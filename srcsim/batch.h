@@ -0,0 +1,61 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Unattended batch jobs with scripted console input
+ */
+
+#ifndef BATCH_INC
+#define BATCH_INC
+
+#include <stddef.h>
+#include "sim.h"
+#include "simdefs.h"
+
+/*
+ * With BATCH80 the machine runs the script BATCH_FILE after the power
+ * on, if there is one. The script types lines into the console SIO1
+ * and waits for text in its output, the steps with their times and
+ * the result of the run are written to BATCH_LOG when the machine
+ * stops. See batch.c for the commands.
+ */
+#ifndef BATCH80
+#define BATCH80		0	/* batch jobs from BATCH_FILE */
+#endif
+
+#if BATCH80
+
+#define BATCH_FILE	"/CONF80/BATCH.TXT"
+#define BATCH_LOG	"/CONF80/BATCH.LOG"
+#define BATCH_SIZE	4096	/* max. size of the script */
+#define BATCH_LOG_SIZE	4096	/* max. size of the log */
+
+extern void batch_start(void), batch_stop(void);
+extern bool batch_active(void);
+extern BYTE batch_status(BYTE stat);
+extern int batch_in(void);
+extern void batch_out(BYTE data);
+
+/* reading the script and writing the log, in disks.c */
+extern size_t batch_load(char *buf, size_t size);
+extern bool batch_save(const char *buf, size_t len);
+
+#else /* !BATCH80 */
+
+static inline void batch_start(void)
+{
+}
+
+static inline void batch_stop(void)
+{
+}
+
+static inline bool batch_active(void)
+{
+	return false;
+}
+
+#endif /* !BATCH80 */
+
+#endif /* !BATCH_INC */
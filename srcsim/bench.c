@@ -0,0 +1,286 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Benchmark kernels for the ICE, for comparing firmware builds and
+ * the platforms with a repeatable number. Each kernel is a loop
+ * stored at 0000H and run without the CPU speed throttle for BENCH_MS.
+ * From the T states of one pass of the loop and the operations in it
+ * the emulated clock and the time per operation are calculated.
+ *
+ * Memory from 0000H to 03FFH, the CPU registers and the devices
+ * used are restored afterwards:
+ *	0000H - 00FFH	code of the kernels, stack below 0100H
+ *	0100H - 01FFH	data of the kernels and the disk sector buffer
+ *	0200H - 03FFH	Dazzler picture
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include "pico/time.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simcore.h"
+
+#ifdef WANT_ICE
+
+#include "sd-fdc.h"
+#include "dazzler.h"
+#include "disks.h"
+#include "bench.h"
+
+#define BENCH_MEM	0x0400	/* memory used by the benchmark */
+#define BENCH_SP	0x0100	/* stack of the kernels */
+#define BENCH_DMA	0x0100	/* sector buffer of the disk benchmark */
+
+typedef struct bench_code {
+	const BYTE *code;
+	BYTE len;
+	unsigned t;		/* T states of one pass of the loop */
+	unsigned ops;		/* operations in one pass of the loop */
+} bench_code_t;
+
+typedef struct bench {
+	const char *name;
+	const char *unit;	/* what an operation is */
+	bench_code_t z80, i8080; /* i8080.code NULL if Z80 only */
+} bench_t;
+
+#define CODE(c, t, n)	{ c, sizeof(c), t, n }
+
+/*
+ *	LOOP:	ADD A,B / ADC A,C / SUB D / XOR E / AND H / OR L / CP B
+ *		INC A / DEC B / RLCA / ADD HL,BC / INC DE / JP LOOP
+ */
+static const BYTE alu[] = {
+	0x80, 0x89, 0x92, 0xab, 0xa4, 0xb5, 0xb8, 0x3c, 0x05, 0x07,
+	0x09, 0x13, 0xc3, 0x00, 0x00
+};
+
+/*
+ *	LOOP:	LD HL,0100H / LD DE,0180H / LD BC,0080H / LDIR / JP LOOP
+ */
+static const BYTE move_z80[] = {
+	0x21, 0x00, 0x01, 0x11, 0x80, 0x01, 0x01, 0x80, 0x00,
+	0xed, 0xb0, 0xc3, 0x00, 0x00
+};
+
+/*
+ *	LOOP:	LXI H,0100H / LXI D,0180H / LXI B,0080H
+ *	MOVE:	MOV A,M / STAX D / INX H / INX D / DCX B / MOV A,B / ORA C
+ *		JNZ MOVE / JMP LOOP
+ */
+static const BYTE move_8080[] = {
+	0x21, 0x00, 0x01, 0x11, 0x80, 0x01, 0x01, 0x80, 0x00,
+	0x7e, 0x12, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2, 0x09, 0x00,
+	0xc3, 0x00, 0x00
+};
+
+/*
+ *	LOOP:	CALL SUB / JP LOOP
+ *	SUB:	RET
+ */
+static const BYTE call[] = {
+	0xcd, 0x06, 0x00, 0xc3, 0x00, 0x00, 0xc9
+};
+
+/*
+ *		LD IX,0100H / LD IY,0100H
+ *	LOOP:	LD A,(IX+1) / ADD A,(IY+2) / LD (IX+3),A / INC IX / DEC IX
+ *		INC (IY+4) / BIT 0,(IX+5) / JP LOOP
+ */
+static const BYTE xy[] = {
+	0xdd, 0x21, 0x00, 0x01, 0xfd, 0x21, 0x00, 0x01,
+	0xdd, 0x7e, 0x01, 0xfd, 0x86, 0x02, 0xdd, 0x77, 0x03,
+	0xdd, 0x23, 0xdd, 0x2b, 0xfd, 0x34, 0x04, 0xdd, 0xcb, 0x05, 0x46,
+	0xc3, 0x08, 0x00
+};
+
+/*
+ *	LOOP:	IN A,(0FFH) / OUT (0FFH),A / IN A,(0EH) / JP LOOP
+ */
+static const BYTE port[] = {
+	0xdb, 0xff, 0xd3, 0xff, 0xdb, 0x0e, 0xc3, 0x00, 0x00
+};
+
+/*
+ *		LD A,81H / OUT (0EH),A / XOR A / OUT (0FH),A / LD HL,0200H
+ *	LOOP:	INC (HL) / INC HL / LD A,H / AND 01H / OR 02H / LD H,A
+ *		JP LOOP
+ */
+static const BYTE dazzler[] = {
+	0x3e, 0x81, 0xd3, 0x0e, 0xaf, 0xd3, 0x0f, 0x21, 0x00, 0x02,
+	0x34, 0x23, 0x7c, 0xe6, 0x01, 0xf6, 0x02, 0x67, 0xc3, 0x0a, 0x00
+};
+
+static const bench_t kernels[] = {
+	{ "ALU mix", "inst", CODE(alu, 67, 13), CODE(alu, 67, 13) },
+	{ "Memory move", "byte", CODE(move_z80, 2723, 128),
+	  CODE(move_8080, 6184, 128) },
+	{ "Call/return", "inst", CODE(call, 37, 3), CODE(call, 37, 3) },
+	{ "IX/IY prefixes", "inst", CODE(xy, 130, 8), { NULL, 0, 0, 0 } },
+	{ "Port I/O", "inst", CODE(port, 43, 4), CODE(port, 40, 4) }
+};
+
+static const bench_t dazzler_kernel = {
+	"Dazzler", "inst", CODE(dazzler, 49, 7), CODE(dazzler, 49, 7)
+};
+
+static BYTE save_mem[BENCH_MEM];
+
+/*
+ * callback of the alarm, stops the CPU at the end of a kernel
+ */
+static int64_t bench_timeout(alarm_id_t id, void *user_data)
+{
+	UNUSED(id);
+	UNUSED(user_data);
+
+	cpu_state = ST_STOPPED;
+	return 0;
+}
+
+/*
+ * run a kernel and print the results, false if interrupted by the user
+ */
+static bool bench_kernel(const bench_t *b)
+{
+	const bench_code_t *k = cpu == Z80 ? &b->z80 : &b->i8080;
+	Tstates_t T0;
+	uint64_t t0, us;
+	double passes;
+	register int i;
+
+	if (k->code == NULL) {
+		printf("%-16s (Z80 only)\n", b->name);
+		return true;
+	}
+
+	for (i = 0; i < k->len; i++)
+		putmem(i, k->code[i]);
+	PC = 0;
+	SP = BENCH_SP;
+	T0 = T;
+	t0 = time_us_64();
+	add_alarm_in_ms(BENCH_MS, bench_timeout, NULL, true);
+	run_cpu();
+	us = time_us_64() - t0;
+	if (cpu_error != NONE) {
+		puts("Interrupted by user");
+		return false;
+	}
+
+	passes = (double) (T - T0) / k->t;
+	printf("%-16s %8.2f MHz %8.1f ns/%s\n", b->name,
+	       (double) (T - T0) / us, us * 1000.0 / (passes * k->ops),
+	       b->unit);
+	return true;
+}
+
+/*
+ * read the disk in drive A sector by sector, until the end of the
+ * disk or BENCH_MS are over
+ */
+static void bench_disk(void)
+{
+	int track = 0, sector = 1;
+	uint32_t n = 0;
+	uint64_t t0, us;
+
+	if (disks[0][0] == '\0') {
+		printf("%-16s no disk in drive A\n", "Disk read");
+		return;
+	}
+
+	t0 = time_us_64();
+	while ((us = time_us_64() - t0) < BENCH_MS * 1000ULL) {
+		if (read_sec(0, track, sector, BENCH_DMA) != FDC_STAT_OK) {
+			if (sector == 1)
+				break;	/* end of the disk */
+			track++;
+			sector = 1;
+			continue;
+		}
+		sector++;
+		n++;
+	}
+
+	if (n)
+		printf("%-16s %8lu KB/s %7.1f us/sector\n", "Disk read",
+		       (unsigned long) ((uint64_t) n * SEC_SZ * 1000000 /
+					us / 1024), (double) us / n);
+	else
+		printf("%-16s read error\n", "Disk read");
+}
+
+/*
+ * run the Dazzler kernel, which changes the picture all the time,
+ * and print the time the LCD task needed for drawing a frame
+ */
+static bool bench_dazzler(void)
+{
+	BYTE ctl = dazzler_ctl(), format = dazzler_format();
+	uint32_t f0, f;
+	uint64_t us0, us;
+	bool ok;
+
+	dazzler_draw_stats(&f0, &us0);
+	ok = bench_kernel(&dazzler_kernel);
+	dazzler_draw_stats(&f, &us);
+	dazzler_format_out(format);
+	dazzler_ctl_out(ctl);
+
+	if (ok && f > f0)
+		printf("%-16s %8lu frames %6.1f us/frame\n", "Dazzler draw",
+		       (unsigned long) (f - f0),
+		       (double) (us - us0) / (f - f0));
+	return ok;
+}
+
+void run_bench(void)
+{
+	BYTE A0 = A, B0 = B, C0 = C, D0 = D, E0 = E, H0 = H, L0 = L;
+	BYTE IFF0 = IFF, led0 = fp_led_output;
+	WORD IX0 = IX, IY0 = IY, SP0 = SP, PC0 = PC;
+	int F0 = F, f_value0 = f_value, tmax0 = tmax;
+#ifdef WANT_HB
+	bool hb_flag0 = hb_flag;
+#endif
+	register int i;
+
+#ifdef WANT_HB
+	hb_flag = false;
+#endif
+	for (i = 0; i < BENCH_MEM; i++)
+		save_mem[i] = getmem(i);
+	IFF = 0;		/* no interrupts */
+	f_value = 0;		/* no CPU speed throttle */
+	tmax = 100000;
+
+	printf("Benchmark %s, %d ms per kernel\n",
+	       cpu == Z80 ? "Z80" : "8080", BENCH_MS);
+	for (i = 0; i < (int) count_of(kernels); i++)
+		if (!bench_kernel(&kernels[i]))
+			break;
+	if (i == (int) count_of(kernels) && bench_dazzler())
+		bench_disk();
+
+	for (i = 0; i < BENCH_MEM; i++)
+		putmem(i, save_mem[i]);
+	A = A0; B = B0; C = C0; D = D0; E = E0; H = H0; L = L0; F = F0;
+	IX = IX0; IY = IY0; SP = SP0; PC = PC0; IFF = IFF0;
+	fp_led_output = led0;
+	f_value = f_value0;
+	tmax = tmax0;
+#ifdef WANT_HB
+	hb_flag = hb_flag0;
+#endif
+}
+
+#endif /* WANT_ICE */
@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Benchmark kernels for the ICE
+ */
+
+#ifndef BENCH_INC
+#define BENCH_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#ifndef BENCH_MS	/* run time of each benchmark kernel in ms */
+#define BENCH_MS 2000
+#endif
+
+extern void run_bench(void);
+
+#endif /* !BENCH_INC */
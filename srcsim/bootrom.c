@@ -3,7 +3,11 @@ unsigned char code[MEMSIZE] = {
 	0xf3, 0xaf, 0x32, 0x00, 0xf0, 0x32, 0x02, 0xf0, 0x32, 0x03, 0xf0, 0x3e,
 	0x01, 0x32, 0x01, 0xf0, 0x3e, 0x10, 0xd3, 0x04, 0x3e, 0x00, 0xd3, 0x04,
 	0x3e, 0xf0, 0xd3, 0x04, 0x3e, 0x20, 0xd3, 0x04, 0xdb, 0x04, 0xb7, 0xca,
-	0x00, 0x00, 0xfe, 0x02, 0xca, 0x00, 0x00, 0x76
+	0x2c, 0xff, 0xfe, 0x02, 0xca, 0x00, 0x00, 0x76, 0x2a, 0x76, 0x00, 0x7d,
+	0xfe, 0x44, 0xc2, 0x00, 0x00, 0x7c, 0xfe, 0x4c, 0xc2, 0x00, 0x00, 0x3e,
+	0x10, 0xd3, 0x09, 0x3e, 0x7a, 0xd3, 0x09, 0x3e, 0x00, 0xd3, 0x09, 0x3e,
+	0x20, 0xd3, 0x09, 0xdb, 0x09, 0xb7, 0xc2, 0x00, 0x00, 0x31, 0xff, 0x00,
+	0x2a, 0x78, 0x00, 0xe9
 };
-unsigned short code_length = 44;
+unsigned short code_length = 88;
 unsigned short code_load_addr = 0xff00;
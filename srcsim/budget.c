@@ -0,0 +1,101 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Accounting of the time of core 0 to its subsystems, so that it can
+ * be seen why the CPU emulation doesn't reach a clock frequency.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "simdefs.h"
+
+#include "budget.h"
+#if LIB_STDIO_MSC_USB
+#include "stdio_msc_usb.h"
+#endif
+
+#if CPU_BUDGET
+
+uint64_t budget_cycles[BUDGETS]; /* cycles of the subsystems */
+int budget_cur = BUDGET_CPU;	/* subsystem running */
+uint32_t budget_stamp;		/* cycle count of the last switch */
+
+/*
+ * start the cycle counter of core 0 and clear the accounting
+ */
+void budget_init(void)
+{
+	uint32_t save;
+
+#if PICO_RP2040
+	systick_hw->csr = 0;
+	systick_hw->rvr = BUDGET_MASK;
+	systick_hw->cvr = 0;
+	systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS
+			  | M0PLUS_SYST_CSR_ENABLE_BITS;
+#elif defined(__riscv)
+	__asm volatile ("csrci 0x320, 1"); /* mcountinhibit.CY */
+#else
+	m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+	m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+#endif
+
+	save = save_and_disable_interrupts();
+	memset(budget_cycles, 0, sizeof(budget_cycles));
+	budget_cur = BUDGET_CPU;
+	budget_stamp = budget_count();
+	restore_interrupts(save);
+}
+
+/*
+ * print the share of the subsystems in the time of core 0
+ * since budget_init()
+ */
+void report_budget(void)
+{
+	static const char *const names[BUDGETS] = {
+		"CPU", "I/O", "disk", "USB", "timers", "sleep"
+	};
+	uint64_t c[BUDGETS], total = 0;
+	uint32_t save;
+	register int i;
+
+	save = save_and_disable_interrupts();
+	budget_exit(budget_enter(BUDGET_CPU)); /* account up to now */
+	memcpy(c, budget_cycles, sizeof(c));
+	restore_interrupts(save);
+
+	for (i = 0; i < BUDGETS; i++)
+		total += c[i];
+	if (total == 0)
+		return;
+
+	printf("Core 0 time:");
+	for (i = 0; i < BUDGETS; i++)
+		printf(" %s %.1f%%%s", names[i], 100.0 * c[i] / total,
+		       i < BUDGETS - 1 ? "," : "\n");
+}
+
+#if LIB_STDIO_MSC_USB && STDIO_MSC_USB_TASK_HOOKS
+/*
+ * called by stdio_msc_usb around the USB task
+ */
+int stdio_msc_usb_task_enter(void)
+{
+	return budget_enter(BUDGET_USB);
+}
+
+void stdio_msc_usb_task_exit(int prev)
+{
+	budget_exit(prev);
+}
+#endif
+
+#endif /* CPU_BUDGET */
@@ -0,0 +1,121 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Accounting of the time of core 0 to its subsystems
+ */
+
+#ifndef BUDGET_INC
+#define BUDGET_INC
+
+#include "pico.h"
+#include "hardware/sync.h"
+
+/*
+ * With CPU_BUDGET the cycles core 0 spends in the port I/O handlers,
+ * the FDC sector transfers, the USB task and the timer callbacks are
+ * counted with the cycle counter of the core, DWT on the Cortex-M33,
+ * mcycle on Hazard3 and SysTick on the Cortex-M0+. The cycles spent
+ * outside of them are the CPU emulation, or the sleeps of the speed
+ * throttle.
+ * The SysTick counter has 24 bits, the periodic callback of the LCD
+ * status display makes sure there are less than 2^24 cycles between
+ * two switches.
+ */
+#ifndef CPU_BUDGET
+#define CPU_BUDGET	0	/* cycle budget of core 0 */
+#endif
+
+#define BUDGET_CPU	0	/* CPU emulation */
+#define BUDGET_IO	1	/* port I/O handlers */
+#define BUDGET_DISK	2	/* FDC sector transfers */
+#define BUDGET_USB	3	/* USB task */
+#define BUDGET_ALARM	4	/* timer callbacks */
+#define BUDGET_SLEEP	5	/* sleeps of the speed throttle */
+#define BUDGETS		6
+
+#if CPU_BUDGET
+
+#if PICO_RP2040
+#include "hardware/structs/systick.h"
+#elif !defined(__riscv)
+#include "hardware/structs/m33.h"
+#endif
+
+#if PICO_RP2040
+#define BUDGET_MASK	0xffffffU
+#else
+#define BUDGET_MASK	0xffffffffU
+#endif
+
+extern uint64_t budget_cycles[BUDGETS];
+extern int budget_cur;
+extern uint32_t budget_stamp;
+
+extern void budget_init(void);
+extern void report_budget(void);
+
+/* cycle counter counting up, BUDGET_MASK bits */
+static inline uint32_t budget_count(void)
+{
+#if PICO_RP2040
+	return BUDGET_MASK - systick_hw->cvr;
+#elif defined(__riscv)
+	uint32_t c;
+
+	__asm volatile ("csrr %0, mcycle" : "=r" (c));
+	return c;
+#else
+	return m33_hw->dwt_cyccnt;
+#endif
+}
+
+/*
+ * account the cycles up to now to the current subsystem and switch
+ * to budget b, returns the previous one for budget_exit()
+ */
+static inline int budget_enter(int b)
+{
+	uint32_t save, now;
+	int prev;
+
+	if (get_core_num())
+		return b;
+	save = save_and_disable_interrupts();
+	now = budget_count();
+	prev = budget_cur;
+	budget_cycles[prev] += (now - budget_stamp) & BUDGET_MASK;
+	budget_stamp = now;
+	budget_cur = b;
+	restore_interrupts(save);
+
+	return prev;
+}
+
+static inline void budget_exit(int prev)
+{
+	(void) budget_enter(prev);
+}
+
+#define BUDGET_ENTER(b)	int budget_prev = budget_enter(b)
+#define BUDGET_EXIT()	budget_exit(budget_prev)
+
+#else /* !CPU_BUDGET */
+
+static inline int budget_enter(int b)
+{
+	return b;
+}
+
+static inline void budget_exit(int prev)
+{
+	(void) prev;
+}
+
+#define BUDGET_ENTER(b)
+#define BUDGET_EXIT()
+
+#endif /* !CPU_BUDGET */
+
+#endif /* !BUDGET_INC */
@@ -6,6 +6,7 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 #include "pico.h"
 #include "pico/time.h"
 
@@ -19,6 +20,11 @@
 #include "dazzler.h"
 #include "draw.h"
 #include "lcd.h"
+#include "picosim.h"
+
+#if DAZZLER_INTERP
+#include "hardware/interp.h"
+#endif
 
 /* Graphics stuff */
 #if COLOR_DEPTH == 12
@@ -35,6 +41,20 @@ static const uint16_t __not_in_flash("color_map") grays[16] = {
 	0x0888, 0x0999, 0x0aaa, 0x0bbb,
 	0x0ccc, 0x0ddd, 0x0eee, 0x0fff
 };
+#elif COLOR_DEPTH == 8
+/* 332 RGB colors and grays */
+static const uint16_t __not_in_flash("color_map") colors[16] = {
+	0x00, 0x80, 0x10, 0x90,
+	0x02, 0x82, 0x12, 0x92,
+	0x00, 0xe0, 0x1c, 0xfc,
+	0x03, 0xe3, 0x1f, 0xff
+};
+static const uint16_t __not_in_flash("color_map") grays[16] = {
+	0x00, 0x00, 0x24, 0x24,
+	0x49, 0x49, 0x6d, 0x6d,
+	0x92, 0x92, 0xb6, 0xb6,
+	0xdb, 0xdb, 0xff, 0xff
+};
 #else
 /* 565 RGB colors and grays */
 static const uint16_t __not_in_flash("color_map") colors[16] = {
@@ -140,181 +160,435 @@ static const draw_ro_pixmap_t dazzler_bitmap = {
 /* DAZZLER stuff */
 static bool state;
 static WORD dma_addr;
-static BYTE flags = 64;
+static BYTE dma_bank;
+static const BYTE flags = 64;
 static BYTE format;
 static uint16_t x_off, y_off;
+static bool redraw;
+
+/*
+ * The x offset is even, so that the pixels are drawn in pairs, which
+ * are looked up already packed in tables for the current format.
+ */
+static draw_pair_t hires_lut[4];	/* pixel pairs of two bits */
+static draw_pair_t lowres_lut[16];	/* pixel pairs of a nibble */
+
+#if DAZZLER_SCALE
+/*
+ * With DAZZLER_SCALE the 128 x 128 picture is scaled to the height
+ * of the panel. Pixel n of a line or column is drawn from scale[n]
+ * to scale[n + 1] - 1, nearest neighbour with the extra pixels
+ * spread evenly. The picture is drawn in spans of single colors.
+ */
+static uint16_t scale[129];		/* scaled start of each pixel */
+static uint16_t size = 128;		/* scaled size of the picture */
+static uint16_t hires_colors[2];	/* background and foreground */
+static const uint16_t *lowres_colors;	/* color map */
+#else
+static const uint16_t size = 128;	/* size of the picture */
+#endif
+
+/*
+ * The frame flag is low for DAZZLER_VBLANK_US at the start of every
+ * frame. The time is the emulated time from the T-states, so that
+ * programs syncing on it get the same frame rate at any CPU speed,
+ * and the host time if the CPU runs unlimited.
+ */
+#define DAZZLER_FRAME_US	16667	/* 60 Hz frames */
+#define DAZZLER_VBLANK_US	4000
+
+static uint32_t draw_frames;		/* frames drawn */
+static uint64_t draw_us;		/* time spent drawing them */
 
-static inline void pixel(uint16_t x, uint16_t y, uint16_t color)
+static inline void put(uint16_t x, uint16_t y, draw_pair_t pp)
 {
-	draw_pixel(x_off + x, y_off + y, color);
+	draw_put_pair(x_off + x, y_off + y, pp);
 }
 
-/* draw pixels for one frame in hires */
-static void __not_in_flash_func(draw_hires)(void)
+#if DAZZLER_SCALE
+/* draw the w x h pixels at x, y of the picture scaled in one color */
+static inline void put_scaled(uint16_t x, uint16_t y, uint16_t w,
+			      uint16_t h, uint16_t color)
 {
-	int x, y, i, j, c;
-	WORD addr = dma_addr;
-	unsigned int cmap[2];
-	unsigned int c0, c1, c2, c3, c4, c5, c6, c7;
+	uint16_t sx = x_off + scale[x], sw = scale[x + w] - scale[x];
+	uint16_t sy = y_off + scale[y], sy1 = y_off + scale[y + h];
+
+	for (; sy < sy1; sy++)
+		draw_hspan(sx, sy, sw, color);
+}
+
+/* set up the scale table for a picture of size n */
+static void dazzler_scale(uint16_t n)
+{
+	register int i;
+
+	for (i = 0; i <= 128; i++)
+		scale[i] = (i * n) / 128;
+	size = n;
+}
+#endif
+
+#if DAZZLER_INTERP
+/*
+ * With DAZZLER_INTERP the table entries are addressed by the
+ * interpolators of core 1. The DMA byte times 4 is written into
+ * accumulator 0 of both, each lane masks the two bits (hires) or
+ * the nibble (lowres) for its pixel pair out of it, shifted into
+ * place by the lane shift, and adds the table address. Lowres only
+ * uses the two lanes of interp0.
+ */
+static void __not_in_flash_func(dazzler_interp)(BYTE fmt)
+{
+	interp_config cfg;
+	uintptr_t base;
+	unsigned int bits;
+	register int lane;
+
+	if (fmt & 64) {		/* hires, four pairs of two bits */
+		base = (uintptr_t) hires_lut;
+		bits = 2;
+	} else {		/* lowres, two pairs of a nibble */
+		base = (uintptr_t) lowres_lut;
+		bits = 4;
+	}
+
+	for (lane = 0; lane < 4; lane++) {
+		cfg = interp_default_config();
+		interp_config_set_shift(&cfg, lane * bits);
+		interp_config_set_mask(&cfg, 2, 2 + bits - 1);
+		interp_config_set_cross_input(&cfg, (lane & 1) != 0);
+		interp_set_config(lane < 2 ? interp0 : interp1, lane & 1,
+				  &cfg);
+	}
+	interp0->base[0] = interp0->base[1] = base;
+	interp1->base[0] = interp1->base[1] = base;
+}
+
+/* the pixel pair for lane n of the DMA byte in the accumulators */
+#define LUT0(c)	(interp0->accum[0] = interp1->accum[0] = (c) << 2, \
+		 *(draw_pair_t *) (uintptr_t) interp0->peek[0])
+#define LUT1()	(*(draw_pair_t *) (uintptr_t) interp0->peek[1])
+#define LUT2()	(*(draw_pair_t *) (uintptr_t) interp1->peek[0])
+#define LUT3()	(*(draw_pair_t *) (uintptr_t) interp1->peek[1])
+#endif
+
+/* set up the pixel pair tables for the format */
+static void __not_in_flash_func(dazzler_luts)(BYTE fmt)
+{
+	const uint16_t *cmap = (fmt & 16) ? colors : grays;
+	uint16_t fg = cmap[fmt & 0x0f];
+	register int i;
+
+	/* hires: color or grayscale from lower nibble in graphics format */
+	for (i = 0; i < 4; i++)
+		hires_lut[i] = draw_pack_pair((i & 1) ? fg : C_BLACK,
+					      (i & 2) ? fg : C_BLACK);
+	for (i = 0; i < 16; i++)
+		lowres_lut[i] = draw_pack_pair(cmap[i], cmap[i]);
+#if DAZZLER_SCALE
+	hires_colors[0] = C_BLACK;
+	hires_colors[1] = fg;
+	lowres_colors = cmap;
+#endif
+#if DAZZLER_INTERP
+	dazzler_interp(fmt);
+#endif
+}
+
+/*
+ * The display memory is drawn in lines of 16 bytes, 32 lines with 512
+ * bytes and 128 lines with 2048 bytes, where the lines of the four
+ * 64 x 64 pixel quadrants follow each other.
+ */
+#define LINE_BYTES	16
+
+/*
+ * The bank selected when the DMA address is set is latched, the frames
+ * are drawn from its memory with direct pointers to the pages, looked
+ * up at the start of each frame. So a bank switch of the CPU on core 0
+ * doesn't change the memory of a frame drawn on core 1.
+ */
+#define DMA_PAGES	(2048 / PAGESIZ)
+
+static const BYTE *dma_pg[DMA_PAGES];	/* pages of the display memory */
+
+/*
+ * look up the pages of the display memory in the latched bank,
+ * returns false if the bank isn't in SRAM now
+ */
+static bool __not_in_flash_func(dazzler_pages)(void)
+{
+	const BYTE *bank = NULL;
+	WORD a;
+	int i;
+
+	if (dma_bank != 0 && dma_bank <= numseg &&
+	    (bank = bank_addr(dma_bank)) == NULL)
+		return false;
+	for (i = 0; i < DMA_PAGES; i++) {
+		a = dma_addr + i * PAGESIZ;
+		dma_pg[i] = bank == NULL || a >= segsiz ? &bnk0[a] : &bank[a];
+	}
+	return true;
+}
+
+/* memory of line n, the lines don't cross a page */
+static inline const BYTE *dma_line(int n)
+{
+	return dma_pg[(n * LINE_BYTES) / PAGESIZ] +
+	       (n * LINE_BYTES) % PAGESIZ;
+}
+
+#if DAZZLER_INTERP
+#define HIRES_PAIRS(c)	p0 = LUT0(c); p1 = LUT1(); p2 = LUT2(); p3 = LUT3()
+#define LOWRES_PAIRS(c)	p0 = LUT0(c); p1 = LUT1()
+#else
+#define HIRES_PAIRS(c)	p0 = hires_lut[(c) & 3];			\
+			p1 = hires_lut[((c) >> 2) & 3];			\
+			p2 = hires_lut[((c) >> 4) & 3];			\
+			p3 = hires_lut[(c) >> 6]
+#define LOWRES_PAIRS(c)	p0 = lowres_lut[(c) & 0x0f];			\
+			p1 = lowres_lut[(c) >> 4]
+#endif
 
-	/* set color or grayscale from lower nibble in graphics format */
-	c = format & 0x0f;
-	cmap[0] = C_BLACK;
-	cmap[1] = (format & 16) ? colors[c] : grays[c];
+/* draw pixels for one line in hires */
+static void __not_in_flash_func(draw_hires)(int n)
+{
+	int x, y, i, j, c;
+	const BYTE *p = dma_line(n);
+	draw_pair_t p0, p1, p2, p3;
 
 	if (format & 32) {	/* 2048 bytes memory */
-		for (j = 0; j < 128; j += 64) {
-			for (i = 0; i < 128; i += 64) {
-				for (y = j; y < j + 64; y += 2) {
-					for (x = i; x < i + 64;) {
-						c = dma_read(addr++);
-						c0 = cmap[c & 1];
-						c1 = cmap[(c >> 1) & 1];
-						c2 = cmap[(c >> 2) & 1];
-						c3 = cmap[(c >> 3) & 1];
-						c4 = cmap[(c >> 4) & 1];
-						c5 = cmap[(c >> 5) & 1];
-						c6 = cmap[(c >> 6) & 1];
-						c7 = cmap[(c >> 7) & 1];
-						pixel(x, y, c0);
-						pixel(x + 1, y, c1);
-						pixel(x, y + 1, c2);
-						pixel(x + 1, y + 1, c3);
-						x += 2;
-						pixel(x, y, c4);
-						pixel(x + 1, y, c5);
-						pixel(x, y + 1, c6);
-						pixel(x + 1, y + 1, c7);
-						x += 2;
-					}
-				}
-			}
+		i = (n & 32) ? 64 : 0;
+		y = ((n & 64) ? 64 : 0) + (n & 31) * 2;
+		for (x = i; x < i + 64; x += 4) {
+			c = *p++;
+			HIRES_PAIRS(c);
+			put(x, y, p0);
+			put(x, y + 1, p1);
+			put(x + 2, y, p2);
+			put(x + 2, y + 1, p3);
 		}
 	} else {		/* 512 bytes memory */
-		for (j = 0; j < 128; j += 4) {
-			for (i = 0; i < 128; i += 8) {
-				c = dma_read(addr++);
-				c0 = cmap[c & 1];
-				c1 = cmap[(c >> 1) & 1];
-				c2 = cmap[(c >> 2) & 1];
-				c3 = cmap[(c >> 3) & 1];
-				c4 = cmap[(c >> 4) & 1];
-				c5 = cmap[(c >> 5) & 1];
-				c6 = cmap[(c >> 6) & 1];
-				c7 = cmap[(c >> 7) & 1];
-				for (y = j; y < j + 4; y += 2) {
-					for (x = i; x < i + 8;) {
-						pixel(x, y, c0);
-						pixel(x + 1, y, c1);
-						pixel(x, y + 1, c2);
-						pixel(x + 1, y + 1, c3);
-						x += 2;
-						pixel(x, y, c4);
-						pixel(x + 1, y, c5);
-						pixel(x, y + 1, c6);
-						pixel(x + 1, y + 1, c7);
-						x += 2;
-					}
+		j = n * 4;
+		for (i = 0; i < 128; i += 8) {
+			c = *p++;
+			HIRES_PAIRS(c);
+			for (y = j; y < j + 4; y += 2) {
+				for (x = i; x < i + 8; x += 4) {
+					put(x, y, p0);
+					put(x, y + 1, p1);
+					put(x + 2, y, p2);
+					put(x + 2, y + 1, p3);
 				}
 			}
 		}
 	}
 }
 
-/* draw pixels for one frame in lowres */
-static void __not_in_flash_func(draw_lowres)(void)
+/* draw pixels for one line in lowres */
+static void __not_in_flash_func(draw_lowres)(int n)
 {
 	int x, y, i, j, c;
-	WORD addr = dma_addr;
-	const uint16_t *cmap;
-	unsigned int c0, c1;
+	const BYTE *p = dma_line(n);
+	draw_pair_t p0, p1;
 
-	cmap = (format & 16) ? colors : grays;
 	/* get size of DMA memory and draw the pixels */
 	if (format & 32) {	/* 2048 bytes memory */
-		for (j = 0; j < 128; j += 64) {
-			for (i = 0; i < 128; i += 64) {
-				for (y = j; y < j + 64; y += 2) {
-					for (x = i; x < i + 64;) {
-						c = dma_read(addr++);
-						c0 = cmap[c & 0x0f];
-						c1 = cmap[(c >> 4) & 0x0f];
-						pixel(x, y, c0);
-						pixel(x + 1, y, c0);
-						pixel(x, y + 1, c0);
-						pixel(x + 1, y + 1, c0);
-						x += 2;
-						pixel(x, y, c1);
-						pixel(x + 1, y, c1);
-						pixel(x, y + 1, c1);
-						pixel(x + 1, y + 1, c1);
-						x += 2;
-					}
-				}
-			}
+		i = (n & 32) ? 64 : 0;
+		y = ((n & 64) ? 64 : 0) + (n & 31) * 2;
+		for (x = i; x < i + 64; x += 4) {
+			c = *p++;
+			LOWRES_PAIRS(c);
+			put(x, y, p0);
+			put(x, y + 1, p0);
+			put(x + 2, y, p1);
+			put(x + 2, y + 1, p1);
 		}
 	} else {		/* 512 bytes memory */
-		for (j = 0; j < 128; j += 4) {
-			for (i = 0; i < 128; i += 8) {
-				c = dma_read(addr++);
-				c0 = cmap[c & 0x0f];
-				c1 = cmap[(c >> 4) & 0x0f];
-				for (y = j; y < j + 4; y += 2) {
-					for (x = i; x < i + 8;) {
-						pixel(x, y, c0);
-						pixel(x + 1, y, c0);
-						pixel(x, y + 1, c0);
-						pixel(x + 1, y + 1, c0);
-						x += 2;
-						pixel(x, y, c1);
-						pixel(x + 1, y, c1);
-						pixel(x, y + 1, c1);
-						pixel(x + 1, y + 1, c1);
-						x += 2;
-					}
+		j = n * 4;
+		for (i = 0; i < 128; i += 8) {
+			c = *p++;
+			LOWRES_PAIRS(c);
+			for (y = j; y < j + 4; y++) {
+				for (x = i; x < i + 8; x += 4) {
+					put(x, y, p0);
+					put(x + 2, y, p1);
 				}
 			}
 		}
 	}
 }
 
+#if DAZZLER_SCALE
+/* draw one line in hires scaled, bit n is the pixel at x + xn, y + yn */
+static void __not_in_flash_func(draw_hires_scaled)(int n)
+{
+	static const uint8_t __not_in_flash("color_map") xn[8] = {
+		0, 1, 0, 1, 2, 3, 2, 3
+	};
+	static const uint8_t __not_in_flash("color_map") yn[8] = {
+		0, 0, 1, 1, 0, 0, 1, 1
+	};
+	int x, y, i, b, c;
+	const BYTE *p = dma_line(n);
+
+	if (format & 32) {	/* 2048 bytes memory */
+		i = (n & 32) ? 64 : 0;
+		y = ((n & 64) ? 64 : 0) + (n & 31) * 2;
+		for (x = i; x < i + 64; x += 4) {
+			c = *p++;
+			for (b = 0; b < 8; b++, c >>= 1)
+				put_scaled(x + xn[b], y + yn[b], 1, 1,
+					   hires_colors[c & 1]);
+		}
+	} else {		/* 512 bytes memory, the same as unscaled */
+		y = n * 4;
+		for (x = 0; x < 128; x += 8) {
+			c = *p++;
+			for (b = 0; b < 8; b++, c >>= 1)
+				for (i = 0; i < 4; i++)
+					put_scaled(x + xn[b] + (i & 1) * 4,
+						   y + yn[b] + (i & 2), 1, 1,
+						   hires_colors[c & 1]);
+		}
+	}
+}
+
+/* draw one line in lowres scaled */
+static void __not_in_flash_func(draw_lowres_scaled)(int n)
+{
+	int x, y, i, c;
+	const BYTE *p = dma_line(n);
+
+	if (format & 32) {	/* 2048 bytes memory */
+		i = (n & 32) ? 64 : 0;
+		y = ((n & 64) ? 64 : 0) + (n & 31) * 2;
+		for (x = i; x < i + 64; x += 4) {
+			c = *p++;
+			put_scaled(x, y, 2, 2, lowres_colors[c & 0x0f]);
+			put_scaled(x + 2, y, 2, 2, lowres_colors[c >> 4]);
+		}
+	} else {		/* 512 bytes memory, the same as unscaled */
+		y = n * 4;
+		for (x = 0; x < 128; x += 8) {
+			c = *p++;
+			for (i = 0; i < 8; i += 4) {
+				put_scaled(x + i, y, 2, 4,
+					   lowres_colors[c & 0x0f]);
+				put_scaled(x + i + 2, y, 2, 4,
+					   lowres_colors[c >> 4]);
+			}
+		}
+	}
+}
+
+#define draw_hires	draw_hires_scaled
+#define draw_lowres	draw_lowres_scaled
+#endif /* DAZZLER_SCALE */
+
+/*
+ * check if all lines must be drawn, because the format or the memory
+ * mapped at the display memory changed, or the display was set up
+ */
+static bool __not_in_flash_func(dazzler_redraw)(void)
+{
+	static WORD last_addr;
+	static BYTE last_format;
+	static const BYTE *last_pg;
+	const BYTE *pg = dma_pg[0];
+	bool all = redraw;
+
+	/* another bank latched has other memory at the same address */
+	if (dma_addr != last_addr || format != last_format || pg != last_pg)
+		all = true;
+	/* the pixel pairs for the colors change with the format */
+	if (all)
+		dazzler_luts(format);
+	last_addr = dma_addr;
+	last_format = format;
+	last_pg = pg;
+	redraw = false;
+
+	return all;
+}
+
+/* check if line n was written since the last frame */
+static inline bool line_changed(int n)
+{
+#if MEM_WATCH
+	if (!watch_line[n])
+		return false;
+	watch_line[n] = 0;
+#else
+	UNUSED(n);
+#endif
+	return true;
+}
+
 static void __not_in_flash_func(dazzler_draw)(bool first)
 {
+	int i, n;
+	bool all;
+	uint32_t t;
+
 	if (first) {
-		x_off = (draw_pixmap->width - 128) / 2;
-		y_off = (draw_pixmap->height - 128) / 2;
-		draw_clear(C_BLACK);
-		draw_bitmap(x_off - cromemco_bitmap.width - 25,
-			    (draw_pixmap->height - cromemco_bitmap.height) / 2,
-			    &cromemco_bitmap, C_GRAY);
-		draw_bitmap(x_off + 128 + 25,
-			    (draw_pixmap->height - dazzler_bitmap.height) / 2,
-			    &dazzler_bitmap, C_GRAY);
+#if DAZZLER_SCALE
+		dazzler_scale(draw_pixmap->height);
+#endif
+		x_off = (draw_pixmap->width - size) / 2;
+		y_off = (draw_pixmap->height - size) / 2;
+		if (!lcd_bg_restore(dazzler_draw, size)) {
+			draw_clear(C_BLACK);
+			draw_bitmap(x_off - cromemco_bitmap.width - 25,
+				    (draw_pixmap->height -
+				     cromemco_bitmap.height) / 2,
+				    &cromemco_bitmap, C_GRAY);
+			draw_bitmap(x_off + size + 25,
+				    (draw_pixmap->height -
+				     dazzler_bitmap.height) / 2,
+				    &dazzler_bitmap, C_GRAY);
+			lcd_bg_save(dazzler_draw, size);
+		}
+		redraw = true;
 	} else {
-		if (format & 64)
-			draw_hires();
-		else
-			draw_lowres();
-
-		/* frame done, set frame flag for 4ms */
-		flags = 0;
-		sleep_ms(4);
-		flags = 64;
+		if (!dazzler_pages())
+			return;		/* keep the last frame */
+		t = time_us_32();
+		n = (format & 32) ? 2048 / LINE_BYTES : 512 / LINE_BYTES;
+		all = dazzler_redraw();
+		for (i = 0; i < n; i++) {
+			if (!line_changed(i) && !all)
+				continue;
+			if (format & 64)
+				draw_hires(i);
+			else
+				draw_lowres(i);
+		}
+		draw_us += time_us_32() - t;
+		draw_frames++;
 	}
 }
 
 void dazzler_ctl_out(BYTE data)
 {
-	/* get DMA address for display memory */
+	/* get DMA address for display memory, in the bank selected now */
 	dma_addr = (data & 0x7f) << 9;
+	dma_bank = selbnk;
 
 	/* switch DAZZLER on/off */
 	if (data & 128) {
+#if MEM_WATCH
+		mem_watch(dma_addr, 2048);
+#endif
 		if (!state) {
 			state = true;
 			lcd_custom_disp(dazzler_draw);
 		}
 	} else {
+#if MEM_WATCH
+		mem_watch(0, 0);
+#endif
 		if (state) {
 			state = false;
 			lcd_status_disp(LCD_STATUS_CURRENT);
@@ -324,10 +598,55 @@ void dazzler_ctl_out(BYTE data)
 
 BYTE dazzler_flags_in(void)
 {
-	return flags;
+	uint64_t us;
+
+	if (!state)
+		return flags;
+
+	if (speed)
+		us = T * 1000 / (unsigned) speed_khz;
+	else
+		us = time_us_64();
+
+	return (us % DAZZLER_FRAME_US) < DAZZLER_VBLANK_US ? 0 : flags;
 }
 
 void dazzler_format_out(BYTE data)
 {
 	format = data;
 }
+
+/*
+ * print the average time for drawing a frame, for comparing
+ * the drawing with and without DAZZLER_INTERP
+ */
+void dazzler_report(void)
+{
+	if (draw_frames)
+		printf("Dazzler: %lu frames drawn in %llu us average\n",
+		       (unsigned long) draw_frames,
+		       (unsigned long long) (draw_us / draw_frames));
+}
+
+/*
+ * the number of frames drawn and the time spent drawing them,
+ * for the benchmark of the ICE
+ */
+void dazzler_draw_stats(uint32_t *frames, uint64_t *us)
+{
+	*frames = draw_frames;
+	*us = draw_us;
+}
+
+/*
+ * the last control and format values, for machine snapshots
+ */
+BYTE dazzler_ctl(void)
+{
+	return (state ? 128 : 0) | (dma_addr >> 9);
+}
+
+BYTE dazzler_format(void)
+{
+	return format;
+}
@@ -11,7 +11,17 @@
 #include "sim.h"
 #include "simdefs.h"
 
+#ifndef DAZZLER_INTERP	/* look up the pixels with the interpolators */
+#define DAZZLER_INTERP 0
+#endif
+#ifndef DAZZLER_SCALE	/* scale the picture to the full panel height */
+#define DAZZLER_SCALE 0
+#endif
+
 extern void dazzler_ctl_out(BYTE data), dazzler_format_out(BYTE data);
 extern BYTE dazzler_flags_in(void);
+extern BYTE dazzler_ctl(void), dazzler_format(void);
+extern void dazzler_report(void);
+extern void dazzler_draw_stats(uint32_t *frames, uint64_t *us);
 
 #endif /* !DAZZLER_INC */
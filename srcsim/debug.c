@@ -5,24 +5,44 @@
  *
  * This module implements a TX UART on the DEBUG port, GP 2 is TX,
  * and stdio compatible functions debug_* to print on this port.
+ * With TRACE80 the port sends the binary trace stream instead.
  *
  * History:
  * 06-JUN-2025 first implementation
+ * 14-OCT-2026 follow changes of the system clock
+ * 14-OCT-2026 binary trace stream fed by DMA
  */
 
+#include <string.h>
 #include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "hardware/pio.h"
+#include "hardware/sync.h"
 #include "uart_tx.pio.h"
 
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
 #include "gpio.h"
 #include "debug.h"
+#include "trace.h"
 
+#if TRACE80
+#define SERIAL_BAUD	TRACE_BAUD	/* baud rate we use */
+#else
 #define SERIAL_BAUD	115200	/* baud rate we use */
+#endif
 
 /* PIO and sm we use */
 static PIO pio = pio1;
 static uint sm;
 
+#if TRACE80
+static void trace_init(void);
+#endif
+
 /*
  * initialialize TX UART using PIO
  * must be called before output to the port
@@ -35,6 +55,19 @@ void debug_init(void)
 	/* setup the GPIO as TX UART */
 	uint offset = pio_add_program(pio, &uart_tx_program);
 	uart_tx_program_init(pio, sm, offset, WAVESHARE_DEBUG_TX_PIN, SERIAL_BAUD);
+
+#if TRACE80
+	trace_init();
+#endif
+}
+
+/*
+ * set the PIO clock divider again after the system clock was changed
+ */
+void debug_clock_changed(void)
+{
+	pio_sm_set_clkdiv(pio, sm,
+			  (float) clock_get_hz(clk_sys) / (8 * SERIAL_BAUD));
 }
 
 /*
@@ -42,7 +75,180 @@ void debug_init(void)
  */
 void debug_puts(const char *s)
 {
+#if TRACE80
+	trace_text(s);
+#else
 	uart_tx_program_puts(pio, sm, s);
 	uart_tx_program_putc(pio, sm, '\r');
 	uart_tx_program_putc(pio, sm, '\n');
+#endif
+}
+
+#if TRACE80
+
+/*
+ * The trace stream is a sequence of records, each starts with the
+ * record type followed by its data, words are little endian:
+ *
+ *	01H	PC (2), opcode		opcode fetch (M1 cycle)
+ *	02H	port, data		input from an I/O port
+ *	03H	port, data		output to an I/O port
+ *	04H	drive, track, sector,	sectors read, status is the
+ *		count, status		FDC status
+ *	05H	drive, track, sector,	sectors written
+ *		count, status
+ *	06H	bank			bank selected
+ *	07H	source, vector		interrupt requested
+ *	08H	length, text		output of debug_puts()
+ *	09H	count (2)		records dropped before this one
+ *	A5H	5AH, us (4), T (4)	time since boot and T states
+ *
+ * A5H 5AH is sent every TRACE_SYNC_US while there are records, so
+ * a decoder started in the middle of the stream can synchronize.
+ * The ring buffer is aligned to its size for the ring mode of the
+ * DMA channel, which reads it with the DREQ of the PIO TX FIFO.
+ */
+#ifndef TRACE_RING_BITS		/* size of the ring buffer in bits */
+#if PICO_RP2040
+#define TRACE_RING_BITS	12
+#else
+#define TRACE_RING_BITS	14
+#endif
+#endif
+#define TRACE_RING	(1U << TRACE_RING_BITS)
+#define TRACE_MSK	(TRACE_RING - 1)
+#define TRACE_SYNC_US	1000	/* period of the sync records */
+#define TRACE_TEXT	64	/* maximum text of a record */
+
+volatile BYTE trace_mask = TRACE_MASK;	/* events traced */
+
+static BYTE trace_ring[TRACE_RING] __attribute__((aligned(TRACE_RING)));
+static uint32_t trace_head;	/* bytes written into the ring */
+static uint32_t trace_sent;	/* bytes given to the DMA channel */
+static uint32_t trace_lost;	/* records dropped */
+static bool trace_new;		/* records since the last sync */
+static uint trace_dma;		/* DMA channel */
+static spin_lock_t *trace_lock;	/* for the records of both cores */
+static repeating_timer_t trace_timer;
+
+/*
+ * start the DMA channel with the new bytes, if it is idle,
+ * called with trace_lock held
+ */
+static inline void trace_kick(void)
+{
+	if (trace_head != trace_sent && !dma_channel_is_busy(trace_dma)) {
+		dma_channel_set_trans_count(trace_dma,
+					    trace_head - trace_sent, true);
+		trace_sent = trace_head;
+	}
+}
+
+/*
+ * copy a record into the ring if there is room for it,
+ * called with trace_lock held
+ */
+static bool __not_in_flash_func(trace_put)(const BYTE *rec, unsigned len)
+{
+	uint32_t used;
+
+	used = trace_head - trace_sent
+	       + dma_channel_hw_addr(trace_dma)->transfer_count;
+	if (TRACE_RING - used < len)
+		return false;
+	while (len--)
+		trace_ring[trace_head++ & TRACE_MSK] = *rec++;
+	return true;
 }
+
+void __not_in_flash_func(trace_write)(const BYTE *rec, unsigned len)
+{
+	BYTE lost[3];
+	uint32_t save, n;
+
+	save = spin_lock_blocking(trace_lock);
+	if (trace_lost) {
+		n = trace_lost > 0xffff ? 0xffff : trace_lost;
+		lost[0] = TR_LOST;
+		lost[1] = n & 0xff;
+		lost[2] = n >> 8;
+		if (trace_put(lost, sizeof(lost)))
+			trace_lost -= n;
+	}
+	if (trace_lost || !trace_put(rec, len))
+		trace_lost++;
+	else
+		trace_new = true;
+	trace_kick();
+	spin_unlock(trace_lock, save);
+}
+
+void trace_text(const char *s)
+{
+	BYTE rec[2 + TRACE_TEXT];
+	size_t n = strlen(s);
+
+	do {
+		rec[0] = TR_TEXT;
+		rec[1] = n > TRACE_TEXT ? TRACE_TEXT : n;
+		memcpy(&rec[2], s, rec[1]);
+		trace_write(rec, 2 + rec[1]);
+		s += rec[1];
+		n -= rec[1];
+	} while (n);
+}
+
+/*
+ * timer callback, sends the sync record and the bytes which
+ * came in while the DMA channel was busy
+ */
+static bool __not_in_flash_func(trace_sync)(repeating_timer_t *rt)
+{
+	BYTE rec[10];
+	uint32_t save, us, t;
+
+	UNUSED(rt);
+
+	save = spin_lock_blocking(trace_lock);
+	if (trace_new) {
+		us = time_us_32();
+		t = (uint32_t) T;
+		rec[0] = TR_SYNC;
+		rec[1] = TR_SYNC2;
+		rec[2] = us & 0xff;
+		rec[3] = (us >> 8) & 0xff;
+		rec[4] = (us >> 16) & 0xff;
+		rec[5] = us >> 24;
+		rec[6] = t & 0xff;
+		rec[7] = (t >> 8) & 0xff;
+		rec[8] = (t >> 16) & 0xff;
+		rec[9] = t >> 24;
+		if (trace_put(rec, sizeof(rec)))
+			trace_new = false;
+	}
+	trace_kick();
+	spin_unlock(trace_lock, save);
+
+	return true;
+}
+
+static void trace_init(void)
+{
+	dma_channel_config c;
+
+	trace_lock = spin_lock_init(spin_lock_claim_unused(true));
+	trace_dma = (uint) dma_claim_unused_channel(true);
+
+	c = dma_channel_get_default_config(trace_dma);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_ring(&c, false, TRACE_RING_BITS);
+	channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+	dma_channel_configure(trace_dma, &c, &pio->txf[sm], trace_ring, 0,
+			      false);
+
+	add_repeating_timer_us(-TRACE_SYNC_US, trace_sync, NULL, &trace_timer);
+}
+
+#endif /* TRACE80 */
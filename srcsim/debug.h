@@ -1,2 +1,3 @@
 extern void debug_init(void);
+extern void debug_clock_changed(void);
 extern void debug_puts(const char *s);
@@ -11,11 +11,75 @@
  * 28-MAY-2024 implemented sector I/O to disk images
  * 03-JUN-2024 added directory list for code files and disk images
  * 29-JUN-2024 split of from memsim.c and picosim.c
+ * 14-OCT-2026 keep the disk image files open while mounted
+ * 14-OCT-2026 added track cache for sector reads
+ * 14-OCT-2026 write-back track cache with flush on idle
+ * 14-OCT-2026 added multi sector transfers
+ * 14-OCT-2026 use block transfers to and from memory
+ * 14-OCT-2026 transfer sectors directly from/to memory if possible
+ * 14-OCT-2026 use fast seek with a cluster link map for the disk images
+ * 14-OCT-2026 added RAM disk
+ * 14-OCT-2026 added hard disk geometry
+ * 14-OCT-2026 lock the SD card also without cache for use from core 1
+ * 14-OCT-2026 read ahead tracks on sequential access
+ * 14-OCT-2026 unskew floppy disks with logical sector order
+ * 14-OCT-2026 added disk statistics
+ * 14-OCT-2026 added copy-on-write overlays
+ * 14-OCT-2026 added swap_disk() for changing disks at runtime
+ * 14-OCT-2026 load files with block transfers, .COM and Intel HEX files
+ * 14-OCT-2026 cache the directories of disk images and code files
+ * 14-OCT-2026 per track CRCs of the disk images in sidecar files
+ * 14-OCT-2026 added compressed disk images
+ * 14-OCT-2026 read the boot disk from a copy in flash
+ * 14-OCT-2026 added machine snapshots
+ * 14-OCT-2026 added file transfers from and to /XFER80
+ * 14-OCT-2026 added directory search in /XFER80
+ * 14-OCT-2026 added printer spool to /PRINT80
+ * 14-OCT-2026 set the SDIO clock again after system clock changes
+ * 14-OCT-2026 read-only USB mass storage access while the machine runs
+ * 14-OCT-2026 the mounted disk images as USB mass storage LUNs
+ * 14-OCT-2026 end idle SD multiple block writes
+ * 14-OCT-2026 SDIO clock up to 50 MHz in high speed mode
+ * 14-OCT-2026 cache FAT sectors
+ * 14-OCT-2026 create contiguous images, direct sector I/O for them
+ * 14-OCT-2026 raw block I/O for contiguous images
+ * 14-OCT-2026 added MicroSD card statistics
+ * 14-OCT-2026 added PC sampling profiler
+ * 14-OCT-2026 account the time of the sector transfers and callbacks
+ * 14-OCT-2026 sector transfers in the trace stream
+ * 14-OCT-2026 event buffer for the recording and replay of runs
+ * 14-OCT-2026 warm the track cache with the first tracks of a disk
+ * 14-OCT-2026 read ahead also on sequential reads at the end of a track
+ * 14-OCT-2026 up to 16 drives sharing a pool of open disk images
+ * 14-OCT-2026 several disk images in flash, read uncached
+ * 14-OCT-2026 optionally the track cache is the buffer of USB mass storage
+ * 14-OCT-2026 buffers and caches in the memory usage report
+ * 14-OCT-2026 reading the script and writing the log of batch jobs
+ * 14-OCT-2026 capture of the console and printer output to /LOG80
+ * 14-OCT-2026 warm the track cache with the tracks read at the last start
+ * 14-OCT-2026 PC samples accounted per bank and console
+ * 14-OCT-2026 append the performance records of PERFLOG80
+ * 14-OCT-2026 lazy remount of a lost MicroSD card, no panic without one
+ * 14-OCT-2026 direct sector I/O for exFAT images without a FAT chain
+ * 14-OCT-2026 ICE memory ranges saved to and loaded from /CODE80
+ * 14-OCT-2026 defragment the disk images in /DISKS80
+ * 14-OCT-2026 write back whole blocks of the card from the track cache
+ * 14-OCT-2026 sector transfers into a latched bank for core 1
+ * 14-OCT-2026 only plain 8.3 names for the files in /XFER80
+ * 14-OCT-2026 keep the CRC sidecar open, update it without track reads
+ * 14-OCT-2026 convert the images between physical and logical order
+ * 15-OCT-2026 logical sector order recorded in a sidecar of the image
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "pico/flash.h"
+#include "pico/mutex.h"
+#include "pico/time.h"
+#include "hardware/irq.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
 
 #include "sim.h"
 #include "simdefs.h"
@@ -25,21 +89,395 @@
 #include "ff.h"
 #include "f_util.h"
 #include "hw_config.h"
+#include "diskio.h"
+#include "SDIO/SdioCard.h"
+#if LIB_STDIO_MSC_USB
+#include "tusb.h"
+#include "stdio_msc_usb.h"
+#endif
 
 #include "sd-fdc.h"
 #include "disks.h"
 #include "draw.h"
 #include "lcd.h"
+#include "budget.h"
+#include "memuse.h"
+#include "trace.h"
+#include "replay.h"
+#include "batch.h"
+#include "perflog.h"
 
-FIL sd_file;	/* at any time we have only one file open */
+FIL sd_file;	/* for config and code files, only one open at any time */
 FRESULT sd_res;	/* result code from FatFS */
-char disks[NUMDISK][DISKLEN+1]; /* path name for 4 disk images /DISKS80/filename.DSK */
+char disks[NUMDISK][DISKLEN+1]; /* path names of the disk images /DISKS80/filename.DSK */
+BYTE disk_type[NUMDISK];	/* geometry of the disk images */
+bool disk_linear[NUMDISK];	/* BIOS sends logical sector numbers */
+bool disk_overlay[NUMDISK];	/* writes go to an overlay file */
+disk_stats_t disk_stats[NUMDISK]; /* I/O statistics of the drives */
+BYTE disk_readahead = DISK_READAHEAD; /* number of tracks read ahead */
+BYTE disk_warm;			/* tracks of disk 0 cached at the start */
+bool disk_learn;		/* tracks read at the last start cached */
+bool disk_flash;		/* read the disks stored in flash from there */
+
+/* geometry for the disk types */
+static const struct {
+	int maxtrk;		/* highest track number */
+	int spt;		/* sectors per track */
+} geom[] = {
+	[DISK_FD] = { TRK, SPT },
+	[DISK_HD] = { HD_TRK - 1, HD_SPT },
+	[DISK_FDL] = { TRK, SPT }
+};
+
+/*
+ * Physical to logical sector for the 8" floppy disks with a skew of 6,
+ * the inverse of the translation table in the BIOS. The data tracks of
+ * a DISK_FDL image hold the sectors in logical order, so that sequential
+ * reads by CP/M are sequential on the SD card. If the BIOS doesn't
+ * translate the sectors for such a disk it sets disk_linear. The order
+ * belongs to the image, an image NAME.DSK in logical order has an
+ * empty sidecar NAME.FDL next to it, which is checked whenever the
+ * image is opened.
+ */
+static const BYTE fd_unskew[SPT] = {
+	1, 14, 10, 23, 6, 19, 2, 15, 11, 24, 7, 20, 3,
+	16, 12, 25, 8, 21, 4, 17, 13, 26, 9, 22, 5, 18
+};
 
 static FATFS fs; /* FatFs on MicroSD */
+static bool fs_mounted;	/* and not released for USB mass storage access */
+
+#if DISK_OVL_SECS > 0
+/*
+ * Copy-on-write overlay, the image is opened read only and written
+ * sectors go into the overlay file NAME.OVL next to it. The overlay
+ * is a log of records with the sector number in the image layout,
+ * 4 bytes little endian, followed by the sector, a sector written
+ * again updates its record in place. Deleting the overlay file
+ * resets the disk to the unmodified image. When the overlay is opened
+ * an index sorted by sector number is built, so that a lookup needs
+ * a binary search and nothing is read from the overlay for sectors
+ * which aren't in it.
+ */
+#define OVL_RECSZ	(4 + SEC_SZ)	/* size of an overlay record */
+
+typedef struct ovl_ent {
+	uint16_t sec;	/* sector number in the image layout */
+	uint16_t rec;	/* record number in the overlay file */
+} ovl_ent_t;
+#endif
+
+#if DISK_CRC
+/*
+ * Integrity check, if an image NAME.DSK has a sidecar NAME.CRC next
+ * to it, the sidecar holds a CRC-32 for every track in the image
+ * layout of SPT sectors, 4 bytes little endian. The CRC of a track is
+ * updated whenever modified sectors are written to the image, so that
+ * verify_disks() can find images damaged by a worn out SD card with
+ * one read of the images. The CRCs are calculated by the DMA sniffer.
+ * The sidecar stays open with the image. The CRC of a track written
+ * back from the track cache or the RAM disk is calculated from the
+ * buffer, for a single sector written through the CRC is linear, the
+ * new one is the old one changed by the CRCs of the difference of the
+ * old and the new sector, followed by the zeros up to the track end.
+ * Images mounted with an overlay aren't modified, their sidecar stays
+ * valid as is. verify_disks() creates the missing sidecars, deleting
+ * a sidecar turns off the check for the image.
+ */
+#define CRC_TRKSZ	(SPT * SEC_SZ)	/* bytes per CRC */
+
+static uint crc_chan;		/* DMA channel for the CRC calculation */
+static uint32_t crc_sink;	/* write address of the DMA channel */
+static FIL crc_fil;		/* sidecar file of verify_image() */
+static BYTE __aligned(4) crc_old[SEC_SZ]; /* sector before the write */
+static const BYTE crc_zero;	/* zeros for the DMA sniffer */
+#endif
+
+#if DISK_DSZ
+/*
+ * Compressed disk images NAME.DSZ are made from NAME.DSK with
+ * compress_disk(). The file starts with the magic "DSZ", the format
+ * version 1 and the size of the uncompressed image, 4 bytes little
+ * endian. It is followed by an index with the file offsets of the
+ * tracks in the image layout of SPT sectors and the offset of the
+ * end of the last track, also 4 bytes little endian. The tracks are
+ * run length encoded like PackBits, a byte n < 128 is followed by
+ * n + 1 literal bytes, a byte n >= 128 by a byte repeated n - 126
+ * times. Tracks which don't get smaller are stored as they are.
+ * A track is decompressed when it is read into the track cache.
+ * The compressed image is never modified, it is always mounted with
+ * a copy-on-write overlay.
+ */
+#define DSZ_HDRSZ	8		/* size of the header */
+
+typedef struct dsz_in {
+	int drive;	/* drive of the compressed image */
+	UINT left;	/* bytes of the track not read yet */
+	UINT pos;	/* position in dsk_buf */
+	UINT n;		/* bytes in dsk_buf */
+} dsz_in_t;
+
+typedef struct dsz_out {
+	FIL *fp;	/* output file, NULL to count the bytes only */
+	UINT size;	/* bytes of the compressed track */
+	FRESULT res;	/* result of the writes */
+} dsz_out_t;
+
+static FIL dsz_fil;	/* compressed image written by compress_disk() */
+#endif
+
+#if FLASH_DISK
+/*
+ * Disks in flash, copies of floppy disk images can be stored in the
+ * QSPI flash after the firmware, in FLASH_DISK_SLOTS areas counted
+ * down from the end of the flash. If disk_flash is set and a drive
+ * has one of these images mounted, its sectors are read from the XIP
+ * mapped flash without access to the SD card, so that the system
+ * boots fast and distribution disks cost no SD card I/O. The sectors
+ * are read through the uncached XIP alias, so that they don't evict
+ * the code running from flash out of the XIP cache. Written sectors go
+ * into a copy-on-write overlay, so the copy in flash stays valid. The
+ * first flash sector of an area holds a header with the name and the
+ * size of the image, area 0 is the one of the boot disk in drive 0.
+ */
+#define FLASH_DISK_DATA	FLASH_SECTOR_SIZE /* offset of the image */
+#define FLASH_DISK_MAX	(((TRK + 1) * SPT * SEC_SZ + FLASH_SECTOR_SIZE - 1) \
+			 & ~(FLASH_SECTOR_SIZE - 1)) /* max. size of image */
+#define FLASH_DISK_AREA	(FLASH_DISK_DATA + FLASH_DISK_MAX) /* size of area */
+#define FLASH_DISK_OFFS(n) (PICO_FLASH_SIZE_BYTES - ((n) + 1) * \
+			    FLASH_DISK_AREA)	/* flash offset of area n */
+#define FLASH_DISK_MAGIC 0x4b534446	/* "FDSK" */
+
+typedef struct flash_hdr {
+	uint32_t magic;		/* FLASH_DISK_MAGIC if valid */
+	uint32_t size;		/* size of the image */
+	char name[DISKLEN+1];	/* path name of the image */
+} flash_hdr_t;
+
+#define flash_hdr(n)	((const flash_hdr_t *) (uintptr_t) \
+			 (XIP_BASE + FLASH_DISK_OFFS(n)))
+
+extern char __flash_binary_end;	/* from the linker script */
+#endif
+
+/*
+ * The disk image files stay open from the first access until the
+ * disk is unmounted or the SD card is released, so that sector I/O
+ * doesn't need to walk the directory and setup a FIL every time.
+ *
+ * The files with their link maps and overlay indexes are the large
+ * part of a drive, so there are only DISK_FILES of them for all the
+ * drives. When a drive needs one and all are in use, the one used
+ * least recently is taken from its drive, whose modified sectors are
+ * written back first. The sectors of that drive in the track cache
+ * stay valid, the next access opens its image again.
+ */
+typedef struct dfile {
+	FIL fil;	/* file of the disk image */
+#if FF_USE_FASTSEEK
+	DWORD clmt[DISK_CLMT_SIZE]; /* cluster link map table for f_lseek */
+#endif
+#if DISK_OVL_SECS > 0
+	FIL ovl_fil;	/* overlay file, if disk_overlay is set */
+	bool ovl_open;	/* overlay file is open */
+	UINT ovl_n;	/* number of sectors in the overlay */
+	ovl_ent_t ovl_map[DISK_OVL_SECS]; /* index of the overlay */
+#endif
+#if DISK_CRC
+	FIL crc_fil;	/* CRC sidecar, open if the drive's crc is set */
+#endif
+	bool busy;	/* used by a drive */
+	int drive;	/* the drive using it */
+	uint32_t used;	/* time of last use for LRU replacement */
+} dfile_t;
+
+typedef struct drive {
+	bool open;	/* file is open */
+	dfile_t *f;	/* the open files, if open */
+#if DISK_CONTIG
+	LBA_t lba;	/* first SD sector of a contiguous image, 0 if not */
+	FSIZE_t pos;	/* position of the sector I/O in it */
+#endif
+#if DISK_CRC
+	bool crc;	/* image has a CRC sidecar, open in f */
+#endif
+#if DISK_DSZ
+	bool dsz;	/* image is compressed */
+	UINT dsz_size;	/* size of the uncompressed image */
+#endif
+#if FLASH_DISK
+	const BYTE *flash; /* copy of the image in flash, NULL if none */
+	UINT flash_size; /* size of the copy */
+#endif
+#if RAMDISK_SIZE > 0
+	bool ram;	/* image is loaded into the RAM disk */
+	bool ram_dirty;	/* RAM disk was modified */
+	UINT ram_size;	/* size of the image in the RAM disk */
+#endif
+} drive_t;
+
+static drive_t drives[NUMDISK];
+static dfile_t dfiles[DISK_FILES];
+static uint32_t dfile_clock;	/* incremented for every use of a file */
+
+#if RAMDISK_SIZE > 0
+/*
+ * The RAM disk holds the complete image of one drive in memory, it is
+ * loaded on request after mounting and written back to the image file
+ * with flush_disks() and when the disk is unmounted or the SD card is
+ * released. With RAMDISK_BASE the memory can be placed in a PSRAM
+ * region already mapped into the address space.
+ */
+#ifdef RAMDISK_BASE
+#define ramdisk	((BYTE *) RAMDISK_BASE)
+#else
+static BYTE __aligned(4) ramdisk[RAMDISK_SIZE];
+#endif
+static int ramdisk_drive = -1;	/* drive using the RAM disk */
+
+static BYTE ram_flush(void);
+#endif
+
+#if DISK_CACHE_TRACKS > 0
+/*
+ * Track cache, CP/M reads the sectors of a track mostly in sequence,
+ * so a complete track is read with one transfer from the SD card and
+ * the other sectors are served from memory.
+ *
+ * Written sectors are kept in the cache and marked dirty. A dirty
+ * track is written back in runs of consecutive sectors, so that FatFS
+ * can merge them into full 512 byte SD blocks, when:
+ *	- the drive writes to another track
+ *	- the track is replaced in the cache
+ *	- no sector was written for DISK_FLUSH_MS milliseconds
+ *	- the CPU is reset with the hardware control port
+ *	- the disk is unmounted or the SD card is released,
+ *	  which is done before USB mass storage access
+ *
+ * On power loss all sectors written in the last DISK_FLUSH_MS
+ * milliseconds before can be lost, older writes are on the SD card.
+ * The size of the disk images never changes because of a flush, so
+ * the FAT and directory of the SD card stay consistent.
+ */
+#define TRKSIZ	(SPT * SEC_SZ)	/* size of a track in bytes */
+
+typedef struct trkbuf {
+	int drive;		/* drive of the cached track, -1 if unused */
+	int track;		/* the cached track */
+	int nsec;		/* number of valid sectors */
+	uint32_t used;		/* time of last use for LRU replacement */
+	uint32_t dirty;		/* bit n set if sector n + 1 was modified */
+	BYTE data[TRKSIZ];	/* the sectors of the track */
+} trkbuf_t;
+
+static trkbuf_t __aligned(4) cache[DISK_CACHE_TRACKS];
+static uint32_t cache_clock;	/* incremented for every cache access */
+
+#if LIB_STDIO_MSC_USB && STDIO_MSC_USB_PIPELINE && STDIO_MSC_USB_PIPELINE_BUF
+/*
+ * The track cache is empty while the MicroSD card is USB mass storage
+ * after exit_disks(), so it is the buffer of the pipelined transfers.
+ */
+void *stdio_msc_usb_pipeline_buf(void)
+{
+	_Static_assert(sizeof(cache) >= CFG_TUD_MSC_EP_BUFSIZE,
+		       "track cache smaller than the MSC buffer");
+
+	return cache;
+}
+#endif
+
+static uint8_t flush_irq_num;		/* user IRQ for the idle flush */
+static volatile bool flush_armed;	/* idle flush scheduled */
+static volatile uint32_t last_write;	/* time of last write in ms */
+
+/*
+ * Read-ahead, when a drive reads from the track following the one it
+ * read before, the next disk_readahead tracks are read into the cache
+ * by disk_task() on core 1 while the CPU continues. Cache entries with
+ * modified sectors are never replaced for this.
+ *
+ * Block devices like the screens of FIG-Forth read 1K blocks of eight
+ * sectors at random places, and a block crossing the end of a track
+ * would wait for the next track in the middle of the block. A drive
+ * reading the sectors in the last DISK_RA_TAIL of a track in sequence
+ * therefore already starts read-ahead with the following track.
+ */
+static int last_track[NUMDISK];		/* track of last read per drive */
+static int last_sector[NUMDISK];	/* sector of last read per drive */
+static volatile int ra_drive = -1;	/* drive to read ahead, -1 if none */
+static volatile int ra_track;		/* first track to read ahead */
+
+static void cache_invalidate(int drive);
+static BYTE cache_flush(int drive, int track);
+static void flush_irq(void);
+#endif
+
+/*
+ * All accesses to the SD card are done with disk_mutex held, so that
+ * the cache can be flushed safely from a low priority IRQ and the
+ * extended FDC can execute background commands on core 1.
+ */
+static mutex_t disk_mutex;
+#define DISK_LOCK()	mutex_enter_blocking(&disk_mutex)
+#define DISK_UNLOCK()	mutex_exit(&disk_mutex)
+
+static FRESULT open_disk(int drive);
+static void close_disk(int drive);
+static dfile_t *get_dfile(void);
+static FRESULT img_read(int drive, void *buf, UINT n, UINT *br);
+static FRESULT img_write(int drive, const void *buf, UINT n, UINT *bw);
+static BYTE seek_sec(int drive, int track, int sector);
+#if DISK_OVL_SECS > 0
+static FRESULT ovl_open(int drive);
+static BYTE ovl_patch(int drive, int track, int sector, BYTE *buf, int n);
+static BYTE ovl_write(int drive, int track, int sector, const BYTE *buf,
+		      int n);
+#endif
+
+#if DIR_CACHE_SIZE > 0
+/*
+ * Directory cache, the file names found by list_files() are kept
+ * until the SD card is mounted again, which is done after USB mass
+ * storage access, so that listing the disk images and code files
+ * doesn't read the directories again. Mounting a disk image which
+ * isn't in a cached complete directory fails without SD card access.
+ */
+#define DIR_CACHE_DIRS	2	/* /DISKS80 and /CODE80 */
 
-/* buffer for disk/memory transfers */
+typedef struct dir_cache {
+	bool valid;		/* entry holds a complete directory */
+	bool trunc;		/* some names were too long for names[] */
+	uint32_t used;		/* time of last use for LRU replacement */
+	char dir[16];		/* the directory */
+	char ext[8];		/* the pattern */
+	int n;			/* number of files */
+	char names[DIR_CACHE_SIZE][FNLEN + 6]; /* the file names */
+} dir_cache_t;
+
+static dir_cache_t dir_cache[DIR_CACHE_DIRS];
+static uint32_t dir_clock;	/* incremented for every directory access */
+
+static void dir_invalidate(void);
+#endif
+
+#if DISK_CRC
+static void crc_update(int drive, int track, const BYTE *data, UINT len);
+#endif
+#if DISK_DSZ
+static FRESULT dsz_open(int drive);
+static FRESULT dsz_read(int drive, int track, BYTE *buf, UINT *br);
+#endif
+
+/* buffer for disk/memory transfers crossing a memory boundary */
 static unsigned char __aligned(4) dsk_buf[SEC_SZ];
 
+#if DISK_CONTIG
+/* last SD sector read or written for a contiguous image */
+static unsigned char __aligned(4) contig_buf[FF_MAX_SS];
+static LBA_t contig_sec;	/* its number, 0 if none */
+#endif
+
 /* global variables for access to MicroSD card */
 
 /* SDIO Interface */
@@ -47,14 +485,8 @@ static sd_sdio_if_t sdio_if = {
 	.CMD_gpio = PICO_DEFAULT_SPI_TX_PIN,
 	.D0_gpio = PICO_DEFAULT_SPI_RX_PIN,
 	.DMA_IRQ_num = DMA_IRQ_0,
-#if PICO_RP2040
-	//.baud_rate = 125 * 1000 * 1000 / 8,	/* 15.625 MHz */
-	.baud_rate = 200 * 1000 * 1000 / 8,	/* 25.00 MHz */
-#endif
-#if PICO_RP2350
-	//.baud_rate = 150 * 1000 * 1000 / 8,	/* 18.75 MHz */
-	.baud_rate = 150 * 1000 * 1000 / 6,	/* 25.00 MHz */
-#endif
+	/* the driver tries the fastest clock up to this, that works */
+	.baud_rate = DISK_SDIO_BAUD,
 };
 
 /* Configuration of the SD Card socket object */
@@ -79,260 +511,4955 @@ sd_card_t *sd_get_by_num(size_t num)
 	}
 }
 
-void init_disks(void)
-{
-	/* try to mount SD card */
-	sd_res = f_mount(&fs, "", 1);
-	if (sd_res != FR_OK)
-		panic("f_mount error: %s (%d)\n", FRESULT_str(sd_res), sd_res);
-}
+/*
+ * A MicroSD card which is pulled or fails is noticed by the FatFs
+ * errors of the disk image transfers. The FDC command getting the
+ * error fails with it, the next one finds the card lost: the disk
+ * images are released without writing them back, the track cache,
+ * the RAM disk, the FAT sectors, the directory cache and the last
+ * contiguous sector are dropped, and the FDC commands fail with
+ * FDC_STAT_NODISK at once, instead of waiting for the card. An FDC
+ * command after SD_RETRY_MS initializes the card and mounts it
+ * again, each failed try doubles the wait up to SD_RETRY_MAX_MS. The
+ * disks stay in the drives and are opened from the new mount.
+ */
+#ifndef SD_RETRY_MS
+#define SD_RETRY_MS	250	/* first wait for mounting again */
+#endif
+#ifndef SD_RETRY_MAX_MS
+#define SD_RETRY_MAX_MS	8000	/* longest wait */
+#endif
 
-void exit_disks(void)
+static bool sd_fail;		/* a transfer had a card error */
+static bool sd_lost;		/* the card is lost, not mounted */
+static uint32_t sd_retry_ms;	/* wait before the next try */
+static absolute_time_t sd_retry_at;
+static uint32_t sd_losses, sd_remounts;
+
+/* the FatFs results of a failed or missing card */
+static inline bool card_error(FRESULT res)
 {
-	/* unmount SD card */
-	f_unmount("");
+	return res == FR_DISK_ERR || res == FR_NOT_READY;
 }
 
 /*
- * list files with pattern 'ext' in directory 'dir'
+ * mount the SD card, with disk_mutex held or before the disks run
  */
-void list_files(const char *dir, const char *ext)
+static bool card_mount(void)
 {
-	DIR dp;
-	FILINFO fno;
-	FRESULT res;
-	int cols = 80 / (FNLEN + 8) - 1;
-	register int i = 0;
+	/* the card is initialized again while STA_NOINIT is set */
+	if ((sd_res = f_mount(&fs, "", 1)) != FR_OK)
+		return false;
+	fs_mounted = true;
 
-	/* convert to string */
-	#define STR_(X) #X
-	/* this makes sure the argument is expanded before converting to string */
-	#define STR(X) STR_(X)
+	/* keep some sectors of the FAT, it might have changed too */
+#if FF_FS_EXFAT
+	/* the contiguous files of exFAT have no FAT chain, cluster
+	   allocation and f_expand() search the allocation bitmap */
+	if (fs.fs_type == FS_EXFAT)
+		disk_cache_fat(0, fs.bitbase,
+			       ((LBA_t) fs.n_fatent - 2 + FF_MAX_SS * 8 - 1)
+			       / (FF_MAX_SS * 8));
+	else
+#endif
+	disk_cache_fat(0, fs.fatbase, (LBA_t) fs.fsize * fs.n_fats);
+	return true;
+}
 
-	res = f_findfirst(&dp, &fno, dir, ext);
-	if (res == FR_OK) {
-		while (true) {
-			printf("%-" STR(FNLEN) "s\t", fno.fname);
-			i++;
-			if (i > cols) {
-				putchar('\n');
-				i = 0;
-			}
-			res = f_findnext(&dp, &fno);
-			if (!strlen(fno.fname)) {
-				if (i > 0)
-					putchar('\n');
-				break;
-			}
-		}
-	}
+/* wait before the next try to mount the card */
+static void card_retry(uint32_t ms)
+{
+	sd_lost = true;
+	sd_retry_ms = ms;
+	sd_retry_at = make_timeout_time_ms(ms);
 }
 
 /*
- * load a file 'name' into memory
- * returns true on success, false on error
+ * drop everything of the lost card, with disk_mutex held
  */
-bool load_file(const char *name)
+static void card_lost(void)
 {
-	int i = 0;
-	bool res;
-	register unsigned int j;
-	unsigned int br;
-	char SFN[DISKLEN+1];
-
-	strcpy(SFN, "/CODE80/");
-	strcat(SFN, name);
-	strcat(SFN, ".BIN");
+	register int i;
 
-	/* try to open file */
-	sd_res = f_open(&sd_file, SFN, FA_READ);
-	if (sd_res != FR_OK) {
-		puts("File not found");
-		return false;
-	}
+	sd_fail = false;
+	if (sd_lost)
+		return;
+	sd_losses++;
 
-	/* read file into memory */
-	while ((sd_res = f_read(&sd_file, dsk_buf, SEC_SZ, &br)) == FR_OK) {
-		for (j = 0; j < br; j++)
-			dma_write(i + j, dsk_buf[j]);
-		if (br < SEC_SZ)	/* last record reached */
-			break;
-		i += SEC_SZ;
+	for (i = 0; i < NUMDISK; i++) {
+		if (!drives[i].open)
+			continue;
+		/* the files can't be closed on the card */
+		drives[i].f->busy = false;
+#if DISK_OVL_SECS > 0
+		drives[i].f->ovl_open = false;
+#endif
+#if DISK_CRC
+		drives[i].crc = false;
+#endif
+		drives[i].f = NULL;
+		drives[i].open = false;
+#if DISK_CONTIG
+		drives[i].lba = 0;
+#endif
 	}
-	if (sd_res != FR_OK) {
-		printf("f_read error: %s (%d)\n", FRESULT_str(sd_res), sd_res);
-		res = false;
-	} else {
-		printf("loaded file \"%s\" (%d bytes)\n", SFN, i + br);
-		res = true;
+#if DISK_CACHE_TRACKS > 0
+	cache_invalidate(-1);
+	ra_drive = -1;
+#endif
+#if RAMDISK_SIZE > 0
+	if (ramdisk_drive >= 0) {
+		drives[ramdisk_drive].ram = false;
+		ramdisk_drive = -1;
 	}
+#endif
+#if DIR_CACHE_SIZE > 0
+	dir_invalidate();
+#endif
+#if DISK_CONTIG
+	contig_sec = 0;
+#endif
+	disk_cache_fat(0, 0, 0);
 
-	f_close(&sd_file);
-	return res;
+	f_unmount("");
+	fs_mounted = false;
+	sd_card.state.m_Status |= STA_NOINIT;	/* init it again */
+	card_retry(SD_RETRY_MS);
 }
 
 /*
- * check that all disks refer to existing files
+ * check that the card is mounted, a lost card is mounted again
+ * when the wait is over, with disk_mutex held
  */
-void check_disks(void)
+static bool card_ready(void)
 {
-	int i, n = 0;
+	if (sd_fail)
+		card_lost();
+	if (!sd_lost)
+		return true;
+	if (!time_reached(sd_retry_at))
+		return false;
 
-	for (i = 0; i < NUMDISK; i++) {
-		if (disks[i][0]) {
-			/* try to open file */
-			sd_res = f_open(&sd_file, disks[i], FA_READ);
-			if (sd_res != FR_OK) {
-				printf("Disk image \"%s\" no longer exists.\n",
-				       disks[i]);
-				disks[i][0] = '\0';
-				n++;
-			} else
-				f_close(&sd_file);
-		}
+	if (card_mount()) {
+		sd_lost = false;
+		sd_remounts++;
+		return true;
 	}
-	if (n > 0)
-		putchar('\n');
+	card_retry(sd_retry_ms * 2 < SD_RETRY_MAX_MS ? sd_retry_ms * 2
+						     : SD_RETRY_MAX_MS);
+	return false;
 }
 
-/*
- * mount a disk image 'name' on disk 'drive'
- */
-void mount_disk(int drive, const char *name)
+void init_disks(void)
 {
-	char SFN[DISKLEN+1];
-	int i;
+	if (!mutex_is_initialized(&disk_mutex)) {
+		mutex_init(&disk_mutex);
+#if DISK_CACHE_TRACKS > 0
+		/* setup low priority IRQ for flushing the cache */
+		flush_irq_num = (uint8_t) user_irq_claim_unused(true);
+		irq_set_exclusive_handler(flush_irq_num, flush_irq);
+		irq_set_priority(flush_irq_num, PICO_LOWEST_IRQ_PRIORITY);
+		irq_set_enabled(flush_irq_num, true);
+#endif
+#if DISK_CRC
+		/* setup the DMA sniffer for calculating CRC-32s */
+		crc_chan = (uint) dma_claim_unused_channel(true);
+		dma_sniffer_enable(crc_chan, DMA_SNIFF_CTRL_CALC_VALUE_CRC32,
+				   true);
+#endif
+	}
 
-	strcpy(SFN, "/DISKS80/");
-	strcat(SFN, name);
-	strcat(SFN, ".DSK");
+#if DISK_CACHE_TRACKS > 0
+	/* the disk images might have been changed while unmounted */
+	cache_invalidate(-1);
+#endif
 
-	for (i = 0; i < NUMDISK; i++) {
-		if (i != drive && strcmp(disks[i], SFN) == 0) {
-			puts("Disk already mounted\n");
-			return;
-		}
-	}
+#if DIR_CACHE_SIZE > 0
+	/* the files might have been changed while unmounted */
+	dir_invalidate();
+#endif
 
-	/* try to open file */
-	sd_res = f_open(&sd_file, SFN, FA_READ);
-	if (sd_res != FR_OK) {
-		puts("File not found\n");
-		return;
+	/* try to mount SD card, without one it is tried again later */
+	sd_fail = false;
+	sd_lost = false;
+	if (!card_mount()) {
+		printf("f_mount error: %s (%d), no MicroSD card\n",
+		       FRESULT_str(sd_res), sd_res);
+		card_retry(SD_RETRY_MS);
 	}
-
-	f_close(&sd_file);
-	strcpy(disks[drive], SFN);
-	putchar('\n');
 }
 
 /*
- * prepare I/O for sector read and write routines
+ * set the SDIO clock again after the system clock was changed,
+ * the SD library derives its divider for sdio_if.baud_rate from
+ * clk_sys, when the card is initialized
  */
-static BYTE prep_io(int drive, int track, int sector, WORD addr, bool rdwr)
+void disk_clock_changed(void)
 {
-	FSIZE_t pos;
+	DISK_LOCK();
+	if (!(sd_card.state.m_Status & STA_NOINIT) && !sd_sdio_begin(&sd_card))
+		puts("SDIO clock change failed");
+	DISK_UNLOCK();
+}
 
-	/* check if drive in range */
-	if ((drive < 0) || (drive > 3))
-		return FDC_STAT_DISK;
+/*
+ * return the SDIO clock in use, and if the card is in high speed mode
+ */
+uint32_t disk_sd_clock(bool *high_speed)
+{
+	uint32_t hz;
 
-	/* check if track and sector in range */
-	if (track > TRK)
-		return FDC_STAT_TRACK;
-	if ((sector < 1) || (sector > SPT))
-		return FDC_STAT_SEC;
+	DISK_LOCK();
+	hz = sd_sdio_clockHz(&sd_card);
+	*high_speed = sd_sdio_highSpeed(&sd_card);
+	DISK_UNLOCK();
 
-	/* check if DMA address in range */
-	if (addr > 0xff7f)
-		return FDC_STAT_DMAADR;
+	return hz;
+}
 
-	/* check if disk in drive */
-	if (!strlen(disks[drive])) {
-		return FDC_STAT_NODISK;
-	}
+void exit_disks(void)
+{
+	register int i;
 
-	lcd_update_drive(drive, track, sector, addr, rdwr, true);
+	DISK_LOCK();
 
-	/* open file with the disk image */
-	sd_res = f_open(&sd_file, disks[drive], rdwr ? FA_WRITE : FA_READ);
-	if (sd_res != FR_OK)
-		return FDC_STAT_NODISK;
+	/* close all disk images, this writes back the cache */
+	for (i = 0; i < NUMDISK; i++)
+		close_disk(i);
 
-	/* seek to track/sector */
-	pos = (((FSIZE_t) track * (FSIZE_t) SPT) + sector - 1) * SEC_SZ;
-	if (f_lseek(&sd_file, pos) != FR_OK) {
-		f_close(&sd_file);
-		return FDC_STAT_SEEK;
-	}
+	/* unmount SD card */
+	f_unmount("");
+	fs_mounted = false;
 
-	return FDC_STAT_OK;
+	DISK_UNLOCK();
 }
 
 /*
- * read from drive a sector on track into memory @ addr
+ * write back all modified sectors in the track cache
  */
-BYTE read_sec(int drive, int track, int sector, WORD addr)
+void flush_disks(void)
 {
-	BYTE stat;
-	unsigned int br;
-	register int i;
+	DISK_LOCK();
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(-1, -1);
+#endif
+#if RAMDISK_SIZE > 0
+	ram_flush();
+#endif
+	DISK_UNLOCK();
+}
 
-	/* prepare for sector read */
-	stat = prep_io(drive, track, sector, addr, false);
-	if (stat == FDC_STAT_OK) {
+#if RAMDISK_SIZE > 0
+/*
+ * load the image of the disk in drive into the RAM disk
+ * returns true on success, false on error
+ */
+bool load_ramdisk(int drive)
+{
+	drive_t *dp = &drives[drive];
+	FSIZE_t size;
+	UINT br;
 
-		/* read sector into memory */
-		sd_res = f_read(&sd_file, dsk_buf, SEC_SZ, &br);
-		if (sd_res == FR_OK) {
+	if (ramdisk_drive >= 0 && ramdisk_drive != drive) {
+		puts("RAM disk already in use");
+		return false;
+	}
+	if (disk_overlay[drive]) {
+		puts("Disk uses an overlay");
+		return false;
+	}
+
+	DISK_LOCK();
+	if (!dp->open && open_disk(drive) != FR_OK) {
+		DISK_UNLOCK();
+		puts("File not found");
+		return false;
+	}
+	size = f_size(&dp->f->fil);
+	if (size > RAMDISK_SIZE) {
+		DISK_UNLOCK();
+		printf("Disk image too large for RAM disk (%d bytes)\n",
+		       RAMDISK_SIZE);
+		return false;
+	}
+
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(drive, -1);
+	cache_invalidate(drive);
+#endif
+	if ((sd_res = f_lseek(&dp->f->fil, 0)) == FR_OK)
+		sd_res = f_read(&dp->f->fil, ramdisk, (UINT) size, &br);
+	if (sd_res != FR_OK || br != size) {
+		DISK_UNLOCK();
+		printf("f_read error: %s (%d)\n", FRESULT_str(sd_res), sd_res);
+		return false;
+	}
+	dp->ram = true;
+	dp->ram_dirty = false;
+	dp->ram_size = br;
+	ramdisk_drive = drive;
+	DISK_UNLOCK();
+
+	printf("Disk image loaded into RAM disk (%u bytes)\n", br);
+	return true;
+}
+
+/*
+ * write back the RAM disk to the image file, if modified
+ */
+static BYTE ram_flush(void)
+{
+	drive_t *dp;
+	UINT bw;
+
+	if (ramdisk_drive < 0 || !drives[ramdisk_drive].ram_dirty)
+		return FDC_STAT_OK;
+
+	dp = &drives[ramdisk_drive];
+#if DISK_CONTIG
+	contig_sec = 0;
+#endif
+	if (f_lseek(&dp->f->fil, 0) != FR_OK)
+		return FDC_STAT_SEEK;
+	sd_res = f_write(&dp->f->fil, ramdisk, dp->ram_size, &bw);
+	if (sd_res != FR_OK || bw != dp->ram_size)
+		return FDC_STAT_WRITE;
+	if (f_sync(&dp->f->fil) != FR_OK)
+		return FDC_STAT_WRITE;
+	dp->ram_dirty = false;
+#if DISK_CRC
+	crc_update(ramdisk_drive, 0, ramdisk, dp->ram_size);
+#endif
+
+	return FDC_STAT_OK;
+}
+#endif
+
+#if FLASH_DISK
+static struct {
+	uint32_t offs;		/* flash offset of the page */
+	const BYTE *data;	/* the data for the page */
+} flash_op;
+
+/*
+ * erase the flash sector at flash_op.offs
+ */
+static void flash_erase_func(void *param)
+{
+	UNUSED(param);
+
+	flash_range_erase(flash_op.offs, FLASH_SECTOR_SIZE);
+}
+
+/*
+ * program the flash page at flash_op.offs
+ */
+static void flash_prog_func(void *param)
+{
+	UNUSED(param);
+
+	flash_range_program(flash_op.offs, flash_op.data, FLASH_PAGE_SIZE);
+}
+
+/*
+ * check if flash area n is after the firmware
+ */
+static inline bool flash_area_ok(int n)
+{
+	return (uintptr_t) &__flash_binary_end - XIP_BASE <=
+	       FLASH_DISK_OFFS(n);
+}
+
+/*
+ * find the flash area with a copy of the disk image name, -1 if none
+ */
+static int flash_find(const char *name)
+{
+	register int n;
+
+	for (n = 0; n < FLASH_DISK_SLOTS && flash_area_ok(n); n++)
+		if (flash_hdr(n)->magic == FLASH_DISK_MAGIC &&
+		    strcmp(flash_hdr(n)->name, name) == 0)
+			return n;
+	return -1;
+}
+
+/*
+ * number of disk images stored in flash
+ */
+int flash_disks(void)
+{
+	register int n, cnt = 0;
+
+	for (n = 0; n < FLASH_DISK_SLOTS && flash_area_ok(n); n++)
+		if (flash_hdr(n)->magic == FLASH_DISK_MAGIC)
+			cnt++;
+	return cnt;
+}
+
+/*
+ * store the image in drive in flash, in the area which has a copy of
+ * it already, otherwise in the area of the drive, the previous copy
+ * is invalidated first, returns true on success
+ */
+static bool flash_store(int drive)
+{
+	drive_t *dp = &drives[drive];
+	BYTE page[FLASH_PAGE_SIZE];
+	flash_hdr_t hdr;
+	FSIZE_t size;
+	uint32_t pos, offs;
+	UINT br;
+	int n;
+
+	if ((n = flash_find(disks[drive])) < 0)
+		n = drive % FLASH_DISK_SLOTS;
+	if (!flash_area_ok(n)) {
+		puts("No space in flash after the firmware");
+		return false;
+	}
+	offs = FLASH_DISK_OFFS(n);
+	if (!disks[drive][0] || (!dp->open && open_disk(drive) != FR_OK)) {
+		printf("No disk in drive %d\n", drive);
+		return false;
+	}
+#if DISK_DSZ
+	if (dp->dsz) {
+		puts("Disk image is compressed");
+		return false;
+	}
+#endif
+	size = f_size(&dp->f->fil);
+	if (size > FLASH_DISK_MAX) {
+		printf("Disk image too large for flash (%d bytes)\n",
+		       FLASH_DISK_MAX);
+		return false;
+	}
+
+	/* the image must be up to date */
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(drive, -1);
+#endif
+#if RAMDISK_SIZE > 0
+	ram_flush();
+#endif
+
+	/* erasing the header invalidates the old copy */
+	flash_op.offs = offs;
+	if (flash_safe_execute(flash_erase_func, NULL, UINT32_MAX) != PICO_OK)
+		goto error;
+
+	for (pos = 0; pos < size; pos += FLASH_PAGE_SIZE) {
+		flash_op.offs = offs + FLASH_DISK_DATA + pos;
+		if (pos % FLASH_SECTOR_SIZE == 0 &&
+		    flash_safe_execute(flash_erase_func, NULL, UINT32_MAX)
+		    != PICO_OK)
+			goto error;
+		memset(page, 0xff, sizeof(page));
+		if (f_lseek(&dp->f->fil, pos) != FR_OK ||
+		    f_read(&dp->f->fil, page, sizeof(page), &br) != FR_OK)
+			goto error;
+		flash_op.data = page;
+		if (flash_safe_execute(flash_prog_func, NULL, UINT32_MAX)
+		    != PICO_OK)
+			goto error;
+	}
+
+	/* make the copy valid */
+	memset(page, 0xff, sizeof(page));
+	hdr.magic = FLASH_DISK_MAGIC;
+	hdr.size = size;
+	strcpy(hdr.name, disks[drive]);
+	memcpy(page, &hdr, sizeof(hdr));
+	flash_op.offs = offs;
+	flash_op.data = page;
+	if (flash_safe_execute(flash_prog_func, NULL, UINT32_MAX) != PICO_OK)
+		goto error;
+
+	printf("Disk image stored in flash area %d (%u bytes)\n", n,
+	       (UINT) size);
+	return true;
+
+error:
+	puts("Storing the disk image in flash failed");
+	return false;
+}
+
+/*
+ * turn reading the disks from flash on or off, if drive is not -1
+ * its disk image is stored in flash and reading it turned on,
+ * returns disk_flash
+ */
+bool flash_disk(int drive)
+{
+	register int i;
+
+	DISK_LOCK();
+	for (i = 0; i < NUMDISK; i++)
+		close_disk(i);
+	if (drive < 0)
+		disk_flash = !disk_flash;
+	else if (flash_store(drive))
+		disk_flash = true;
+	if (drive >= 0)
+		close_disk(drive);
+	DISK_UNLOCK();
+
+	return disk_flash;
+}
+#endif
+
+/*
+ * store a 32 bit value little endian
+ */
+static inline void put_le32(BYTE *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+}
+
+/*
+ * get a 32 bit value stored little endian
+ */
+static inline uint32_t get_le32(const BYTE *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+#if DISK_CRC || DISK_DSZ
+/*
+ * get the file of disk image img for reading, the file of the
+ * drive if it is mounted, otherwise img is opened with sd_file
+ */
+static FIL *image_fil(const char *img)
+{
+	register int i;
+
+	for (i = 0; i < NUMDISK; i++)
+		if (drives[i].open && strcmp(disks[i], img) == 0)
+			return &drives[i].f->fil;
+
+	if ((sd_res = f_open(&sd_file, img, FA_READ)) != FR_OK)
+		return NULL;
+	return &sd_file;
+}
+
+/*
+ * release the file from image_fil()
+ */
+static void image_close(FIL *fp)
+{
+	if (fp == &sd_file)
+		f_close(&sd_file);
+}
+#endif
+
+#if DISK_CRC
+/*
+ * build the name of the CRC sidecar of disk image img
+ */
+static void crc_name(char *name, const char *img)
+{
+	strcpy(name, img);
+	strcpy(&name[strlen(name) - 3], "CRC");
+}
+
+/*
+ * calculate the CRC-32 of n bytes at data with the DMA sniffer, the
+ * CRC continues from the last call unless start is true, without incr
+ * the byte at data is repeated n times
+ */
+static uint32_t crc_dma(const BYTE *data, UINT n, bool start, bool incr)
+{
+	dma_channel_config c = dma_channel_get_default_config(crc_chan);
+
+	if (start)
+		dma_sniffer_set_data_accumulator(0xffffffff);
+	if (n == 0)
+		return ~dma_sniffer_get_data_accumulator();
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, incr);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_sniff_enable(&c, true);
+	dma_channel_configure(crc_chan, &c, &crc_sink, data, n, true);
+	dma_channel_wait_for_finish_blocking(crc_chan);
+
+	return ~dma_sniffer_get_data_accumulator();
+}
+
+/*
+ * the CRC-32 of n bytes at data, see crc_dma()
+ */
+static uint32_t crc_block(const BYTE *data, UINT n, bool start)
+{
+	return crc_dma(data, n, start, true);
+}
+
+/*
+ * continue the CRC-32 with n zero bytes
+ */
+static uint32_t crc_zeros(UINT n)
+{
+	return crc_dma(&crc_zero, n, false, false);
+}
+
+/*
+ * calculate the CRC-32 of track in the image file fp, the number
+ * of bytes in the track is stored in *len, 0 if it is past the end
+ */
+static FRESULT crc_file(FIL *fp, int track, uint32_t *crc, UINT *len)
+{
+	FRESULT res;
+	UINT br;
+
+	*crc = 0;
+	*len = 0;
+	res = f_lseek(fp, (FSIZE_t) track * CRC_TRKSZ);
+	while (res == FR_OK && *len < CRC_TRKSZ) {
+		res = f_read(fp, dsk_buf, SEC_SZ, &br);
+		if (res != FR_OK || br == 0)
+			break;
+		*crc = crc_block(dsk_buf, br, *len == 0);
+		*len += br;
+		if (br < SEC_SZ)
+			break;
+	}
+
+	return res;
+}
+
+/*
+ * append a CRC-32 to the sidecar file fp
+ */
+static FRESULT crc_put(FIL *fp, uint32_t crc)
+{
+	BYTE le[4];
+	FRESULT res;
+	UINT bw;
+
+	put_le32(le, crc);
+	res = f_write(fp, le, sizeof(le), &bw);
+	if (res == FR_OK && bw < sizeof(le))
+		res = FR_DISK_ERR;
+
+	return res;
+}
+
+/*
+ * open the CRC sidecar of drive with its image, if it has one
+ */
+static void crc_open(int drive)
+{
+	char name[DISKLEN+1];
+
+	crc_name(name, disks[drive]);
+	drives[drive].crc = (f_open(&drives[drive].f->crc_fil, name,
+				    FA_READ | FA_WRITE) == FR_OK);
+}
+
+/*
+ * close the CRC sidecar of drive, the CRCs aren't updated anymore
+ */
+static void crc_close(int drive)
+{
+	if (drives[drive].crc) {
+		f_close(&drives[drive].f->crc_fil);
+		drives[drive].crc = false;
+	}
+}
+
+/*
+ * update the CRCs in the sidecar of drive for the tracks starting
+ * with track, from len bytes at data, or for track only from the
+ * image if data is NULL, on error the sidecar isn't used anymore
+ */
+static void crc_update(int drive, int track, const BYTE *data, UINT len)
+{
+	drive_t *dp = &drives[drive];
+	FIL *fp = &dp->f->crc_fil;
+	uint32_t crc;
+	FRESULT res;
+	UINT n;
+
+	if (!dp->crc)
+		return;
+
+	res = f_lseek(fp, (FSIZE_t) track * 4);
+	while (res == FR_OK) {
+		if (data == NULL)
+			res = crc_file(&dp->f->fil, track, &crc, &n);
+		else {
+			n = len < CRC_TRKSZ ? len : CRC_TRKSZ;
+			crc = crc_block(data, n, true);
+			data += n;
+			len -= n;
+		}
+		if (res == FR_OK)
+			res = crc_put(fp, crc);
+		if (data == NULL || len == 0)
+			break;
+	}
+	if (res != FR_OK || f_sync(fp) != FR_OK)
+		crc_close(drive);
+}
+
+/*
+ * update the CRC of track in the sidecar of drive for sector, which
+ * was crc_old and is now at data, without reading the track
+ */
+static void crc_sector(int drive, int track, int sector, const BYTE *data)
+{
+	drive_t *dp = &drives[drive];
+	FIL *fp = &dp->f->crc_fil;
+	FSIZE_t size = f_size(&dp->f->fil);
+	FSIZE_t start = (FSIZE_t) track * CRC_TRKSZ;
+	UINT off = (sector - 1) * SEC_SZ, tail, br;
+	uint32_t crc;
+	BYTE le[4];
+	register int i;
+
+	if (!dp->crc)
+		return;
+
+	/* a short last track gets a new CRC from the image */
+	if (start + CRC_TRKSZ > size) {
+		crc_update(drive, track, NULL, 0);
+		return;
+	}
+	tail = CRC_TRKSZ - off - SEC_SZ;
+
+	if (f_lseek(fp, (FSIZE_t) track * 4) != FR_OK ||
+	    f_read(fp, le, sizeof(le), &br) != FR_OK || br < sizeof(le)) {
+		crc_close(drive);
+		return;
+	}
+	/* the leading zeros of the difference don't change the CRC */
+	for (i = 0; i < SEC_SZ; i++)
+		crc_old[i] ^= data[i];
+	crc_block(crc_old, SEC_SZ, true);
+	crc = get_le32(le) ^ crc_zeros(tail);
+	crc ^= crc_dma(&crc_zero, SEC_SZ + tail, true, false);
+
+	if (f_lseek(fp, (FSIZE_t) track * 4) != FR_OK ||
+	    crc_put(fp, crc) != FR_OK || f_sync(fp) != FR_OK)
+		crc_close(drive);
+}
+
+/*
+ * check a disk image against its CRC sidecar, or create the sidecar
+ */
+static void verify_image(const char *img)
+{
+	char name[DISKLEN+1];
+	BYTE le[4];
+	uint32_t crc;
+	FRESULT res;
+	UINT n, br;
+	int track, bad = 0;
+	bool create = false;
+	FIL *fp, *cp = &crc_fil;
+	register int i;
+
+	printf("%s: ", &img[9]);
+	if ((fp = image_fil(img)) == NULL) {
+		printf("f_open error: %s (%d)\n", FRESULT_str(sd_res), sd_res);
+		return;
+	}
+
+	/* the sidecar of a mounted image is open already */
+	for (i = 0; i < NUMDISK; i++)
+		if (drives[i].open && drives[i].crc &&
+		    strcmp(disks[i], img) == 0)
+			cp = &drives[i].f->crc_fil;
+	if (cp != &crc_fil)
+		res = f_lseek(cp, 0);
+	else {
+		crc_name(name, img);
+		res = f_open(cp, name, FA_READ);
+		if ((create = (res == FR_NO_FILE)))
+			res = f_open(cp, name, FA_WRITE | FA_CREATE_NEW);
+	}
+	if (res != FR_OK) {
+		image_close(fp);
+		printf("f_open error: %s (%d)\n", FRESULT_str(res), res);
+		return;
+	}
+
+	for (track = 0; ; track++) {
+		if ((res = crc_file(fp, track, &crc, &n)) != FR_OK ||
+		    n == 0)
+			break;
+		if (create)
+			res = crc_put(cp, crc);
+		else if ((res = f_read(cp, le, sizeof(le), &br)) ==
+			 FR_OK && (br < sizeof(le) || crc != get_le32(le))) {
+			if (bad++ == 0)
+				printf("bad tracks");
+			printf(" %d", track);
+		}
+		if (res != FR_OK)
+			break;
+	}
+
+	image_close(fp);
+	if (cp == &crc_fil && f_close(cp) != FR_OK && res == FR_OK)
+		res = FR_DISK_ERR;
+	if (res != FR_OK) {
+		if (bad > 0)
+			putchar('\n');
+		printf("error: %s (%d)\n", FRESULT_str(res), res);
+	} else if (bad > 0)
+		putchar('\n');
+	else if (create) {
+		printf("CRC created, %d tracks\n", track);
+
+		/* update the CRCs from now on, if mounted */
+		for (i = 0; i < NUMDISK; i++)
+			if (drives[i].open && !disk_overlay[i] &&
+			    strcmp(disks[i], img) == 0)
+				crc_open(i);
+	} else
+		printf("OK, %d tracks\n", track);
+}
+
+/*
+ * check all disk images against their CRC sidecars,
+ * images without a sidecar get one
+ */
+void verify_disks(void)
+{
+	DIR dir;
+	FILINFO fno;
+	char img[DISKLEN+1];
+	FRESULT res;
+
+	DISK_LOCK();
+
+	/* the images must be up to date */
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(-1, -1);
+#endif
+#if RAMDISK_SIZE > 0
+	ram_flush();
+#endif
+
+	res = f_findfirst(&dir, &fno, "/DISKS80", "*.DSK");
+	while (res == FR_OK && fno.fname[0]) {
+		if (strlen(fno.fname) <= FNLEN + 4) {
+			strcpy(img, "/DISKS80/");
+			strcat(img, fno.fname);
+			verify_image(img);
+		}
+		res = f_findnext(&dir, &fno);
+	}
+	f_closedir(&dir);
+
+	DISK_UNLOCK();
+}
+#endif /* DISK_CRC */
+
+/*
+ * build the name of the sidecar of disk image img, which marks
+ * an image with the data tracks in logical sector order
+ */
+static void linear_name(char *name, const char *img)
+{
+	strcpy(name, img);
+	strcpy(&name[strlen(name) - 3], "FDL");
+}
+
+/*
+ * true if the disk image img is in logical sector order
+ */
+static bool linear_marked(const char *img)
+{
+	char name[DISKLEN+1];
+
+	linear_name(name, img);
+	return f_stat(name, NULL) == FR_OK;
+}
+
+/*
+ * mark the disk image img as in logical sector order with to_linear,
+ * otherwise as in physical order
+ */
+static FRESULT linear_mark(const char *img, bool to_linear)
+{
+	char name[DISKLEN+1];
+	FIL fil;
+	FRESULT res;
+
+	linear_name(name, img);
+	if (!to_linear) {
+		res = f_unlink(name);
+		return res == FR_NO_FILE ? FR_OK : res;
+	}
+	res = f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res == FR_OK)
+		res = f_close(&fil);
+
+	return res;
+}
+
+/*
+ * open the disk image of drive 'drive', read/write if possible,
+ * otherwise read only, and read only with an overlay
+ */
+static FRESULT open_disk(int drive)
+{
+	dfile_t *f = get_dfile();
+	FIL *fp = &f->fil;
+	FRESULT res;
+#if FLASH_DISK
+	int n;
+#endif
+
+	drives[drive].f = f;
+#if DISK_OVL_SECS > 0
+	f->ovl_open = false;
+#endif
+
+#if FLASH_DISK
+	/* the disk is read from flash, if stored there */
+	drives[drive].flash = NULL;
+	if (disk_flash && (n = flash_find(disks[drive])) >= 0) {
+		drives[drive].flash = (const BYTE *) XIP_NOCACHE_NOALLOC_BASE +
+				      FLASH_DISK_OFFS(n) + FLASH_DISK_DATA;
+		drives[drive].flash_size = flash_hdr(n)->size;
+		disk_overlay[drive] = true;
+	}
+#endif
+
+#if DISK_DSZ
+	/* compressed images are never written */
+	drives[drive].dsz = (strcmp(&disks[drive][strlen(disks[drive]) - 3],
+				    "DSZ") == 0);
+	if (drives[drive].dsz)
+		disk_overlay[drive] = true;
+#endif
+
+#if DISK_OVL_SECS > 0
+	if (disk_overlay[drive]) {
+		res = f_open(fp, disks[drive], FA_READ);
+#if DISK_DSZ
+		if (res == FR_OK && drives[drive].dsz &&
+		    (res = dsz_open(drive)) != FR_OK)
+			f_close(fp);
+#endif
+		if (res == FR_OK && (res = ovl_open(drive)) != FR_OK)
+			f_close(fp);
+	} else
+#endif
+	{
+		res = f_open(fp, disks[drive], FA_READ | FA_WRITE);
+		if (res == FR_DENIED)
+			res = f_open(fp, disks[drive], FA_READ);
+	}
+	drives[drive].open = (res == FR_OK);
+	if (res == FR_OK) {
+		f->busy = true;
+		f->drive = drive;
+		f->used = ++dfile_clock;
+	} else
+		drives[drive].f = NULL;
+
+	/* the sector order of a floppy disk is a property of the image */
+	if (res == FR_OK && disk_type[drive] != DISK_HD)
+		disk_type[drive] = linear_marked(disks[drive]) ? DISK_FDL
+							       : DISK_FD;
+
+#if DISK_CRC
+	/* keep the CRCs up to date, if the image has a sidecar */
+	drives[drive].crc = false;
+	if (res == FR_OK && !disk_overlay[drive])
+		crc_open(drive);
+#endif
+
+#if FF_USE_FASTSEEK
+	/*
+	 * build the cluster link map, so that seeks don't follow
+	 * the FAT chain, if the image is too fragmented for the
+	 * table use normal seeks
+	 */
+	if (res == FR_OK) {
+		drives[drive].f->clmt[0] = DISK_CLMT_SIZE;
+		fp->cltbl = drives[drive].f->clmt;
+		if (f_lseek(fp, CREATE_LINKMAP) != FR_OK)
+			fp->cltbl = NULL;
+	}
+#endif
+
+#if DISK_CONTIG
+	/*
+	 * a link map of one fragment is a contiguous image, whose
+	 * sectors are found without FatFs, on exFAT an image without
+	 * a FAT chain is contiguous too
+	 */
+	drives[drive].lba = 0;
+	if (res == FR_OK
+#if DISK_DSZ
+	    && !drives[drive].dsz
+#endif
+	   ) {
+#if FF_FS_EXFAT
+		if (fs.fs_type == FS_EXFAT && fp->obj.stat == 2)
+			drives[drive].lba = fs.database +
+				(LBA_t) fs.csize * (fp->obj.sclust - 2);
+		else
+#endif
+		if (fp->cltbl && drives[drive].f->clmt[0] == 4)
+			drives[drive].lba = fs.database +
+				(LBA_t) fs.csize * (drives[drive].f->clmt[2] - 2);
+	}
+#endif
+
+	return res;
+}
+
+/*
+ * close the files of drive 'drive', if open, and give them back
+ */
+static void close_files(int drive)
+{
+	dfile_t *f = drives[drive].f;
+
+	if (!drives[drive].open)
+		return;
+	f_close(&f->fil);
+#if DISK_CRC
+	crc_close(drive);
+#endif
+#if DISK_OVL_SECS > 0
+	if (f->ovl_open) {
+		f_close(&f->ovl_fil);
+		f->ovl_open = false;
+	}
+#endif
+	f->busy = false;
+	drives[drive].f = NULL;
+	drives[drive].open = false;
+#if DISK_CONTIG
+	drives[drive].lba = 0;
+	contig_sec = 0;
+#endif
+}
+
+/*
+ * get files for opening a disk image, a free one or the one used
+ * least recently, which is taken from its drive
+ */
+static dfile_t *get_dfile(void)
+{
+	dfile_t *f, *lru = &dfiles[0];
+	int drive;
+
+	for (f = dfiles; f < &dfiles[DISK_FILES]; f++) {
+		if (!f->busy)
+			return f;
+		if ((int32_t) (f->used - lru->used) < 0)
+			lru = f;
+	}
+
+	/* the image must be up to date before it is closed */
+	drive = lru->drive;
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(drive, -1);
+#endif
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram)
+		ram_flush();
+#endif
+	close_files(drive);
+	return lru;
+}
+
+/*
+ * close the disk image of drive 'drive', if open
+ */
+static void close_disk(int drive)
+{
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(drive, -1);
+	cache_invalidate(drive);
+#endif
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram) {
+		ram_flush();
+		drives[drive].ram = false;
+		ramdisk_drive = -1;
+	}
+#endif
+	close_files(drive);
+}
+
+#if DIR_CACHE_SIZE > 0
+/*
+ * find the directory cache entry for the files with pattern 'ext'
+ * in directory 'dir', read the directory if not cached yet,
+ * returns NULL if the directory has too many files
+ */
+static dir_cache_t *dir_lookup(const char *dir, const char *ext)
+{
+	dir_cache_t *cp;
+	DIR dp;
+	FILINFO fno;
+	register int i;
+
+	for (i = 0; i < DIR_CACHE_DIRS; i++) {
+		cp = &dir_cache[i];
+		if (cp->valid && strcmp(cp->dir, dir) == 0 &&
+		    strcmp(cp->ext, ext) == 0) {
+			cp->used = ++dir_clock;
+			return cp;
+		}
+	}
+
+	/* replace the least recently used entry */
+	cp = &dir_cache[0];
+	for (i = 1; i < DIR_CACHE_DIRS; i++)
+		if (dir_cache[i].used < cp->used)
+			cp = &dir_cache[i];
+
+	cp->valid = false;
+	if (strlen(dir) >= sizeof(cp->dir) || strlen(ext) >= sizeof(cp->ext))
+		return NULL;
+	strcpy(cp->dir, dir);
+	strcpy(cp->ext, ext);
+	cp->n = 0;
+	cp->trunc = false;
+	if (f_findfirst(&dp, &fno, dir, ext) == FR_OK) {
+		while (fno.fname[0]) {
+			if (cp->n == DIR_CACHE_SIZE) {
+				f_closedir(&dp);
+				return NULL;
+			}
+			if (strlen(fno.fname) >= sizeof(cp->names[0]))
+				cp->trunc = true;
+			strncpy(cp->names[cp->n], fno.fname,
+				sizeof(cp->names[0]) - 1);
+			cp->names[cp->n][sizeof(cp->names[0]) - 1] = '\0';
+			cp->n++;
+			if (f_findnext(&dp, &fno) != FR_OK)
+				break;
+		}
+		f_closedir(&dp);
+	}
+	cp->valid = true;
+	cp->used = ++dir_clock;
+
+	return cp;
+}
+
+/*
+ * returns true if the file 'name' is known not to exist, because
+ * the files with pattern 'ext' in directory 'dir' are cached
+ */
+static bool dir_missing(const char *dir, const char *ext, const char *name)
+{
+	dir_cache_t *cp;
+	register int i, j;
+
+	for (i = 0; i < DIR_CACHE_DIRS; i++) {
+		cp = &dir_cache[i];
+		if (cp->valid && !cp->trunc && strcmp(cp->dir, dir) == 0 &&
+		    strcmp(cp->ext, ext) == 0) {
+			for (j = 0; j < cp->n; j++)
+				if (strcasecmp(cp->names[j], name) == 0)
+					return false;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * drop all cached directories, called when the files
+ * on the SD card might have changed
+ */
+static void dir_invalidate(void)
+{
+	register int i;
+
+	for (i = 0; i < DIR_CACHE_DIRS; i++)
+		dir_cache[i].valid = false;
+}
+#endif
+
+/*
+ * list files with pattern 'ext' in directory 'dir'
+ */
+void list_files(const char *dir, const char *ext)
+{
+	DIR dp;
+	FILINFO fno;
+	FRESULT res;
+	int cols = 80 / (FNLEN + 8) - 1;
+	register int i = 0;
+#if DIR_CACHE_SIZE > 0
+	dir_cache_t *cp;
+	register int j;
+#endif
+
+	/* convert to string */
+	#define STR_(X) #X
+	/* this makes sure the argument is expanded before converting to string */
+	#define STR(X) STR_(X)
+
+	DISK_LOCK();
+#if DIR_CACHE_SIZE > 0
+	if ((cp = dir_lookup(dir, ext)) != NULL) {
+		for (j = 0; j < cp->n; j++) {
+			printf("%-" STR(FNLEN) "s\t", cp->names[j]);
+			i++;
+			if (i > cols) {
+				putchar('\n');
+				i = 0;
+			}
+		}
+		if (i > 0)
+			putchar('\n');
+		DISK_UNLOCK();
+		return;
+	}
+#endif
+	res = f_findfirst(&dp, &fno, dir, ext);
+	if (res == FR_OK) {
+		while (true) {
+			printf("%-" STR(FNLEN) "s\t", fno.fname);
+			i++;
+			if (i > cols) {
+				putchar('\n');
+				i = 0;
+			}
+			res = f_findnext(&dp, &fno);
+			if (!strlen(fno.fname)) {
+				if (i > 0)
+					putchar('\n');
+				break;
+			}
+		}
+	}
+	DISK_UNLOCK();
+}
+
+/*
+ * load a file into memory with one f_read for every block of
+ * contiguous memory, starting at addr, returns the number
+ * of bytes loaded or -1 on error
+ */
+static int load_bin(FIL *fp, WORD addr)
+{
+	FSIZE_t size = f_size(fp) - f_tell(fp);
+	unsigned int br, n;
+	BYTE *p;
+	int total = 0;
+
+	while (size > 0) {
+		if ((n = dma_block_len(addr, true)) == 0) {
+			puts("file truncated at the boot ROM");
+			break;
+		}
+		if (n > size)
+			n = size;
+		p = dma_block_ptr(addr, n, true);
+		sd_res = f_read(fp, p, n, &br);
+		if (sd_res != FR_OK)
+			return -1;
+		total += br;
+		if (br < n)
+			break;
+		addr += n;
+		size -= n;
+	}
+
+	return total;
+}
+
+/*
+ * get the value of two hex digits @ s, -1 if not hex digits
+ */
+static int hex_byte(const char *s)
+{
+	int i, n = 0;
+
+	for (i = 0; i < 2; i++, s++) {
+		n <<= 4;
+		if (*s >= '0' && *s <= '9')
+			n |= *s - '0';
+		else if (*s >= 'A' && *s <= 'F')
+			n |= *s - 'A' + 10;
+		else if (*s >= 'a' && *s <= 'f')
+			n |= *s - 'a' + 10;
+		else
+			return -1;
+	}
+
+	return n;
+}
+
+/* longest record, ':', length, address, type, 255 data bytes, sum, CR LF */
+#define HEX_LINE	(1 + 2 + 4 + 2 + 2 * 255 + 2 + 2)
+
+/*
+ * load an Intel HEX file into memory, the entry point is the address
+ * of the end of file or start address record, an entry point 0000H
+ * in them falls back to the lowest address loaded, as without these
+ * records, returns the number of bytes loaded or -1 on error
+ */
+static int load_hex(FIL *fp, WORD *start)
+{
+	static char line[HEX_LINE + 1];
+	int total = 0, len, sum, b;
+	unsigned lowest = 0;
+	WORD addr;
+	bool eof = false;
+	register int i;
+
+	*start = 0;
+	while (!eof && f_gets(line, sizeof(line), fp) != NULL) {
+		if (line[0] != ':')
+			continue;
+		if ((len = hex_byte(&line[1])) < 0 ||
+		    strlen(line) < (size_t) (11 + 2 * len))
+			return -1;
+		sum = len;
+		for (i = 0; i < len + 4; i++) {
+			if ((b = hex_byte(&line[3 + 2 * i])) < 0)
+				return -1;
+			sum += b;
+		}
+		if (sum & 0xff)
+			return -1;
+		addr = (hex_byte(&line[3]) << 8) | hex_byte(&line[5]);
+
+		switch (hex_byte(&line[7])) {
+		case 0:		/* data */
+			for (i = 0; i < len; i++)
+				putmem(addr + i, hex_byte(&line[9 + 2 * i]));
+			if (len && (total == 0 || addr < lowest))
+				lowest = addr;
+			total += len;
+			break;
+		case 1:		/* end of file */
+			if (addr)
+				*start = addr;
+			eof = true;
+			break;
+		case 3:		/* start segment address, CS:IP */
+			if (len == 4)
+				*start = (hex_byte(&line[13]) << 8) |
+					 hex_byte(&line[15]);
+			break;
+		default:	/* extended addresses are ignored */
+			break;
+		}
+	}
+
+	if (f_error(fp)) {
+		sd_res = FR_DISK_ERR;
+		return -1;
+	}
+	if (*start == 0)
+		*start = lowest;
+	return total;
+}
+
+/*
+ * load file 'name' from /CODE80 into memory, tried are NAME.BIN
+ * loaded at 0000H, NAME.COM loaded at 0100H and the Intel HEX file
+ * NAME.HEX. A .BIN file may start with the 8 byte header
+ * 0FFH 'Z' '8' '0', load address and entry point, low byte first.
+ * The entry point is returned in start.
+ */
+bool load_file(const char *name, WORD *start)
+{
+	static const char *const ext[] = { ".BIN", ".COM", ".HEX" };
+	BYTE hdr[8];
+	WORD addr = 0;
+	bool res;
+	int n = -1;
+	unsigned int br;
+	uint64_t t;
+	char SFN[DISKLEN+1];
+	register int i;
+
+	DISK_LOCK();
+
+	/* try to open file */
+	for (i = 0; i < 3; i++) {
+		strcpy(SFN, "/CODE80/");
+		strcat(SFN, name);
+		strcat(SFN, ext[i]);
+		if ((sd_res = f_open(&sd_file, SFN, FA_READ)) == FR_OK)
+			break;
+	}
+	if (sd_res != FR_OK) {
+		DISK_UNLOCK();
+		puts("File not found");
+		return false;
+	}
+
+	/* read file into memory */
+	t = time_us_64();
+	switch (i) {
+	case 0:			/* .BIN, with optional header */
+		sd_res = f_read(&sd_file, hdr, sizeof(hdr), &br);
+		if (sd_res == FR_OK && br == sizeof(hdr) && hdr[0] == 0xff &&
+		    hdr[1] == 'Z' && hdr[2] == '8' && hdr[3] == '0') {
+			addr = hdr[4] | (hdr[5] << 8);
+			*start = hdr[6] | (hdr[7] << 8);
+		} else {
+			*start = 0;
+			sd_res = f_lseek(&sd_file, 0);
+		}
+		if (sd_res == FR_OK)
+			n = load_bin(&sd_file, addr);
+		break;
+	case 1:			/* .COM */
+		addr = *start = 0x0100;
+		n = load_bin(&sd_file, addr);
+		break;
+	default:		/* .HEX */
+		n = load_hex(&sd_file, start);
+		addr = *start;
+		break;
+	}
+	t = time_us_64() - t;
+
+	if (n < 0) {
+		if (sd_res != FR_OK)
+			printf("f_read error: %s (%d)\n",
+			       FRESULT_str(sd_res), sd_res);
+		else
+			puts("Invalid Intel HEX file");
+		res = false;
+	} else {
+		printf("loaded file \"%s\" (%d bytes at %04XH, entry %04XH, "
+		       "%lu KB/s)\n", SFN, n, addr, *start,
+		       (unsigned long) (t ? (uint64_t) n * 1000000 / 1024 / t
+					  : 0));
+		res = true;
+	}
+
+	f_close(&sd_file);
+	DISK_UNLOCK();
+	return res;
+}
+
+/*
+ * load the file 'name' from /CODE80 at addr into memory, as mapped
+ * now, for the ICE, tried are NAME.BIN, without its header if it has
+ * one, and NAME.COM, in large reads directly into the memory
+ */
+bool load_file_at(const char *name, WORD addr)
+{
+	static const char *const ext[] = { ".BIN", ".COM" };
+	BYTE hdr[8];
+	unsigned int br;
+	uint64_t t;
+	int n = -1;
+	char SFN[DISKLEN+1];
+	register int i;
+
+	DISK_LOCK();
+
+	for (i = 0; i < 2; i++) {
+		strcpy(SFN, "/CODE80/");
+		strcat(SFN, name);
+		strcat(SFN, ext[i]);
+		if ((sd_res = f_open(&sd_file, SFN, FA_READ)) == FR_OK)
+			break;
+	}
+	if (sd_res != FR_OK) {
+		DISK_UNLOCK();
+		puts("File not found");
+		return false;
+	}
+
+	t = time_us_64();
+	if (i == 0) {
+		sd_res = f_read(&sd_file, hdr, sizeof(hdr), &br);
+		if (sd_res == FR_OK && !(br == sizeof(hdr) && hdr[0] == 0xff &&
+		    hdr[1] == 'Z' && hdr[2] == '8' && hdr[3] == '0'))
+			sd_res = f_lseek(&sd_file, 0);
+	}
+	if (sd_res == FR_OK)
+		n = load_bin(&sd_file, addr);
+	t = time_us_64() - t;
+
+	f_close(&sd_file);
+	DISK_UNLOCK();
+
+	if (n < 0) {
+		printf("f_read error: %s (%d)\n", FRESULT_str(sd_res), sd_res);
+		return false;
+	}
+	printf("loaded file \"%s\" (%d bytes at %04XH, %lu KB/s)\n",
+	       SFN, n, addr,
+	       (unsigned long) (t ? (uint64_t) n * 1000000 / 1024 / t : 0));
+	return true;
+}
+
+/*
+ * write len bytes of memory @ addr, as mapped now, into NAME.BIN in
+ * /CODE80 for the ICE, with the header for loading it at addr again,
+ * in large writes directly from the memory
+ */
+bool save_file(const char *name, WORD addr, uint32_t len)
+{
+	BYTE hdr[8];
+	UINT bw = 0, n;
+	uint64_t t;
+	uint32_t total = 0;
+	char SFN[DISKLEN+1];
+
+	if (len == 0 || addr + len > 0x10000U) {
+		puts("range exceeds the 64K memory");
+		return false;
+	}
+
+	DISK_LOCK();
+
+	strcpy(SFN, "/CODE80/");
+	strcat(SFN, name);
+	strcat(SFN, ".BIN");
+	t = time_us_64();
+	if ((sd_res = f_open(&sd_file, SFN,
+			     FA_WRITE | FA_CREATE_ALWAYS)) == FR_OK) {
+		hdr[0] = 0xff;
+		hdr[1] = 'Z';
+		hdr[2] = '8';
+		hdr[3] = '0';
+		hdr[4] = hdr[6] = addr & 0xff;	/* load address and entry */
+		hdr[5] = hdr[7] = addr >> 8;
+		if ((sd_res = f_write(&sd_file, hdr, sizeof(hdr),
+				      &bw)) == FR_OK && bw < sizeof(hdr))
+			sd_res = FR_DENIED;	/* the card is full */
+		while (sd_res == FR_OK && total < len) {
+			n = dma_block_len(addr, false);
+			if (n > len - total)
+				n = len - total;
+			sd_res = f_write(&sd_file,
+					 dma_block_ptr(addr, n, false), n, &bw);
+			if (sd_res == FR_OK && bw < n)
+				sd_res = FR_DENIED;
+			total += bw;
+			addr += n;
+		}
+		if (f_close(&sd_file) != FR_OK && sd_res == FR_OK)
+			sd_res = FR_DISK_ERR;
+		if (sd_res != FR_OK)
+			f_unlink(SFN);
+	}
+	t = time_us_64() - t;
+
+	DISK_UNLOCK();
+
+	if (sd_res != FR_OK) {
+		printf("%s: %s (%d)\n", SFN, FRESULT_str(sd_res), sd_res);
+		return false;
+	}
+	printf("saved file \"%s\" (%lu bytes, %lu KB/s)\n", SFN,
+	       (unsigned long) total,
+	       (unsigned long) (t ? (uint64_t) total * 1000000 / 1024 / t
+				  : 0));
+	return true;
+}
+
+/*
+ * write the n blocks of memory in blk into the snapshot file name,
+ * in large sequential writes directly from the memory, with update
+ * the blocks are written at their offsets into the existing file
+ */
+bool write_snapshot(const char *name, const snap_blk_t *blk, int n,
+		    bool update)
+{
+	UINT bw = 0;
+	uint64_t t;
+	uint32_t size = 0;
+	register int i;
+
+	DISK_LOCK();
+
+	t = time_us_64();
+	if ((sd_res = f_open(&sd_file, name, FA_WRITE | (update ?
+			     FA_OPEN_EXISTING : FA_CREATE_ALWAYS))) == FR_OK) {
+		for (i = 0; i < n; i++) {
+			if (update && f_tell(&sd_file) != blk[i].ofs &&
+			    (sd_res = f_lseek(&sd_file, blk[i].ofs)) != FR_OK)
+				break;
+			sd_res = f_write(&sd_file, blk[i].p, blk[i].n, &bw);
+			if (sd_res != FR_OK || bw != blk[i].n)
+				break;
+			size += bw;
+		}
+		if (f_close(&sd_file) != FR_OK && sd_res == FR_OK)
+			sd_res = FR_DISK_ERR;
+		if (sd_res != FR_OK || i < n)
+			f_unlink(name);
+	}
+	t = time_us_64() - t;
+
+	DISK_UNLOCK();
+
+	if (sd_res != FR_OK) {
+		printf("snapshot %s: %s (%d)\n", name, FRESULT_str(sd_res),
+		       sd_res);
+		return false;
+	}
+	if (i < n) {
+		printf("snapshot %s: disk full\n", name);
+		return false;
+	}
+	printf("%s snapshot %s (%lu KB, %lu KB/s)\n",
+	       update ? "updated" : "saved", name,
+	       (unsigned long) size / 1024,
+	       (unsigned long) (t ? (uint64_t) size * 1000000 / 1024 / t : 0));
+	return true;
+}
+
+/*
+ * read the snapshot file name into the n blocks of memory in blk,
+ * check is called after the first block is read and can reject the
+ * snapshot. The file is removed after it was read successfully,
+ * because the disks change when the machine continues.
+ */
+bool read_snapshot(const char *name, const snap_blk_t *blk, int n,
+		   bool (*check)(void))
+{
+	UINT br = 0;
+	bool res = false;
+	register int i;
+
+	DISK_LOCK();
+
+	if ((sd_res = f_open(&sd_file, name, FA_READ)) != FR_OK) {
+		DISK_UNLOCK();
+		if (sd_res == FR_NO_FILE)
+			puts("No snapshot found");
+		else
+			printf("snapshot %s: %s (%d)\n", name,
+			       FRESULT_str(sd_res), sd_res);
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		sd_res = f_read(&sd_file, blk[i].p, blk[i].n, &br);
+		if (sd_res != FR_OK || br != blk[i].n)
+			break;
+		if (i == 0 && !check())
+			break;
+	}
+	f_close(&sd_file);
+	if (i == n) {
+		f_unlink(name);
+		res = true;
+	}
+
+	DISK_UNLOCK();
+
+	if (sd_res != FR_OK)
+		printf("snapshot %s: %s (%d)\n", name, FRESULT_str(sd_res),
+		       sd_res);
+	else if (i < n && br != blk[i].n)
+		printf("snapshot %s: file too short\n", name);
+	return res;
+}
+
+/*
+ * Files transferred by the guest from and to /XFER80, only one
+ * file is open at a time. The name is the zero terminated 8.3 name.
+ */
+static FIL xfer_file;
+static bool xfer_isopen;
+
+static bool xfer_is83(const char *name)
+{
+	const char *dot = strchr(name, '.');
+	size_t len = strlen(name);
+
+	if (strchr(name, ' ') != NULL)
+		return false;
+	if (dot == NULL)
+		return len <= 8;
+	return dot - name <= 8 && len - (dot - name) <= 4 &&
+	       strchr(dot + 1, '.') == NULL;
+}
+
+/*
+ * check a file name from the guest, it must be a plain 8.3 name,
+ * so that no file outside of /XFER80 can be opened or created
+ */
+bool xfer_name_ok(const char *name)
+{
+	register const char *p;
+
+	if (name[0] == '\0' || name[0] == '.' || strstr(name, "..") != NULL ||
+	    !xfer_is83(name))
+		return false;
+	for (p = name; *p; p++)
+		if (*p < ' ' || strchr("/\\:*?\"<>|", *p) != NULL)
+			return false;
+	return true;
+}
+
+bool xfer_open(const char *name, bool wr)
+{
+	char path[8 + 12 + 1];	/* "/XFER80/" 8.3 name */
+
+	if (!xfer_name_ok(name))
+		return false;
+	strcpy(path, "/XFER80/");
+	strcat(path, name);
+
+	DISK_LOCK();
+	if (xfer_isopen)
+		f_close(&xfer_file);
+	sd_res = f_open(&xfer_file, path,
+			wr ? FA_WRITE | FA_CREATE_ALWAYS : FA_READ);
+	xfer_isopen = (sd_res == FR_OK);
+	DISK_UNLOCK();
+
+	return xfer_isopen;
+}
+
+/*
+ * read up to len bytes from the open transfer file,
+ * returns the number of bytes read or -1 on error
+ */
+int xfer_read(BYTE *buf, UINT len)
+{
+	UINT br;
+
+	if (!xfer_isopen)
+		return -1;
+	DISK_LOCK();
+	sd_res = f_read(&xfer_file, buf, len, &br);
+	DISK_UNLOCK();
+
+	return sd_res == FR_OK ? (int) br : -1;
+}
+
+/*
+ * write len bytes to the open transfer file
+ */
+bool xfer_write(const BYTE *buf, UINT len)
+{
+	UINT bw;
+
+	if (!xfer_isopen)
+		return false;
+	DISK_LOCK();
+	sd_res = f_write(&xfer_file, buf, len, &bw);
+	DISK_UNLOCK();
+
+	return sd_res == FR_OK && bw == len;
+}
+
+void xfer_close(void)
+{
+	if (xfer_isopen) {
+		DISK_LOCK();
+		f_close(&xfer_file);
+		xfer_isopen = false;
+		DISK_UNLOCK();
+	}
+}
+
+/*
+ * search the files in /XFER80 matching the pattern, with a NULL
+ * pattern the next match of the last search is returned. Only files
+ * with a name that fits 8.3 are found, the name is copied into name.
+ */
+static DIR xfer_dir;
+static char xfer_pat[13];
+static bool xfer_dirisopen;
+
+bool xfer_find(const char *pattern, char *name)
+{
+	FILINFO fno;
+	bool found = false;
+
+	DISK_LOCK();
+	if (pattern != NULL) {
+		if (xfer_dirisopen)
+			f_closedir(&xfer_dir);
+		/* f_findnext() still uses the pattern */
+		strncpy(xfer_pat, pattern, sizeof(xfer_pat) - 1);
+		xfer_pat[sizeof(xfer_pat) - 1] = '\0';
+		sd_res = f_findfirst(&xfer_dir, &fno, "/XFER80", xfer_pat);
+		xfer_dirisopen = (sd_res == FR_OK);
+	} else if (xfer_dirisopen)
+		sd_res = f_findnext(&xfer_dir, &fno);
+	else
+		sd_res = FR_NO_FILE;
+
+	while (sd_res == FR_OK && fno.fname[0]) {
+		if (!(fno.fattrib & (AM_DIR | AM_HID | AM_SYS)) &&
+		    xfer_is83(fno.fname)) {
+			strcpy(name, fno.fname);
+			found = true;
+			break;
+		}
+		sd_res = f_findnext(&xfer_dir, &fno);
+	}
+	if (!found && xfer_dirisopen) {
+		f_closedir(&xfer_dir);
+		xfer_dirisopen = false;
+	}
+	DISK_UNLOCK();
+
+	return found;
+}
+
+/*
+ * check that all disks refer to existing files
+ */
+void check_disks(void)
+{
+	int i, n = 0;
+
+	DISK_LOCK();
+	for (i = 0; i < NUMDISK; i++) {
+		if (disks[i][0]) {
+			/* try to open file, it stays open */
+			close_disk(i);
+			sd_res = open_disk(i);
+			if (sd_res != FR_OK) {
+				printf("Disk image \"%s\" no longer exists.\n",
+				       disks[i]);
+				disks[i][0] = '\0';
+				n++;
+			}
+		}
+	}
+	DISK_UNLOCK();
+	if (n > 0)
+		putchar('\n');
+}
+
+/*
+ * replace the disk image on disk 'drive' with image 'name', with
+ * a copy-on-write overlay if 'overlay' is true, only the cache and
+ * file of this drive are released, returns FDC_STAT_OK, or
+ * FDC_STAT_DISK if the image is mounted on another drive or has
+ * another sector order than the floppy disk the BIOS set up the drive
+ * for, or FDC_STAT_NODISK if it doesn't exist or can't be opened, then
+ * the disk image in the drive is kept
+ */
+BYTE swap_disk(int drive, const char *name, bool overlay)
+{
+	char SFN[DISKLEN+1], old[DISKLEN+1];
+	FSIZE_t size;
+	BYTE old_type;
+	bool old_overlay;
+	int i, n;
+
+	if (strlen(name) > FNLEN)
+		return FDC_STAT_NODISK;
+	strcpy(SFN, "/DISKS80/");
+	strcat(SFN, name);
+	n = strlen(SFN);
+
+	for (i = 0; i < NUMDISK; i++)
+		if (i != drive && strncmp(disks[i], SFN, n) == 0 &&
+		    disks[i][n] == '.')
+			return FDC_STAT_DISK;
+
+	DISK_LOCK();
+	strcpy(&SFN[n], ".DSK");
+
+	/*
+	 * the BIOS keeps or drops the translation table of a floppy disk
+	 * drive with the sector order at the get disk type command
+	 */
+	if (disk_linear[drive] && disk_type[drive] != DISK_HD &&
+	    linear_marked(SFN) != (disk_type[drive] == DISK_FDL)) {
+		DISK_UNLOCK();
+		return FDC_STAT_DISK;
+	}
+
+	/* find the new image before the drive is touched */
+	sd_res = FR_NO_FILE;
+#if DIR_CACHE_SIZE > 0
+	if (!dir_missing("/DISKS80", "*.DSK", &SFN[9]))
+#endif
+		sd_res = f_stat(SFN, NULL);
+#if DISK_DSZ
+	/* else try the compressed image */
+	if (sd_res != FR_OK) {
+		strcpy(&SFN[n], ".DSZ");
+		sd_res = f_stat(SFN, NULL);
+	}
+#endif
+	if (sd_res != FR_OK) {
+		DISK_UNLOCK();
+		return FDC_STAT_NODISK;
+	}
+
+	/* release the disk image currently in the drive */
+	close_disk(drive);
+	strcpy(old, disks[drive]);
+	old_overlay = disk_overlay[drive];
+	old_type = disk_type[drive];
+
+	/* open the new image, it stays open */
+	strcpy(disks[drive], SFN);
+	disk_overlay[drive] = DISK_OVL_SECS > 0 && overlay;
+	if ((sd_res = open_disk(drive)) != FR_OK) {
+		/* keep the old image, it is opened again when used */
+		strcpy(disks[drive], old);
+		disk_overlay[drive] = old_overlay;
+		disk_type[drive] = old_type;
+		DISK_UNLOCK();
+		return FDC_STAT_NODISK;
+	}
+
+	/* images larger than a floppy disk are hard disks */
+#if DISK_DSZ
+	if (drives[drive].dsz)
+		size = drives[drive].dsz_size;
+	else
+#endif
+		size = f_size(&drives[drive].f->fil);
+	if (size > (FSIZE_t) (TRK + 1) * SPT * SEC_SZ)
+		disk_type[drive] = DISK_HD;
+	else
+		disk_type[drive] = linear_marked(disks[drive]) ? DISK_FDL
+							       : DISK_FD;
+
+	DISK_UNLOCK();
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * mount a disk image 'name' on disk 'drive', with a copy-on-write
+ * overlay if 'overlay' is true
+ */
+void mount_disk(int drive, const char *name, bool overlay)
+{
+	switch (swap_disk(drive, name, overlay)) {
+	case FDC_STAT_DISK:
+		puts("Disk already mounted or in another sector order\n");
+		return;
+	case FDC_STAT_NODISK:
+		puts("File not found\n");
+		return;
+	default:
+		break;
+	}
+
+	if (disk_type[drive] == DISK_HD)
+		puts("Hard disk image");
+	putchar('\n');
+}
+
+/*
+ * unmount the disk image on disk 'drive'
+ */
+void unmount_disk(int drive)
+{
+	DISK_LOCK();
+	close_disk(drive);
+	disks[drive][0] = '\0';
+	DISK_UNLOCK();
+}
+
+/*
+ * create the new disk image /DISKS80/NAME.DSK, a hard disk if 'hd'
+ * is true, else a floppy disk. It is allocated contiguous on the SD
+ * card, so that its sectors are found without the FAT, and formatted
+ * with 0xe5.
+ */
+void create_disk(const char *name, bool hd)
+{
+	char img[DISKLEN+1];
+	FSIZE_t size, left;
+	UINT n, bw;
+	int t = hd ? DISK_HD : DISK_FD;
+
+	if (strlen(name) == 0 || strlen(name) > FNLEN) {
+		puts("Invalid filename");
+		return;
+	}
+	strcpy(img, "/DISKS80/");
+	strcat(img, name);
+	strcat(img, ".DSK");
+	size = (FSIZE_t) (geom[t].maxtrk + 1) * geom[t].spt * SEC_SZ;
+
+	DISK_LOCK();
+
+	sd_res = f_open(&sd_file, img, FA_WRITE | FA_CREATE_NEW);
+	if (sd_res == FR_EXIST) {
+		DISK_UNLOCK();
+		puts("File exists");
+		return;
+	}
+	if (sd_res == FR_OK) {
+		/* it still works fragmented, only slower */
+		if ((sd_res = f_expand(&sd_file, size, 1)) == FR_DENIED) {
+			puts("No contiguous free space, image is fragmented");
+			sd_res = f_lseek(&sd_file, size);
+		}
+		if (sd_res == FR_OK)
+			sd_res = f_lseek(&sd_file, 0);
+		memset(dsk_buf, 0xe5, SEC_SZ);
+		for (left = size; sd_res == FR_OK && left > 0; left -= n) {
+			n = left > SEC_SZ ? SEC_SZ : (UINT) left;
+			if ((sd_res = f_write(&sd_file, dsk_buf, n, &bw)) ==
+			    FR_OK && bw < n)
+				sd_res = FR_DENIED;
+		}
+		if (f_close(&sd_file) != FR_OK && sd_res == FR_OK)
+			sd_res = FR_DISK_ERR;
+		if (sd_res != FR_OK)
+			f_unlink(img);
+	}
+
+	DISK_UNLOCK();
+
+	if (sd_res == FR_OK)
+		printf("%s created, %lu bytes\n", img, (unsigned long) size);
+	else
+		printf("f_write error: %s (%d)\n", FRESULT_str(sd_res),
+		       sd_res);
+}
+
+#if FF_USE_FASTSEEK
+/*
+ * count the extents of the open file fp from the size of its cluster
+ * link map, which needn't fit into the table for that, -1 on an error
+ */
+static int file_extents(FIL *fp)
+{
+	DWORD tbl[4], *save = fp->cltbl;
+	FRESULT res;
+
+	tbl[0] = 4;
+	fp->cltbl = tbl;
+	res = f_lseek(fp, CREATE_LINKMAP);
+	fp->cltbl = save;
+	if (res != FR_OK && res != FR_NOT_ENOUGH_CORE)
+		return -1;
+	return (int) (tbl[0] - 2) / 2;
+}
+
+#define DEFRAG_TMP	"/DEFRAG.TMP"	/* not in the directory searched */
+
+/*
+ * rewrite the fragmented disk image img, open in fp, contiguous into
+ * DEFRAG_TMP, which replaces it, the file for that is taken from the
+ * pool of the drives, returns its extents afterwards, -1 on an error,
+ * -2 if the image is left in DEFRAG_TMP
+ */
+static int defrag_image(const char *img, FIL *fp)
+{
+	FIL *tp = &get_dfile()->fil;
+#if DISK_CACHE_TRACKS > 0
+	BYTE *buf = cache[0].data;
+	const UINT len = TRKSIZ;
+#else
+	BYTE *buf = dsk_buf;
+	const UINT len = SEC_SZ;
+#endif
+	FSIZE_t left = f_size(fp);
+	UINT n, br, bw;
+	int ext = -1;
+
+	if ((sd_res = f_open(tp, DEFRAG_TMP,
+			     FA_WRITE | FA_CREATE_ALWAYS)) != FR_OK) {
+		f_close(fp);
+		return -1;
+	}
+	sd_res = f_expand(tp, left, 1);
+	for (; sd_res == FR_OK && left > 0; left -= n) {
+		n = left > len ? len : (UINT) left;
+		if ((sd_res = f_read(fp, buf, n, &br)) == FR_OK && br < n)
+			sd_res = FR_INT_ERR;
+		if (sd_res == FR_OK &&
+		    (sd_res = f_write(tp, buf, n, &bw)) == FR_OK &&
+		    bw < n)
+			sd_res = FR_DENIED;
+	}
+	if (sd_res == FR_OK)
+		ext = file_extents(tp);
+	if (f_close(tp) != FR_OK && sd_res == FR_OK)
+		sd_res = FR_DISK_ERR;
+	f_close(fp);
+	if (sd_res == FR_OK && (sd_res = f_unlink(img)) == FR_OK)
+		return (sd_res = f_rename(DEFRAG_TMP, img)) == FR_OK ? ext : -2;
+	f_unlink(DEFRAG_TMP);
+	return -1;
+}
+
+/*
+ * check all disk images in /DISKS80 for fragmentation and rewrite
+ * the fragmented ones contiguous, so that their sectors are found
+ * without the FAT again, reports the extents before and after
+ */
+void defrag_disks(void)
+{
+	DIR dir;
+	FILINFO fno;
+	char img[DISKLEN+1];
+	FRESULT res;
+	int before, after, checked = 0, done = 0;
+	register int i;
+
+	DISK_LOCK();
+
+	/* the images must be up to date and are closed */
+#if DISK_CACHE_TRACKS > 0
+	cache_flush(-1, -1);
+	cache_invalidate(-1);
+#endif
+#if RAMDISK_SIZE > 0
+	ram_flush();
+#endif
+
+	res = f_findfirst(&dir, &fno, "/DISKS80", "*.DSK");
+	while (res == FR_OK && fno.fname[0]) {
+		if (strlen(fno.fname) > FNLEN + 4 || (fno.fattrib & AM_RDO))
+			goto next;
+		strcpy(img, "/DISKS80/");
+		strcat(img, fno.fname);
+		for (i = 0; i < NUMDISK; i++)
+			if (strcmp(disks[i], img) == 0)
+				close_disk(i);
+		if ((sd_res = f_open(&sd_file, img, FA_READ)) != FR_OK)
+			goto next;
+		checked++;
+		if ((before = file_extents(&sd_file)) <= 1) {
+			f_close(&sd_file);
+			goto next;
+		}
+		printf("%s: %d extents", img, before);
+		if ((after = defrag_image(img, &sd_file)) == -2)
+			printf(", rename error: %s (%d), the image is %s\n",
+			       FRESULT_str(sd_res), sd_res, DEFRAG_TMP);
+		else if (after < 0 && sd_res == FR_DENIED)
+			puts(", no contiguous free space");
+		else if (after < 0)
+			printf(", error: %s (%d)\n", FRESULT_str(sd_res),
+			       sd_res);
+		else {
+			printf(" -> %d\n", after);
+			done++;
+		}
+next:
+		res = f_findnext(&dir, &fno);
+	}
+	f_closedir(&dir);
+#if DIR_CACHE_SIZE > 0
+	dir_invalidate();
+#endif
+
+	DISK_UNLOCK();
+
+	printf("%d disk images checked, %d defragmented\n", checked, done);
+}
+#endif /* FF_USE_FASTSEEK */
+
+/*
+ * prepare I/O for sector read and write routines
+ */
+static BYTE prep_io(int drive, int track, int sector, WORD addr, bool rdwr)
+{
+	/* check if drive in range */
+	if ((drive < 0) || (drive >= NUMDISK))
+		return FDC_STAT_DISK;
+
+	/* check if track and sector in range */
+	if (track > geom[disk_type[drive]].maxtrk)
+		return FDC_STAT_TRACK;
+	if ((sector < 1) || (sector > geom[disk_type[drive]].spt))
+		return FDC_STAT_SEC;
+
+	/* check if DMA address in range */
+	if (addr > 0xff7f)
+		return FDC_STAT_DMAADR;
+
+	/* check if disk in drive */
+	if (!strlen(disks[drive])) {
+		return FDC_STAT_NODISK;
+	}
+
+	/* the card might have been lost */
+	if (!card_ready())
+		return FDC_STAT_NODISK;
+
+	lcd_update_drive(drive, track, sector, addr, rdwr, true);
+
+	/* open file with the disk image, if not done already */
+	if (!drives[drive].open) {
+		sd_res = open_disk(drive);
+		if (sd_res != FR_OK) {
+			sd_fail = card_error(sd_res);
+			return FDC_STAT_NODISK;
+		}
+	}
+	drives[drive].f->used = ++dfile_clock;
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * Convert track and sector into track and sector of the image layout
+ * with SPT sectors per track, which is used by the cache and for the
+ * file offsets. Hard disks are mapped linear, the data tracks of
+ * floppy disks with logical sector order are unskewed.
+ */
+static inline void map_sec(int drive, int *track, int *sector)
+{
+	uint32_t lsec;
+
+	switch (disk_type[drive]) {
+	case DISK_HD:
+		lsec = (uint32_t) *track * geom[DISK_HD].spt + *sector - 1;
+		*track = lsec / SPT;
+		*sector = lsec % SPT + 1;
+		break;
+
+	case DISK_FDL:
+		if (*track >= FD_SYSTRK && !disk_linear[drive])
+			*sector = fd_unskew[*sector - 1];
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * slot in the data track of a DISK_FDL image for the sector in slot i
+ * of a DISK_FD image, or the other way round without to_linear
+ */
+static int linear_slot(int i, bool to_linear)
+{
+	register int j;
+
+	if (to_linear)
+		return fd_unskew[i] - 1;
+	for (j = 0; fd_unskew[j] - 1 != i; j++)
+		;
+	return j;
+}
+
+/*
+ * read or write the sector in slot of track of the image of drive
+ */
+static BYTE linear_io(int drive, int track, int slot, BYTE *p, bool wr)
+{
+	UINT n;
+
+	if (seek_sec(drive, track, slot + 1) != FDC_STAT_OK)
+		return FDC_STAT_SEEK;
+	if (wr)
+		sd_res = img_write(drive, p, SEC_SZ, &n);
+	else
+		sd_res = img_read(drive, p, SEC_SZ, &n);
+	if (sd_res != FR_OK || n < SEC_SZ)
+		return wr ? FDC_STAT_WRITE : FDC_STAT_READ;
+	return FDC_STAT_OK;
+}
+
+/*
+ * Toggle the floppy disk in drive between DISK_FD and DISK_FDL. The
+ * sectors of the data tracks in the image are moved into the other
+ * order, so that CP/M finds its data where it was, a permutation cycle
+ * at a time with two sector buffers, and the sidecar marking the order
+ * is created or removed. Only images mounted read/write without an
+ * overlay can be converted. Returns FDC_STAT_OK, FDC_STAT_NODISK
+ * without an image in the drive, FDC_STAT_DISK if it isn't a whole
+ * floppy disk image, FDC_STAT_WRITE if the image can't be written, or
+ * the status of a failed I/O, then the image is only converted partly.
+ */
+BYTE convert_linear(int drive)
+{
+	BYTE a[SEC_SZ], b[SEC_SZ], *carry, *next, *t;
+	BYTE stat = FDC_STAT_OK;
+	bool to_linear;
+	uint32_t moved;
+	int track, ntrk, s, i, k;
+
+	if (disk_type[drive] == DISK_HD)
+		return FDC_STAT_DISK;
+	if (disks[drive][0] == '\0')
+		return FDC_STAT_NODISK;
+	if (disk_overlay[drive])
+		return FDC_STAT_WRITE;
+
+	DISK_LOCK();
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram) {
+		DISK_UNLOCK();
+		return FDC_STAT_WRITE;
+	}
+#endif
+	if (!card_ready() ||
+	    (!drives[drive].open && open_disk(drive) != FR_OK)) {
+		DISK_UNLOCK();
+		return FDC_STAT_NODISK;
+	}
+	to_linear = (disk_type[drive] == DISK_FD);	/* from the image */
+#if DISK_CACHE_TRACKS > 0
+	stat = cache_flush(drive, -1);
+	cache_invalidate(drive);
+#endif
+	ntrk = f_size(&drives[drive].f->fil) / (SPT * SEC_SZ);
+	if (stat == FDC_STAT_OK && ntrk <= FD_SYSTRK)
+		stat = FDC_STAT_DISK;
+
+	for (track = FD_SYSTRK; stat == FDC_STAT_OK && track < ntrk;
+	     track++) {
+		moved = 0;
+		for (s = 0; stat == FDC_STAT_OK && s < SPT; s++) {
+			if (moved & (1UL << s))
+				continue;
+			carry = a;
+			next = b;
+			stat = linear_io(drive, track, s, carry, false);
+			for (i = s; stat == FDC_STAT_OK; i = k) {
+				k = linear_slot(i, to_linear);
+				moved |= 1UL << k;
+				if (k != s)
+					stat = linear_io(drive, track, k, next,
+							 false);
+				if (stat == FDC_STAT_OK)
+					stat = linear_io(drive, track, k,
+							 carry, true);
+				if (k == s)
+					break;
+				t = carry;
+				carry = next;
+				next = t;
+			}
+		}
+		if (f_sync(&drives[drive].f->fil) != FR_OK &&
+		    stat == FDC_STAT_OK)
+			stat = FDC_STAT_WRITE;
+#if DISK_CRC
+		crc_update(drive, track, NULL, 0);
+#endif
+	}
+
+	if (stat == FDC_STAT_OK) {
+		disk_type[drive] = to_linear ? DISK_FDL : DISK_FD;
+		if (linear_mark(disks[drive], to_linear) != FR_OK)
+			stat = FDC_STAT_WRITE;
+	}
+	DISK_UNLOCK();
+
+	return stat;
+}
+
+/*
+ * count transferred bytes and the latency of a transfer
+ * started at t0 in the statistics of drive
+ */
+static void count_io(int drive, uint32_t t0, UINT n)
+{
+	uint32_t us = time_us_32() - t0;
+	int b = us ? 31 - __builtin_clz(us) : 0;
+
+	if (b >= DISK_LAT_BUCKETS)
+		b = DISK_LAT_BUCKETS - 1;
+	disk_stats[drive].lat[b]++;
+	disk_stats[drive].bytes += n;
+}
+
+#if DISK_CONTIG
+/*
+ * read or write n bytes at pos of the contiguous image of drive
+ * with raw block I/O on the SD card, bypassing FatFs, false if it
+ * must be done through FatFs
+ */
+static bool contig_io(int drive, FSIZE_t pos, BYTE *p, UINT n, bool wr)
+{
+	drive_t *dp = &drives[drive];
+	FIL *fp = &dp->f->fil;
+	LBA_t lba;
+	UINT off, len, cnt;
+	int rc;
+
+	if (pos + n > f_size(fp) || (wr && !(fp->flag & FA_WRITE)))
+		return false;
+
+	/* FatFs might have file data not on the card yet */
+	if (f_sync(fp) != FR_OK)
+		return false;
+
+	lba = dp->lba + (LBA_t) (pos / FF_MAX_SS);
+	off = (UINT) (pos % FF_MAX_SS);
+	while (n > 0) {
+		if (off == 0 && n >= FF_MAX_SS && ((uintptr_t) p & 3) == 0) {
+			/* whole blocks in one transfer */
+			cnt = n / FF_MAX_SS;
+			len = cnt * FF_MAX_SS;
+			if (wr)
+				rc = sd_card.write_blocks(&sd_card, p, lba,
+							  cnt);
+			else
+				rc = sd_card.read_blocks(&sd_card, p, lba,
+							 cnt);
+			if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
+				return false;
+			if (wr && contig_sec >= lba && contig_sec - lba < cnt)
+				memcpy(contig_buf, p + (contig_sec - lba) *
+				       FF_MAX_SS, FF_MAX_SS);
+		} else {
+			/* part of a block through contig_buf */
+			cnt = 1;
+			len = FF_MAX_SS - off;
+			if (len > n)
+				len = n;
+			if (contig_sec != lba) {
+				contig_sec = 0;
+				if (sd_card.read_blocks(&sd_card, contig_buf,
+							lba, 1) !=
+				    SD_BLOCK_DEVICE_ERROR_NONE)
+					return false;
+				contig_sec = lba;
+			}
+			if (wr) {
+				memcpy(contig_buf + off, p, len);
+				if (sd_card.write_blocks(&sd_card, contig_buf,
+							 lba, 1) !=
+				    SD_BLOCK_DEVICE_ERROR_NONE) {
+					contig_sec = 0;
+					return false;
+				}
+			} else
+				memcpy(p, contig_buf + off, len);
+		}
+
+		/* the FIL buffer must be read again, if it was written */
+		if (wr && fp->sect >= lba && fp->sect - lba < cnt)
+			fp->sect = 0;
+
+		lba += cnt;
+		off = 0;
+		p += len;
+		n -= len;
+	}
+
+	return true;
+}
+#endif
+
+/*
+ * read from the disk image of drive at the current position
+ */
+static FRESULT img_read(int drive, void *buf, UINT n, UINT *br)
+{
+	uint32_t t0 = time_us_32();
+	FRESULT res;
+
+#if DISK_CONTIG
+	if (drives[drive].lba) {
+		if (contig_io(drive, drives[drive].pos, buf, n, false)) {
+			drives[drive].pos += n;
+			*br = n;
+			res = FR_OK;
+		} else if ((res = f_lseek(&drives[drive].f->fil,
+					  drives[drive].pos)) == FR_OK) {
+			res = f_read(&drives[drive].f->fil, buf, n, br);
+			drives[drive].pos += *br;
+		}
+	} else
+#endif
+	res = f_read(&drives[drive].f->fil, buf, n, br);
+	count_io(drive, t0, *br);
+	if (card_error(res))
+		sd_fail = true;
+
+	return res;
+}
+
+/*
+ * write to the disk image of drive at the current position
+ */
+static FRESULT img_write(int drive, const void *buf, UINT n, UINT *bw)
+{
+	uint32_t t0 = time_us_32();
+	FRESULT res;
+
+#if DISK_CONTIG
+	if (drives[drive].lba) {
+		if (contig_io(drive, drives[drive].pos, (BYTE *) buf, n,
+			      true)) {
+			drives[drive].pos += n;
+			*bw = n;
+			res = FR_OK;
+		} else {
+			/* the image grows, or the card failed */
+			contig_sec = 0;
+			if ((res = f_lseek(&drives[drive].f->fil,
+					   drives[drive].pos)) == FR_OK) {
+				res = f_write(&drives[drive].f->fil, buf, n, bw);
+				drives[drive].pos += *bw;
+			}
+		}
+	} else
+#endif
+	res = f_write(&drives[drive].f->fil, buf, n, bw);
+	count_io(drive, t0, *bw);
+	if (card_error(res))
+		sd_fail = true;
+
+	return res;
+}
+
+/*
+ * print the I/O statistics of the drives
+ */
+void print_disk_stats(void)
+{
+	register int i, j;
+	uint32_t n;
+#if DISK_CACHE_TRACKS > 0
+	uint32_t part;
+#endif
+
+	puts("Drive     Reads    Writes      Hits    Misses    KBytes");
+	for (i = 0; i < NUMDISK; i++)
+		printf("%c     %9lu %9lu %9lu %9lu %9lu\n", 'A' + i,
+		       (unsigned long) disk_stats[i].reads,
+		       (unsigned long) disk_stats[i].writes,
+		       (unsigned long) disk_stats[i].hits,
+		       (unsigned long) disk_stats[i].misses,
+		       (unsigned long) (disk_stats[i].bytes / 1024));
+#if DISK_CACHE_TRACKS > 0
+	n = part = 0;
+	for (i = 0; i < NUMDISK; i++) {
+		n += disk_stats[i].packed;
+		part += disk_stats[i].partial;
+	}
+	printf("\nPartly modified blocks written whole: %lu, partly: %lu\n",
+	       (unsigned long) n, (unsigned long) part);
+#endif
+
+	puts("\nLatency of MicroSD transfers");
+	for (j = 0; j < DISK_LAT_BUCKETS; j++) {
+		n = 0;
+		for (i = 0; i < NUMDISK; i++)
+			n += disk_stats[i].lat[j];
+		if (j < DISK_LAT_BUCKETS - 1)
+			printf("%6lu - %6lu us: %lu\n", j ? 1UL << j : 0UL,
+			       (2UL << j) - 1, (unsigned long) n);
+		else
+			printf("%6lu us or more: %lu\n", 1UL << j,
+			       (unsigned long) n);
+	}
+}
+
+/*
+ * clear the I/O statistics of the drives
+ */
+void clear_disk_stats(void)
+{
+	DISK_LOCK();
+	memset(disk_stats, 0, sizeof(disk_stats));
+	sd_sdio_clearStats(&sd_card);
+	DISK_UNLOCK();
+}
+
+/*
+ * KBytes per second for n blocks transferred in us microseconds
+ */
+static unsigned long sd_kbps(uint32_t n, uint64_t us)
+{
+	return us ? (unsigned long) ((uint64_t) n * 500000U / us) : 0UL;
+}
+
+/*
+ * print the counters of the SD driver and the SD status register
+ * of the card, for finding slow or failing cards
+ */
+void print_sd_stats(void)
+{
+	static const BYTE classes[5] = { 0, 2, 4, 6, 10 };
+	static const uint16_t au_mb[5] = { 12, 16, 24, 32, 64 };
+	static uint32_t buf[16];	/* 512 bits, aligned for the DMA */
+	const BYTE *s = (const BYTE *) buf;
+	sdio_stats_t st;
+	static const char *const fs_types[5] = {
+		"?", "FAT12", "FAT16", "FAT32", "exFAT"
+	};
+	uint32_t hz, csize = 0;
+	bool hs, ok;
+	BYTE au, fs_type = 0;
+
+	DISK_LOCK();
+	if (fs_mounted) {
+		fs_type = fs.fs_type;
+		csize = fs.csize;
+	}
+	st = *sd_sdio_stats(&sd_card);
+	hz = sd_sdio_clockHz(&sd_card);
+	hs = sd_sdio_highSpeed(&sd_card);
+	ok = !(sd_card.state.m_Status & STA_NOINIT)
+	     && rp2040_sdio_get_sd_status(&sd_card, (uint8_t *) buf);
+	DISK_UNLOCK();
+
+	printf("Clock: %.1f MHz%s\n", hz / 1e6, hs ? " (high speed)" : "");
+	printf("Commands: %lu, errors: %lu\n", (unsigned long) st.commands,
+	       (unsigned long) st.cmd_errors);
+	printf("Read: %lu blocks, %lu KB/s, CRC errors: %lu\n",
+	       (unsigned long) st.rd_blocks, sd_kbps(st.rd_blocks, st.rd_us),
+	       (unsigned long) st.rd_crc_errors);
+	printf("Write: %lu blocks, %lu KB/s, CRC errors: %lu\n",
+	       (unsigned long) st.wr_blocks, sd_kbps(st.wr_blocks, st.wr_us),
+	       (unsigned long) st.wr_crc_errors);
+	printf("Timeouts: %lu, retries: %lu, busy: %lu ms\n",
+	       (unsigned long) st.timeouts, (unsigned long) st.retries,
+	       (unsigned long) (st.busy_us / 1000));
+	if (fs_type > 0 && fs_type <= FS_EXFAT)
+		printf("File system: %s, clusters: %lu KB\n",
+		       fs_types[fs_type],
+		       (unsigned long) (csize * FF_MAX_SS / 1024));
+	printf("Card lost: %lu times, mounted again: %lu times%s\n",
+	       (unsigned long) sd_losses, (unsigned long) sd_remounts,
+	       sd_lost ? ", lost now" : "");
+
+	if (!ok) {
+		puts("Can't read the SD status");
+		return;
+	}
+	printf("Speed class: %d, UHS grade: %d, video class: %d\n",
+	       s[8] < 5 ? classes[s[8]] : 0, s[14] >> 4, s[15]);
+	au = s[10] >> 4;
+	if (au == 0)
+		printf("Allocation unit: undefined\n");
+	else if (au <= 10)
+		printf("Allocation unit: %d KB\n", 16 << (au - 1));
+	else
+		printf("Allocation unit: %d MB\n", au_mb[au - 11]);
+	printf("Erase size: %d AUs, timeout: %d s, offset: %d s\n",
+	       (s[11] << 8) | s[12], s[13] >> 2, s[13] & 3);
+}
+
+#if DISK_OVL_SECS > 0
+/*
+ * open or create the overlay file of drive and build the index
+ */
+static FRESULT ovl_open(int drive)
+{
+	drive_t *dp = &drives[drive];
+	char name[DISKLEN+1];
+	BYTE hdr[4];
+	UINT br;
+	uint16_t sec;
+	FRESULT res;
+	register int i;
+
+	strcpy(name, disks[drive]);
+	strcpy(&name[strlen(name) - 3], "OVL");
+	res = f_open(&dp->f->ovl_fil, name, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+	if (res != FR_OK)
+		return res;
+	dp->f->ovl_open = true;
+
+	/* read the sector numbers of the records, a partial last
+	   record from a power loss is overwritten by the next one */
+	dp->f->ovl_n = 0;
+	while (dp->f->ovl_n < DISK_OVL_SECS) {
+		res = f_lseek(&dp->f->ovl_fil, (FSIZE_t) dp->f->ovl_n * OVL_RECSZ);
+		if (res == FR_OK)
+			res = f_read(&dp->f->ovl_fil, hdr, sizeof(hdr), &br);
+		if (res != FR_OK)
+			return res;
+		if (br < sizeof(hdr) || f_size(&dp->f->ovl_fil) <
+		    (FSIZE_t) (dp->f->ovl_n + 1) * OVL_RECSZ)
+			break;
+		sec = hdr[0] | (hdr[1] << 8);
+
+		/* insert into the index, sorted by sector number */
+		for (i = dp->f->ovl_n; i > 0 && dp->f->ovl_map[i - 1].sec > sec; i--)
+			dp->f->ovl_map[i] = dp->f->ovl_map[i - 1];
+		dp->f->ovl_map[i].sec = sec;
+		dp->f->ovl_map[i].rec = dp->f->ovl_n++;
+	}
+
+	return FR_OK;
+}
+
+/*
+ * find the first index entry of the overlay of drive
+ * with a sector number >= sec
+ */
+static int ovl_find(drive_t *dp, uint16_t sec)
+{
+	int lo = 0, hi = dp->f->ovl_n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (dp->f->ovl_map[mid].sec < sec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * replace the n sectors in buf, read from the image of drive starting
+ * with sector on track, with the sectors in the overlay
+ */
+static BYTE ovl_patch(int drive, int track, int sector, BYTE *buf, int n)
+{
+	drive_t *dp = &drives[drive];
+	uint16_t first = track * SPT + sector - 1;
+	uint32_t t0;
+	UINT br;
+	register int i;
+
+	if (!dp->f->ovl_open)
+		return FDC_STAT_OK;
+
+	for (i = ovl_find(dp, first);
+	     i < (int) dp->f->ovl_n && dp->f->ovl_map[i].sec < first + n; i++) {
+		t0 = time_us_32();
+		if (f_lseek(&dp->f->ovl_fil, (FSIZE_t) dp->f->ovl_map[i].rec *
+			    OVL_RECSZ + 4) != FR_OK)
+			return FDC_STAT_SEEK;
+		sd_res = f_read(&dp->f->ovl_fil,
+				&buf[(dp->f->ovl_map[i].sec - first) * SEC_SZ],
+				SEC_SZ, &br);
+		count_io(drive, t0, br);
+		if (sd_res != FR_OK || br < SEC_SZ)
+			return FDC_STAT_READ;
+	}
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * write n sectors from buf starting with sector on track
+ * into the overlay of drive
+ */
+static BYTE ovl_write(int drive, int track, int sector, const BYTE *buf,
+		      int n)
+{
+	drive_t *dp = &drives[drive];
+	uint16_t sec = track * SPT + sector - 1;
+	BYTE hdr[4] = { 0, 0, 0, 0 };
+	uint32_t t0;
+	UINT bw;
+	register int i, j;
+
+	for (j = 0; j < n; j++, sec++, buf += SEC_SZ) {
+		t0 = time_us_32();
+		i = ovl_find(dp, sec);
+		if (i < (int) dp->f->ovl_n && dp->f->ovl_map[i].sec == sec) {
+			/* update the record in place */
+			if (f_lseek(&dp->f->ovl_fil, (FSIZE_t) dp->f->ovl_map[i].rec
+				    * OVL_RECSZ + 4) != FR_OK)
+				return FDC_STAT_SEEK;
+		} else {
+			/* append a new record */
+			if (dp->f->ovl_n >= DISK_OVL_SECS)
+				return FDC_STAT_WRITE;
+			if (f_lseek(&dp->f->ovl_fil, (FSIZE_t) dp->f->ovl_n *
+				    OVL_RECSZ) != FR_OK)
+				return FDC_STAT_SEEK;
+			hdr[0] = sec & 0xff;
+			hdr[1] = sec >> 8;
+			sd_res = f_write(&dp->f->ovl_fil, hdr, sizeof(hdr), &bw);
+			if (sd_res != FR_OK || bw < sizeof(hdr))
+				return FDC_STAT_WRITE;
+			memmove(&dp->f->ovl_map[i + 1], &dp->f->ovl_map[i],
+				(dp->f->ovl_n - i) * sizeof(ovl_ent_t));
+			dp->f->ovl_map[i].sec = sec;
+			dp->f->ovl_map[i].rec = dp->f->ovl_n++;
+		}
+		sd_res = f_write(&dp->f->ovl_fil, buf, SEC_SZ, &bw);
+		count_io(drive, t0, bw);
+		if (sd_res != FR_OK || bw < SEC_SZ)
+			return FDC_STAT_WRITE;
+	}
+
+	if (f_sync(&dp->f->ovl_fil) != FR_OK)
+		return FDC_STAT_WRITE;
+
+	return FDC_STAT_OK;
+}
+#endif /* DISK_OVL_SECS > 0 */
+
+/*
+ * seek to sector on track in the disk image of drive
+ */
+static BYTE seek_sec(int drive, int track, int sector)
+{
+	FSIZE_t pos;
+
+	pos = (((FSIZE_t) track * (FSIZE_t) SPT) + sector - 1) * SEC_SZ;
+#if DISK_CONTIG
+	/* img_read() and img_write() seek themselves */
+	if (drives[drive].lba) {
+		drives[drive].pos = pos;
+		return FDC_STAT_OK;
+	}
+#endif
+	if (f_lseek(&drives[drive].f->fil, pos) != FR_OK)
+		return FDC_STAT_SEEK;
+
+	return FDC_STAT_OK;
+}
+
+#if DISK_CACHE_TRACKS > 0
+
+/*
+ * find track of drive in the track cache
+ */
+static trkbuf_t *cache_lookup(int drive, int track)
+{
+	register int i;
+
+	for (i = 0; i < DISK_CACHE_TRACKS; i++)
+		if (cache[i].drive == drive && cache[i].track == track) {
+			cache[i].used = ++cache_clock;
+			return &cache[i];
+		}
+
+	return NULL;
+}
+
+/*
+ * read a complete track of drive into the least recently
+ * used track cache entry, returns NULL on error
+ */
+static trkbuf_t *cache_fill(int drive, int track)
+{
+	trkbuf_t *tp = &cache[0];
+	unsigned int br;
+	register int i;
+
+	for (i = 1; i < DISK_CACHE_TRACKS; i++)
+		if (cache[i].used < tp->used)
+			tp = &cache[i];
+
+	/* write back the replaced track, if modified */
+	if (tp->dirty && cache_flush(tp->drive, tp->track) != FDC_STAT_OK)
+		return NULL;
+
+	tp->drive = -1;
+#if DISK_DSZ
+	if (drives[drive].dsz)
+		sd_res = dsz_read(drive, track, tp->data, &br);
+	else
+#endif
+	{
+		if (seek_sec(drive, track, 1) != FDC_STAT_OK)
+			return NULL;
+		sd_res = img_read(drive, tp->data, TRKSIZ, &br);
+	}
+	if (sd_res != FR_OK || br < SEC_SZ)
+		return NULL;
+#if DISK_OVL_SECS > 0
+	if (ovl_patch(drive, track, 1, tp->data, br / SEC_SZ) != FDC_STAT_OK)
+		return NULL;
+#endif
+
+	tp->drive = drive;
+	tp->track = track;
+	tp->nsec = br / SEC_SZ;
+	tp->used = ++cache_clock;
+
+	return tp;
+}
+
+/*
+ * drop all cached tracks of drive, or of all drives if drive is -1
+ */
+static void cache_invalidate(int drive)
+{
+	register int i;
+
+	for (i = 0; i < DISK_CACHE_TRACKS; i++)
+		if (drive < 0 || cache[i].drive == drive) {
+			cache[i].drive = -1;
+			cache[i].used = 0;
+			cache[i].dirty = 0;
+		}
+}
+
+static BYTE flush_track(trkbuf_t *tp);
+
+/*
+ * write back and drop a cached track of drive
+ */
+static void cache_drop(int drive, int track)
+{
+	trkbuf_t *tp;
+
+	if ((tp = cache_lookup(drive, track)) != NULL) {
+		if (tp->dirty)
+			flush_track(tp);
+		tp->drive = -1;
+		tp->used = 0;
+		tp->dirty = 0;
+	}
+}
+
+#define SEC_PER_BLK	(FF_MAX_SS / SEC_SZ)	/* sectors in a card block */
+
+/*
+ * Sectors of a cached track to write back: the modified ones and the
+ * others in the same blocks of the card. The whole track is in the
+ * cache, so the card gets whole blocks and needn't read the rest of a
+ * block before writing it. Only the blocks split by the start or end
+ * of the track are still written partly.
+ */
+static uint32_t flush_mask(trkbuf_t *tp)
+{
+	const int first = (int) (((FSIZE_t) tp->track * SPT) % SEC_PER_BLK);
+	disk_stats_t *st = &disk_stats[tp->drive];
+	uint32_t m = 0, blk;
+	register int b, s, e;
+
+	for (b = -first; b < tp->nsec; b += SEC_PER_BLK) {
+		s = b < 0 ? 0 : b;
+		e = b + SEC_PER_BLK < tp->nsec ? b + SEC_PER_BLK : tp->nsec;
+		blk = (uint32_t) ((1ULL << e) - (1ULL << s));
+		if (!(tp->dirty & blk))
+			continue;
+		if (b < 0 || b + SEC_PER_BLK > tp->nsec)
+			st->partial++;
+		else if ((tp->dirty & blk) != blk)
+			st->packed++;
+		m |= blk;
+	}
+
+	return m;
+}
+
+/*
+ * write back the modified sectors of a cached track
+ */
+static BYTE flush_track(trkbuf_t *tp)
+{
+	unsigned int br;
+	uint32_t m;
+#if DISK_OVL_SECS > 0
+	BYTE res;
+#endif
+	register int s, n;
+
+#if DISK_OVL_SECS > 0
+	/* an overlay keeps the sectors */
+	if (drives[tp->drive].f->ovl_open)
+		m = tp->dirty;
+	else
+#endif
+	m = flush_mask(tp);
+
+	for (s = 0; s < tp->nsec; s++) {
+		if (!(m & (1UL << s)))
+			continue;
+
+		/* find run of consecutive sectors to write */
+		for (n = 1; s + n < tp->nsec; n++)
+			if (!(m & (1UL << (s + n))))
+				break;
+
+#if DISK_OVL_SECS > 0
+		if (drives[tp->drive].f->ovl_open) {
+			res = ovl_write(tp->drive, tp->track, s + 1,
+					&tp->data[s * SEC_SZ], n);
+			if (res != FDC_STAT_OK)
+				return res;
+		} else
+#endif
+		{
+			if (seek_sec(tp->drive, tp->track, s + 1) !=
+			    FDC_STAT_OK)
+				return FDC_STAT_SEEK;
+			sd_res = img_write(tp->drive, &tp->data[s * SEC_SZ],
+					   n * SEC_SZ, &br);
+			if (sd_res != FR_OK ||
+			    br < (unsigned int) (n * SEC_SZ))
+				return FDC_STAT_WRITE;
+		}
+		tp->dirty &= ~(((1UL << n) - 1) << s);
+		s += n;
+	}
+
+	if (f_sync(&drives[tp->drive].f->fil) != FR_OK)
+		return FDC_STAT_WRITE;
+#if DISK_CRC
+	crc_update(tp->drive, tp->track, tp->data, tp->nsec * SEC_SZ);
+#endif
+
+	return FDC_STAT_OK;
+}
+
+/*
+ * write back the modified tracks of drive, or of all drives
+ * if drive is -1, skipping track 'except'
+ */
+static BYTE cache_flush(int drive, int except)
+{
+	BYTE stat = FDC_STAT_OK, res;
+	register int i;
+
+	for (i = 0; i < DISK_CACHE_TRACKS; i++)
+		if (cache[i].drive >= 0 && cache[i].dirty &&
+		    (drive < 0 || cache[i].drive == drive) &&
+		    (drive < 0 || cache[i].track != except)) {
+			res = flush_track(&cache[i]);
+			if (res != FDC_STAT_OK)
+				stat = res;
+		}
+
+	return stat;
+}
+
+/*
+ * alarm callback, schedules the idle flush when no sector
+ * was written for DISK_FLUSH_MS milliseconds
+ */
+static int64_t flush_alarm(alarm_id_t id, void *user_data)
+{
+	int32_t idle;
+	int64_t next = 0;
+	BUDGET_ENTER(BUDGET_ALARM);
+
+	UNUSED(id);
+	UNUSED(user_data);
+
+	idle = (int32_t) (to_ms_since_boot(get_absolute_time()) - last_write);
+	if (idle < DISK_FLUSH_MS)
+		next = -((int64_t) (DISK_FLUSH_MS - idle) * 1000);
+	else
+		irq_set_pending(flush_irq_num);
+	BUDGET_EXIT();
+	return next;
+}
+
+/*
+ * low priority IRQ handler, if the disks are busy try again later
+ */
+static void flush_irq(void)
+{
+	BUDGET_ENTER(BUDGET_DISK);
+
+	if (mutex_try_enter(&disk_mutex, NULL)) {
+		cache_flush(-1, -1);
+		flush_armed = false;
+		mutex_exit(&disk_mutex);
+	} else
+		add_alarm_in_ms(DISK_FLUSH_MS, flush_alarm, NULL, true);
+	BUDGET_EXIT();
+}
+
+/*
+ * read the requested tracks ahead into the cache, unless the disks
+ * are busy, in which case it is tried again with the next call
+ */
+static void readahead(void)
+{
+	trkbuf_t *tp;
+	int drive, track;
+	register int i, j, n;
+
+	if ((drive = ra_drive) < 0 || !mutex_try_enter(&disk_mutex, NULL))
+		return;
+	__mem_fence_acquire();
+	track = ra_track;
+	ra_drive = -1;
+
+	n = disk_readahead;
+	if (n > DISK_READAHEAD_MAX)
+		n = DISK_READAHEAD_MAX;
+
+	for (i = 0; i < n && drives[drive].open
+#if RAMDISK_SIZE > 0
+		    && !drives[drive].ram
+#endif
+		    ; i++, track++) {
+		if (cache_lookup(drive, track) != NULL)
+			continue;
+
+		/* don't replace modified tracks */
+		tp = &cache[0];
+		for (j = 1; j < DISK_CACHE_TRACKS; j++)
+			if (cache[j].used < tp->used)
+				tp = &cache[j];
+		if (tp->dirty || cache_fill(drive, track) == NULL)
+			break;
+	}
+
+	mutex_exit(&disk_mutex);
+}
+
+/*
+ * read the first tracks of drive into the cache before the machine
+ * is started, so that the boot loader and the system tracks are
+ * served without waiting for the MicroSD card
+ */
+void warm_cache(int drive, int tracks)
+{
+	register int track;
+
+	if (tracks > DISK_CACHE_TRACKS)
+		tracks = DISK_CACHE_TRACKS;
+
+	DISK_LOCK();
+	if (disks[drive][0] == '\0' || (!drives[drive].open
+					&& open_disk(drive) != FR_OK))
+		tracks = 0;
+#if FLASH_DISK
+	if (drives[drive].flash != NULL)
+		tracks = 0;
+#endif
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram)
+		tracks = 0;
+#endif
+	for (track = 0; track < tracks; track++)
+		if (cache_lookup(drive, track) == NULL
+		    && cache_fill(drive, track) == NULL)
+			break;
+	DISK_UNLOCK();
+}
+
+/*
+ * Learned warm-up of the track cache. With disk_learn the tracks read
+ * in the first DISK_LEARN_S seconds after the start are logged in the
+ * order of their first read, and the log is written to LEARN_FILE
+ * for the next start. Then disk_task() on core 1 reads the tracks of
+ * the last log into the cache while the boot ROM and the BIOS run, up
+ * to DISK_CACHE_TRACKS - 1 ahead of the last one the CPU read from
+ * the log, so that the tracks read ahead aren't replaced before their
+ * use. The log is only used with the same disks mounted.
+ */
+#define LEARN_FILE	"/CONF80/LEARN.DAT"
+#define LEARN_MAGIC	0x314e524c	/* "LRN1" */
+#ifndef DISK_LEARN_S
+#define DISK_LEARN_S	10	/* seconds logged after the start */
+#endif
+#ifndef DISK_LEARN_MAX
+#define DISK_LEARN_MAX	256	/* tracks in the log */
+#endif
+#define LEARN_ENTRY(d, t)	((uint16_t) ((d) << 12 | (t)))
+
+typedef struct learn_hdr {
+	uint32_t magic;		/* LEARN_MAGIC */
+	uint32_t disks;		/* hash of the mounted disks */
+	uint32_t n;		/* number of tracks */
+} learn_hdr_t;
+
+static uint16_t learn_rec[DISK_LEARN_MAX]; /* tracks read this time */
+static uint16_t learn_play[DISK_LEARN_MAX]; /* tracks of the last log */
+static uint32_t learn_nrec, learn_nplay;
+static uint32_t learn_pos;		/* next track read ahead */
+static uint32_t learn_used;		/* after the last one read by CPU */
+static volatile bool learn_on;		/* logging, disk mutex held */
+static uint32_t learn_end;		/* time the log is written in ms */
+static FIL learn_fil;
+
+/*
+ * FNV-1a hash of the names of the mounted disks
+ */
+static uint32_t learn_disks(void)
+{
+	uint32_t h = 2166136261U;
+	register const char *p;
+	register int i;
+
+	for (i = 0; i < NUMDISK; i++)
+		for (p = disks[i]; *p; p++)
+			h = (h ^ (BYTE) *p) * 16777619U;
+	return h;
+}
+
+/*
+ * log a track read, and follow the CPU in the last log,
+ * called with the disk mutex held
+ */
+static void learn_read(int drive, int track)
+{
+	uint16_t e = LEARN_ENTRY(drive, track);
+	register uint32_t i, n;
+
+	if (!learn_on || track >= 4096)
+		return;
+	for (i = 0; i < learn_nrec; i++)
+		if (learn_rec[i] == e)
+			break;
+	if (i == learn_nrec && learn_nrec < DISK_LEARN_MAX)
+		learn_rec[learn_nrec++] = e;
+
+	n = learn_used + DISK_CACHE_TRACKS;
+	if (n > learn_nplay)
+		n = learn_nplay;
+	for (i = learn_used; i < n; i++)
+		if (learn_play[i] == e) {
+			learn_used = i + 1;
+			break;
+		}
+}
+
+/*
+ * write the log to LEARN_FILE, called with the disk mutex held
+ */
+static void learn_save(void)
+{
+	learn_hdr_t hdr;
+	UINT bw;
+
+	hdr.magic = LEARN_MAGIC;
+	hdr.disks = learn_disks();
+	hdr.n = learn_nrec;
+	if (f_open(&learn_fil, LEARN_FILE, FA_WRITE | FA_CREATE_ALWAYS)
+	    != FR_OK)
+		return;
+	f_write(&learn_fil, &hdr, sizeof(hdr), &bw);
+	f_write(&learn_fil, learn_rec, learn_nrec * sizeof(learn_rec[0]),
+		&bw);
+	f_close(&learn_fil);
+}
+
+/*
+ * read the tracks of the last log ahead, and write the new log
+ * when the time is up, called from core 1
+ */
+static void learn_task(void)
+{
+	trkbuf_t *tp;
+	int drive, track;
+	register int j;
+
+	if (!learn_on || !mutex_try_enter(&disk_mutex, NULL))
+		return;
+
+	if ((int32_t) (to_ms_since_boot(get_absolute_time()) - learn_end)
+	    >= 0) {
+		learn_save();
+		learn_on = false;
+		mutex_exit(&disk_mutex);
+		return;
+	}
+
+	while (learn_pos < learn_nplay
+	       && learn_pos < learn_used + DISK_CACHE_TRACKS - 1) {
+		drive = learn_play[learn_pos] >> 12;
+		track = learn_play[learn_pos++] & 0xfff;
+		if (drive >= NUMDISK || !drives[drive].open
+#if FLASH_DISK
+		    || drives[drive].flash != NULL
+#endif
+#if RAMDISK_SIZE > 0
+		    || drives[drive].ram
+#endif
+		    || cache_lookup(drive, track) != NULL)
+			continue;
+
+		/* don't replace modified tracks */
+		tp = &cache[0];
+		for (j = 1; j < DISK_CACHE_TRACKS; j++)
+			if (cache[j].used < tp->used)
+				tp = &cache[j];
+		if (tp->dirty || cache_fill(drive, track) == NULL)
+			break;
+	}
+
+	mutex_exit(&disk_mutex);
+}
+
+/*
+ * load the log of the last start and start logging this one,
+ * called from core 0 before the machine is started
+ */
+void learn_cache(void)
+{
+	learn_hdr_t hdr;
+	UINT br;
+	register int i, d;
+
+	DISK_LOCK();
+	learn_nrec = learn_nplay = learn_pos = learn_used = 0;
+	if (f_open(&learn_fil, LEARN_FILE, FA_READ) == FR_OK) {
+		if (f_read(&learn_fil, &hdr, sizeof(hdr), &br) == FR_OK
+		    && br == sizeof(hdr) && hdr.magic == LEARN_MAGIC
+		    && hdr.disks == learn_disks() && hdr.n <= DISK_LEARN_MAX
+		    && f_read(&learn_fil, learn_play,
+			      hdr.n * sizeof(learn_play[0]), &br) == FR_OK
+		    && br == hdr.n * sizeof(learn_play[0]))
+			learn_nplay = hdr.n;
+		f_close(&learn_fil);
+	}
+	/* the disks in the log are opened, core 1 only reads open ones */
+	for (i = 0; i < (int) learn_nplay; i++) {
+		d = learn_play[i] >> 12;
+		if (d < NUMDISK && disks[d][0] != '\0' && !drives[d].open)
+			open_disk(d);
+	}
+	learn_end = to_ms_since_boot(get_absolute_time())
+		    + DISK_LEARN_S * 1000;
+	learn_on = true;
+	DISK_UNLOCK();
+	__sev();
+}
+
+#endif /* DISK_CACHE_TRACKS > 0 */
+
+#if DISK_DSZ
+/*
+ * read the header of the compressed image of drive
+ */
+static FRESULT dsz_open(int drive)
+{
+	BYTE hdr[DSZ_HDRSZ];
+	FRESULT res;
+	UINT br;
+
+	res = f_read(&drives[drive].f->fil, hdr, sizeof(hdr), &br);
+	if (res == FR_OK && (br < sizeof(hdr) || memcmp(hdr, "DSZ\1", 4)))
+		res = FR_NO_FILESYSTEM;
+	if (res == FR_OK)
+		drives[drive].dsz_size = get_le32(&hdr[4]);
+
+	return res;
+}
+
+/*
+ * get the next byte of a compressed track, -1 on error
+ */
+static int dsz_getc(dsz_in_t *ip)
+{
+	UINT br;
+
+	if (ip->pos == ip->n) {
+		if (ip->left == 0)
+			return -1;
+		ip->n = ip->left < SEC_SZ ? ip->left : SEC_SZ;
+		if (img_read(ip->drive, dsk_buf, ip->n, &br) != FR_OK ||
+		    br < ip->n)
+			return -1;
+		ip->left -= ip->n;
+		ip->pos = 0;
+	}
+
+	return dsk_buf[ip->pos++];
+}
+
+/*
+ * read and decompress track of the compressed image of drive into
+ * buf, the number of bytes of the track is stored in *br
+ */
+static FRESULT dsz_read(int drive, int track, BYTE *buf, UINT *br)
+{
+	drive_t *dp = &drives[drive];
+	dsz_in_t in;
+	BYTE idx[8];
+	FRESULT res;
+	UINT len, o, n;
+	int c;
+	register UINT j;
+
+	*br = 0;
+	if ((UINT) track * TRKSIZ >= dp->dsz_size)
+		return FR_OK;
+	len = dp->dsz_size - (UINT) track * TRKSIZ;
+	if (len > TRKSIZ)
+		len = TRKSIZ;
+
+	/* get the offsets of this and the next track from the index */
+	res = f_lseek(&dp->f->fil, DSZ_HDRSZ + (FSIZE_t) track * 4);
+	if (res == FR_OK)
+		res = img_read(drive, idx, sizeof(idx), &n);
+	if (res == FR_OK && n < sizeof(idx))
+		res = FR_DISK_ERR;
+	if (res == FR_OK)
+		res = f_lseek(&dp->f->fil, get_le32(idx));
+	if (res != FR_OK)
+		return res;
+	in.drive = drive;
+	in.left = get_le32(&idx[4]) - get_le32(idx);
+	in.pos = in.n = 0;
+
+	/* stored uncompressed */
+	if (in.left == len)
+		return img_read(drive, buf, len, br);
+
+	for (o = 0; o < len; o += n) {
+		if ((c = dsz_getc(&in)) < 0)
+			return FR_DISK_ERR;
+		n = c < 128 ? c + 1 : c - 126;
+		if (o + n > len)
+			return FR_DISK_ERR;
+		if (c < 128) {
+			for (j = 0; j < n; j++) {
+				if ((c = dsz_getc(&in)) < 0)
+					return FR_DISK_ERR;
+				buf[o + j] = c;
+			}
+		} else {
+			if ((c = dsz_getc(&in)) < 0)
+				return FR_DISK_ERR;
+			memset(&buf[o], c, n);
+		}
+	}
+	*br = len;
+
+	return FR_OK;
+}
+
+/*
+ * output a byte of a compressed track, buffered in dsk_buf
+ */
+static void dsz_putc(dsz_out_t *op, BYTE b)
+{
+	UINT bw;
+
+	if (op->fp != NULL) {
+		dsk_buf[op->size % SEC_SZ] = b;
+		if (op->size % SEC_SZ == SEC_SZ - 1 && op->res == FR_OK) {
+			op->res = f_write(op->fp, dsk_buf, SEC_SZ, &bw);
+			if (op->res == FR_OK && bw < SEC_SZ)
+				op->res = FR_DISK_ERR;
+		}
+	}
+	op->size++;
+}
+
+/*
+ * compress len bytes of a track at p
+ */
+static void dsz_pack(dsz_out_t *op, const BYTE *p, UINT len)
+{
+	UINT i = 0, n, bw;
+	register UINT j;
+
+	while (i < len) {
+		/* runs of 3 or more bytes are encoded */
+		for (n = 1; i + n < len && n < 129 && p[i + n] == p[i]; n++)
+			;
+		if (n >= 3) {
+			dsz_putc(op, n + 126);
+			dsz_putc(op, p[i]);
+			i += n;
+			continue;
+		}
+
+		/* literal bytes up to the next run */
+		for (n = 1; i + n < len && n < 128; n++)
+			if (i + n + 2 < len && p[i + n] == p[i + n + 1] &&
+			    p[i + n] == p[i + n + 2])
+				break;
+		dsz_putc(op, n - 1);
+		for (j = 0; j < n; j++)
+			dsz_putc(op, p[i + j]);
+		i += n;
+	}
+
+	/* write the rest in the buffer */
+	if (op->fp != NULL && op->size % SEC_SZ && op->res == FR_OK) {
+		op->res = f_write(op->fp, dsk_buf, op->size % SEC_SZ, &bw);
+		if (op->res == FR_OK && bw < op->size % SEC_SZ)
+			op->res = FR_DISK_ERR;
+	}
+}
+
+/*
+ * make the compressed image NAME.DSZ of the disk image NAME.DSK,
+ * the first entry of the track cache is used as buffer
+ */
+void compress_disk(const char *name)
+{
+	char img[DISKLEN+1], dsz[DISKLEN+1];
+	BYTE *buf = cache[0].data, le[DSZ_HDRSZ];
+	dsz_out_t out;
+	FSIZE_t size;
+	DWORD off;
+	FRESULT res;
+	UINT n, bw;
+	int track, tracks;
+	FIL *fp;
+	register int i;
+
+	if (strlen(name) > FNLEN) {
+		puts("File not found");
+		return;
+	}
+	strcpy(img, "/DISKS80/");
+	strcat(img, name);
+	strcpy(dsz, img);
+	strcat(img, ".DSK");
+	strcat(dsz, ".DSZ");
+	for (i = 0; i < NUMDISK; i++)
+		if (strcmp(disks[i], dsz) == 0) {
+			puts("Compressed image is mounted");
+			return;
+		}
+
+	DISK_LOCK();
+
+	/* the image must be up to date */
+	cache_flush(-1, -1);
+	cache_invalidate(-1);
+#if RAMDISK_SIZE > 0
+	ram_flush();
+#endif
+
+	if ((fp = image_fil(img)) == NULL) {
+		DISK_UNLOCK();
+		puts("File not found");
+		return;
+	}
+	if ((res = f_open(&dsz_fil, dsz, FA_WRITE | FA_CREATE_ALWAYS))
+	    != FR_OK) {
+		image_close(fp);
+		DISK_UNLOCK();
+		printf("f_open error: %s (%d)\n", FRESULT_str(res), res);
+		return;
+	}
+
+	size = f_size(fp);
+	tracks = (size + TRKSIZ - 1) / TRKSIZ;
+	memcpy(le, "DSZ\1", 4);
+	put_le32(&le[4], size);
+	res = f_write(&dsz_fil, le, DSZ_HDRSZ, &bw);
+	off = DSZ_HDRSZ + (tracks + 1) * 4;
+
+	for (track = 0; res == FR_OK; track++) {
+		/* offset of the track in the index */
+		put_le32(le, off);
+		if ((res = f_lseek(&dsz_fil, DSZ_HDRSZ + track * 4)) == FR_OK)
+			res = f_write(&dsz_fil, le, 4, &bw);
+		if (res != FR_OK || track == tracks)
+			break;
+
+		if ((res = f_lseek(fp, (FSIZE_t) track * TRKSIZ)) == FR_OK)
+			res = f_read(fp, buf, TRKSIZ, &n);
+		if (res == FR_OK)
+			res = f_lseek(&dsz_fil, off);
+		if (res != FR_OK)
+			break;
+
+		/* store the track compressed if it gets smaller */
+		out.fp = NULL;
+		out.size = 0;
+		out.res = FR_OK;
+		dsz_pack(&out, buf, n);
+		if (out.size < n) {
+			out.fp = &dsz_fil;
+			out.size = 0;
+			dsz_pack(&out, buf, n);
+			res = out.res;
+			off += out.size;
+		} else {
+			res = f_write(&dsz_fil, buf, n, &bw);
+			off += n;
+		}
+	}
+
+	image_close(fp);
+	if (f_close(&dsz_fil) != FR_OK && res == FR_OK)
+		res = FR_DISK_ERR;
+	if (res != FR_OK)
+		f_unlink(dsz);
+#if DIR_CACHE_SIZE > 0
+	dir_invalidate();
+#endif
+	DISK_UNLOCK();
+
+	if (res != FR_OK)
+		printf("f_write error: %s (%d)\n", FRESULT_str(res), res);
+	else
+		printf("%s compressed from %lu to %lu bytes\n", &dsz[9],
+		       (unsigned long) size, (unsigned long) off);
+}
+#endif /* DISK_DSZ */
+
+#if PRINT_SPOOL_SIZE > 0
+/*
+ * Printer spool, the CPU on core 0 puts the printer output into a
+ * ring buffer, which is written by disk_task() on core 1 in chunks of
+ * PRINT_SPOOL_CHUNK bytes to /PRINT80/PRINTnnn.TXT, so that the CPU
+ * doesn't wait for the MicroSD card. Output left in the buffer is
+ * written after DISK_FLUSH_MS without new output. The file is created
+ * with the first output written and closed on reset and exit. If the
+ * file can't be created or written the output is discarded.
+ */
+static BYTE spool_buf[PRINT_SPOOL_SIZE];
+static volatile uint32_t spool_head;	/* next byte put, by core 0 */
+static volatile uint32_t spool_tail;	/* next byte written, disk mutex held */
+static volatile uint32_t spool_last;	/* time of last output in ms */
+static FIL spool_file;
+static bool spool_isopen, spool_failed;
+
+unsigned int __not_in_flash_func(spool_room)(void)
+{
+	return PRINT_SPOOL_SIZE - (spool_head - spool_tail);
+}
+
+/*
+ * put a byte into the spool buffer, returns false if it is full
+ */
+bool __not_in_flash_func(spool_put)(BYTE c)
+{
+	if (spool_room() == 0)
+		return false;
+	spool_buf[spool_head & (PRINT_SPOOL_SIZE - 1)] = c;
+	__mem_fence_release();
+	spool_head++;
+	spool_last = to_ms_since_boot(get_absolute_time());
+
+	return true;
+}
+
+/*
+ * create the next free /PRINT80/PRINTnnn.TXT, called with the disk
+ * mutex held
+ */
+static void spool_open(void)
+{
+	char path[9 + 12 + 1];	/* "/PRINT80/" 8.3 name */
+	FILINFO fno;
+	int i;
+
+	f_mkdir("/PRINT80");
+	for (i = 0; i < 1000; i++) {
+		snprintf(path, sizeof(path), "/PRINT80/PRINT%03d.TXT", i);
+		if ((sd_res = f_stat(path, &fno)) == FR_NO_FILE)
+			break;
+	}
+	if (sd_res == FR_NO_FILE)
+		sd_res = f_open(&spool_file, path,
+				FA_WRITE | FA_CREATE_NEW);
+	spool_isopen = (sd_res == FR_OK);
+	spool_failed = !spool_isopen;
+}
+
+/*
+ * write n bytes from the spool buffer, called with the disk mutex held
+ */
+static void spool_write(uint32_t n)
+{
+	uint32_t tail = spool_tail, i, len;
+	UINT bw;
+
+	__mem_fence_acquire();
+	if (!spool_isopen && !spool_failed)
+		spool_open();
+
+	while (n > 0) {
+		i = tail & (PRINT_SPOOL_SIZE - 1);
+		len = PRINT_SPOOL_SIZE - i;
+		if (len > n)
+			len = n;
+		if (spool_isopen &&
+		    ((sd_res = f_write(&spool_file, &spool_buf[i], len,
+				       &bw)) != FR_OK || bw != len)) {
+			f_close(&spool_file);
+			spool_isopen = false;
+			spool_failed = true;
+		}
+		tail += len;
+		n -= len;
+	}
+
+	__mem_fence_release();
+	spool_tail = tail;
+}
+
+/*
+ * write full chunks, or what is left after the idle time,
+ * called from core 1
+ */
+static void spool_task(void)
+{
+	uint32_t n = spool_head - spool_tail;
+	int32_t idle;
+
+	if (n == 0)
+		return;
+	idle = (int32_t) (to_ms_since_boot(get_absolute_time()) - spool_last);
+	if (n < PRINT_SPOOL_CHUNK && idle < DISK_FLUSH_MS)
+		return;
+	if (!mutex_try_enter(&disk_mutex, NULL))
+		return;
+
+	if (n >= PRINT_SPOOL_CHUNK)
+		spool_write(PRINT_SPOOL_CHUNK);
+	else {
+		spool_write(n);
+		if (spool_isopen)
+			f_sync(&spool_file);
+	}
+
+	mutex_exit(&disk_mutex);
+}
+
+/*
+ * write the rest of the spool buffer and close the file,
+ * called on reset and exit
+ */
+void spool_close(void)
+{
+	DISK_LOCK();
+	spool_write(spool_head - spool_tail);
+	if (spool_isopen)
+		f_close(&spool_file);
+	spool_isopen = false;
+	spool_failed = false;
+	DISK_UNLOCK();
+}
+#endif /* PRINT_SPOOL_SIZE > 0 */
+
+#if CAPTURE_SIZE > 0
+/*
+ * Capture of the console and printer output, a copy of the output of
+ * SIO1, SIO2 and the printer is put into a ring buffer for each, which
+ * is written by disk_task() on core 1 to /LOG80/SIO1_nnn.TXT,
+ * SIO2_nnn.TXT and PRT_nnn.TXT, with the same nnn for a session. The
+ * file positions stay aligned to CAPTURE_CHUNK: a full chunk is
+ * written at once, a part written after DISK_FLUSH_MS without new
+ * output is written again with the rest of its chunk, so the card sees
+ * few and aligned writes. The CPU never waits, if a buffer is full the
+ * output isn't captured and counted as lost, which is noted at the end
+ * of the file. The files are created with the first output written and
+ * closed on exit.
+ */
+typedef struct capture {
+	BYTE buf[CAPTURE_SIZE];
+	volatile uint32_t head;	/* next byte put, by core 0 */
+	volatile uint32_t tail;	/* start of the chunk, disk mutex held */
+	uint32_t synced;	/* bytes of the chunk in the file */
+	volatile uint32_t last;	/* time of last output in ms */
+	volatile uint32_t lost;	/* bytes which didn't fit */
+	FIL file;
+	bool isopen, failed;
+} capture_t;
+
+static capture_t capture[CAPT_STREAMS];
+static const char *const capture_names[CAPT_STREAMS] = {
+	"SIO1", "SIO2", "PRT"
+};
+static int capture_session = -1; /* nnn of the files */
+
+/*
+ * put a byte into the buffer of stream s, never waits
+ */
+void __not_in_flash_func(capture_put)(int s, BYTE c)
+{
+	capture_t *cp = &capture[s];
+	uint32_t head = cp->head;
+
+	if (head - cp->tail == CAPTURE_SIZE) {
+		cp->lost++;
+		return;
+	}
+	cp->buf[head & (CAPTURE_SIZE - 1)] = c;
+	__mem_fence_release();
+	cp->head = head + 1;
+	cp->last = to_ms_since_boot(get_absolute_time());
+}
+
+/*
+ * create the file of stream s, the first one of a session looks for
+ * the next nnn free for all streams, called with the disk mutex held
+ */
+static void capture_open(int s)
+{
+	char path[7 + 12 + 1];	/* "/LOG80/" 8.3 name */
+	capture_t *cp = &capture[s];
+	int i, j;
+
+	if (capture_session < 0) {
+		f_mkdir("/LOG80");
+		for (i = 0; i < 1000; i++) {
+			for (j = 0; j < CAPT_STREAMS; j++) {
+				snprintf(path, sizeof(path),
+					 "/LOG80/%s_%03d.TXT",
+					 capture_names[j], i);
+				if (f_stat(path, NULL) != FR_NO_FILE)
+					break;
+			}
+			if (j == CAPT_STREAMS)
+				break;
+		}
+		if (i == 1000) {
+			cp->failed = true;
+			return;
+		}
+		capture_session = i;
+	}
+	snprintf(path, sizeof(path), "/LOG80/%s_%03d.TXT", capture_names[s],
+		 capture_session);
+	sd_res = f_open(&cp->file, path, FA_WRITE | FA_CREATE_NEW);
+	cp->isopen = (sd_res == FR_OK);
+	cp->failed = !cp->isopen;
+}
+
+/*
+ * write n bytes from the start of the chunk, a full chunk moves the
+ * tail to the next one, else the file position is set back to the
+ * start of the chunk, called with the disk mutex held
+ */
+static void capture_write(int s, uint32_t n)
+{
+	capture_t *cp = &capture[s];
+	uint32_t tail = cp->tail;
+	UINT bw;
+
+	__mem_fence_acquire();
+	if (!cp->isopen && !cp->failed)
+		capture_open(s);
+
+	if (cp->isopen) {
+		if ((sd_res = f_write(&cp->file,
+				      &cp->buf[tail & (CAPTURE_SIZE - 1)],
+				      n, &bw)) != FR_OK || bw != n
+		    || (n < CAPTURE_CHUNK &&
+			((sd_res = f_sync(&cp->file)) != FR_OK ||
+			 (sd_res = f_lseek(&cp->file, f_tell(&cp->file) - n))
+			 != FR_OK))) {
+			f_close(&cp->file);
+			cp->isopen = false;
+			cp->failed = true;
+		}
+	}
+
+	if (n == CAPTURE_CHUNK) {
+		cp->synced = 0;
+		__mem_fence_release();
+		cp->tail = tail + CAPTURE_CHUNK;
+	} else
+		cp->synced = n;
+}
+
+/*
+ * write full chunks, or the part of one after the idle time,
+ * called from core 1
+ */
+static void capture_task(void)
+{
+	capture_t *cp;
+	uint32_t n;
+	int32_t idle;
+	int s;
+
+	for (s = 0; s < CAPT_STREAMS; s++) {
+		cp = &capture[s];
+		n = cp->head - cp->tail;
+		if (n == cp->synced)
+			continue;
+		idle = (int32_t) (to_ms_since_boot(get_absolute_time())
+				  - cp->last);
+		if (n < CAPTURE_CHUNK && idle < DISK_FLUSH_MS)
+			continue;
+		if (!mutex_try_enter(&disk_mutex, NULL))
+			return;
+		capture_write(s, n < CAPTURE_CHUNK ? n : CAPTURE_CHUNK);
+		mutex_exit(&disk_mutex);
+	}
+}
+
+/*
+ * write the rest of the buffers, note the lost bytes and close
+ * the files, called on exit
+ */
+void capture_close(void)
+{
+	capture_t *cp;
+	char s[48];
+	uint32_t n;
+	UINT bw;
+	int i;
+
+	DISK_LOCK();
+	for (i = 0; i < CAPT_STREAMS; i++) {
+		cp = &capture[i];
+		while ((n = cp->head - cp->tail) >= CAPTURE_CHUNK)
+			capture_write(i, CAPTURE_CHUNK);
+		if (n > 0)
+			capture_write(i, n);
+		if (cp->isopen) {
+			f_lseek(&cp->file, f_tell(&cp->file) + cp->synced);
+			if (cp->lost) {
+				n = snprintf(s, sizeof(s),
+					     "\r\n[%lu bytes lost]\r\n",
+					     (unsigned long) cp->lost);
+				f_write(&cp->file, s, n, &bw);
+			}
+			f_close(&cp->file);
+		}
+		cp->head = cp->tail = cp->synced = cp->lost = 0;
+		cp->isopen = cp->failed = false;
+	}
+	capture_session = -1;
+	DISK_UNLOCK();
+}
+#endif /* CAPTURE_SIZE > 0 */
+
+#if PC_PROF_SIZE > 0
+/*
+ * PC sampling profiler, a repeating timer on core 0 samples PC and
+ * the selected bank PC_PROF_HZ times a second into a ring buffer,
+ * which disk_task() on core 1 writes in chunks of PC_PROF_CHUNK samples
+ * to PC_PROF_FILE. The file starts with "PCP1" and the sample rate,
+ * followed by the samples, 32 bits little endian with the PC in bits
+ * 0 - 15 and the bank in bits 16 - 23. Samples are dropped if the
+ * buffer is full. Without the profiler running nothing is done.
+ *
+ * For MP/M, where the processes run in their own banks, the samples
+ * are also counted per bank and per console. A bank belongs to the
+ * console SIO1 - SIO5 whose data port was used last with it selected,
+ * the XIOS does the console I/O in the bank of the calling process.
+ * Console 0 are the banks without console I/O, like the resident
+ * system processes. The counts are read through the hardware control
+ * port, e.g. by cpmtools/cpuacct.com, and cleared when the profiler
+ * starts.
+ */
+static uint32_t prof_buf[PC_PROF_SIZE];
+static volatile uint32_t prof_head;	/* next sample put, by the timer */
+static volatile uint32_t prof_tail;	/* next sample written, disk mutex held */
+static volatile uint32_t prof_lost;	/* samples dropped */
+static repeating_timer_t prof_timer;
+static FIL prof_file;
+static bool prof_on, prof_isopen;
+uint32_t pc_acct_total;			/* samples accounted */
+uint32_t pc_acct_bank[PC_ACCT_BANKS];	/* samples per bank */
+uint32_t pc_acct_con[PC_ACCT_CONS];	/* samples per console */
+BYTE pc_acct_owner[PC_ACCT_BANKS];	/* console of the banks */
+
+static bool __not_in_flash_func(prof_sample)(repeating_timer_t *rt)
+{
+	BUDGET_ENTER(BUDGET_ALARM);
+
+	UNUSED(rt);
+
+	if (cpu_state == ST_CONTIN_RUN) {
+		pc_acct_total++;
+		pc_acct_bank[selbnk]++;
+		pc_acct_con[pc_acct_owner[selbnk]]++;
+		if (prof_head - prof_tail == PC_PROF_SIZE)
+			prof_lost++;
+		else {
+			prof_buf[prof_head & (PC_PROF_SIZE - 1)] = PC
+				| (uint32_t) selbnk << 16;
+			__mem_fence_release();
+			prof_head++;
+		}
+	}
+	BUDGET_EXIT();
+
+	return true;
+}
+
+/*
+ * write n samples from the ring buffer, called with the disk mutex held
+ */
+static void prof_write(uint32_t n)
+{
+	uint32_t tail = prof_tail, i, len;
+	UINT bw;
+
+	__mem_fence_acquire();
+	while (n > 0) {
+		i = tail & (PC_PROF_SIZE - 1);
+		len = PC_PROF_SIZE - i;
+		if (len > n)
+			len = n;
+		if (prof_isopen &&
+		    ((sd_res = f_write(&prof_file, &prof_buf[i],
+				       len * sizeof(uint32_t), &bw)) != FR_OK
+		     || bw != len * sizeof(uint32_t))) {
+			f_close(&prof_file);
+			prof_isopen = false;
+		}
+		tail += len;
+		n -= len;
+	}
+
+	__mem_fence_release();
+	prof_tail = tail;
+}
+
+/*
+ * write full chunks, called from core 1
+ */
+static void prof_task(void)
+{
+	if (prof_head - prof_tail < PC_PROF_CHUNK
+	    || !mutex_try_enter(&disk_mutex, NULL))
+		return;
+
+	prof_write(PC_PROF_CHUNK);
+
+	mutex_exit(&disk_mutex);
+}
+
+bool pc_prof_active(void)
+{
+	return prof_on;
+}
+
+/*
+ * start the profiler with a new PC_PROF_FILE, or stop it and write
+ * the rest of the samples, called from core 0
+ */
+void pc_prof(bool on)
+{
+	static const BYTE hdr[8] = {
+		'P', 'C', 'P', '1', PC_PROF_HZ & 0xff, (PC_PROF_HZ >> 8) & 0xff,
+		(PC_PROF_HZ >> 16) & 0xff, PC_PROF_HZ >> 24
+	};
+	UINT bw;
+
+	if (on == prof_on)
+		return;
+
+	if (on) {
+		DISK_LOCK();
+		if ((sd_res = f_open(&prof_file, PC_PROF_FILE,
+				     FA_WRITE | FA_CREATE_ALWAYS)) == FR_OK) {
+			prof_isopen = true;
+			if ((sd_res = f_write(&prof_file, hdr, sizeof(hdr),
+					      &bw)) != FR_OK
+			    || bw != sizeof(hdr)) {
+				f_close(&prof_file);
+				prof_isopen = false;
+			}
+		}
+		DISK_UNLOCK();
+		if (!prof_isopen) {
+			printf("can't create %s\n", PC_PROF_FILE);
+			return;
+		}
+		prof_head = prof_tail = prof_lost = 0;
+		pc_acct_total = 0;
+		memset(pc_acct_bank, 0, sizeof(pc_acct_bank));
+		memset(pc_acct_con, 0, sizeof(pc_acct_con));
+		prof_on = add_repeating_timer_us(-1000000 / PC_PROF_HZ,
+						 prof_sample, NULL,
+						 &prof_timer);
+		if (!prof_on) {
+			DISK_LOCK();
+			f_close(&prof_file);
+			prof_isopen = false;
+			DISK_UNLOCK();
+		}
+	} else {
+		cancel_repeating_timer(&prof_timer);
+		prof_on = false;
+		DISK_LOCK();
+		prof_write(prof_head - prof_tail);
+		if (prof_isopen)
+			f_close(&prof_file);
+		prof_isopen = false;
+		DISK_UNLOCK();
+		if (prof_lost)
+			printf("PC profiler: %lu samples dropped\n",
+			       (unsigned long) prof_lost);
+	}
+}
+#endif /* PC_PROF_SIZE > 0 */
+
+#if REPLAY80
+/*
+ * Ring buffer of the events of a recording or replay. When recording
+ * core 0 puts the events and disk_task() on core 1 writes them in
+ * chunks of REPLAY_CHUNK events to REPLAY_FILE, when replaying core 1
+ * reads them in chunks and core 0 gets them. No event may be lost, so
+ * core 0 waits if the buffer is full resp. empty. The file starts with
+ * "RPL1", followed by the events as in replay_ev_t, little endian.
+ */
+static replay_ev_t rp_buf[REPLAY_SIZE];
+static volatile uint32_t rp_head;	/* next event put */
+static volatile uint32_t rp_tail;	/* next event taken */
+static volatile bool rp_eof = true;	/* all events read from the file */
+static FIL rp_file;
+static volatile bool rp_rec;		/* recording */
+static bool rp_isopen;
+
+static const BYTE rp_hdr[4] = { 'R', 'P', 'L', '1' };
+
+/*
+ * write n events from the ring buffer, called with the disk mutex held
+ */
+static void rp_write(uint32_t n)
+{
+	uint32_t tail = rp_tail, i, len;
+	UINT bw;
+
+	__mem_fence_acquire();
+	while (n > 0) {
+		i = tail & (REPLAY_SIZE - 1);
+		len = REPLAY_SIZE - i;
+		if (len > n)
+			len = n;
+		if (rp_isopen &&
+		    ((sd_res = f_write(&rp_file, &rp_buf[i],
+				       len * sizeof(replay_ev_t), &bw)) != FR_OK
+		     || bw != len * sizeof(replay_ev_t))) {
+			f_close(&rp_file);
+			rp_isopen = false;
+		}
+		tail += len;
+		n -= len;
+	}
+
+	__mem_fence_release();
+	rp_tail = tail;
+}
+
+/*
+ * read up to n events into the ring buffer, called with the disk
+ * mutex held
+ */
+static void rp_read(uint32_t n)
+{
+	uint32_t head = rp_head, i, len;
+	UINT br;
+
+	while (n > 0 && !rp_eof) {
+		i = head & (REPLAY_SIZE - 1);
+		len = REPLAY_SIZE - i;
+		if (len > n)
+			len = n;
+		if (!rp_isopen
+		    || (sd_res = f_read(&rp_file, &rp_buf[i],
+					len * sizeof(replay_ev_t), &br)) != FR_OK)
+			br = 0;
+		br /= sizeof(replay_ev_t);
+		head += br;
+		n -= br;
+		if (br < len)
+			rp_eof = true;
+	}
+
+	__mem_fence_release();
+	rp_head = head;
+}
+
+/*
+ * write full resp. read free chunks, called from core 1
+ */
+static void rp_task(void)
+{
+	if (rp_rec) {
+		if (rp_head - rp_tail < REPLAY_CHUNK
+		    || !mutex_try_enter(&disk_mutex, NULL))
+			return;
+		rp_write(REPLAY_CHUNK);
+	} else {
+		if (rp_eof || REPLAY_SIZE - (rp_head - rp_tail) < REPLAY_CHUNK
+		    || !mutex_try_enter(&disk_mutex, NULL))
+			return;
+		rp_read(REPLAY_CHUNK);
+	}
+
+	mutex_exit(&disk_mutex);
+}
+
+/*
+ * create REPLAY_FILE for a recording, or open it for a replay and
+ * fill the ring buffer, called from core 0
+ */
+bool replay_open(bool rec)
+{
+	BYTE hdr[sizeof(rp_hdr)];
+	UINT bw;
+
+	DISK_LOCK();
+	rp_head = rp_tail = 0;
+	rp_eof = false;
+	rp_rec = rec;
+	if (rec) {
+		if ((sd_res = f_open(&rp_file, REPLAY_FILE,
+				     FA_WRITE | FA_CREATE_ALWAYS)) == FR_OK) {
+			rp_isopen = true;
+			if ((sd_res = f_write(&rp_file, rp_hdr, sizeof(rp_hdr),
+					      &bw)) != FR_OK
+			    || bw != sizeof(rp_hdr)) {
+				f_close(&rp_file);
+				rp_isopen = false;
+			}
+		}
+	} else {
+		if ((sd_res = f_open(&rp_file, REPLAY_FILE,
+				     FA_READ)) == FR_OK) {
+			rp_isopen = true;
+			if ((sd_res = f_read(&rp_file, hdr, sizeof(hdr),
+					     &bw)) != FR_OK
+			    || bw != sizeof(hdr)
+			    || memcmp(hdr, rp_hdr, sizeof(hdr))) {
+				f_close(&rp_file);
+				rp_isopen = false;
+			} else
+				rp_read(REPLAY_SIZE);
+		}
+	}
+	DISK_UNLOCK();
+
+	if (!rp_isopen)
+		printf("can't %s %s\n", rec ? "create" : "read", REPLAY_FILE);
+	return rp_isopen;
+}
+
+/*
+ * write the rest of a recording and close REPLAY_FILE
+ */
+void replay_close(void)
+{
+	DISK_LOCK();
+	if (rp_rec)
+		rp_write(rp_head - rp_tail);
+	if (rp_isopen)
+		f_close(&rp_file);
+	rp_isopen = false;
+	rp_rec = false;
+	rp_eof = true;
+	DISK_UNLOCK();
+}
+
+/*
+ * put an event of a recording, waits for core 1 if the buffer is full
+ */
+void __not_in_flash_func(replay_put)(const replay_ev_t *ev)
+{
+	while (rp_head - rp_tail == REPLAY_SIZE)
+		tight_loop_contents();
+
+	rp_buf[rp_head & (REPLAY_SIZE - 1)] = *ev;
+	__mem_fence_release();
+	rp_head++;
+}
+
+/*
+ * get the next event of a replay, waits for core 1 if the buffer
+ * is empty, returns false at the end of REPLAY_FILE
+ */
+bool __not_in_flash_func(replay_get)(replay_ev_t *ev)
+{
+	while (rp_head == rp_tail) {
+		if (rp_eof)
+			return false;
+		__sev();
+		tight_loop_contents();
+	}
+
+	__mem_fence_acquire();
+	*ev = rp_buf[rp_tail & (REPLAY_SIZE - 1)];
+	__mem_fence_release();
+	rp_tail++;
+	return true;
+}
+#endif /* REPLAY80 */
+
+#if BATCH80
+/*
+ * read BATCH_FILE into buf, returns the bytes read, 0 if there is
+ * none, called from core 0
+ */
+size_t batch_load(char *buf, size_t size)
+{
+	UINT br = 0;
+
+	DISK_LOCK();
+	if ((sd_res = f_open(&sd_file, BATCH_FILE, FA_READ)) == FR_OK) {
+		if ((sd_res = f_read(&sd_file, buf, size, &br)) != FR_OK)
+			br = 0;
+		f_close(&sd_file);
+	}
+	DISK_UNLOCK();
+
+	return br;
+}
+
+/*
+ * write the log of a batch job into BATCH_LOG, called from core 0
+ */
+bool batch_save(const char *buf, size_t len)
+{
+	UINT bw = 0;
+
+	DISK_LOCK();
+	if ((sd_res = f_open(&sd_file, BATCH_LOG,
+			     FA_WRITE | FA_CREATE_ALWAYS)) == FR_OK) {
+		sd_res = f_write(&sd_file, buf, len, &bw);
+		if (f_close(&sd_file) != FR_OK)
+			bw = 0;
+	}
+	DISK_UNLOCK();
+
+	return sd_res == FR_OK && bw == len;
+}
+#endif /* BATCH80 */
+
+#if PERFLOG80
+/*
+ * append performance records to PERFLOG_FILE, a new file starts
+ * with the header, called from core 1
+ */
+bool perflog_save(const char *hdr, const char *buf, size_t len)
+{
+	UINT bw = 0, hw = 0;
+	size_t hlen = 0;
+
+	DISK_LOCK();
+	if ((sd_res = f_open(&sd_file, PERFLOG_FILE,
+			     FA_WRITE | FA_OPEN_APPEND)) == FR_OK) {
+		if (f_size(&sd_file) == 0) {
+			hlen = strlen(hdr);
+			sd_res = f_write(&sd_file, hdr, hlen, &hw);
+		}
+		if (sd_res == FR_OK && hw == hlen)
+			sd_res = f_write(&sd_file, buf, len, &bw);
+		if (f_close(&sd_file) != FR_OK)
+			bw = 0;
+	}
+	DISK_UNLOCK();
+
+	return sd_res == FR_OK && bw == len;
+}
+#endif /* PERFLOG80 */
+
+#if LIB_STDIO_MSC_USB
+/*
+ * Give the host read-only USB mass storage access to the SD card while
+ * the machine keeps running. The track cache and the open files are
+ * written back first, so that the host sees the files as they are now.
+ * It doesn't see later changes until it ejected and mounted the card
+ * again. The USB background task reads the card with disk_mutex held,
+ * if the disks are busy the host is told to try again.
+ */
+void live_msc(bool on)
+{
+	register int i;
+
+	if (on) {
+		DISK_LOCK();
+#if DISK_CACHE_TRACKS > 0
+		cache_flush(-1, -1);
+#endif
+#if RAMDISK_SIZE > 0
+		ram_flush();
+#endif
+		for (i = 0; i < NUMDISK; i++) {
+			if (!drives[i].open)
+				continue;
+			f_sync(&drives[i].f->fil);
+#if DISK_OVL_SECS > 0
+			if (drives[i].f->ovl_open)
+				f_sync(&drives[i].f->ovl_fil);
+#endif
+		}
+#if PRINT_SPOOL_SIZE > 0
+		if (spool_head != spool_tail)
+			spool_write(spool_head - spool_tail);
+		if (spool_isopen)
+			f_sync(&spool_file);
+#endif
+#if CAPTURE_SIZE > 0
+		for (i = 0; i < CAPT_STREAMS; i++)
+			if (capture[i].isopen)
+				f_sync(&capture[i].file);
+#endif
+#if PC_PROF_SIZE > 0
+		if (prof_isopen)
+			f_sync(&prof_file);
+#endif
+		DISK_UNLOCK();
+	}
+
+	stdio_msc_usb_live_msc(on);
+}
+
+bool stdio_msc_usb_try_lock(void)
+{
+	return mutex_try_enter(&disk_mutex, NULL);
+}
+
+void stdio_msc_usb_unlock(void)
+{
+	mutex_exit(&disk_mutex);
+}
+
+#if STDIO_MSC_USB_IMAGE_LUNS > 0
+/*
+ * The disks in the drives are also offered as raw images on their own
+ * LUNs, so that the host can use cpmtools on them directly. A LUN holds
+ * the image file in the image layout as the CPU sees it, with the
+ * modified sectors from the track cache and the overlay. The part of
+ * the last block after the end of the disk and sectors missing in a
+ * short image read as 0xe5.
+ */
+
+/*
+ * number of sectors of the disk in drive
+ */
+static uint32_t lun_secs(int drive)
+{
+	return (uint32_t) (geom[disk_type[drive]].maxtrk + 1) *
+	       geom[disk_type[drive]].spt;
+}
+
+/*
+ * read a sector of the image layout, called with the disk mutex held
+ */
+static BYTE lun_read_sec(int drive, int track, int sector, BYTE *buf)
+{
+	UINT pos = (((UINT) track * SPT) + sector - 1) * SEC_SZ;
+	UINT br;
+#if DISK_CACHE_TRACKS > 0
+	trkbuf_t *tp;
+#endif
+
+	memset(buf, 0xe5, SEC_SZ);
+
+#if FLASH_DISK
+	if (drives[drive].flash != NULL) {
+		if (pos + SEC_SZ <= drives[drive].flash_size)
+			memcpy(buf, &drives[drive].flash[pos], SEC_SZ);
+		return ovl_patch(drive, track, sector, buf, 1);
+	}
+#endif
+
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram) {
+		if (pos + SEC_SZ <= drives[drive].ram_size)
+			memcpy(buf, &ramdisk[pos], SEC_SZ);
+		return FDC_STAT_OK;
+	}
+#endif
+
+#if DISK_CACHE_TRACKS > 0
+	tp = cache_lookup(drive, track);
+#if DISK_DSZ
+	/* compressed images can only be read through the cache */
+	if (tp == NULL && drives[drive].dsz)
+		tp = cache_fill(drive, track);
+#endif
+	if (tp != NULL) {
+		if (sector <= tp->nsec)
+			memcpy(buf, &tp->data[(sector - 1) * SEC_SZ], SEC_SZ);
+		return FDC_STAT_OK;
+	}
+#endif
+#if DISK_DSZ
+	if (drives[drive].dsz)
+		return FDC_STAT_READ;
+#endif
+
+	if (pos >= f_size(&drives[drive].f->fil))
+		br = 0;
+#if DISK_CONTIG
+	else if (drives[drive].lba && contig_io(drive, pos, buf, SEC_SZ, false))
+		br = SEC_SZ;
+#endif
+	else if (f_lseek(&drives[drive].f->fil, pos) != FR_OK ||
+		 f_read(&drives[drive].f->fil, buf, SEC_SZ, &br) != FR_OK)
+		return FDC_STAT_READ;
+	if (br < SEC_SZ)
+		memset(buf + br, 0xe5, SEC_SZ - br);
+
+#if DISK_OVL_SECS > 0
+	return ovl_patch(drive, track, sector, buf, 1);
+#else
+	return FDC_STAT_OK;
+#endif
+}
+
+uint32_t stdio_msc_usb_image_blocks(uint8_t n)
+{
+	if (n >= NUMDISK || disks[n][0] == '\0')
+		return 0;
+
+	return (lun_secs(n) * SEC_SZ + 511) / 512;
+}
+
+bool stdio_msc_usb_image_read(uint8_t n, uint32_t lba, void *buffer,
+			      uint32_t blockcnt)
+{
+	BYTE *p = buffer;
+	uint32_t lsec, end, nsec;
+
+	if (n >= NUMDISK || disks[n][0] == '\0')
+		return false;
+	if (!drives[n].open && open_disk(n) != FR_OK)
+		return false;
+
+	nsec = lun_secs(n);
+	lsec = lba * (512 / SEC_SZ);
+	end = lsec + blockcnt * (512 / SEC_SZ);
+	for (; lsec < end; lsec++, p += SEC_SZ)
+		if (lsec >= nsec)
+			memset(p, 0xe5, SEC_SZ);
+		else if (lun_read_sec(n, lsec / SPT, lsec % SPT + 1, p)
+			 != FDC_STAT_OK)
+			return false;
+
+	return true;
+}
+#endif /* STDIO_MSC_USB_IMAGE_LUNS > 0 */
+#endif /* LIB_STDIO_MSC_USB */
+
+#if DISK_WRITE_IDLE_MS > 0
+/*
+ * The SDIO driver keeps a multiple block write open, so that the
+ * write of the next sector continues it. End it after no sector
+ * was written for DISK_WRITE_IDLE_MS milliseconds, unless the disks
+ * are busy or USB mass storage access owns the SD card.
+ */
+static void write_idle(void)
+{
+	if (sd_card.type != SD_IF_SDIO || !fs_mounted)
+		return;
+
+	if (mutex_try_enter(&disk_mutex, NULL)) {
+		sd_lock(&sd_card);
+		sd_sdio_closeIdle(&sd_card, DISK_WRITE_IDLE_MS);
+		sd_unlock(&sd_card);
+		mutex_exit(&disk_mutex);
+	}
+}
+#endif
+
+/*
+ * called from core 1 to do background work for the disks
+ */
+void __not_in_flash_func(disk_task)(void)
+{
+#if DISK_CACHE_TRACKS > 0
+	readahead();
+#endif
+#if DISK_WRITE_IDLE_MS > 0
+	write_idle();
+#endif
+#if DISK_CACHE_TRACKS > 0
+	learn_task();
+#endif
+#if PRINT_SPOOL_SIZE > 0
+	spool_task();
+#endif
+#if CAPTURE_SIZE > 0
+	capture_task();
+#endif
+#if PC_PROF_SIZE > 0
+	prof_task();
+#endif
+#if REPLAY80
+	rp_task();
+#endif
+}
+
+#if DISK_CACHE_TRACKS > 0
+/*
+ * check if drive reads the last sectors of track in sequence, so that
+ * a block crossing the end of the track will need the next one soon
+ */
+static inline bool ra_tail(int drive, int track, int sector)
+{
+#if DISK_RA_TAIL > 0
+	return track == last_track[drive] && sector > SPT - DISK_RA_TAIL
+		&& sector == last_sector[drive] + 1;
+#else
+	UNUSED(drive);
+	UNUSED(track);
+	UNUSED(sector);
+
+	return false;
+#endif
+}
+#endif
+
+/*
+ * The memory of the sector transfers, NULL for the memory map of the
+ * CPU, else the page tables of the bank a command of the extended FDC
+ * was issued for, set by read_secs() and write_secs() while they hold
+ * the disk mutex.
+ */
+static const mem_map_t *xfer_map;
+
+static inline void xfer_write_block(WORD addr, const BYTE *p, unsigned len)
+{
+	if (xfer_map != NULL)
+		map_write_block(xfer_map, addr, p, len);
+	else
+		dma_write_block(addr, p, len);
+}
+
+static inline void xfer_read_block(WORD addr, BYTE *p, unsigned len)
+{
+	if (xfer_map != NULL)
+		map_read_block(xfer_map, addr, p, len);
+	else
+		dma_read_block(addr, p, len);
+}
+
+/* direct transfers only with the memory map of the CPU */
+static inline BYTE *xfer_block_ptr(WORD addr, unsigned len, bool wr)
+{
+	return xfer_map == NULL ? dma_block_ptr(addr, len, wr) : NULL;
+}
+
+/*
+ * read from drive a sector on track into memory @ addr,
+ * called with the disk mutex held
+ */
+static BYTE do_read(int drive, int track, int sector, WORD addr)
+{
+	BYTE stat, *p;
+	unsigned int br;
+#if DISK_CACHE_TRACKS > 0
+	trkbuf_t *tp;
+#endif
+#if RAMDISK_SIZE > 0 || FLASH_DISK
+	UINT pos;
+#endif
+
+	/* prepare for sector read */
+	stat = prep_io(drive, track, sector, addr, false);
+	if (stat != FDC_STAT_OK)
+		return stat;
+	map_sec(drive, &track, &sector);
+	disk_stats[drive].reads++;
+
+#if FLASH_DISK
+	if (drives[drive].flash != NULL) {
+		pos = (((UINT) track * SPT) + sector - 1) * SEC_SZ;
+		if (pos + SEC_SZ > drives[drive].flash_size)
+			return FDC_STAT_READ;
+		memcpy(dsk_buf, &drives[drive].flash[pos], SEC_SZ);
+		stat = ovl_patch(drive, track, sector, dsk_buf, 1);
+		if (stat == FDC_STAT_OK)
+			xfer_write_block(addr, dsk_buf, SEC_SZ);
+		return stat;
+	}
+#endif
+
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram) {
+		pos = (((UINT) track * SPT) + sector - 1) * SEC_SZ;
+		if (pos + SEC_SZ > drives[drive].ram_size)
+			return FDC_STAT_READ;
+		xfer_write_block(addr, &ramdisk[pos], SEC_SZ);
+		return FDC_STAT_OK;
+	}
+#endif
+
+#if DISK_CACHE_TRACKS > 0
+	/* request read-ahead on sequential access */
+	if (disk_readahead > 0 && (track == last_track[drive] + 1
+				   || ra_tail(drive, track, sector))) {
+		ra_track = track + 1;
+		__mem_fence_release();
+		ra_drive = drive;
+		__sev();
+	}
+	last_track[drive] = track;
+	last_sector[drive] = sector;
+	learn_read(drive, track);
+
+	/* try to serve the sector from the track cache */
+	if ((tp = cache_lookup(drive, track)) == NULL) {
+		disk_stats[drive].misses++;
+		tp = cache_fill(drive, track);
+	} else
+		disk_stats[drive].hits++;
+	if (tp != NULL) {
+		if (sector > tp->nsec)
+			return FDC_STAT_READ;
+		xfer_write_block(addr, &tp->data[(sector - 1) * SEC_SZ],
+				 SEC_SZ);
+		return FDC_STAT_OK;
+	}
+#if DISK_DSZ
+	/* compressed images can only be read through the cache */
+	if (drives[drive].dsz)
+		return FDC_STAT_READ;
+#endif
+#endif
+
+	stat = seek_sec(drive, track, sector);
+	if (stat == FDC_STAT_OK) {
+
+		/* read sector into memory, directly if possible */
+		p = xfer_block_ptr(addr, SEC_SZ, true);
+		sd_res = img_read(drive, p ? p : dsk_buf, SEC_SZ, &br);
+		if (sd_res == FR_OK) {
 			if (br < SEC_SZ)	/* UH OH */
 				stat = FDC_STAT_READ;
-			else {
-				for (i = 0; i < SEC_SZ; i++)
-					dma_write(addr + i, dsk_buf[i]);
+			else
 				stat = FDC_STAT_OK;
-			}
 		} else
 			stat = FDC_STAT_READ;
 
-		f_close(&sd_file);
+#if DISK_OVL_SECS > 0
+		/* replace with the sector from the overlay */
+		if (stat == FDC_STAT_OK)
+			stat = ovl_patch(drive, track, sector,
+					 p ? p : dsk_buf, 1);
+#endif
+		if (stat == FDC_STAT_OK && p == NULL)
+			xfer_write_block(addr, dsk_buf, SEC_SZ);
 	}
 
-	lcd_update_drive(drive, track, sector, addr, false, false);
-
 	return stat;
 }
 
 /*
- * write to drive a sector on track from memory @ addr
+ * write to drive a sector on track from memory @ addr,
+ * called with the disk mutex held
  */
-BYTE write_sec(int drive, int track, int sector, WORD addr)
+static BYTE do_write(int drive, int track, int sector, WORD addr)
 {
-	BYTE stat;
+	BYTE stat, *p;
 	unsigned int br;
-	register int i;
+#if DISK_CACHE_TRACKS > 0
+	trkbuf_t *tp;
+#endif
+#if RAMDISK_SIZE > 0 || FLASH_DISK
+	UINT pos;
+#endif
+#if DISK_CRC
+	bool crc_ok;
+#endif
 
 	/* prepare for sector write */
 	stat = prep_io(drive, track, sector, addr, true);
+	if (stat != FDC_STAT_OK)
+		return stat;
+	map_sec(drive, &track, &sector);
+	disk_stats[drive].writes++;
+
+#if FLASH_DISK
+	/* the sector goes into the overlay */
+	if (drives[drive].flash != NULL) {
+		pos = (((UINT) track * SPT) + sector - 1) * SEC_SZ;
+		if (pos + SEC_SZ > drives[drive].flash_size)
+			return FDC_STAT_WRITE;
+		if ((p = xfer_block_ptr(addr, SEC_SZ, false)) == NULL) {
+			xfer_read_block(addr, dsk_buf, SEC_SZ);
+			p = dsk_buf;
+		}
+		return ovl_write(drive, track, sector, p, 1);
+	}
+#endif
+
+#if RAMDISK_SIZE > 0
+	if (drives[drive].ram) {
+		pos = (((UINT) track * SPT) + sector - 1) * SEC_SZ;
+		if (pos + SEC_SZ > drives[drive].ram_size)
+			return FDC_STAT_WRITE;
+		xfer_read_block(addr, &ramdisk[pos], SEC_SZ);
+		drives[drive].ram_dirty = true;
+		return FDC_STAT_OK;
+	}
+#endif
+
+#if DISK_CACHE_TRACKS > 0
+	/* drive changed the track, write back the old one */
+	stat = cache_flush(drive, track);
+	if (stat != FDC_STAT_OK)
+		return stat;
+
+	/* write the sector into the track cache */
+	if ((tp = cache_lookup(drive, track)) == NULL)
+		tp = cache_fill(drive, track);
+	if (tp != NULL && sector <= tp->nsec) {
+		xfer_read_block(addr, &tp->data[(sector - 1) * SEC_SZ],
+				SEC_SZ);
+		tp->dirty |= 1UL << (sector - 1);
+
+		/* schedule the idle flush */
+		last_write = to_ms_since_boot(get_absolute_time());
+		if (!flush_armed) {
+			flush_armed = true;
+			add_alarm_in_ms(DISK_FLUSH_MS, flush_alarm, NULL, true);
+		}
+		return FDC_STAT_OK;
+	}
+#endif
+
+	stat = seek_sec(drive, track, sector);
 	if (stat == FDC_STAT_OK) {
 
-		/* write sector to disk image */
-		for (i = 0; i < SEC_SZ; i++)
-			dsk_buf[i] = dma_read(addr + i);
-		sd_res = f_write(&sd_file, dsk_buf, SEC_SZ, &br);
-		if (sd_res == FR_OK) {
-			if (br < SEC_SZ)	/* UH OH */
+		/* write sector to disk image, directly if possible */
+		if ((p = xfer_block_ptr(addr, SEC_SZ, false)) == NULL) {
+			xfer_read_block(addr, dsk_buf, SEC_SZ);
+			p = dsk_buf;
+		}
+#if DISK_OVL_SECS > 0
+		if (drives[drive].f->ovl_open)
+			stat = ovl_write(drive, track, sector, p, 1);
+		else
+#endif
+		{
+#if DISK_CRC
+			/* the old sector for the update of the track CRC */
+			crc_ok = false;
+			if (drives[drive].crc) {
+				crc_ok = img_read(drive, crc_old, SEC_SZ, &br)
+					 == FR_OK && br == SEC_SZ;
+				stat = seek_sec(drive, track, sector);
+			}
+			if (stat == FDC_STAT_OK)
+#endif
+			{
+				sd_res = img_write(drive, p, SEC_SZ, &br);
+				if (sd_res == FR_OK) {
+					if (br < SEC_SZ)	/* UH OH */
+						stat = FDC_STAT_WRITE;
+					else
+						stat = FDC_STAT_OK;
+				} else
+					stat = FDC_STAT_WRITE;
+			}
+
+			/* write the sector through to the SD card */
+			if (stat == FDC_STAT_OK &&
+			    f_sync(&drives[drive].f->fil) != FR_OK)
 				stat = FDC_STAT_WRITE;
-			else
-				stat = FDC_STAT_OK;
-		} else
-			stat = FDC_STAT_WRITE;
+#if DISK_CRC
+			if (stat == FDC_STAT_OK && crc_ok)
+				crc_sector(drive, track, sector, p);
+			else if (stat == FDC_STAT_OK)
+				crc_update(drive, track, NULL, 0);
+#endif
+		}
 
-		f_close(&sd_file);
+#if DISK_CACHE_TRACKS > 0
+		/* a short track can be extended, reread it next time */
+		if (stat == FDC_STAT_OK)
+			cache_drop(drive, track);
+#endif
+	}
+
+	return stat;
+}
+
+/*
+ * read from drive a sector on track into memory @ addr
+ */
+BYTE read_sec(int drive, int track, int sector, WORD addr)
+{
+	BYTE stat;
+	BUDGET_ENTER(BUDGET_DISK);
+
+	DISK_LOCK();
+	stat = do_read(drive, track, sector, addr);
+	DISK_UNLOCK();
+#if TRACE80
+	trace_fdc(false, drive, track, sector, 1, stat);
+#endif
+
+	lcd_update_drive(drive, track, sector, addr, false, false);
+	BUDGET_EXIT();
+
+	return stat;
+}
+
+/*
+ * write to drive a sector on track from memory @ addr
+ */
+BYTE write_sec(int drive, int track, int sector, WORD addr)
+{
+	BYTE stat;
+	BUDGET_ENTER(BUDGET_DISK);
+
+	DISK_LOCK();
+	stat = do_write(drive, track, sector, addr);
+	DISK_UNLOCK();
+#if TRACE80
+	trace_fdc(true, drive, track, sector, 1, stat);
+#endif
+
+	lcd_update_drive(drive, track, sector, addr, true, false);
+	BUDGET_EXIT();
+
+	return stat;
+}
+
+/*
+ * read from drive count consecutive sectors, starting with sector
+ * on track, into memory @ addr. The sectors continue with sector 1
+ * of the next track. The number of sectors read is stored in *done.
+ * With map the sectors go into the bank of it, else into the memory
+ * of the CPU.
+ */
+BYTE read_secs(const mem_map_t *map, int drive, int track, int sector,
+	       WORD addr, int count, int *done)
+{
+	BYTE stat = FDC_STAT_OK;
+	register int n;
+#if TRACE80
+	int track0 = track, sector0 = sector;
+#endif
+	BUDGET_ENTER(BUDGET_DISK);
+
+	DISK_LOCK();
+	xfer_map = map;
+	for (n = 0; n < count; n++) {
+		if ((stat = do_read(drive, track, sector, addr)) != FDC_STAT_OK)
+			break;
+		addr += SEC_SZ;
+		if (++sector > geom[disk_type[drive]].spt) {
+			sector = 1;
+			track++;
+		}
+	}
+	xfer_map = NULL;
+	DISK_UNLOCK();
+#if TRACE80
+	trace_fdc(false, drive, track0, sector0, n, stat);
+#endif
+
+	lcd_update_drive(drive, track, sector, addr, false, false);
+
+	*done = n;
+	BUDGET_EXIT();
+	return stat;
+}
+
+/*
+ * write to drive count consecutive sectors, starting with sector
+ * on track, from memory @ addr. The sectors continue with sector 1
+ * of the next track. The number of sectors written is stored in *done.
+ * With map the sectors come from the bank of it, else from the memory
+ * of the CPU.
+ */
+BYTE write_secs(const mem_map_t *map, int drive, int track, int sector,
+		WORD addr, int count, int *done)
+{
+	BYTE stat = FDC_STAT_OK;
+	register int n;
+#if TRACE80
+	int track0 = track, sector0 = sector;
+#endif
+	BUDGET_ENTER(BUDGET_DISK);
+
+	DISK_LOCK();
+	xfer_map = map;
+	for (n = 0; n < count; n++) {
+		if ((stat = do_write(drive, track, sector, addr)) != FDC_STAT_OK)
+			break;
+		addr += SEC_SZ;
+		if (++sector > geom[disk_type[drive]].spt) {
+			sector = 1;
+			track++;
+		}
 	}
+	xfer_map = NULL;
+	DISK_UNLOCK();
+#if TRACE80
+	trace_fdc(true, drive, track0, sector0, n, stat);
+#endif
 
 	lcd_update_drive(drive, track, sector, addr, true, false);
 
+	*done = n;
+	BUDGET_EXIT();
 	return stat;
 }
 
@@ -346,3 +5473,33 @@ void get_fdccmd(BYTE *cmd, WORD addr)
 	for (i = 0; i < 4; i++)
 		cmd[i] = dma_read(addr + i);
 }
+
+/*
+ * print the buffers and caches for the memory usage report
+ */
+void print_disk_mem(void)
+{
+	mem_line("FatFs", &fs, sizeof(fs));
+	mem_line("disk files", dfiles, sizeof(dfiles));
+#if DISK_CACHE_TRACKS > 0
+	mem_line("track cache", cache, sizeof(cache));
+#endif
+#if DIR_CACHE_SIZE > 0
+	mem_line("directory cache", dir_cache, sizeof(dir_cache));
+#endif
+#if RAMDISK_SIZE > 0
+	mem_line("RAM disk", ramdisk, RAMDISK_SIZE);
+#endif
+#if PRINT_SPOOL_SIZE > 0
+	mem_line("print spool", spool_buf, sizeof(spool_buf));
+#endif
+#if CAPTURE_SIZE > 0
+	mem_line("output capture", capture, sizeof(capture));
+#endif
+#if PC_PROF_SIZE > 0
+	mem_line("PC profile", prof_buf, sizeof(prof_buf));
+#endif
+#if REPLAY80
+	mem_line("replay buffer", rp_buf, sizeof(rp_buf));
+#endif
+}
@@ -9,6 +9,33 @@
  * History:
  * 29-JUN-2024 split of from memsim.c and picosim.c
  * 26-APR-2025 use a define for filename lenght
+ * 14-OCT-2026 added unmount_disk()
+ * 14-OCT-2026 added track cache size
+ * 14-OCT-2026 added flush_disks()
+ * 14-OCT-2026 added multi sector transfers
+ * 14-OCT-2026 added cluster link map size
+ * 14-OCT-2026 added RAM disk
+ * 14-OCT-2026 added hard disk geometry
+ * 14-OCT-2026 added track read-ahead
+ * 14-OCT-2026 added floppy disks with logical sector order
+ * 14-OCT-2026 added disk statistics
+ * 14-OCT-2026 added copy-on-write overlays
+ * 14-OCT-2026 added swap_disk()
+ * 14-OCT-2026 load_file() returns the entry point
+ * 14-OCT-2026 added directory cache size
+ * 14-OCT-2026 added CRC sidecars for the disk images
+ * 14-OCT-2026 added compressed disk images
+ * 14-OCT-2026 added boot disk in flash
+ * 14-OCT-2026 added printer spool
+ * 14-OCT-2026 up to 16 drives, number of open disk images
+ * 14-OCT-2026 several disk images in flash
+ * 14-OCT-2026 added PC sample accounting per bank and console
+ * 14-OCT-2026 added load_file_at() and save_file()
+ * 14-OCT-2026 added defrag_disks()
+ * 14-OCT-2026 added counts of the blocks written whole or partly
+ * 14-OCT-2026 read_secs() and write_secs() with the map of a bank
+ * 14-OCT-2026 added xfer_name_ok()
+ * 14-OCT-2026 added convert_linear()
  */
 
 #ifndef DISKS_INC
@@ -19,23 +46,237 @@
 
 #include "ff.h"
 
-#define NUMDISK	4		/* number of disk drives */
+#define NUMDISK	16		/* number of disk drives, A: to P: */
 #define FNLEN	8		/* length of filename without extension */
 #define DISKLEN	9 + FNLEN + 4	/* path length for disk drives /DISKS80/filename.DSK */
 				/* also used for code files /CODE80/filename.BIN */
 
+/* disk types */
+#define DISK_FD	0		/* 8" IBM 3740 floppy disk, 77 tracks, 26 sectors */
+#define DISK_HD	1		/* 4 MB hard disk */
+#define DISK_FDL 2		/* 8" floppy disk, data tracks in logical order */
+#define HD_TRK	255		/* number of tracks of a hard disk */
+#define HD_SPT	128		/* sectors per track of a hard disk */
+#define FD_SYSTRK 2		/* system tracks of a floppy disk, not skewed */
+
+#ifndef DISK_CACHE_TRACKS	/* number of tracks in the track cache, 0 = off */
+#if PICO_RP2350
+#define DISK_CACHE_TRACKS 8
+#else
+#define DISK_CACHE_TRACKS 2
+#endif
+#endif
+#ifndef DISK_CLMT_SIZE		/* cluster link map entries, 2 per fragment + 2 */
+#define DISK_CLMT_SIZE	64
+#endif
+#ifndef DISK_FILES		/* disk images open at the same time */
+#define DISK_FILES	4
+#endif
+#if DISK_FILES > NUMDISK
+#undef DISK_FILES
+#define DISK_FILES	NUMDISK
+#endif
+#ifndef RAMDISK_SIZE		/* size of the RAM disk in bytes, 0 = none */
+#define RAMDISK_SIZE	0
+#endif
+#ifndef DISK_OVL_SECS		/* max. sectors in an overlay, 0 = no overlays */
+#if PICO_RP2350
+#define DISK_OVL_SECS	1024
+#else
+#define DISK_OVL_SECS	256
+#endif
+#endif
+#ifndef DIR_CACHE_SIZE		/* max. files of a cached directory, 0 = off */
+#if PICO_RP2350
+#define DIR_CACHE_SIZE	256
+#else
+#define DIR_CACHE_SIZE	128
+#endif
+#endif
+#ifndef DISK_CRC		/* CRC sidecars for the disk images, 0 = off */
+#define DISK_CRC	1
+#endif
+#ifndef DISK_DSZ		/* compressed disk images, 0 = off */
+#define DISK_DSZ	1
+#endif
+#if DISK_CACHE_TRACKS == 0 || DISK_OVL_SECS == 0 /* which need both */
+#undef DISK_DSZ
+#define DISK_DSZ	0
+#endif
+#ifndef DISK_CONTIG		/* sector I/O of contiguous images directly */
+#define DISK_CONTIG	1	/* on the SD card, 0 = off */
+#endif
+#ifndef FLASH_DISK		/* copies of disk images in flash, 0 = off */
+#define FLASH_DISK	1
+#endif
+#if DISK_OVL_SECS == 0		/* which needs overlays */
+#undef FLASH_DISK
+#define FLASH_DISK	0
+#endif
+#ifndef FLASH_DISK_SLOTS	/* disk images stored in flash */
+#define FLASH_DISK_SLOTS 4
+#endif
+#ifndef DISK_FLUSH_MS		/* write back the cache after this idle time */
+#define DISK_FLUSH_MS	500
+#endif
+#ifndef DISK_SDIO_BAUD		/* fastest SDIO clock tried, above 25 MHz */
+#define DISK_SDIO_BAUD (50 * 1000 * 1000) /* needs high speed mode */
+#endif
+#ifndef DISK_WRITE_IDLE_MS	/* end an open SD multiple block write after */
+#define DISK_WRITE_IDLE_MS 100	/* this idle time, 0 = only by the driver */
+#endif
+#if DISK_CACHE_TRACKS > 1	/* max. tracks read ahead, keeps the current one */
+#define DISK_READAHEAD_MAX (DISK_CACHE_TRACKS - 1)
+#else
+#define DISK_READAHEAD_MAX 0
+#endif
+#ifndef DISK_READAHEAD		/* default number of tracks read ahead */
+#define DISK_READAHEAD	(DISK_READAHEAD_MAX > 0 ? 1 : 0)
+#endif
+#ifndef DISK_RA_TAIL		/* sequential reads of the last sectors of a */
+#define DISK_RA_TAIL	8	/* track start read-ahead, a 1K block, 0 = off */
+#endif
+
+#ifndef PRINT_SPOOL_SIZE	/* printer spool buffer, power of 2, 0 = off */
+#define PRINT_SPOOL_SIZE 8192
+#endif
+#define PRINT_SPOOL_CHUNK 4096	/* bytes written to the spool file at once */
+#if PRINT_SPOOL_SIZE > 0 && PRINT_SPOOL_SIZE < PRINT_SPOOL_CHUNK
+#error "PRINT_SPOOL_SIZE must be 0 or at least PRINT_SPOOL_CHUNK"
+#endif
+#ifndef CAPTURE_SIZE		/* output capture buffers, power of 2, 0 = off */
+#define CAPTURE_SIZE	0
+#endif
+#define CAPTURE_CHUNK	4096	/* bytes written to a capture file at once */
+#if CAPTURE_SIZE > 0 && CAPTURE_SIZE < CAPTURE_CHUNK
+#error "CAPTURE_SIZE must be 0 or at least CAPTURE_CHUNK"
+#endif
+#define CAPT_SIO1	0	/* streams of the output capture */
+#define CAPT_SIO2	1
+#define CAPT_PRT	2
+#define CAPT_STREAMS	3
+
+#ifndef PC_PROF_SIZE		/* PC samples buffer, power of 2, 0 = off */
+#define PC_PROF_SIZE	1024
+#endif
+#define PC_PROF_CHUNK	512	/* samples written to the profile at once */
+#if PC_PROF_SIZE > 0 && PC_PROF_SIZE < PC_PROF_CHUNK
+#error "PC_PROF_SIZE must be 0 or at least PC_PROF_CHUNK"
+#endif
+#ifndef PC_PROF_HZ		/* PC samples per second */
+#define PC_PROF_HZ	2000
+#endif
+#define PC_PROF_FILE	"/CONF80/PCPROF.DAT"
+#define PC_ACCT_BANKS	16	/* banks 0 - MAXSEG accounted */
+#define PC_ACCT_CONS	6	/* consoles SIO1 - SIO5, 0 is none */
+
+#define DISK_LAT_BUCKETS 16	/* latency histogram, bucket n counts >= 2^n us */
+
+typedef struct disk_stats {
+	uint32_t reads;		/* sectors read */
+	uint32_t writes;	/* sectors written */
+	uint32_t hits;		/* sector reads served by the track cache */
+	uint32_t misses;	/* sector reads which needed a track read */
+	uint32_t bytes;		/* bytes transferred from/to the MicroSD */
+	uint32_t lat[DISK_LAT_BUCKETS]; /* latency of f_read/f_write */
+	uint32_t packed;	/* partly modified blocks written whole */
+	uint32_t partial;	/* blocks written partly, split by a track */
+} disk_stats_t;
+
+/* a block of memory saved in or restored from a machine snapshot */
+typedef struct snap_blk {
+	void *p;
+	UINT n;
+	FSIZE_t ofs;		/* offset in the file, for updates */
+} snap_blk_t;
+
 extern FIL sd_file;
 extern FRESULT sd_res;
 extern char disks[NUMDISK][DISKLEN+1];
+extern BYTE disk_type[NUMDISK];
+extern bool disk_linear[NUMDISK];
+extern bool disk_overlay[NUMDISK];
+extern disk_stats_t disk_stats[NUMDISK];
+extern BYTE disk_readahead;
+extern BYTE disk_warm;
+extern bool disk_learn;
+extern bool disk_flash;
 
 extern void init_disks(void), exit_disks(void);
+extern void flush_disks(void);
+extern void disk_task(void);
+extern void print_disk_stats(void), clear_disk_stats(void);
+extern void print_sd_stats(void);
+extern void print_disk_mem(void);
+extern void disk_clock_changed(void);
+extern uint32_t disk_sd_clock(bool *high_speed);
+#if LIB_STDIO_MSC_USB
+extern void live_msc(bool on);
+#endif
 extern void list_files(const char *dir, const char *ext);
-extern bool load_file(const char *name);
+extern bool load_file(const char *name, WORD *start);
+extern bool load_file_at(const char *name, WORD addr);
+extern bool save_file(const char *name, WORD addr, uint32_t len);
+extern bool write_snapshot(const char *name, const snap_blk_t *blk, int n,
+			   bool update);
+extern bool read_snapshot(const char *name, const snap_blk_t *blk, int n,
+			  bool (*check)(void));
+extern bool xfer_name_ok(const char *name);
+extern bool xfer_open(const char *name, bool wr);
+extern int xfer_read(BYTE *buf, UINT len);
+extern bool xfer_write(const BYTE *buf, UINT len);
+extern void xfer_close(void);
+extern bool xfer_find(const char *pattern, char *name);
+#if PRINT_SPOOL_SIZE > 0
+extern unsigned int spool_room(void);
+extern bool spool_put(BYTE c);
+extern void spool_close(void);
+#endif
+#if CAPTURE_SIZE > 0
+extern void capture_put(int s, BYTE c);
+extern void capture_close(void);
+#endif
+#if PC_PROF_SIZE > 0
+extern bool pc_prof_active(void);
+extern void pc_prof(bool on);
+extern uint32_t pc_acct_total, pc_acct_bank[PC_ACCT_BANKS];
+extern uint32_t pc_acct_con[PC_ACCT_CONS];
+extern BYTE pc_acct_owner[PC_ACCT_BANKS];
+#endif
 extern void check_disks(void);
-extern void mount_disk(int drive, const char *name);
+#if DISK_CRC
+extern void verify_disks(void);
+#endif
+extern void create_disk(const char *name, bool hd);
+#if FF_USE_FASTSEEK
+extern void defrag_disks(void);
+#endif
+#if DISK_DSZ
+extern void compress_disk(const char *name);
+#endif
+extern void mount_disk(int drive, const char *name, bool overlay);
+extern BYTE swap_disk(int drive, const char *name, bool overlay);
+extern BYTE convert_linear(int drive);
+extern void unmount_disk(int drive);
+#if RAMDISK_SIZE > 0
+extern bool load_ramdisk(int drive);
+#endif
+#if FLASH_DISK
+extern bool flash_disk(int drive);
+extern int flash_disks(void);
+#endif
 
 extern BYTE read_sec(int drive, int track, int sector, WORD addr);
 extern BYTE write_sec(int drive, int track, int sector, WORD addr);
+struct mem_map;
+extern BYTE read_secs(const struct mem_map *map, int drive, int track,
+		      int sector, WORD addr, int count, int *done);
+extern BYTE write_secs(const struct mem_map *map, int drive, int track,
+		       int sector, WORD addr, int count, int *done);
 extern void get_fdccmd(BYTE *cmd, WORD addr);
+#if DISK_CACHE_TRACKS > 0
+extern void warm_cache(int drive, int tracks);
+extern void learn_cache(void);
+#endif
 
 #endif /* !DISK_INC */
@@ -1,5 +1,5 @@
 /*
- * Functions for drawing into a pixmap (supports COLOR_DEPTH 12 and 16)
+ * Functions for drawing into a pixmap (supports COLOR_DEPTH 8, 12 and 16)
  *
  * Copyright (C) 2024 by Thomas Eberhardt
  */
@@ -10,11 +10,58 @@
 #endif
 
 #include "pico.h"
+#include "hardware/dma.h"
 
 #include "draw.h"
 
+/*
+ *	With DRAW_DMA draw_clear() copies the first row into the others
+ *	with a DMA channel of its own, the LCD transfer has another one.
+ *	The channel reads a row behind where it writes, far more than
+ *	the transfers it has in flight, so it reads what it wrote.
+ */
+#ifndef DRAW_DMA
+#define DRAW_DMA 1	/* clear the pixmap with DMA */
+#endif
+
 draw_pixmap_t *draw_pixmap;	/* active pixmap */
 
+#if DRAW_DMA
+static int draw_dma_chan = -1;	/* DMA channel, -1 = not claimed yet */
+static bool draw_dma_none;	/* there was no free channel */
+
+/*
+ *	Copy the first row of the pixmap into all others with DMA,
+ *	returns false if no DMA channel is available.
+ */
+static bool __not_in_flash_func(draw_dma_rows)(void)
+{
+	dma_channel_config c;
+	const uint32_t n = (draw_pixmap->height - 1) * draw_pixmap->stride;
+
+	if (draw_dma_chan < 0) {
+		if (draw_dma_none)
+			return false;
+		if ((draw_dma_chan = dma_claim_unused_channel(false)) < 0) {
+			draw_dma_none = true;
+			return false;
+		}
+	}
+	if ((n | (uintptr_t) draw_pixmap->bits) & 3)
+		return false;
+
+	c = dma_channel_get_default_config(draw_dma_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, true);
+	dma_channel_configure(draw_dma_chan, &c,
+			      draw_pixmap->bits + draw_pixmap->stride,
+			      draw_pixmap->bits, n / 4, true);
+	dma_channel_wait_for_finish_blocking(draw_dma_chan);
+	return true;
+}
+#endif
+
 /*
  *	Fill the pixmap with the specified color.
  */
@@ -42,16 +89,91 @@ void __not_in_flash_func(draw_clear)(uint16_t color)
 		if (i == 3)
 			i = 0;
 	}
+#elif COLOR_DEPTH == 8
+	for (x = 0; x < draw_pixmap->stride; x++)
+		*p++ = color & 0xff;
 #else
 	for (x = 0; x < draw_pixmap->width; x++) {
 		*p++ = (color >> 8) & 0xff;
 		*p++ = color & 0xff;
 	}
+#endif
+#if DRAW_DMA
+	if (!draw_dma_rows())
 #endif
 	for (y = 1; y < draw_pixmap->height; y++) {
 		memcpy(p, draw_pixmap->bits, draw_pixmap->stride);
 		p += draw_pixmap->stride;
 	}
+	draw_dirty(0, draw_pixmap->height - 1);
+}
+
+/*
+ *	Fill a rectangle in the specified color. The first row is drawn
+ *	in pairs and copied with memcpy() into the other rows, rows only
+ *	are marked as changed if they change. With 12 bits a pixel at an
+ *	odd start or even end shares its byte with the next pixel, it is
+ *	drawn on its own.
+ */
+void __not_in_flash_func(draw_fill)(uint16_t x, uint16_t y, uint16_t w,
+				    uint16_t h, uint16_t color)
+{
+	const uint8_t *src;
+	uint8_t *p;
+	uint16_t n, j;
+#if COLOR_DEPTH == 12
+	uint16_t x0, x1;
+#endif
+
+#ifdef DRAW_DEBUG
+	if (draw_pixmap == NULL) {
+		fprintf(stderr, "%s: draw pixmap is NULL\n", __func__);
+		return;
+	}
+	if (x >= draw_pixmap->width || y >= draw_pixmap->height ||
+	    x + w > draw_pixmap->width || y + h > draw_pixmap->height) {
+		fprintf(stderr, "%s: rectangle (%d,%d)-(%d,%d) is outside "
+			"(0,0)-(%d,%d)\n", __func__, x, y, x + w - 1,
+			y + h - 1, draw_pixmap->width - 1,
+			draw_pixmap->height - 1);
+		return;
+	}
+#endif
+	if (w == 0 || h == 0)
+		return;
+	draw_hspan(x, y, w, color);
+
+	/* bytes of the pixels which have them for their own */
+#if COLOR_DEPTH == 12
+	x0 = x;
+	x1 = x + w;
+	if (x0 & 1)
+		x0++;
+	if (x1 & 1)
+		x1--;
+	n = x1 > x0 ? (x1 - x0) / 2 * 3 : 0;
+	src = draw_pixmap->bits + (x0 / 2 * 3 + y * draw_pixmap->stride);
+#elif COLOR_DEPTH == 8
+	n = w;
+	src = draw_pixmap->bits + (x + y * draw_pixmap->stride);
+#else
+	n = w * 2;
+	src = draw_pixmap->bits + (x * 2 + y * draw_pixmap->stride);
+#endif
+	p = (uint8_t *) src;
+	for (j = 1; j < h; j++) {
+		p += draw_pixmap->stride;
+		if (n && memcmp(p, src, n)) {
+			memcpy(p, src, n);
+			draw_dirty(y + j, y + j);
+		}
+#if COLOR_DEPTH == 12
+		if (x0 != x)
+			draw_pixel(x, y + j, color);
+		if (x1 != x + w)
+			draw_pixel(x1, y + j, color);
+#endif
+	}
 }
 
 /*
@@ -1,5 +1,5 @@
 /*
- * Functions for drawing into a pixmap (supports COLOR_DEPTH 12 and 16)
+ * Functions for drawing into a pixmap (supports COLOR_DEPTH 8, 12 and 16)
  *
  * Copyright (C) 2024-2025 by Thomas Eberhardt
  */
@@ -12,7 +12,7 @@
 #include <stdio.h>
 #endif
 
-#if COLOR_DEPTH != 12 && COLOR_DEPTH != 16
+#if COLOR_DEPTH != 8 && COLOR_DEPTH != 12 && COLOR_DEPTH != 16
 #error "Unsupported COLOR_DEPTH"
 #endif
 
@@ -38,6 +38,25 @@
 #define C_GRAY		0x0888
 #define C_ORANGE	0x0fa0
 #define C_WHEAT		0x0edb
+#elif COLOR_DEPTH == 8
+/* 332 RGB colors, expanded to 565 when sent to the LCD */
+#define C_BLACK		0x00
+#define C_RED		0xe0
+#define C_GREEN		0x1c
+#define C_BLUE		0x03
+#define C_CYAN		0x1f
+#define C_MAGENTA	0xe3
+#define C_YELLOW	0xfc
+#define C_WHITE		0xff
+#define C_DKRED		0x80
+#define C_DKGREEN	0x10
+#define C_DKBLUE	0x02
+#define C_DKCYAN	0x12
+#define C_DKMAGENTA	0x82
+#define C_DKYELLOW	0x90
+#define C_GRAY		0x92
+#define C_ORANGE	0xf4
+#define C_WHEAT		0xdb
 #else
 /* 565 RGB colors */
 #define C_BLACK		0x0000
@@ -63,6 +82,8 @@
  *	Pixmap type for drawing into.
  *	The depth field is currently ignored, and COLOR_DEPTH is used for
  *	conditional compilation.
+ *	The rows dirty_y0 to dirty_y1 contain pixels changed since the
+ *	pixmap was marked clean, none if dirty_y0 > dirty_y1.
  */
 typedef struct draw_pixmap {
 	uint8_t *bits;
@@ -70,6 +91,8 @@ typedef struct draw_pixmap {
 	uint16_t width;
 	uint16_t height;
 	uint16_t stride;
+	uint16_t dirty_y0;
+	uint16_t dirty_y1;
 } draw_pixmap_t;
 
 /*
@@ -123,6 +146,8 @@ extern const font_t font28;	/* 14 x 28 pixels */
 extern const font_t font32;	/* 16 x 32 pixels */
 
 extern void draw_clear(uint16_t color);
+extern void draw_fill(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+		      uint16_t color);
 extern void draw_string(uint16_t x, uint16_t y, const char *s,
 			const font_t *font, uint16_t fgc, uint16_t bgc);
 extern void draw_bitmap(uint16_t x, uint16_t y, const draw_ro_pixmap_t *bitmap,
@@ -143,11 +168,35 @@ static inline void draw_set_pixmap(draw_pixmap_t *pixmap)
 }
 
 /*
- *	Draw a pixel in the specified color.
+ *	Mark rows of the active pixmap as changed.
+ */
+static inline void draw_dirty(uint16_t y0, uint16_t y1)
+{
+	if (y0 < draw_pixmap->dirty_y0)
+		draw_pixmap->dirty_y0 = y0;
+	if (y1 > draw_pixmap->dirty_y1)
+		draw_pixmap->dirty_y1 = y1;
+}
+
+/*
+ *	Mark a pixmap as unchanged.
+ */
+static inline void draw_clean(draw_pixmap_t *pixmap)
+{
+	pixmap->dirty_y0 = pixmap->height;
+	pixmap->dirty_y1 = 0;
+}
+
+/*
+ *	Draw a pixel in the specified color, the row is only marked
+ *	as changed if the pixel changes.
  */
 static inline void draw_pixel(uint16_t x, uint16_t y, uint16_t color)
 {
 	uint8_t *p;
+#if COLOR_DEPTH != 8
+	uint8_t b0, b1;
+#endif
 
 #ifdef DRAW_DEBUG
 	if (draw_pixmap == NULL) {
@@ -161,34 +210,184 @@ static inline void draw_pixel(uint16_t x, uint16_t y, uint16_t color)
 		return;
 	}
 #endif
+#if COLOR_DEPTH == 8
+	p = draw_pixmap->bits + (x + y * draw_pixmap->stride);
+	if (*p != (uint8_t) color) {
+		*p = (uint8_t) color;
+		draw_dirty(y, y);
+	}
+#else
 #if COLOR_DEPTH == 12
 	p = draw_pixmap->bits + ((x >> 1) * 3 + y * draw_pixmap->stride);
 	if ((x & 1) == 0) {
-		*p++ = (color >> 4) & 0xff;
-		*p = ((color & 0x0f) << 4) | (*p & 0x0f);
+		b0 = (color >> 4) & 0xff;
+		b1 = ((color & 0x0f) << 4) | (p[1] & 0x0f);
 	} else {
 		p++;
-		*p = (*p & 0xf0) | ((color >> 8) & 0x0f);
-		*++p = color & 0xff;
+		b0 = (*p & 0xf0) | ((color >> 8) & 0x0f);
+		b1 = color & 0xff;
 	}
 #else
 	p = draw_pixmap->bits + ((x << 1) + y * draw_pixmap->stride);
-	*p++ = (color >> 8) & 0xff;
-	*p = color & 0xff;
+	b0 = (color >> 8) & 0xff;
+	b1 = color & 0xff;
+#endif
+	if (p[0] != b0 || p[1] != b1) {
+		p[0] = b0;
+		p[1] = b1;
+		draw_dirty(y, y);
+	}
+#endif
+}
+
+/*
+ *	Two pixels at an even x are one unit, a half word with 8 bits,
+ *	three bytes with 12 bits and one word with 16 bits, which needs
+ *	the pixmap bits and the stride word aligned. A pair packed with draw_pack_pair() is
+ *	written with draw_put_pair(), so that tables of packed pairs
+ *	can be prepared.
+ */
+typedef uint32_t draw_pair_t;
+
+static inline draw_pair_t draw_pack_pair(uint16_t c0, uint16_t c1)
+{
+#if COLOR_DEPTH == 12
+	return ((c0 >> 4) & 0xff) |
+	       ((((c0 & 0x0f) << 4) | ((c1 >> 8) & 0x0f)) << 8) |
+	       ((uint32_t) (c1 & 0xff) << 16);
+#elif COLOR_DEPTH == 8
+	return (c0 & 0xff) | ((c1 & 0xff) << 8);
+#else
+	/* big endian pixels in a little endian word */
+	return ((c0 >> 8) & 0xff) | ((c0 & 0xff) << 8) |
+	       ((uint32_t) ((c1 >> 8) & 0xff) << 16) |
+	       ((uint32_t) (c1 & 0xff) << 24);
+#endif
+}
+
+/*
+ *	Draw a packed pixel pair at an even x.
+ */
+static inline void draw_put_pair(uint16_t x, uint16_t y, draw_pair_t pp)
+{
+#if COLOR_DEPTH == 12
+	uint8_t *p;
+#elif COLOR_DEPTH == 8
+	uint16_t *p;
+#else
+	uint32_t *p;
+#endif
+
+#ifdef DRAW_DEBUG
+	if (draw_pixmap == NULL) {
+		fprintf(stderr, "%s: draw pixmap is NULL\n", __func__);
+		return;
+	}
+	if ((x & 1) || x + 1 >= draw_pixmap->width ||
+	    y >= draw_pixmap->height) {
+		fprintf(stderr, "%s: pair at (%d,%d) is odd or outside "
+			"(0,0)-(%d,%d)\n", __func__, x, y,
+			draw_pixmap->width - 1, draw_pixmap->height - 1);
+		return;
+	}
 #endif
+#if COLOR_DEPTH == 12
+	p = draw_pixmap->bits + ((x >> 1) * 3 + y * draw_pixmap->stride);
+	if ((p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16)) != pp) {
+		p[0] = pp & 0xff;
+		p[1] = (pp >> 8) & 0xff;
+		p[2] = (pp >> 16) & 0xff;
+		draw_dirty(y, y);
+	}
+#elif COLOR_DEPTH == 8
+	p = (uint16_t *) (draw_pixmap->bits + (x + y * draw_pixmap->stride));
+	if (*p != (uint16_t) pp) {
+		*p = (uint16_t) pp;
+		draw_dirty(y, y);
+	}
+#else
+	p = (uint32_t *) (draw_pixmap->bits + ((x << 1) +
+					       y * draw_pixmap->stride));
+	if (*p != pp) {
+		*p = pp;
+		draw_dirty(y, y);
+	}
+#endif
+}
+
+/*
+ *	Draw two pixels at an even x in the specified colors.
+ */
+static inline void draw_pair(uint16_t x, uint16_t y, uint16_t c0, uint16_t c1)
+{
+	draw_put_pair(x, y, draw_pack_pair(c0, c1));
+}
+
+/*
+ *	Fill a 2 x 2 pixel block in the specified color.
+ */
+static inline void draw_block2(uint16_t x, uint16_t y, uint16_t color)
+{
+	if (x & 1) {
+		draw_pixel(x, y, color);
+		draw_pixel(x + 1, y, color);
+		draw_pixel(x, y + 1, color);
+		draw_pixel(x + 1, y + 1, color);
+	} else {
+		draw_pair(x, y, color, color);
+		draw_pair(x, y + 1, color, color);
+	}
 }
 
 /*
- *	Draw a character in the specfied font and colors.
+ *	Draw a horizontal span of w pixels in the specified color.
+ */
+static inline void draw_hspan(uint16_t x, uint16_t y, uint16_t w,
+			      uint16_t color)
+{
+	if ((x & 1) && w > 0) {
+		draw_pixel(x++, y, color);
+		w--;
+	}
+	for (; w >= 2; w -= 2, x += 2)
+		draw_pair(x, y, color, color);
+	if (w)
+		draw_pixel(x, y, color);
+}
+
+/*
+ *	Draw 8 pixels from the bits of a byte, MSB first, set bits
+ *	in the foreground and cleared bits in the background color.
+ */
+static inline void draw_bits8(uint16_t x, uint16_t y, uint8_t bits,
+			      uint16_t fgc, uint16_t bgc)
+{
+	int i;
+
+	if (x & 1) {
+		for (i = 0; i < 8; i++, bits <<= 1)
+			draw_pixel(x++, y, (bits & 0x80) ? fgc : bgc);
+	} else {
+		for (i = 0; i < 4; i++, bits <<= 2, x += 2)
+			draw_pair(x, y, (bits & 0x80) ? fgc : bgc,
+				  (bits & 0x40) ? fgc : bgc);
+	}
+}
+
+/*
+ *	Draw a character in the specfied font and colors. A row of the
+ *	glyph, at most 16 pixels wide, is read MSB aligned into a word
+ *	and drawn in pairs, from the four pairs of the two colors.
  */
 static inline void draw_char(uint16_t x, uint16_t y, const char c,
 			     const font_t *font, uint16_t fgc, uint16_t bgc)
 {
 	const uint16_t off = (c & 0x7f) * font->width;
 	const uint8_t *p0 = font->bits + (off >> 3), *p;
-	const uint8_t m0 = 0x80 >> (off & 7);
-	uint8_t m;
-	uint16_t i, j;
+	const uint16_t n = ((off & 7) + font->width + 7) >> 3;
+	draw_pair_t pp[4];
+	uint32_t bits;
+	uint16_t i, j, w, px;
 
 #ifdef DRAW_DEBUG
 	if (draw_pixmap == NULL) {
@@ -209,21 +408,31 @@ static inline void draw_char(uint16_t x, uint16_t y, const char c,
 		return;
 	}
 #endif
+	/* index is the first pixel in bit 1, the second in bit 0 */
+	pp[0] = draw_pack_pair(bgc, bgc);
+	pp[1] = draw_pack_pair(bgc, fgc);
+	pp[2] = draw_pack_pair(fgc, bgc);
+	pp[3] = draw_pack_pair(fgc, fgc);
+
 	for (j = font->height; j > 0; j--) {
-		m = m0;
+		/* only read the bytes of the glyph, it may be the last */
 		p = p0;
-		for (i = font->width; i > 0; i--) {
-			if (*p & m)
-				draw_pixel(x, y, fgc);
-			else
-				draw_pixel(x, y, bgc);
-			if ((m >>= 1) == 0) {
-				m = 0x80;
-				p++;
-			}
-			x++;
+		bits = 0;
+		for (i = 0; i < n; i++)
+			bits |= (uint32_t) *p++ << (24 - 8 * i);
+		bits <<= off & 7;
+
+		px = x;
+		w = font->width;
+		if (px & 1) {
+			draw_pixel(px++, y, (bits & 0x80000000) ? fgc : bgc);
+			bits <<= 1;
+			w--;
 		}
-		x -= font->width;
+		for (; w >= 2; w -= 2, px += 2, bits <<= 2)
+			draw_put_pair(px, y, pp[bits >> 30]);
+		if (w)
+			draw_pixel(px, y, (bits & 0x80000000) ? fgc : bgc);
 		y++;
 		p0 += font->stride;
 	}
@@ -247,8 +456,7 @@ static inline void draw_hline(uint16_t x, uint16_t y, uint16_t w, uint16_t col)
 		return;
 	}
 #endif
-	while (w--)
-		draw_pixel(x++, y, col);
+	draw_hspan(x, y, w, col);
 }
 
 /*
@@ -431,14 +639,9 @@ static inline void draw_led_bracket(uint16_t x, uint16_t y)
  */
 static inline void draw_led(uint16_t x, uint16_t y, uint16_t col)
 {
-	int i;
-
-	for (i = 1; i < 9; i++) {
-		if (i == 1 || i == 8)
-			draw_hline(x + 2, y + i, 6, col);
-		else
-			draw_hline(x + 1, y + i, 8, col);
-	}
+	draw_hline(x + 2, y + 1, 6, col);
+	draw_fill(x + 1, y + 2, 8, 6, col);
+	draw_hline(x + 2, y + 8, 6, col);
 }
 
 #endif /* !DRAW_INC */
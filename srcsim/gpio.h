@@ -25,6 +25,10 @@
 #define WAVESHARE_DEBUG_TX_PIN 2
 #endif
 
+#ifndef SOUND_PIN
+#define SOUND_PIN 3	/* PWM output of the sound device */
+#endif
+
 #ifndef WAVESHARE_LCD_WIDTH
 #define WAVESHARE_LCD_WIDTH 240
 #endif
@@ -0,0 +1,172 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Hang detector, for machines running unattended. An event of the
+ * scheduler samples the PC every HANG_TICK_T T-states, and the
+ * machine counts as hung when for HANG_SECS there was no console
+ * I/O on the SIO ports, no disk I/O and the PC stayed within
+ * HANG_SPAN bytes, a loop waiting for something which never comes.
+ * This also is a HALT with the interrupts disabled. Polling the
+ * console status is I/O, so a machine waiting at a prompt isn't hung.
+ *
+ * When a hang is detected the CPU is stopped, the machine state is
+ * saved into HANG_PATH, like a snapshot, and the MCU reboots, which
+ * restarts the machine with autoboot. The boot reports the hang, with
+ * BRANCH_TRACE also the last branches. The hung machine can be looked
+ * at by copying HANG_PATH to the snapshot file and resuming it with
+ * the ICE. The event also updates the hardware watchdog, so that the
+ * MCU resets if the CPU emulation itself stops.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+#include "hang.h"
+#include "disks.h"
+#include "lcd.h"
+#include "sched.h"
+#include "simio.h"
+#include "simmem.h"
+
+#if HANG80
+
+#ifndef HANG_SPAN
+#define HANG_SPAN	256	/* bytes of code a hung loop is within */
+#endif
+#define HANG_TICK_T	20000	/* T-states between the samples */
+#define HANG_WDOG_MS	5000	/* timeout of the hardware watchdog */
+#define HANG_MAGIC	0x48414e47 /* "HANG" in the scratch register */
+#define HANG_REG	1	/* watchdog scratch register */
+
+uint32_t hang_act;		/* console I/O counter */
+
+static bool hang_on;		/* detector running */
+static bool hang_hit;		/* hang detected */
+static uint64_t hang_due;	/* end of the time without progress */
+static uint32_t last_act, last_ops;
+static WORD pc_lo, pc_hi;	/* range of the PC samples */
+
+/* sectors read and written of all drives */
+static uint32_t disk_ops(void)
+{
+	uint32_t n = 0;
+	register int i;
+
+	for (i = 0; i < NUMDISK; i++)
+		n += disk_stats[i].reads + disk_stats[i].writes;
+	return n;
+}
+
+/* progress, start the time again */
+static void hang_progress(uint64_t now)
+{
+	last_act = hang_act;
+	last_ops = disk_ops();
+	pc_lo = pc_hi = PC;
+	hang_due = now + (uint64_t) HANG_SECS * 1000000;
+}
+
+static void hang_tick(void)
+{
+	const uint64_t now = time_us_64();
+
+	watchdog_update();
+
+	if (PC < pc_lo)
+		pc_lo = PC;
+	if (PC > pc_hi)
+		pc_hi = PC;
+	if (hang_act != last_act || pc_hi - pc_lo >= HANG_SPAN ||
+	    disk_ops() != last_ops)
+		hang_progress(now);
+	else if (now >= hang_due) {
+		hang_hit = true;
+		cpu_error = IOHALT;
+		cpu_state = ST_STOPPED;
+		return;
+	}
+	sched_post(T + HANG_TICK_T, hang_tick);
+}
+
+/*
+ * start the detector and the watchdog, called when the CPU starts
+ */
+void hang_start(void)
+{
+	hang_hit = false;
+	hang_progress(time_us_64());
+	hang_on = true;
+	watchdog_enable(HANG_WDOG_MS, true);
+	sched_post(T + HANG_TICK_T, hang_tick);
+}
+
+/*
+ * stop the detector and the watchdog, called when the CPU stopped,
+ * the state of a hung machine is saved before the I/O devices stop
+ */
+void hang_stop(void)
+{
+	if (!hang_on)
+		return;
+	hang_on = false;
+	sched_cancel(hang_tick);
+	watchdog_disable();
+
+	if (hang_hit) {
+		printf("\nMachine hung at PC %04X, ", PC);
+		if (save_snapshot_as(HANG_PATH))
+			printf("state saved into %s\n", HANG_PATH);
+		else
+			printf("can't save the state into %s\n", HANG_PATH);
+	}
+}
+
+bool hang_detected(void)
+{
+	return hang_hit;
+}
+
+/*
+ * reboot after a hang, the boot restarts the machine
+ */
+void hang_reboot(void)
+{
+	puts("Rebooting");
+	watchdog_hw->scratch[HANG_REG] = HANG_MAGIC;
+
+	exit_disks();		/* stop disk drives */
+	lcd_exit();		/* shutdown LCD */
+	watchdog_reboot(0, 0, 0);
+	while (true) {
+		__nop();
+	}
+}
+
+/*
+ * report a hang before the reboot, called at the boot
+ */
+void hang_boot_report(void)
+{
+	if (watchdog_hw->scratch[HANG_REG] != HANG_MAGIC)
+		return;
+	watchdog_hw->scratch[HANG_REG] = 0;
+	printf("Rebooted after a hang, the machine state is in %s\n",
+	       HANG_PATH);
+#if BRANCH_TRACE
+	if (branch_trace.magic == BRANCH_MAGIC)
+		print_branch_trace();
+#endif
+	putchar('\n');
+}
+
+#endif /* HANG80 */
@@ -0,0 +1,74 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Detector for machines hanging in the guest code
+ */
+
+#ifndef HANG_INC
+#define HANG_INC
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * With HANG80 the machine counts as hung when for HANG_SECS there was
+ * no console I/O, no disk I/O and the PC stayed within HANG_SPAN bytes.
+ * Then the machine state is saved into HANG_PATH and the MCU reboots,
+ * the hardware watchdog resets it if the CPU emulation itself stops.
+ * See hang.c.
+ */
+#ifndef HANG80
+#define HANG80		0	/* hang detector */
+#endif
+
+#if HANG80
+
+#ifndef HANG_SECS
+#define HANG_SECS	60	/* seconds without progress for a hang */
+#endif
+#define HANG_PATH	"/CONF80/HANG.SNP"
+
+extern uint32_t hang_act;
+
+/* console I/O, called by the SIO ports */
+static inline void hang_io(void)
+{
+	hang_act++;
+}
+
+extern void hang_start(void), hang_stop(void);
+extern bool hang_detected(void);
+extern void hang_reboot(void), hang_boot_report(void);
+
+#else /* !HANG80 */
+
+static inline void hang_io(void)
+{
+}
+
+static inline void hang_start(void)
+{
+}
+
+static inline void hang_stop(void)
+{
+}
+
+static inline bool hang_detected(void)
+{
+	return false;
+}
+
+static inline void hang_reboot(void)
+{
+}
+
+static inline void hang_boot_report(void)
+{
+}
+
+#endif /* !HANG80 */
+
+#endif /* !HANG_INC */
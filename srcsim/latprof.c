@@ -0,0 +1,185 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Profiler of the MMU bank switches and the interrupt latency, for
+ * tuning banked systems like CP/M 3 and MP/M. The switches of the
+ * guest through the MMU port are counted, the T-states between them
+ * are added to the bank which was selected and to a histogram.
+ *
+ * The CPU cores clear int_int when they take an interrupt, this can't
+ * be hooked, so an event of the scheduler samples it every
+ * LATPROF_TICK_T T-states. The latency is the T-states from raising
+ * the interrupt, e.g. by the system timer, until a sample finds it
+ * taken, so it is exact to within LATPROF_TICK_T. The same event
+ * samples IFF for the share of the time with interrupts disabled.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "latprof.h"
+#include "sched.h"
+
+#if LATPROF80
+
+#ifndef LATPROF_TICK_T
+#define LATPROF_TICK_T	100	/* T-states between the samples */
+#endif
+
+struct latprof latprof;
+volatile uint32_t latprof_raise_T;	/* T-states at the last request */
+volatile bool latprof_wait;		/* the CPU didn't take it yet */
+
+static bool lp_on;			/* profiler running */
+static Tstates_t bank_since;		/* T-states at the last switch */
+static uint64_t start_us;		/* time of the start or clear */
+
+/* class of the histograms, the power of two <= n */
+static inline int latprof_bin(uint64_t n)
+{
+	int b = n ? 63 - __builtin_clzll(n) : 0;
+
+	return b < LATPROF_BINS ? b : LATPROF_BINS - 1;
+}
+
+/*
+ * the guest selects a bank, before the switch
+ */
+void latprof_bank(BYTE bank)
+{
+	Tstates_t d = T - bank_since;
+
+	UNUSED(bank);
+
+	latprof.bank_T[selbnk] += d;
+	latprof.bank_hist[latprof_bin(d)]++;
+	latprof.switches++;
+	bank_since = T;
+}
+
+/*
+ * event of the scheduler, samples if the CPU took the interrupt
+ * and if the interrupts are disabled
+ */
+static void __not_in_flash_func(latprof_tick)(void)
+{
+	uint32_t lat;
+
+	if (latprof_wait && !int_int) {
+		latprof_wait = false;
+		lat = (uint32_t) T - latprof_raise_T;
+		latprof.irqs++;
+		latprof.lat_T += lat;
+		if (lat > latprof.lat_max)
+			latprof.lat_max = lat;
+		latprof.lat_hist[latprof_bin(lat)]++;
+	}
+	latprof.ticks++;
+	if (!(IFF & 1))
+		latprof.di_ticks++;
+	sched_post(T + LATPROF_TICK_T, latprof_tick);
+}
+
+/*
+ * T-states with interrupts disabled, from the samples
+ */
+uint32_t latprof_di_T(void)
+{
+	return latprof.di_ticks * LATPROF_TICK_T;
+}
+
+void latprof_clear(void)
+{
+	memset(&latprof, 0, sizeof(latprof));
+	latprof_wait = false;
+	bank_since = T;
+	start_us = time_us_64();
+}
+
+/*
+ * start the profiler, called when the machine starts
+ */
+void latprof_start(void)
+{
+	latprof_clear();
+	lp_on = true;
+	sched_post(T + LATPROF_TICK_T, latprof_tick);
+}
+
+/*
+ * stop the profiler, called when the machine stops
+ */
+void latprof_stop(void)
+{
+	if (!lp_on)
+		return;
+	lp_on = false;
+	sched_cancel(latprof_tick);
+}
+
+static void latprof_print_hist(const uint32_t *hist)
+{
+	register int i;
+
+	for (i = 0; i < LATPROF_BINS; i++)
+		if (hist[i])
+			printf("  %6lu%s T-states %10lu\n",
+			       (unsigned long) (1UL << i),
+			       i == LATPROF_BINS - 1 ? "+" : " ",
+			       (unsigned long) hist[i]);
+}
+
+/*
+ * show the counters since the start or the last clear
+ */
+void latprof_print(void)
+{
+	uint64_t us = time_us_64() - start_us, total = 0;
+	Tstates_t t;
+	register int i;
+
+	for (i = 0; i <= numseg; i++)
+		total += latprof.bank_T[i];
+	total += T - bank_since;	/* the bank selected now */
+
+	printf("Bank switches %lu, %lu/s\n",
+	       (unsigned long) latprof.switches,
+	       (unsigned long) (us ? latprof.switches * 1000000ULL / us : 0));
+	for (i = 0; i <= numseg; i++) {
+		t = latprof.bank_T[i];
+		if (i == selbnk)
+			t += T - bank_since;
+		if (t)
+			printf("  bank %2d %3u.%u%%\n", i,
+			       (unsigned) (t * 100 / total),
+			       (unsigned) (t * 1000 / total % 10));
+	}
+	puts("Bank selected for");
+	latprof_print_hist(latprof.bank_hist);
+
+	printf("Interrupts taken %lu, latency avg. %lu max. %lu T-states\n",
+	       (unsigned long) latprof.irqs,
+	       (unsigned long) (latprof.irqs ?
+				latprof.lat_T / latprof.irqs : 0),
+	       (unsigned long) latprof.lat_max);
+	latprof_print_hist(latprof.lat_hist);
+	printf("Interrupts disabled %u.%u%% of the time\n",
+	       (unsigned) (latprof.ticks ?
+			   latprof.di_ticks * 100ULL / latprof.ticks : 0),
+	       (unsigned) (latprof.ticks ?
+			   latprof.di_ticks * 1000ULL / latprof.ticks % 10 :
+			   0));
+}
+
+#endif /* LATPROF80 */
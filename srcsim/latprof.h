@@ -0,0 +1,82 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Profiler of the MMU bank switches and the interrupt latency
+ */
+
+#ifndef LATPROF_INC
+#define LATPROF_INC
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+/*
+ * With LATPROF80 the bank switches of the MMU are counted with the
+ * T-states the banks stay selected, and the interrupts with the
+ * T-states from the request until the CPU takes it, and the time the
+ * interrupts are disabled is sampled. The ICE shows them, the hardware
+ * control port and the performance pages of the LCD too. See latprof.c.
+ */
+#ifndef LATPROF80
+#define LATPROF80	0	/* MMU and interrupt latency profiler */
+#endif
+
+#if LATPROF80
+
+#define LATPROF_BINS	16	/* power of two classes of the histograms */
+
+struct latprof {
+	uint32_t switches;		/* bank switches */
+	uint32_t irqs;			/* interrupts taken */
+	uint64_t lat_T;			/* sum of their latencies */
+	uint32_t lat_max;		/* longest latency */
+	uint32_t ticks, di_ticks;	/* samples, with interrupts disabled */
+	uint64_t bank_T[MAXSEG + 1];	/* T-states the banks were selected */
+	uint32_t bank_hist[LATPROF_BINS]; /* T-states of the selections */
+	uint32_t lat_hist[LATPROF_BINS];  /* T-states of the latencies */
+};
+
+extern struct latprof latprof;
+extern volatile uint32_t latprof_raise_T;
+extern volatile bool latprof_wait;
+
+/* an interrupt was raised to the CPU, called with int_int set */
+static inline void latprof_raise(void)
+{
+	latprof_raise_T = (uint32_t) T;
+	latprof_wait = true;
+}
+
+extern void latprof_bank(BYTE bank);
+extern void latprof_start(void), latprof_stop(void);
+extern void latprof_print(void), latprof_clear(void);
+extern uint32_t latprof_di_T(void);
+
+#else /* !LATPROF80 */
+
+static inline void latprof_raise(void)
+{
+}
+
+static inline void latprof_bank(BYTE bank)
+{
+	(void) bank;
+}
+
+static inline void latprof_start(void)
+{
+}
+
+static inline void latprof_stop(void)
+{
+}
+
+#endif /* !LATPROF80 */
+
+#endif /* !LATPROF_INC */
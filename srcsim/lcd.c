@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include "pico/flash.h"
 #include "pico/multicore.h"
 #include "pico/sync.h"
 #include "pico/time.h"
@@ -14,44 +15,356 @@
 #include "simdefs.h"
 #include "simglb.h"
 #include "simmem.h"
+#include "simio.h"
 
 #include "lcd.h"
 #include "draw.h"
 #include "disks.h"
+#include "xfdc.h"
 #include "gpio.h"
 #include "picosim.h"
+#include "budget.h"
+#include "memuse.h"
+#include "alog.h"
+#include "latprof.h"
+#include "perflog.h"
+#if USB_CORE1
+#include "stdio_msc_usb.h"
+#endif
 
 #if COLOR_DEPTH == 12
 #define STRIDE (((WAVESHARE_LCD_WIDTH + 1) / 2) * 3)
+#elif COLOR_DEPTH == 8
+#define STRIDE WAVESHARE_LCD_WIDTH
 #else
 #define STRIDE (WAVESHARE_LCD_WIDTH * 2)
 #endif
-static uint8_t pixmap_bits[WAVESHARE_LCD_HEIGHT * STRIDE];
 
 /*
- *	pixmap for drawing into.
+ *	With a second pixmap the next frame is drawn while the DMA sends
+ *	the last one to the LCD, otherwise drawing can change the pixmap
+ *	still being sent. The RP2040 doesn't have the RAM for it.
  */
-static draw_pixmap_t lcd_pixmap = {
-	.bits = pixmap_bits,
-	.depth = COLOR_DEPTH,
-	.width = WAVESHARE_LCD_WIDTH,
-	.height = WAVESHARE_LCD_HEIGHT,
-	.stride = STRIDE
+#ifndef LCD_DOUBLE_BUFFER
+#if PICO_RP2350
+#define LCD_DOUBLE_BUFFER 1
+#else
+#define LCD_DOUBLE_BUFFER 0
+#endif
+#endif
+#define LCD_PIXMAPS (LCD_DOUBLE_BUFFER ? 2 : 1)
+
+static uint8_t __aligned(4)
+	pixmap_bits[LCD_PIXMAPS][WAVESHARE_LCD_HEIGHT * STRIDE];
+
+#define LCD_PIXMAP(n) {				\
+	.bits = pixmap_bits[n],			\
+	.depth = COLOR_DEPTH,			\
+	.width = WAVESHARE_LCD_WIDTH,		\
+	.height = WAVESHARE_LCD_HEIGHT,		\
+	.stride = STRIDE,			\
+	.dirty_y0 = 0,				\
+	.dirty_y1 = WAVESHARE_LCD_HEIGHT - 1	\
+}
+
+/*
+ *	pixmaps for drawing into.
+ */
+static draw_pixmap_t lcd_pixmap[LCD_PIXMAPS] = {
+	LCD_PIXMAP(0),
+#if LCD_DOUBLE_BUFFER
+	LCD_PIXMAP(1)
+#endif
 };
 
+/*
+ *	Pre-rendered backgrounds of the status displays. The static
+ *	content a display draws when it is selected is saved once run
+ *	length encoded in lcd_bg_pool, for the display and a variant like
+ *	the CPU type, and restored from there when the display is selected
+ *	again, with memset() and memcpy() of the runs instead of drawing
+ *	the characters, lines and bitmaps pixel by pixel. A run is a 16 bit
+ *	header, bit 15 set for a repeated pixel unit (a pixel, or a pixel
+ *	pair with 12 bits), cleared for literal units, and the count in the
+ *	other bits. When the pool is full it starts over empty.
+ */
+#if LCD_BG_POOL > 0
+
+#if COLOR_DEPTH == 12
+#define BG_UNIT 3
+#elif COLOR_DEPTH == 8
+#define BG_UNIT 1
+#else
+#define BG_UNIT 2
+#endif
+#define BG_UNITS	(WAVESHARE_LCD_HEIGHT * STRIDE / BG_UNIT)
+#define BG_MAXRUN	0x7fff
+#define BG_MINRUN	3	/* shorter runs are literal */
+#define BG_ENTRIES	16
+
+static struct {
+	lcd_func_t page;	/* drawing function of the display */
+	int variant;
+	uint32_t off, len;	/* in lcd_bg_pool */
+} bg_entry[BG_ENTRIES];
+static int bg_n;		/* entries used */
+static uint32_t bg_used;	/* bytes of lcd_bg_pool used */
+static uint8_t lcd_bg_pool[LCD_BG_POOL];
+
+/*
+ * append a run to dst, returns false if it doesn't fit
+ */
+static bool bg_run(uint8_t *dst, uint32_t *n, uint32_t room, bool rep,
+		   const uint8_t *src, uint32_t count)
+{
+	uint32_t len = 2 + (rep ? 1 : count) * BG_UNIT;
+
+	if (count == 0)
+		return true;
+	if (*n + len > room)
+		return false;
+	dst[*n] = count & 0xff;
+	dst[*n + 1] = (count >> 8) | (rep ? 0x80 : 0);
+	memcpy(&dst[*n + 2], src, len - 2);
+	*n += len;
+	return true;
+}
+
+/*
+ * encode the pixmap into dst, returns the length or 0 if it doesn't fit
+ */
+static uint32_t bg_encode(const uint8_t *src, uint8_t *dst, uint32_t room)
+{
+	uint32_t i = 0, lit = 0, run, n = 0;
+
+	while (i < BG_UNITS) {
+		for (run = 1; i + run < BG_UNITS && run < BG_MAXRUN &&
+			     !memcmp(&src[(i + run) * BG_UNIT],
+				     &src[i * BG_UNIT], BG_UNIT); run++)
+			;
+		if (run >= BG_MINRUN) {
+			if (!bg_run(dst, &n, room, false, &src[lit * BG_UNIT],
+				    i - lit) ||
+			    !bg_run(dst, &n, room, true, &src[i * BG_UNIT],
+				    run))
+				return 0;
+			i += run;
+			lit = i;
+		} else {
+			i += run;
+			if (i - lit >= BG_MAXRUN - BG_MINRUN) {
+				if (!bg_run(dst, &n, room, false,
+					    &src[lit * BG_UNIT], i - lit))
+					return 0;
+				lit = i;
+			}
+		}
+	}
+	if (!bg_run(dst, &n, room, false, &src[lit * BG_UNIT], i - lit))
+		return 0;
+	return n;
+}
+
+/*
+ * decode the runs of an entry into the pixmap
+ */
+static void __not_in_flash_func(bg_decode)(const uint8_t *p, uint8_t *dst)
+{
+	uint8_t *end = dst + BG_UNITS * BG_UNIT;
+	uint32_t h, n;
+#if BG_UNIT > 1
+	uint32_t k, c;
+#endif
+
+	while (dst < end) {
+		h = p[0] | (p[1] << 8);
+		n = (h & BG_MAXRUN) * BG_UNIT;
+		p += 2;
+		if (h & 0x8000) {
+#if BG_UNIT == 1
+			memset(dst, *p, n);
+#else
+			memcpy(dst, p, BG_UNIT);
+			for (k = BG_UNIT; k < n; k += c) {
+				c = k < n - k ? k : n - k;
+				memcpy(dst + k, dst, c);
+			}
+#endif
+			p += BG_UNIT;
+		} else {
+			memcpy(dst, p, n);
+			p += n;
+		}
+		dst += n;
+	}
+}
+
+/*
+ * restore the background of page and variant into the pixmap,
+ * returns false if it isn't saved
+ */
+bool __not_in_flash_func(lcd_bg_restore)(lcd_func_t page, int variant)
+{
+	register int i;
+
+	for (i = 0; i < bg_n; i++)
+		if (bg_entry[i].page == page &&
+		    bg_entry[i].variant == variant) {
+			bg_decode(&lcd_bg_pool[bg_entry[i].off],
+				  draw_pixmap->bits);
+			draw_dirty(0, draw_pixmap->height - 1);
+			return true;
+		}
+	return false;
+}
+
+/*
+ * save the pixmap as the background of page and variant
+ */
+void lcd_bg_save(lcd_func_t page, int variant)
+{
+	uint32_t n;
+
+	if (bg_n == BG_ENTRIES)
+		bg_n = bg_used = 0;
+	n = bg_encode(draw_pixmap->bits, &lcd_bg_pool[bg_used],
+		      LCD_BG_POOL - bg_used);
+	if (n == 0 && bg_n > 0) {
+		bg_n = bg_used = 0;	/* start over */
+		n = bg_encode(draw_pixmap->bits, lcd_bg_pool, LCD_BG_POOL);
+	}
+	if (n == 0)
+		return;		/* too large */
+	bg_entry[bg_n].page = page;
+	bg_entry[bg_n].variant = variant;
+	bg_entry[bg_n].off = bg_used;
+	bg_entry[bg_n].len = n;
+	bg_n++;
+	bg_used += n;
+}
+
+#endif /* LCD_BG_POOL > 0 */
+
 /* core 0 & 1 (R0 means read by core 0 etc. after multicore_launch_core1() */
 static volatile lcd_func_t lcd_draw_func; /* current LCD draw func (W0 R1) */
 static volatile uint8_t lcd_backlight;	/* LCD backlight intensity (W0 R1) */
 static volatile bool lcd_rotated;	/* LCD rotation status (W0 R1) */
 static volatile bool lcd_task_done;	/* core 1 LCD task finished (R0 W1) */
-static volatile uint16_t lcd_led_color;	/* RGB LED color (W0, R1) */
+static uint16_t lcd_led_color;		/* RGB LED color (core 1) */
+static volatile bool lcd_may_idle;	/* status panel, may slow down (W0 R1) */
+static volatile uint8_t lcd_refresh_div; /* draw every n-th period (W0 R1) */
+static volatile bool lcd_perf;		/* info line shows performance (W0 R1) */
+static volatile uint8_t lcd_spi_div;	/* SPI clock divider, 0 = default (W0 R1) */
+static volatile uint8_t lcd_spi_gen;	/* counts lcd_set_spi_div() (W0 R1) */
+static uint32_t lcd_frame_us;		/* longest frame in the last second */
 
 static lcd_func_t lcd_status_func;	/* current LCD status panel */
 static bool lcd_shows_status;		/* LCD shows status panel */
 
 static uint32_t lcd_frame_cnt;		/* Frame counter (>2 yrs @ 60 Hz) */
 
+#define LCD_REFRESH_US (1000000 / LCD_REFRESH)
+
+/*
+ *	With LCD_PERF the info line starts out showing the performance
+ *	pages too, the ICE can switch them on and off.
+ */
+#ifndef LCD_PERF
+#define LCD_PERF 0
+#endif
+
+/*
+ *	State of the CPU shown by the status displays. Core 0 publishes
+ *	it in a timer interrupt once every refresh period, with a sequence
+ *	count which is odd while it is written, and core 1 copies it until
+ *	it got the same even count before and after, so that the CPU loop
+ *	doesn't pay for it. The I/O port access flags are taken over and
+ *	cleared by core 0 too, so core 1 doesn't clear them behind its back.
+ */
+typedef struct lcd_cpu {
+	BYTE A, B, C, D, E, H, L, IFF;
+	int F;
+	WORD PC, SP;
+#ifndef EXCLUDE_Z80
+	BYTE A_, B_, C_, D_, E_, H_, L_, I, R, R_;
+	int F_;
+	WORD IX, IY;
+#endif
+	Tstates_t T;
+	uint64_t slept;
+	BYTE cpu_state, cpu_bus, bus_request;
+	BYTE fp_led_data, fp_led_output;
+	WORD fp_led_address;
+#ifdef IOPANEL
+	port_flags_t port_flags[256];
+#if IO_COUNT
+	uint16_t port_in[256];		/* accesses in the last period */
+	uint16_t port_out[256];
+#endif
+#endif
+#if CPU_BUDGET
+	uint64_t budget[BUDGETS];	/* cycles of the subsystems */
+#endif
+} lcd_cpu_t;
+
+static lcd_cpu_t lcd_cpu_pub;		/* published state (W0 R1) */
+static volatile uint32_t lcd_cpu_seq;	/* its sequence count (W0 R1) */
+static lcd_cpu_t lcd_cpu;		/* the copy drawn (core 1) */
+static repeating_timer_t lcd_cpu_timer;	/* publishes the state (core 0) */
+
+/*
+ *	The disk and I/O port paths on core 0 don't change the LED and
+ *	drive state shown on core 1, they post events into a ring which
+ *	core 1 takes them from, every refresh period and while it waits
+ *	for the next one. Core 1 lights the LED colors of the events and
+ *	lets them fade out. If the ring is full the event is dropped and
+ *	counted, core 1 then takes the blue LED state from led_color.
+ */
+#ifndef LCD_EVENTS
+#define LCD_EVENTS	128	/* size of the event ring, power of 2 */
+#endif
+#ifndef LCD_LED_DECAY
+#define LCD_LED_DECAY	2	/* LED fade out per refresh period */
+#endif
+
+#define LCD_EV_DRIVE	0	/* disk drive access */
+#define LCD_EV_LED	1	/* blue LED switched by the I/O port */
+
+#define LCD_EV_RDWR	0x01	/* drive write access */
+#define LCD_EV_ACTIVE	0x02	/* drive access in progress */
+#define LCD_EV_BLUE	0x04	/* blue LED on */
+
+typedef struct lcd_event {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t drive;
+	uint8_t track;
+	uint8_t sector;
+	WORD addr;
+} lcd_event_t;
+
+static lcd_event_t lcd_events[LCD_EVENTS];
+static volatile uint32_t lcd_ev_head;	/* next event written (W0 R1) */
+static volatile uint32_t lcd_ev_tail;	/* next event read (W1 R0) */
+static volatile uint32_t lcd_ev_drops;	/* events dropped (W0 R1) */
+
+static void __not_in_flash_func(lcd_post_event)(const lcd_event_t *ev)
+{
+	uint32_t head = lcd_ev_head;
+
+	if (head - lcd_ev_tail >= LCD_EVENTS) {
+		lcd_ev_drops++;
+		return;
+	}
+	lcd_events[head & (LCD_EVENTS - 1)] = *ev;
+	__mem_fence_release();
+	lcd_ev_head = head + 1;
+	__sev();
+}
+
 static void lcd_task(void);
+static void lcd_drain_events(void);
+static void lcd_led_animate(void);
 static void lcd_draw_empty(bool first);
 static void lcd_draw_cpu_reg(bool first);
 #ifdef SIMPLEPANEL
@@ -59,33 +372,135 @@ static void lcd_draw_panel(bool first);
 #endif
 static void lcd_draw_memory(bool first);
 static void lcd_draw_drives(bool first);
+static void lcd_draw_dstats(bool first);
 #ifdef IOPANEL
 static void lcd_draw_ports(bool first);
 #endif
+static void lcd_draw_console(bool first);
+#if MEM_HEAT
+static void lcd_draw_heat(bool first);
+#endif
 
 uint16_t led_color;			/* RGB LED color (core 0) */
 
+static bool __not_in_flash_func(lcd_cpu_publish)(repeating_timer_t *rt)
+{
+	lcd_cpu_t *c = &lcd_cpu_pub;
+#if defined(IOPANEL) && IO_COUNT
+	static io_count_t last[256];
+	uint32_t n;
+	register int i;
+#endif
+
+	UNUSED(rt);
+	BUDGET_ENTER(BUDGET_ALARM);
+
+	lcd_cpu_seq++;
+	__mem_fence_release();
+	c->A = A; c->B = B; c->C = C; c->D = D; c->E = E; c->H = H; c->L = L;
+	c->IFF = IFF; c->F = F; c->PC = PC; c->SP = SP;
+#ifndef EXCLUDE_Z80
+	c->A_ = A_; c->B_ = B_; c->C_ = C_; c->D_ = D_; c->E_ = E_;
+	c->H_ = H_; c->L_ = L_;
+	c->I = I; c->R = R; c->R_ = R_; c->F_ = F_;
+	c->IX = IX; c->IY = IY;
+#endif
+	c->T = T;
+	c->slept = throttle_slept;
+	c->cpu_state = cpu_state;
+	c->cpu_bus = cpu_bus;
+	c->bus_request = bus_request;
+	/* the bus of the front panel is the next opcode fetch */
+	c->fp_led_address = PC;
+	c->fp_led_data = rdmap[PC >> 8][PC & 0xff];
+	c->fp_led_output = fp_led_output;
+#ifdef IOPANEL
+	memcpy(c->port_flags, port_flags, sizeof(port_flags));
+	memset(port_flags, 0, sizeof(port_flags));
+#if IO_COUNT
+	/* the counters only count up, except when cleared by the ICE */
+	for (i = 0; i < 256; i++) {
+		n = io_count[i].in - last[i].in;
+		if (io_count[i].in < last[i].in)
+			n = io_count[i].in;
+		c->port_in[i] = n > 0xffff ? 0xffff : n;
+		n = io_count[i].out - last[i].out;
+		if (io_count[i].out < last[i].out)
+			n = io_count[i].out;
+		c->port_out[i] = n > 0xffff ? 0xffff : n;
+		last[i] = io_count[i];
+	}
+#endif
+#endif
+#if CPU_BUDGET
+	memcpy(c->budget, budget_cycles, sizeof(budget_cycles));
+#endif
+	__mem_fence_release();
+	lcd_cpu_seq++;
+	BUDGET_EXIT();
+
+	return true;
+}
+
+static void __not_in_flash_func(lcd_cpu_fetch)(void)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = lcd_cpu_seq) & 1)
+			tight_loop_contents();
+		__mem_fence_acquire();
+		lcd_cpu = lcd_cpu_pub;
+		__mem_fence_acquire();
+	} while (seq != lcd_cpu_seq);
+}
+
 void lcd_init(void)
 {
 	lcd_draw_func = lcd_draw_empty;
 	lcd_backlight = 90;
 	lcd_rotated = false;
-	lcd_led_color = C_BLACK;
 	lcd_task_done = false;
+	lcd_refresh_div = 1;
+	lcd_spi_div = 0;
+	lcd_spi_gen = 0;
+	lcd_perf = LCD_PERF;
 
 	lcd_status_func = lcd_draw_cpu_reg;
 	lcd_shows_status = false;
 
 	lcd_frame_cnt = 0;
 
-	led_color = lcd_led_color;
+	led_color = C_BLACK;
+	lcd_led_color = C_BLACK;
+	lcd_ev_head = lcd_ev_tail = lcd_ev_drops = 0;
+
+	draw_set_pixmap(&lcd_pixmap[0]);
 
-	draw_set_pixmap(&lcd_pixmap);
+	/* publish the CPU state from core 0 every refresh period */
+	add_repeating_timer_us(-LCD_REFRESH_US, lcd_cpu_publish, NULL,
+			       &lcd_cpu_timer);
+
+#if USB_CORE1
+	/* core 1 runs the USB task from now on */
+	stdio_msc_usb_task_core1(true);
+#endif
 
 	/* launch LCD task on other core */
 	multicore_launch_core1(lcd_task);
 }
 
+/*
+ *	print the pixmaps for the memory usage report
+ */
+void print_lcd_mem(void)
+{
+	mem_line("LCD pixmaps", pixmap_bits, sizeof(pixmap_bits));
+#if LCD_BG_POOL > 0
+	mem_line("LCD backgrounds", lcd_bg_pool, sizeof(lcd_bg_pool));
+#endif
+}
+
 void lcd_exit(void)
 {
 	/* tell LCD refresh task to finish */
@@ -95,19 +510,85 @@ void lcd_exit(void)
 	while (!lcd_task_done)
 		sleep_ms(20);
 
+#if USB_CORE1
+	/* core 0 runs the USB task again */
+	stdio_msc_usb_task_core1(false);
+#endif
+
 	/* kill LCD refresh task and reset core 1 */
 	multicore_reset_core1();
+
+	cancel_repeating_timer(&lcd_cpu_timer);
 }
 
-#define LCD_REFRESH_US (1000000 / LCD_REFRESH)
+/*
+ *	After LCD_IDLE_FRAMES frames without changes a status panel is
+ *	only drawn every LCD_IDLE_DIV refresh periods, until it changes
+ *	again, and while the CPU waits in HALT. The frame counter still
+ *	counts the refresh periods, which the panels use for timing.
+ *	Custom displays like the Dazzler keep the full rate, the programs
+ *	using them wait for the frames.
+ */
+#ifndef LCD_IDLE_FRAMES
+#define LCD_IDLE_FRAMES	(2 * LCD_REFRESH)
+#endif
+#ifndef LCD_IDLE_DIV
+#define LCD_IDLE_DIV	6
+#endif
+
+#if USB_CORE1
+/*
+ *	With -D USB_CORE1=1 core 1 runs the USB task between its other
+ *	work, the USB interrupt on core 0 only wakes it. While the USB
+ *	had work in the last USB_ACTIVE_US it is also polled every
+ *	USB_FAST_US, else every USB_SLOW_US.
+ */
+#ifndef USB_FAST_US
+#define USB_FAST_US	250
+#endif
+#ifndef USB_SLOW_US
+#define USB_SLOW_US	4000
+#endif
+#ifndef USB_ACTIVE_US
+#define USB_ACTIVE_US	100000
+#endif
+
+/*
+ * run the USB task, returns the time of the next poll, not after t
+ */
+static absolute_time_t __not_in_flash_func(lcd_usb_task)(absolute_time_t t)
+{
+	static absolute_time_t active;
+	absolute_time_t now, next;
+
+	now = get_absolute_time();
+	if (stdio_msc_usb_task())
+		active = delayed_by_us(now, USB_ACTIVE_US);
+	if (absolute_time_diff_us(now, active) > 0)
+		next = delayed_by_us(now, USB_FAST_US);
+	else
+		next = delayed_by_us(now, USB_SLOW_US);
+
+	return absolute_time_min(next, t);
+}
+#endif
 
 static void __not_in_flash_func(lcd_task)(void)
 {
 	absolute_time_t t;
-	int64_t d;
 	bool first, rotated, new_rotated;
 	uint8_t backlight, new_backlight;
 	lcd_func_t draw_func, new_draw_func;
+	uint32_t idle = 0;
+	uint8_t div, new_div, period, spi_gen, new_spi_gen;
+	bool changed;
+	uint32_t frame_us;
+#if LCD_DOUBLE_BUFFER
+	int cur = 0;
+#endif
+
+	/* allow core 0 to program the flash while we run */
+	flash_safe_execute_core_init();
 
 	/* initialize the LCD controller */
 	backlight = lcd_backlight;
@@ -116,6 +597,11 @@ static void __not_in_flash_func(lcd_task)(void)
 	rotated = false;
 	draw_func = NULL;
 	first = true;
+	div = 1;
+	spi_gen = 0;
+
+	/* the LCD shows nothing of the pixmap yet */
+	draw_dirty(0, draw_pixmap->height - 1);
 
 	while (true) {
 		/* loops every LCD_REFRESH_US */
@@ -126,11 +612,34 @@ static void __not_in_flash_func(lcd_task)(void)
 		if (lcd_draw_func == NULL)
 			break;
 
+		/* check if refresh rate changed, 0 turns the LCD off */
+		new_div = lcd_refresh_div;
+		if (new_div != div) {
+			if (new_div == 0)
+				lcd_dev_backlight(0);
+			else if (div == 0) {
+				lcd_dev_backlight(backlight);
+				draw_dirty(0, draw_pixmap->height - 1);
+			}
+			div = new_div;
+			idle = 0;
+		}
+
 		/* check if backlight changed */
 		new_backlight = lcd_backlight;
 		if (new_backlight != backlight) {
 			backlight = new_backlight;
-			lcd_dev_backlight(backlight);
+			if (div)
+				lcd_dev_backlight(backlight);
+		}
+
+		/* check if SPI clock or the system clock changed */
+		new_spi_gen = lcd_spi_gen;
+		if (new_spi_gen != spi_gen) {
+			spi_gen = new_spi_gen;
+			lcd_dev_spi_clock(lcd_spi_div);
+			draw_dirty(0, draw_pixmap->height - 1);
+			idle = 0;
 		}
 
 		/* check if rotation changed */
@@ -138,6 +647,8 @@ static void __not_in_flash_func(lcd_task)(void)
 		if (new_rotated != rotated) {
 			rotated = new_rotated;
 			lcd_dev_rotation(rotated);
+			draw_dirty(0, draw_pixmap->height - 1);
+			idle = 0;
 		}
 
 		/* check if drawing function changed */
@@ -145,22 +656,72 @@ static void __not_in_flash_func(lcd_task)(void)
 		if (new_draw_func != draw_func) {
 			draw_func = new_draw_func;
 			first = true;
+			idle = 0;
 		}
 
-		/* call drawing function and send pixmap to LCD */
-		(*draw_func)(first);
-		first = false;
-		lcd_dev_send_pixmap(draw_pixmap);
+		if (!lcd_may_idle)
+			idle = 0;
+
+		period = div;
+		if ((idle >= LCD_IDLE_FRAMES || (cpu_halted && lcd_may_idle))
+		    && period < LCD_IDLE_DIV)
+			period = LCD_IDLE_DIV;
+
+		/* take the events from core 0 and animate the LED */
+		lcd_drain_events();
+		lcd_led_animate();
+
+		if (period && lcd_frame_cnt % period == 0) {
+			/* call drawing function and send changes to LCD */
+			lcd_cpu_fetch();
+			(*draw_func)(first);
+			first = false;
+			changed = draw_pixmap->dirty_y0 <= draw_pixmap->dirty_y1;
+			lcd_dev_send_pixmap(draw_pixmap);
+			frame_us = absolute_time_diff_us(t, get_absolute_time());
+			if (frame_us > lcd_frame_us)
+				lcd_frame_us = frame_us;
+
+			if (changed) {
+				idle = 0;
+#if LCD_DOUBLE_BUFFER
+				/*
+				 * draw the next frame into the other pixmap,
+				 * the drawing functions only update what
+				 * changed, so it starts as a copy of the
+				 * frame being sent
+				 */
+				cur ^= 1;
+				memcpy(lcd_pixmap[cur].bits, draw_pixmap->bits,
+				       sizeof(pixmap_bits[0]));
+				draw_clean(&lcd_pixmap[cur]);
+				draw_set_pixmap(&lcd_pixmap[cur]);
+#endif
+			} else if (idle < LCD_IDLE_FRAMES)
+				idle++;
+		}
 
 		lcd_frame_cnt++;
 
-		d = absolute_time_diff_us(t, get_absolute_time());
-		// printf("SLEEP %lld\n", LCD_REFRESH_US - d);
-		if (d < LCD_REFRESH_US)
-			sleep_us(LCD_REFRESH_US - d);
-#if 0
-		else
-			puts("REFRESH!");
+		/* do background disk work until the next refresh */
+		t = delayed_by_us(t, LCD_REFRESH_US);
+#if USB_CORE1
+		do {
+			xfdc_task();
+			disk_task();
+			alog_task();
+			perflog_task();
+			lcd_drain_events();
+		} while (!best_effort_wfe_or_timeout(lcd_usb_task(t))
+			 || !time_reached(t));
+#else
+		do {
+			xfdc_task();
+			disk_task();
+			alog_task();
+			perflog_task();
+			lcd_drain_events();
+		} while (!best_effort_wfe_or_timeout(t));
 #endif
 	}
 
@@ -177,6 +738,148 @@ void lcd_brightness(int brightness)
 	lcd_backlight = brightness;
 }
 
+/*
+ *	Emulated CPU clock while each display was shown, printed when the
+ *	CPU stops. The displays read their fonts and tables from SRAM,
+ *	so that core 1 doesn't take the XIP cache from the CPU emulation,
+ *	comparing a display with the LCD turned off shows what is left.
+ *	Measured on core 0 from the switches between the displays.
+ */
+#define LCD_CLK_OFF	(LCD_STATUS_HEAT + 1)	/* the LCD is turned off */
+#define LCD_CLK_OTHER	(LCD_STATUS_HEAT + 2)	/* Dazzler and others */
+#define LCD_CLKS	(LCD_STATUS_HEAT + 3)
+
+static const char *const lcd_clk_name[LCD_CLKS] = {
+	NULL, "registers", "frontpanel", "drives", "I/O ports", "memory",
+	"disk statistics", "console", "heat map", "LCD off", "other"
+};
+static uint64_t lcd_clk_us[LCD_CLKS];
+static Tstates_t lcd_clk_T[LCD_CLKS];
+static int lcd_clk_cur = -1;	/* display measured, -1 = none */
+static uint64_t lcd_clk_start_us;
+static Tstates_t lcd_clk_start_T;
+
+static int lcd_clk_index(void)
+{
+	const lcd_func_t f = lcd_draw_func;
+
+	if (lcd_refresh_div == 0)
+		return LCD_CLK_OFF;
+	if (f == lcd_draw_cpu_reg)
+		return LCD_STATUS_REGISTERS;
+#ifdef SIMPLEPANEL
+	if (f == lcd_draw_panel)
+		return LCD_STATUS_PANEL;
+#endif
+	if (f == lcd_draw_drives)
+		return LCD_STATUS_DRIVES;
+	if (f == lcd_draw_dstats)
+		return LCD_STATUS_DSTATS;
+#ifdef IOPANEL
+	if (f == lcd_draw_ports)
+		return LCD_STATUS_PORTS;
+#endif
+	if (f == lcd_draw_memory)
+		return LCD_STATUS_MEMORY;
+	if (f == lcd_draw_console)
+		return LCD_STATUS_CONSOLE;
+#if MEM_HEAT
+	if (f == lcd_draw_heat)
+		return LCD_STATUS_HEAT;
+#endif
+	return LCD_CLK_OTHER;
+}
+
+/*
+ *	add the time since the last switch to the display shown,
+ *	called when the display changes
+ */
+static void lcd_clk_switch(void)
+{
+	const uint64_t now = time_us_64();
+
+	if (lcd_clk_cur < 0)
+		return;
+	lcd_clk_us[lcd_clk_cur] += now - lcd_clk_start_us;
+	lcd_clk_T[lcd_clk_cur] += T - lcd_clk_start_T;
+	lcd_clk_cur = lcd_clk_index();
+	lcd_clk_start_us = now;
+	lcd_clk_start_T = T;
+}
+
+/*
+ *	start measuring, called when the CPU starts
+ */
+void lcd_clock_start(void)
+{
+	memset(lcd_clk_us, 0, sizeof(lcd_clk_us));
+	memset(lcd_clk_T, 0, sizeof(lcd_clk_T));
+	lcd_clk_cur = lcd_clk_index();
+	lcd_clk_start_us = time_us_64();
+	lcd_clk_start_T = T;
+}
+
+/*
+ *	print the clock of the displays shown for a second at least,
+ *	called when the CPU stopped
+ */
+void lcd_clock_report(void)
+{
+	register int i;
+	unsigned clk;
+
+	lcd_clk_switch();
+	lcd_clk_cur = -1;
+	for (i = 1; i < LCD_CLKS; i++) {
+		if (lcd_clk_us[i] < 1000000)
+			continue;
+		clk = (unsigned) (lcd_clk_T[i] * 100 / lcd_clk_us[i]);
+		printf("LCD %-16s %4u.%02u MHz in %llu s\n",
+		       lcd_clk_name[i], clk / 100, clk % 100,
+		       (unsigned long long) (lcd_clk_us[i] / 1000000));
+	}
+}
+
+/*
+ *	Set the refresh rate, LCD_REFRESH divided by a whole number, or
+ *	0 for turning the LCD off. The LCD task still runs every refresh
+ *	period for the background disk work, but only draws every n-th
+ *	period and doesn't use SPI and DMA while off.
+ */
+void lcd_set_refresh(int hz)
+{
+	if (hz <= 0)
+		lcd_refresh_div = 0;
+	else if (hz >= LCD_REFRESH)
+		lcd_refresh_div = 1;
+	else
+		lcd_refresh_div = LCD_REFRESH / hz;
+	lcd_clk_switch();
+}
+
+/*
+ *	Set the divider of clk_peri for the LCD SPI clock, 0 is the
+ *	default of about 50 MHz. Also called with the same divider
+ *	after the system clock was changed.
+ */
+void lcd_set_spi_div(int div)
+{
+	lcd_spi_div = (div < 0 || div > 254) ? 0 : div;
+	lcd_spi_gen++;
+}
+
+int lcd_get_spi_div(void)
+{
+	return lcd_spi_div;
+}
+
+bool lcd_toggle_perf(void)
+{
+	lcd_perf = !lcd_perf;
+
+	return lcd_perf;
+}
+
 void lcd_set_rotation(bool rotated)
 {
 	lcd_rotated = rotated;
@@ -184,13 +887,19 @@ void lcd_set_rotation(bool rotated)
 
 void lcd_update_led(void)
 {
-	lcd_led_color = led_color;
+	lcd_event_t ev;
+
+	ev.type = LCD_EV_LED;
+	ev.flags = (led_color & C_BLUE) ? LCD_EV_BLUE : 0;
+	lcd_post_event(&ev);
 }
 
 void lcd_custom_disp(lcd_func_t draw_func)
 {
+	lcd_may_idle = false;
 	lcd_draw_func = draw_func;
 	lcd_shows_status = false;
+	lcd_clk_switch();
 }
 
 void lcd_status_disp(int which)
@@ -207,6 +916,9 @@ void lcd_status_disp(int which)
 	case LCD_STATUS_DRIVES:
 		lcd_status_func = lcd_draw_drives;
 		break;
+	case LCD_STATUS_DSTATS:
+		lcd_status_func = lcd_draw_dstats;
+		break;
 #ifdef IOPANEL
 	case LCD_STATUS_PORTS:
 		lcd_status_func = lcd_draw_ports;
@@ -215,12 +927,22 @@ void lcd_status_disp(int which)
 	case LCD_STATUS_MEMORY:
 		lcd_status_func = lcd_draw_memory;
 		break;
+	case LCD_STATUS_CONSOLE:
+		lcd_status_func = lcd_draw_console;
+		break;
+#if MEM_HEAT
+	case LCD_STATUS_HEAT:
+		lcd_status_func = lcd_draw_heat;
+		break;
+#endif
 	case LCD_STATUS_CURRENT:
 	default:
 		break;
 	}
 	lcd_draw_func = lcd_status_func;
 	lcd_shows_status = true;
+	lcd_may_idle = true;
+	lcd_clk_switch();
 }
 
 void lcd_status_next(void)
@@ -232,15 +954,25 @@ void lcd_status_next(void)
 #endif
 		lcd_status_func = lcd_draw_drives;
 	else if (lcd_status_func == lcd_draw_drives)
+		lcd_status_func = lcd_draw_dstats;
+	else if (lcd_status_func == lcd_draw_dstats)
 #ifdef IOPANEL
 		lcd_status_func = lcd_draw_ports;
 	else if (lcd_status_func == lcd_draw_ports)
 #endif
 		lcd_status_func = lcd_draw_memory;
+	else if (lcd_status_func == lcd_draw_memory)
+		lcd_status_func = lcd_draw_console;
+#if MEM_HEAT
+	else if (lcd_status_func == lcd_draw_console)
+		lcd_status_func = lcd_draw_heat;
+#endif
 	else
 		lcd_status_func = lcd_draw_cpu_reg;
-	if (lcd_shows_status)
+	if (lcd_shows_status) {
 		lcd_draw_func = lcd_status_func;
+		lcd_clk_switch();
+	}
 }
 
 static void __not_in_flash_func(lcd_draw_empty)(bool first)
@@ -254,35 +986,173 @@ static void __not_in_flash_func(lcd_draw_empty)(bool first)
  *	displays except memory:
  *
  *	xx.xx °C   o    xxx.xx MHz
+ *
+ *	With the performance info on, it changes every LCD_PERF_SECS
+ *	seconds to the utilization of core 0 by the CPU emulation, the
+ *	longest LCD frame time, the MicroSD operations per second and
+ *	the CPU clock counted from the T states, and back:
+ *
+ *	core 0 xxx%  LCD xx.x ms
+ *	SD xxxxx/s    xxx.xx MHz
  */
 
+#ifndef LCD_PERF_SECS
+#define LCD_PERF_SECS 2
+#endif
+
+static void __not_in_flash_func(lcd_draw_info_static)(font_t *font)
+{
+	const uint16_t w = font->width;
+	const uint16_t n = draw_pixmap->width / w;
+	const uint16_t x = (draw_pixmap->width - n * w) / 2;
+	const uint16_t y = draw_pixmap->height - font->height;
+	register int i;
+
+	for (i = 0; i < n; i++)
+		draw_char(i * w + x, y, ' ', font, C_ORANGE, C_DKBLUE);
+
+	/* draw temperature text */
+	draw_char(2 * w + x, y, '.', font, C_ORANGE, C_DKBLUE);
+	draw_char(6 * w + x, y, '\007', font, C_ORANGE, C_DKBLUE);
+	draw_char(7 * w + x, y, 'C', font, C_ORANGE, C_DKBLUE);
+
+	/* draw frequency text */
+	draw_char((n - 7) * w + x, y, '.', font, C_ORANGE, C_DKBLUE);
+	draw_char((n - 3) * w + x, y, 'M', font, C_ORANGE, C_DKBLUE);
+	draw_char((n - 2) * w + x, y, 'H', font, C_ORANGE, C_DKBLUE);
+	draw_char((n - 1) * w + x, y, 'z', font, C_ORANGE, C_DKBLUE);
+
+	/* draw the RGB LED bracket */
+	draw_led_bracket(11 * w + x, y + (font->height - 10) / 2);
+}
+
+/*
+ *	Pages of the performance info, with CPU_BUDGET two more for
+ *	the share of the subsystems in the time of core 0, with LATPROF80
+ *	two more for the bank switches and the interrupts.
+ */
+#if CPU_BUDGET
+#define LCD_PERF_BUDGET	2
+static unsigned lcd_budget_pct[BUDGETS]; /* shares of the last second */
+#else
+#define LCD_PERF_BUDGET	0
+#endif
+#if LATPROF80
+#define LCD_PERF_LAT	2
+#define LCD_PAGE_LAT	(3 + LCD_PERF_BUDGET)
+/* bank switches, interrupts per second, their latency, % disabled */
+static unsigned lcd_lat_sw, lcd_lat_irqs, lcd_lat_avg, lcd_lat_di;
+
+/*
+ *	Take the counters of the profiler for the last second.
+ */
+static void __not_in_flash_func(lcd_lat_update)(uint64_t us)
+{
+	static uint32_t last_sw, last_irqs, last_ticks, last_di;
+	static uint64_t last_lat;
+	uint32_t sw = latprof.switches, irqs = latprof.irqs;
+	uint32_t ticks = latprof.ticks, di = latprof.di_ticks;
+	uint64_t lat = latprof.lat_T;
+
+	if (us) {
+		lcd_lat_sw = (unsigned) ((sw - last_sw) * 1000000ULL / us);
+		lcd_lat_irqs = (unsigned) ((irqs - last_irqs) * 1000000ULL
+					   / us);
+	}
+	lcd_lat_avg = irqs != last_irqs ?
+		      (unsigned) ((lat - last_lat) / (irqs - last_irqs)) : 0;
+	lcd_lat_di = ticks != last_ticks ?
+		     (unsigned) ((di - last_di) * 100ULL / (ticks - last_ticks))
+		     : 0;
+	last_sw = sw;
+	last_irqs = irqs;
+	last_ticks = ticks;
+	last_di = di;
+	last_lat = lat;
+}
+#else
+#define LCD_PERF_LAT	0
+#endif
+#define LCD_PERF_PAGES	(3 + LCD_PERF_BUDGET + LCD_PERF_LAT)
+
+/*
+ *	Draw a performance page, the counters are the deltas of the
+ *	last second.
+ */
+static void __not_in_flash_func(lcd_draw_info_perf)(font_t *font, int page,
+						    uint64_t us, uint64_t slept,
+						    Tstates_t t, uint32_t ops)
+{
+	char buf[48];
+	unsigned util, clk;
+	const uint16_t w = font->width;
+	const uint16_t n = draw_pixmap->width / w;
+	const uint16_t x = (draw_pixmap->width - n * w) / 2;
+	const uint16_t y = draw_pixmap->height - font->height;
+
+	if (us == 0)
+		return;
+
+	if (page == 1) {
+		util = slept >= us ? 0 : (unsigned) (100 - slept * 100 / us);
+		snprintf(buf, sizeof(buf), "core 0 %3u%%%*sLCD %2u.%u ms",
+			 util, n - 22, "",
+			 (unsigned) (lcd_frame_us / 1000 % 100),
+			 (unsigned) (lcd_frame_us / 100 % 10));
+#if CPU_BUDGET
+	} else if (page == 3) {
+		snprintf(buf, sizeof(buf), "CPU %3u%% I/O %2u%% SD %2u%%",
+			 lcd_budget_pct[BUDGET_CPU],
+			 lcd_budget_pct[BUDGET_IO],
+			 lcd_budget_pct[BUDGET_DISK]);
+	} else if (page == 4) {
+		snprintf(buf, sizeof(buf), "USB %2u%%%*stimer %2u%%",
+			 lcd_budget_pct[BUDGET_USB], n - 17, "",
+			 lcd_budget_pct[BUDGET_ALARM]);
+#endif
+#if LATPROF80
+	} else if (page == LCD_PAGE_LAT) {
+		snprintf(buf, sizeof(buf), "MMU %5u/s%*sDI %3u%%",
+			 lcd_lat_sw % 100000, n - 18, "", lcd_lat_di);
+	} else if (page == LCD_PAGE_LAT + 1) {
+		snprintf(buf, sizeof(buf), "IRQ %5u/s%*s%5u T",
+			 lcd_lat_irqs % 100000, n - 18, "",
+			 lcd_lat_avg % 100000);
+#endif
+	} else {
+		clk = (unsigned) (t * 100 / us);
+		snprintf(buf, sizeof(buf), "SD %5u/s%*s%3u.%02u MHz",
+			 (unsigned) (ops * 1000000ULL / us % 100000),
+			 n - 20, "", clk / 100 % 1000, clk % 100);
+	}
+	buf[n < sizeof(buf) ? n : sizeof(buf) - 1] = '\0';
+	draw_string(x, y, buf, font, C_ORANGE, C_DKBLUE);
+}
+
 static void __not_in_flash_func(lcd_draw_info)(font_t *font, bool first)
 {
 	char c;
 	int i, f, temp, digit;
 	bool onlyz;
+	uint32_t ops;
+	uint64_t now;
 	const uint16_t w = font->width;
 	const uint16_t n = draw_pixmap->width / w;
 	const uint16_t x = (draw_pixmap->width - n * w) / 2;
 	const uint16_t y = draw_pixmap->height - font->height;
-	static uint32_t last_upd;
+	static uint32_t last_upd, last_ops, secs;
+	static uint64_t last_us, last_slept;
+	static Tstates_t last_T;
+	static int page;
+#if CPU_BUDGET
+	static uint64_t last_budget[BUDGETS];
+	uint64_t d[BUDGETS], total;
+#endif
 
 	if (first) {
 		/* draw static content */
-
-		/* draw temperature text */
-		draw_char(2 * w + x, y, '.', font, C_ORANGE, C_DKBLUE);
-		draw_char(6 * w + x, y, '\007', font, C_ORANGE, C_DKBLUE);
-		draw_char(7 * w + x, y, 'C', font, C_ORANGE, C_DKBLUE);
-
-		/* draw frequency text */
-		draw_char((n - 7) * w + x, y, '.', font, C_ORANGE, C_DKBLUE);
-		draw_char((n - 3) * w + x, y, 'M', font, C_ORANGE, C_DKBLUE);
-		draw_char((n - 2) * w + x, y, 'H', font, C_ORANGE, C_DKBLUE);
-		draw_char((n - 1) * w + x, y, 'z', font, C_ORANGE, C_DKBLUE);
-
-		/* draw the RGB LED bracket */
-		draw_led_bracket(11 * w + x, y + (font->height - 10) / 2);
+		lcd_draw_info_static(font);
+		page = 0;
 
 		/* force update */
 		last_upd = lcd_frame_cnt - LCD_REFRESH + 1;
@@ -293,6 +1163,49 @@ static void __not_in_flash_func(lcd_draw_info)(font_t *font, bool first)
 		if (lcd_frame_cnt - last_upd >= LCD_REFRESH) {
 			last_upd = lcd_frame_cnt;
 
+			/* take the performance counters */
+			now = time_us_64();
+			for (ops = 0, i = 0; i < NUMDISK; i++)
+				ops += disk_stats[i].reads +
+				       disk_stats[i].writes;
+			if (++secs % LCD_PERF_SECS == 0) {
+				if (lcd_perf)
+					i = (page + 1) % LCD_PERF_PAGES;
+				else
+					i = 0;
+				if (i == 0 && page != 0)
+					lcd_draw_info_static(font);
+				page = i;
+			}
+#if CPU_BUDGET
+			for (total = 0, i = 0; i < BUDGETS; i++) {
+				d[i] = lcd_cpu.budget[i] - last_budget[i];
+				last_budget[i] = lcd_cpu.budget[i];
+				total += d[i];
+			}
+			/* two digits for the subsystems, 100% is CPU only */
+			for (i = 0; i < BUDGETS; i++) {
+				f = total ? (int) (d[i] * 100 / total) : 0;
+				lcd_budget_pct[i] = i != BUDGET_CPU && f > 99 ?
+						    99 : f;
+			}
+#endif
+#if LATPROF80
+			lcd_lat_update(now - last_us);
+#endif
+			if (page)
+				lcd_draw_info_perf(font, page, now - last_us,
+						   lcd_cpu.slept - last_slept,
+						   lcd_cpu.T - last_T,
+						   ops - last_ops);
+			last_us = now;
+			last_slept = lcd_cpu.slept;
+			last_T = lcd_cpu.T;
+			last_ops = ops;
+			lcd_frame_us = 0;
+			if (page)
+				return;
+
 			/* read the onboard temperature sensor */
 			temp = (int) (read_onboard_temp() * 100.0f + 0.5f);
 
@@ -330,8 +1243,9 @@ static void __not_in_flash_func(lcd_draw_info)(font_t *font, bool first)
 		}
 
 		/* update the RGB LED */
-		draw_led(11 * w + x, y + (font->height - 10) / 2,
-			 lcd_led_color);
+		if (page == 0)
+			draw_led(11 * w + x, y + (font->height - 10) / 2,
+				 lcd_led_color);
 	}
 }
 
@@ -385,26 +1299,26 @@ typedef struct reg {
 #define SPC20	3	/* vertical text spacing for font20 */
 
 static const reg_t __not_in_flash("lcd_tables") regs_z80[] = {
-	{  4, 0, RB, "AF",   .b.p = &A },
-	{  6, 0, RJ, NULL,   .i.p = &F },
-	{ 12, 0, RB, "BC",   .b.p = &B },
-	{ 14, 0, RB, NULL,   .b.p = &C },
-	{ 20, 0, RB, "DE",   .b.p = &D },
-	{ 22, 0, RB, NULL,   .b.p = &E },
-	{  4, 1, RB, "HL",   .b.p = &H },
-	{  6, 1, RB, NULL,   .b.p = &L },
-	{ 14, 1, RW, "SP",   .w.p = &SP },
-	{ 22, 1, RW, "PC",   .w.p = &PC },
-	{  4, 2, RB, "AF\'", .b.p = &A_ },
-	{  6, 2, RJ, NULL,   .i.p = &F_ },
-	{ 12, 2, RB, "BC\'", .b.p = &B_ },
-	{ 14, 2, RB, NULL,   .b.p = &C_ },
-	{ 20, 2, RB, "DE\'", .b.p = &D_ },
-	{ 22, 2, RB, NULL,   .b.p = &E_ },
-	{  4, 3, RB, "HL\'", .b.p = &H_ },
-	{  6, 3, RB, NULL,   .b.p = &L_ },
-	{ 14, 3, RW, "IX",   .w.p = &IX },
-	{ 22, 3, RW, "IY",   .w.p = &IY },
+	{  4, 0, RB, "AF",   .b.p = &lcd_cpu.A },
+	{  6, 0, RJ, NULL,   .i.p = &lcd_cpu.F },
+	{ 12, 0, RB, "BC",   .b.p = &lcd_cpu.B },
+	{ 14, 0, RB, NULL,   .b.p = &lcd_cpu.C },
+	{ 20, 0, RB, "DE",   .b.p = &lcd_cpu.D },
+	{ 22, 0, RB, NULL,   .b.p = &lcd_cpu.E },
+	{  4, 1, RB, "HL",   .b.p = &lcd_cpu.H },
+	{  6, 1, RB, NULL,   .b.p = &lcd_cpu.L },
+	{ 14, 1, RW, "SP",   .w.p = &lcd_cpu.SP },
+	{ 22, 1, RW, "PC",   .w.p = &lcd_cpu.PC },
+	{  4, 2, RB, "AF\'", .b.p = &lcd_cpu.A_ },
+	{  6, 2, RJ, NULL,   .i.p = &lcd_cpu.F_ },
+	{ 12, 2, RB, "BC\'", .b.p = &lcd_cpu.B_ },
+	{ 14, 2, RB, NULL,   .b.p = &lcd_cpu.C_ },
+	{ 20, 2, RB, "DE\'", .b.p = &lcd_cpu.D_ },
+	{ 22, 2, RB, NULL,   .b.p = &lcd_cpu.E_ },
+	{  4, 3, RB, "HL\'", .b.p = &lcd_cpu.H_ },
+	{  6, 3, RB, NULL,   .b.p = &lcd_cpu.L_ },
+	{ 14, 3, RW, "IX",   .w.p = &lcd_cpu.IX },
+	{ 22, 3, RW, "IY",   .w.p = &lcd_cpu.IY },
 	{  3, 4, RF, NULL,   .f.c = 'S', .f.m = S_FLAG },
 	{  4, 4, RF, "F",    .f.c = 'Z', .f.m = Z_FLAG },
 	{  5, 4, RF, NULL,   .f.c = 'H', .f.m = H_FLAG },
@@ -413,7 +1327,7 @@ static const reg_t __not_in_flash("lcd_tables") regs_z80[] = {
 	{  8, 4, RF, NULL,   .f.c = 'C', .f.m = C_FLAG },
 	{ 13, 4, RI, NULL,   .f.c = '1', .f.m = 1 },
 	{ 14, 4, RI, "IF",   .f.c = '2', .f.m = 2 },
-	{ 20, 4, RB, "IR",   .b.p = &I },
+	{ 20, 4, RB, "IR",   .b.p = &lcd_cpu.I },
 	{ 22, 4, RR, NULL,   .b.p = NULL }
 };
 static const int num_regs_z80 = sizeof(regs_z80) / sizeof(reg_t);
@@ -427,16 +1341,16 @@ static const int num_regs_z80 = sizeof(regs_z80) / sizeof(reg_t);
 #define SPC28	1	/* vertical text spacing for font28 */
 
 static const reg_t __not_in_flash("lcd_tables") regs_8080[] = {
-	{  4, 0, RB, "AF", .b.p = &A },
-	{  6, 0, RJ, NULL, .i.p = &F },
-	{ 13, 0, RB, "BC", .b.p = &B },
-	{ 15, 0, RB, NULL, .b.p = &C },
-	{  4, 1, RB, "DE", .b.p = &D },
-	{  6, 1, RB, NULL, .b.p = &E },
-	{ 13, 1, RB, "HL", .b.p = &H },
-	{ 15, 1, RB, NULL, .b.p = &L },
-	{  6, 2, RW, "SP", .w.p = &SP },
-	{ 15, 2, RW, "PC", .w.p = &PC },
+	{  4, 0, RB, "AF", .b.p = &lcd_cpu.A },
+	{  6, 0, RJ, NULL, .i.p = &lcd_cpu.F },
+	{ 13, 0, RB, "BC", .b.p = &lcd_cpu.B },
+	{ 15, 0, RB, NULL, .b.p = &lcd_cpu.C },
+	{  4, 1, RB, "DE", .b.p = &lcd_cpu.D },
+	{  6, 1, RB, NULL, .b.p = &lcd_cpu.E },
+	{ 13, 1, RB, "HL", .b.p = &lcd_cpu.H },
+	{ 15, 1, RB, NULL, .b.p = &lcd_cpu.L },
+	{  6, 2, RW, "SP", .w.p = &lcd_cpu.SP },
+	{ 15, 2, RW, "PC", .w.p = &lcd_cpu.PC },
 	{  3, 3, RF, NULL, .f.c = 'S', .f.m = S_FLAG },
 	{  4, 3, RF, "F",  .f.c = 'Z', .f.m = Z_FLAG },
 	{  5, 3, RF, NULL, .f.c = 'H', .f.m = H_FLAG },
@@ -448,6 +1362,16 @@ static const int num_regs_8080 = sizeof(regs_8080) / sizeof(reg_t);
 
 #endif /* !EXCLUDE_I8080 */
 
+/*
+ *	The values last drawn, so that only the fields of registers and
+ *	flags that changed are drawn again. The Z80 has more registers.
+ */
+#ifndef EXCLUDE_Z80
+#define MAX_REGS (sizeof(regs_z80) / sizeof(reg_t))
+#else
+#define MAX_REGS (sizeof(regs_8080) / sizeof(reg_t))
+#endif
+
 static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 {
 	char c;
@@ -458,6 +1382,7 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 	const reg_t *rp = NULL;
 	static int cpu_type;
 	static draw_grid_t grid;
+	static int32_t drawn[MAX_REGS];
 
 	/* redraw static content if new CPU type */
 	if (cpu_type != cpu) {
@@ -481,16 +1406,30 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 #endif
 
 	if (first) {
+		/* setup text grid */
+#ifndef EXCLUDE_Z80
+		if (cpu_type == Z80)
+			draw_setup_grid(&grid, XOFF20, YOFF20, -1, 5, &font20,
+					SPC20);
+#endif
+#ifndef EXCLUDE_I8080
+		if (cpu_type == I8080)
+			draw_setup_grid(&grid, XOFF28, YOFF28, -1, 4, &font28,
+					SPC28);
+#endif
+		/* nothing drawn yet */
+		for (i = 0; i < (int) MAX_REGS; i++)
+			drawn[i] = -1;
+	}
+
+	if (first && !lcd_bg_restore(lcd_draw_cpu_reg, cpu_type)) {
 		/* draw static content */
 
 		draw_clear(C_DKBLUE);
 
-		/* setup text grid and draw grid lines */
+		/* draw grid lines */
 #ifndef EXCLUDE_Z80
 		if (cpu_type == Z80) {
-			draw_setup_grid(&grid, XOFF20, YOFF20, -1, 5, &font20,
-					SPC20);
-
 			/* draw vertical grid lines */
 			draw_grid_vline(7, 0, 4, &grid, C_DKYELLOW);
 			draw_grid_vline(10, 4, 1, &grid, C_DKYELLOW);
@@ -503,9 +1442,6 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 #endif
 #ifndef EXCLUDE_I8080
 		if (cpu_type == I8080) {
-			draw_setup_grid(&grid, XOFF28, YOFF28, -1, 4, &font28,
-					SPC28);
-
 			/* draw vertical grid line */
 			draw_grid_vline(8, 0, 4, &grid, C_DKYELLOW);
 			/* draw horizontal grid lines */
@@ -524,7 +1460,9 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 					draw_grid_char(x++, rp->y, *s++, &grid,
 						       C_WHITE, C_DKBLUE);
 			}
-	} else {
+
+		lcd_bg_save(lcd_draw_cpu_reg, cpu_type);
+	} else if (!first) {
 		/* draw dynamic content */
 
 		/* draw register contents */
@@ -543,24 +1481,33 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 				j = 2;
 				break;
 			case RF: /* flags */
+				w = (lcd_cpu.F & rp->f.m) != 0;
+				if (drawn[i] == w)
+					continue;
+				drawn[i] = w;
 				draw_grid_char(rp->x, rp->y, rp->f.c, &grid,
-					       (F & rp->f.m) ? C_GREEN : C_RED,
-					       C_DKBLUE);
+					       w ? C_GREEN : C_RED, C_DKBLUE);
 				continue;
 			case RI: /* interrupt register */
+				w = (lcd_cpu.IFF & rp->f.m) == rp->f.m;
+				if (drawn[i] == w)
+					continue;
+				drawn[i] = w;
 				draw_grid_char(rp->x, rp->y, rp->f.c, &grid,
-					       (IFF & rp->f.m) == rp->f.m ?
-					       C_GREEN : C_RED, C_DKBLUE);
+					       w ? C_GREEN : C_RED, C_DKBLUE);
 				continue;
 #ifndef EXCLUDE_Z80
 			case RR: /* refresh register */
-				w = (R_ & 0x80) | (R & 0x7f);
+				w = (lcd_cpu.R_ & 0x80) | (lcd_cpu.R & 0x7f);
 				j = 2;
 				break;
 #endif
 			default:
 				continue;
 			}
+			if (drawn[i] == w)
+				continue;
+			drawn[i] = w;
 			x = rp->x;
 			while (j--) {
 				c = w & 0xf;
@@ -588,49 +1535,101 @@ static void __not_in_flash_func(lcd_draw_cpu_reg)(bool first)
 #define MEM_YOFF 0	/* memory display y offset */
 #define MEM_BRDR 3	/* free space around and between pixel blocks */
 
+#if MEM_DIRTY
+/*
+ *	check if one of the n pages starting with page pg changed since the
+ *	last call, a column of the memory display shows 2 pages
+ */
+static inline bool lcd_mem_changed(int pg, int n)
+{
+	bool changed = false;
+
+	while (n--) {
+		if (page_dirty[pg].user[DIRTY_LCD]) {
+			page_dirty[pg].user[DIRTY_LCD] = 0;
+			changed = true;
+		}
+		pg++;
+	}
+	return changed;
+}
+#endif
+
 static void __not_in_flash_func(lcd_draw_memory)(bool first)
 {
 	int x, y;
 	const uint32_t *p;
+#if MEM_DIRTY
+	int i;
+#endif
 
 	if (first) {
-		/* draw static content */
-
-		draw_clear(C_DKBLUE);
-
-		draw_hline(MEM_XOFF, MEM_YOFF, 128 + 96 + 4 * MEM_BRDR - 1,
-			   C_GREEN);
-		draw_hline(MEM_XOFF, MEM_YOFF + 128 + 2 * MEM_BRDR - 1,
-			   128 + 96 + 4 * MEM_BRDR - 1, C_GREEN);
-		draw_vline(MEM_XOFF, MEM_YOFF, 128 + 2 * MEM_BRDR, C_GREEN);
-		draw_vline(MEM_XOFF + 128 + 2 * MEM_BRDR - 1, 0,
-			   128 + 2 * MEM_BRDR, C_GREEN);
-		draw_vline(MEM_XOFF + 128 + 96 + 4 * MEM_BRDR - 2, 0,
-			   128 + 2 * MEM_BRDR, C_GREEN);
+		if (!lcd_bg_restore(lcd_draw_memory, 0)) {
+			/* draw static content */
+
+			draw_clear(C_DKBLUE);
+
+			draw_hline(MEM_XOFF, MEM_YOFF,
+				   128 + 96 + 4 * MEM_BRDR - 1, C_GREEN);
+			draw_hline(MEM_XOFF, MEM_YOFF + 128 + 2 * MEM_BRDR - 1,
+				   128 + 96 + 4 * MEM_BRDR - 1, C_GREEN);
+			draw_vline(MEM_XOFF, MEM_YOFF, 128 + 2 * MEM_BRDR,
+				   C_GREEN);
+			draw_vline(MEM_XOFF + 128 + 2 * MEM_BRDR - 1, 0,
+				   128 + 2 * MEM_BRDR, C_GREEN);
+			draw_vline(MEM_XOFF + 128 + 96 + 4 * MEM_BRDR - 2, 0,
+				   128 + 2 * MEM_BRDR, C_GREEN);
+
+			lcd_bg_save(lcd_draw_memory, 0);
+		}
+#if MEM_DIRTY
+		/* draw everything in the next frame */
+		for (i = 0; i < NUMPHYS; i++)
+			page_dirty[i].user[DIRTY_LCD] = 1;
+#endif
 	} else {
-		/* draw dynamic content */
+		/* draw dynamic content, only the changed columns */
 
 		p = (uint32_t *) bnk0;
 		for (x = MEM_XOFF + MEM_BRDR;
 		     x < MEM_XOFF + MEM_BRDR + 128; x++) {
+#if MEM_DIRTY
+			i = (x - MEM_XOFF - MEM_BRDR) * 2;
+			if (!lcd_mem_changed(i, 2)) {
+				p += 128;
+				continue;
+			}
+#endif
 			for (y = MEM_YOFF + MEM_BRDR;
 			     y < MEM_YOFF + MEM_BRDR + 128; y++) {
 				/* constant = 2^32 / ((1 + sqrt(5)) / 2) */
 #if COLOR_DEPTH == 12
 				draw_pixel(x, y, (*p++ * 2654435769U) >> 20);
+#elif COLOR_DEPTH == 8
+				draw_pixel(x, y, (*p++ * 2654435769U) >> 24);
 #else
 				draw_pixel(x, y, (*p++ * 2654435769U) >> 16);
 #endif
 			}
 		}
 
-		p = (uint32_t *) bnks[0];
+		p = (uint32_t *) bnks;
 		for (x = MEM_XOFF + 3 * MEM_BRDR - 1 + 128;
 		     x < MEM_XOFF + 3 * MEM_BRDR - 1 + 128 + 96; x++) {
+#if MEM_DIRTY
+			i = 65536 / PAGESIZ +
+			    (x - MEM_XOFF - 3 * MEM_BRDR + 1 - 128) * 2;
+			if (!lcd_mem_changed(i, 2)) {
+				p += 128;
+				continue;
+			}
+#endif
 			for (y = MEM_YOFF + MEM_BRDR;
 			     y < MEM_YOFF + MEM_BRDR + 128; y++) {
 #if COLOR_DEPTH == 12
 				draw_pixel(x, y, (*p++ * 2654435769U) >> 20);
+#elif COLOR_DEPTH == 8
+				draw_pixel(x, y, (*p++ * 2654435769U) >> 24);
 #else
 				draw_pixel(x, y, (*p++ * 2654435769U) >> 16);
 #endif
@@ -639,6 +1638,108 @@ static void __not_in_flash_func(lcd_draw_memory)(bool first)
 	}
 }
 
+#if MEM_HEAT
+
+/*
+ *	Memory heat map display:
+ *
+ *	Shows the sampled accesses of every page of bank 0 and of the
+ *	banks, 64 pages in a row and every bank in its own rows. Reads
+ *	are green, writes red and the instruction stream blue, brighter
+ *	with more accesses. The counters decay with every frame drawn.
+ */
+
+#define HEAT_XOFF	16		/* x offset, bank numbers left of it */
+#define HEAT_CELLW	3		/* width of a page */
+#define HEAT_ROW	64		/* pages in a row */
+#define HEAT_MAXH	8		/* max. height of a row */
+
+/* 0 - 15 for a counter, one step for each power of 2 */
+static inline uint16_t lcd_heat_level(BYTE h)
+{
+	return h ? (32 - __builtin_clz(h)) * 2 - 1 : 0;
+}
+
+/* a counter for the heat color and its decay */
+static inline uint16_t lcd_heat_decay(int kind, int p)
+{
+	BYTE h = mem_heat[kind][p];
+
+	mem_heat[kind][p] = h - ((h + 7) >> 3);
+	return lcd_heat_level(h);
+}
+
+static void __not_in_flash_func(lcd_draw_heat)(bool first)
+{
+	static int nsec, sec_start[MAXSEG + 1], sec_pages[MAXSEG + 1];
+	static uint16_t sec_y[MAXSEG + 1], rowh;
+	int s, i, j, p, rows;
+	uint16_t r, g, b, col;
+	char label[3];
+
+	if (first) {
+		/* bank 0 and the banks which are in bnks */
+
+		sec_start[0] = 0;
+		sec_pages[0] = 65536 / PAGESIZ;
+		rows = sec_pages[0] / HEAT_ROW;
+		for (nsec = 1; nsec <= numseg; nsec++) {
+			sec_start[nsec] = 65536 / PAGESIZ +
+				(nsec - 1) * (int) (segsiz / PAGESIZ);
+			sec_pages[nsec] = segsiz / PAGESIZ;
+			if (sec_start[nsec] + sec_pages[nsec] > NUMPHYS)
+				break;
+			rows += (sec_pages[nsec] + HEAT_ROW - 1) / HEAT_ROW;
+		}
+
+		/* the banks are one pixel apart */
+		rowh = (draw_pixmap->height - (nsec - 1)) / rows;
+		if (rowh > HEAT_MAXH)
+			rowh = HEAT_MAXH;
+
+		draw_clear(C_BLACK);
+		sec_y[0] = 0;
+		for (s = 0; s < nsec; s++) {
+			rows = (sec_pages[s] + HEAT_ROW - 1) / HEAT_ROW;
+			if (s + 1 <= MAXSEG)
+				sec_y[s + 1] = sec_y[s] + rows * rowh + 1;
+			/* the bank number if there is room for it */
+			if (rows * rowh >= font12.height) {
+				snprintf(label, sizeof(label), "%d", s);
+				draw_string(0, sec_y[s], label, &font12,
+					    C_WHITE, C_BLACK);
+			}
+		}
+	} else {
+		/* draw dynamic content */
+
+		for (s = 0; s < nsec; s++)
+			for (i = 0; i < sec_pages[s]; i++) {
+				p = sec_start[s] + i;
+				r = lcd_heat_decay(HEAT_WRITE, p);
+				g = lcd_heat_decay(HEAT_READ, p);
+				b = lcd_heat_decay(HEAT_EXEC, p);
+#if COLOR_DEPTH == 12
+				col = (r << 8) | (g << 4) | b;
+#elif COLOR_DEPTH == 8
+				col = ((r >> 1) << 5) | ((g >> 1) << 2) |
+				      (b >> 2);
+#else
+				col = (((r << 1) | (r >> 3)) << 11) |
+				      (((g << 2) | (g >> 2)) << 5) |
+				      ((b << 1) | (b >> 3));
+#endif
+				for (j = 0; j < rowh; j++)
+					draw_hspan(HEAT_XOFF + (i % HEAT_ROW) *
+						   HEAT_CELLW,
+						   sec_y[s] + (i / HEAT_ROW) *
+						   rowh + j, HEAT_CELLW, col);
+			}
+	}
+}
+
+#endif /* MEM_HEAT */
+
 #ifdef SIMPLEPANEL
 
 /*
@@ -703,50 +1804,50 @@ typedef struct led {
 } led_t;
 
 static const led_t __not_in_flash("lcd_tables") leds[] = {
-	{ LX( 0), LY(0), 'P', '7', LB, .b.i = 0xff, .b.m = 0x80, .b.p = &fp_led_output },
-	{ LX( 1), LY(0), 'P', '6', LB, .b.i = 0xff, .b.m = 0x40, .b.p = &fp_led_output },
-	{ LX( 2), LY(0), 'P', '5', LB, .b.i = 0xff, .b.m = 0x20, .b.p = &fp_led_output },
-	{ LX( 3), LY(0), 'P', '4', LB, .b.i = 0xff, .b.m = 0x10, .b.p = &fp_led_output },
-	{ LX( 4), LY(0), 'P', '3', LB, .b.i = 0xff, .b.m = 0x08, .b.p = &fp_led_output },
-	{ LX( 5), LY(0), 'P', '2', LB, .b.i = 0xff, .b.m = 0x04, .b.p = &fp_led_output },
-	{ LX( 6), LY(0), 'P', '1', LB, .b.i = 0xff, .b.m = 0x02, .b.p = &fp_led_output },
-	{ LX( 7), LY(0), 'P', '0', LB, .b.i = 0xff, .b.m = 0x01, .b.p = &fp_led_output },
-	{ LX(12), LY(0), 'I', 'E', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &IFF },
-	{ LX(13), LY(0), 'R', 'U', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &cpu_state },
+	{ LX( 0), LY(0), 'P', '7', LB, .b.i = 0xff, .b.m = 0x80, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 1), LY(0), 'P', '6', LB, .b.i = 0xff, .b.m = 0x40, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 2), LY(0), 'P', '5', LB, .b.i = 0xff, .b.m = 0x20, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 3), LY(0), 'P', '4', LB, .b.i = 0xff, .b.m = 0x10, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 4), LY(0), 'P', '3', LB, .b.i = 0xff, .b.m = 0x08, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 5), LY(0), 'P', '2', LB, .b.i = 0xff, .b.m = 0x04, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 6), LY(0), 'P', '1', LB, .b.i = 0xff, .b.m = 0x02, .b.p = &lcd_cpu.fp_led_output },
+	{ LX( 7), LY(0), 'P', '0', LB, .b.i = 0xff, .b.m = 0x01, .b.p = &lcd_cpu.fp_led_output },
+	{ LX(12), LY(0), 'I', 'E', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &lcd_cpu.IFF },
+	{ LX(13), LY(0), 'R', 'U', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &lcd_cpu.cpu_state },
 	{ LX(14), LY(0), 'W', 'A', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &fp_led_wait },
-	{ LX(15), LY(0), 'H', 'O', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &bus_request },
-	{ LX( 0), LY(1), 'M', 'R', LB, .b.i = 0x00, .b.m = 0x80, .b.p = &cpu_bus },
-	{ LX( 1), LY(1), 'I', 'P', LB, .b.i = 0x00, .b.m = 0x40, .b.p = &cpu_bus },
-	{ LX( 2), LY(1), 'M', '1', LB, .b.i = 0x00, .b.m = 0x20, .b.p = &cpu_bus },
-	{ LX( 3), LY(1), 'O', 'P', LB, .b.i = 0x00, .b.m = 0x10, .b.p = &cpu_bus },
-	{ LX( 4), LY(1), 'H', 'A', LB, .b.i = 0x00, .b.m = 0x08, .b.p = &cpu_bus },
-	{ LX( 5), LY(1), 'S', 'T', LB, .b.i = 0x00, .b.m = 0x04, .b.p = &cpu_bus },
-	{ LX( 6), LY(1), 'W', 'O', LB, .b.i = 0x00, .b.m = 0x02, .b.p = &cpu_bus },
-	{ LX( 7), LY(1), 'I', 'A', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &cpu_bus },
-	{ LX( 8), LY(1), 'D', '7', LB, .b.i = 0x00, .b.m = 0x80, .b.p = &fp_led_data },
-	{ LX( 9), LY(1), 'D', '6', LB, .b.i = 0x00, .b.m = 0x40, .b.p = &fp_led_data },
-	{ LX(10), LY(1), 'D', '5', LB, .b.i = 0x00, .b.m = 0x20, .b.p = &fp_led_data },
-	{ LX(11), LY(1), 'D', '4', LB, .b.i = 0x00, .b.m = 0x10, .b.p = &fp_led_data },
-	{ LX(12), LY(1), 'D', '3', LB, .b.i = 0x00, .b.m = 0x08, .b.p = &fp_led_data },
-	{ LX(13), LY(1), 'D', '2', LB, .b.i = 0x00, .b.m = 0x04, .b.p = &fp_led_data },
-	{ LX(14), LY(1), 'D', '1', LB, .b.i = 0x00, .b.m = 0x02, .b.p = &fp_led_data },
-	{ LX(15), LY(1), 'D', '0', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &fp_led_data },
-	{ LX( 0), LY(2), '1', '5', LW, .w.m = 0x8000, .w.p = &fp_led_address },
-	{ LX( 1), LY(2), '1', '4', LW, .w.m = 0x4000, .w.p = &fp_led_address },
-	{ LX( 2), LY(2), '1', '3', LW, .w.m = 0x2000, .w.p = &fp_led_address },
-	{ LX( 3), LY(2), '1', '2', LW, .w.m = 0x1000, .w.p = &fp_led_address },
-	{ LX( 4), LY(2), '1', '1', LW, .w.m = 0x0800, .w.p = &fp_led_address },
-	{ LX( 5), LY(2), '1', '0', LW, .w.m = 0x0400, .w.p = &fp_led_address },
-	{ LX( 6), LY(2), 'A', '9', LW, .w.m = 0x0200, .w.p = &fp_led_address },
-	{ LX( 7), LY(2), 'A', '8', LW, .w.m = 0x0100, .w.p = &fp_led_address },
-	{ LX( 8), LY(2), 'A', '7', LW, .w.m = 0x0080, .w.p = &fp_led_address },
-	{ LX( 9), LY(2), 'A', '6', LW, .w.m = 0x0040, .w.p = &fp_led_address },
-	{ LX(10), LY(2), 'A', '5', LW, .w.m = 0x0020, .w.p = &fp_led_address },
-	{ LX(11), LY(2), 'A', '4', LW, .w.m = 0x0010, .w.p = &fp_led_address },
-	{ LX(12), LY(2), 'A', '3', LW, .w.m = 0x0008, .w.p = &fp_led_address },
-	{ LX(13), LY(2), 'A', '2', LW, .w.m = 0x0004, .w.p = &fp_led_address },
-	{ LX(14), LY(2), 'A', '1', LW, .w.m = 0x0002, .w.p = &fp_led_address },
-	{ LX(15), LY(2), 'A', '0', LW, .w.m = 0x0001, .w.p = &fp_led_address }
+	{ LX(15), LY(0), 'H', 'O', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &lcd_cpu.bus_request },
+	{ LX( 0), LY(1), 'M', 'R', LB, .b.i = 0x00, .b.m = 0x80, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 1), LY(1), 'I', 'P', LB, .b.i = 0x00, .b.m = 0x40, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 2), LY(1), 'M', '1', LB, .b.i = 0x00, .b.m = 0x20, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 3), LY(1), 'O', 'P', LB, .b.i = 0x00, .b.m = 0x10, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 4), LY(1), 'H', 'A', LB, .b.i = 0x00, .b.m = 0x08, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 5), LY(1), 'S', 'T', LB, .b.i = 0x00, .b.m = 0x04, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 6), LY(1), 'W', 'O', LB, .b.i = 0x00, .b.m = 0x02, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 7), LY(1), 'I', 'A', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &lcd_cpu.cpu_bus },
+	{ LX( 8), LY(1), 'D', '7', LB, .b.i = 0x00, .b.m = 0x80, .b.p = &lcd_cpu.fp_led_data },
+	{ LX( 9), LY(1), 'D', '6', LB, .b.i = 0x00, .b.m = 0x40, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(10), LY(1), 'D', '5', LB, .b.i = 0x00, .b.m = 0x20, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(11), LY(1), 'D', '4', LB, .b.i = 0x00, .b.m = 0x10, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(12), LY(1), 'D', '3', LB, .b.i = 0x00, .b.m = 0x08, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(13), LY(1), 'D', '2', LB, .b.i = 0x00, .b.m = 0x04, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(14), LY(1), 'D', '1', LB, .b.i = 0x00, .b.m = 0x02, .b.p = &lcd_cpu.fp_led_data },
+	{ LX(15), LY(1), 'D', '0', LB, .b.i = 0x00, .b.m = 0x01, .b.p = &lcd_cpu.fp_led_data },
+	{ LX( 0), LY(2), '1', '5', LW, .w.m = 0x8000, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 1), LY(2), '1', '4', LW, .w.m = 0x4000, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 2), LY(2), '1', '3', LW, .w.m = 0x2000, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 3), LY(2), '1', '2', LW, .w.m = 0x1000, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 4), LY(2), '1', '1', LW, .w.m = 0x0800, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 5), LY(2), '1', '0', LW, .w.m = 0x0400, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 6), LY(2), 'A', '9', LW, .w.m = 0x0200, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 7), LY(2), 'A', '8', LW, .w.m = 0x0100, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 8), LY(2), 'A', '7', LW, .w.m = 0x0080, .w.p = &lcd_cpu.fp_led_address },
+	{ LX( 9), LY(2), 'A', '6', LW, .w.m = 0x0040, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(10), LY(2), 'A', '5', LW, .w.m = 0x0020, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(11), LY(2), 'A', '4', LW, .w.m = 0x0010, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(12), LY(2), 'A', '3', LW, .w.m = 0x0008, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(13), LY(2), 'A', '2', LW, .w.m = 0x0004, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(14), LY(2), 'A', '1', LW, .w.m = 0x0002, .w.p = &lcd_cpu.fp_led_address },
+	{ LX(15), LY(2), 'A', '0', LW, .w.m = 0x0001, .w.p = &lcd_cpu.fp_led_address }
 };
 static const int num_leds = sizeof(leds) / sizeof(led_t);
 
@@ -757,20 +1858,26 @@ static void __not_in_flash_func(lcd_draw_panel)(bool first)
 	uint16_t col;
 
 	if (first) {
-		/* draw static content */
-
-		draw_clear(C_DKBLUE);
+		if (!lcd_bg_restore(lcd_draw_panel, 0)) {
+			/* draw static content */
+
+			draw_clear(C_DKBLUE);
+
+			for (i = 0; i < num_leds; i++) {
+				draw_char(p->x - PLEDXO, p->y - PLEDYO,
+					  p->c1, &font12, C_WHITE, C_DKBLUE);
+				draw_char(p->x - PLEDXO + PFNTW,
+					  p->y - PLEDYO, p->c2, &font12,
+					  C_WHITE, C_DKBLUE);
+				if (p->c1 == 'W' && p->c2 == 'O')
+					draw_hline(p->x - PLEDXO,
+						   p->y - PLEDYO - 2,
+						   PLBLW, C_WHITE);
+				draw_led_bracket(p->x, p->y);
+				p++;
+			}
 
-		for (i = 0; i < num_leds; i++) {
-			draw_char(p->x - PLEDXO, p->y - PLEDYO,
-				  p->c1, &font12, C_WHITE, C_DKBLUE);
-			draw_char(p->x - PLEDXO + PFNTW, p->y - PLEDYO,
-				  p->c2, &font12, C_WHITE, C_DKBLUE);
-			if (p->c1 == 'W' && p->c2 == 'O')
-				draw_hline(p->x - PLEDXO, p->y - PLEDYO - 2,
-					   PLBLW, C_WHITE);
-			draw_led_bracket(p->x, p->y);
-			p++;
+			lcd_bg_save(lcd_draw_panel, 0);
 		}
 	} else {
 		/* draw dynamic content */
@@ -806,11 +1913,14 @@ static void __not_in_flash_func(lcd_draw_panel)(bool first)
  *
  *	Shows last access type LED, track, sector, and DMA address
  *	of disk drive operations. Clears after 10 seconds of no access.
+ *	The drives are shown in groups of four, A - D, E - H and so on,
+ *	the group of the drive accessed last.
  */
 
 #define DXOFF	8	/* x pixel offset of text grid */
 #define DYOFF	0	/* y pixel offset of text grid */
 #define DSPC	1	/* vertical text spacing */
+#define DROWS	4	/* drives shown at the same time */
 
 typedef struct lcd_drive {
 	uint8_t track;	/* track */
@@ -822,50 +1932,168 @@ typedef struct lcd_drive {
 } lcd_drive_t;
 
 static lcd_drive_t lcd_drives[NUMDISK];
+static int lcd_drive_last;	/* drive accessed last */
 
 /*
- *	Called from core 0 to update disk drive status
+ *	First drive of the group shown, the one of the drive accessed last
  */
-void lcd_update_drive(int drive, int track, int sector, WORD addr, bool rdwr,
-		      bool active)
+static inline int lcd_drive_group(void)
+{
+	return lcd_drive_last - lcd_drive_last % DROWS;
+}
+
+/* brightness of the LED colors red, green and blue, 0 - 15 */
+static uint8_t lcd_led_level[3];
+static bool lcd_led_on[3];
+
+/*
+ *	Apply an event on core 1
+ */
+static void __not_in_flash_func(lcd_apply_event)(const lcd_event_t *ev)
 {
-	lcd_drive_t *p = &lcd_drives[drive];
+	lcd_drive_t *p;
 
-	p->track = track;
-	p->sector = sector;
-	p->addr = addr;
-	p->rdwr = rdwr;
-	p->active = active;
+	if (ev->type == LCD_EV_LED) {
+		lcd_led_on[2] = ev->flags & LCD_EV_BLUE;
+		if (lcd_led_on[2])
+			lcd_led_level[2] = 15;
+		return;
+	}
+
+	if (ev->drive >= NUMDISK)
+		return;
+	lcd_drive_last = ev->drive;
+	p = &lcd_drives[ev->drive];
+	p->track = ev->track;
+	p->sector = ev->sector;
+	p->addr = ev->addr;
+	p->rdwr = ev->flags & LCD_EV_RDWR;
+	p->active = ev->flags & LCD_EV_ACTIVE;
 	p->lastacc = lcd_frame_cnt;
 
+	/* an access lights the LED even if it ended in the same period */
 	if (p->active) {
-		if (p->rdwr)
-			led_color = (led_color & ~C_RED) | C_RED;
-		else
-			led_color = (led_color & ~C_GREEN) | C_GREEN;
+		lcd_led_on[p->rdwr ? 0 : 1] = true;
+		lcd_led_level[p->rdwr ? 0 : 1] = 15;
 	} else
-		led_color &= ~(C_RED | C_GREEN);
-	lcd_update_led();
+		lcd_led_on[0] = lcd_led_on[1] = false;
+}
+
+static void __not_in_flash_func(lcd_drain_events)(void)
+{
+	static uint32_t drops;
+	uint32_t tail = lcd_ev_tail, n;
+
+	while (tail != lcd_ev_head) {
+		__mem_fence_acquire();
+		lcd_apply_event(&lcd_events[tail & (LCD_EVENTS - 1)]);
+		lcd_ev_tail = ++tail;
+	}
+
+	n = lcd_ev_drops;
+	if (n != drops) {
+		drops = n;
+		lcd_led_on[0] = lcd_led_on[1] = false;
+		lcd_led_on[2] = led_color & C_BLUE;
+	}
+}
+
+static void __not_in_flash_func(lcd_led_animate)(void)
+{
+	register int i;
+	uint16_t r, g, b;
+
+	for (i = 0; i < 3; i++)
+		if (lcd_led_on[i])
+			lcd_led_level[i] = 15;
+		else if (lcd_led_level[i] > LCD_LED_DECAY)
+			lcd_led_level[i] -= LCD_LED_DECAY;
+		else
+			lcd_led_level[i] = 0;
+
+	r = lcd_led_level[0];
+	g = lcd_led_level[1];
+	b = lcd_led_level[2];
+#if COLOR_DEPTH == 12
+	lcd_led_color = (r << 8) | (g << 4) | b;
+#elif COLOR_DEPTH == 8
+	lcd_led_color = ((r >> 1) << 5) | ((g >> 1) << 2) | (b >> 2);
+#else
+	lcd_led_color = (((r << 1) | (r >> 3)) << 11) |
+			(((g << 2) | (g >> 2)) << 5) | ((b << 1) | (b >> 3));
+#endif
+}
+
+/*
+ *	Called to update disk drive status, from core 0 with an event,
+ *	the background commands of the extended FDC on core 1 apply it
+ */
+void lcd_update_drive(int drive, int track, int sector, WORD addr, bool rdwr,
+		      bool active)
+{
+	lcd_event_t ev;
+
+	ev.type = LCD_EV_DRIVE;
+	ev.flags = (rdwr ? LCD_EV_RDWR : 0) | (active ? LCD_EV_ACTIVE : 0);
+	ev.drive = drive;
+	ev.track = track;
+	ev.sector = sector;
+	ev.addr = addr;
+
+	if (get_core_num() == 1)
+		lcd_apply_event(&ev);
+	else
+		lcd_post_event(&ev);
+}
+
+/*
+ *	Draw a track or sector number with two digits, or three
+ *	digits if it is larger than 99 (hard disk images)
+ */
+static void __not_in_flash_func(lcd_draw_drive_num)(int x, int y, int n,
+						      bool clr,
+						      const draw_grid_t *grid)
+{
+	if (clr) {
+		draw_grid_char(x, y, ' ', grid, C_YELLOW, C_DKBLUE);
+		draw_grid_char(x + 1, y, ' ', grid, C_YELLOW, C_DKBLUE);
+		draw_grid_char(x + 2, y, ' ', grid, C_YELLOW, C_DKBLUE);
+	} else if (n > 99) {
+		draw_grid_char(x, y, '0' + n / 100, grid, C_YELLOW, C_DKBLUE);
+		draw_grid_char(x + 1, y, '0' + (n / 10) % 10, grid, C_YELLOW,
+			       C_DKBLUE);
+		draw_grid_char(x + 2, y, '0' + n % 10, grid, C_YELLOW,
+			       C_DKBLUE);
+	} else {
+		draw_grid_char(x, y, '0' + n / 10, grid, C_YELLOW, C_DKBLUE);
+		draw_grid_char(x + 1, y, '0' + n % 10, grid, C_YELLOW,
+			       C_DKBLUE);
+		draw_grid_char(x + 2, y, ' ', grid, C_YELLOW, C_DKBLUE);
+	}
 }
 
 static void __not_in_flash_func(lcd_draw_drives)(bool first)
 {
 	char c;
-	int i, j;
+	int i, j, g;
 	WORD w;
-	bool clr;
-	lcd_drive_t *p = lcd_drives;
+	bool clr, regroup;
+	lcd_drive_t *p;
 	static draw_grid_t grid;
+	static int group;
 
 	if (first) {
+		draw_setup_grid(&grid, DXOFF, DYOFF, -1, DROWS, &font28, DSPC);
+		group = lcd_drive_group();
+	}
+
+	if (first && !lcd_bg_restore(lcd_draw_drives, group)) {
 		/* draw static content */
 
 		draw_clear(C_DKBLUE);
 
-		draw_setup_grid(&grid, DXOFF, DYOFF, -1, 4, &font28, DSPC);
-
-		for (i = 0; i < NUMDISK; i++) {
-			draw_grid_char(0, i, 'A' + i, &grid, C_CYAN,
+		for (i = 0; i < DROWS; i++) {
+			draw_grid_char(0, i, 'A' + group + i, &grid, C_CYAN,
 				       C_DKBLUE);
 			draw_led_bracket(grid.cwidth +
 					 (2 * grid.cwidth - 10) / 2 +
@@ -888,14 +2116,26 @@ static void __not_in_flash_func(lcd_draw_drives)(bool first)
 			if (i)
 				draw_grid_hline(0, i, grid.cols, &grid,
 						C_DKYELLOW);
-			p++;
 		}
-     } else {
+
+		lcd_bg_save(lcd_draw_drives, group);
+	} else if (!first) {
 		/* draw dynamic content */
 
-		for (i = 0; i < NUMDISK; i++) {
+		/* switch to the group of the drive accessed last */
+		g = lcd_drive_group();
+		regroup = (g != group);
+		if (regroup) {
+			group = g;
+			for (i = 0; i < DROWS; i++)
+				draw_grid_char(0, i, 'A' + group + i, &grid,
+					       C_CYAN, C_DKBLUE);
+		}
+
+		p = &lcd_drives[group];
+		for (i = 0; i < DROWS; i++) {
 			/* clear drive 10 seconds after last access */
-			clr = false;
+			clr = regroup && !p->sector;
 			if (lcd_frame_cnt - p->lastacc >= 10 * LCD_REFRESH) {
 				p->sector = 0;
 				clr = true;
@@ -910,18 +2150,8 @@ static void __not_in_flash_func(lcd_draw_drives)(bool first)
 					 grid.yoff,
 					 clr ? C_DKBLUE
 					     : (p->rdwr ? C_RED : C_GREEN));
-				draw_grid_char(4, i,
-					       clr ? ' ' : '0' + p->track / 10,
-					       &grid, C_YELLOW, C_DKBLUE);
-				draw_grid_char(5, i,
-					       clr ? ' ' : '0' + p->track % 10,
-					       &grid, C_YELLOW, C_DKBLUE);
-				draw_grid_char(8, i,
-					       clr ? ' ' : '0' + p->sector / 10,
-					       &grid, C_YELLOW, C_DKBLUE);
-				draw_grid_char(9, i,
-					       clr ? ' ' : '0' + p->sector % 10,
-					       &grid, C_YELLOW, C_DKBLUE);
+				lcd_draw_drive_num(4, i, p->track, clr, &grid);
+				lcd_draw_drive_num(8, i, p->sector, clr, &grid);
 				w = p->addr;
 				for (j = 0; j < 4; j++) {
 					c = w & 0xf;
@@ -940,6 +2170,137 @@ static void __not_in_flash_func(lcd_draw_drives)(bool first)
 	lcd_draw_info(&font20, first);
 }
 
+/*
+ *	Disk statistics display using font12 (6 x 12 pixels):
+ *
+ *	  0123456789012345678901234567890123456789
+ *	0    Reads  Writes    Hits  Misses  KBytes
+ *	1 Axxxxxxx xxxxxxx xxxxxxx xxxxxxx xxxxxxx
+ *	2 Bxxxxxxx xxxxxxx xxxxxxx xxxxxxx xxxxxxx
+ *	3 Cxxxxxxx xxxxxxx xxxxxxx xxxxxxx xxxxxxx
+ *	4 Dxxxxxxx xxxxxxx xxxxxxx xxxxxxx xxxxxxx
+ *	  latency histogram of all drives, 1 us - 32 ms
+ *
+ *	Shows the I/O counters of the drives and the distribution of
+ *	the MicroSD transfer latencies with a log2 scale. Like on the
+ *	drives display the group of four drives accessed last is shown.
+ */
+
+#define SXOFF	0	/* x pixel offset of text grid */
+#define SYOFF	0	/* y pixel offset of text grid */
+#define SSPC	1	/* vertical text spacing */
+#define SHYOFF	68	/* y pixel offset of the histogram */
+#define SHHGT	32	/* height of the histogram bars */
+#define SHBWID	15	/* width of a histogram bar including gap */
+
+static void __not_in_flash_func(lcd_draw_dstats)(bool first)
+{
+	int i, j, h, g;
+	uint32_t n, v, max, lat[DISK_LAT_BUCKETS];
+	const disk_stats_t *p;
+	static draw_grid_t grid;
+	static int group;
+
+	if (first) {
+		draw_setup_grid(&grid, SXOFF, SYOFF, -1, 5, &font12, SSPC);
+		group = lcd_drive_group();
+	}
+
+	if (first && !lcd_bg_restore(lcd_draw_dstats, group)) {
+		/* draw static content */
+
+		draw_clear(C_DKBLUE);
+
+		draw_string(grid.xoff, grid.yoff,
+			    "   Reads  Writes    Hits  Misses  KBytes",
+			    &font12, C_WHEAT, C_DKBLUE);
+		for (i = 0; i < DROWS; i++)
+			draw_grid_char(0, i + 1, 'A' + group + i, &grid,
+				       C_CYAN, C_DKBLUE);
+		draw_string(0, SHYOFF + SHHGT + 2, "1us", &font12, C_WHEAT,
+			    C_DKBLUE);
+		draw_string(10 * SHBWID, SHYOFF + SHHGT + 2, "1ms", &font12,
+			    C_WHEAT, C_DKBLUE);
+		draw_string(DISK_LAT_BUCKETS * SHBWID - 4 * font12.width,
+			    SHYOFF + SHHGT + 2, "32ms", &font12, C_WHEAT,
+			    C_DKBLUE);
+
+		lcd_bg_save(lcd_draw_dstats, group);
+	} else if (!first) {
+		/* draw dynamic content */
+
+		max = 0;
+		for (j = 0; j < DISK_LAT_BUCKETS; j++) {
+			lat[j] = 0;
+			for (i = 0; i < NUMDISK; i++)
+				lat[j] += disk_stats[i].lat[j];
+			if (lat[j] > max)
+				max = lat[j];
+		}
+
+		if ((g = lcd_drive_group()) != group) {
+			group = g;
+			for (i = 0; i < DROWS; i++)
+				draw_grid_char(0, i + 1, 'A' + group + i,
+					       &grid, C_CYAN, C_DKBLUE);
+		}
+
+		p = &disk_stats[group];
+		for (i = 0; i < DROWS; i++) {
+			for (j = 0; j < 5; j++) {
+				switch (j) {
+				case 0:
+					v = p->reads;
+					break;
+				case 1:
+					v = p->writes;
+					break;
+				case 2:
+					v = p->hits;
+					break;
+				case 3:
+					v = p->misses;
+					break;
+				default:
+					v = p->bytes / 1024;
+					break;
+				}
+				/* right aligned in 7 digits, max. 9999999 */
+				if (v > 9999999)
+					v = 9999999;
+				for (h = 0; h < 7; h++) {
+					draw_grid_char(7 + j * 8 - h, i + 1,
+						       (h && !v) ? ' ' :
+						       '0' + v % 10,
+						       &grid, C_YELLOW,
+						       C_DKBLUE);
+					v /= 10;
+				}
+			}
+			p++;
+		}
+
+		for (j = 0; j < DISK_LAT_BUCKETS; j++) {
+			n = lat[j];
+			h = max ? (int) ((uint64_t) n * SHHGT / max) : 0;
+			if (n && !h)
+				h = 1;
+			for (i = 0; i < SHBWID - 2; i++) {
+				if (h < SHHGT)
+					draw_vline(j * SHBWID + i, SHYOFF,
+						   SHHGT - h, C_DKBLUE);
+				if (h)
+					draw_vline(j * SHBWID + i,
+						   SHYOFF + SHHGT - h, h,
+						   C_GREEN);
+			}
+		}
+	}
+
+	/* draw info line */
+	lcd_draw_info(&font20, first);
+}
+
 #ifdef IOPANEL
 
 /*
@@ -967,55 +2328,96 @@ static void __not_in_flash_func(lcd_draw_drives)(bool first)
 #define IOLEDYS	1			/* I/O port LED y spacing */
 #define IOLEDGH	(2 * IOLEDH + IOLEDYS)	/* I/O port LED grid cell height */
 
+#if IO_COUNT
+/*
+ *	The LEDs are brighter with more accesses in the last period,
+ *	one step for each power of 2.
+ */
+static inline uint16_t lcd_port_color(uint16_t n, bool out)
+{
+	uint16_t l;
+
+	if (n == 0)
+		return C_DKBLUE;
+	l = 6 + 2 * (31 - __builtin_clz(n));
+	if (l > 15)
+		l = 15;
+#if COLOR_DEPTH == 12
+	return out ? l << 8 : l << 4;
+#elif COLOR_DEPTH == 8
+	return out ? (l >> 1) << 5 : (l >> 1) << 2;
+#else
+	return out ? ((l << 1) | (l >> 3)) << 11 : ((l << 2) | (l >> 2)) << 5;
+#endif
+}
+#endif
+
 static void __not_in_flash_func(lcd_draw_ports)(bool first)
 {
-	port_flags_t *p = port_flags;
-	int i, j, k;
+	port_flags_t *p = lcd_cpu.port_flags;
+	int i, j;
 	uint16_t col;
 
 	if (first) {
-		/* draw static content */
-
-		draw_clear(C_DKBLUE);
-		for (j = 0; j < 8; j++) {
-			draw_char(IOXOFF, j * IOLEDGH + IOYOFF,
-				  "02468ACE"[j], &font14, C_WHITE, C_DKBLUE);
-			draw_char(font14.width + IOXOFF, j * IOLEDGH + IOYOFF,
-				  '0', &font14, C_WHITE, C_DKBLUE);
-			if (j)
-				draw_hline(2 * font14.width + 1 + IOXOFF,
-					   j * IOLEDGH - IOLEDYS + IOYOFF,
-					   32 * IOLEDGW - IOLEDXS,
+		if (!lcd_bg_restore(lcd_draw_ports, 0)) {
+			/* draw static content */
+
+			draw_clear(C_DKBLUE);
+			for (j = 0; j < 8; j++) {
+				draw_char(IOXOFF, j * IOLEDGH + IOYOFF,
+					  "02468ACE"[j], &font14, C_WHITE,
+					  C_DKBLUE);
+				draw_char(font14.width + IOXOFF,
+					  j * IOLEDGH + IOYOFF, '0', &font14,
+					  C_WHITE, C_DKBLUE);
+				if (j)
+					draw_hline(2 * font14.width + 1 +
+						   IOXOFF,
+						   j * IOLEDGH - IOLEDYS +
+						   IOYOFF,
+						   32 * IOLEDGW - IOLEDXS,
+						   C_DKYELLOW);
+			}
+			for (i = 1; i < 32; i++)
+				draw_vline(2 * font14.width + 1 +
+					   i * IOLEDGW - IOLEDXS + IOXOFF,
+					   IOYOFF, 8 * IOLEDGH - IOLEDYS,
 					   C_DKYELLOW);
+
+			lcd_bg_save(lcd_draw_ports, 0);
 		}
-		for (i = 1; i < 32; i++)
-			draw_vline(2 * font14.width + 1 +
-				   i * IOLEDGW - IOLEDXS + IOXOFF,
-				   IOYOFF, 8 * IOLEDGH - IOLEDYS, C_DKYELLOW);
 	} else {
 		/* draw dynamic content */
 
 		for (j = 0; j < 8; j++) {
 			for (i = 0; i < 32; i++) {
+#if IO_COUNT
+				col = lcd_port_color(lcd_cpu.port_in[j * 32 + i],
+						     false);
+				if (col == C_DKBLUE && p->in)
+					col = C_GREEN;
+#else
 				col = (p->in ? C_GREEN : C_DKBLUE);
-				for (k = 0; k < IOLEDH; k++)
-					draw_hline(2 * font14.width + 1 +
-						   i * IOLEDGW + IOXOFF,
-						   k + j * IOLEDGH + IOYOFF,
-						   IOLEDW, col);
+#endif
+				draw_fill(2 * font14.width + 1 +
+					  i * IOLEDGW + IOXOFF,
+					  j * IOLEDGH + IOYOFF,
+					  IOLEDW, IOLEDH, col);
+#if IO_COUNT
+				col = lcd_port_color(lcd_cpu.port_out[j * 32 + i],
+						     true);
+				if (col == C_DKBLUE && p->out)
+					col = C_RED;
+#else
 				col = (p->out ? C_RED : C_DKBLUE);
-				for (k = 0; k < IOLEDH; k++)
-					draw_hline(2 * font14.width + 1 +
-						   i * IOLEDGW + IOXOFF,
-						   k + j * IOLEDGH +
-						   IOLEDH + IOYOFF,
-						   IOLEDW, col);
+#endif
+				draw_fill(2 * font14.width + 1 +
+					  i * IOLEDGW + IOXOFF,
+					  j * IOLEDGH + IOLEDH + IOYOFF,
+					  IOLEDW, IOLEDH, col);
 				p++;
 			}
 		}
-
-		/* clear access flags */
-		memset(port_flags, 0, sizeof(port_flags));
 	}
 
 	/* draw info line */
@@ -1023,3 +2425,224 @@ static void __not_in_flash_func(lcd_draw_ports)(bool first)
 }
 
 #endif /* IOPANEL */
+
+/*
+ *	Console display:
+ *
+ *	Shows the last CONROWS lines of the SIO1 console output with
+ *	CONCOLS columns in font12, longer lines wrap. Core 0 writes the
+ *	characters into the screen and marks the changed cells, core 1
+ *	only draws the marked cells. CSI sequences for moving the cursor
+ *	and erasing are done, other escape sequences are skipped.
+ */
+
+#define CONCW	6			/* font12 character width */
+#define CONCH	12			/* font12 character height */
+#define CONCOLS	(WAVESHARE_LCD_WIDTH / CONCW)
+#define CONROWS	(WAVESHARE_LCD_HEIGHT / CONCH)
+#define CONXOFF	((WAVESHARE_LCD_WIDTH - CONCOLS * CONCW) / 2)
+#define CONYOFF	((WAVESHARE_LCD_HEIGHT - CONROWS * CONCH) / 2)
+#define CONPARS	2			/* max. CSI parameters */
+
+static volatile char lcd_con[CONROWS][CONCOLS];	/* screen (W0 R1) */
+static volatile bool lcd_con_dirty[CONROWS][CONCOLS]; /* changed (W0 W1) */
+static volatile uint8_t lcd_con_x, lcd_con_y;	/* cursor (W0 R1) */
+
+static enum { CON_CHAR, CON_ESC, CON_CSI } con_state;
+static int con_par[CONPARS], con_npar;
+
+/* mark the cells from x0, y0 up to x1, y1 changed, with x1 excluded */
+static void lcd_con_mark(int x0, int y0, int x1, int y1)
+{
+	register int x, y;
+
+	for (y = y0; y <= y1; y++)
+		for (x = (y == y0 ? x0 : 0);
+		     x < (y == y1 ? x1 : CONCOLS); x++)
+			lcd_con_dirty[y][x] = true;
+}
+
+/* erase the cells from x0, y0 up to x1, y1, with x1 excluded */
+static void lcd_con_erase(int x0, int y0, int x1, int y1)
+{
+	register int x, y;
+
+	for (y = y0; y <= y1; y++)
+		for (x = (y == y0 ? x0 : 0);
+		     x < (y == y1 ? x1 : CONCOLS); x++)
+			lcd_con[y][x] = ' ';
+	lcd_con_mark(x0, y0, x1, y1);
+}
+
+static void lcd_con_newline(void)
+{
+	register int x, y;
+
+	if (lcd_con_y < CONROWS - 1) {
+		lcd_con_y++;
+		return;
+	}
+	for (y = 0; y < CONROWS - 1; y++)
+		for (x = 0; x < CONCOLS; x++)
+			lcd_con[y][x] = lcd_con[y + 1][x];
+	lcd_con_erase(0, CONROWS - 1, CONCOLS, CONROWS - 1);
+	lcd_con_mark(0, 0, CONCOLS, CONROWS - 1);
+}
+
+/* execute the CSI sequence with the final character c */
+static void lcd_con_csi(char c)
+{
+	int p0 = con_npar > 0 ? con_par[0] : 0;
+	int p1 = con_npar > 1 ? con_par[1] : 0;
+	int x1 = lcd_con_x < CONCOLS ? lcd_con_x + 1 : CONCOLS;
+
+	switch (c) {
+	case 'H':		/* cursor position */
+	case 'f':
+		lcd_con_y = (p0 > CONROWS ? CONROWS : (p0 ? p0 : 1)) - 1;
+		lcd_con_x = (p1 > CONCOLS ? CONCOLS : (p1 ? p1 : 1)) - 1;
+		break;
+
+	case 'J':		/* erase in display */
+		if (p0 == 0)
+			lcd_con_erase(lcd_con_x, lcd_con_y,
+				      CONCOLS, CONROWS - 1);
+		else if (p0 == 1)
+			lcd_con_erase(0, 0, x1, lcd_con_y);
+		else
+			lcd_con_erase(0, 0, CONCOLS, CONROWS - 1);
+		break;
+
+	case 'K':		/* erase in line */
+		if (p0 == 0)
+			lcd_con_erase(lcd_con_x, lcd_con_y,
+				      CONCOLS, lcd_con_y);
+		else if (p0 == 1)
+			lcd_con_erase(0, lcd_con_y, x1, lcd_con_y);
+		else
+			lcd_con_erase(0, lcd_con_y, CONCOLS, lcd_con_y);
+		break;
+
+	default:		/* everything else is ignored */
+		break;
+	}
+}
+
+/*
+ *	Called by core 0 for every character written to the console.
+ */
+void lcd_console_out(BYTE data)
+{
+	char c = (char) (data & 0x7f);
+
+	switch (con_state) {
+	case CON_ESC:
+		if (c == '[') {
+			con_par[0] = con_par[1] = con_npar = 0;
+			con_state = CON_CSI;
+		} else
+			con_state = CON_CHAR;
+		return;
+
+	case CON_CSI:
+		if (c >= '0' && c <= '9') {
+			if (con_npar == 0)
+				con_npar = 1;
+			if (con_npar <= CONPARS && con_par[con_npar - 1] < 1000)
+				con_par[con_npar - 1] =
+					con_par[con_npar - 1] * 10 + c - '0';
+		} else if (c == ';') {
+			if (con_npar == 0)
+				con_npar = 1;
+			if (con_npar < CONPARS)
+				con_par[con_npar] = 0;
+			con_npar++;
+		} else if (c >= 0x40 && c <= 0x7e) {
+			if (con_npar > CONPARS)
+				con_npar = CONPARS;
+			lcd_con_csi(c);
+			con_state = CON_CHAR;
+		}
+		return;
+
+	default:
+		break;
+	}
+
+	switch (c) {
+	case '\r':
+		lcd_con_x = 0;
+		break;
+
+	case '\n':
+		lcd_con_newline();
+		break;
+
+	case '\b':
+		if (lcd_con_x > 0)
+			lcd_con_x--;
+		break;
+
+	case '\t':
+		do
+			lcd_console_out(' ');
+		while (lcd_con_x & 7);
+		break;
+
+	case 0x1b:
+		con_state = CON_ESC;
+		break;
+
+	default:
+		if (c < ' ' || c == 0x7f)
+			break;
+		if (lcd_con_x >= CONCOLS) {
+			lcd_con_x = 0;
+			lcd_con_newline();
+		}
+		lcd_con[lcd_con_y][lcd_con_x] = c;
+		lcd_con_dirty[lcd_con_y][lcd_con_x] = true;
+		lcd_con_x++;
+		break;
+	}
+}
+
+static void __not_in_flash_func(lcd_draw_console)(bool first)
+{
+	static int cur_x, cur_y;
+	int x, y;
+	char c;
+	bool cursor;
+
+	if (first) {
+		draw_clear(C_BLACK);
+		lcd_con_mark(0, 0, CONCOLS, CONROWS - 1);
+	}
+
+	/* redraw the cells of the cursor if it moved */
+	x = lcd_con_x;
+	y = lcd_con_y;
+	if (x >= CONCOLS)
+		x = CONCOLS - 1;
+	if (x != cur_x || y != cur_y) {
+		lcd_con_dirty[cur_y][cur_x] = true;
+		lcd_con_dirty[y][x] = true;
+		cur_x = x;
+		cur_y = y;
+	}
+
+	for (y = 0; y < CONROWS; y++)
+		for (x = 0; x < CONCOLS; x++) {
+			if (!lcd_con_dirty[y][x])
+				continue;
+			/* clear first, so that a new change is not lost */
+			lcd_con_dirty[y][x] = false;
+			c = lcd_con[y][x];
+			if (c < ' ')
+				c = ' ';
+			cursor = (x == cur_x && y == cur_y);
+			draw_char(CONXOFF + x * CONCW, CONYOFF + y * CONCH, c,
+				  &font12, cursor ? C_BLACK : C_GREEN,
+				  cursor ? C_GREEN : C_BLACK);
+		}
+}
@@ -19,19 +19,61 @@
 #define LCD_STATUS_DRIVES	3
 #define LCD_STATUS_PORTS	4
 #define LCD_STATUS_MEMORY	5
+#define LCD_STATUS_DSTATS	6
+#define LCD_STATUS_CONSOLE	7
+#define LCD_STATUS_HEAT		8
 
 typedef void (*lcd_func_t)(bool first);
 
+/*
+ * Bytes for the pre-rendered backgrounds of the displays, the static
+ * content is restored from there when a display is selected again.
+ * The RP2040 doesn't have the RAM for it.
+ */
+#ifndef LCD_BG_POOL
+#if PICO_RP2350
+#define LCD_BG_POOL	32768
+#else
+#define LCD_BG_POOL	0
+#endif
+#endif
+
 extern uint16_t led_color;	/* call lcd_update_led() after changing this */
 
 extern void lcd_init(void), lcd_exit(void);
 extern void lcd_brightness(int brightness);
+extern void lcd_set_refresh(int hz);
+extern void lcd_set_spi_div(int div);
+extern int lcd_get_spi_div(void);
 extern void lcd_set_rotation(bool rotated);
+extern bool lcd_toggle_perf(void);
 extern void lcd_update_led(void);
 extern void lcd_custom_disp(lcd_func_t draw_func);
 extern void lcd_status_disp(int which);
 extern void lcd_status_next(void);
+extern void lcd_console_out(BYTE data);
 extern void lcd_update_drive(int drive, int track, int sector, WORD addr,
 			     bool rdwr, bool active);
+extern void print_lcd_mem(void);
+extern void lcd_clock_start(void), lcd_clock_report(void);
+
+#if LCD_BG_POOL > 0
+extern bool lcd_bg_restore(lcd_func_t page, int variant);
+extern void lcd_bg_save(lcd_func_t page, int variant);
+#else
+static inline bool lcd_bg_restore(lcd_func_t page, int variant)
+{
+	UNUSED(page);
+	UNUSED(variant);
+
+	return false;
+}
+
+static inline void lcd_bg_save(lcd_func_t page, int variant)
+{
+	UNUSED(page);
+	UNUSED(variant);
+}
+#endif
 
 #endif /* !LCD_INC */
@@ -15,12 +15,21 @@
 #include "hardware/sync.h"
 #include "pico/time.h"
 
+#include "gpio.h"
 #include "lcd_dev.h"
 #include "draw.h"
 
 #define LCD_SPI		(__CONCAT(spi,WAVESHARE_LCD_SPI))
 #define LCD_DMA_IRQ	(DMA_IRQ_1)
 
+/*
+ *	Delays of the ST7789 controller: after the reset it takes 120 ms
+ *	until Sleep Out may be sent, after Sleep Out 5 ms until the next
+ *	command. The reset pulse must be at least 10 us.
+ */
+#define LCD_RESET_MS	120	/* after the reset */
+#define LCD_CMD_MS	10	/* after commands flagged in lcd_init_tab */
+
 static bool lcd_rotated;
 static uint lcd_dma_channel;
 static bool lcd_dma_active;
@@ -29,6 +38,64 @@ static uint lcd_pwm_slice_num;
 static void lcd_dma_irq_handler(void);
 static void lcd_dma_wait(void);
 
+#if COLOR_DEPTH == 8
+/*
+ *	A pixmap with 8-bit 332 RGB pixels is sent as 12-bit pixels, the
+ *	rows are expanded in chunks of LCD_XROWS rows into two buffers,
+ *	while one is sent by the DMA the next chunk is expanded into the
+ *	other one by the DMA interrupt handler.
+ */
+#define LCD_XROWS	4	/* rows expanded at once */
+#define LCD_XSTRIDE	(((WAVESHARE_LCD_WIDTH + 1) / 2) * 3) /* 12-bit row */
+
+static uint16_t lcd_lut[256];	/* 332 RGB to 444 RGB */
+static uint8_t __aligned(4) lcd_xbuf[2][LCD_XROWS * LCD_XSTRIDE];
+static draw_pixmap_t *lcd_xpixmap; /* pixmap sent */
+static uint16_t lcd_xrow, lcd_xend; /* next and last row to expand */
+static int lcd_xnext;		/* buffer with the next chunk */
+static uint32_t lcd_xlen;	/* its length, 0 = no more chunks */
+
+/*
+ *	Expand the next rows of the pixmap sent into buffer d,
+ *	returns the number of bytes
+ */
+static uint32_t __not_in_flash_func(lcd_expand)(uint8_t *d)
+{
+	uint8_t *start = d;
+	const uint8_t *s;
+	uint16_t c0, c1;
+	int x, n;
+
+	for (n = 0; n < LCD_XROWS && lcd_xrow <= lcd_xend; n++) {
+		s = lcd_xpixmap->bits + lcd_xrow++ * lcd_xpixmap->stride;
+		for (x = 0; x < lcd_xpixmap->width; x += 2) {
+			c0 = lcd_lut[*s++];
+			c1 = lcd_lut[*s++];
+			*d++ = (c0 >> 4) & 0xff;
+			*d++ = ((c0 & 0x0f) << 4) | ((c1 >> 8) & 0x0f);
+			*d++ = c1 & 0xff;
+		}
+	}
+
+	return (uint32_t) (d - start);
+}
+#endif
+
+/*
+ *	SPI clock for a divider of clk_peri, 0 is the default:
+ *	50 MHz on 200 MHz RP2040, 50 MHz on 150 MHz RP2350
+ */
+static uint32_t lcd_dev_spi_rate(uint8_t div)
+{
+	if (div)
+		return clock_get_hz(clk_peri) / div;
+#if PICO_RP2040
+	return clock_get_hz(clk_sys) / 4;
+#else
+	return clock_get_hz(clk_sys) / 3;
+#endif
+}
+
 /*
  *	Send command to LCD controller
  */
@@ -70,7 +137,7 @@ static void __not_in_flash_func(lcd_dev_send_word)(uint16_t data)
  */
 static const uint8_t lcd_init_tab[] = {
 	/* cmd, nargs, args... */
-	/* nargs with bit 7 set delays 100 ms after command is sent */
+	/* nargs with bit 7 set delays LCD_CMD_MS after command is sent */
 	0x36, 1, 0x70,				/* Memory Data Access Control */
 	0xb2, 5, 0x0c, 0x0c, 0x00, 0x33, 0x33,	/* Porch Setting */
 	0xb7, 1, 0x35,				/* Gate Control */
@@ -109,12 +176,7 @@ void lcd_dev_init(uint8_t backlight)
 	 */
 
 	/* SPI Config for LCD controller */
-	/* 50 MHz on 200 MHz RP2040, 50 MHz on 150 MHz RP2350 */
-#if PICO_RP2040
-	spi_init(LCD_SPI, clock_get_hz(clk_sys) / 4);
-#else
-	spi_init(LCD_SPI, clock_get_hz(clk_sys) / 3);
-#endif
+	spi_init(LCD_SPI, lcd_dev_spi_rate(0));
 	gpio_set_function(WAVESHARE_LCD_SCLK_PIN, GPIO_FUNC_SPI);
 	gpio_set_function(WAVESHARE_LCD_TX_PIN, GPIO_FUNC_SPI);
 
@@ -157,12 +219,10 @@ void lcd_dev_init(uint8_t backlight)
 	irq_set_enabled(LCD_DMA_IRQ, true);
 
 	/* reset the LCD controller */
-	gpio_put(WAVESHARE_LCD_RST_PIN, 1);
-	sleep_ms(100);
 	gpio_put(WAVESHARE_LCD_RST_PIN, 0);
-	sleep_ms(100);
+	sleep_ms(1);
 	gpio_put(WAVESHARE_LCD_RST_PIN, 1);
-	sleep_ms(100);
+	sleep_ms(LCD_RESET_MS);
 
 	/* set LCD backlight intensity */
 	lcd_dev_backlight(backlight);
@@ -174,10 +234,17 @@ void lcd_dev_init(uint8_t backlight)
 		for (i = n & 0x7f; i; i--)
 			lcd_dev_send_byte(*p++);
 		if (n & 0x80)
-			sleep_ms(100);
+			sleep_ms(LCD_CMD_MS);
 	}
 
 	lcd_rotated = false;
+
+#if COLOR_DEPTH == 8
+	for (i = 0; i < 256; i++)
+		lcd_lut[i] = ((((i >> 5) << 1) | (i >> 7)) << 8) |
+			     (((((i >> 2) & 7) << 1) | ((i >> 4) & 1)) << 4) |
+			     ((i & 3) * 5);
+#endif
 }
 
 /*
@@ -238,16 +305,43 @@ void lcd_dev_rotation(bool rotated)
 	}
 }
 
+/*
+ *	Set the SPI clock, see lcd_dev_spi_rate(). The LCD has no
+ *	connection for reading it back, so whether it still works
+ *	with a faster clock can only be seen on it. Returns the
+ *	clock set.
+ */
+uint32_t lcd_dev_spi_clock(uint8_t div)
+{
+	lcd_dma_wait();
+
+	return spi_set_baudrate(LCD_SPI, lcd_dev_spi_rate(div));
+}
+
 /*
  *	DMA transfer interrupt handler
  */
 static void __not_in_flash_func(lcd_dma_irq_handler)(void)
 {
-	if (lcd_dma_active) { /* is there an active transfer from us? */
+	/* is there an active transfer from us? the IRQ is shared */
+	if (lcd_dma_active &&
+	    dma_irqn_get_channel_status(LCD_DMA_IRQ - DMA_IRQ_0,
+					lcd_dma_channel)) {
 		if (LCD_DMA_IRQ == DMA_IRQ_0)
 			dma_channel_acknowledge_irq0(lcd_dma_channel);
 		else
 			dma_channel_acknowledge_irq1(lcd_dma_channel);
+#if COLOR_DEPTH == 8
+		if (lcd_xlen) {
+			/* send the next chunk and expand the one after it */
+			dma_channel_transfer_from_buffer_now(lcd_dma_channel,
+							     lcd_xbuf[lcd_xnext],
+							     lcd_xlen);
+			lcd_xnext ^= 1;
+			lcd_xlen = lcd_expand(lcd_xbuf[lcd_xnext]);
+			return;
+		}
+#endif
 		/* DMA transfer done doesn't mean that the SPI FIFO is empty */
 		while (spi_is_busy(LCD_SPI))
 			tight_loop_contents();
@@ -266,16 +360,27 @@ static void __not_in_flash_func(lcd_dma_wait)(void)
 }
 
 /*
- *	Send a pixmap to the LCD controller using DMA
+ *	Send the changed rows of a pixmap to the LCD controller using DMA,
+ *	the pixmap is marked clean afterwards. The rows are contiguous in
+ *	the pixmap, so they are sent with one transfer into a row window,
+ *	with 8-bit pixels in chunks of expanded rows.
  */
 void __not_in_flash_func(lcd_dev_send_pixmap)(draw_pixmap_t *pixmap)
 {
 	uint8_t x = 40, y = lcd_rotated ? 52 : 53;
+	uint16_t y0 = pixmap->dirty_y0, y1 = pixmap->dirty_y1;
+#if COLOR_DEPTH == 8
+	uint32_t n;
+#endif
+
+	if (y0 > y1)			/* nothing changed */
+		return;
+	draw_clean(pixmap);
 
 	lcd_dma_wait();
 
 	lcd_dev_send_cmd(0x3a);		/* Interface Pixel Format */
-#if COLOR_DEPTH == 12
+#if COLOR_DEPTH == 12 || COLOR_DEPTH == 8
 	lcd_dev_send_byte(0x03);	/* 12-bit */
 #else
 	lcd_dev_send_byte(0x05);	/* 16-bit */
@@ -284,13 +389,25 @@ void __not_in_flash_func(lcd_dev_send_pixmap)(draw_pixmap_t *pixmap)
 	lcd_dev_send_word(x);
 	lcd_dev_send_word(x + pixmap->width - 1);
 	lcd_dev_send_cmd(0x2b);		/* Row Address Set */
-	lcd_dev_send_word(y);
-	lcd_dev_send_word(y + pixmap->height - 1);
+	lcd_dev_send_word(y + y0);
+	lcd_dev_send_word(y + y1);
 	lcd_dev_send_cmd(0x2c);		/* Memory Write */
 	gpio_put(WAVESHARE_LCD_DC_PIN, 1);
 	gpio_put(WAVESHARE_LCD_CS_PIN, 0);
 	lcd_dma_active = true;
-	dma_channel_transfer_from_buffer_now(lcd_dma_channel, pixmap->bits,
+#if COLOR_DEPTH == 8
+	lcd_xpixmap = pixmap;
+	lcd_xrow = y0;
+	lcd_xend = y1;
+	n = lcd_expand(lcd_xbuf[0]);
+	lcd_xnext = 1;
+	lcd_xlen = lcd_expand(lcd_xbuf[1]);
+	dma_channel_transfer_from_buffer_now(lcd_dma_channel, lcd_xbuf[0], n);
+#else
+	dma_channel_transfer_from_buffer_now(lcd_dma_channel,
+					     pixmap->bits +
+					     y0 * pixmap->stride,
 					     (uint32_t) pixmap->stride *
-					     pixmap->height);
+					     (y1 - y0 + 1));
+#endif
 }
@@ -16,6 +16,7 @@ extern void lcd_dev_init(uint8_t backlight);
 extern void lcd_dev_exit(void);
 extern void lcd_dev_backlight(uint8_t value);
 extern void lcd_dev_rotation(bool rotated);
+extern uint32_t lcd_dev_spi_clock(uint8_t div);
 extern void lcd_dev_send_pixmap(draw_pixmap_t *pixmap);
 
 #endif /* !LCD_DEV_INC */
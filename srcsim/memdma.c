@@ -0,0 +1,132 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Memory to memory DMA device, moves or fills a block of memory in
+ * and between the banks with one command, instead of a LDIR or a CPU
+ * loop, and without switching the banks of the CPU.
+ *
+ * Output to the port:
+ *	10H		next two bytes written are the address of the
+ *			command bytes, low byte first
+ *	20H		move the block from source to destination
+ *	30H		fill the destination with byte 0 of the command
+ *
+ * Command bytes:
+ *	0	source address low, fill byte
+ *	1	source address high
+ *	2	source bank
+ *	3	destination address low
+ *	4	destination address high
+ *	5	destination bank
+ *	6	length low
+ *	7	length high, a length of 0 is 64 KB
+ *
+ * A bank FFH is the bank selected by the CPU, addresses in the common
+ * segment are the same in all banks. Moves go forward like LDIR, also
+ * for overlapping blocks. Input from the port returns the status of
+ * the last command, which is 00H after a reset, so software can find
+ * the device by reading 00H instead of FFH from the unused port.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "memdma.h"
+
+#define MEMDMA_CMDLEN	8	/* number of command bytes */
+#define MEMDMA_CURBNK	0xff	/* the bank selected by the CPU */
+
+static enum { MEMDMA_CMD, MEMDMA_ADRL, MEMDMA_ADRH } state;
+static WORD cmd_addr;		/* address of the command bytes */
+static BYTE status;		/* status of the last command */
+
+/*
+ * execute a move or fill with the command bytes
+ */
+static BYTE memdma_exec(bool fill)
+{
+	BYTE cb[MEMDMA_CMDLEN];
+	register int i;
+	unsigned len;
+
+	for (i = 0; i < MEMDMA_CMDLEN; i++)
+		cb[i] = dma_read(cmd_addr + i);
+
+	if (cb[2] == MEMDMA_CURBNK)
+		cb[2] = selbnk;
+	if (cb[5] == MEMDMA_CURBNK)
+		cb[5] = selbnk;
+	if ((!fill && cb[2] > numseg) || cb[5] > numseg)
+		return MEMDMA_STAT_BANK;
+
+	if ((len = (cb[7] << 8) | cb[6]) == 0)
+		len = 65536;
+
+	if (fill)
+		bank_fill(cb[5], (cb[4] << 8) | cb[3], cb[0], len);
+	else
+		bank_move(cb[2], (cb[1] << 8) | cb[0],
+			  cb[5], (cb[4] << 8) | cb[3], len);
+
+	return MEMDMA_STAT_OK;
+}
+
+/*
+ * reset the device, called on reset
+ */
+void memdma_reset(void)
+{
+	state = MEMDMA_CMD;
+	status = MEMDMA_STAT_OK;
+}
+
+/*
+ * I/O handler for read memory DMA status
+ */
+BYTE memdma_in(void)
+{
+	return status;
+}
+
+/*
+ * I/O handler for write memory DMA command
+ */
+void memdma_out(BYTE data)
+{
+	switch (state) {
+	case MEMDMA_ADRL:
+		cmd_addr = data;
+		state = MEMDMA_ADRH;
+		return;
+
+	case MEMDMA_ADRH:
+		cmd_addr |= data << 8;
+		state = MEMDMA_CMD;
+		return;
+
+	default:
+		break;
+	}
+
+	switch (data) {
+	case 0x10:		/* set address of command bytes */
+		state = MEMDMA_ADRL;
+		break;
+
+	case 0x20:		/* move */
+	case 0x30:		/* fill */
+		status = memdma_exec(data == 0x30);
+		break;
+
+	default:		/* unknown command */
+		status = MEMDMA_STAT_CMD;
+		break;
+	}
+}
@@ -0,0 +1,23 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Memory to memory DMA device, moves and fills across banks
+ */
+
+#ifndef MEMDMA_INC
+#define MEMDMA_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define MEMDMA_STAT_OK	 0x00	/* command done */
+#define MEMDMA_STAT_BANK 0x01	/* bank doesn't exist */
+#define MEMDMA_STAT_CMD	 0x02	/* unknown command */
+
+extern void memdma_reset(void);
+extern BYTE memdma_in(void);
+extern void memdma_out(BYTE data);
+
+#endif /* !MEMDMA_INC */
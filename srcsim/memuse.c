@@ -0,0 +1,111 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Run time report of the SRAM usage, for sizing the caches, buffers
+ * and memory banks on evidence instead of the usage printed by the
+ * linker only. The unused part of the stacks of both cores is painted
+ * with MEM_PAINT at boot, the high-water mark is the lowest word
+ * overwritten since. The heap usage is from the malloc statistics of
+ * the C library, followed by the addresses and sizes of the sections
+ * and the large arrays.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>
+#include "pico.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "disks.h"
+#include "lcd.h"
+#include "memuse.h"
+
+/* from the linker script of the SDK */
+extern uint32_t __StackBottom[], __StackTop[];
+extern uint32_t __StackOneBottom[], __StackOneTop[];
+extern char __data_start__[], __data_end__[];
+extern char __bss_start__[], __bss_end__[];
+extern char __end__[], __HeapLimit[];
+
+/*
+ * paint the stack of core 0 below the caller, and the stack of core 1
+ * before it is launched, called first thing in main()
+ */
+void __noinline mem_paint_stacks(void)
+{
+	uint32_t mark, *p, *sp;
+
+	sp = &mark - MEM_PAINT_GAP;
+	for (p = __StackBottom; p < sp; p++)
+		*p = MEM_PAINT;
+	for (p = __StackOneBottom; p < __StackOneTop; p++)
+		*p = MEM_PAINT;
+}
+
+/*
+ * bytes of a stack used so far
+ */
+static size_t stack_used(const uint32_t *bottom, const uint32_t *top)
+{
+	const uint32_t *p = bottom;
+
+	while (p < top && *p == MEM_PAINT)
+		p++;
+	return (size_t) (top - p) * sizeof(uint32_t);
+}
+
+/*
+ * print a line of the memory map
+ */
+void mem_line(const char *name, const void *p, size_t size)
+{
+	printf("%-16s %08lX %7lu\n", name, (unsigned long) (uintptr_t) p,
+	       (unsigned long) size);
+}
+
+void print_mem_usage(void)
+{
+	struct mallinfo mi = mallinfo();
+	size_t heap = (size_t) (__HeapLimit - __end__);
+
+	printf("Core 0 stack: %lu of %lu bytes used\n",
+	       (unsigned long) stack_used(__StackBottom, __StackTop),
+	       (unsigned long) ((__StackTop - __StackBottom) *
+				sizeof(uint32_t)));
+	printf("Core 1 stack: %lu of %lu bytes used\n",
+	       (unsigned long) stack_used(__StackOneBottom, __StackOneTop),
+	       (unsigned long) ((__StackOneTop - __StackOneBottom) *
+				sizeof(uint32_t)));
+	printf("Heap: %lu bytes in use, %lu taken of %lu\n",
+	       (unsigned long) mi.uordblks, (unsigned long) mi.arena,
+	       (unsigned long) heap);
+#if BANK_PACK
+	print_bank_pack();
+#endif
+	putchar('\n');
+
+	printf("%-16s %-8s %7s\n", "Area", "Address", "Bytes");
+	mem_line(".data", __data_start__,
+		 (size_t) (__data_end__ - __data_start__));
+	mem_line(".bss", __bss_start__,
+		 (size_t) (__bss_end__ - __bss_start__));
+	mem_line("heap", __end__, heap);
+	mem_line("core 0 stack", __StackBottom,
+		 (size_t) (__StackTop - __StackBottom) * sizeof(uint32_t));
+	mem_line("core 1 stack", __StackOneBottom,
+		 (size_t) (__StackOneTop - __StackOneBottom)
+		 * sizeof(uint32_t));
+	mem_line("bnk0", bnk0, sizeof(bnk0));
+	mem_line("bnks", bnks, sizeof(bnks));
+	print_lcd_mem();
+	print_disk_mem();
+}
@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Run time report of the SRAM usage
+ */
+
+#ifndef MEMUSE_INC
+#define MEMUSE_INC
+
+#include <stddef.h>
+
+#define MEM_PAINT	0x55aa55aaU	/* pattern of the unused stack */
+#define MEM_PAINT_GAP	64		/* words kept free below the SP */
+
+extern void mem_paint_stacks(void);
+extern void mem_line(const char *name, const void *p, size_t size);
+extern void print_mem_usage(void);
+
+#endif /* !MEMUSE_INC */
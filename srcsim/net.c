@@ -0,0 +1,338 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Network bridge device, a socket channel over the serial UART to the
+ * gateway srcnetgw/netgw on the host, which makes the TCP connection.
+ * Data is moved in blocks from and to memory, so that a terminal or
+ * BBS program doesn't poll every character through a SIO.
+ *
+ * Output to the port:
+ *	10H		next two bytes written are the address of the
+ *			command bytes, low byte first
+ *	20H		connect to the zero terminated host:port
+ *	30H		receive data
+ *	40H		send data
+ *	50H		close the connection
+ *
+ * Command bytes:
+ *	0	number of bytes, replaced with the number of bytes
+ *		transferred when the command is done
+ *	1	DMA address low
+ *	2	DMA address high
+ *
+ * Input from the port returns the status bits in net.h. A connect
+ * is pending until the gateway answers, send transfers as many bytes
+ * as fit into the UART buffer, receive as many as were received.
+ *
+ * The frames on the UART are SLIP (RFC 1055) encoded, the first
+ * byte of a frame is the type:
+ *	C host:port	connect, to the gateway
+ *	D data		send data, to the gateway
+ *	X		close the connection, to the gateway
+ *	S / G		stop / go on sending data, to the gateway
+ *	c status	connected if status is 0, else refused, from it
+ *	d data		received data, from the gateway
+ *	x		connection closed by the remote, from it
+ *
+ * While the bridge is enabled the serial UART isn't available as SIO3.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <string.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simio.h"
+
+#include "net.h"
+
+#define SLIP_END	0xc0	/* SLIP frame end */
+#define SLIP_ESC	0xdb	/* SLIP escape */
+#define SLIP_ESC_END	0xdc	/* escaped frame end */
+#define SLIP_ESC_ESC	0xdd	/* escaped escape */
+
+#define NET_FRAME	257	/* max. frame length, type and 256 bytes */
+#define NET_NAMELEN	63	/* max. length of host:port */
+#define NET_TXMIN	8	/* UART buffer room needed for sending */
+#define NET_RXSIZ	2048	/* receive buffer, power of 2 */
+#define NET_RXMSK	(NET_RXSIZ - 1)
+
+bool net_uart;			/* bridge is using the serial UART */
+
+static enum { NET_CMD, NET_ADRL, NET_ADRH } state;
+static WORD cmd_addr;		/* address of the command bytes */
+static BYTE conn;		/* NET_CONN, NET_PEND and NET_CLOSED */
+static BYTE err;		/* NET_ERR from the last command */
+
+static BYTE frame[NET_FRAME];	/* frame received */
+static int flen;		/* its length so far */
+static bool fesc;		/* escape received */
+static bool fover;		/* frame too long, ignored */
+
+static BYTE rxbuf[NET_RXSIZ];	/* data received */
+static uint32_t rxhead, rxtail;
+static bool stopped;		/* gateway was told to stop sending */
+
+/*
+ * send a frame to the gateway
+ */
+static void net_send(BYTE type, const BYTE *p, int n)
+{
+	BYTE c;
+
+	uart_put(SLIP_END);
+	uart_put(type);
+	while (n-- > 0) {
+		c = *p++;
+		if (c == SLIP_END) {
+			uart_put(SLIP_ESC);
+			uart_put(SLIP_ESC_END);
+		} else if (c == SLIP_ESC) {
+			uart_put(SLIP_ESC);
+			uart_put(SLIP_ESC_ESC);
+		} else
+			uart_put(c);
+	}
+	uart_put(SLIP_END);
+}
+
+/*
+ * process a frame received from the gateway
+ */
+static void net_frame(void)
+{
+	register int i;
+
+	switch (frame[0]) {
+	case 'c':		/* connect answer */
+		if (conn & NET_PEND)
+			conn = (flen > 1 && frame[1] == 0) ? NET_CONN
+							    : NET_CLOSED;
+		break;
+
+	case 'd':		/* received data, dropped if no room */
+		if (conn & NET_CONN)
+			for (i = 1; i < flen && rxhead - rxtail < NET_RXSIZ;
+			     i++)
+				rxbuf[rxhead++ & NET_RXMSK] = frame[i];
+		break;
+
+	case 'x':		/* closed by the remote */
+		if (conn & (NET_CONN | NET_PEND))
+			conn = NET_CLOSED;
+		break;
+
+	default:		/* unknown frame */
+		break;
+	}
+}
+
+/*
+ * decode the frames received from the gateway and tell it
+ * to stop sending while the receive buffer is filled up
+ */
+static void net_poll(void)
+{
+	uint32_t used;
+	int c;
+
+	while ((c = uart_get()) >= 0) {
+		if (c == SLIP_END) {
+			if (flen > 0 && !fover)
+				net_frame();
+			flen = 0;
+			fesc = fover = false;
+			continue;
+		}
+		if (c == SLIP_ESC) {
+			fesc = true;
+			continue;
+		}
+		if (fesc) {
+			if (c == SLIP_ESC_END)
+				c = SLIP_END;
+			else if (c == SLIP_ESC_ESC)
+				c = SLIP_ESC;
+			fesc = false;
+		}
+		if (flen < NET_FRAME)
+			frame[flen++] = (BYTE) c;
+		else
+			fover = true;
+	}
+
+	used = rxhead - rxtail;
+	if (!stopped && used >= NET_RXSIZ * 3 / 4) {
+		net_send('S', NULL, 0);
+		stopped = true;
+	} else if (stopped && used <= NET_RXSIZ / 4) {
+		net_send('G', NULL, 0);
+		stopped = false;
+	}
+}
+
+/*
+ * drop the connection and the data received for it
+ */
+static void net_drop(void)
+{
+	if (conn & (NET_CONN | NET_PEND))
+		net_send('X', NULL, 0);
+	conn = 0;
+	rxhead = rxtail = 0;
+	if (stopped) {
+		net_send('G', NULL, 0);
+		stopped = false;
+	}
+}
+
+/*
+ * connect to the host:port named in memory
+ */
+static BYTE net_connect(void)
+{
+	BYTE name[NET_NAMELEN];
+	WORD addr;
+	register int i;
+
+	addr = (dma_read(cmd_addr + 2) << 8) | dma_read(cmd_addr + 1);
+	for (i = 0; i < NET_NAMELEN; i++)
+		if ((name[i] = dma_read(addr + i)) == '\0')
+			break;
+	if (i == 0 || i == NET_NAMELEN)
+		return NET_ERR;
+
+	net_drop();
+	net_send('C', name, i);
+	conn = NET_PEND;
+
+	return 0;
+}
+
+/*
+ * move received data into memory, or data from memory to the gateway
+ */
+static BYTE net_data(bool send)
+{
+	BYTE buf[256];
+	WORD addr;
+	unsigned int room, len;
+	int n, done;
+
+	n = dma_read(cmd_addr);
+	addr = (dma_read(cmd_addr + 2) << 8) | dma_read(cmd_addr + 1);
+	done = 0;
+
+	if (send) {
+		if (!(conn & NET_CONN)) {
+			dma_write(cmd_addr, 0);
+			return NET_ERR;
+		}
+		/* as much as fits into the UART buffer, escaped */
+		room = uart_tx_room();
+		for (len = 3; done < n; done++) {
+			buf[done] = dma_read(addr + done);
+			len += (buf[done] == SLIP_END ||
+				buf[done] == SLIP_ESC) ? 2 : 1;
+			if (len > room)
+				break;
+		}
+		if (done > 0)
+			net_send('D', buf, done);
+	} else {
+		net_poll();
+		for (; done < n && rxtail != rxhead; done++)
+			dma_write(addr + done, rxbuf[rxtail++ & NET_RXMSK]);
+	}
+
+	dma_write(cmd_addr, (BYTE) done);
+
+	return 0;
+}
+
+/*
+ * close the connection and reset the device, called on reset and exit
+ */
+void net_reset(void)
+{
+	if (net_uart)
+		net_drop();
+	state = NET_CMD;
+	err = 0;
+}
+
+/*
+ * I/O handler for read network bridge status
+ */
+BYTE net_in(void)
+{
+	BYTE stat;
+
+	if (!net_uart)
+		return NET_ERR;
+
+	net_poll();
+	stat = conn | err;
+	if (rxhead != rxtail)
+		stat |= NET_RXRDY;
+	if ((conn & NET_CONN) && uart_tx_room() >= NET_TXMIN)
+		stat |= NET_TXRDY;
+
+	return stat;
+}
+
+/*
+ * I/O handler for write network bridge command
+ */
+void net_out(BYTE data)
+{
+	switch (state) {
+	case NET_ADRL:
+		cmd_addr = data;
+		state = NET_ADRH;
+		return;
+
+	case NET_ADRH:
+		cmd_addr |= data << 8;
+		state = NET_CMD;
+		return;
+
+	default:
+		break;
+	}
+
+	if (!net_uart && data != 0x10) {
+		err = NET_ERR;
+		return;
+	}
+
+	switch (data) {
+	case 0x10:		/* set address of command bytes */
+		state = NET_ADRL;
+		break;
+
+	case 0x20:		/* connect */
+		err = net_connect();
+		break;
+
+	case 0x30:		/* receive data */
+	case 0x40:		/* send data */
+		err = net_data(data == 0x40);
+		break;
+
+	case 0x50:		/* close connection */
+		net_drop();
+		err = 0;
+		break;
+
+	default:		/* unknown command */
+		err = NET_ERR;
+		break;
+	}
+}
@@ -0,0 +1,28 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Network bridge device, a socket channel over the serial UART
+ */
+
+#ifndef NET_INC
+#define NET_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define NET_RXRDY	0x01	/* received data available */
+#define NET_TXRDY	0x02	/* room for sending data */
+#define NET_CONN	0x04	/* connected */
+#define NET_PEND	0x08	/* connect pending */
+#define NET_CLOSED	0x10	/* connection refused or closed by the remote */
+#define NET_ERR		0x80	/* last command failed */
+
+extern bool net_uart;
+
+extern void net_reset(void);
+extern BYTE net_in(void);
+extern void net_out(BYTE data);
+
+#endif /* !NET_INC */
@@ -0,0 +1,151 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Arithmetic assist device for p-code interpreters. The 8080 and Z80
+ * p-code interpreters keep the evaluation stack on the CPU stack and
+ * spend hundreds of T-states in shift and subtract loops for integer
+ * multiply and divide. A patched interpreter passes the stack pointer
+ * to the device, which does the operation directly on the stack in
+ * memory, the interpreter then drops the top word itself.
+ *
+ * Output to the port:
+ *	10H		next two bytes written are the address of the
+ *			top of the stack, low byte first
+ *	20H		NOS = NOS * TOS, low 16 bits of the product
+ *	21H		NOS = NOS / TOS, signed, truncated towards zero
+ *	22H		NOS = NOS % TOS, signed, sign of NOS
+ *
+ * TOS is the word at the stack address, NOS the word above it, both
+ * low byte first. Dividing by zero leaves the stack unchanged, so the
+ * interpreter can raise its own execution error. Input from the port
+ * returns the status of the last command.
+ *
+ * DVI of a patched interpreter for example becomes:
+ *	LD	A,10H
+ *	OUT	(18),A
+ *	LD	HL,0
+ *	ADD	HL,SP
+ *	LD	A,L
+ *	OUT	(18),A
+ *	LD	A,H
+ *	OUT	(18),A
+ *	LD	A,21H
+ *	OUT	(18),A
+ *	IN	A,(18)
+ *	OR	A
+ *	JP	NZ,DIVERR
+ *	POP	HL		drop TOS
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "pcode.h"
+
+static enum { PCODE_CMD, PCODE_ADRL, PCODE_ADRH } state;
+static WORD sp_addr;		/* address of the top of the stack */
+static BYTE status;		/* status of the last command */
+
+static inline WORD get_word(WORD addr)
+{
+	return dma_read(addr) | (dma_read(addr + 1) << 8);
+}
+
+static inline void put_word(WORD addr, WORD w)
+{
+	dma_write(addr, w & 0xff);
+	dma_write(addr + 1, w >> 8);
+}
+
+/*
+ * execute the operation on TOS and NOS
+ */
+static BYTE pcode_arith(BYTE cmd)
+{
+	int16_t tos, nos;
+	WORD res;
+
+	tos = (int16_t) get_word(sp_addr);
+	nos = (int16_t) get_word(sp_addr + 2);
+
+	switch (cmd) {
+	case 0x20:
+		res = (WORD) (nos * tos);
+		break;
+
+	default:
+		if (tos == 0)
+			return PCODE_STAT_DIV0;
+		/* in int, so -32768 / -1 wraps like in the interpreter */
+		if (cmd == 0x21)
+			res = (WORD) (nos / tos);
+		else
+			res = (WORD) (nos % tos);
+		break;
+	}
+
+	put_word(sp_addr + 2, res);
+
+	return PCODE_STAT_OK;
+}
+
+/*
+ * reset the device, called on reset
+ */
+void pcode_reset(void)
+{
+	state = PCODE_CMD;
+	status = PCODE_STAT_OK;
+}
+
+/*
+ * I/O handler for read arithmetic assist status
+ */
+BYTE pcode_in(void)
+{
+	return status;
+}
+
+/*
+ * I/O handler for write arithmetic assist command
+ */
+void __not_in_flash_func(pcode_out)(BYTE data)
+{
+	switch (state) {
+	case PCODE_ADRL:
+		sp_addr = data;
+		state = PCODE_ADRH;
+		return;
+
+	case PCODE_ADRH:
+		sp_addr |= data << 8;
+		state = PCODE_CMD;
+		return;
+
+	default:
+		break;
+	}
+
+	switch (data) {
+	case 0x10:		/* set address of the top of the stack */
+		state = PCODE_ADRL;
+		break;
+
+	case 0x20:		/* multiply */
+	case 0x21:		/* divide */
+	case 0x22:		/* remainder */
+		status = pcode_arith(data);
+		break;
+
+	default:		/* unknown command */
+		status = PCODE_STAT_CMD;
+		break;
+	}
+}
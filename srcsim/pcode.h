@@ -0,0 +1,23 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Arithmetic assist device for p-code interpreters
+ */
+
+#ifndef PCODE_INC
+#define PCODE_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define PCODE_STAT_OK	0x00	/* command done */
+#define PCODE_STAT_DIV0	0x01	/* division by zero, stack unchanged */
+#define PCODE_STAT_CMD	0x02	/* unknown command */
+
+extern void pcode_reset(void);
+extern BYTE pcode_in(void);
+extern void pcode_out(BYTE data);
+
+#endif /* !PCODE_INC */
@@ -0,0 +1,251 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Periodic performance records, for the data of many units to choose
+ * the default cache sizes and clock profiles from. A repeating timer
+ * on core 0 takes the counters every PERFLOG_MIN minutes into a ring,
+ * so that the T-states and the disk counters go together. perflog_task()
+ * on core 1 makes a line of CSV from the differences to the counters
+ * before, with the chip temperature read there like for the LCD, and
+ * appends PERFLOG_BATCH lines at once to PERFLOG_FILE. The rest is
+ * written when the machine stops. A new file starts with a comment
+ * line with the board ID, the system clock and the track cache, and
+ * a line with the names of the columns:
+ *
+ *	uptime_s	seconds since the power on
+ *	mhz		emulated CPU clock
+ *	core0_pct	time of core 0 not slept by the speed throttle
+ *	reads, writes	sectors of all drives
+ *	hit_pct		sector reads served by the track cache
+ *	sd_p50_us ...	latency percentiles of the MicroSD transfers,
+ *	sd_p99_us	the upper bounds of the histogram buckets
+ *	usb_bps		bytes per second in and out of the USB consoles
+ *	temp_c		chip temperature
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+#include "perflog.h"
+#include "disks.h"
+#include "picosim.h"
+#include "simio.h"
+
+#if PERFLOG80
+
+#ifndef PERFLOG_BATCH
+#define PERFLOG_BATCH	6	/* records appended at once */
+#endif
+#define PERFLOG_RING	8	/* counters waiting for core 1, a power of 2 */
+#define PERFLOG_LINE	128	/* max. length of a record */
+#define PERFLOG_FLUSH_MS 1000	/* perflog_stop() waits that long at most */
+
+typedef struct perflog_ctr {
+	bool base;		/* taken at the start, no record */
+	uint64_t us;		/* time since the power on */
+	Tstates_t T;		/* T-states of the CPU */
+	uint64_t slept;		/* slept by the speed throttle */
+	uint32_t reads, writes;	/* sectors of all drives */
+	uint32_t hits, misses;	/* sector reads from the cache, the card */
+	uint32_t lat[DISK_LAT_BUCKETS]; /* latency of the transfers */
+	uint32_t usb;		/* bytes of the USB consoles */
+} perflog_ctr_t;
+
+static perflog_ctr_t perflog_ring[PERFLOG_RING];
+static volatile uint32_t perflog_head;	/* counters taken (W0 R1) */
+static volatile uint32_t perflog_tail;	/* counters done (W1 R0) */
+static volatile bool perflog_flush;	/* write the rest (W0 W1) */
+static repeating_timer_t perflog_timer;
+static bool perflog_on;
+
+static perflog_ctr_t perflog_last;	/* the counters before (core 1) */
+static char perflog_buf[PERFLOG_BATCH * PERFLOG_LINE];
+static size_t perflog_len;
+static int perflog_recs;
+
+/*
+ * take the counters into the ring, on core 0, dropped if it is full
+ */
+static void perflog_take(bool base)
+{
+	const uint32_t head = perflog_head;
+	perflog_ctr_t *c;
+	register int i, j;
+
+	if (head - perflog_tail >= PERFLOG_RING)
+		return;
+	c = &perflog_ring[head % PERFLOG_RING];
+	c->base = base;
+	c->us = time_us_64();
+	c->T = T;
+	c->slept = throttle_slept;
+	c->reads = c->writes = c->hits = c->misses = 0;
+	memset(c->lat, 0, sizeof(c->lat));
+	for (i = 0; i < NUMDISK; i++) {
+		c->reads += disk_stats[i].reads;
+		c->writes += disk_stats[i].writes;
+		c->hits += disk_stats[i].hits;
+		c->misses += disk_stats[i].misses;
+		for (j = 0; j < DISK_LAT_BUCKETS; j++)
+			c->lat[j] += disk_stats[i].lat[j];
+	}
+	c->usb = usb_bytes;
+	__dmb();		/* the counters before the head */
+	perflog_head = head + 1;
+	__sev();		/* wake up core 1 */
+}
+
+static bool perflog_tick(repeating_timer_t *rt)
+{
+	UNUSED(rt);
+
+	perflog_take(false);
+	return true;
+}
+
+/*
+ * upper bound in us of the bucket with the p percent of n transfers
+ * of the latency histogram d
+ */
+static uint32_t perflog_pct(const uint32_t *d, uint32_t n, unsigned p)
+{
+	uint32_t want = (uint32_t) (((uint64_t) n * p + 99) / 100), sum = 0;
+	register int i;
+
+	if (n == 0)
+		return 0;
+	for (i = 0; i < DISK_LAT_BUCKETS - 1; i++)
+		if ((sum += d[i]) >= want)
+			return 2UL << i;
+	return 1UL << (DISK_LAT_BUCKETS - 1);
+}
+
+/*
+ * make the record of counters c, to the counters l before
+ */
+static void perflog_record(const perflog_ctr_t *c, const perflog_ctr_t *l)
+{
+	uint64_t us = c->us - l->us, slept = c->slept - l->slept;
+	uint32_t d[DISK_LAT_BUCKETS], n = 0, hits, rd;
+	unsigned clk, util, hit;
+	int temp, len;
+	register int i;
+
+	if (us == 0 || perflog_len + PERFLOG_LINE > sizeof(perflog_buf))
+		return;
+	for (i = 0; i < DISK_LAT_BUCKETS; i++)
+		n += (d[i] = c->lat[i] - l->lat[i]);
+	clk = (unsigned) ((c->T - l->T) * 100 / us);
+	util = slept >= us ? 0 : (unsigned) (100 - slept * 100 / us);
+	hits = c->hits - l->hits;
+	rd = hits + c->misses - l->misses;
+	hit = rd ? (unsigned) ((uint64_t) hits * 100 / rd) : 0;
+	temp = (int) (read_onboard_temp() * 10.0f + 0.5f);
+
+	len = snprintf(&perflog_buf[perflog_len], PERFLOG_LINE,
+		       "%lu,%u.%02u,%u,%lu,%lu,%u,%lu,%lu,%lu,%lu,%d.%d\n",
+		       (unsigned long) (c->us / 1000000), clk / 100, clk % 100,
+		       util, (unsigned long) (c->reads - l->reads),
+		       (unsigned long) (c->writes - l->writes), hit,
+		       (unsigned long) perflog_pct(d, n, 50),
+		       (unsigned long) perflog_pct(d, n, 90),
+		       (unsigned long) perflog_pct(d, n, 99),
+		       (unsigned long) ((uint64_t) (c->usb - l->usb) * 1000000
+					/ us),
+		       temp / 10, temp % 10);
+	if (len > 0 && len < PERFLOG_LINE) {
+		perflog_len += len;
+		perflog_recs++;
+	}
+}
+
+/*
+ * append the records made, with the header in a new file
+ */
+static void perflog_write(void)
+{
+	char id[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+	char hdr[160];
+
+	pico_get_unique_board_id_string(id, sizeof(id));
+	snprintf(hdr, sizeof(hdr),
+		 "# board %s, %lu MHz, %d cache tracks\n"
+		 "uptime_s,mhz,core0_pct,reads,writes,hit_pct,"
+		 "sd_p50_us,sd_p90_us,sd_p99_us,usb_bps,temp_c\n",
+		 id, (unsigned long) (clock_get_hz(clk_sys) / 1000000),
+		 DISK_CACHE_TRACKS);
+	perflog_save(hdr, perflog_buf, perflog_len);
+	perflog_len = 0;
+	perflog_recs = 0;
+}
+
+/*
+ * make the records of the counters taken, on core 1
+ */
+void perflog_task(void)
+{
+	const bool flush = perflog_flush;
+	uint32_t tail = perflog_tail;
+	const perflog_ctr_t *c;
+
+	__dmb();		/* the last counters before the flush */
+	while (tail != perflog_head) {
+		__dmb();	/* the counters after the head */
+		c = &perflog_ring[tail % PERFLOG_RING];
+		if (!c->base)
+			perflog_record(c, &perflog_last);
+		perflog_last = *c;
+		perflog_tail = ++tail;
+	}
+
+	if (perflog_recs >= PERFLOG_BATCH || (flush && perflog_len))
+		perflog_write();
+	if (flush)
+		perflog_flush = false;
+}
+
+/*
+ * start the records, called when the machine starts
+ */
+void perflog_start(void)
+{
+	perflog_take(true);
+	perflog_on = add_repeating_timer_us(-(int64_t) PERFLOG_MIN * 60000000,
+					    perflog_tick, NULL,
+					    &perflog_timer);
+}
+
+/*
+ * take the last record and wait until core 1 wrote the records,
+ * called when the machine stops
+ */
+void perflog_stop(void)
+{
+	const absolute_time_t t = make_timeout_time_ms(PERFLOG_FLUSH_MS);
+
+	if (!perflog_on)
+		return;
+	cancel_repeating_timer(&perflog_timer);
+	perflog_on = false;
+	perflog_take(false);
+	__dmb();		/* the counters before the flush */
+	perflog_flush = true;
+	__sev();
+	while (perflog_flush && !time_reached(t))
+		sleep_us(100);
+}
+
+#endif /* PERFLOG80 */
@@ -0,0 +1,56 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Periodic performance records for comparing many units
+ */
+
+#ifndef PERFLOG_INC
+#define PERFLOG_INC
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * With PERFLOG80 a record of the performance counters is appended to
+ * PERFLOG_FILE every PERFLOG_MIN minutes while the machine runs, as a
+ * line of CSV: the emulated clock, the utilization of core 0, the disk
+ * sectors with the hit rate of the track cache, the latency of the
+ * MicroSD, the USB console bytes, the chip temperature and the uptime.
+ * See perflog.c.
+ */
+#ifndef PERFLOG80
+#define PERFLOG80	0	/* performance records */
+#endif
+
+#if PERFLOG80
+
+#ifndef PERFLOG_MIN
+#define PERFLOG_MIN	10	/* minutes between the records */
+#endif
+#define PERFLOG_FILE	"/CONF80/PERF.LOG"
+
+extern void perflog_start(void), perflog_stop(void);
+extern void perflog_task(void);
+
+/* appending the records, in disks.c */
+extern bool perflog_save(const char *hdr, const char *buf, size_t len);
+
+#else /* !PERFLOG80 */
+
+static inline void perflog_start(void)
+{
+}
+
+static inline void perflog_stop(void)
+{
+}
+
+static inline void perflog_task(void)
+{
+}
+
+#endif /* !PERFLOG80 */
+
+#endif /* !PERFLOG_INC */
@@ -17,10 +17,47 @@
  * 15-JUN-2024 added access to RP2040-GEEK LCD display
  * 24-JUN-2024 added emulation of Cromemco Dazzler
  * 08-DEC-2024 ported to RP2350-GEEK
+ * 14-OCT-2026 ICE commands for disk statistics
+ * 14-OCT-2026 ICE command for changing disks
+ * 14-OCT-2026 start loaded files at their entry point
+ * 14-OCT-2026 save and resume machine snapshots
+ * 14-OCT-2026 CPU speed throttle with drift correction and disk turbo
+ * 14-OCT-2026 run at full speed for some seconds after reset
+ * 14-OCT-2026 ICE commands for the I/O port access counters
+ * 14-OCT-2026 ICE command for the performance info on the LCD
+ * 14-OCT-2026 system clock profiles
+ * 14-OCT-2026 ICE command for read-only USB mass storage access
+ * 14-OCT-2026 ICE command for the MicroSD card statistics
+ * 14-OCT-2026 ICE command for the benchmark kernels
+ * 14-OCT-2026 ICE commands for the opcode profiler
+ * 14-OCT-2026 ICE command for the PC profiler
+ * 14-OCT-2026 report of the time of core 0 spent in the subsystems
+ * 14-OCT-2026 ICE command for the events in the trace stream
+ * 14-OCT-2026 branch trace post-mortem on stops and watchdog resets
+ * 14-OCT-2026 record or replay the inputs of a run
+ * 14-OCT-2026 ICE commands for the memory watchpoints
+ * 14-OCT-2026 don't wait for the terminal with autoboot
+ * 14-OCT-2026 restart with a machine profile without a key
+ * 14-OCT-2026 warm restart without a reboot of the Pico
+ * 14-OCT-2026 wait in HALT and for commands with __wfe()
+ * 14-OCT-2026 CPU speed and full speed window set from the hwctl port
+ * 14-OCT-2026 end the wait in HALT at the next T-state event
+ * 14-OCT-2026 poll the remote control channel in HALT and at the prompts
+ * 14-OCT-2026 ICE mount command for all drives
+ * 14-OCT-2026 stack painting and memory usage report
+ * 14-OCT-2026 CPU speed in kHz paced in short slices
+ * 14-OCT-2026 unattended batch jobs
+ * 14-OCT-2026 emulated clock with the LCD displays shown
+ * 14-OCT-2026 flush the asynchronous log when the CPU stops
+ * 14-OCT-2026 hang detector
+ * 14-OCT-2026 ICE commands of the MMU and interrupt latency profiler
+ * 14-OCT-2026 periodic performance records
+ * 14-OCT-2026 ICE command for read only pages of bank 0
  */
 
 /* Raspberry SDK and FatFS includes */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #if LIB_PICO_STDIO_USB || LIB_STDIO_MSC_USB
@@ -30,10 +67,20 @@
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "hardware/adc.h"
+#include "hardware/clocks.h"
 #include "hardware/uart.h"
+#include "hardware/vreg.h"
 #include "hardware/watchdog.h"
+#if PICO_RP2040
+#include "hardware/structs/ssi.h"
+#else
+#include "hardware/structs/qmi.h"
+#endif
 
 #include "hw_config.h"
+#if LIB_STDIO_MSC_USB
+#include "stdio_msc_usb.h"
+#endif
 #include "my_rtc.h"
 
 /* Project includes */
@@ -49,14 +96,238 @@
 #include "simice.h"
 #endif
 
+#include "sd-fdc.h"
+#include "batch.h"
+#include "alog.h"
+#include "hang.h"
+#include "latprof.h"
+#include "perflog.h"
+#include "bench.h"
+#include "dazzler.h"
 #include "disks.h"
 #include "draw.h"
 #include "gpio.h"
 #include "lcd.h"
+#include "memuse.h"
 #include "picosim.h"
 #include "debug.h"
+#include "sched.h"
+#include "remote.h"
+#include "trace.h"
 
 #ifdef WANT_ICE
+#if MEM_WP
+/*
+ * ICE command "! wp [addr len [rwb]]", sets a watchpoint range
+ * or shows them
+ */
+static void picosim_ice_wp(char *s)
+{
+	unsigned long addr, len;
+	BYTE mode = 0;
+	char *p;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	if (*s == '\0') {
+		print_wp();
+		return;
+	}
+	addr = strtoul(s, &p, 16);
+	len = strtoul(p, &s, 16);
+	if (p == s || addr > 0xffff || len == 0) {
+		puts("address and length in hex required");
+		return;
+	}
+	for (; *s; s++)
+		switch (tolower((unsigned char) *s)) {
+		case 'r':
+			mode |= WP_READ;
+			break;
+		case 'w':
+			mode |= WP_WRITE;
+			break;
+		case 'b':
+			mode |= WP_BREAK;
+			break;
+		default:
+			break;
+		}
+	if (!(mode & (WP_READ | WP_WRITE)))
+		mode |= WP_READ | WP_WRITE;
+	if (!wp_set((WORD) addr, (unsigned) len, mode))
+		printf("all %d watchpoints used\n", WP_RANGES);
+}
+
+#endif
+
+/*
+ *	Make a range of bank 0 a read only overlay, a ROM loaded with r
+ *	before stays as it is when the program writes into it. Below the
+ *	common segment the range is protected in bank 0, or shown in all
+ *	banks with *. Without arguments the overlays are shown, with - all
+ *	but the boot ROM are removed.
+ */
+static void picosim_ice_rom(char *s)
+{
+	unsigned long addr, len;
+	bool all;
+	char *p;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	if (*s == '\0') {
+		print_overlays();
+		return;
+	}
+	if (*s == '-') {
+		mem_overlay_clear();
+		return;
+	}
+	addr = strtoul(s, &p, 16);
+	len = strtoul(p, &s, 16);
+	if (p == s || addr > 0xffff || len == 0 || addr % PAGESIZ ||
+	    len % PAGESIZ) {
+		puts("address and length in hex required, multiples of 100");
+		return;
+	}
+	while (isspace((unsigned char) *s))
+		s++;
+	all = (*s == '*' || addr >= segsiz);
+	if (!mem_overlay(all ? OVL_ALL : 0, (WORD) addr, &bnk0[addr],
+			 (unsigned) len))
+		printf("doesn't fit, or all %d overlays used\n", MAXOVL);
+}
+
+/*
+ *	Split the file name from the arguments of the load and save
+ *	commands, the name is converted to upper case, returns the
+ *	arguments.
+ */
+static char *picosim_ice_name(char *s)
+{
+	while (isspace((unsigned char) *s))
+		s++;
+	for (; *s && !isspace((unsigned char) *s); s++)
+		*s = toupper((unsigned char) *s);
+	if (*s)
+		*s++ = '\0';
+	return s;
+}
+
+/*
+ *	Parse the bank of a load or save, the selected one if there is
+ *	none, returns false if it doesn't exist.
+ */
+static bool picosim_ice_bank(char *s, BYTE *bank)
+{
+	unsigned long n;
+	char *p;
+
+	n = strtoul(s, &p, 16);
+	if (p == s) {
+		*bank = selbnk;
+		return true;
+	}
+	if (n > (unsigned long) numseg) {
+		printf("bank %lu doesn't exist, 0 - %d\n", n, numseg);
+		return false;
+	}
+	*bank = (BYTE) n;
+	return true;
+}
+
+/*
+ *	ICE command "w filename addr len [bank]", saves a memory range
+ *	of a bank into a file, the bank is mapped for the transfer only.
+ */
+static void picosim_ice_save(char *s)
+{
+	unsigned long addr, len;
+	char *name = s, *p;
+	BYTE bank, sel = selbnk;
+
+	s = picosim_ice_name(s);
+	addr = strtoul(s, &p, 16);
+	len = strtoul(p, &s, 16);
+	if (*name == '\0' || p == s || addr > 0xffff || len == 0) {
+		puts("file name, address and length in hex required");
+		return;
+	}
+	if (!picosim_ice_bank(s, &bank))
+		return;
+	bank_map(bank);
+	save_file(name, (WORD) addr, (uint32_t) len);
+	bank_map(sel);
+}
+
+/*
+ *	ICE command "r filename [addr [bank]]", loads a file at its
+ *	address, or at addr in a bank, which is mapped for it only.
+ */
+static bool picosim_ice_load(char *s, WORD *start)
+{
+	unsigned long addr;
+	char *name = s, *p;
+	BYTE bank, sel = selbnk;
+	bool res;
+
+	s = picosim_ice_name(s);
+	addr = strtoul(s, &p, 16);
+	if (p == s)	/* at the address of the file */
+		return load_file(name, start);
+	if (addr > 0xffff) {
+		puts("address in hex required");
+		return false;
+	}
+	if (!picosim_ice_bank(p, &bank))
+		return false;
+	bank_map(bank);
+	res = load_file_at(name, (WORD) addr);
+	bank_map(sel);
+	*start = (WORD) addr;
+	return res;
+}
+
+/*
+ *	Change the disk in a drive while the machine is stopped, only
+ *	the cache and file of this drive are released.
+ */
+static void picosim_ice_mount(char *s)
+{
+	int drive;
+	char *p;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	drive = (int) strtol(s, &p, 10);
+	if (p == s || drive < 0 || drive >= NUMDISK) {
+		printf("drive 0 - %d required\n", NUMDISK - 1);
+		return;
+	}
+	s = p;
+	while (isspace((unsigned char) *s))
+		s++;
+	for (p = s; *p; p++)
+		*p = toupper((unsigned char) *p);
+
+	if (*s == '\0') {
+		unmount_disk(drive);
+		return;
+	}
+	switch (swap_disk(drive, s, disk_overlay[drive])) {
+	case FDC_STAT_DISK:
+		puts("Disk already mounted or in another sector order");
+		break;
+	case FDC_STAT_NODISK:
+		puts("File not found");
+		break;
+	default:
+		printf("Disk %d: %s\n", drive, disks[drive]);
+		break;
+	}
+}
+
 static void picosim_ice_cmd(char *cmd, WORD *wrk_addr);
 static void picosim_ice_help(void);
 #endif
@@ -64,12 +335,79 @@ static void picosim_ice_help(void);
 #define BS  0x08 /* ASCII backspace */
 #define DEL 0x7f /* ASCII delete */
 
-/* CPU speed */
+/* CPU speed in kHz and its whole MHz, 0 is unlimited */
+int speed_khz = CPU_SPEED * 1000;
 int speed = CPU_SPEED;
 
+#ifndef THROTTLE_SLICE_US
+#define THROTTLE_SLICE_US 500	/* emulated time between throttle sleeps */
+#endif
+#ifndef THROTTLE_LAG_US
+#define THROTTLE_LAG_US	10000	/* max. lag the throttle catches up */
+#endif
+
 /* initial LCD status display */
 int initial_lcd = LCD_STATUS_REGISTERS;
 
+/* run the CPU unthrottled while the disks are busy */
+bool turbo_disk;
+
+/* seconds the CPU runs unthrottled after reset, 0 = off */
+int turbo_boot;
+static absolute_time_t turbo_end;
+
+/* microseconds core 0 slept in the CPU speed throttle */
+uint64_t throttle_slept;
+
+/*
+ * start the full speed window after power on or reset,
+ * the CPU falls back to the configured speed afterwards
+ */
+void start_turbo(void)
+{
+	start_turbo_s(turbo_boot);
+}
+
+/*
+ * run the CPU at full speed for the next s seconds
+ */
+void start_turbo_s(int s)
+{
+	turbo_end = make_timeout_time_ms(s * 1000);
+}
+
+/*
+ * set the CPU speed in MHz, 0 is unlimited
+ */
+void set_speed(int mhz)
+{
+	set_speed_khz(mhz * 1000);
+}
+
+/*
+ * set the CPU speed in kHz, 0 is unlimited, else at least 1 MHz
+ */
+void set_speed_khz(int khz)
+{
+	if (khz > 0 && khz < 1000)
+		khz = 1000;
+	speed_khz = khz;
+	speed = khz / 1000;
+	f_value = speed;	/* setup speed of the CPU */
+	if (f_value)		/* T-states of a throttle slice */
+		tmax = (int) ((int64_t) khz * THROTTLE_SLICE_US / 1000);
+	else
+		tmax = 100000;	/* for periodic CPU accounting updates */
+}
+
+/*
+ * speed in MHz with three decimals
+ */
+void print_khz(int khz)
+{
+	printf("%d.%03d MHz", khz / 1000, khz % 1000);
+}
+
 /*
  *	callback for TinyUSB when terminal sends a break
  *	stops CPU
@@ -127,9 +465,165 @@ float read_onboard_temp(void)
 	return tempC;
 }
 
+/*
+ *	System clock profiles with the core voltage they need. When the
+ *	clock is changed, the dividers for the flash, SDIO, LCD SPI and
+ *	the UARTs are set again, so that they keep their rates. The flash
+ *	is kept at CLOCK_FLASH_MAX or below. A faster profile than the
+ *	one running isn't switched to if the chip is CLOCK_HOT or hotter,
+ *	then the built clock is used.
+ */
+#ifndef CLOCK_FLASH_MAX
+#define CLOCK_FLASH_MAX	133000	/* kHz */
+#endif
+#ifndef CLOCK_HOT
+#define CLOCK_HOT	70.0f	/* °C */
+#endif
+
+static const struct clock_prof {
+	uint32_t khz;
+	enum vreg_voltage vreg;
+} clock_profs[CLOCK_PROFILES] = {
+	{ 0, 0 },			/* as built, set at the first switch */
+#if PICO_RP2040
+	{ 250000, VREG_VOLTAGE_1_20 },
+	{ 300000, VREG_VOLTAGE_1_30 },
+#else
+	{ 200000, VREG_VOLTAGE_1_15 },
+	{ 250000, VREG_VOLTAGE_1_20 },
+	{ 300000, VREG_VOLTAGE_1_30 },
+#endif
+};
+
+int clock_profile;			/* selected in the configuration */
+static int clock_running;		/* profile running */
+static uint32_t clock_built_khz;
+static enum vreg_voltage clock_built_vreg;
+static uint32_t clock_flash_div;	/* flash divider of the boot */
+
+uint32_t clock_profile_khz(int n)
+{
+	if (n <= 0 || n >= CLOCK_PROFILES)
+		return clock_built_khz ? clock_built_khz
+				       : clock_get_hz(clk_sys) / 1000;
+	return clock_profs[n].khz;
+}
+
+/*
+ *	Set the flash clock divider, runs from RAM with the other
+ *	core locked out, because the flash can't be read meanwhile
+ */
+static void __no_inline_not_in_flash_func(set_flash_div)(void *param)
+{
+	uint32_t div = (uint32_t) (uintptr_t) param;
+
+#if PICO_RP2040
+	ssi_hw->ssienr = 0;
+	ssi_hw->baudr = div;
+	ssi_hw->ssienr = 1;
+#else
+	qmi_hw->m[0].timing = (qmi_hw->m[0].timing &
+			       ~QMI_M0_TIMING_CLKDIV_BITS) |
+			      (div << QMI_M0_TIMING_CLKDIV_LSB);
+#endif
+}
+
+static uint32_t flash_div(uint32_t khz)
+{
+	uint32_t div = (khz + CLOCK_FLASH_MAX - 1) / CLOCK_FLASH_MAX;
+
+#if PICO_RP2040
+	div = (div + 1) & ~1;		/* SSI divider must be even */
+#endif
+	return div < clock_flash_div ? clock_flash_div : div;
+}
+
+void set_clock_profile(int n)
+{
+	uint32_t khz, cur;
+	enum vreg_voltage vreg;
+
+	if (n < 0 || n >= CLOCK_PROFILES)
+		n = 0;
+
+	if (clock_built_khz == 0) {
+		clock_built_khz = clock_get_hz(clk_sys) / 1000;
+		clock_built_vreg = vreg_get_voltage();
+#if PICO_RP2040
+		clock_flash_div = ssi_hw->baudr;
+#else
+		clock_flash_div = (qmi_hw->m[0].timing &
+				   QMI_M0_TIMING_CLKDIV_BITS) >>
+				  QMI_M0_TIMING_CLKDIV_LSB;
+#endif
+	}
+
+	khz = n ? clock_profs[n].khz : clock_built_khz;
+	vreg = n ? clock_profs[n].vreg : clock_built_vreg;
+	cur = clock_get_hz(clk_sys) / 1000;
+
+	if (khz > cur && read_onboard_temp() >= CLOCK_HOT) {
+		printf("Chip too hot for %lu MHz, using %lu MHz\n",
+		       (unsigned long) khz / 1000,
+		       (unsigned long) clock_built_khz / 1000);
+		n = 0;
+		khz = clock_built_khz;
+		vreg = clock_built_vreg;
+	}
+	if (n == clock_running || khz == cur)
+		return;
+
+	/* slow the flash down and raise the voltage before the clock */
+	if (khz > cur) {
+		flash_safe_execute(set_flash_div, (void *) (uintptr_t) flash_div(khz),
+				   UINT32_MAX);
+		vreg_set_voltage(vreg);
+		sleep_ms(10);
+	}
+	if (!set_sys_clock_khz(khz, false)) {
+		printf("%lu MHz isn't possible\n", (unsigned long) khz / 1000);
+		return;
+	}
+	clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+			khz * 1000, khz * 1000);
+	if (khz < cur) {
+		vreg_set_voltage(vreg);
+		flash_safe_execute(set_flash_div, (void *) (uintptr_t) flash_div(khz),
+				   UINT32_MAX);
+	}
+	clock_running = n;
+
+	/* the peripherals derive their dividers from clk_sys or clk_peri */
+	sio3_set_baud(sio3_baud);
+	debug_clock_changed();
+	lcd_set_spi_div(lcd_get_spi_div());
+	disk_clock_changed();
+
+	printf("System clock now %lu MHz\n", (unsigned long) khz / 1000);
+}
+
+#if BRANCH_TRACE && BRANCH_WDOG_MS > 0
+static repeating_timer_t wdog_timer;
+
+static bool wdog_kick(repeating_timer_t *rt)
+{
+	UNUSED(rt);
+
+	watchdog_update();
+	return true;
+}
+#endif
+
 int main(void)
 {
 	char s[2];
+#if BRANCH_TRACE
+	/* the trace of the run before a watchdog reset */
+	bool wdog_reset = watchdog_enable_caused_reboot()
+			  && branch_trace.magic == BRANCH_MAGIC;
+#endif
+
+	mem_paint_stacks();	/* for the stack high-water marks */
 
 	/* strings for picotool, so that it shows used pins */
 	bi_decl(bi_2pins_with_names(WAVESHARE_I2CADC_SDA_PIN,
@@ -169,11 +663,15 @@ int main(void)
 	gpio_set_function(PICO_DEFAULT_UART_TX_PIN, GPIO_FUNC_UART);
 	gpio_set_function(PICO_DEFAULT_UART_RX_PIN, GPIO_FUNC_UART);
 
-	/* when using USB UART wait until it is connected */
+	init_disks();		/* initialize disk drives */
+
+	/* when using USB UART wait until it is connected, not for autoboot */
 #if LIB_PICO_STDIO_USB || (LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO)
-	lcd_custom_disp(lcd_draw_wait_term);
-	while (!tud_cdc_connected()) {
-		sleep_ms(100);
+	if (!config_autoboot()) {
+		lcd_custom_disp(lcd_draw_wait_term);
+		while (!tud_cdc_connected()) {
+			sleep_ms(10);
+		}
 	}
 #endif
 
@@ -195,6 +693,14 @@ int main(void)
 	printf("running on ARM Cortex-M0+ cores at %i MHz\n", SYS_CLK_MHZ);
 #endif
 	printf("%s\n\n", USR_CPR);
+#if BRANCH_TRACE
+	if (wdog_reset) {
+		puts("Watchdog reset!");
+		print_branch_trace();
+		putchar('\n');
+	}
+#endif
+	hang_boot_report();	/* the machine hung before the reboot */
 
 #ifdef WANT_ICE
 	/* if ICE compiled in print some hints */
@@ -202,18 +708,47 @@ int main(void)
 	puts("For help type ? at the ICE prompt\n");
 #endif
 
+	/*
+	 * A warm restart runs the machine again from here, the MicroSD
+	 * card stays mounted, the disk images open, and the track and
+	 * directory caches and the USB connection are kept.
+	 */
+warm:
 	init_cpu();		/* initialize CPU */
 	PC = 0xff00;		/* power on jump into the boot ROM */
-	init_disks();		/* initialize disk drives */
+	snap_resume = false;
 	init_memory();		/* initialize memory configuration */
 	init_io();		/* initialize I/O devices */
 	config();		/* configure the machine */
 
-	f_value = speed;	/* setup speed of the CPU */
-	if (f_value)
-		tmax = speed * 10000;	/* theoretically */
+	set_speed_khz(speed_khz); /* setup speed of the CPU */
+
+	lcd_status_disp(initial_lcd); /* tell LCD task to display status */
+	lcd_clock_start();	/* measure the clock with the displays shown */
+
+	if (snap_resume)
+		load_snapshot(); /* continue the machine from the snapshot */
 	else
-		tmax = 100000;	/* for periodic CPU accounting updates */
+		start_turbo();	/* boot at full speed */
+#if REPLAY80
+	replay_start();		/* record or replay the inputs of the run */
+#endif
+	batch_start();		/* run the batch job, if there is one */
+	hang_start();		/* detect hangs of the guest */
+	latprof_start();	/* profile the bank switches and interrupts */
+	perflog_start();	/* append the performance records */
+
+#if CPU_BUDGET
+	budget_init();		/* start the cycle accounting of core 0 */
+#endif
+#if BRANCH_TRACE
+	init_branch_trace();	/* start the branch trace */
+#if BRANCH_WDOG_MS > 0
+	add_repeating_timer_ms(-BRANCH_WDOG_MS / 4, wdog_kick, NULL,
+			       &wdog_timer);
+	watchdog_enable(BRANCH_WDOG_MS, true);
+#endif
+#endif
 
 #ifdef SIMPLEPANEL
 	fp_led_address = PC;
@@ -221,8 +756,6 @@ int main(void)
 	cpu_bus = CPU_WO | CPU_M1 | CPU_MEMR;
 #endif
 
-	lcd_status_disp(initial_lcd); /* tell LCD task to display status */
-
 	/* run the CPU with whatever is in memory */
 #ifdef WANT_ICE
 	ice_cust_cmd = picosim_ice_cmd;
@@ -232,17 +765,53 @@ int main(void)
 	run_cpu();
 #endif
 
+#if BRANCH_TRACE && BRANCH_WDOG_MS > 0
+	watchdog_disable();
+	cancel_repeating_timer(&wdog_timer);
+#endif
+	latprof_stop();		/* stop the profiler */
+	hang_stop();		/* save the state if the machine hung */
+	alog_flush();		/* output the messages logged */
+	perflog_stop();		/* write the last performance records */
 	exit_io();		/* stop I/O devices */
-	exit_disks();		/* stop disk drives */
+	flush_disks();		/* write back disk caches */
+	if (hang_detected())
+		hang_reboot();	/* restart the machine */
 
 #ifndef WANT_ICE
 	putchar('\n');
 	report_cpu_error();	/* check for CPU emulation errors and report */
+#if BRANCH_TRACE
+	if (cpu_error != NONE)
+		print_branch_trace(); /* how the program got there */
+#endif
 	report_cpu_stats();	/* print some execution statistics */
+#if CPU_BUDGET
+	report_budget();	/* print the time of core 0 per subsystem */
+#endif
+	dazzler_report();	/* print the Dazzler drawing time */
+	lcd_clock_report();	/* print the clock with the displays shown */
+#if OP_PROF
+#ifdef DEBUG80
+	print_op_prof(0, true);	/* all opcode counts to the DEBUG port */
+#else
+	print_op_prof(OP_PROF_TOP, false);
+#endif
 #endif
-	puts("\nPress any key to restart CPU");
+#endif
+	if (profile_pending() > 0) {
+		printf("\nRestarting with machine profile %d\n\n",
+		       profile_pending());
+		goto warm;
+	}
+	puts("\nPress any key to restart CPU, C for a cold restart");
 	get_cmdline(s, 2);
+	if (tolower((unsigned char) s[0]) != 'c') {
+		putchar('\n');
+		goto warm;
+	}
 
+	exit_disks();		/* stop disk drives */
 	lcd_exit();		/* shutdown LCD */
 
 	/* reset machine */
@@ -252,6 +821,135 @@ int main(void)
 	}
 }
 
+/*
+ * Sleep of the CPU speed throttle, called by the CPU cores after
+ * every tmax T-states, that is THROTTLE_SLICE_US of emulated time.
+ * The time of the sleep asked for by the cores is for their 10 ms
+ * slices and isn't used. Instead the host time at which the T-states
+ * are due is computed from an anchor, the T-states and the host time
+ * when the pacing started, and the sleep lasts until then. So the
+ * wake up latency and fractional speeds don't add up to a drift, and
+ * the CPU runs at the set speed also in short intervals. A lag of
+ * more than THROTTLE_LAG_US, after a long interruption, isn't caught
+ * up, the pacing starts again. With turbo_disk the sleep is skipped
+ * if disk I/O was done since the last one, so that loading runs at
+ * full speed, and for turbo_boot seconds after reset, or as long as
+ * the hardware control port asked for.
+ * sleep_until() waits with __wfe() for the alarm.
+ */
+void throttle_sleep_us(unsigned long time)
+{
+	static Tstates_t pace_T;	/* T-states of the anchor */
+	static uint64_t pace_us;	/* host time of the anchor */
+	static int pace_khz;		/* speed of the anchor, 0 = none */
+	static uint32_t last_ops;
+	uint64_t now, due;
+	uint32_t ops;
+	int prev;
+	register int i;
+
+	UNUSED(time);
+
+	if (absolute_time_diff_us(get_absolute_time(), turbo_end) > 0) {
+		pace_khz = 0;
+		return;
+	}
+
+	if (turbo_disk) {
+		for (ops = 0, i = 0; i < NUMDISK; i++)
+			ops += disk_stats[i].reads + disk_stats[i].writes;
+		if (ops != last_ops) {
+			last_ops = ops;
+			pace_khz = 0;
+			return;
+		}
+	}
+
+	now = time_us_64();
+	if (pace_khz != speed_khz || T < pace_T) {
+		pace_T = T;
+		pace_us = now;
+		pace_khz = speed_khz;
+		return;
+	}
+	due = pace_us + (uint64_t) (T - pace_T) * 1000 / (unsigned) pace_khz;
+	if (due <= now) {
+		/* don't catch up after a long interruption */
+		if (now - due > THROTTLE_LAG_US)
+			pace_khz = 0;
+		return;
+	}
+	prev = budget_enter(BUDGET_SLEEP);
+	sleep_until(from_us_since_boot(due));
+	budget_exit(prev);
+	throttle_slept += time_us_64() - now;
+}
+
+/*
+ * Wait of the CPU cores in HALT for an interrupt. Core 0 waits with
+ * __wfe() until an interrupt is pending or the CPU is stopped, at most
+ * time ms. The T-states the CPU would have run in that time are added,
+ * so that the emulated time stays right. Meanwhile the LCD status
+ * panels are drawn at the idle rate. Not done in a replay, which
+ * posts the timer interrupts at their T-states. The wait ends at the
+ * time of the next event of the T-state scheduler, so that the timer
+ * interrupt comes when it is due.
+ */
+volatile bool cpu_halted;	/* core 0 waits in HALT */
+
+void halt_sleep_ms(unsigned time)
+{
+	absolute_time_t end;
+	Tstates_t next;
+	uint64_t t, us;
+	int prev;
+
+	if (replay_active()) {
+		sleep_ms(time);
+		return;
+	}
+
+	t = time_us_64();
+	end = make_timeout_time_ms(time);
+	if (speed && sched_next(&next)) {
+		us = next > T ? (next - T) * 1000 / (unsigned) speed_khz
+			      : 0;
+		if (us < (uint64_t) time * 1000)
+			end = make_timeout_time_us(us);
+	}
+	cpu_halted = true;
+	prev = budget_enter(BUDGET_SLEEP);
+	do {
+		int_service();
+		remote_poll(false);
+		if (int_int || int_nmi || cpu_state != ST_CONTIN_RUN)
+			break;
+	} while (!best_effort_wfe_or_timeout(end));
+	budget_exit(prev);
+	cpu_halted = false;
+	if (speed)
+		T += (time_us_64() - t) * (unsigned) speed_khz / 1000;
+}
+
+/*
+ * get the next character from the terminal, waiting with __wfe()
+ * for the USB or UART interrupts instead of polling
+ */
+static char wait_char(void)
+{
+	int c;
+
+	while (true) {
+		remote_poll(true);
+		if ((c = remote_getc()) >= 0)
+			break;
+		if ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT)
+			break;
+		best_effort_wfe_or_timeout(make_timeout_time_ms(10));
+	}
+	return (char) c;
+}
+
 /*
  * Read an ICE or config command line of maximum length len - 1
  * from the terminal. For single character requests (len == 2),
@@ -263,7 +961,7 @@ bool get_cmdline(char *buf, int len)
 	char c;
 
 	while (true) {
-		c = getchar();
+		c = wait_char();
 		if ((c == BS) || (c == DEL)) {
 			if (i >= 1) {
 				putchar(BS);
@@ -306,7 +1004,7 @@ static void picosim_ice_cmd(char *cmd, WORD *wrk_addr)
 {
 	char *s;
 	BYTE save[3];
-	WORD save_PC;
+	WORD save_PC, w;
 	Tstates_t T0;
 	unsigned freq;
 #ifdef WANT_HB
@@ -369,18 +1067,27 @@ static void picosim_ice_cmd(char *cmd, WORD *wrk_addr)
 			       "in 3 seconds\n", (T - T0) / 10, s);
 			printf("clock frequency = %u.%02u MHz\n",
 			       freq / 100, freq % 100);
+			if (speed) {
+				freq = (unsigned) ((T - T0) / 3000);
+				printf("target ");
+				print_khz(speed_khz);
+				printf(", measured ");
+				print_khz((int) freq);
+				printf(" = %u.%u%%\n",
+				       freq * 1000 / speed_khz / 10,
+				       freq * 1000 / speed_khz % 10);
+			}
 		} else
 			puts("Interrupted by user");
 		break;
 
 	case 'r':
-		cmd++;
-		while (isspace((unsigned char) *cmd))
-			cmd++;
-		for (s = cmd; *s; s++)
-			*s = toupper((unsigned char) *s);
-		if (load_file(cmd))
-			*wrk_addr = PC = 0;
+		if (picosim_ice_load(cmd + 1, &w))
+			*wrk_addr = PC = w;
+		break;
+
+	case 'w':
+		picosim_ice_save(cmd + 1);
 		break;
 
 	case '!':
@@ -389,6 +1096,81 @@ static void picosim_ice_cmd(char *cmd, WORD *wrk_addr)
 			cmd++;
 		if (strcasecmp(cmd, "ls") == 0)
 			list_files("/CODE80", "*.BIN");
+		else if (strcasecmp(cmd, "ds") == 0)
+			print_disk_stats();
+		else if (strcasecmp(cmd, "dz") == 0)
+			clear_disk_stats();
+		else if (strcasecmp(cmd, "sd") == 0)
+			print_sd_stats();
+		else if (strcasecmp(cmd, "mem") == 0)
+			print_mem_usage();
+#if IO_COUNT
+		else if (strcasecmp(cmd, "io") == 0)
+			print_io_count();
+		else if (strcasecmp(cmd, "iz") == 0)
+			clear_io_count();
+#endif
+#if OP_PROF
+		else if (strcasecmp(cmd, "op") == 0)
+			print_op_prof(OP_PROF_TOP, false);
+		else if (strcasecmp(cmd, "opa") == 0)
+			print_op_prof(0, false);
+#ifdef DEBUG80
+		else if (strcasecmp(cmd, "opd") == 0)
+			print_op_prof(0, true);
+#endif
+		else if (strcasecmp(cmd, "oz") == 0)
+			clear_op_prof();
+#endif
+		else if (strcasecmp(cmd, "perf") == 0)
+			printf("performance info %s\n",
+			       lcd_toggle_perf() ? "on" : "off");
+#if LIB_STDIO_MSC_USB
+		else if (strcasecmp(cmd, "msc") == 0) {
+			live_msc(!stdio_msc_usb_live_active());
+			printf("read-only USB mass storage %s\n",
+			       stdio_msc_usb_live_active() ? "on" : "off");
+		}
+#endif
+		else if (strcasecmp(cmd, "snap") == 0)
+			save_snapshot();
+		else if (strcasecmp(cmd, "bench") == 0)
+			run_bench();
+#if PC_PROF_SIZE > 0
+		else if (strcasecmp(cmd, "prof") == 0) {
+			pc_prof(!pc_prof_active());
+			printf("PC profiler %s\n",
+			       pc_prof_active() ? "on" : "off");
+		}
+#endif
+#if LATPROF80
+		else if (strcasecmp(cmd, "lt") == 0)
+			latprof_print();
+		else if (strcasecmp(cmd, "lz") == 0)
+			latprof_clear();
+#endif
+#if BRANCH_TRACE
+		else if (strcasecmp(cmd, "br") == 0)
+			print_branch_trace();
+#endif
+#if TRACE80
+		else if (strncasecmp(cmd, "trace", 5) == 0) {
+			if (cmd[5] != '\0')
+				trace_mask = (BYTE) strtoul(cmd + 5, NULL, 16)
+					     & TRACE_ALL;
+			printf("trace events %02X\n", trace_mask);
+		}
+#endif
+#if MEM_WP
+		else if (strcasecmp(cmd, "wpc") == 0)
+			wp_clear();
+		else if (strncasecmp(cmd, "wp", 2) == 0)
+			picosim_ice_wp(cmd + 2);
+#endif
+		else if (strncasecmp(cmd, "mount", 5) == 0)
+			picosim_ice_mount(cmd + 5);
+		else if (strncasecmp(cmd, "rom", 3) == 0)
+			picosim_ice_rom(cmd + 3);
 		else
 			puts("what??");
 		break;
@@ -403,8 +1185,54 @@ static void picosim_ice_help(void)
 {
 	puts("a                         switch to next LCD status display");
 	puts("c                         measure clock frequency");
-	puts("r filename                read file (without .BIN) into memory");
+	puts("r filename                read file (without .BIN/.COM/.HEX) into memory");
+	puts("r file addr [bank]        read file (without .BIN/.COM) to address");
+	puts("w file addr len [bank]    write memory into file (without .BIN)");
 	puts("! ls                      list files");
+	puts("! ds                      show disk statistics");
+	puts("! dz                      clear disk statistics");
+	puts("! sd                      show MicroSD card statistics");
+	puts("! mem                     show memory usage");
+#if IO_COUNT
+	puts("! io                      show I/O port accesses");
+	puts("! iz                      clear I/O port accesses");
+#endif
+#if OP_PROF
+	puts("! op                      show most executed opcodes and pages");
+	puts("! opa                     show all executed opcodes and pages");
+#ifdef DEBUG80
+	puts("! opd                     print all opcode counts to DEBUG port");
+#endif
+	puts("! oz                      clear opcode counts");
+#endif
+#if LIB_STDIO_MSC_USB
+	puts("! msc                     toggle read-only USB mass storage");
+#endif
+	puts("! perf                    toggle performance info on the LCD");
+	puts("! snap                    save machine snapshot");
+	puts("! bench                   run the benchmark kernels");
+#if PC_PROF_SIZE > 0
+	puts("! prof                    toggle PC profiler into " PC_PROF_FILE);
+#endif
+#if LATPROF80
+	puts("! lt                      show bank switches and interrupt latency");
+	puts("! lz                      clear bank switches and interrupt latency");
+#endif
+#if BRANCH_TRACE
+	puts("! br                      show the last branches");
+#endif
+#if TRACE80
+	puts("! trace [mask]            show or set the traced events, 01 opcodes");
+	puts("                          02 ports 04 disks 08 banks 10 interrupts");
+#endif
+#if MEM_WP
+	puts("! wp [addr len [rwb]]     show or set watchpoints, r reads w writes");
+	puts("                          b stop on a hit");
+	puts("! wpc                     clear watchpoints");
+#endif
+	puts("! mount drive [filename]  change disk (without .DSK)");
+	puts("! rom [addr len [*]|-]    show, set or remove read only pages of");
+	puts("                          bank 0, * in all banks");
 }
 
 #endif
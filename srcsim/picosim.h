@@ -7,8 +7,28 @@
 #ifndef PICOSIM_INC
 #define PICOSIM_INC
 
-extern int speed, initial_lcd;
+extern int speed, speed_khz, initial_lcd;
+extern bool turbo_disk;
+extern int turbo_boot;
+extern uint64_t throttle_slept;
+extern volatile bool cpu_halted;
+
+extern void start_turbo(void), start_turbo_s(int s);
+extern void set_speed(int mhz), set_speed_khz(int khz);
+extern void print_khz(int khz);
 
 extern float read_onboard_temp(void);
 
+/* system clock profiles, 0 is the clock the firmware was built for */
+#if PICO_RP2040
+#define CLOCK_PROFILES	3
+#else
+#define CLOCK_PROFILES	4
+#endif
+
+extern int clock_profile;
+
+extern uint32_t clock_profile_khz(int n);
+extern void set_clock_profile(int n);
+
 #endif /* !PICOSIM_INC */
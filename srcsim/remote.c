@@ -0,0 +1,395 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Remote control channel on its own USB CDC interface, for loading
+ * and dumping memory at USB speed and controlling the machine from a
+ * program on the host, srcremote/remote80. The frames are SLIP (RFC
+ * 1055) encoded like the ones of the network bridge, the first byte
+ * of a frame is the command, the answer has the same first byte and
+ * the status in the second, followed by the data:
+ *	i			info: version, number of banks, bank size
+ *				low, high, CPU, max. data length low, high
+ *	r bank al ah nl nh	read n bytes of memory
+ *	w bank al ah data	write memory
+ *	g			get the registers
+ *	s regs			set the registers
+ *	h			stop the CPU
+ *	c			continue at the ICE prompt
+ *	b al ah nl nh		stop the CPU on an access of n bytes
+ *	x			remove all breakpoints
+ *	p			performance counters: T-states and host
+ *				microseconds (8 bytes each), CPU speed in
+ *				MHz (2 bytes), CPU state and error
+ *
+ * All words are low byte first. A bank FFH is the bank selected by
+ * the CPU, like for the memory DMA device. The registers are the
+ * words AF, BC, DE, HL, AF', BC', DE', HL', IX, IY, SP and PC, then
+ * the bytes I, R, IFF and the interrupt mode.
+ *
+ * While the CPU runs, the channel is polled from the event scheduler
+ * every REMOTE_POLL_T T-states, so memory is accessed between two
+ * memory reads of the CPU, like by a DMA device. The registers can
+ * only be set while the CPU is stopped at the ICE or the restart
+ * prompt, where the channel is polled while waiting for a key. The
+ * breakpoints use the memory watchpoints and need -D MEM_WP=1, the
+ * continue command types "g" at the ICE prompt and needs the ICE.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <string.h>
+#include <tusb.h>
+#include "pico/stdlib.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "picosim.h"
+#include "sched.h"
+#include "remote.h"
+
+#if REMOTE80
+
+#define SLIP_END	0xc0	/* SLIP frame end */
+#define SLIP_ESC	0xdb	/* SLIP escape */
+#define SLIP_ESC_END	0xdc	/* escaped frame end */
+#define SLIP_ESC_ESC	0xdd	/* escaped escape */
+
+#define REMOTE_ITF	STDIO_MSC_USB_REMOTE_ITF
+#define REMOTE_VERSION	1	/* version of the protocol */
+#define REMOTE_MAX	1024	/* max. data length of a read or write */
+#define REMOTE_FRAME	(4 + REMOTE_MAX) /* max. frame length */
+#define REMOTE_REGS	28	/* length of the registers */
+#define REMOTE_CURBNK	0xff	/* the bank selected by the CPU */
+
+#ifndef REMOTE_POLL_T
+#define REMOTE_POLL_T	10000	/* T-states between polls if connected */
+#endif
+#ifndef REMOTE_IDLE_T
+#define REMOTE_IDLE_T	1000000	/* T-states between polls if not */
+#endif
+#define REMOTE_WAIT_US	50000	/* max. wait for room in the FIFO */
+
+static BYTE frame[REMOTE_FRAME]; /* frame received */
+static int flen;		/* its length so far */
+static bool fesc;		/* escape received */
+static bool fover;		/* frame too long, ignored */
+
+static BYTE data[REMOTE_MAX];	/* data of an answer */
+static bool txfail;		/* the host doesn't take the answer */
+static const char *inject;	/* characters typed at the ICE prompt */
+
+/*
+ * write a byte to the channel, waiting a while for room in the FIFO
+ */
+static void remote_put(BYTE c)
+{
+	uint64_t t;
+
+	if (txfail)
+		return;
+	if (tud_cdc_n_write_available(REMOTE_ITF) == 0) {
+		tud_cdc_n_write_flush(REMOTE_ITF);
+		t = time_us_64();
+		while (tud_cdc_n_write_available(REMOTE_ITF) == 0)
+			if (!tud_cdc_n_connected(REMOTE_ITF) ||
+			    time_us_64() - t > REMOTE_WAIT_US) {
+				txfail = true;
+				return;
+			}
+	}
+	tud_cdc_n_write_char(REMOTE_ITF, (char) c);
+}
+
+static void remote_put_esc(BYTE c)
+{
+	if (c == SLIP_END) {
+		remote_put(SLIP_ESC);
+		remote_put(SLIP_ESC_END);
+	} else if (c == SLIP_ESC) {
+		remote_put(SLIP_ESC);
+		remote_put(SLIP_ESC_ESC);
+	} else
+		remote_put(c);
+}
+
+/*
+ * send the answer to a command to the host
+ */
+static void remote_send(BYTE type, BYTE status, const BYTE *p, int n)
+{
+	txfail = false;
+	remote_put(SLIP_END);
+	remote_put_esc(type);
+	remote_put_esc(status);
+	while (n-- > 0)
+		remote_put_esc(*p++);
+	remote_put(SLIP_END);
+	tud_cdc_n_write_flush(REMOTE_ITF);
+}
+
+static inline BYTE *put_word(BYTE *p, WORD w)
+{
+	*p++ = w & 0xff;
+	*p++ = w >> 8;
+	return p;
+}
+
+static inline WORD get_word(const BYTE *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/*
+ * put the registers into p
+ */
+static void get_regs(BYTE *p)
+{
+	memset(p, 0, REMOTE_REGS);
+	p = put_word(p, (A << 8) | (F & 0xff));
+	p = put_word(p, (B << 8) | C);
+	p = put_word(p, (D << 8) | E);
+	p = put_word(p, (H << 8) | L);
+#ifndef EXCLUDE_Z80
+	p = put_word(p, (A_ << 8) | (F_ & 0xff));
+	p = put_word(p, (B_ << 8) | C_);
+	p = put_word(p, (D_ << 8) | E_);
+	p = put_word(p, (H_ << 8) | L_);
+	p = put_word(p, IX);
+	p = put_word(p, IY);
+#else
+	p += 12;
+#endif
+	p = put_word(p, SP);
+	p = put_word(p, PC);
+#ifndef EXCLUDE_Z80
+	*p++ = I;
+	*p++ = (R_ & 0x80) | (R & 0x7f);
+#else
+	p += 2;
+#endif
+	*p++ = IFF;
+	*p = int_mode;
+}
+
+/*
+ * set the registers from p
+ */
+static void set_regs(const BYTE *p)
+{
+	A = p[1]; F = p[0]; B = p[3]; C = p[2];
+	D = p[5]; E = p[4]; H = p[7]; L = p[6];
+#ifndef EXCLUDE_Z80
+	A_ = p[9]; F_ = p[8]; B_ = p[11]; C_ = p[10];
+	D_ = p[13]; E_ = p[12]; H_ = p[15]; L_ = p[14];
+	IX = get_word(&p[16]);
+	IY = get_word(&p[18]);
+#endif
+	SP = get_word(&p[20]);
+	PC = get_word(&p[22]);
+#ifndef EXCLUDE_Z80
+	I = p[24];
+	R = R_ = p[25];
+#endif
+	IFF = p[26] & 3;
+	int_mode = p[27];
+}
+
+/*
+ * check the bank of a read or write, returns it or -1
+ */
+static int remote_bank(BYTE bank)
+{
+	if (bank == REMOTE_CURBNK)
+		bank = selbnk;
+	return bank > numseg ? -1 : bank;
+}
+
+/*
+ * execute the command in the frame received, stopped is true if
+ * the CPU doesn't run
+ */
+static void remote_frame(bool stopped)
+{
+	BYTE type = frame[0], status = REMOTE_STAT_OK;
+	int bank, n = 0;
+	uint64_t t;
+
+	switch (type) {
+	case 'i':
+		data[0] = REMOTE_VERSION;
+		data[1] = numseg;
+		put_word(&data[2], segsiz);
+		data[4] = cpu;
+		put_word(&data[5], REMOTE_MAX);
+		n = 7;
+		break;
+
+	case 'r':
+		n = flen == 6 ? get_word(&frame[4]) : 0;
+		if (n == 0 || n > REMOTE_MAX) {
+			status = REMOTE_STAT_CMD;
+			n = 0;
+		} else if ((bank = remote_bank(frame[1])) < 0) {
+			status = REMOTE_STAT_BANK;
+			n = 0;
+		} else
+			bank_read(bank, get_word(&frame[2]), data, n);
+		break;
+
+	case 'w':
+		if (flen < 5)
+			status = REMOTE_STAT_CMD;
+		else if ((bank = remote_bank(frame[1])) < 0)
+			status = REMOTE_STAT_BANK;
+		else
+			bank_write(bank, get_word(&frame[2]), &frame[4],
+				   flen - 4);
+		break;
+
+	case 'g':
+		get_regs(data);
+		n = REMOTE_REGS;
+		break;
+
+	case 's':
+		if (flen != 1 + REMOTE_REGS)
+			status = REMOTE_STAT_CMD;
+		else if (!stopped)
+			status = REMOTE_STAT_RUN;
+		else
+			set_regs(&frame[1]);
+		break;
+
+	case 'h':
+		if (!stopped) {
+			cpu_error = USERINT;
+			cpu_state = ST_STOPPED;
+		}
+		break;
+
+	case 'c':
+#ifdef WANT_ICE
+		if (!stopped)
+			status = REMOTE_STAT_RUN;
+		else
+			inject = "g\r";
+#else
+		status = REMOTE_STAT_NOSUP;
+#endif
+		break;
+
+	case 'b':
+#if MEM_WP
+		if (flen != 5 || get_word(&frame[3]) == 0)
+			status = REMOTE_STAT_CMD;
+		else if (!wp_set(get_word(&frame[1]), get_word(&frame[3]),
+				 WP_READ | WP_WRITE | WP_BREAK))
+			status = REMOTE_STAT_CMD;
+#else
+		status = REMOTE_STAT_NOSUP;
+#endif
+		break;
+
+	case 'x':
+#if MEM_WP
+		wp_clear();
+#else
+		status = REMOTE_STAT_NOSUP;
+#endif
+		break;
+
+	case 'p':
+		t = T;
+		memcpy(&data[0], &t, 8);
+		t = time_us_64();
+		memcpy(&data[8], &t, 8);
+		put_word(&data[16], speed);
+		data[18] = cpu_state;
+		data[19] = cpu_error;
+		n = 20;
+		break;
+
+	default:
+		status = REMOTE_STAT_CMD;
+		break;
+	}
+
+	remote_send(type, status, data, n);
+}
+
+/*
+ * decode the frames received from the host and execute them
+ */
+void remote_poll(bool stopped)
+{
+	BYTE buf[64];
+	register int i, n;
+	register BYTE c;
+
+	while (tud_cdc_n_available(REMOTE_ITF)) {
+		n = (int) tud_cdc_n_read(REMOTE_ITF, buf, sizeof(buf));
+		for (i = 0; i < n; i++) {
+			c = buf[i];
+			if (c == SLIP_END) {
+				if (flen > 0 && !fover)
+					remote_frame(stopped);
+				flen = 0;
+				fesc = fover = false;
+				continue;
+			}
+			if (c == SLIP_ESC) {
+				fesc = true;
+				continue;
+			}
+			if (fesc) {
+				if (c == SLIP_ESC_END)
+					c = SLIP_END;
+				else if (c == SLIP_ESC_ESC)
+					c = SLIP_ESC;
+				fesc = false;
+			}
+			if (flen < REMOTE_FRAME)
+				frame[flen++] = c;
+			else
+				fover = true;
+		}
+	}
+}
+
+/*
+ * event of the scheduler for polling the channel while the CPU runs
+ */
+static void remote_tick(void)
+{
+	remote_poll(false);
+	sched_post(T + (tud_cdc_n_connected(REMOTE_ITF) ? REMOTE_POLL_T
+							 : REMOTE_IDLE_T),
+		   remote_tick);
+}
+
+/*
+ * start polling the channel, called when the machine starts
+ */
+void remote_start(void)
+{
+	inject = NULL;
+	sched_post(T + REMOTE_POLL_T, remote_tick);
+}
+
+/*
+ * next character typed by the remote at the CPU prompt, or -1
+ */
+int remote_getc(void)
+{
+	if (inject == NULL || *inject == '\0')
+		return -1;
+	return (unsigned char) *inject++;
+}
+
+#endif /* REMOTE80 */
@@ -0,0 +1,47 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Remote control channel on its own USB CDC interface
+ */
+
+#ifndef REMOTE_INC
+#define REMOTE_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define REMOTE_STAT_OK		0x00	/* command done */
+#define REMOTE_STAT_CMD		0x01	/* unknown command or bad length */
+#define REMOTE_STAT_BANK	0x02	/* no such bank */
+#define REMOTE_STAT_RUN		0x03	/* only while the CPU is stopped */
+#define REMOTE_STAT_NOSUP	0x04	/* not in this firmware */
+
+#ifndef REMOTE80
+#define REMOTE80	0	/* remote control channel */
+#endif
+
+#if REMOTE80
+extern void remote_start(void);
+extern void remote_poll(bool stopped);
+extern int remote_getc(void);
+#else /* !REMOTE80 */
+
+static inline void remote_start(void)
+{
+}
+
+static inline void remote_poll(bool stopped)
+{
+	(void) stopped;
+}
+
+static inline int remote_getc(void)
+{
+	return -1;
+}
+
+#endif /* !REMOTE80 */
+
+#endif /* !REMOTE_INC */
@@ -0,0 +1,96 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Recording and replay of the inputs of a run
+ */
+
+#ifndef REPLAY_INC
+#define REPLAY_INC
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+/*
+ * With REPLAY80 a run of the machine can be recorded into REPLAY_FILE
+ * and replayed later, so that performance changes can be measured with
+ * exactly the same instructions executed. Recorded are the values
+ * returned by the input ports which depend on the world outside, the
+ * consoles, printer, Dazzler flags, network bridge and RTC, and the
+ * 60 Hz timer interrupts, each with the T-states since the start. In
+ * a replay the ports return the recorded values, and the timer
+ * interrupts are requested at the recorded T-states instead of by the
+ * timer. Background disk commands are executed in the foreground and
+ * the console idle wait is off, so that the rest is deterministic.
+ * The machine must be configured and the disks must be the same as
+ * for the recording. At the end of the log the machine continues
+ * with the real inputs.
+ */
+#ifndef REPLAY80
+#define REPLAY80	0	/* record and replay of runs */
+#endif
+
+#if REPLAY80
+
+#define REPLAY_SIZE	256	/* events buffered, power of 2 */
+#define REPLAY_CHUNK	128	/* events read or written at once */
+#define REPLAY_FILE	"/CONF80/REPLAY.DAT"
+
+#define REPLAY_OFF	0	/* normal run */
+#define REPLAY_REC	1	/* recording into REPLAY_FILE */
+#define REPLAY_PLAY	2	/* replaying REPLAY_FILE */
+
+/* event types */
+#define RP_IN		1	/* arg = port, data = value returned */
+#define RP_INT		2	/* arg = source, data = vector */
+
+/* an event, stored as is in REPLAY_FILE after the "RPL1" header */
+typedef struct replay_ev {
+	uint32_t t_lo;		/* T-states since the start, bits 0 - 31 */
+	uint16_t t_hi;		/* bits 32 - 47 */
+	BYTE type;
+	BYTE arg;
+	BYTE data;
+	BYTE pad[3];
+} replay_ev_t;
+
+extern int replay_mode, replay_sel;
+extern uint32_t replay_due;
+
+extern void replay_start(void), replay_stop(void);
+extern void replay_step(int port);
+extern BYTE replay_port_in(BYTE port, BYTE data);
+
+/* ring buffer of the events to and from REPLAY_FILE, in disks.c */
+extern bool replay_open(bool rec);
+extern void replay_close(void);
+extern void replay_put(const replay_ev_t *ev);
+extern bool replay_get(replay_ev_t *ev);
+
+static inline bool replay_active(void)
+{
+	return replay_mode != REPLAY_OFF;
+}
+
+/*
+ * called on every memory read of the CPU, handles the events
+ * which are due, with a 32 bit compare of T, see simio.c
+ */
+static inline void replay_check(void)
+{
+	if ((int32_t) ((uint32_t) T - replay_due) >= 0)
+		replay_step(-1);
+}
+
+#else /* !REPLAY80 */
+
+static inline bool replay_active(void)
+{
+	return false;
+}
+
+#endif /* !REPLAY80 */
+
+#endif /* !REPLAY_INC */
@@ -0,0 +1,134 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Real time clock on the I/O ports 65 (command) and 66 (data), like
+ * the one of z80pack, which the BIOS of CP/M 3 and MP/M use. A write
+ * to the command port selects what the data port returns:
+ *	0	seconds in BCD
+ *	1	minutes in BCD
+ *	2	hours in BCD
+ *	3	low byte of the days since 31.12.1977
+ *	4	high byte of the days since 31.12.1977
+ * Other commands return 0. The operating systems poll the clock often,
+ * so the values are kept in a table, which an alarm updates from the
+ * AON timer at the start of every second. The reads of the data port
+ * are a load from the table. Setting the clock is done in the config
+ * dialog, writes to the data port are ignored.
+ *
+ * History:
+ * 14-OCT-2026 first version, replaces iodevices/rtc80.c
+ */
+
+#include <time.h>
+#include "pico/aon_timer.h"
+#include "pico/time.h"
+
+#include "sim.h"
+#include "simdefs.h"
+
+#include "budget.h"
+#include "rtc80.h"
+#include "rtc.h"
+
+#define RTC_CMDS	5	/* number of commands */
+#define DAYS_1978	2921	/* days from 1.1.1970 to 31.12.1977 */
+
+static BYTE clkcmd;			/* last clock command */
+static volatile BYTE rtc_val[RTC_CMDS];	/* the values of the commands */
+static alarm_id_t rtc_alarm_id;
+
+static inline BYTE to_bcd(int v)
+{
+	return (BYTE) (((v / 10) << 4) | (v % 10));
+}
+
+/*
+ * update the table from the AON timer, returns the microseconds
+ * until the next second
+ */
+static int64_t rtc_update(void)
+{
+	struct timespec ts;
+	struct tm t;
+	long days;
+
+	aon_timer_get_time(&ts);
+	localtime_r(&ts.tv_sec, &t);
+	days = (long) (ts.tv_sec / 86400) - DAYS_1978;
+
+	rtc_val[0] = to_bcd(t.tm_sec);
+	rtc_val[1] = to_bcd(t.tm_min);
+	rtc_val[2] = to_bcd(t.tm_hour);
+	rtc_val[3] = days & 0xff;
+	rtc_val[4] = (days >> 8) & 0xff;
+
+	return (1000000000L - ts.tv_nsec) / 1000 + 1;
+}
+
+static int64_t rtc_alarm(alarm_id_t id, void *user_data)
+{
+	int64_t next;
+	BUDGET_ENTER(BUDGET_ALARM);
+
+	UNUSED(id);
+	UNUSED(user_data);
+
+	next = -rtc_update();	/* reschedule at the next second */
+	BUDGET_EXIT();
+	return next;
+}
+
+/*
+ * start the updates of the table, called from init_io()
+ */
+void rtc_init(void)
+{
+	if (rtc_alarm_id > 0)
+		return;
+	rtc_alarm_id = add_alarm_in_us(rtc_update(), rtc_alarm, NULL, true);
+}
+
+/*
+ * stop the updates, called from exit_io()
+ */
+void rtc_exit(void)
+{
+	if (rtc_alarm_id > 0)
+		cancel_alarm(rtc_alarm_id);
+	rtc_alarm_id = 0;
+}
+
+/*
+ * I/O handler for read clock command
+ */
+BYTE clkc_in(void)
+{
+	return clkcmd;
+}
+
+/*
+ * I/O handler for write clock command
+ */
+void clkc_out(BYTE data)
+{
+	clkcmd = data;
+}
+
+/*
+ * I/O handler for read clock data
+ */
+BYTE __not_in_flash_func(clkd_in)(void)
+{
+	return clkcmd < RTC_CMDS ? rtc_val[clkcmd] : 0;
+}
+
+/*
+ * I/O handler for write clock data, the clock is set in the
+ * config dialog
+ */
+void clkd_out(BYTE data)
+{
+	UNUSED(data);
+}
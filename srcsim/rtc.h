@@ -0,0 +1,14 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Real time clock with the time kept in a table
+ */
+
+#ifndef RTC_INC
+#define RTC_INC
+
+extern void rtc_init(void), rtc_exit(void);
+
+#endif /* !RTC_INC */
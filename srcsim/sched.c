@@ -0,0 +1,179 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Event scheduler on the T-states of the CPU. Devices post an event
+ * with the T-state it is due and a function, which is called on the
+ * first memory read of the CPU at or after that T-state. So the event
+ * happens in the emulated time, at the same instruction with every
+ * CPU speed and in the same place of a replay, without a host alarm.
+ * The events are kept in a min-heap on the T-state, a memory read only
+ * checks the first one, with a 32 bit compare against sched_due. Like
+ * for the replay events that is at most SCHED_SPAN T-states ahead, so
+ * that the compare can't wrap, for an event further away sched_run()
+ * is called early and sets sched_due again.
+ *
+ * Events can be posted and cancelled from the IRQs of core 0, the
+ * heap is changed with the interrupts disabled, the functions are
+ * called with them enabled.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include "pico/stdlib.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "sched.h"
+
+#define SCHED_SPAN	(1U << 30)	/* max. T-states to the next check */
+
+typedef struct sched_ev {
+	Tstates_t when;		/* T-state the event is due */
+	sched_func_t *func;	/* function called then */
+} sched_ev_t;
+
+static sched_ev_t heap[SCHED_EVENTS];	/* min-heap on when */
+static int nev;				/* number of events in the heap */
+uint32_t sched_due = ~0U;		/* low 32 bits of T of the next check */
+
+/*
+ * set sched_due for the first event, called with interrupts disabled
+ */
+static void __not_in_flash_func(sched_set_due)(void)
+{
+	Tstates_t when;
+
+	if (nev == 0) {
+		mem_attn.on.sched = 0;
+		return;
+	}
+	when = heap[0].when;
+	if (when > T + SCHED_SPAN)
+		when = T + SCHED_SPAN;
+	sched_due = (uint32_t) when;
+	mem_attn.on.sched = 1;
+}
+
+static void __not_in_flash_func(sched_up)(int i)
+{
+	sched_ev_t ev = heap[i];
+	register int p;
+
+	while (i > 0 && heap[p = (i - 1) / 2].when > ev.when) {
+		heap[i] = heap[p];
+		i = p;
+	}
+	heap[i] = ev;
+}
+
+static void __not_in_flash_func(sched_down)(int i)
+{
+	sched_ev_t ev = heap[i];
+	register int c;
+
+	while ((c = 2 * i + 1) < nev) {
+		if (c + 1 < nev && heap[c + 1].when < heap[c].when)
+			c++;
+		if (heap[c].when >= ev.when)
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = ev;
+}
+
+/*
+ * remove event i from the heap, called with interrupts disabled
+ */
+static void __not_in_flash_func(sched_remove)(int i)
+{
+	if (--nev == i)
+		return;
+	heap[i] = heap[nev];
+	sched_up(i);
+	sched_down(i);
+}
+
+/*
+ * post an event for func at T-state when, an event already pending
+ * for func is replaced
+ */
+void __not_in_flash_func(sched_post)(Tstates_t when, sched_func_t *func)
+{
+	uint32_t save = save_and_disable_interrupts();
+	register int i;
+
+	for (i = 0; i < nev; i++)
+		if (heap[i].func == func) {
+			sched_remove(i);
+			break;
+		}
+	if (nev < SCHED_EVENTS) {
+		heap[nev].when = when;
+		heap[nev].func = func;
+		sched_up(nev++);
+	}
+	sched_set_due();
+	restore_interrupts(save);
+}
+
+/*
+ * cancel the event pending for func
+ */
+void __not_in_flash_func(sched_cancel)(sched_func_t *func)
+{
+	uint32_t save = save_and_disable_interrupts();
+	register int i;
+
+	for (i = 0; i < nev; i++)
+		if (heap[i].func == func) {
+			sched_remove(i);
+			break;
+		}
+	sched_set_due();
+	restore_interrupts(save);
+}
+
+/*
+ * get the T-state of the next event, false if there is none
+ */
+bool sched_next(Tstates_t *when)
+{
+	uint32_t save = save_and_disable_interrupts();
+	bool pending = nev > 0;
+
+	if (pending)
+		*when = heap[0].when;
+	restore_interrupts(save);
+
+	return pending;
+}
+
+/*
+ * run the events which are due
+ */
+void __not_in_flash_func(sched_run)(void)
+{
+	uint32_t save;
+	sched_func_t *func;
+
+	while (true) {
+		save = save_and_disable_interrupts();
+		if (nev == 0 || heap[0].when > T) {
+			sched_set_due();
+			restore_interrupts(save);
+			return;
+		}
+		func = heap[0].func;
+		sched_remove(0);
+		sched_set_due();
+		restore_interrupts(save);
+		(*func)();
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Event scheduler on the T-states of the CPU
+ */
+
+#ifndef SCHED_INC
+#define SCHED_INC
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+#define SCHED_EVENTS	8	/* events pending at the same time */
+
+typedef void (sched_func_t)(void);
+
+extern uint32_t sched_due;
+
+extern void sched_post(Tstates_t when, sched_func_t *func);
+extern void sched_cancel(sched_func_t *func);
+extern bool sched_next(Tstates_t *when);
+extern void sched_run(void);
+
+/*
+ * called on the memory reads of the CPU while events are pending,
+ * runs the events which are due, with a 32 bit compare of T
+ */
+static inline void sched_check(void)
+{
+	if ((int32_t) ((uint32_t) T - sched_due) >= 0)
+		sched_run();
+}
+
+#endif /* !SCHED_INC */
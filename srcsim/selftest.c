@@ -0,0 +1,346 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Self-test of the CPU cores, from the configuration dialog or at
+ * every boot. Two small exercisers are stored at 0000H and run at full
+ * speed until their HALT, the results they store at 0100H are compared
+ * with the known ones: a CRC-16 over the bytes 00H to FFH with 8080
+ * instructions and a subroutine, a BCD count with DAA, the parity and
+ * sign flags of all bytes, and for the Z80 the same CRC with DJNZ, JR
+ * and IX, a block move with LDIR and a sum with the alternate
+ * registers. The 8080 part runs on both CPUs, only flags which are the
+ * same on both are tested. Then a loop of ALU instructions is run for
+ * SELFTEST_MS for the emulated clock, so units with a wrong system
+ * clock or a slow firmware build stand out. The results are saved with
+ * the configuration. At last a command is sent through the port of the
+ * extended FDC and its status read back, which checks that the boot
+ * ROM and the BIOSes using it can reach it, and a program writes into
+ * a read only overlay at 0300H, which must keep its contents.
+ *
+ * Memory from 0000H to 03FFH and the CPU registers are restored
+ * afterwards.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ * 14-OCT-2026 check the port of the extended FDC
+ * 14-OCT-2026 check the read only overlays
+ */
+
+#include <stdio.h>
+#include "pico/time.h"
+#include "hardware/clocks.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simcore.h"
+
+#include "sd-fdc.h"
+#include "disks.h"
+#include "selftest.h"
+
+#define SELFTEST_MEM	0x0400	/* memory used by the self-test */
+#define SELFTEST_RES	0x0100	/* results stored by the exercisers */
+#define SELFTEST_CRC	0x3fbd	/* CRC-16/CCITT of the bytes 00H - FFH */
+
+/* results of the last self-test */
+selftest_t selftest;
+
+/* run the self-test at every boot */
+bool selftest_boot;
+
+/*
+ *		LXI SP,0100H / LXI H,0FFFFH / MVI E,0
+ *	L1:	MOV A,E / CALL CRCB / INR E / JNZ L1 / SHLD 0100H
+ *		LXI D,0 / MVI C,0
+ *	L2:	MOV A,E / ADI 37H / DAA / MOV E,A / MOV A,D / ACI 0 / DAA
+ *		MOV D,A / DCR C / JNZ L2 / XCHG / SHLD 0102H
+ *		LXI B,0 / MVI E,0
+ *	L3:	MOV A,E / ORA A / JPO L4 / INR C
+ *	L4:	MOV A,E / ORA A / JP L5 / INR B
+ *	L5:	INR E / JNZ L3 / MOV H,B / MOV L,C / SHLD 0104H / HLT
+ *	CRCB:	XRA H / MOV H,A / MVI B,8
+ *	C1:	DAD H / JNC C2 / MOV A,H / XRI 10H / MOV H,A
+ *		MOV A,L / XRI 21H / MOV L,A
+ *	C2:	DCR B / JNZ C1 / RET
+ */
+static const BYTE test_8080[] = {
+	0x31, 0x00, 0x01, 0x21, 0xff, 0xff, 0x1e, 0x00, 0x7b, 0xcd,
+	0x45, 0x00, 0x1c, 0xc2, 0x08, 0x00, 0x22, 0x00, 0x01, 0x11,
+	0x00, 0x00, 0x0e, 0x00, 0x7b, 0xc6, 0x37, 0x27, 0x5f, 0x7a,
+	0xce, 0x00, 0x27, 0x57, 0x0d, 0xc2, 0x18, 0x00, 0xeb, 0x22,
+	0x02, 0x01, 0x01, 0x00, 0x00, 0x1e, 0x00, 0x7b, 0xb7, 0xe2,
+	0x35, 0x00, 0x0c, 0x7b, 0xb7, 0xf2, 0x3b, 0x00, 0x04, 0x1c,
+	0xc2, 0x2f, 0x00, 0x60, 0x69, 0x22, 0x04, 0x01, 0x76, 0xac,
+	0x67, 0x06, 0x08, 0x29, 0xd2, 0x55, 0x00, 0x7c, 0xee, 0x10,
+	0x67, 0x7d, 0xee, 0x21, 0x6f, 0x05, 0xc2, 0x49, 0x00, 0xc9
+};
+
+/*
+ *		LD SP,0100H / LD HL,0200H / XOR A
+ *	T1:	LD (HL),A / INC L / INC A / JR NZ,T1
+ *		LD IX,0200H / LD HL,0FFFFH / LD C,0
+ *	Z1:	LD A,(IX+0) / XOR H / LD H,A / LD B,8
+ *	Z2:	ADD HL,HL / JR NC,Z3 / LD A,H / XOR 10H / LD H,A
+ *		LD A,L / XOR 21H / LD L,A
+ *	Z3:	DJNZ Z2 / INC IX / DEC C / JR NZ,Z1 / LD (0106H),HL
+ *		LD HL,0200H / LD DE,0300H / LD BC,0100H / LDIR
+ *		EXX / LD HL,0300H / LD DE,0 / LD B,0
+ *	S1:	LD A,(HL) / ADD A,E / LD E,A / JR NC,S2 / INC D
+ *	S2:	INC HL / DJNZ S1 / EX DE,HL / LD (0108H),HL / EXX / HALT
+ */
+static const BYTE test_z80[] = {
+	0x31, 0x00, 0x01, 0x21, 0x00, 0x02, 0xaf, 0x77, 0x2c, 0x3c,
+	0x20, 0xfb, 0xdd, 0x21, 0x00, 0x02, 0x21, 0xff, 0xff, 0x0e,
+	0x00, 0xdd, 0x7e, 0x00, 0xac, 0x67, 0x06, 0x08, 0x29, 0x30,
+	0x08, 0x7c, 0xee, 0x10, 0x67, 0x7d, 0xee, 0x21, 0x6f, 0x10,
+	0xf3, 0xdd, 0x23, 0x0d, 0x20, 0xe7, 0x22, 0x06, 0x01, 0x21,
+	0x00, 0x02, 0x11, 0x00, 0x03, 0x01, 0x00, 0x01, 0xed, 0xb0,
+	0xd9, 0x21, 0x00, 0x03, 0x11, 0x00, 0x00, 0x06, 0x00, 0x7e,
+	0x83, 0x5f, 0x30, 0x01, 0x14, 0x23, 0x10, 0xf7, 0xeb, 0x22,
+	0x08, 0x01, 0xd9, 0x76
+};
+
+/*
+ *	LOOP:	ADD A,B / ADC A,C / SUB D / XOR E / AND H / OR L / CP B
+ *		INC A / DEC B / RLCA / ADD HL,BC / INC DE / JP LOOP
+ */
+static const BYTE alu[] = {
+	0x80, 0x89, 0x92, 0xab, 0xa4, 0xb5, 0xb8, 0x3c, 0x05, 0x07,
+	0x09, 0x13, 0xc3, 0x00, 0x00
+};
+
+/*
+ *		MVI A,0FFH / STA 0200H
+ *		MVI A,10H / OUT 9 / MVI A,0 / OUT 9 / MVI A,2 / OUT 9
+ *		MVI A,50H / OUT 9 / IN 9 / STA 010AH / HLT
+ *
+ * sets the address of the command bytes to 0200H, the get disk type
+ * command of drive 0 stores its type there
+ */
+static const BYTE test_xfdc[] = {
+	0x3e, 0xff, 0x32, 0x00, 0x02, 0x3e, 0x10, 0xd3, 0x09, 0x3e,
+	0x00, 0xd3, 0x09, 0x3e, 0x02, 0xd3, 0x09, 0x3e, 0x50, 0xd3,
+	0x09, 0xdb, 0x09, 0x32, 0x0a, 0x01, 0x76
+};
+
+/*
+ *		MVI A,0A5H / STA 0300H / LDA 0300H / STA 010BH / HLT
+ *
+ * writes into the read only overlay at 0300H and reads it back
+ */
+static const BYTE test_rom[] = {
+	0x3e, 0xa5, 0x32, 0x00, 0x03, 0x3a, 0x00, 0x03, 0x32, 0x0b,
+	0x01, 0x76
+};
+
+/* the page of the overlay, 5AH at 0300H */
+static const BYTE __aligned(4) rom_page[PAGESIZ] = { 0x5a };
+
+static BYTE save_mem[SELFTEST_MEM];
+
+/*
+ * callback of the alarm, stops a loop or an exerciser which doesn't halt
+ */
+static int64_t selftest_timeout(alarm_id_t id, void *user_data)
+{
+	UNUSED(id);
+	UNUSED(user_data);
+
+	cpu_state = ST_STOPPED;
+	return 0;
+}
+
+static WORD res_word(WORD addr)
+{
+	return getmem(addr) | (getmem(addr + 1) << 8);
+}
+
+/*
+ * run code at 0000H until HALT, or for ms with halt false,
+ * returns false if it didn't stop the way it should
+ */
+static bool selftest_run(const BYTE *code, int len, int ms, bool halt)
+{
+	alarm_id_t id;
+	register int i;
+
+	for (i = 0; i < SELFTEST_MEM; i++)
+		putmem(i, 0);
+	for (i = 0; i < len; i++)
+		putmem(i, code[i]);
+	PC = 0;
+	SP = SELFTEST_RES;
+	id = add_alarm_in_ms(ms, selftest_timeout, NULL, true);
+	run_cpu();
+	if (id > 0)
+		cancel_alarm(id);
+	return halt ? cpu_error == OPHALT : cpu_error == NONE;
+}
+
+/*
+ * test the CPU selected, returns its result
+ */
+static selftest_cpu_t selftest_cpu(void)
+{
+	selftest_cpu_t r = { SELFTEST_FAIL, 0 };
+	Tstates_t T0;
+	uint64_t t0;
+
+	if (!selftest_run(test_8080, sizeof(test_8080), SELFTEST_MS, true)
+	    || res_word(SELFTEST_RES) != SELFTEST_CRC
+	    || res_word(SELFTEST_RES + 2) != 0x9472
+	    || res_word(SELFTEST_RES + 4) != 0x8080)
+		return r;
+#ifndef EXCLUDE_Z80
+	if (cpu == Z80 &&
+	    (!selftest_run(test_z80, sizeof(test_z80), SELFTEST_MS, true)
+	     || res_word(SELFTEST_RES + 6) != SELFTEST_CRC
+	     || res_word(SELFTEST_RES + 8) != 0x7f80))
+		return r;
+#endif
+
+	T0 = T;
+	t0 = time_us_64();
+	if (!selftest_run(alu, sizeof(alu), SELFTEST_MS, false))
+		return r;
+	r.khz = (uint32_t) ((T - T0) * 1000 / (time_us_64() - t0));
+	r.state = SELFTEST_PASS;
+	return r;
+}
+
+/*
+ * run a command of the extended FDC through its port, returns false
+ * if the status or the command byte isn't right
+ */
+static bool selftest_xfdc(void)
+{
+	const bool linear = disk_linear[0];	/* set by the command */
+	bool ok;
+
+	ok = selftest_run(test_xfdc, sizeof(test_xfdc), SELFTEST_MS, true)
+	     && getmem(SELFTEST_RES + 10) == FDC_STAT_OK
+	     && getmem(0x0200) == disk_type[0];
+	disk_linear[0] = linear;
+	return ok;
+}
+
+/*
+ * run a program which writes into a read only overlay, returns false
+ * if the write went through, or if no overlay is free
+ */
+static bool selftest_rom(void)
+{
+	bool ok;
+
+	if (!mem_overlay(OVL_ALL, 0x0300, rom_page, PAGESIZ))
+		return false;
+	ok = selftest_run(test_rom, sizeof(test_rom), SELFTEST_MS, true)
+	     && getmem(SELFTEST_RES + 11) == 0x5a && getmem(0x0300) == 0x5a;
+	mem_overlay_remove(rom_page);
+	return ok;
+}
+
+/*
+ * run the self-test of all CPUs of the firmware and print the results
+ */
+void run_selftest(void)
+{
+	BYTE A0 = A, B0 = B, C0 = C, D0 = D, E0 = E, H0 = H, L0 = L;
+	BYTE IFF0 = IFF;
+	WORD SP0 = SP, PC0 = PC;
+	int F0 = F, f_value0 = f_value, tmax0 = tmax, cpu0 = cpu;
+#ifndef EXCLUDE_Z80
+	BYTE A_0 = A_, B_0 = B_, C_0 = C_, D_0 = D_, E_0 = E_;
+	BYTE H_0 = H_, L_0 = L_;
+	WORD IX0 = IX, IY0 = IY;
+	int F_0 = F_;
+#endif
+#ifdef WANT_HB
+	bool hb_flag0 = hb_flag;
+#endif
+	bool xfdc_ok, rom_ok;
+	register int i;
+
+#ifdef WANT_HB
+	hb_flag = false;
+#endif
+	for (i = 0; i < SELFTEST_MEM; i++)
+		save_mem[i] = getmem(i);
+	IFF = 0;		/* no interrupts, HALT stops the CPU */
+	f_value = 0;		/* no CPU speed throttle */
+	tmax = 100000;
+
+	puts("CPU self-test");
+	selftest.sys_khz = clock_get_hz(clk_sys) / 1000;
+#ifndef EXCLUDE_Z80
+	switch_cpu(Z80);
+	selftest.z80 = selftest_cpu();
+#endif
+#ifndef EXCLUDE_I8080
+	switch_cpu(I8080);
+	selftest.i8080 = selftest_cpu();
+#endif
+	switch_cpu(cpu0);
+	xfdc_ok = selftest_xfdc();
+	rom_ok = selftest_rom();
+
+	for (i = 0; i < SELFTEST_MEM; i++)
+		putmem(i, save_mem[i]);
+	A = A0; B = B0; C = C0; D = D0; E = E0; H = H0; L = L0; F = F0;
+	SP = SP0; PC = PC0; IFF = IFF0;
+#ifndef EXCLUDE_Z80
+	A_ = A_0; B_ = B_0; C_ = C_0; D_ = D_0; E_ = E_0;
+	H_ = H_0; L_ = L_0; F_ = F_0;
+	IX = IX0; IY = IY0;
+#endif
+	cpu_error = NONE;
+	f_value = f_value0;
+	tmax = tmax0;
+#ifdef WANT_HB
+	hb_flag = hb_flag0;
+#endif
+
+	print_selftest();
+	printf(" extended FDC port 9 %s, read only overlay %s\n\n",
+	       xfdc_ok ? "ok" : "FAILED", rom_ok ? "ok" : "FAILED");
+}
+
+static void print_selftest_cpu(const char *name, const selftest_cpu_t *r)
+{
+	printf(" %s ", name);
+	switch (r->state) {
+	case SELFTEST_PASS:
+		printf("ok %lu.%02lu MHz", (unsigned long) r->khz / 1000,
+		       (unsigned long) r->khz % 1000 / 10);
+		break;
+	case SELFTEST_FAIL:
+		printf("FAILED");
+		break;
+	default:
+		printf("not run");
+		break;
+	}
+}
+
+/*
+ * print the results of the last self-test on one line
+ */
+void print_selftest(void)
+{
+	if (selftest.sys_khz == 0) {
+		puts(" not run");
+		return;
+	}
+#ifndef EXCLUDE_Z80
+	print_selftest_cpu("Z80", &selftest.z80);
+#endif
+#ifndef EXCLUDE_I8080
+	print_selftest_cpu("8080", &selftest.i8080);
+#endif
+	printf(", system clock %lu MHz\n",
+	       (unsigned long) selftest.sys_khz / 1000);
+}
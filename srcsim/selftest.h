@@ -0,0 +1,39 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Self-test of the CPU cores
+ */
+
+#ifndef SELFTEST_INC
+#define SELFTEST_INC
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef SELFTEST_MS	/* run time of the speed loop in ms */
+#define SELFTEST_MS 500
+#endif
+
+#define SELFTEST_NONE	0	/* not run */
+#define SELFTEST_PASS	1	/* results right */
+#define SELFTEST_FAIL	2	/* wrong results */
+
+typedef struct selftest_cpu {
+	uint32_t state;		/* SELFTEST_NONE, _PASS or _FAIL */
+	uint32_t khz;		/* emulated clock at full speed */
+} selftest_cpu_t;
+
+typedef struct selftest {
+	uint32_t sys_khz;	/* system clock of the test, 0 = not run */
+	selftest_cpu_t z80, i8080;
+} selftest_t;
+
+extern selftest_t selftest;
+extern bool selftest_boot;
+
+extern void run_selftest(void);
+extern void print_selftest(void);
+
+#endif /* !SELFTEST_INC */
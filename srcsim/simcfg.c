@@ -14,6 +14,43 @@
  * 03-JUN-2024 added directory list for code files and disk images
  * 31-AUG-2024 read date/time from an optional I2C battery backed RTC
  * 07-JUN-2025 added option for 7/8 bit output to consoles
+ * 14-OCT-2026 option to load a mounted disk into the RAM disk
+ * 14-OCT-2026 save disk types
+ * 14-OCT-2026 option for the number of tracks read ahead
+ * 14-OCT-2026 option for floppy disks with logical sector order
+ * 14-OCT-2026 added disk statistics LCD status display
+ * 14-OCT-2026 option to mount a disk with a copy-on-write overlay
+ * 14-OCT-2026 start loaded files at their entry point
+ * 14-OCT-2026 added verification of the disk images
+ * 14-OCT-2026 added compression of disk images
+ * 14-OCT-2026 option to boot from a copy of disk 0 in flash
+ * 14-OCT-2026 option for the size of the memory banks
+ * 14-OCT-2026 option for the memory fill at power on
+ * 14-OCT-2026 resume the machine from a snapshot
+ * 14-OCT-2026 option to run at full speed while the disks are busy
+ * 14-OCT-2026 option to run at full speed after reset
+ * 14-OCT-2026 configurable baud rate of the serial UART
+ * 14-OCT-2026 option to spool the printer output to the MicroSD card
+ * 14-OCT-2026 option to use the serial UART for the network bridge
+ * 14-OCT-2026 option for the LCD SPI clock
+ * 14-OCT-2026 option for the system clock profile
+ * 14-OCT-2026 show the MicroSD card clock
+ * 14-OCT-2026 create disk images
+ * 14-OCT-2026 show the MicroSD card statistics
+ * 14-OCT-2026 option to record or replay the run
+ * 14-OCT-2026 disks 4 - 15
+ * 14-OCT-2026 store any disk in flash
+ * 14-OCT-2026 config file with tagged records, replaced when complete
+ * 14-OCT-2026 autoboot without the dialog
+ * 14-OCT-2026 machine profiles
+ * 14-OCT-2026 keep the clock running at a warm restart
+ * 14-OCT-2026 memory usage report
+ * 14-OCT-2026 CPU speed with three decimals
+ * 14-OCT-2026 CPU self-test
+ * 14-OCT-2026 option to capture the console and printer output
+ * 14-OCT-2026 option to cache the tracks read at the last start
+ * 14-OCT-2026 defragment the disk images
+ * 14-OCT-2026 convert the image when toggling the linear sector order
  */
 
 #include <stdlib.h>
@@ -24,7 +61,9 @@
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "pico/aon_timer.h"
+#include "hardware/clocks.h"
 #include "hardware/i2c.h"
+#include "hardware/watchdog.h"
 
 #include "ff.h"
 #include "ds3231.h"
@@ -39,11 +78,16 @@
 #include "simport.h"
 #include "simio.h"
 #include "simcfg.h"
+#include "simmem.h"
 
+#include "sd-fdc.h"
 #include "disks.h"
 #include "gpio.h"
 #include "lcd.h"
+#include "memuse.h"
+#include "net.h"
 #include "picosim.h"
+#include "selftest.h"
 
 /*
  * prompt for a filename
@@ -81,68 +125,540 @@ static int get_int(const char *prompt, const char *hint,
 	}
 }
 
+/*
+ * get a CPU speed in MHz with up to three decimals, returns it in kHz
+ */
+static int get_khz(const char *prompt, const char *hint, int max_mhz)
+{
+	int khz, m;
+	char s[8], *p;
+
+	while (true) {
+		printf("Enter %s%s: ", prompt, hint);
+		get_cmdline(s, 7);
+		if (s[0] == '\0')
+			return -1;
+		khz = atoi(s) * 1000;
+		if ((p = strchr(s, '.')) != NULL)
+			for (m = 100, p++; m > 0 && isdigit((unsigned char) *p);
+			     m /= 10, p++)
+				khz += (*p - '0') * m;
+		if ((khz != 0 && khz < 1000) || khz > max_mhz * 1000) {
+			printf("Invalid %s: 0 or range 1 - %d\n",
+			       prompt, max_mhz);
+		} else
+			return khz;
+	}
+}
+
+/*
+ * The config file starts with "CFG" and the version of the format,
+ * followed by records of a tag, the length of the value and the value.
+ * Records with an unknown tag, or with a length which doesn't fit the
+ * variable, are skipped, so that options can be added without breaking
+ * older or newer files. The last record CFG_END has the 16 bit sum of
+ * all bytes before it, files without it are ignored. The file is written
+ * as CFG_NEW and then renamed, if it was lost by a crash in between the
+ * complete CFG_NEW is read. Files without the header are the field dumps
+ * of older versions, these fields are in the order of the tags.
+ */
+#define CFG_VERSION	1
+#define CFG_SIZE	1024	/* maximum size of the file */
+#define CFG_PATH	"/CONF80/" CONF_FILE
+#define CFG_NEW		CFG_PATH ".NEW"
+
+/*
+ * With autoboot the machine starts right after the power on. The
+ * terminal isn't waited for, and the dialog is only entered if a key
+ * arrives within AUTOBOOT_MS.
+ */
+#ifndef AUTOBOOT_MS
+#define AUTOBOOT_MS	300
+#endif
+static bool autoboot;
+
+/*
+ * A machine profile is a config file PROFILE<n>.DAT with all options
+ * but the autoboot flag. They are saved and loaded in the dialog, with
+ * autoboot a digit at the prompt boots a profile. The hardware control
+ * port selects a profile for the next start, it is kept in a watchdog
+ * scratch register over the reboot.
+ */
+#define PROFILES	9	/* numbered 1 - PROFILES */
+#define PROFILE_PATH	"/CONF80/PROFILE%d.DAT"
+#define PROFILE_MAGIC	0x50524f00 /* "PRO" and the number */
+#define PROFILE_REG	0	/* scratch register, 0 - 3 are free */
+
+enum cfg_tag {
+	CFG_END, CFG_CPU, CFG_SPEED, CFG_FP_VALUE, CFG_BRIGHTNESS,
+	CFG_ROTATED, CFG_LCD, CFG_TIME, CFG_CONS_BITS, CFG_DISK0, CFG_DISK1,
+	CFG_DISK2, CFG_DISK3, CFG_DISK_TYPE, CFG_READAHEAD, CFG_OVERLAY,
+	CFG_FLASH, CFG_SEGSIZ, CFG_MEM_FILL, CFG_TURBO_DISK, CFG_TURBO_BOOT,
+	CFG_BAUD, CFG_SPOOL, CFG_NET_UART, CFG_REFRESH, CFG_SPI_DIV,
+	CFG_CLOCK, CFG_AUTOBOOT, CFG_WARM, CFG_DISK4, CFG_DISK5, CFG_DISK6,
+	CFG_DISK7, CFG_DISK8, CFG_DISK9, CFG_DISK10, CFG_DISK11, CFG_DISK12,
+	CFG_DISK13, CFG_DISK14, CFG_DISK15, CFG_DISK_TYPE_HI, CFG_OVERLAY_HI,
+	CFG_SPEED_KHZ, CFG_SELFTEST, CFG_SELFTEST_BOOT, CFG_CAPTURE,
+	CFG_LEARN
+};
+
+/* a variable in the config file, str for a string of up to len - 1 */
+typedef struct cfg_item {
+	BYTE tag;
+	bool str;
+	void *p;
+	unsigned len;
+} cfg_item_t;
+
+static BYTE cfg_buf[CFG_SIZE];
+
+static const uint32_t bauds[] = { 9600, 19200, 38400, 57600, 115200,
+				  230400, 460800, 921600 };
+static const int refreshs[] = { LCD_REFRESH, LCD_REFRESH / 2,
+				LCD_REFRESH / 3, LCD_REFRESH / 4, 0 };
+static const int spi_divs[] = { 0, 2, 4, 6, 8 };
+
+static unsigned cfg_sum(unsigned len)
+{
+	unsigned sum = 0;
+	register unsigned i;
+
+	for (i = 0; i < len; i++)
+		sum += cfg_buf[i];
+	return sum & 0xffff;
+}
+
+/*
+ * check the records of the size bytes in cfg_buf and set the
+ * variables of items from them, returns false if the file is bad
+ */
+static bool cfg_parse(const cfg_item_t *items, int n, UINT size)
+{
+	const cfg_item_t *it;
+	unsigned pos, len;
+	bool pass;
+
+	if (size < 4 || memcmp(cfg_buf, "CFG", 3) || cfg_buf[3] != CFG_VERSION)
+		return false;
+
+	/* first pass checks the records and the sum, second sets */
+	for (pass = false; ; pass = true) {
+		for (pos = 4; pos + 2 <= size; pos += 2 + len) {
+			len = cfg_buf[pos + 1];
+			if (pos + 2 + len > size)
+				return false;
+			if (cfg_buf[pos] == CFG_END) {
+				if (len != 2 || cfg_sum(pos) !=
+				    (unsigned) (cfg_buf[pos + 2]
+						| cfg_buf[pos + 3] << 8))
+					return false;
+				break;
+			}
+			if (!pass)
+				continue;
+			for (it = items; it < &items[n]; it++)
+				if (it->tag == cfg_buf[pos])
+					break;
+			if (it == &items[n])
+				continue;
+			if (it->str && len < it->len) {
+				memcpy(it->p, &cfg_buf[pos + 2], len);
+				((char *) it->p)[len] = '\0';
+			} else if (!it->str && len == it->len)
+				memcpy(it->p, &cfg_buf[pos + 2], len);
+		}
+		if (pos + 2 > size)
+			return false;		/* no CFG_END */
+		if (pass)
+			return true;
+	}
+}
+
+/*
+ * set the variables of items from the field dump of size bytes
+ * of an older version in cfg_buf, up to the first field missing
+ */
+static void cfg_legacy(const cfg_item_t *items, int n, UINT size)
+{
+	const cfg_item_t *it;
+	unsigned pos = 0;
+
+	for (it = items; it < &items[n] && pos + it->len <= size; it++) {
+		memcpy(it->p, &cfg_buf[pos], it->len);
+		if (it->str)
+			((char *) it->p)[it->len - 1] = '\0';
+		pos += it->len;
+	}
+}
+
+/*
+ * read the config file name in one go, a field dump only if legacy,
+ * returns false if there is none or it is bad
+ */
+static bool cfg_load(const char *name, const cfg_item_t *items, int n,
+		     bool legacy)
+{
+	UINT br;
+
+	if ((sd_res = f_open(&sd_file, name, FA_READ)) != FR_OK)
+		return false;
+	sd_res = f_read(&sd_file, cfg_buf, sizeof(cfg_buf), &br);
+	f_close(&sd_file);
+	if (sd_res != FR_OK || br == 0)
+		return false;
+
+	if (br >= 3 && memcmp(cfg_buf, "CFG", 3) == 0)
+		return cfg_parse(items, n, br);
+	if (!legacy)
+		return false;
+	cfg_legacy(items, n, br);
+	return true;
+}
+
+/*
+ * write the variables of items into tmp, and replace the config
+ * file name with it when it is complete
+ */
+static void cfg_save(const char *name, const char *tmp,
+		     const cfg_item_t *items, int n)
+{
+	const cfg_item_t *it;
+	unsigned pos = 4, len, sum;
+	UINT bw;
+
+	memcpy(cfg_buf, "CFG", 3);
+	cfg_buf[3] = CFG_VERSION;
+	for (it = items; it < &items[n]; it++) {
+		len = it->str ? strlen((const char *) it->p) : it->len;
+		if (len > 255 || pos + 2 + len + 4 > sizeof(cfg_buf))
+			continue;
+		cfg_buf[pos] = it->tag;
+		cfg_buf[pos + 1] = len;
+		memcpy(&cfg_buf[pos + 2], it->p, len);
+		pos += 2 + len;
+	}
+	sum = cfg_sum(pos);
+	cfg_buf[pos] = CFG_END;
+	cfg_buf[pos + 1] = 2;
+	cfg_buf[pos + 2] = sum & 0xff;
+	cfg_buf[pos + 3] = sum >> 8;
+	pos += 4;
+
+	if ((sd_res = f_open(&sd_file, tmp, FA_WRITE | FA_CREATE_ALWAYS))
+	    != FR_OK)
+		return;
+	sd_res = f_write(&sd_file, cfg_buf, pos, &bw);
+	if (f_close(&sd_file) != FR_OK || sd_res != FR_OK || bw != pos) {
+		f_unlink(tmp);
+		return;
+	}
+	f_unlink(name);
+	sd_res = f_rename(tmp, name);
+}
+
+/*
+ * read only the autoboot flag from the config file,
+ * called before the terminal is waited for
+ */
+bool config_autoboot(void)
+{
+	const cfg_item_t items[] = {
+		{ CFG_AUTOBOOT, false, &autoboot, sizeof(autoboot) }
+	};
+
+	autoboot = false;
+	if (!cfg_load(CFG_PATH, items, count_of(items), false))
+		cfg_load(CFG_NEW, items, count_of(items), false);
+	return autoboot || profile_pending() > 0;
+}
+
+/*
+ * start the machine with profile n after the next reboot,
+ * called from the hardware control port
+ */
+void profile_select(int n)
+{
+	if (n >= 1 && n <= PROFILES)
+		watchdog_hw->scratch[PROFILE_REG] = PROFILE_MAGIC | n;
+}
+
+/*
+ * the profile selected for this start, or 0 if none
+ */
+int profile_pending(void)
+{
+	uint32_t r = watchdog_hw->scratch[PROFILE_REG];
+
+	if ((r & ~0xffu) != PROFILE_MAGIC || (r & 0xff) < 1
+	    || (r & 0xff) > PROFILES)
+		return 0;
+	return r & 0xff;
+}
+
+/*
+ * check the variables from a config file, reset those out of range
+ * and set the bank size and the UART baud rate
+ */
+static void cfg_check(unsigned u, uint32_t baud, int *refresh, int *spi_div)
+{
+	int i;
+
+	for (i = 0; i < NUMDISK; i++) {
+		if (disk_type[i] > DISK_FDL)
+			disk_type[i] = DISK_FD;
+		if (DISK_OVL_SECS == 0)
+			disk_overlay[i] = false;
+	}
+	if (disk_readahead > DISK_READAHEAD_MAX)
+		disk_readahead = DISK_READAHEAD;
+	if (disk_warm > DISK_CACHE_TRACKS)
+		disk_warm = 0;
+	if (!DISK_CACHE_TRACKS)
+		disk_learn = false;
+	if (!FLASH_DISK)
+		disk_flash = false;
+	if (u < SEGSTEP || u > MAX_SEGSIZ || u % SEGSTEP)
+		u = DEF_SEGSIZ;
+	set_segsiz(u);
+	if (mem_fill < 0 || mem_fill > MEM_FILL_MAX)
+		mem_fill = MEM_XORSHIFT;
+	if (turbo_boot < 0 || turbo_boot > 60)
+		turbo_boot = 0;
+	if (speed < 0 || speed > 40)
+		speed = CPU_SPEED;
+	if (speed_khz / 1000 != speed)	/* from an older file or profile */
+		speed_khz = speed * 1000;
+	for (i = 0; i < (int) count_of(bauds); i++)
+		if (baud == bauds[i])
+			break;
+	if (i == (int) count_of(bauds))
+		baud = 115200;
+	sio3_set_baud(baud);
+	if (!PRINT_SPOOL_SIZE)
+		prt_spool = false;
+	if (!CAPTURE_SIZE)
+		out_capture = false;
+	for (i = 0; i < (int) count_of(refreshs); i++)
+		if (*refresh == refreshs[i])
+			break;
+	if (i == (int) count_of(refreshs))
+		*refresh = LCD_REFRESH;
+	for (i = 0; i < (int) count_of(spi_divs); i++)
+		if (*spi_div == spi_divs[i])
+			break;
+	if (i == (int) count_of(spi_divs))
+		*spi_div = 0;
+	if (clock_profile < 0 || clock_profile >= CLOCK_PROFILES)
+		clock_profile = 0;
+#if defined(EXCLUDE_I8080) || defined(EXCLUDE_Z80)
+	cpu = DEF_CPU;
+#endif
+	switch (initial_lcd) {
+	case LCD_STATUS_REGISTERS:
+#ifdef SIMPLEPANEL
+	case LCD_STATUS_PANEL:
+#endif
+	case LCD_STATUS_DRIVES:
+	case LCD_STATUS_DSTATS:
+#ifdef IOPANEL
+	case LCD_STATUS_PORTS:
+#endif
+	case LCD_STATUS_MEMORY:
+	case LCD_STATUS_CONSOLE:
+#if MEM_HEAT
+	case LCD_STATUS_HEAT:
+#endif
+		break;
+	default:
+		initial_lcd = LCD_STATUS_REGISTERS;
+	}
+}
+
+/*
+ * load machine profile n, the disks of the profile replace the
+ * mounted ones, returns false if there is no such profile
+ */
+static bool profile_load(int n, const cfg_item_t *items, int cnt)
+{
+	char name[sizeof(PROFILE_PATH)];
+	bool save = autoboot;
+	int i;
+#if !defined(EXCLUDE_I8080) && !defined(EXCLUDE_Z80)
+	int old = cpu, new;
+#endif
+
+	snprintf(name, sizeof(name), PROFILE_PATH, n);
+	if (f_stat(name, NULL) != FR_OK) {
+		printf("No machine profile %d\n", n);
+		return false;
+	}
+	for (i = 0; i < NUMDISK; i++)
+		unmount_disk(i);
+	if (!cfg_load(name, items, cnt, false)) {
+		printf("Machine profile %d is bad\n", n);
+		return false;
+	}
+	autoboot = save;
+	check_disks();
+#if !defined(EXCLUDE_I8080) && !defined(EXCLUDE_Z80)
+	if ((new = cpu) != old) {
+		cpu = old;
+		switch_cpu(new);
+	}
+#endif
+	printf("Machine profile %d loaded\n", n);
+	return true;
+}
+
+/*
+ * save the configuration as machine profile n
+ */
+static void profile_save(int n, const cfg_item_t *items, int cnt)
+{
+	char name[sizeof(PROFILE_PATH)], tmp[sizeof(PROFILE_PATH) + 4];
+
+	snprintf(name, sizeof(name), PROFILE_PATH, n);
+	snprintf(tmp, sizeof(tmp), "%s.NEW", name);
+	cfg_save(name, tmp, items, cnt);
+	if (sd_res == FR_OK)
+		printf("Machine profile %d saved\n", n);
+	else
+		printf("Can't save machine profile %d\n", n);
+}
+
+/*
+ * set the LCD options the dialog doesn't set as they are changed
+ */
+static void cfg_lcd(int brightness, bool rotated, int refresh, int spi_div)
+{
+	cfg_lcd(brightness, rotated, refresh, spi_div);
+}
+
+/*
+ * start the machine, with the first tracks of disk 0 in the cache,
+ * and the tracks read at the last start read ahead
+ */
+static void cfg_go(void)
+{
+#if DISK_CACHE_TRACKS > 0
+	if (disk_warm > 0 && !snap_resume)
+		warm_cache(0, disk_warm);
+	if (disk_learn && !snap_resume)
+		learn_cache();
+#endif
+	set_clock_profile(clock_profile);
+}
+
 /*
  * Configuration dialog for the machine
  */
 void config(void)
 {
-	const char *cfg = "/CONF80/" CONF_FILE;
+	const char *cfg = CFG_PATH;
+	const char *cfg_new = CFG_NEW;
 	const char *cpath = "/CODE80";
 	const char *cext = "*.BIN";
 	const char *dpath = "/DISKS80";
-	const char *dext = "*.DSK";
+	const char *dext = "*.DS?";
 	char s[FNLEN+1];
-	unsigned int br;
+	char yn[2];
 	bool go_flag = false, rotated = false;
-	int brightness = 90;
+	bool sd_hs;
+	uint32_t sd_hz;
+	int brightness = 90, refresh = LCD_REFRESH, spi_div = 0;
 	int i, n, menu;
+	unsigned u;
+	WORD w;
 	struct tm t = { .tm_year = 124, .tm_mon = 0, .tm_mday = 1,
 			.tm_wday = 1, .tm_hour = 0, .tm_min = 0, .tm_sec = 0,
 			.tm_isdst = -1 };
 	static const char *dotw[7] = { "Sun", "Mon", "Tue", "Wed",
 				       "Thu", "Fri", "Sat" };
+	static const char *fillnames[MEM_FILL_MAX + 1] = {
+		"random (fast)", "random (rand)", "00H", "E5H" };
+#if REPLAY80
+	static const char *replaynames[] = { "off", "record", "replay" };
+#endif
+	uint32_t baud = sio3_baud;
 	struct timespec ts;
 	struct ds3231_rtc rtc;
 	ds3231_datetime_t dt;
 	uint8_t buf;
+	const cfg_item_t items[] = {
+		{ CFG_CPU, false, &cpu, sizeof(cpu) },
+		{ CFG_SPEED, false, &speed, sizeof(speed) },
+		{ CFG_FP_VALUE, false, &fp_value, sizeof(fp_value) },
+		{ CFG_BRIGHTNESS, false, &brightness, sizeof(brightness) },
+		{ CFG_ROTATED, false, &rotated, sizeof(rotated) },
+		{ CFG_LCD, false, &initial_lcd, sizeof(initial_lcd) },
+		{ CFG_TIME, false, &t, sizeof(t) },
+		{ CFG_CONS_BITS, false, &cons_data_bits,
+		  sizeof(cons_data_bits) },
+		{ CFG_DISK0, true, disks[0], sizeof(disks[0]) },
+		{ CFG_DISK1, true, disks[1], sizeof(disks[1]) },
+		{ CFG_DISK2, true, disks[2], sizeof(disks[2]) },
+		{ CFG_DISK3, true, disks[3], sizeof(disks[3]) },
+		{ CFG_DISK_TYPE, false, disk_type, 4 },
+		{ CFG_READAHEAD, false, &disk_readahead,
+		  sizeof(disk_readahead) },
+		{ CFG_OVERLAY, false, disk_overlay, 4 },
+		{ CFG_FLASH, false, &disk_flash, sizeof(disk_flash) },
+		{ CFG_SEGSIZ, false, &u, sizeof(u) },
+		{ CFG_MEM_FILL, false, &mem_fill, sizeof(mem_fill) },
+		{ CFG_TURBO_DISK, false, &turbo_disk, sizeof(turbo_disk) },
+		{ CFG_TURBO_BOOT, false, &turbo_boot, sizeof(turbo_boot) },
+		{ CFG_BAUD, false, &baud, sizeof(baud) },
+		{ CFG_SPOOL, false, &prt_spool, sizeof(prt_spool) },
+		{ CFG_NET_UART, false, &net_uart, sizeof(net_uart) },
+		{ CFG_REFRESH, false, &refresh, sizeof(refresh) },
+		{ CFG_SPI_DIV, false, &spi_div, sizeof(spi_div) },
+		{ CFG_CLOCK, false, &clock_profile, sizeof(clock_profile) },
+		{ CFG_AUTOBOOT, false, &autoboot, sizeof(autoboot) },
+		{ CFG_WARM, false, &disk_warm, sizeof(disk_warm) },
+		{ CFG_DISK4, true, disks[4], sizeof(disks[4]) },
+		{ CFG_DISK5, true, disks[5], sizeof(disks[5]) },
+		{ CFG_DISK6, true, disks[6], sizeof(disks[6]) },
+		{ CFG_DISK7, true, disks[7], sizeof(disks[7]) },
+		{ CFG_DISK8, true, disks[8], sizeof(disks[8]) },
+		{ CFG_DISK9, true, disks[9], sizeof(disks[9]) },
+		{ CFG_DISK10, true, disks[10], sizeof(disks[10]) },
+		{ CFG_DISK11, true, disks[11], sizeof(disks[11]) },
+		{ CFG_DISK12, true, disks[12], sizeof(disks[12]) },
+		{ CFG_DISK13, true, disks[13], sizeof(disks[13]) },
+		{ CFG_DISK14, true, disks[14], sizeof(disks[14]) },
+		{ CFG_DISK15, true, disks[15], sizeof(disks[15]) },
+		{ CFG_DISK_TYPE_HI, false, &disk_type[4], NUMDISK - 4 },
+		{ CFG_OVERLAY_HI, false, &disk_overlay[4], NUMDISK - 4 },
+		{ CFG_SPEED_KHZ, false, &speed_khz, sizeof(speed_khz) },
+		{ CFG_SELFTEST, false, &selftest, sizeof(selftest) },
+		{ CFG_SELFTEST_BOOT, false, &selftest_boot,
+		  sizeof(selftest_boot) },
+		{ CFG_CAPTURE, false, &out_capture, sizeof(out_capture) },
+		{ CFG_LEARN, false, &disk_learn, sizeof(disk_learn) }
+	};
 	UNUSED(DS3231_MONTHS);
 	UNUSED(DS3231_WDAYS);
 
 	/* try to read config file */
-	sd_res = f_open(&sd_file, cfg, FA_READ);
-	if (sd_res == FR_OK) {
-		f_read(&sd_file, &cpu, sizeof(cpu), &br);
-		f_read(&sd_file, &speed, sizeof(speed), &br);
-		f_read(&sd_file, &fp_value, sizeof(fp_value), &br);
-		f_read(&sd_file, &brightness, sizeof(brightness), &br);
-		f_read(&sd_file, &rotated, sizeof(rotated), &br);
-		f_read(&sd_file, &initial_lcd, sizeof(initial_lcd), &br);
-		f_read(&sd_file, &t, sizeof(t), &br);
-		f_read(&sd_file, &cons_data_bits, sizeof(cons_data_bits), &br);
-		f_read(&sd_file, &disks[0], DISKLEN+1, &br);
-		f_read(&sd_file, &disks[1], DISKLEN+1, &br);
-		f_read(&sd_file, &disks[2], DISKLEN+1, &br);
-		f_read(&sd_file, &disks[3], DISKLEN+1, &br);
-		f_close(&sd_file);
-#if defined(EXCLUDE_I8080) || defined(EXCLUDE_Z80)
-		cpu = DEF_CPU;
-#endif
-		switch (initial_lcd) {
-		case LCD_STATUS_REGISTERS:
-#ifdef SIMPLEPANEL
-		case LCD_STATUS_PANEL:
-#endif
-		case LCD_STATUS_DRIVES:
-#ifdef IOPANEL
-		case LCD_STATUS_PORTS:
-#endif
-		case LCD_STATUS_MEMORY:
-			break;
-		default:
-			initial_lcd = LCD_STATUS_REGISTERS;
-		}
+	u = segsiz;
+	if (cfg_load(cfg, items, count_of(items), true)
+	    || cfg_load(cfg_new, items, count_of(items), false))
+		cfg_check(u, baud, &refresh, &spi_div);
+
+	/* the machine profile selected with the hardware control port */
+	if ((n = profile_pending()) > 0) {
+		watchdog_hw->scratch[PROFILE_REG] = 0;
+		u = segsiz;
+		baud = sio3_baud;
+		if (profile_load(n, items, count_of(items)))
+			cfg_check(u, baud, &refresh, &spi_div);
+		else
+			n = 0;
 	}
 
+	/* trash memory like in a real machine after power on */
+	fill_memory();
+
 	/* Create a real-time clock structure and initiate this */
 	ds3231_init(__CONCAT(i2c, WAVESHARE_I2CADC_I2C),
 		    WAVESHARE_I2CADC_SDA_PIN, WAVESHARE_I2CADC_SCL_PIN, &rtc);
@@ -165,13 +681,53 @@ void config(void)
 			t.tm_wday = 0;
 	}
 
-	ts.tv_sec = mktime(&t);
-	ts.tv_nsec = 0;
-	aon_timer_start(&ts);
+	/* the clock keeps running over a warm restart */
+	if (!aon_timer_is_running()) {
+		ts.tv_sec = mktime(&t);
+		ts.tv_nsec = 0;
+		aon_timer_start(&ts);
+	}
 
 	lcd_brightness(brightness);
 	lcd_set_rotation(rotated);
+	lcd_set_refresh(refresh);
+	lcd_set_spi_div(spi_div);
 
+#if REPLAY80
+	replay_sel = f_stat(REPLAY_FILE, NULL) == FR_OK ? REPLAY_PLAY
+							 : REPLAY_REC;
+#endif
+	/* the self-test at boot, its result is saved right away */
+	if (selftest_boot) {
+		run_selftest();
+		u = segsiz;
+		baud = sio3_baud;
+		cfg_save(cfg, cfg_new, items, count_of(items));
+	}
+	if (n > 0) {
+		cfg_go();
+		return;
+	}
+	if (autoboot) {
+		printf("Autoboot, press 1 - %d for a machine profile, any "
+		       "other key for the configuration dialog", PROFILES);
+		i = getchar_timeout_us(AUTOBOOT_MS * 1000);
+		putchar('\n');
+		go_flag = (i == PICO_ERROR_TIMEOUT);
+		if (i >= '1' && i <= '0' + PROFILES) {
+			u = segsiz;
+			baud = sio3_baud;
+			if (profile_load(i - '0', items, count_of(items))) {
+				cfg_check(u, baud, &refresh, &spi_div);
+				cfg_lcd(brightness, rotated, refresh, spi_div);
+				go_flag = true;
+			}
+		}
+		if (go_flag) {
+			cfg_go();
+			return;
+		}
+	}
 	menu = 1;
 
 	while (!go_flag) {
@@ -183,8 +739,25 @@ void config(void)
 			       dotw[t.tm_wday], t.tm_year + 1900, t.tm_mon + 1,
 			       t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
 			       read_onboard_temp());
+			sd_hz = disk_sd_clock(&sd_hs);
+			printf("MicroSD card clock: %.1f MHz%s\n", sd_hz / 1e6,
+			       sd_hs ? " (high speed)" : "");
 			printf("b - LCD brightness: %d\n", brightness);
 			printf("m - rotate LCD\n");
+			printf("* - LCD refresh rate: ");
+			if (refresh == 0)
+				puts("off");
+			else
+				printf("%d Hz\n", refresh);
+			printf("$ - system clock: %lu MHz%s\n",
+			       (unsigned long) clock_profile_khz(clock_profile)
+			       / 1000, clock_profile ? "" : " (as built)");
+			printf("+ - LCD SPI clock: ");
+			if (spi_div == 0)
+				puts("default");
+			else
+				printf("%.1f MHz\n",
+				       clock_get_hz(clk_peri) / spi_div / 1e6);
 			printf("l - LCD status display: ");
 			switch (initial_lcd) {
 			case LCD_STATUS_REGISTERS:
@@ -198,6 +771,9 @@ void config(void)
 			case LCD_STATUS_DRIVES:
 				printf("floppy diskette drives\n");
 				break;
+			case LCD_STATUS_DSTATS:
+				printf("disk statistics\n");
+				break;
 #ifdef IOPANEL
 			case LCD_STATUS_PORTS:
 				printf("I/O ports panel\n");
@@ -206,6 +782,14 @@ void config(void)
 			case LCD_STATUS_MEMORY:
 				printf("memory contents\n");
 				break;
+			case LCD_STATUS_CONSOLE:
+				printf("console output\n");
+				break;
+#if MEM_HEAT
+			case LCD_STATUS_HEAT:
+				printf("memory heat map\n");
+				break;
+#endif
 			default:
 				printf("unknown!\n");
 				break;
@@ -227,17 +811,90 @@ void config(void)
 			printf("s - CPU speed: ");
 			if (speed == 0)
 				puts("unlimited");
+			else {
+				print_khz(speed_khz);
+				putchar('\n');
+			}
+			printf("y - full speed while disks are busy: %s\n",
+			       turbo_disk ? "on" : "off");
+			printf("n - full speed after reset: ");
+			if (turbo_boot == 0)
+				puts("off");
 			else
-				printf("%d MHz\n", speed);
+				printf("%d s\n", turbo_boot);
 			printf("o - console output bits: %i\n", cons_data_bits);
+			printf("j - serial UART baud rate: %lu\n",
+			       (unsigned long) sio3_baud);
+			printf("! - serial UART used by the network bridge: %s\n",
+			       net_uart ? "on" : "off");
+#if PRINT_SPOOL_SIZE > 0
+			printf("q - printer output to /PRINT80: %s\n",
+			       prt_spool ? "on" : "off");
+#endif
+#if CAPTURE_SIZE > 0
+			printf("| - console and printer output to /LOG80: %s\n",
+			       out_capture ? "on" : "off");
+#endif
+#if REPLAY80
+			printf("@ - record or replay the run: %s\n",
+			       replaynames[replay_sel]);
+#endif
 			printf("p - Port 255 value: %02XH\n", fp_value);
+			printf("e - memory banks: %d x %uK, common %uK\n",
+			       numseg, segsiz / 1024, (65536 - segsiz) / 1024);
+			printf("i - memory fill at power on: %s\n",
+			       fillnames[mem_fill]);
 			printf("f - list files\n");
 			printf("r - load file\n");
 			printf("d - list disks\n");
-			printf("0 - Disk 0: %s\n", disks[0]);
-			printf("1 - Disk 1: %s\n", disks[1]);
-			printf("2 - Disk 2: %s\n", disks[2]);
-			printf("3 - Disk 3: %s\n", disks[3]);
+#if DISK_CRC
+			printf("v - verify disk images\n");
+#endif
+			printf("# - create disk image\n");
+#if FF_USE_FASTSEEK
+			printf(". - defragment disk images\n");
+#endif
+			printf("%% - MicroSD card statistics\n");
+			printf("? - memory usage\n");
+			printf("^ - CPU self-test, last:");
+			print_selftest();
+			printf("~ - CPU self-test at boot: %s\n",
+			       selftest_boot ? "on" : "off");
+#if DISK_DSZ
+			printf("z - compress disk image\n");
+#endif
+#if DISK_READAHEAD_MAX > 0
+			printf("h - disk tracks read ahead: %d\n",
+			       disk_readahead);
+#endif
+#if DISK_CACHE_TRACKS > 0
+			printf("/ - tracks of disk 0 cached at the start: %d\n",
+			       disk_warm);
+			printf(": - tracks read at the last start cached: %s\n",
+			       disk_learn ? "on" : "off");
+#endif
+			for (i = 0; i < NUMDISK; i++)
+				if (i < 4 || disks[i][0])
+					printf("%c - Disk %d: %s%s%s\n",
+					       i < 4 ? '0' + i : ' ', i,
+					       disks[i],
+					       disk_type[i] == DISK_HD ?
+					       " (HD)" :
+					       disk_type[i] == DISK_FDL ?
+					       " (linear)" : "",
+					       disk_overlay[i] ?
+					       " (overlay)" : "");
+			printf("= - mount disk 4 - %d\n", NUMDISK - 1);
+			printf("x - convert a disk to/from linear order\n");
+#if FLASH_DISK
+			printf("k - disks from flash: %s, %d stored\n",
+			       disk_flash ? "on" : "off", flash_disks());
+#endif
+			printf("& - autoboot without this dialog: %s\n",
+			       autoboot ? "on" : "off");
+			printf("< - load machine profile\n");
+			printf("> - save machine profile\n");
+			printf("w - resume machine from snapshot\n");
 			printf("g - run machine\n\n");
 		} else
 			menu = 1;
@@ -259,6 +916,26 @@ void config(void)
 			lcd_set_rotation(rotated);
 			break;
 
+		case '*':
+			for (i = 0; i < (int) count_of(refreshs); i++)
+				if (refreshs[i] == refresh)
+					break;
+			refresh = refreshs[(i + 1) % (int) count_of(refreshs)];
+			lcd_set_refresh(refresh);
+			break;
+
+		case '$':
+			clock_profile = (clock_profile + 1) % CLOCK_PROFILES;
+			break;
+
+		case '+':
+			for (i = 0; i < (int) count_of(spi_divs); i++)
+				if (spi_divs[i] == spi_div)
+					break;
+			spi_div = spi_divs[(i + 1) % (int) count_of(spi_divs)];
+			lcd_set_spi_div(spi_div);
+			break;
+
 		case 'l':
 			if (initial_lcd == LCD_STATUS_REGISTERS)
 #ifdef SIMPLEPANEL
@@ -267,11 +944,19 @@ void config(void)
 #endif
 				initial_lcd = LCD_STATUS_DRIVES;
 			else if (initial_lcd == LCD_STATUS_DRIVES)
+				initial_lcd = LCD_STATUS_DSTATS;
+			else if (initial_lcd == LCD_STATUS_DSTATS)
 #ifdef IOPANEL
 				initial_lcd = LCD_STATUS_PORTS;
 			else if (initial_lcd == LCD_STATUS_PORTS)
 #endif
 				initial_lcd = LCD_STATUS_MEMORY;
+			else if (initial_lcd == LCD_STATUS_MEMORY)
+				initial_lcd = LCD_STATUS_CONSOLE;
+#if MEM_HEAT
+			else if (initial_lcd == LCD_STATUS_CONSOLE)
+				initial_lcd = LCD_STATUS_HEAT;
+#endif
 			else
 				initial_lcd = LCD_STATUS_REGISTERS;
 			break;
@@ -363,10 +1048,24 @@ void config(void)
 			break;
 
 		case 's':
-			i = get_int("speed", " in MHz (0=unlimited)", 0, 40);
+			i = get_khz("speed", " in MHz, e.g. 1.79 (0=unlimited)",
+				    40);
+			putchar('\n');
+			if (i >= 0) {
+				speed_khz = i;
+				speed = i / 1000;
+			}
+			break;
+
+		case 'y':
+			turbo_disk = !turbo_disk;
+			break;
+
+		case 'n':
+			i = get_int("seconds", " (0=off)", 0, 60);
 			putchar('\n');
 			if (i >= 0)
-				speed = i;
+				turbo_boot = i;
 			break;
 
 		case 'o':
@@ -374,6 +1073,35 @@ void config(void)
 			putchar('\n');
 			break;
 
+		case 'j':
+			for (i = 0; i < (int) count_of(bauds); i++)
+				if (bauds[i] == sio3_baud)
+					break;
+			sio3_set_baud(bauds[(i + 1) % (int) count_of(bauds)]);
+			break;
+
+		case '!':
+			net_uart = !net_uart;
+			break;
+
+#if PRINT_SPOOL_SIZE > 0
+		case 'q':
+			prt_spool = !prt_spool;
+			break;
+
+#endif
+#if CAPTURE_SIZE > 0
+		case '|':
+			out_capture = !out_capture;
+			break;
+
+#endif
+#if REPLAY80
+		case '@':
+			replay_sel = (replay_sel + 1) % 3;
+			break;
+
+#endif
 		case 'p':
 again:
 			printf("Enter value in Hex: ");
@@ -394,6 +1122,25 @@ again:
 			putchar('\n');
 			break;
 
+		case 'e':
+			i = get_int("bank size in KB", " (4K steps)",
+				    SEGSTEP / 1024, MAX_SEGSIZ / 1024);
+			putchar('\n');
+			if (i >= 0) {
+				if (i % (SEGSTEP / 1024))
+					printf("Invalid bank size: not a "
+					       "multiple of %dK\n\n",
+					       SEGSTEP / 1024);
+				else
+					set_segsiz(i * 1024);
+			}
+			break;
+
+		case 'i':
+			if (++mem_fill > MEM_FILL_MAX)
+				mem_fill = MEM_XORSHIFT;
+			break;
+
 		case 'f':
 			list_files(cpath, cext);
 			putchar('\n');
@@ -401,9 +1148,9 @@ again:
 			break;
 
 		case 'r':
-			prompt_fn(s, "bin");
-			if (s[0] && load_file(s))
-				PC = 0;
+			prompt_fn(s, "bin/com/hex");
+			if (s[0] && load_file(s, &w))
+				PC = w;
 			putchar('\n');
 			menu = 0;
 			break;
@@ -414,20 +1161,207 @@ again:
 			menu = 0;
 			break;
 
+#if DISK_CRC
+		case 'v':
+			verify_disks();
+			putchar('\n');
+			menu = 0;
+			break;
+#endif
+
+		case '%':
+			print_sd_stats();
+			putchar('\n');
+			menu = 0;
+			break;
+
+		case '?':
+			print_mem_usage();
+			putchar('\n');
+			menu = 0;
+			break;
+
+		case '^':
+			run_selftest();
+			menu = 0;
+			break;
+
+		case '~':
+			selftest_boot = !selftest_boot;
+			break;
+
+		case '#':
+			prompt_fn(s, "dsk");
+			if (s[0]) {
+				printf("Hard disk (y/n): ");
+				get_cmdline(yn, 2);
+				create_disk(s, tolower((unsigned char) yn[0])
+					    == 'y');
+			}
+			putchar('\n');
+			menu = 0;
+			break;
+
+#if FF_USE_FASTSEEK
+		case '.':
+			defrag_disks();
+			putchar('\n');
+			menu = 0;
+			break;
+#endif
+
+#if DISK_DSZ
+		case 'z':
+			prompt_fn(s, "dsk");
+			if (s[0])
+				compress_disk(s);
+			putchar('\n');
+			menu = 0;
+			break;
+#endif
+
+#if DISK_READAHEAD_MAX > 0
+		case 'h':
+			i = get_int("tracks", " (0=off)", 0, DISK_READAHEAD_MAX);
+			putchar('\n');
+			if (i >= 0)
+				disk_readahead = i;
+			break;
+#endif
+
+#if DISK_CACHE_TRACKS > 0
+		case '/':
+			i = get_int("tracks", " (0=off)", 0, DISK_CACHE_TRACKS);
+			putchar('\n');
+			if (i >= 0)
+				disk_warm = i;
+			break;
+
+		case ':':
+			disk_learn = !disk_learn;
+			break;
+
+#endif
+		case 'x':
+			i = get_int("drive", "", 0, NUMDISK - 1);
+			putchar('\n');
+			if (i < 0)
+				break;
+			if (disk_type[i] == DISK_HD) {
+				puts("Not a floppy disk\n");
+				break;
+			}
+			if (disks[i][0]) {
+				/* the sectors of the image must be moved */
+				printf("Rewrite the data tracks of %s in %s "
+				       "sector order (y/n): ", &disks[i][9],
+				       disk_type[i] == DISK_FD ? "logical"
+							       : "physical");
+				get_cmdline(yn, 2);
+				putchar('\n');
+				if (tolower((unsigned char) yn[0]) != 'y')
+					break;
+			}
+			switch (convert_linear(i)) {
+			case FDC_STAT_OK:
+				break;
+			case FDC_STAT_NODISK:
+				puts("No disk in the drive\n");
+				break;
+			case FDC_STAT_DISK:
+				puts("Not a floppy disk image\n");
+				break;
+			case FDC_STAT_WRITE:
+				puts("The image can't be written, mount it "
+				     "without overlay and RAM disk\n");
+				break;
+			default:
+				puts("Disk I/O error, the image is converted "
+				     "only partly\n");
+				break;
+			}
+			break;
+
+#if FLASH_DISK
+		case 'k':
+			i = get_int("drive to store in flash", " (none=toggle)",
+				    0, NUMDISK - 1);
+			putchar('\n');
+			if (i >= 0)
+				puts("Storing the disk in flash, this takes a "
+				     "few seconds");
+			flash_disk(i);
+			putchar('\n');
+			break;
+#endif
+
+		case '=':
+			i = get_int("drive", "", 4, NUMDISK - 1);
+			putchar('\n');
+			if (i < 0)
+				break;
+			/* fall through */
 		case '0':
 		case '1':
 		case '2':
 		case '3':
-			i = s[0] - '0';
+			if (s[0] != '=')
+				i = s[0] - '0';
 			prompt_fn(s, "dsk");
-			if (s[0])
-				mount_disk(i, s);
-			else {
-				disks[i][0] = '\0';
+			if (s[0]) {
+				n = 0;
+#if DISK_OVL_SECS > 0
+				printf("Copy-on-write overlay (y/n): ");
+				get_cmdline(yn, 2);
+				n = tolower((unsigned char) yn[0]) == 'y';
+#endif
+				mount_disk(i, s, n);
+#if RAMDISK_SIZE > 0
+				if (disks[i][0] && !n) {
+					printf("Load into RAM disk (y/n): ");
+					get_cmdline(s, 2);
+					if (tolower((unsigned char) s[0]) == 'y'
+					    && load_ramdisk(i))
+						putchar('\n');
+				}
+#endif
+			} else {
+				unmount_disk(i);
 				putchar('\n');
 			}
 			break;
 
+		case 'w':
+			snap_resume = true;
+			go_flag = true;
+			break;
+
+		case '&':
+			autoboot = !autoboot;
+			break;
+
+		case '<':
+			if ((i = get_int("profile", "", 1, PROFILES)) >= 0) {
+				u = segsiz;
+				baud = sio3_baud;
+				if (profile_load(i, items, count_of(items))) {
+					cfg_check(u, baud, &refresh, &spi_div);
+					cfg_lcd(brightness, rotated, refresh,
+						spi_div);
+				}
+			}
+			putchar('\n');
+			break;
+
+		case '>':
+			if ((i = get_int("profile", "", 1, PROFILES)) >= 0) {
+				u = segsiz;
+				baud = sio3_baud;
+				profile_save(i, items, count_of(items));
+			}
+			putchar('\n');
+			break;
+
 		case 'g':
 			go_flag = true;
 			break;
@@ -438,20 +1372,9 @@ again:
 	}
 
 	/* try to save config file */
-	sd_res = f_open(&sd_file, cfg, FA_WRITE | FA_CREATE_ALWAYS);
-	if (sd_res == FR_OK) {
-		f_write(&sd_file, &cpu, sizeof(cpu), &br);
-		f_write(&sd_file, &speed, sizeof(speed), &br);
-		f_write(&sd_file, &fp_value, sizeof(fp_value), &br);
-		f_write(&sd_file, &brightness, sizeof(brightness), &br);
-		f_write(&sd_file, &rotated, sizeof(rotated), &br);
-		f_write(&sd_file, &initial_lcd, sizeof(initial_lcd), &br);
-		f_write(&sd_file, &t, sizeof(t), &br);
-		f_write(&sd_file, &cons_data_bits, sizeof(cons_data_bits), &br);
-		f_write(&sd_file, &disks[0], DISKLEN+1, &br);
-		f_write(&sd_file, &disks[1], DISKLEN+1, &br);
-		f_write(&sd_file, &disks[2], DISKLEN+1, &br);
-		f_write(&sd_file, &disks[3], DISKLEN+1, &br);
-		f_close(&sd_file);
-	}
+	u = segsiz;
+	baud = sio3_baud;
+	cfg_save(cfg, cfg_new, items, count_of(items));
+
+	cfg_go();
 }
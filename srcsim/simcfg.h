@@ -10,11 +10,16 @@
  * 23-APR-2024 dummy, no configuration implemented yet
  * 12-MAY-2024 implemented configuration dialog
  * 28-MAY-2024 implemented mount/unmount of disk images
+ * 14-OCT-2026 autoboot without the dialog
+ * 14-OCT-2026 machine profiles
  */
 
 #ifndef SIMCFG_INC
 #define SIMCFG_INC
 
+extern bool config_autoboot(void);
+extern void profile_select(int n);
+extern int profile_pending(void);
 extern void config(void);
 
 #endif /* !SIMCFG_INC */
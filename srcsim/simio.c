@@ -18,14 +18,70 @@
  * 12-MAR-2025 added more memory banks for RP2350, 60 Hz timer, SIO2 & printer
  * 07-JUN-2025 configurable 7/8 bit console output
  * 07-JUN-2025 added another SIO for the serial UART
+ * 14-OCT-2026 write back disk cache on system reset
+ * 14-OCT-2026 added extended FDC with multi sector transfers
+ * 14-OCT-2026 finish background disk commands on reset and exit
+ * 14-OCT-2026 rebuild the memory map on bank switches
+ * 14-OCT-2026 configurable number and size of the memory banks
+ * 14-OCT-2026 added banks in PSRAM on RP2350
+ * 14-OCT-2026 added machine snapshots
+ * 14-OCT-2026 incremental snapshots with the changed pages
+ * 14-OCT-2026 port tables in RAM
+ * 14-OCT-2026 interrupt controller with pending sources and priorities
+ * 14-OCT-2026 USB console status from state kept by the TinyUSB callbacks
+ * 14-OCT-2026 batched flush of the USB console and printer output
+ * 14-OCT-2026 interrupt driven SIO3 with ring buffers, settable baud rate
+ * 14-OCT-2026 sleep the host while the consoles are polled without input
+ * 14-OCT-2026 one status and output handler for all USB consoles
+ * 14-OCT-2026 added SIO4 & SIO5 on the extra USB consoles
+ * 14-OCT-2026 added DMA file transfer device
+ * 14-OCT-2026 spool printer output to the MicroSD card
+ * 14-OCT-2026 added network bridge device on the serial UART
+ * 14-OCT-2026 count the accesses of the I/O ports
+ * 14-OCT-2026 start and stop the PC profiler with the hardware control port
+ * 14-OCT-2026 account the time of the port handlers and callbacks
+ * 14-OCT-2026 port I/O and interrupt requests in the trace stream
+ * 14-OCT-2026 recording and replay of the inputs of a run
+ * 14-OCT-2026 RTC with the time kept in a table
+ * 14-OCT-2026 restart with a machine profile from the hardware control port
+ * 14-OCT-2026 init_io() can be called again for a warm restart
+ * 14-OCT-2026 wake up core 0 on interrupt requests
+ * 14-OCT-2026 extended commands of the hardware control port
+ * 14-OCT-2026 added arithmetic assist device for p-code interpreters
+ * 14-OCT-2026 BIOS function traps registered with the hardware control port
+ * 14-OCT-2026 added memory to memory DMA device
+ * 14-OCT-2026 set the attention bytes of the BIOS traps and replays
+ * 14-OCT-2026 32 bit compare of T for the replay events on memory reads
+ * 14-OCT-2026 added cycle and time counter port
+ * 14-OCT-2026 system timer with programmable rate and one-shot mode
+ * 14-OCT-2026 system timer on the T-states with the event scheduler
+ * 14-OCT-2026 SIO1 input directly from its CDC interface
+ * 14-OCT-2026 start polling the remote control channel
+ * 14-OCT-2026 snapshots with the disks of all 16 drives
+ * 14-OCT-2026 no snapshots with packed banks
+ * 14-OCT-2026 sound output device at port 20
+ * 14-OCT-2026 CPU speed in kHz from the hwctl port
+ * 14-OCT-2026 SIO1 input and output of batch jobs
+ * 14-OCT-2026 capture of the SIO1, SIO2 and printer output
+ * 14-OCT-2026 asynchronous logging with ALOG80
+ * 14-OCT-2026 console I/O for the hang detector, snapshot into a file
+ * 14-OCT-2026 MMU and interrupt latency profiler with LATPROF80
+ * 14-OCT-2026 console of the banks for the PC sample accounting
+ * 14-OCT-2026 count the bytes of the USB consoles
+ * 14-OCT-2026 register the command port of the extended FDC
+ * 14-OCT-2026 count only console polls in a tight loop as idle
+ * 14-OCT-2026 raise pending interrupts on CPU reads, in the snapshot
  */
 
 /* Raspberry SDK includes */
 #include <stdio.h>
+#include <string.h>
 #if LIB_PICO_STDIO_USB || LIB_STDIO_MSC_USB
 #include <tusb.h>
 #endif
 #include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
 
 /* Project includes */
@@ -35,14 +91,31 @@
 #include "simmem.h"
 #include "simcore.h"
 #include "simio.h"
+#include "simcfg.h"
+#include "remote.h"
 
+#include "batch.h"
 #include "dazzler.h"
+#include "disks.h"
 #include "draw.h"
 #include "lcd.h"
+#include "memdma.h"
+#include "net.h"
+#include "pcode.h"
 #include "rtc80.h"
+#include "rtc.h"
+#include "sched.h"
 #include "sd-fdc.h"
+#include "sound.h"
+#include "xfdc.h"
+#include "xfer.h"
+
+#include "picosim.h"
+#include "hang.h"
+#include "latprof.h"
 
 #include "log.h"
+#include "alog.h"
 static const char *TAG = "IO";
 
 /*
@@ -52,26 +125,82 @@ static const char *TAG = "IO";
 static BYTE sio1s_in(void), sio1d_in(void), sio2s_in(void), sio2d_in(void);
 static BYTE sio3s_in(void), sio3d_in(void);
 static BYTE prts_in(void), prtd_in(void), mmu_in(void), timer_in(void);
+static BYTE cycle_in(void);
 static BYTE hwctl_in(void), fpsw_in(void);
 static void led_out(BYTE data), sio1d_out(BYTE data), sio2s_out(BYTE data);
 static void sio2d_out(BYTE data), prts_out(BYTE data), prtd_out(BYTE data);
 static void sio3s_out(BYTE data), sio3d_out(BYTE data);
 static void mmu_out(BYTE data), timer_out(BYTE data), hwctl_out(BYTE data);
+static void timer_stop(void), timer_start(bool once), timer_rate(WORD hz);
+static void cycle_out(BYTE data);
 static void fpsw_out(BYTE data), fpled_out(BYTE data);
+#if BIOS_TRAP
+static void trap_clear(void);
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+static BYTE sio4s_in(void), sio4d_in(void);
+static void sio4d_out(BYTE data);
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+static BYTE sio5s_in(void), sio5d_in(void);
+static void sio5d_out(BYTE data);
+#endif
 
 static BYTE sio1_last;	/* last character received on SIO1 */
 static BYTE sio2_last;	/* last character received on SIO2 */
 static BYTE sio3_last;	/* last character received on SIO3 */
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+static BYTE sio4_last;	/* last character received on SIO4 */
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+static BYTE sio5_last;	/* last character received on SIO5 */
+#endif
        BYTE fp_value;	/* port 255 value, can be set from ICE or config() */
-static bool timer;	/* 60 Hz timer enabled flag */
+static bool timer;	/* system timer enabled flag */
+static bool timer_once;	/* one interrupt only, then stopped */
+static alarm_id_t timer_id;	/* alarm of the running timer, 0 if none */
+static WORD timer_hz = TIMER_HZ;	/* rate of the interrupts */
+static uint32_t timer_period = 16667; /* interval in microseconds */
+static WORD timer_count;	/* interrupts since the start */
+static Tstates_t timer_when;	/* T-state of the next interrupt */
+static BYTE timer_cmd;		/* command waiting for arguments */
+static int timer_argn;		/* arguments received */
+static BYTE timer_ctr[2];	/* latched count of interrupts */
+static int timer_ctr_n;		/* bytes of it not read yet */
+static BYTE cycle_ctr[16];	/* latched T-states and microseconds */
+static int cycle_n;		/* bytes of them not read yet */
 static BYTE hwctl_lock = 0xff; /* lock status hardware control port */
+static BYTE hwctl_ext;		/* state of an extended command */
+static BYTE hwctl_ctr[4];	/* latched performance counter */
+static int hwctl_ctr_n;		/* bytes of it not read yet */
+static BYTE hwctl_arg[5];	/* arguments of an extended command */
+static int hwctl_argn;		/* arguments received */
 int cons_data_bits = 7;	/* output to consoles is 7 or 8 bits */
+uint32_t sio3_baud = 115200; /* baud rate of the serial UART */
+bool snap_resume;	/* resume the machine from the snapshot */
+bool prt_spool;		/* printer output is spooled to /PRINT80 */
+bool out_capture;	/* console and printer output is captured */
+uint32_t usb_bytes;	/* bytes in and out of the USB consoles */
+
+/*
+ *	With IO_COUNT the CPU calls the ports through the tables of
+ *	counting functions below, which call the devices in these.
+ */
+#if IO_COUNT
+#define PORT_IN		static in_func_t *const port_in_dev
+#define PORT_OUT	static out_func_t *const port_out_dev
+#else
+#define PORT_IN		in_func_t *const port_in
+#define PORT_OUT	out_func_t *const port_out
+#endif
 
 /*
  *	This array contains function pointers for every input
  *	I/O port (0 - 255), to do the required I/O.
+ *	Both port tables are in RAM, so that an I/O instruction
+ *	doesn't miss the XIP cache while core 1 refreshes the LCD.
  */
-in_func_t *const port_in[256] = {
+PORT_IN[256] __not_in_flash("port_tables") = {
 	[  0] = sio1s_in,	/* SIO1 status */
 	[  1] = sio1d_in,	/* SIO1 read data */
 	[  2] = sio2s_in,	/* SIO2 status */
@@ -81,11 +210,28 @@ in_func_t *const port_in[256] = {
 	[  6] = prtd_in,	/* printer read data */
 	[  7] = sio3s_in,	/* SIO3 status */
 	[  8] = sio3d_in,	/* SIO3 read data */
+	[  9] = xfdc_in,	/* extended FDC status */
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+	[ 10] = sio4s_in,	/* SIO4 status */
+	[ 11] = sio4d_in,	/* SIO4 read data */
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+	[ 12] = sio5s_in,	/* SIO5 status */
+	[ 13] = sio5d_in,	/* SIO5 read data */
+#endif
 	[ 14] = dazzler_flags_in, /* Cromemco Dazzler flags */
+	[ 16] = xfer_in,	/* file transfer status */
+	[ 17] = net_in,		/* network bridge status */
+	[ 18] = pcode_in,	/* arithmetic assist status */
+	[ 19] = memdma_in,	/* memory DMA status */
+#if SOUND80
+	[ 20] = sound_in,	/* sound device status */
+#endif
 	[ 64] = mmu_in,		/* MMU */
 	[ 65] = clkc_in,	/* RTC read clock command */
 	[ 66] = clkd_in,	/* RTC read clock data */
-	[ 67] = timer_in,	/* 60 Hz timer status */
+	[ 67] = timer_in,	/* system timer status */
+	[ 68] = cycle_in,	/* cycle and time counter */
 	[160] = hwctl_in,	/* virtual hardware control */
 	[254] = fpsw_in,	/* mirror of port 255 */
 	[255] = fpsw_in		/* read from front panel switches */
@@ -95,7 +241,7 @@ in_func_t *const port_in[256] = {
  *	This array contains function pointers for every output
  *	I/O port (0 - 255), to do the required I/O.
  */
-out_func_t *const port_out[256] = {
+PORT_OUT[256] __not_in_flash("port_tables") = {
 	[  0] = led_out,	/* RGB LED */
 	[  1] = sio1d_out,	/* SIO1 write data */
 	[  2] = sio2s_out,	/* SIO2 write status */
@@ -105,363 +251,1720 @@ out_func_t *const port_out[256] = {
 	[  6] = prtd_out,	/* printer write data */
 	[  7] = sio3s_out,	/* SIO3 write status */
 	[  8] = sio3d_out,	/* SIO3 write data */
+	[  9] = xfdc_out,	/* extended FDC command */
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+	[ 11] = sio4d_out,	/* SIO4 write data */
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+	[ 13] = sio5d_out,	/* SIO5 write data */
+#endif
 	[ 14] = dazzler_ctl_out, /* Cromemco Dazzler control */
 	[ 15] = dazzler_format_out, /* Cromemco Dazzler format */
+	[ 16] = xfer_out,	/* file transfer command */
+	[ 17] = net_out,	/* network bridge command */
+	[ 18] = pcode_out,	/* arithmetic assist command */
+	[ 19] = memdma_out,	/* memory DMA command */
+#if SOUND80
+	[ 20] = sound_out,	/* sound device DAC level */
+#endif
 	[ 64] = mmu_out,	/* MMU */
 	[ 65] = clkc_out,	/* RTC write clock command */
 	[ 66] = clkd_out,	/* RTC write clock data */
-	[ 67] = timer_out,	/* 60 Hz timer control */
+	[ 67] = timer_out,	/* system timer control */
+	[ 68] = cycle_out,	/* latch cycle and time counter */
 	[160] = hwctl_out,	/* virtual hardware control */
 	[254] = fpsw_out,	/* write to front panel switches */
 	[255] = fpled_out	/* write to front panel lights */
 };
 
+#if IO_COUNT
 /*
- *	This function is to initiate the I/O devices.
- *	It will be called from the CPU simulation before
- *	any operation with the CPU is possible.
+ *	A counting function for every port, in RAM like the tables. The
+ *	ports without a device stay NULL in the tables used by the CPU,
+ *	so that it handles them as before.
  */
-void init_io(void)
+io_count_t io_count[256];
+
+in_func_t *port_in[256] __not_in_flash("port_dispatch");
+out_func_t *port_out[256] __not_in_flash("port_dispatch");
+
+#define IO_HEX(m, h)	m(h##0) m(h##1) m(h##2) m(h##3) m(h##4) m(h##5) \
+			m(h##6) m(h##7) m(h##8) m(h##9) m(h##a) m(h##b) \
+			m(h##c) m(h##d) m(h##e) m(h##f)
+#define IO_ALL(m)	IO_HEX(m, 0) IO_HEX(m, 1) IO_HEX(m, 2) IO_HEX(m, 3) \
+			IO_HEX(m, 4) IO_HEX(m, 5) IO_HEX(m, 6) IO_HEX(m, 7) \
+			IO_HEX(m, 8) IO_HEX(m, 9) IO_HEX(m, a) IO_HEX(m, b) \
+			IO_HEX(m, c) IO_HEX(m, d) IO_HEX(m, e) IO_HEX(m, f)
+
+#if TRACE80
+#define IO_TRACE(t, p, d)	trace_io(t, p, d)
+#else
+#define IO_TRACE(t, p, d)
+#endif
+
+#if REPLAY80
+#define IO_REPLAY(p, d)	if (replay_active()) d = replay_port_in(p, d)
+#else
+#define IO_REPLAY(p, d)
+#endif
+
+#define IO_COUNTER(n)							\
+static BYTE __not_in_flash_func(io_in_##n)(void)			\
+{									\
+	BYTE data;							\
+	BUDGET_ENTER(BUDGET_IO);					\
+									\
+	io_count[0x##n].in++;						\
+	data = (*port_in_dev[0x##n])();					\
+	IO_REPLAY(0x##n, data);						\
+	IO_TRACE(TR_IN, 0x##n, data);					\
+	BUDGET_EXIT();							\
+	return data;							\
+}									\
+static void __not_in_flash_func(io_out_##n)(BYTE data)			\
+{									\
+	BUDGET_ENTER(BUDGET_IO);					\
+									\
+	io_count[0x##n].out++;						\
+	IO_TRACE(TR_OUT, 0x##n, data);					\
+	(*port_out_dev[0x##n])(data);					\
+	BUDGET_EXIT();							\
+}
+#define IO_IN_FUNC(n)	io_in_##n,
+#define IO_OUT_FUNC(n)	io_out_##n,
+
+IO_ALL(IO_COUNTER)
+
+static in_func_t *const io_in_funcs[256] = { IO_ALL(IO_IN_FUNC) };
+static out_func_t *const io_out_funcs[256] = { IO_ALL(IO_OUT_FUNC) };
+
+static void io_count_init(void)
 {
+	register int i;
+
+	for (i = 0; i < 256; i++) {
+		port_in[i] = port_in_dev[i] ? io_in_funcs[i] : NULL;
+		port_out[i] = port_out_dev[i] ? io_out_funcs[i] : NULL;
+	}
+	memset(io_count, 0, sizeof(io_count));
 }
 
 /*
- *	This function is to stop the I/O devices. It is
- *	called from the CPU simulation on exit.
+ *	Port access profile for the ICE
  */
-void exit_io(void)
+void print_io_count(void)
+{
+	register int i;
+
+	puts("Port        In       Out");
+	for (i = 0; i < 256; i++)
+		if (io_count[i].in || io_count[i].out)
+			printf("%02X   %9lu %9lu\n", i,
+			       (unsigned long) io_count[i].in,
+			       (unsigned long) io_count[i].out);
+}
+
+void clear_io_count(void)
 {
-	timer = false;		/* stop 60 Hz timer */
+	memset(io_count, 0, sizeof(io_count));
 }
+#endif /* IO_COUNT */
 
+#if LIB_STDIO_MSC_USB
 /*
- *	I/O handler for read SIO1 (Pico USB Console CDC) status:
- *	bit 0 = 0, character available for input from tty
- *	bit 7 = 0, transmitter ready to write character to tty
+ *	State of the USB CDC interfaces, kept up to date by the TinyUSB
+ *	callbacks, so that polling a status port is a few memory loads
+ *	instead of TinyUSB queries in the common case of no input.
+ *	A set receive flag is checked against the FIFO before it is
+ *	reported, because stdio can read the FIFO without us knowing.
+ *	The flags are cleared before the FIFO is checked, so that a
+ *	callback in between isn't lost.
  */
-static BYTE sio1s_in(void)
+static volatile bool cdc_conn[CFG_TUD_CDC];	/* DTR is set */
+static volatile bool cdc_rx[CFG_TUD_CDC];	/* data may be available */
+static volatile bool cdc_tx[CFG_TUD_CDC];	/* write FIFO has room */
+
+/*
+ *	Output is collected in the write FIFO and sent when a packet is
+ *	full, on newline, or when a status poll finds it waiting for
+ *	CDC_FLUSH_US, instead of sending a USB packet for every byte.
+ */
+#define CDC_FLUSH_US 1000
+#define CDC_WAIT_US 50000	/* max. wait for room in the FIFO */
+static bool cdc_unflushed[CFG_TUD_CDC];	/* output waits in the FIFO */
+static uint32_t cdc_since[CFG_TUD_CDC];	/* time of first waiting byte */
+
+void tud_cdc_rx_cb(uint8_t itf)
 {
-	register BYTE stat = 0b10000001; /* initially not ready */
+	cdc_rx[itf] = true;
+}
 
-#if LIB_PICO_STDIO_USB
-	if (tud_cdc_connected()) {
-		/* check if output to CDC is possible */
-		if (tud_cdc_write_available())
-			stat &= 0b01111111;	/* if so flip status bit */
-		/* check if there is input from CDC */
-		if (tud_cdc_available())
-			stat &= 0b11111110;	/* if so flip status bit */
-	}
-#endif
-#if LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO
-	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE_ITF)) {
-		/* check if output to CDC is possible */
-		if (tud_cdc_n_write_available(STDIO_MSC_USB_CONSOLE_ITF))
-			stat &= 0b01111111;	/* if so flip status bit */
-		/* check if there is input from CDC */
-		if (tud_cdc_n_available(STDIO_MSC_USB_CONSOLE_ITF))
-			stat &= 0b11111110;	/* if so flip status bit */
-	}
-#endif
+void tud_cdc_tx_complete_cb(uint8_t itf)
+{
+	cdc_tx[itf] = true;
+}
 
-	return stat;
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
+{
+	UNUSED(rts);
+
+	cdc_conn[itf] = dtr;
+	cdc_rx[itf] = true;
+	cdc_tx[itf] = true;
+}
+
+static inline bool cdc_readable(uint8_t itf)
+{
+	if (cdc_rx[itf]) {
+		cdc_rx[itf] = false;
+		__compiler_memory_barrier();
+		if (tud_cdc_n_available(itf))
+			cdc_rx[itf] = true;
+	}
+	return cdc_rx[itf];
 }
 
 /*
- *	I/O handler for read SIO1 (Pico USB Console CDC) data.
+ * update the transmitter ready flag after a write, room is what was
+ * free before it, more than one means there still is
  */
-static BYTE sio1d_in(void)
+static inline void cdc_written(uint8_t itf, uint32_t room)
 {
-	bool input_avail = false;
+	cdc_tx[itf] = false;
+	__compiler_memory_barrier();
+	if (room > 1 || tud_cdc_n_write_available(itf))
+		cdc_tx[itf] = true;
+}
 
-#if LIB_PICO_STDIO_USB
-	if (tud_cdc_connected() && tud_cdc_available())
-		input_avail = true;
-#endif
-#if LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO
-	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE_ITF) &&
-	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE_ITF))
-		input_avail = true;
-#endif
+static void cdc_flush(uint8_t itf)
+{
+	if (cdc_unflushed[itf]) {
+		tud_cdc_n_write_flush(itf);
+		cdc_unflushed[itf] = false;
+	}
+}
 
-	if (input_avail)
-		sio1_last = getchar();
+static inline void cdc_poll_flush(uint8_t itf)
+{
+	if (cdc_unflushed[itf] &&
+	    time_us_32() - cdc_since[itf] >= CDC_FLUSH_US)
+		cdc_flush(itf);
+}
 
-	return sio1_last;
+static void cdc_putc(uint8_t itf, char c)
+{
+	uint32_t t, room;
+
+	if ((room = tud_cdc_n_write_available(itf)) == 0) {
+		/* tud_task() runs in an IRQ and empties the FIFO */
+		tud_cdc_n_write_flush(itf);
+		t = time_us_32();
+		while ((room = tud_cdc_n_write_available(itf)) == 0 &&
+		       tud_cdc_n_connected(itf) &&
+		       time_us_32() - t < CDC_WAIT_US)
+			tight_loop_contents();
+	}
+	tud_cdc_n_write_char(itf, c);
+	if (c == '\n') {
+		tud_cdc_n_write_flush(itf);
+		cdc_unflushed[itf] = false;
+	} else if (!cdc_unflushed[itf]) {
+		cdc_unflushed[itf] = true;
+		cdc_since[itf] = time_us_32();
+	}
+	cdc_written(itf, room);
 }
 
 /*
- *	I/O handler for read SIO2 (USB Console 2 CDC) status:
+ *	status of a USB console:
  *	bit 0 = 0, character available for input from tty
  *	bit 7 = 0, transmitter ready to write character to tty
  */
-static BYTE sio2s_in(void)
+static BYTE cdc_status(uint8_t itf)
 {
 	register BYTE stat = 0b10000001; /* initially not ready */
 
-#if LIB_STDIO_MSC_USB
-	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE2_ITF)) {
+	if (cdc_conn[itf]) {
+		cdc_poll_flush(itf);
 		/* check if output to CDC is possible */
-		if (tud_cdc_n_write_available(STDIO_MSC_USB_CONSOLE2_ITF))
+		if (cdc_tx[itf])
 			stat &= 0b01111111;	/* if so flip status bit */
 		/* check if there is input from CDC */
-		if (tud_cdc_n_available(STDIO_MSC_USB_CONSOLE2_ITF))
+		if (cdc_readable(itf))
 			stat &= 0b11111110;	/* if so flip status bit */
 	}
-#endif
 
 	return stat;
 }
 
 /*
- *	I/O handler for read SIO2 (USB Console 2 CDC) data.
+ *	write a byte to a USB console
  */
-static BYTE sio2d_in(void)
+static void cdc_out(uint8_t itf, BYTE data)
 {
-#if LIB_STDIO_MSC_USB
-	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE2_ITF) &&
-	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE2_ITF))
-		sio2_last = tud_cdc_n_read_char(STDIO_MSC_USB_CONSOLE2_ITF);
-#endif
-
-	return sio2_last;
+	if (cons_data_bits == 7)
+		data &= 0x7f;	/* strip parity, some software won't */
+	if (cdc_conn[itf]) {
+		cdc_putc(itf, (char) data);
+		usb_bytes++;
+	}
 }
 
 /*
- *	I/O handler for read SIO3 (serial UART) status.
+ *	read a byte from a USB console
  */
-static BYTE sio3s_in(void)
+static inline BYTE cdc_getc(uint8_t itf)
 {
-	register BYTE stat = 0b10000001; /* initially not ready */
-
-	uart_inst_t *my_uart = uart_default;
-
-	if (uart_is_writable(my_uart))	/* check if output to UART is possible */
-		stat &= 0b01111111;	/* if so flip status bit */
-	if (uart_is_readable(my_uart))	/* check if there is input from UART */
-		stat &= 0b11111110;	/* if so flip status bit */
+	usb_bytes++;
+	return (BYTE) tud_cdc_n_read_char(itf);
+}
 
-	return stat;
+static void cdc_init(uint8_t itf)
+{
+	cdc_conn[itf] = tud_cdc_n_connected(itf);
+	cdc_rx[itf] = true;
+	cdc_tx[itf] = true;
 }
+#endif
 
 /*
- *	I/O handler for read SIO3 (serial UART) data.
+ *	The serial UART is served by its interrupt from ring buffers, so
+ *	that the CPU doesn't wait for the 32 byte hardware FIFOs. The PL011
+ *	only interrupts when the TX FIFO level drops below the threshold,
+ *	so the TX FIFO is filled from the thread when the ring was empty.
+ *	The rings are also used by the network bridge, sized for frames.
  */
-static BYTE sio3d_in(void)
+#define UART_BUFSIZ	1024	/* size of the ring buffers, power of 2 */
+#define UART_BUFMSK	(UART_BUFSIZ - 1)
+static BYTE uart_rxbuf[UART_BUFSIZ], uart_txbuf[UART_BUFSIZ];
+static volatile uint32_t uart_rxhead, uart_rxtail, uart_txhead, uart_txtail;
+
+static void uart_fill_tx(uart_inst_t *my_uart)
 {
-	uart_inst_t *my_uart = uart_default;
+	while (uart_txtail != uart_txhead && uart_is_writable(my_uart))
+		uart_putc_raw(my_uart, uart_txbuf[uart_txtail++ & UART_BUFMSK]);
+	uart_set_irqs_enabled(my_uart, true, uart_txtail != uart_txhead);
+}
 
-	if (uart_is_readable(my_uart))
-		sio3_last = uart_getc(my_uart);
+static void __not_in_flash_func(uart_irq)(void)
+{
+	uart_inst_t *my_uart = uart_default;
+	BYTE c;
+	BUDGET_ENTER(BUDGET_IO);
 
-	return sio3_last;
+	while (uart_is_readable(my_uart)) {
+		c = (BYTE) uart_getc(my_uart);
+		if (uart_rxhead - uart_rxtail < UART_BUFSIZ)
+			uart_rxbuf[uart_rxhead++ & UART_BUFMSK] = c;
+	}
+	uart_fill_tx(my_uart);
+	BUDGET_EXIT();
 }
 
-/*
- *	I/O handler for read printer (USB Printer CDC) status:
- */
-static BYTE prts_in(void)
+void uart_put(BYTE c)
 {
-	register BYTE stat = 0; /* initially not ready */
+	uart_inst_t *my_uart = uart_default;
 
-#if LIB_STDIO_MSC_USB
-	if (tud_cdc_n_connected(STDIO_MSC_USB_PRINTER_ITF) &&
-	    tud_cdc_n_write_available(STDIO_MSC_USB_PRINTER_ITF))
-		stat = 0xff;
-#endif
+	/* wait for room, the IRQ empties the ring */
+	while (uart_txhead - uart_txtail >= UART_BUFSIZ)
+		tight_loop_contents();
 
-	return stat;
+	irq_set_enabled(UART_IRQ_NUM(my_uart), false);
+	uart_txbuf[uart_txhead++ & UART_BUFMSK] = c;
+	uart_fill_tx(my_uart);
+	irq_set_enabled(UART_IRQ_NUM(my_uart), true);
 }
 
 /*
- *	I/O handler for read printer (USB Printer CDC) data:
- *	always read an EOF from the printer
+ *	get a received byte, -1 if there is none
  */
-static BYTE prtd_in(void)
+int uart_get(void)
 {
-	return 0x1a;	/* CP/M EOF */
+	if (uart_rxhead == uart_rxtail)
+		return -1;
+	return uart_rxbuf[uart_rxtail++ & UART_BUFMSK];
 }
 
 /*
- *	read MMU register
- *	returns maximum bank in upper nibble
- *	and currently selected bank in lower nibble
+ *	room in the transmit ring
  */
-static BYTE mmu_in(void)
+unsigned int uart_tx_room(void)
 {
-	return (NUMSEG << 4) | selbnk;
+	return UART_BUFSIZ - (uart_txhead - uart_txtail);
 }
 
 /*
- *	read 60 Hz timer enabled status
+ *	set the baud rate of the serial UART
  */
-static BYTE timer_in(void)
+void sio3_set_baud(uint32_t baud)
 {
-	return timer ? 1 : 0;
+	sio3_baud = baud;
+	uart_set_baudrate(uart_default, baud);
 }
 
 /*
- *	Input from virtual hardware control port
- *	returns lock status of the port
+ *	Console data transfers, the selected bank belongs to the console
+ *	SIO1 - SIO5 for the accounting of the PC samples.
  */
-static BYTE hwctl_in(void)
-{
-	return hwctl_lock;
-}
+#if PC_PROF_SIZE > 0
+#define sio_owner(sio)	(pc_acct_owner[selbnk] = (BYTE) (sio))
+#else
+#define sio_owner(sio)	UNUSED(sio)
+#endif
 
+#if SIO_IDLE
 /*
- *	Read virtual front panel switches state
+ *	A program waiting for a key polls the console status in a tight
+ *	loop. After SIO_IDLE_POLLS polls without input and without console
+ *	data transfers, each within SIO_IDLE_GAP T-states of the one before,
+ *	the host waits in __wfe() for an interrupt, at most SIO_IDLE_US.
+ *	A program which only checks the status now and then while working
+ *	never gets there. The T-states the CPU would have run in that time
+ *	are added, so that the emulated time stays right.
  */
-static BYTE fpsw_in(void)
-{
-	return fp_value;
-}
+#define SIO_IDLE_POLLS	64
+#define SIO_IDLE_GAP	256	/* max. T-states between two polls */
+#define SIO_IDLE_US	1000
+static unsigned sio_idle_polls;
+static Tstates_t sio_idle_last;	/* T of the last poll */
 
-/*
- *	Switch RGB LED blue on/off.
- */
-static void led_out(BYTE data)
+static void sio_idle(BYTE stat)
 {
-	if (!data) {
-		/* 0 switches LED blue off */
-		led_color &= ~C_BLUE;
-	} else {
-		/* everything else on */
-		led_color = (led_color & ~C_BLUE) | C_BLUE;
+	uint64_t t;
+	int prev;
+
+	hang_io();			/* polling the console is progress */
+	if (replay_active())		/* keep the T-states deterministic */
+		return;
+	if (!(stat & 1)) {		/* input available */
+		sio_idle_polls = 0;
+		return;
 	}
-	lcd_update_led();
+	if (T - sio_idle_last > SIO_IDLE_GAP)	/* not a tight loop */
+		sio_idle_polls = 0;
+	sio_idle_last = T;
+	if (++sio_idle_polls < SIO_IDLE_POLLS)
+		return;
+
+	t = time_us_64();
+	prev = budget_enter(BUDGET_SLEEP);
+	best_effort_wfe_or_timeout(make_timeout_time_us(SIO_IDLE_US));
+	budget_exit(prev);
+	if (speed)
+		T += (time_us_64() - t) * (unsigned) speed_khz / 1000;
+	sio_idle_last = T;
 }
 
-/*
- *	Write byte to Pico USB Console CDC.
- */
-static void sio1d_out(BYTE data)
+static inline void sio_active(int sio)
 {
-	if (cons_data_bits == 7)
-		putchar_raw((int) data & 0x7f); /* strip parity, some software won't */
-	else
-		putchar_raw((int) data);
+	sio_idle_polls = 0;
+	hang_io();
+	sio_owner(sio);
 }
+#else
+#define sio_idle(stat)	hang_io()
 
-/*
- *	Write SIO2 status (no function).
- */
-static void sio2s_out(BYTE data)
+static inline void sio_active(int sio)
 {
-	UNUSED(data);
+	hang_io();
+	sio_owner(sio);
 }
+#endif
 
+#if REPLAY80
 /*
- *	Write SIO2 (USB Console 2 CDC) data.
+ *	Recording and replay of the inputs of a run, see replay.h.
+ *	A port value is recorded when it differs from the last one read
+ *	from the port. The timer ticks are recorded and requested on the
+ *	next memory read of the CPU, so that they have the T-states of an
+ *	instruction. replay_next is the T of the next event replay_step()
+ *	has to handle, the timer sets it to 0 for a tick when recording.
+ *	The memory reads compare only the low 32 bits of T with replay_due,
+ *	which is at most REPLAY_SPAN T-states ahead, so that the compare
+ *	can't wrap. For an event further away replay_step() is called
+ *	early and sets replay_due again.
+ *	In a replay an input event is handled on the read of its port, or
+ *	later if the port wasn't read at that T.
  */
-static void sio2d_out(BYTE data)
+static void int_post(int src, BYTE vector);
+
+int replay_mode;			/* mode of this run */
+int replay_sel;				/* mode for the next run */
+static Tstates_t replay_next = ~(Tstates_t) 0;	/* T of the next event */
+uint32_t replay_due = ~0U;		/* low 32 bits of T of the next check */
+static Tstates_t replay_t0;		/* T at the start of the run */
+static bool replay_on;			/* REPLAY_FILE is open */
+static uint32_t replay_events;		/* events recorded or replayed */
+static replay_ev_t replay_ev;		/* next event of a replay */
+static volatile bool replay_tick;	/* timer tick to record */
+static BYTE replay_vector;		/* its interrupt data */
+
+/* the input ports which depend on the world outside */
+static const BYTE replay_ports[] = {
+	0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, 14, 17, 66, 68, 160
+};
+#define REPLAY_PORTS	count_of(replay_ports)
+static BYTE replay_slot[256];		/* index + 1 into replay_val */
+static BYTE replay_val[REPLAY_PORTS];	/* last value of the port */
+static bool replay_valid[REPLAY_PORTS];	/* replay_val is set */
+
+static inline Tstates_t replay_when(const replay_ev_t *ev)
 {
-#if LIB_STDIO_MSC_USB
-	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE2_ITF)) {
-		if (!tud_cdc_n_write_available(STDIO_MSC_USB_CONSOLE2_ITF))
-			tud_cdc_n_write_flush(STDIO_MSC_USB_CONSOLE2_ITF);
-		if (cons_data_bits == 7)
-			tud_cdc_n_write_char(STDIO_MSC_USB_CONSOLE2_ITF, data & 0x7f);
-		else
-			tud_cdc_n_write_char(STDIO_MSC_USB_CONSOLE2_ITF, data);
-		tud_cdc_n_write_flush(STDIO_MSC_USB_CONSOLE2_ITF);
-	}
-#else
-	UNUSED(data);
-#endif
+	return replay_t0 + ev->t_lo + ((Tstates_t) ev->t_hi << 32);
 }
 
-/*
- *	Write SIO3 status (no function).
- */
-static void sio3s_out(BYTE data)
+#define REPLAY_SPAN	(1U << 30)	/* max. T-states to the next check */
+
+static inline void replay_set(Tstates_t when)
 {
-	UNUSED(data);
+	replay_next = when;
+	if (when > T + REPLAY_SPAN)
+		when = T + REPLAY_SPAN;
+	replay_due = (uint32_t) when;
 }
 
-/*
- *	Write SIO3 (serial UART) data.
- */
-static void sio3d_out(BYTE data)
+static void __not_in_flash_func(replay_rec)(BYTE type, BYTE arg, BYTE data)
 {
-	uart_inst_t *my_uart = uart_default;
+	Tstates_t t = T - replay_t0;
+	replay_ev_t ev = {
+		.t_lo = (uint32_t) t, .t_hi = (uint16_t) (t >> 32),
+		.type = type, .arg = arg, .data = data
+	};
 
-	if (cons_data_bits == 7)
-		uart_putc(my_uart, (int) data & 0x7f); /* strip parity, some software won't */
-	else
-		uart_putc(my_uart, (int) data);
+	replay_put(&ev);
+	replay_events++;
 }
 
 /*
- *	Write printer status (no function).
+ * handle the events due, port is the port being read or -1
  */
-static void prts_out(BYTE data)
+void __not_in_flash_func(replay_step)(int port)
 {
-	UNUSED(data);
+	Tstates_t when;
+	uint32_t save;
+	bool tick;
+	BYTE vector;
+	register int s;
+
+	if (replay_mode == REPLAY_REC) {
+		save = save_and_disable_interrupts();
+		replay_set(~(Tstates_t) 0);
+		tick = replay_tick;
+		vector = replay_vector;
+		replay_tick = false;
+		restore_interrupts(save);
+		if (tick) {
+			replay_rec(RP_INT, INT_TIMER, vector);
+			int_post(INT_TIMER, vector);
+		}
+		return;
+	}
+
+	while ((when = replay_when(&replay_ev)) <= T) {
+		if (replay_ev.type == RP_IN) {
+			/* wait for the read of the port at this T */
+			if (when == T && replay_ev.arg != port)
+				break;
+			if ((s = replay_slot[replay_ev.arg]) != 0) {
+				replay_val[s - 1] = replay_ev.data;
+				replay_valid[s - 1] = true;
+			}
+		} else if (replay_ev.type == RP_INT
+			   && replay_ev.arg < INT_SOURCES)
+			int_post(replay_ev.arg, replay_ev.data);
+		replay_events++;
+		s = replay_ev.type == RP_IN && replay_ev.arg == port;
+		if (!replay_get(&replay_ev)) {
+			/* end of the log, continue with the real inputs */
+			replay_mode = REPLAY_OFF;
+			replay_set(~(Tstates_t) 0);
+			return;
+		}
+		if (s)		/* the next event is for the next read */
+			break;
+	}
+	replay_set(replay_when(&replay_ev));
 }
 
 /*
- *	Write printer (USB Printer CDC) data.
+ * called from the port counting functions with the value read
+ * from port, returns the value for the CPU
  */
-static void prtd_out(BYTE data)
+BYTE __not_in_flash_func(replay_port_in)(BYTE port, BYTE data)
 {
-#if LIB_STDIO_MSC_USB
-	if (tud_cdc_n_connected(STDIO_MSC_USB_PRINTER_ITF)) {
-		if (!tud_cdc_n_write_available(STDIO_MSC_USB_PRINTER_ITF))
-			tud_cdc_n_write_flush(STDIO_MSC_USB_PRINTER_ITF);
-		tud_cdc_n_write_char(STDIO_MSC_USB_PRINTER_ITF, data);
-		tud_cdc_n_write_flush(STDIO_MSC_USB_PRINTER_ITF);
+	register int s = replay_slot[port];
+
+	if (s-- == 0)
+		return data;
+
+	if (replay_mode == REPLAY_REC) {
+		if (!replay_valid[s] || replay_val[s] != data) {
+			replay_val[s] = data;
+			replay_valid[s] = true;
+			replay_rec(RP_IN, port, data);
+		}
+		return data;
 	}
-#else
-	UNUSED(data);
-#endif
+
+	if (T >= replay_next)
+		replay_step(port);
+	return replay_valid[s] ? replay_val[s] : data;
 }
 
 /*
- *	write MMU register
+ * start recording or replaying as selected in the config dialog,
+ * called before the CPU starts
  */
-static void mmu_out(BYTE data)
+void replay_start(void)
 {
-	if (selbnk > NUMSEG) {
-		LOGE(TAG, "%04x: trying to select non-existing bank %d",
-		     PC, data);
-		cpu_error = IOERROR;
-		cpu_state = ST_STOPPED;
+	register unsigned i;
+
+	replay_mode = REPLAY_OFF;
+	replay_set(~(Tstates_t) 0);
+	if (replay_sel == REPLAY_OFF
+	    || !(replay_on = replay_open(replay_sel == REPLAY_REC)))
 		return;
-	}
-	selbnk = data;
-	if (selbnk != 0)
-		curbnk = bnks[selbnk - 1];
+
+	memset(replay_slot, 0, sizeof(replay_slot));
+	for (i = 0; i < REPLAY_PORTS; i++)
+		replay_slot[replay_ports[i]] = i + 1;
+	memset(replay_valid, 0, sizeof(replay_valid));
+	replay_events = 0;
+	replay_tick = false;
+	replay_t0 = T;
+
+	if (replay_sel == REPLAY_PLAY) {
+		if (!replay_get(&replay_ev)) {
+			puts("Replay log is empty");
+			replay_close();
+			replay_on = false;
+			return;
+		}
+		replay_set(replay_when(&replay_ev));
+		puts("Replaying " REPLAY_FILE);
+	} else
+		puts("Recording into " REPLAY_FILE);
+	replay_mode = replay_sel;
+	mem_attn.on.replay = 1;
 }
 
 /*
- *	timer interrupt causes maskable CPU interrupt
+ * stop recording or replaying, called on exit of the CPU
  */
-static int64_t timer_alarm(alarm_id_t id, void *user_data)
+void replay_stop(void)
 {
-	UNUSED(id);
-	UNUSED(user_data);
+	bool done = replay_mode == REPLAY_OFF;
 
-	if (timer) {
-		int_data = 0xff;	/* RST 38H for IM 0, 0FFH for IM 2 */
+	if (!replay_on)
+		return;
+
+	replay_mode = REPLAY_OFF;
+	replay_set(~(Tstates_t) 0);
+	mem_attn.on.replay = 0;
+	replay_close();
+	replay_on = false;
+
+	if (replay_sel == REPLAY_REC)
+		printf("Recorded %lu events in %llu T-states\n",
+		       (unsigned long) replay_events,
+		       (unsigned long long) (T - replay_t0));
+	else
+		printf("Replayed %lu events in %llu T-states%s\n",
+		       (unsigned long) replay_events,
+		       (unsigned long long) (T - replay_t0),
+		       done ? "" : ", end of the log not reached");
+}
+#endif /* REPLAY80 */
+
+/*
+ *	Interrupt controller, the sources are kept pending until the CPU
+ *	took the interrupt from the one raised before, so that sources
+ *	requesting at the same time don't overwrite each other. The pending
+ *	source with the highest priority (lowest number) is raised next.
+ *	The CPU cores clear int_int when they take an interrupt, this is
+ *	checked on the SIO status reads the programs poll, and on timer ticks.
+ *	While sources are pending mem_attn.on.intr is set, then the memory
+ *	reads of the CPU check it too, so that the next one is raised right
+ *	after the CPU took the one before, and is there when the handler
+ *	enables the interrupts again with EI or returns with RETI.
+ *	Requests can come from core 0 IRQs and from core 1.
+ */
+static volatile uint32_t int_pending;	/* pending interrupt sources */
+static BYTE int_vectors[INT_SOURCES];	/* interrupt data of the sources */
+static spin_lock_t *int_lock;
+
+static void __not_in_flash_func(int_raise)(void)
+{
+	register int src;
+
+	if (int_pending && !int_int) {
+		src = __builtin_ctz(int_pending);
+		int_pending &= ~(1U << src);
+		int_data = int_vectors[src];
 		int_int = true;
-		return -16667L;		/* reschedule alarm */
-	} else
-		return 0L;		/* do not reschedule alarm */
+		latprof_raise();
+	}
+	mem_attn.on.intr = int_pending != 0;
+}
+
+static void __not_in_flash_func(int_post)(int src, BYTE vector)
+{
+	uint32_t save;
+
+#if TRACE80
+	trace_int(src, vector);
+#endif
+	save = spin_lock_blocking(int_lock);
+	int_vectors[src] = vector;
+	int_pending |= 1U << src;
+	int_raise();
+	spin_unlock(int_lock, save);
+	__sev();		/* wake up core 0 waiting in HALT */
+}
+
+void __not_in_flash_func(int_request)(int src, BYTE vector)
+{
+#if REPLAY80
+	if (src == INT_TIMER && replay_active()) {
+		/* the ticks are requested by replay_step() */
+		if (replay_mode == REPLAY_REC) {
+			replay_vector = vector;
+			replay_tick = true;
+			replay_next = 0;
+			replay_due = (uint32_t) T;
+		}
+		return;
+	}
+#endif
+	int_post(src, vector);
+}
+
+void __not_in_flash_func(int_service)(void)
+{
+	uint32_t save;
+
+	if (int_pending) {
+		save = spin_lock_blocking(int_lock);
+		int_raise();
+		spin_unlock(int_lock, save);
+	}
+}
+
+void int_clear(void)
+{
+	uint32_t save = spin_lock_blocking(int_lock);
+
+	int_pending = 0;
+	mem_attn.on.intr = 0;
+	spin_unlock(int_lock, save);
+}
+
+/*
+ *	This function is to initiate the I/O devices.
+ *	It will be called from the CPU simulation before
+ *	any operation with the CPU is possible.
+ */
+void init_io(void)
+{
+	if (int_lock == NULL)
+		int_lock = spin_lock_init(spin_lock_claim_unused(true));
+
+#if IO_COUNT
+	io_count_init();
+#endif
+	rtc_init();		/* keep the time for the RTC ports */
+#if BIOS_TRAP
+	trap_clear();		/* no BIOS function traps */
+#endif
+
+	irq_set_exclusive_handler(UART_IRQ_NUM(uart_default), uart_irq);
+	irq_set_enabled(UART_IRQ_NUM(uart_default), true);
+	uart_set_irqs_enabled(uart_default, true, false);
+#if LIB_STDIO_MSC_USB
+#if !STDIO_MSC_USB_DISABLE_STDIO
+	cdc_init(STDIO_MSC_USB_CONSOLE_ITF);
+#endif
+	cdc_init(STDIO_MSC_USB_CONSOLE2_ITF);
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+	cdc_init(STDIO_MSC_USB_CONSOLE3_ITF);
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+	cdc_init(STDIO_MSC_USB_CONSOLE4_ITF);
+#endif
+#endif
+	remote_start();		/* poll the remote control channel */
+	sound_start();		/* set up the sound device */
+}
+
+/*
+ *	This function is to stop the I/O devices. It is
+ *	called from the CPU simulation on exit.
+ */
+void exit_io(void)
+{
+	timer_stop();		/* stop system timer */
+	rtc_exit();		/* stop the updates of the RTC */
+	xfdc_reset();		/* finish background disk commands */
+	xfer_reset();		/* close file transfer */
+	net_reset();		/* close network connection */
+	sound_reset();		/* stop the sound samples */
+	batch_stop();		/* write the log of a batch job */
+#if PRINT_SPOOL_SIZE > 0
+	spool_close();		/* close printer spool file */
+#endif
+#if CAPTURE_SIZE > 0
+	capture_close();	/* close the output capture files */
+#endif
+#if PC_PROF_SIZE > 0
+	pc_prof(false);		/* stop PC profiler */
+#endif
+#if REPLAY80
+	replay_stop();		/* close the recording or replay */
+#endif
+#if LIB_STDIO_MSC_USB
+#if !STDIO_MSC_USB_DISABLE_STDIO
+	cdc_flush(STDIO_MSC_USB_CONSOLE_ITF);
+#endif
+	cdc_flush(STDIO_MSC_USB_CONSOLE2_ITF);
+	cdc_flush(STDIO_MSC_USB_PRINTER_ITF);
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+	cdc_flush(STDIO_MSC_USB_CONSOLE3_ITF);
+#endif
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+	cdc_flush(STDIO_MSC_USB_CONSOLE4_ITF);
+#endif
+#endif
+}
+
+/*
+ *	I/O handler for read SIO1 (Pico USB Console CDC) status:
+ *	bit 0 = 0, character available for input from tty
+ *	bit 7 = 0, transmitter ready to write character to tty
+ */
+static BYTE sio1s_in(void)
+{
+	register BYTE stat = 0b10000001; /* initially not ready */
+
+	int_service();		/* raise the next pending interrupt */
+
+#if LIB_PICO_STDIO_USB
+	if (tud_cdc_connected()) {
+		/* check if output to CDC is possible */
+		if (tud_cdc_write_available())
+			stat &= 0b01111111;	/* if so flip status bit */
+		/* check if there is input from CDC */
+		if (tud_cdc_available())
+			stat &= 0b11111110;	/* if so flip status bit */
+	}
+#endif
+#if LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO
+	stat &= cdc_status(STDIO_MSC_USB_CONSOLE_ITF);
+#endif
+#if BATCH80
+	stat = batch_status(stat);
+#endif
+
+	sio_idle(stat);
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO1 (Pico USB Console CDC) data,
+ *	read from the CDC interface like the other consoles, the
+ *	stdio driver chain is left to the config dialog and the ICE.
+ */
+static BYTE sio1d_in(void)
+{
+#if BATCH80
+	int c;
+#endif
+
+	sio_active(1);
+
+#if BATCH80
+	if ((c = batch_in()) >= 0)
+		return sio1_last = (BYTE) c;
+#endif
+
+#if LIB_PICO_STDIO_USB
+	if (tud_cdc_connected() && tud_cdc_available())
+		sio1_last = getchar();
+#endif
+#if LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO
+	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE_ITF) &&
+	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE_ITF))
+		sio1_last = cdc_getc(STDIO_MSC_USB_CONSOLE_ITF);
+#endif
+
+	return sio1_last;
+}
+
+/*
+ *	I/O handler for read SIO2 (USB Console 2 CDC) status:
+ *	bit 0 = 0, character available for input from tty
+ *	bit 7 = 0, transmitter ready to write character to tty
+ */
+static BYTE sio2s_in(void)
+{
+	register BYTE stat = 0b10000001; /* initially not ready */
+
+	int_service();		/* raise the next pending interrupt */
+
+#if LIB_STDIO_MSC_USB
+	stat &= cdc_status(STDIO_MSC_USB_CONSOLE2_ITF);
+#endif
+
+	sio_idle(stat);
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO2 (USB Console 2 CDC) data.
+ */
+static BYTE sio2d_in(void)
+{
+	sio_active(2);
+
+#if LIB_STDIO_MSC_USB
+	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE2_ITF) &&
+	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE2_ITF))
+		sio2_last = cdc_getc(STDIO_MSC_USB_CONSOLE2_ITF);
+#endif
+
+	return sio2_last;
+}
+
+/*
+ *	I/O handler for read SIO3 (serial UART) status,
+ *	never ready while the network bridge uses the UART.
+ */
+static BYTE sio3s_in(void)
+{
+	register BYTE stat = 0b10000001; /* initially not ready */
+
+	int_service();		/* raise the next pending interrupt */
+
+	if (net_uart)
+		return stat;
+
+	/* check if output to UART is possible */
+	if (uart_txhead - uart_txtail < UART_BUFSIZ)
+		stat &= 0b01111111;	/* if so flip status bit */
+	/* check if there is input from UART */
+	if (uart_rxhead != uart_rxtail)
+		stat &= 0b11111110;	/* if so flip status bit */
+
+	sio_idle(stat);
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO3 (serial UART) data.
+ */
+static BYTE sio3d_in(void)
+{
+	sio_active(3);
+
+	if (!net_uart && uart_rxhead != uart_rxtail)
+		sio3_last = uart_rxbuf[uart_rxtail++ & UART_BUFMSK];
+
+	return sio3_last;
+}
+
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+/*
+ *	I/O handler for read SIO4 (USB Console 3 CDC) status.
+ */
+static BYTE sio4s_in(void)
+{
+	register BYTE stat;
+
+	int_service();		/* raise the next pending interrupt */
+
+	stat = cdc_status(STDIO_MSC_USB_CONSOLE3_ITF);
+
+	sio_idle(stat);
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO4 (USB Console 3 CDC) data.
+ */
+static BYTE sio4d_in(void)
+{
+	sio_active(4);
+
+	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE3_ITF) &&
+	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE3_ITF))
+		sio4_last = cdc_getc(STDIO_MSC_USB_CONSOLE3_ITF);
+
+	return sio4_last;
+}
+#endif
+
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+/*
+ *	I/O handler for read SIO5 (USB Console 4 CDC) status.
+ */
+static BYTE sio5s_in(void)
+{
+	register BYTE stat;
+
+	int_service();		/* raise the next pending interrupt */
+
+	stat = cdc_status(STDIO_MSC_USB_CONSOLE4_ITF);
+
+	sio_idle(stat);
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read SIO5 (USB Console 4 CDC) data.
+ */
+static BYTE sio5d_in(void)
+{
+	sio_active(5);
+
+	if (tud_cdc_n_connected(STDIO_MSC_USB_CONSOLE4_ITF) &&
+	    tud_cdc_n_available(STDIO_MSC_USB_CONSOLE4_ITF))
+		sio5_last = cdc_getc(STDIO_MSC_USB_CONSOLE4_ITF);
+
+	return sio5_last;
+}
+#endif
+
+/*
+ *	I/O handler for read printer (USB Printer CDC) status:
+ *	when spooling ready while there is room in the spool buffer
+ */
+static BYTE prts_in(void)
+{
+	register BYTE stat = 0; /* initially not ready */
+
+#if PRINT_SPOOL_SIZE > 0
+	if (prt_spool)
+		return spool_room() ? 0xff : 0;
+#endif
+#if LIB_STDIO_MSC_USB
+	cdc_poll_flush(STDIO_MSC_USB_PRINTER_ITF);
+	if (tud_cdc_n_connected(STDIO_MSC_USB_PRINTER_ITF) &&
+	    tud_cdc_n_write_available(STDIO_MSC_USB_PRINTER_ITF))
+		stat = 0xff;
+#endif
+
+	return stat;
+}
+
+/*
+ *	I/O handler for read printer (USB Printer CDC) data:
+ *	always read an EOF from the printer
+ */
+static BYTE prtd_in(void)
+{
+	return 0x1a;	/* CP/M EOF */
+}
+
+/*
+ *	read MMU register
+ *	returns maximum bank in upper nibble
+ *	and currently selected bank in lower nibble
+ */
+static BYTE mmu_in(void)
+{
+	return (numseg << 4) | selbnk;
+}
+
+/*
+ *	read system timer enabled status, or the next byte
+ *	of the latched count of interrupts
+ */
+static BYTE timer_in(void)
+{
+	if (timer_ctr_n > 0)
+		return timer_ctr[2 - timer_ctr_n--];
+	return timer ? 1 : 0;
+}
+
+/*
+ *	read the next byte of the latched cycle and time counter
+ */
+static BYTE cycle_in(void)
+{
+	if (cycle_n > 0)
+		return cycle_ctr[16 - cycle_n--];
+	return 0;
+}
+
+/*
+ *	Input from virtual hardware control port
+ *	returns lock status of the port, or the next byte
+ *	of a latched performance counter
+ */
+static BYTE hwctl_in(void)
+{
+	if (hwctl_ctr_n > 0)
+		return hwctl_ctr[4 - hwctl_ctr_n--];
+	return hwctl_lock;
+}
+
+/*
+ *	Read virtual front panel switches state
+ */
+static BYTE fpsw_in(void)
+{
+	return fp_value;
+}
+
+/*
+ *	Switch RGB LED blue on/off.
+ */
+static void led_out(BYTE data)
+{
+	if (!data) {
+		/* 0 switches LED blue off */
+		led_color &= ~C_BLUE;
+	} else {
+		/* everything else on */
+		led_color = (led_color & ~C_BLUE) | C_BLUE;
+	}
+	lcd_update_led();
+}
+
+/*
+ *	Write byte to Pico USB Console CDC.
+ */
+static void sio1d_out(BYTE data)
+{
+	sio_active(1);
+	lcd_console_out(data);
+#if BATCH80
+	batch_out(data);
+#endif
+#if CAPTURE_SIZE > 0
+	if (out_capture)
+		capture_put(CAPT_SIO1, data);
+#endif
+
+#if LIB_STDIO_MSC_USB && !STDIO_MSC_USB_DISABLE_STDIO
+	cdc_out(STDIO_MSC_USB_CONSOLE_ITF, data);
+#else
+	if (cons_data_bits == 7)
+		data &= 0x7f;	/* strip parity, some software won't */
+	putchar_raw((int) data);
+#endif
+}
+
+/*
+ *	Write SIO2 status (no function).
+ */
+static void sio2s_out(BYTE data)
+{
+	UNUSED(data);
+}
+
+/*
+ *	Write SIO2 (USB Console 2 CDC) data.
+ */
+static void sio2d_out(BYTE data)
+{
+	sio_active(2);
+#if CAPTURE_SIZE > 0
+	if (out_capture)
+		capture_put(CAPT_SIO2, data);
+#endif
+
+#if LIB_STDIO_MSC_USB
+	cdc_out(STDIO_MSC_USB_CONSOLE2_ITF, data);
+#else
+	UNUSED(data);
+#endif
+}
+
+/*
+ *	Write SIO3 status (no function).
+ */
+static void sio3s_out(BYTE data)
+{
+	UNUSED(data);
+}
+
+/*
+ *	Write SIO3 (serial UART) data.
+ */
+static void sio3d_out(BYTE data)
+{
+	sio_active(3);
+
+	if (net_uart)
+		return;
+
+	if (cons_data_bits == 7)
+		uart_put(data & 0x7f); /* strip parity, some software won't */
+	else
+		uart_put(data);
+}
+
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 0
+/*
+ *	Write SIO4 (USB Console 3 CDC) data.
+ */
+static void sio4d_out(BYTE data)
+{
+	sio_active(4);
+
+	cdc_out(STDIO_MSC_USB_CONSOLE3_ITF, data);
+}
+#endif
+
+#if STDIO_MSC_USB_EXTRA_CONSOLES > 1
+/*
+ *	Write SIO5 (USB Console 4 CDC) data.
+ */
+static void sio5d_out(BYTE data)
+{
+	sio_active(5);
+
+	cdc_out(STDIO_MSC_USB_CONSOLE4_ITF, data);
+}
+#endif
+
+/*
+ *	Write printer status (no function).
+ */
+static void prts_out(BYTE data)
+{
+	UNUSED(data);
+}
+
+/*
+ *	Write printer (USB Printer CDC) data, or into the spool buffer,
+ *	which is emptied by core 1 if it is full.
+ */
+static void prtd_out(BYTE data)
+{
+#if CAPTURE_SIZE > 0
+	if (out_capture)
+		capture_put(CAPT_PRT, data);
+#endif
+#if PRINT_SPOOL_SIZE > 0
+	if (prt_spool) {
+		while (!spool_put(data))
+			tight_loop_contents();
+		return;
+	}
+#endif
+#if LIB_STDIO_MSC_USB
+	if (tud_cdc_n_connected(STDIO_MSC_USB_PRINTER_ITF))
+		cdc_putc(STDIO_MSC_USB_PRINTER_ITF, data);
+#else
+	UNUSED(data);
+#endif
+}
+
+/*
+ *	write MMU register
+ */
+static void mmu_out(BYTE data)
+{
+	if (data > numseg) {
+		LOGE(TAG, "%04x: trying to select non-existing bank %d",
+		     PC, data);
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
+		return;
+	}
+	if (data != selbnk) {
+		latprof_bank(data);
+		select_bank(data);
+	}
+}
+
+/*
+ *	The system timer counts the intervals in T-states with the event
+ *	scheduler while the CPU speed is set, so that the interrupts come
+ *	in the emulated time, also with the speed throttle or at full
+ *	speed. With unlimited speed there is no such time and a host
+ *	alarm is used. The next interval switches, if the speed changed.
+ */
+static void timer_tick(void);
+
+/*
+ *	timer interrupt causes maskable CPU interrupt,
+ *	returns if the timer continues
+ */
+static bool timer_fire(void)
+{
+	/* RST 38H for IM 0, 0FFH for IM 2 */
+	int_request(INT_TIMER, 0xff);
+	timer_count++;
+	if (timer_once)
+		timer = false;
+	return timer;
+}
+
+/*
+ *	schedule the next interval on the T-states
+ */
+static void timer_post(Tstates_t from)
+{
+	timer_when = from + (Tstates_t) timer_period * (unsigned) speed_khz
+			    / 1000;
+	sched_post(timer_when, timer_tick);
+}
+
+static int64_t timer_alarm(alarm_id_t id, void *user_data)
+{
+	int64_t next = 0L;	/* do not reschedule alarm */
+	BUDGET_ENTER(BUDGET_ALARM);
+
+	UNUSED(id);
+	UNUSED(user_data);
+
+	if (timer && timer_fire()) {
+		if (speed == 0)
+			next = -(int64_t) timer_period; /* reschedule alarm */
+		else
+			timer_post(T);
+	}
+	if (next == 0L)
+		timer_id = 0;
+	BUDGET_EXIT();
+	return next;
+}
+
+static void timer_tick(void)
+{
+	if (!timer || !timer_fire())
+		return;
+	if (speed)
+		timer_post(timer_when);
+	else
+		timer_id = add_alarm_in_us(timer_period, timer_alarm, NULL,
+					   true);
+}
+
+/*
+ *	stop the system timer and its alarm
+ */
+static void timer_stop(void)
+{
+	timer = false;
+	if (timer_id > 0)
+		cancel_alarm(timer_id);
+	timer_id = 0;
+	sched_cancel(timer_tick);
+}
+
+/*
+ *	start the system timer, periodic or for one interrupt, a running
+ *	periodic timer keeps its phase
+ */
+static void timer_start(bool once)
+{
+	if (timer && !timer_once && !once)
+		return;
+
+	timer_stop();
+	timer_once = once;
+	timer_count = 0;
+	timer = true;
+	if (speed)
+		timer_post(T);
+	else
+		timer_id = add_alarm_in_us(timer_period, timer_alarm, NULL,
+					   true);
+}
+
+/*
+ *	set the rate of the system timer in Hz, 0 is the default,
+ *	a running timer uses it from the next interval on
+ */
+static void timer_rate(WORD hz)
+{
+	if (hz == 0)
+		hz = TIMER_HZ;
+	else if (hz > TIMER_MAXHZ)
+		hz = TIMER_MAXHZ;
+	timer_hz = hz;
+	timer_period = (1000000UL + hz / 2) / hz;
 }
 
 /*
- *	write 60 Hz timer (start or stop)
+ *	System timer control, the interrupts are RST 38H (0FFH in IM 2):
+ *
+ *	00H	stop the timer
+ *	01H	start periodic interrupts at the rate set
+ *	02H	start for one interrupt after one interval
+ *	10H l h	set the rate to h * 256 + l Hz, 0 = 60 Hz, at most
+ *		TIMER_MAXHZ, from the next interval on
+ *	11H	latch the count of interrupts since the start, the
+ *		next two reads of the port return it, low byte first
+ *
+ *	Other values stop the timer, like before there was more than
+ *	the 60 Hz tick. The rate is set to 60 Hz again on reset.
  */
 static void timer_out(BYTE data)
 {
-	if (data == 1) {
-		if (!timer) {
-			timer = true;
-			add_alarm_in_us(16667L, timer_alarm, NULL, true);
+	if (timer_cmd == 0x10) {
+		timer_ctr[timer_argn++] = data;
+		if (timer_argn == 2) {
+			timer_rate((timer_ctr[1] << 8) | timer_ctr[0]);
+			timer_cmd = 0;
 		}
-	} else
-		timer = false;
+		return;
+	}
+
+	switch (data) {
+	case 0x01:
+		timer_start(false);
+		break;
+	case 0x02:
+		timer_start(true);
+		break;
+	case 0x10:
+		timer_cmd = data;
+		timer_argn = 0;
+		timer_ctr_n = 0;
+		break;
+	case 0x11:
+		timer_ctr[0] = timer_count & 0xff;
+		timer_ctr[1] = timer_count >> 8;
+		timer_ctr_n = 2;
+		break;
+	default:
+		timer_stop();
+		break;
+	}
+}
+
+/*
+ *	Cycle and time counter, a write of any value latches the T-states
+ *	of the CPU and the microseconds since power on, the next sixteen
+ *	reads return them, 8 bytes each, low byte first, the T-states
+ *	first. Further reads return 00H. So a program times itself with
+ *	an OUT and four or eight INs, without the 60 Hz timer or the RTC.
+ */
+static void cycle_out(BYTE data)
+{
+	uint64_t t = (uint64_t) T, us = time_us_64();
+	register int i;
+
+	UNUSED(data);
+
+	for (i = 0; i < 8; i++) {
+		cycle_ctr[i] = (BYTE) (t >> (i * 8));
+		cycle_ctr[8 + i] = (BYTE) (us >> (i * 8));
+	}
+	cycle_n = 16;
+}
+
+/*
+ *	Extended commands of the hardware control port, the command and
+ *	its argument are written after the unlock and 00H:
+ *
+ *	01H n	set CPU speed to n MHz, 0 = unlimited
+ *	02H n	full speed while disks are busy, n = 0 off, 1 on
+ *	03H n	run at full speed for the next n seconds
+ *	04H n	LCD refresh rate n Hz, 0 = LCD off
+ *	05H	write back disk caches
+ *	06H n	latch performance counter n, the next four reads of
+ *		the port return it, low byte first
+ *	07H t a a p p	register a trap of type t for the BIOS function
+ *		at address a with the parameter p, both low byte
+ *		first, t = 0 removes all traps, ignored without
+ *		BIOS_TRAP
+ *	08H n n	set CPU speed to n * 10 kHz, low byte first, e.g.
+ *		179 for 1.79 MHz, 0 = unlimited
+ *
+ *	Performance counters:
+ *	0	T-states, low 32 bits
+ *	1	T-states, high 32 bits
+ *	2	microseconds since the power on, low 32 bits
+ *	3	microseconds slept by the CPU speed throttle, low 32 bits
+ *	4	sectors read from all disks
+ *	5	sectors written to all disks
+ *	6	sector reads which needed a track read from the MicroSD
+ *	With LATPROF80:
+ *	7	MMU bank switches
+ *	8	interrupts taken by the CPU
+ *	9	sum of their latencies in T-states, low 32 bits
+ *	10	T-states with interrupts disabled, sampled, low 32 bits
+ *	With the PC profiler running, its samples:
+ *	31	all samples
+ *	32 - 47	samples in bank 0 - 15
+ *	48 - 53	samples of the banks of console SIO1 - SIO5, 48 none
+ *	64 - 79	console SIO1 - SIO5 of bank 0 - 15, 0 none
+ */
+#define HWCTL_EXT_CMD	0xff	/* waiting for the command */
+
+static uint32_t hwctl_counter(BYTE n)
+{
+	uint32_t c = 0;
+	register int i;
+
+	switch (n) {
+	case 0:
+		return (uint32_t) T;
+	case 1:
+		return (uint32_t) ((uint64_t) T >> 32);
+	case 2:
+		return time_us_32();
+	case 3:
+		return (uint32_t) throttle_slept;
+	case 4:
+	case 5:
+	case 6:
+		for (i = 0; i < NUMDISK; i++)
+			c += n == 4 ? disk_stats[i].reads :
+			     n == 5 ? disk_stats[i].writes :
+			     disk_stats[i].misses;
+		return c;
+#if LATPROF80
+	case 7:
+		return latprof.switches;
+	case 8:
+		return latprof.irqs;
+	case 9:
+		return (uint32_t) latprof.lat_T;
+	case 10:
+		return latprof_di_T();
+#endif
+#if PC_PROF_SIZE > 0
+	case 31:
+		return pc_acct_total;
+#endif
+	default:
+#if PC_PROF_SIZE > 0
+		if (n >= 32 && n < 32 + PC_ACCT_BANKS)
+			return pc_acct_bank[n - 32];
+		if (n >= 48 && n < 48 + PC_ACCT_CONS)
+			return pc_acct_con[n - 48];
+		if (n >= 64 && n < 64 + PC_ACCT_BANKS)
+			return pc_acct_owner[n - 64];
+#endif
+		return 0;
+	}
+}
+
+#if BIOS_TRAP
+/*
+ *	Types of the BIOS function traps:
+ *
+ *	1	CONST, A = FFH if SIO1 has input, else 00H
+ *	2	SECTRAN of CP/M 2.2, HL = BC + 1 if DE = 0,
+ *		else HL = the byte @ DE + BC
+ *	3	READ, FDC read command for the drive in the byte @ p,
+ *		A = FDC status, on an error A = the complemented status,
+ *		which is shown on the LEDs like the BIOS does
+ *	4	WRITE, the same with the FDC write command
+ *	5	MOVE of CP/M 3, BC bytes (0 = 64 KB) from DE to HL,
+ *		DE and HL point after the bytes moved, A = B = C = 0
+ *
+ *	The ports are accessed through the port tables, so that they
+ *	are counted, traced and replayed like the IN and OUT of the
+ *	BIOS code. The flags are left as they are, the callers test A.
+ */
+#define TRAP_CONST	1
+#define TRAP_SECTRAN	2
+#define TRAP_READ	3
+#define TRAP_WRITE	4
+#define TRAP_MOVE	5
+
+static struct {
+	BYTE type;		/* 0 = unused */
+	int bank;		/* bank or OVL_ALL */
+	WORD addr;		/* address of the jump table entry */
+	WORD par;		/* parameter */
+} traps[MAXTRAP];
+BYTE trap_page[NUMPAGE];	/* pages with a trap */
+
+static void trap_map(void)
+{
+	register int i;
+
+	memset(trap_page, 0, sizeof(trap_page));
+	mem_attn.on.trap = 0;
+	for (i = 0; i < MAXTRAP; i++)
+		if (traps[i].type) {
+			trap_page[traps[i].addr >> 8] = 1;
+			mem_attn.on.trap = 1;
+		}
+}
+
+static void trap_clear(void)
+{
+	memset(traps, 0, sizeof(traps));
+	trap_map();
+}
+
+/*
+ * register a trap, replaces a trap at the same address and bank
+ */
+static void trap_set(BYTE type, WORD addr, WORD par)
+{
+	register int i, j = -1;
+	int bank = addr >= segsiz ? OVL_ALL : selbnk;
+
+	if (type == 0) {
+		trap_clear();
+		return;
+	}
+	if (type > TRAP_MOVE)
+		return;
+
+	for (i = 0; i < MAXTRAP; i++) {
+		if (traps[i].type && traps[i].addr == addr &&
+		    traps[i].bank == bank) {
+			j = i;
+			break;
+		}
+		if (!traps[i].type && j < 0)
+			j = i;
+	}
+	if (j < 0)
+		return;		/* all used */
+
+	traps[j].type = type;
+	traps[j].bank = bank;
+	traps[j].addr = addr;
+	traps[j].par = par;
+	trap_map();
+}
+
+/*
+ * called for the code reads in pages with a trap, returns the
+ * byte read or RET if the function was done
+ */
+BYTE __not_in_flash_func(bios_trap)(WORD addr, BYTE data)
+{
+	register int i;
+	WORD w, src, dst;
+	uint32_t n;
+
+	for (i = 0; i < MAXTRAP; i++)
+		if (traps[i].type && traps[i].addr == addr &&
+		    (traps[i].bank == OVL_ALL || traps[i].bank == selbnk))
+			break;
+	if (i == MAXTRAP)
+		return data;
+
+	switch (traps[i].type) {
+	case TRAP_CONST:
+		A = ((*port_in[0])() & 1) ? 0x00 : 0xff;
+		break;
+
+	case TRAP_SECTRAN:
+		w = (B << 8) | C;
+		if (D == 0 && E == 0)
+			w++;
+		else
+			w = getmem(((D << 8) | E) + w);
+		H = w >> 8;
+		L = w & 0xff;
+		break;
+
+	case TRAP_READ:
+	case TRAP_WRITE:
+		(*port_out[4])(getmem(traps[i].par) |
+			       (traps[i].type == TRAP_READ ? 0x20 : 0x40));
+		A = (*port_in[4])();
+		if (A) {		/* the error path of the BIOS */
+			A = ~A;
+			(*port_out[255])(A);
+		}
+		break;
+
+	case TRAP_MOVE:
+		src = (D << 8) | E;
+		dst = (H << 8) | L;
+		n = (B << 8) | C;
+		if (n == 0)
+			n = 65536;
+		while (n--)
+			putmem(dst++, getmem(src++));
+		D = src >> 8;
+		E = src & 0xff;
+		H = dst >> 8;
+		L = dst & 0xff;
+		A = B = C = 0;
+		break;
+
+	default:
+		return data;
+	}
+
+	return 0xc9;		/* RET */
+}
+#endif /* BIOS_TRAP */
+
+static void hwctl_ext_out(BYTE data)
+{
+	BYTE cmd = hwctl_ext;
+	uint32_t c;
+
+	if (cmd == HWCTL_EXT_CMD) {
+		if (data == 5) {	/* no argument */
+			hwctl_ext = 0;
+			flush_disks();
+		} else if (data >= 1 && data <= 8) {
+			hwctl_ext = data;
+			hwctl_argn = 0;
+		} else
+			hwctl_ext = 0;
+		return;
+	}
+
+	if (cmd == 7) {		/* five arguments */
+		hwctl_arg[hwctl_argn++] = data;
+		if (hwctl_argn < 5)
+			return;
+#if BIOS_TRAP
+		trap_set(hwctl_arg[0], (hwctl_arg[2] << 8) | hwctl_arg[1],
+			 (hwctl_arg[4] << 8) | hwctl_arg[3]);
+#endif
+	}
+
+	if (cmd == 8) {		/* two arguments */
+		hwctl_arg[hwctl_argn++] = data;
+		if (hwctl_argn < 2)
+			return;
+	}
+
+	hwctl_ext = 0;
+	switch (cmd) {
+	case 1:
+		if (data <= 40)
+			set_speed(data);
+		break;
+	case 2:
+		turbo_disk = data != 0;
+		break;
+	case 3:
+		start_turbo_s(data);
+		break;
+	case 4:
+		lcd_set_refresh(data);
+		break;
+	case 6:
+		c = hwctl_counter(data);
+		hwctl_ctr[0] = c & 0xff;
+		hwctl_ctr[1] = (c >> 8) & 0xff;
+		hwctl_ctr[2] = (c >> 16) & 0xff;
+		hwctl_ctr[3] = c >> 24;
+		hwctl_ctr_n = 4;
+		break;
+	case 8:
+		if ((c = (hwctl_arg[1] << 8) | hwctl_arg[0]) <= 4000)
+			set_speed_khz((int) c * 10);
+		break;
+	default:
+		break;
+	}
 }
 
 /*
@@ -470,14 +1973,25 @@ static void timer_out(BYTE data)
  *	Virtual hardware control output.
  *	Used to shutdown and switch CPU's.
  *
+ *	bit 0 = 1	stop PC profiler
+ *	bit 1 = 1	start PC profiler
+ *	bit 2 = 1	save machine snapshot and halt emulation
  *	bit 3 = 1	select next LCD status display
  *	bit 4 = 1	switch CPU model to 8080
  *	bit 5 = 1	switch CPU model to Z80
- *	bit 6 = 1	reset system
+ *	bit 6 = 1	reset system, with bits 0 - 3 = n > 0 halt emulation
+ *			and restart the machine with profile n
  *	bit 7 = 1	halt emulation via I/O
+ *	00H		next bytes written are an extended command
  */
 static void hwctl_out(BYTE data)
 {
+	/* extended command in progress */
+	if (hwctl_ext) {
+		hwctl_ext_out(data);
+		return;
+	}
+
 	/* if port is locked do nothing */
 	if (hwctl_lock && (data != 0xaa))
 		return;
@@ -492,13 +2006,42 @@ static void hwctl_out(BYTE data)
 	/* but first lock port again */
 	hwctl_lock = 0xff;
 
+	if (data == 0) {
+		hwctl_ext = HWCTL_EXT_CMD;
+		return;
+	}
+
 	if (data & 128) {
 		cpu_error = IOHALT;
 		cpu_state = ST_STOPPED;
 		return;
 	}
 
+	if ((data & 64) && (data & 15)) {
+		profile_select(data & 15);
+		cpu_error = IOHALT;
+		cpu_state = ST_STOPPED;
+		return;
+	}
+
 	if (data & 64) {
+		xfdc_reset();		/* finish background disk commands */
+		flush_disks();		/* write back disk cache */
+		xfer_reset();		/* close file transfer */
+		net_reset();		/* close network connection */
+		pcode_reset();		/* reset arithmetic assist */
+		memdma_reset();		/* reset memory DMA */
+		sound_reset();		/* stop the sound samples */
+		timer_cmd = 0;		/* system timer back to 60 Hz */
+		timer_ctr_n = 0;
+		timer_rate(0);
+#if BIOS_TRAP
+		trap_clear();		/* the BIOS registers them again */
+#endif
+#if PRINT_SPOOL_SIZE > 0
+		spool_close();		/* close printer spool file */
+#endif
+		int_clear();		/* drop pending interrupts */
 		reset_cpu();		/* reset CPU */
 		reset_memory();		/* reset memory */
 #ifdef SIMPLEPANEL
@@ -506,6 +2049,7 @@ static void hwctl_out(BYTE data)
 #endif
 		PC = 0xff00;		/* power on jump to boot ROM */
 		dazzler_ctl_out(0);	/* switch Dazzler off */
+		start_turbo();		/* boot at full speed */
 		return;
 	}
 
@@ -525,6 +2069,323 @@ static void hwctl_out(BYTE data)
 		lcd_status_next();
 		return;
 	}
+
+	if (data & 4) {			/* save snapshot and halt */
+		if (save_snapshot()) {
+			cpu_error = IOHALT;
+			cpu_state = ST_STOPPED;
+		}
+		return;
+	}
+
+#if PC_PROF_SIZE > 0
+	if (data & 2) {			/* start PC profiler */
+		pc_prof(true);
+		return;
+	}
+
+	if (data & 1) {			/* stop PC profiler */
+		pc_prof(false);
+		return;
+	}
+#endif
+}
+
+/*
+ *	Machine snapshots
+ *
+ *	The snapshot has a header with the machine configuration and
+ *	the state of the I/O devices, followed by the CPU registers,
+ *	bank 0 without the boot ROM and all other banks. It is taken
+ *	between two instructions with the background disk commands
+ *	finished and the disk caches written back, so no FDC command
+ *	is in progress, and it is only valid as long as the disks are
+ *	not changed, that is the machine isn't continued after it.
+ *	When the machine was continued from the ICE, the next snapshot
+ *	only writes the pages changed since the last one into the file.
+ */
+#define SNAP_PATH	"/CONF80/" SNAP_FILE
+#define SNAP_MAGIC	"Z80S"
+#define SNAP_VERSION	5
+
+typedef struct snap_hdr {
+	char magic[4];		/* SNAP_MAGIC */
+	uint32_t version;	/* SNAP_VERSION */
+	uint32_t bnkmem;	/* size of the bank memory in SRAM */
+	unsigned segsiz;	/* size of the banks */
+	int numseg;		/* number of banks */
+	int cpu;		/* CPU model */
+	char disks[NUMDISK][DISKLEN+1]; /* the mounted disks */
+	BYTE selbnk;		/* selected bank */
+	BYTE hwctl_lock;	/* lock status hardware control port */
+	BYTE fp_value;		/* port 255 value */
+	bool timer;		/* system timer enabled */
+	bool timer_once;	/* for one interrupt only */
+	WORD timer_hz;		/* its rate */
+	BYTE dazzler_ctl;	/* Dazzler control */
+	BYTE dazzler_format;	/* Dazzler format */
+	xfdc_state_t xfdc;	/* extended FDC */
+	bool disk_linear[NUMDISK]; /* BIOS sends logical sector numbers */
+} snap_hdr_t;
+
+static snap_hdr_t snap_hdr;
+
+/* CPU registers and interrupt state, with the pending sources */
+#define SNAP_REG(r)	{ &r, sizeof(r), 0 }
+
+static const snap_blk_t snap_regs[] = {
+	SNAP_REG(A), SNAP_REG(B), SNAP_REG(C), SNAP_REG(D), SNAP_REG(E),
+	SNAP_REG(H), SNAP_REG(L), SNAP_REG(F), SNAP_REG(A_),
+	SNAP_REG(B_), SNAP_REG(C_), SNAP_REG(D_), SNAP_REG(E_),
+	SNAP_REG(H_), SNAP_REG(L_), SNAP_REG(F_), SNAP_REG(IX),
+	SNAP_REG(IY), SNAP_REG(SP), SNAP_REG(PC), SNAP_REG(I),
+	SNAP_REG(R), SNAP_REG(R_), SNAP_REG(IFF), SNAP_REG(int_mode),
+	SNAP_REG(int_int), SNAP_REG(int_nmi), SNAP_REG(int_data),
+	{ (void *) &int_pending, sizeof(int_pending), 0 },
+	SNAP_REG(int_vectors)
+};
+#define SNAP_REGS	(int) (sizeof(snap_regs) / sizeof(snap_regs[0]))
+
+#define SNAP_MAXRUN	64	/* max. runs of changed pages in an update */
+#define SNAP_MAXBLK	(1 + SNAP_REGS + SNAP_MAXRUN)
+
+static snap_blk_t snap_blk[SNAP_MAXBLK];
+static bool snap_saved;	/* the snapshot file has the last saved state */
+
+/*
+ *	build the list of memory blocks of a snapshot
+ */
+static int snap_blocks(snap_blk_t *blk)
+{
+	FSIZE_t ofs = 0;
+	int n = 0;
+	register int i;
+
+	blk[n].p = &snap_hdr;
+	blk[n].n = sizeof(snap_hdr);
+	blk[n++].ofs = ofs;
+	ofs += sizeof(snap_hdr);
+	for (i = 0; i < SNAP_REGS; i++) {
+		blk[n] = snap_regs[i];
+		blk[n++].ofs = ofs;
+		ofs += snap_regs[i].n;
+	}
+	blk[n].p = bnk0;
+	blk[n].n = 0xff00;
+	blk[n++].ofs = ofs;
+	ofs += 0xff00;
+	for (i = 1; i <= numseg; i++) {
+		blk[n].p = bank_addr(i);
+		blk[n].n = segsiz;
+		blk[n++].ofs = ofs;
+		ofs += segsiz;
+	}
+
+	return n;
+}
+
+#if MEM_DIRTY && !defined(PSRAM_BANKS)
+/*
+ *	replace the memory blocks in a list built by snap_blocks() with
+ *	the runs of pages changed since the last snapshot, returns the
+ *	new number of blocks, or 0 if there are too many runs. Bank 0
+ *	is followed by the banks in the bank memory, so page k of the
+ *	memory is at a fixed offset in the file.
+ */
+static int snap_changed(snap_blk_t *blk)
+{
+	const FSIZE_t ofs = blk[1 + SNAP_REGS].ofs;
+	const int np = 0xff00 / PAGESIZ + numseg * (segsiz / PAGESIZ);
+	int n = 1 + SNAP_REGS;
+	volatile page_dirty_t *pg;
+	BYTE *p;
+	bool run = false;
+	register int k;
+
+	for (k = 0; k < np; k++) {
+		if (k < 0xff00 / PAGESIZ) {
+			pg = &page_dirty[k];
+			p = &bnk0[k * PAGESIZ];
+		} else {
+			pg = &page_dirty[k + 1];
+			p = &bnks[(k - 0xff00 / PAGESIZ) * PAGESIZ];
+		}
+		if (!pg->user[DIRTY_SNAP]) {
+			run = false;
+			continue;
+		}
+		pg->user[DIRTY_SNAP] = 0;
+		if (run) {
+			blk[n - 1].n += PAGESIZ;
+			continue;
+		}
+		if (n == SNAP_MAXBLK)
+			return 0;
+		blk[n].p = p;
+		blk[n].n = PAGESIZ;
+		blk[n++].ofs = ofs + (FSIZE_t) k * PAGESIZ;
+		run = true;
+	}
+
+	return n;
+}
+#endif
+
+/*
+ *	fill in the header of a snapshot, returns false if the machine
+ *	can't be saved
+ */
+static bool snap_header(void)
+{
+	register int i;
+
+#if BANK_PACK
+	if (banks_packed()) {
+		puts("No snapshots with packed banks");
+		return false;
+	}
+#endif
+	xfdc_finish();		/* finish background disk commands */
+	flush_disks();		/* write back disk cache */
+
+	memset(&snap_hdr, 0, sizeof(snap_hdr));
+	memcpy(snap_hdr.magic, SNAP_MAGIC, sizeof(snap_hdr.magic));
+	snap_hdr.version = SNAP_VERSION;
+	snap_hdr.bnkmem = BNKMEM;
+	snap_hdr.segsiz = segsiz;
+	snap_hdr.numseg = numseg;
+	snap_hdr.cpu = cpu;
+	for (i = 0; i < NUMDISK; i++)
+		strcpy(snap_hdr.disks[i], disks[i]);
+	snap_hdr.selbnk = selbnk;
+	snap_hdr.hwctl_lock = hwctl_lock;
+	snap_hdr.fp_value = fp_value;
+	snap_hdr.timer = timer;
+	snap_hdr.timer_once = timer_once;
+	snap_hdr.timer_hz = timer_hz;
+	snap_hdr.dazzler_ctl = dazzler_ctl();
+	snap_hdr.dazzler_format = dazzler_format();
+	xfdc_save(&snap_hdr.xfdc);
+	memcpy(snap_hdr.disk_linear, disk_linear, sizeof(disk_linear));
+
+	return true;
+}
+
+/*
+ *	save the machine state into the snapshot file
+ */
+bool save_snapshot(void)
+{
+	int n;
+#if MEM_DIRTY && !defined(PSRAM_BANKS)
+	register int i;
+#endif
+
+	if (!snap_header())
+		return false;
+
+	n = snap_blocks(snap_blk);
+#if MEM_DIRTY && !defined(PSRAM_BANKS)
+	if (snap_saved && (i = snap_changed(snap_blk)) > 0 &&
+	    write_snapshot(SNAP_PATH, snap_blk, i, true))
+		return true;
+
+	/* the whole memory is written now */
+	n = snap_blocks(snap_blk);
+	for (i = 0; i < NUMPHYS; i++)
+		page_dirty[i].user[DIRTY_SNAP] = 0;
+#endif
+	snap_saved = write_snapshot(SNAP_PATH, snap_blk, n, false);
+
+	return snap_saved;
+}
+
+/*
+ *	save the whole machine state into another file, for a post-mortem,
+ *	the next snapshot into the snapshot file isn't affected
+ */
+bool save_snapshot_as(const char *path)
+{
+	if (!snap_header())
+		return false;
+
+	return write_snapshot(path, snap_blk, snap_blocks(snap_blk), false);
+}
+
+/*
+ *	check the header of a snapshot before the machine state is read
+ */
+static bool snap_check(void)
+{
+	register int i;
+
+	if (memcmp(snap_hdr.magic, SNAP_MAGIC, sizeof(snap_hdr.magic)) ||
+	    snap_hdr.version != SNAP_VERSION) {
+		puts("Not a snapshot of this firmware");
+		return false;
+	}
+	if (snap_hdr.bnkmem != BNKMEM || snap_hdr.segsiz != segsiz ||
+	    snap_hdr.numseg != numseg) {
+		puts("Snapshot has different memory banks");
+		return false;
+	}
+#if BANK_PACK
+	if (banks_packed()) {
+		puts("No snapshots with packed banks");
+		return false;
+	}
+#endif
+	for (i = 0; i < NUMDISK; i++)
+		if (strcmp(snap_hdr.disks[i], disks[i])) {
+			printf("Snapshot has different disk %d: %s\n", i,
+			       snap_hdr.disks[i]);
+			return false;
+		}
+#if !defined (EXCLUDE_I8080) && !defined(EXCLUDE_Z80)
+	if (snap_hdr.cpu != cpu)
+		switch_cpu(snap_hdr.cpu);
+#else
+	if (snap_hdr.cpu != cpu) {
+		puts("Snapshot has a different CPU");
+		return false;
+	}
+#endif
+	return true;
+}
+
+/*
+ *	restore the machine state from the snapshot file,
+ *	on failure the machine starts with the boot ROM
+ */
+bool load_snapshot(void)
+{
+	snap_saved = false;
+	if (!read_snapshot(SNAP_PATH, snap_blk, snap_blocks(snap_blk),
+			   snap_check)) {
+		reset_cpu();
+		PC = 0xff00;
+		return false;
+	}
+
+#if MEM_DIRTY
+	mem_dirty_all();
+#endif
+	select_bank(snap_hdr.selbnk);
+	hwctl_lock = snap_hdr.hwctl_lock;
+	fp_value = snap_hdr.fp_value;
+	timer_rate(snap_hdr.timer_hz);
+	if (snap_hdr.timer)
+		timer_start(snap_hdr.timer_once);
+	else
+		timer_stop();
+	dazzler_format_out(snap_hdr.dazzler_format);
+	dazzler_ctl_out(snap_hdr.dazzler_ctl);
+	xfdc_restore(&snap_hdr.xfdc);
+	memcpy(disk_linear, snap_hdr.disk_linear, sizeof(disk_linear));
+	int_service();		/* the pending interrupts come again */
+	puts("Machine resumed from snapshot");
+
+	return true;
 }
 
 /*
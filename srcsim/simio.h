@@ -10,15 +10,77 @@
 #include "sim.h"
 #include "simdefs.h"
 
+#include "budget.h"
+#include "trace.h"
+#include "replay.h"
+
 #define IO_DATA_UNUSED	0xff	/* data returned on unused ports */
 
+#ifndef SIO_IDLE
+#define SIO_IDLE 1	/* sleep the host while the consoles are polled idle */
+#endif
+
+/*
+ * With IO_COUNT the accesses of every used I/O port are counted, for
+ * the I/O ports display and the ICE. It costs a function call for each
+ * access and the counting functions in RAM, so only on the RP2350.
+ */
+#ifndef IO_COUNT
+#if PICO_RP2350
+#define IO_COUNT 1
+#else
+#define IO_COUNT 0
+#endif
+#endif
+#if (CPU_BUDGET || TRACE80 || REPLAY80) && !IO_COUNT
+#undef IO_COUNT
+#define IO_COUNT 1	/* the counting functions time, trace and replay */
+#endif
+
+/* interrupt sources, in order of priority */
+#define INT_FDC		0	/* extended FDC command done */
+#define INT_TIMER	1	/* system timer */
+#define INT_SOURCES	2
+
+#define TIMER_HZ	60	/* default rate of the system timer */
+#ifndef TIMER_MAXHZ		/* fastest rate of the system timer */
+#define TIMER_MAXHZ	10000
+#endif
+
 extern BYTE fp_value;
 extern int cons_data_bits;
+extern uint32_t sio3_baud;
+extern bool snap_resume;
+extern bool prt_spool;
+extern bool out_capture;
+extern uint32_t usb_bytes;
+
+#if IO_COUNT
+typedef struct io_count {
+	uint32_t in;
+	uint32_t out;
+} io_count_t;
+
+extern io_count_t io_count[256];
+
+extern in_func_t *port_in[256];
+extern out_func_t *port_out[256];
 
+extern void print_io_count(void), clear_io_count(void);
+#else
 extern in_func_t *const port_in[256];
 extern out_func_t *const port_out[256];
+#endif
 
 extern void init_io(void);
 extern void exit_io(void);
+extern bool save_snapshot(void), load_snapshot(void);
+extern bool save_snapshot_as(const char *path);
+extern void sio3_set_baud(uint32_t baud);
+extern void uart_put(BYTE c);
+extern int uart_get(void);
+extern unsigned int uart_tx_room(void);
+extern void int_request(int src, BYTE vector);
+extern void int_service(void), int_clear(void);
 
 #endif /* !SIMIO_INC */
@@ -12,20 +12,170 @@
  * 28-JUN-2024 added second memory bank
  * 29-JUN-2024 implemented banked memory
  * 12-MAR-2025 added more memory banks for RP2350
+ * 14-OCT-2026 use page tables for the memory map
+ * 14-OCT-2026 update the front panel LEDs only while the panel is shown
+ * 14-OCT-2026 configurable number and size of the memory banks
+ * 14-OCT-2026 added banks in PSRAM on RP2350
+ * 14-OCT-2026 selectable memory fill at power on
+ * 14-OCT-2026 access to the memory of all banks for snapshots
+ * 14-OCT-2026 track the changed memory pages
+ * 14-OCT-2026 write watch range for video memory
+ * 14-OCT-2026 read only overlays in the memory map
+ * 14-OCT-2026 sampled access counters for the memory heat map
+ * 14-OCT-2026 opcode profiler
+ * 14-OCT-2026 bank switches in the trace stream
+ * 14-OCT-2026 always on branch trace for post-mortems
+ * 14-OCT-2026 memory watchpoints with hit counters
+ * 14-OCT-2026 PSRAM set up only once, for warm restarts
+ * 14-OCT-2026 moves and fills across banks for the memory DMA device
+ * 14-OCT-2026 one attention word for the run time hooks of memory reads
+ * 14-OCT-2026 block reads and writes of a bank for the remote channel
+ * 14-OCT-2026 packed banks without PSRAM
+ * 14-OCT-2026 asynchronous logging with ALOG80
+ * 14-OCT-2026 map a bank without tracing for the ICE
+ * 14-OCT-2026 page tables of a latched bank for DMA on core 1
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "sim.h"
 #include "simdefs.h"
 #include "simmem.h"
+#if OP_PROF
+#include "debug.h"
+#endif
+#if MEM_WP || BANK_PACK
+#include "simglb.h"
+#endif
+#if BANK_PACK
+#include <string.h>
+#include "pico/time.h"
+#include "log.h"
+#include "alog.h"
+static const char *TAG = "MEM";
+#endif
+
+#include "hardware/dma.h"
+#ifdef PSRAM_BANKS
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/structs/qmi.h"
+#include "hardware/structs/xip_ctrl.h"
+#endif
 
 /* 64KB bank 0 + common segment */
 BYTE __aligned(4) bnk0[65536];
-/* NUMSEG memory banks of size SEGSIZ */
-BYTE __aligned(4) bnks[NUMSEG][SEGSIZ];
+/* memory for numseg banks of size segsiz */
+BYTE __aligned(4) bnks[BNKMEM];
+int numseg = BNKMEM / DEF_SEGSIZ;
+unsigned segsiz = DEF_SEGSIZ;
 /* selected bank */
 BYTE selbnk, *curbnk;
+/* pages for reading and writing of the selected memory map */
+BYTE *rdmap[NUMPAGE], *wrmap[NUMPAGE];
+#if MEM_DIRTY
+/* changed flags of the pages of bnk0, bnks and the ROM page */
+volatile page_dirty_t page_dirty[NUMPHYS + 1];
+/* flags of the pages in the selected memory map */
+volatile page_dirty_t *dirtymap[NUMPAGE];
+#endif
+#if MEM_HEAT
+/* sampled access counters of the pages and the sample countdown */
+volatile BYTE mem_heat[3][NUMPHYS + 1];
+unsigned mem_heat_cnt = MEM_HEAT_RATE;
+#endif
+#if OP_PROF
+/* opcode counts, table of the next M1 cycle and instructions per page */
+uint32_t op_prof[OP_PROF_TABS][256];
+uint32_t op_prof_page[NUMPAGE];
+BYTE op_prof_pfx;
+#endif
+#if BRANCH_TRACE
+/* ring of the last branches, survives a watchdog reset */
+branch_trace_t __uninitialized_ram(branch_trace);
+#endif
+#if MEM_WATCH
+/* write watch range and the changed flags of its lines */
+WORD watch_addr;
+unsigned watch_len;
+volatile BYTE watch_line[WATCH_LINES];
+#endif
+#if MEM_WP
+/* watchpoint ranges and the access kinds watched in the pages */
+mem_wp_t mem_wp[WP_RANGES];
+BYTE wp_page[NUMPAGE];
+static WORD wp_break_addr;	/* address of the last stop */
+static bool wp_break;		/* a watchpoint stopped the CPU */
+#endif
+/* how the memory gets filled at power on */
+int mem_fill = MEM_XORSHIFT;
+/* writes to the ROM go here */
+static BYTE __aligned(4) rom_wr[PAGESIZ];
+/* read only overlays */
+typedef struct mem_ovl {
+	int bank;		/* bank or OVL_ALL */
+	WORD addr;		/* address of the first page */
+	unsigned len;		/* length, a multiple of the page size */
+	const BYTE *data;	/* memory of the overlay */
+} mem_ovl_t;
+static mem_ovl_t ovls[MAXOVL];
+static int novl;
+/* the hooks of the memory accesses switched on */
+mem_attn_t mem_attn;
+
+#if defined(PSRAM_BANKS) || BANK_PACK
+#define BANK_SLOTS		/* the bank memory caches the banks */
+
+static int numslot;		/* number of slots in SRAM */
+static int bank_slot[MAXSEG + 1]; /* slot of a bank, -1 if none */
+static BYTE slot_bank[MAXSEG];	/* bank in a slot, 0 if free */
+static uint32_t slot_used[MAXSEG]; /* time of last use for LRU */
+static uint32_t slot_clock;	/* incremented for every bank switch */
+
+static BYTE *bank_mem(BYTE bank);
+#endif
+
+#ifdef PSRAM_BANKS
+/*
+ * Every bank has its memory in PSRAM, the bank memory in SRAM is split
+ * into slots for the recently used banks. When a bank which isn't in
+ * a slot is selected, the least recently used slot is copied back to
+ * PSRAM and the bank is copied into it, both with DMA.
+ */
+#define PSRAM_BASE	((BYTE *) (XIP_BASE + 0x1000000)) /* CS1 of QMI */
+#define PSRAM_MAXSIZE	(8 * 1024 * 1024) /* max. size of PSRAM */
+
+static size_t psram_size;	/* size of the PSRAM, 0 if none */
+static uint copy_chan;		/* DMA channel for the bank copies */
+static bool copy_claimed;	/* PSRAM and DMA channel set up */
+
+static size_t psram_init(uint cs_pin);
+#endif
+
+#if BANK_PACK
+/*
+ * The banks which aren't in a slot are kept packed in pack_pool. A
+ * packed bank is the list of its pages, a page with a single byte
+ * value is PACK_SAME and that byte, any other page PACK_RAW and its
+ * bytes. The packed banks are back to back in the pool, when a bank
+ * is unpacked into a slot the ones after it are moved down. When the
+ * least recently used slot doesn't fit into the pool packed, the CPU
+ * stops with an I/O error.
+ */
+#define PACK_SAME	0	/* page of a single byte value */
+#define PACK_RAW	1	/* page as it is */
+
+static BYTE pack_pool[BANK_PACK_POOL];
+static unsigned pack_off[MAXSEG + 1];	/* offset of a packed bank */
+static unsigned pack_len[MAXSEG + 1];	/* its length, 0 if in a slot */
+static unsigned pack_used;		/* bytes used in the pool */
+static uint32_t pack_cnt, unpack_cnt;	/* banks packed and unpacked */
+static uint64_t pack_us;		/* time spent for it */
+
+static void pack_reset(void);
+#endif
 
 /* boot ROM code */
 #define MEMSIZE 256
@@ -33,25 +183,993 @@ BYTE selbnk, *curbnk;
 
 void init_memory(void)
 {
-	register int i, j;
+	register int i;
 
-	/* copy boot ROM into write protected top memory page */
+	/* copy boot ROM into the top memory page, mapped read only */
 	for (i = 0; i < MEMSIZE; i++)
 		bnk0[0xff00 + i] = code[i];
+	mem_overlay_clear();
 
-	/* trash memory like in a real machine after power on */
-	for (i = 0; i < 0xff00; i++)
-		bnk0[i] = rand() % 256;
-	for (j = 0; j < NUMSEG; j++) {
-		curbnk = bnks[j];
-		for (i = 0; i < SEGSIZ; i++)
-			curbnk[i] = rand() % 256;
+#ifdef PSRAM_BANKS
+	/* only once, init_memory() is called again for a warm restart */
+	if (!copy_claimed) {
+		psram_size = psram_init(PSRAM_CS_PIN);
+		copy_chan = (uint) dma_claim_unused_channel(true);
+		copy_claimed = true;
 	}
+#endif
+#ifdef BANK_SLOTS
+	set_segsiz(segsiz);
+#endif
 
 	selbnk = 0;
+	map_memory();
+}
+
+/*
+ * fill n bytes of memory at p, which is word aligned, with mem_fill
+ */
+static void fill_area(BYTE *p, size_t n)
+{
+	static uint32_t x = 2463534242U; /* xorshift state */
+	static uint32_t e5 = 0xe5e5e5e5, zero = 0;
+	uint32_t *w = (uint32_t *) p;
+	dma_channel_config c;
+	uint chan;
+	register size_t i;
+
+	switch (mem_fill) {
+	case MEM_RAND:
+		for (i = 0; i < n; i++)
+			p[i] = rand() % 256;
+		break;
+
+	case MEM_ZERO:
+	case MEM_E5:
+		chan = (uint) dma_claim_unused_channel(true);
+		c = dma_channel_get_default_config(chan);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_read_increment(&c, false);
+		channel_config_set_write_increment(&c, true);
+		dma_channel_configure(chan, &c, w,
+				      mem_fill == MEM_E5 ? &e5 : &zero,
+				      n / 4, true);
+		dma_channel_wait_for_finish_blocking(chan);
+		dma_channel_unclaim(chan);
+		break;
+
+	default:
+		for (i = 0; i < n / 4; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			w[i] = x;
+		}
+		break;
+	}
+}
+
+/*
+ * fill the memory below the boot ROM and the banks after power on,
+ * random by default like in a real machine
+ */
+void fill_memory(void)
+{
+	fill_area(bnk0, 0xff00);
+	fill_area(bnks, BNKMEM);
+#ifdef PSRAM_BANKS
+	if (psram_size)
+		fill_area(PSRAM_BASE, psram_size);
+#endif
+#if BANK_PACK
+	pack_reset();
+#endif
+#if MEM_DIRTY
+	mem_dirty_all();
+#endif
 }
 
+#if MEM_DIRTY
+/*
+ * mark all pages changed for all users
+ */
+void mem_dirty_all(void)
+{
+	register int i;
+
+	for (i = 0; i < NUMPHYS; i++)
+		page_dirty[i].all = ~0U;
+}
+#endif
+
 void reset_memory(void)
 {
 	selbnk = 0;
+	map_memory();
+}
+
+/*
+ * set the size of the banks, the memory for the banks is
+ * split into as many as possible, bank 0 gets selected
+ */
+void set_segsiz(unsigned size)
+{
+#ifdef BANK_SLOTS
+	register int i;
+#endif
+
+	segsiz = size;
+	numseg = BNKMEM / segsiz;
+#ifdef BANK_SLOTS
+	/* the first banks start in the slots */
+	numslot = numseg < MAXSEG ? numseg : MAXSEG;
+	for (i = 0; i <= MAXSEG; i++)
+		bank_slot[i] = i > 0 && i <= numslot ? i - 1 : -1;
+	for (i = 0; i < numslot; i++) {
+		slot_bank[i] = i + 1;
+		slot_used[i] = 0;
+	}
+#endif
+#ifdef PSRAM_BANKS
+	if (psram_size / segsiz > (size_t) numseg)
+		numseg = psram_size / segsiz;
+#endif
+#if BANK_PACK
+	/* as many more as fit into the pool with single value pages */
+	i = BANK_PACK_POOL / (2 * (segsiz / PAGESIZ));
+	numseg += i < BANK_PACK_BANKS ? i : BANK_PACK_BANKS;
+#endif
+	if (numseg > MAXSEG)
+		numseg = MAXSEG;
+#if BANK_PACK
+	pack_reset();
+#endif
+	selbnk = 0;
+	map_memory();
+}
+
+/*
+ * map a bank, 0 is the 64K bank 0
+ */
+static void switch_bank(BYTE bank)
+{
+	selbnk = bank;
+	if (selbnk != 0)
+#ifdef BANK_SLOTS
+		curbnk = bank_mem(selbnk);
+#else
+		curbnk = &bnks[(selbnk - 1) * segsiz];
+#endif
+	map_memory();
+}
+
+/*
+ * select a bank for the CPU
+ */
+void select_bank(BYTE bank)
+{
+#if TRACE80
+	trace_mmu(bank);
+#endif
+	switch_bank(bank);
+}
+
+/*
+ * map a bank for a transfer of the ICE, without tracing
+ */
+void bank_map(BYTE bank)
+{
+	if (bank != selbnk)
+		switch_bank(bank);
+}
+
+/*
+ * get the memory of a bank 1 - numseg where it is now,
+ * without switching or caching it
+ */
+BYTE *bank_addr(BYTE bank)
+{
+#ifdef BANK_SLOTS
+	if (bank_slot[bank] < 0)
+#ifdef PSRAM_BANKS
+		return PSRAM_BASE + (bank - 1) * segsiz;
+#else
+		return NULL;	/* packed, see banks_packed() */
+#endif
+	return &bnks[bank_slot[bank] * segsiz];
+#else
+	return &bnks[(bank - 1) * segsiz];
+#endif
+}
+
+/*
+ * move len bytes from src in bank sbank to dst in bank dbank, as the
+ * CPU sees the memory in these banks. The move is forward like LDIR,
+ * overlapping moves within one bank repeat the bytes like it. The
+ * banks are switched without tracing, the selected bank is mapped
+ * again at the end.
+ */
+void bank_move(BYTE sbank, WORD src, BYTE dbank, WORD dst, unsigned len)
+{
+	BYTE buf[PAGESIZ], bank = selbnk;
+	register unsigned n;
+
+	if (src >= segsiz && dst >= segsiz)
+		sbank = dbank;	/* both in the common segment */
+
+	if (sbank == dbank) {
+		if (sbank != selbnk)
+			switch_bank(sbank);
+		if (dst != src && (WORD) (dst - src) < len)
+			while (len--)
+				dma_write(dst++, dma_read(src++));
+		else
+			for (; len > 0; len -= n, src += n, dst += n) {
+				n = len < PAGESIZ ? len : PAGESIZ;
+				dma_read_block(src, buf, n);
+				dma_write_block(dst, buf, n);
+			}
+	} else {
+		for (; len > 0; len -= n, src += n, dst += n) {
+			n = len < PAGESIZ ? len : PAGESIZ;
+			if (sbank != selbnk)
+				switch_bank(sbank);
+			dma_read_block(src, buf, n);
+			switch_bank(dbank);
+			dma_write_block(dst, buf, n);
+		}
+	}
+
+	if (bank != selbnk)
+		switch_bank(bank);
+}
+
+/*
+ * fill len bytes @ dst in bank with data
+ */
+void bank_fill(BYTE bank, WORD dst, BYTE data, unsigned len)
+{
+	BYTE buf[PAGESIZ], sel = selbnk;
+	register unsigned n;
+
+	memset(buf, data, sizeof(buf));
+	if (bank != selbnk)
+		switch_bank(bank);
+	for (; len > 0; len -= n, dst += n) {
+		n = len < PAGESIZ ? len : PAGESIZ;
+		dma_write_block(dst, buf, n);
+	}
+	if (sel != selbnk)
+		switch_bank(sel);
+}
+
+/*
+ * copy len bytes @ src in bank to p, as the CPU sees the bank
+ */
+void bank_read(BYTE bank, WORD src, BYTE *p, unsigned len)
+{
+	BYTE sel = selbnk;
+
+	if (bank != selbnk)
+		switch_bank(bank);
+	dma_read_block(src, p, len);
+	if (sel != selbnk)
+		switch_bank(sel);
+}
+
+/*
+ * copy len bytes from p to dst in bank, as the CPU sees the bank
+ */
+void bank_write(BYTE bank, WORD dst, const BYTE *p, unsigned len)
+{
+	BYTE sel = selbnk;
+
+	if (bank != selbnk)
+		switch_bank(bank);
+	dma_write_block(dst, p, len);
+	if (sel != selbnk)
+		switch_bank(sel);
+}
+
+#if MEM_WATCH
+/*
+ * set the write watch range to len <= 2048 bytes @ addr, all lines
+ * are marked changed, len 0 switches the watch off
+ */
+void mem_watch(WORD addr, unsigned len)
+{
+	register int i;
+
+	watch_len = 0;
+	watch_addr = addr;
+	for (i = 0; i < WATCH_LINES; i++)
+		watch_line[i] = 1;
+	watch_len = len < WATCH_LINES * WATCH_LINE ? len
+						   : WATCH_LINES * WATCH_LINE;
+}
+#endif
+
+#if MEM_WP
+/*
+ * count an access of kind to a flagged page in the ranges which
+ * contain addr, and stop the CPU if one of them has WP_BREAK
+ */
+void __not_in_flash_func(wp_hit)(WORD addr, BYTE kind)
+{
+	register mem_wp_t *w;
+
+	for (w = mem_wp; w < &mem_wp[WP_RANGES]; w++) {
+		if (!(w->mode & kind) || (WORD) (addr - w->addr) >= w->len)
+			continue;
+		if (kind == WP_READ)
+			w->reads++;
+		else
+			w->writes++;
+		if (w->mode & WP_BREAK) {
+			wp_break_addr = addr;
+			wp_break = true;
+			cpu_error = USERINT;
+			cpu_state = ST_STOPPED;
+		}
+	}
+}
+
+/*
+ * flag the pages of all ranges in wp_page[]
+ */
+static void wp_map(void)
+{
+	register mem_wp_t *w;
+	register unsigned p;
+
+	memset(wp_page, 0, sizeof(wp_page));
+	for (w = mem_wp; w < &mem_wp[WP_RANGES]; w++)
+		for (p = 0; p < w->len; p += PAGESIZ)
+			wp_page[(WORD) (w->addr + p) >> 8] |= w->mode;
+	for (w = mem_wp; w < &mem_wp[WP_RANGES]; w++)
+		if (w->len)
+			wp_page[(WORD) (w->addr + w->len - 1) >> 8] |= w->mode;
+}
+
+/*
+ * add a range of len bytes @ addr, which wraps at the end of memory,
+ * returns false if all ranges are used
+ */
+bool wp_set(WORD addr, unsigned len, BYTE mode)
+{
+	register mem_wp_t *w;
+
+	for (w = mem_wp; w < &mem_wp[WP_RANGES]; w++)
+		if (w->len == 0)
+			break;
+	if (w == &mem_wp[WP_RANGES])
+		return false;
+
+	w->addr = addr;
+	w->len = len < 65536 ? len : 65536;
+	w->mode = mode;
+	w->reads = w->writes = 0;
+	wp_map();
+	return w->len != 0;
+}
+
+/*
+ * remove all ranges
+ */
+void wp_clear(void)
+{
+	memset(mem_wp, 0, sizeof(mem_wp));
+	wp_break = false;
+	wp_map();
+}
+
+/*
+ * show the ranges with their counters, for the ICE
+ */
+void print_wp(void)
+{
+	register mem_wp_t *w;
+
+	puts("Range        Mode      Reads     Writes");
+	for (w = mem_wp; w < &mem_wp[WP_RANGES]; w++)
+		if (w->len)
+			printf("%04X-%04X    %c%c%c  %10lu %10lu\n", w->addr,
+			       (WORD) (w->addr + w->len - 1),
+			       w->mode & WP_READ ? 'r' : '-',
+			       w->mode & WP_WRITE ? 'w' : '-',
+			       w->mode & WP_BREAK ? 'b' : '-',
+			       (unsigned long) w->reads,
+			       (unsigned long) w->writes);
+	if (wp_break) {
+		printf("Stopped by the access of %04X\n", wp_break_addr);
+		wp_break = false;
+	}
+}
+#endif
+
+/*
+ * build the page tables for bank with its memory at mem
+ */
+#if MEM_DIRTY
+static void build_map(BYTE bank, BYTE *mem, BYTE **rd, BYTE **wr,
+		      volatile page_dirty_t **dirty)
+#else
+static void build_map(BYTE bank, BYTE *mem, BYTE **rd, BYTE **wr)
+#endif
+{
+	const mem_ovl_t *o;
+	register int i, p;
+
+	for (i = 0; i < (int) (segsiz / PAGESIZ); i++) {
+		rd[i] = wr[i] = bank == 0 ? &bnk0[i * PAGESIZ]
+					  : &mem[i * PAGESIZ];
+#if MEM_DIRTY
+		dirty[i] = bank == 0 ? &page_dirty[i]
+			: &page_dirty[(65536 + (mem - bnks)) / PAGESIZ + i];
+#endif
+	}
+	for (; i < NUMPAGE; i++) {
+		rd[i] = wr[i] = &bnk0[i * PAGESIZ];
+#if MEM_DIRTY
+		dirty[i] = &page_dirty[i];
+#endif
+	}
+
+	/* the read only overlays of this bank and of all banks */
+	for (o = ovls; o < &ovls[novl]; o++) {
+		/* overlays of a bank must still fit after set_segsiz() */
+		if (o->bank != OVL_ALL &&
+		    (o->bank != bank || o->addr + o->len > segsiz))
+			continue;
+		for (i = 0; i < (int) (o->len / PAGESIZ); i++) {
+			p = o->addr / PAGESIZ + i;
+			rd[p] = (BYTE *) &o->data[i * PAGESIZ];
+			wr[p] = rom_wr;
+#if MEM_DIRTY
+			dirty[p] = &page_dirty[NUMPHYS];
+#endif
+		}
+	}
+}
+
+/*
+ * rebuild the page tables for the selected bank
+ */
+void map_memory(void)
+{
+#if MEM_DIRTY
+	build_map(selbnk, curbnk, rdmap, wrmap, dirtymap);
+#else
+	build_map(selbnk, curbnk, rdmap, wrmap);
+#endif
+}
+
+/*
+ * build the page tables of bank for a DMA device, without switching
+ * to it, false if the memory of the bank doesn't stay where it is
+ */
+bool bank_pages(BYTE bank, mem_map_t *m)
+{
+#ifdef BANK_SLOTS
+	UNUSED(bank);
+	UNUSED(m);
+
+	return false;
+#else
+	if (bank > numseg)
+		return false;
+#if MEM_DIRTY
+	build_map(bank, bank == 0 ? bnk0 : bank_addr(bank), m->rd, m->wr,
+		  m->dirty);
+#else
+	build_map(bank, bank == 0 ? bnk0 : bank_addr(bank), m->rd, m->wr);
+#endif
+	return true;
+#endif
+}
+
+/*
+ * add a read only overlay of len bytes at data to the memory map
+ * of bank, or of all banks with OVL_ALL, from addr on, both must be
+ * multiples of the page size, returns false if it doesn't fit
+ */
+bool mem_overlay(int bank, WORD addr, const BYTE *data, unsigned len)
+{
+	mem_ovl_t *o;
+
+	if (novl == MAXOVL || len == 0 || addr % PAGESIZ || len % PAGESIZ ||
+	    addr + len > 0x10000U || bank > numseg ||
+	    (bank != OVL_ALL && addr + len > segsiz))
+		return false;
+
+	o = &ovls[novl++];
+	o->bank = bank;
+	o->addr = addr;
+	o->len = len;
+	o->data = data;
+	map_memory();
+
+	return true;
+}
+
+/*
+ * remove the overlay with the memory at data
+ */
+void mem_overlay_remove(const BYTE *data)
+{
+	register int i;
+
+	for (i = 0; i < novl; i++)
+		if (ovls[i].data == data) {
+			ovls[i] = ovls[--novl];
+			map_memory();
+			return;
+		}
+}
+
+/*
+ * show the overlays, for the ICE
+ */
+void print_overlays(void)
+{
+	const mem_ovl_t *o;
+
+	puts("Bank  Range      Memory");
+	for (o = ovls; o < &ovls[novl]; o++) {
+		if (o->bank == OVL_ALL)
+			printf("all   ");
+		else
+			printf("%3d   ", o->bank);
+		printf("%04X-%04X  ", o->addr, (WORD) (o->addr + o->len - 1));
+		if (o->data >= bnk0 && o->data < &bnk0[65536])
+			printf("bank 0 %04X\n", (unsigned) (o->data - bnk0));
+		else
+			puts("ROM");
+	}
+}
+
+/*
+ * remove all overlays except the boot ROM
+ */
+void mem_overlay_clear(void)
+{
+	novl = 0;
+	mem_overlay(OVL_ALL, 0xff00, &bnk0[0xff00], PAGESIZ);
+}
+
+#if OP_PROF
+/*
+ * index of the next largest counter after prev in the order of
+ * decreasing counts, -1 if there are no more counted ones
+ */
+static int op_prof_next(const uint32_t *cnt, int len, int prev)
+{
+	int best = -1;
+	register int i;
+
+	for (i = 0; i < len; i++) {
+		if (cnt[i] == 0)
+			continue;
+		if (prev >= 0 && (cnt[i] > cnt[prev]
+				  || (cnt[i] == cnt[prev] && i <= prev)))
+			continue;
+		if (best < 0 || cnt[i] > cnt[best])
+			best = i;
+	}
+
+	return best;
+}
+
+static void op_prof_puts(const char *s, bool debug)
+{
+	if (debug)
+		debug_puts(s);
+	else
+		puts(s);
+}
+
+/*
+ * print the opcode counts and the instructions per page, with n > 0
+ * the n largest of each, else all counted ones in table order.
+ * With debug the output goes to the DEBUG port.
+ */
+void print_op_prof(int n, bool debug)
+{
+	static const char *const pfx[OP_PROF_TABS] = {
+		"", "CB ", "DD ", "ED ", "FD "
+	};
+	const uint32_t *ops = &op_prof[0][0];
+	char buf[40];
+	int i, k;
+
+	op_prof_puts("Opcode          Count", debug);
+	for (i = 0, k = -1; n <= 0 || i < n; i++) {
+		if (n > 0)
+			k = op_prof_next(ops, OP_PROF_TABS * 256, k);
+		else
+			while (++k < OP_PROF_TABS * 256 && ops[k] == 0)
+				;
+		if (k < 0 || k >= OP_PROF_TABS * 256)
+			break;
+		snprintf(buf, sizeof(buf), "%s%02X %*lu", pfx[k >> 8],
+			 k & 0xff, k >> 8 ? 15 : 18, (unsigned long) ops[k]);
+		op_prof_puts(buf, debug);
+	}
+
+	op_prof_puts("Page            Count", debug);
+	for (i = 0, k = -1; n <= 0 || i < n; i++) {
+		if (n > 0)
+			k = op_prof_next(op_prof_page, NUMPAGE, k);
+		else
+			while (++k < NUMPAGE && op_prof_page[k] == 0)
+				;
+		if (k < 0 || k >= NUMPAGE)
+			break;
+		snprintf(buf, sizeof(buf), "%02XXX %16lu", k,
+			 (unsigned long) op_prof_page[k]);
+		op_prof_puts(buf, debug);
+	}
+}
+
+void clear_op_prof(void)
+{
+	memset(op_prof, 0, sizeof(op_prof));
+	memset(op_prof_page, 0, sizeof(op_prof_page));
+}
+#endif
+
+#if BRANCH_TRACE
+void init_branch_trace(void)
+{
+	memset(&branch_trace, 0, sizeof(branch_trace));
+	branch_trace.magic = BRANCH_MAGIC;
+}
+
+/*
+ * print the branch trace, oldest first
+ */
+void print_branch_trace(void)
+{
+	const branch_trace_t *b = &branch_trace;
+	uint32_t i, n, e;
+
+	if (b->magic != BRANCH_MAGIC)
+		return;
+	n = b->head < BRANCH_SIZE ? b->head : BRANCH_SIZE;
+	printf("Last %lu branches, oldest first:", (unsigned long) n);
+	for (i = 0; i < n; i++) {
+		e = b->ring[(b->head - n + i) & (BRANCH_SIZE - 1)];
+		printf("%s%04lX->%04lX", i % 6 ? "  " : "\n",
+		       (unsigned long) (e >> 16), (unsigned long) (e & 0xffff));
+	}
+	printf("\nlast code read at %04X\n", b->last);
+}
+#endif
+
+#if BANK_PACK
+/*
+ * the pages of a bank packed, the selected bank isn't packed
+ */
+bool banks_packed(void)
+{
+	return numseg > numslot;
+}
+
+static bool page_same(const BYTE *p)
+{
+	register int i;
+
+	for (i = 1; i < PAGESIZ; i++)
+		if (p[i] != p[0])
+			return false;
+	return true;
+}
+
+/*
+ * pack the bank in memory p to the end of the pool,
+ * returns false if it doesn't fit
+ */
+static bool pack_bank(BYTE bank, const BYTE *p)
+{
+	unsigned n = segsiz / PAGESIZ, size = 0;
+	BYTE *d;
+	register unsigned i;
+
+	for (i = 0; i < n; i++)
+		size += page_same(&p[i * PAGESIZ]) ? 2 : 1 + PAGESIZ;
+	if (pack_used + size > BANK_PACK_POOL)
+		return false;
+
+	d = &pack_pool[pack_used];
+	for (i = 0; i < n; i++, p += PAGESIZ)
+		if (page_same(p)) {
+			*d++ = PACK_SAME;
+			*d++ = *p;
+		} else {
+			*d++ = PACK_RAW;
+			memcpy(d, p, PAGESIZ);
+			d += PAGESIZ;
+		}
+	pack_off[bank] = pack_used;
+	pack_len[bank] = size;
+	pack_used += size;
+	pack_cnt++;
+	return true;
+}
+
+/*
+ * unpack a bank into memory p and remove it from the pool
+ */
+static void unpack_bank(BYTE bank, BYTE *p)
+{
+	unsigned n = segsiz / PAGESIZ, off = pack_off[bank];
+	unsigned len = pack_len[bank];
+	const BYTE *s = &pack_pool[off];
+	register unsigned i;
+
+	for (i = 0; i < n; i++, p += PAGESIZ)
+		if (*s++ == PACK_SAME)
+			memset(p, *s++, PAGESIZ);
+		else {
+			memcpy(p, s, PAGESIZ);
+			s += PAGESIZ;
+		}
+
+	memmove(&pack_pool[off], &pack_pool[off + len], pack_used - off - len);
+	pack_used -= len;
+	for (i = 1; i <= MAXSEG; i++)
+		if (pack_len[i] && pack_off[i] > off)
+			pack_off[i] -= len;
+	pack_len[bank] = 0;
+	unpack_cnt++;
+}
+
+/*
+ * the banks which aren't in a slot packed with mem_fill,
+ * the random fills as zero
+ */
+static void pack_reset(void)
+{
+	unsigned n = segsiz / PAGESIZ;
+	register int i;
+	register unsigned j;
+
+	pack_used = 0;
+	for (i = 0; i <= MAXSEG; i++)
+		pack_len[i] = 0;
+	for (i = 1; i <= numseg; i++) {
+		if (bank_slot[i] >= 0)
+			continue;
+		pack_off[i] = pack_used;
+		pack_len[i] = 2 * n;
+		for (j = 0; j < n; j++) {
+			pack_pool[pack_used++] = PACK_SAME;
+			pack_pool[pack_used++] = mem_fill == MEM_E5 ? 0xe5
+								    : 0x00;
+		}
+	}
+}
+
+/*
+ * print the usage of the pool and the cost of the bank switches
+ */
+void print_bank_pack(void)
+{
+	printf("Packed banks: %u of %u bytes, %lu packed, %lu unpacked, "
+	       "%lu ms\n", pack_used, BANK_PACK_POOL, (unsigned long) pack_cnt,
+	       (unsigned long) unpack_cnt, (unsigned long) (pack_us / 1000));
+}
+#endif /* BANK_PACK */
+
+#ifdef BANK_SLOTS
+/*
+ * get the memory of a bank, if it isn't in a slot, it replaces
+ * the bank in the least recently used slot
+ */
+static BYTE *bank_mem(BYTE bank)
+{
+	register int i, s;
+#if BANK_PACK
+	uint64_t t;
+#endif
+
+	if ((s = bank_slot[bank]) < 0) {
+		for (s = 0, i = 1; i < numslot; i++)
+			if (slot_used[i] < slot_used[s])
+				s = i;
+#ifdef PSRAM_BANKS
+		if (slot_bank[s] != 0) {
+			bank_copy(PSRAM_BASE + (slot_bank[s] - 1) * segsiz,
+				  &bnks[s * segsiz]);
+			bank_slot[slot_bank[s]] = -1;
+		}
+		bank_copy(&bnks[s * segsiz], PSRAM_BASE + (bank - 1) * segsiz);
+#else
+		t = time_us_64();
+		if (slot_bank[s] != 0) {
+			if (!pack_bank(slot_bank[s], &bnks[s * segsiz])) {
+				LOGE(TAG, "no room to pack bank %d",
+				     slot_bank[s]);
+				cpu_error = IOERROR;
+				cpu_state = ST_STOPPED;
+				return &bnks[s * segsiz];
+			}
+			bank_slot[slot_bank[s]] = -1;
+		}
+		unpack_bank(bank, &bnks[s * segsiz]);
+		pack_us += time_us_64() - t;
+#endif
+#if MEM_DIRTY
+		for (i = 0; i < (int) (segsiz / PAGESIZ); i++)
+			page_dirty[(65536 + s * segsiz) / PAGESIZ + i].all =
+				~0U;
+#endif
+		slot_bank[s] = bank;
+		bank_slot[bank] = s;
+	}
+	slot_used[s] = ++slot_clock;
+
+	return &bnks[s * segsiz];
+}
+#endif /* BANK_SLOTS */
+
+#ifdef PSRAM_BANKS
+/*
+ * copy a bank with DMA
+ */
+static void bank_copy(BYTE *dst, const BYTE *src)
+{
+	dma_channel_config c = dma_channel_get_default_config(copy_chan);
+
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, true);
+	dma_channel_configure(copy_chan, &c, dst, src, segsiz / 4, true);
+	dma_channel_wait_for_finish_blocking(copy_chan);
+}
+
+/*
+ * detect the PSRAM on chip select 1 of the QMI, switch it into QPI
+ * mode and setup the memory window for it with timing, returns the
+ * size of the PSRAM, or 0 if there is none. Flash can't be accessed
+ * while the PSRAM is programmed with direct mode, so this runs from
+ * RAM with interrupts disabled.
+ */
+static size_t __no_inline_not_in_flash_func(psram_setup)(uint32_t timing)
+{
+	uint8_t kgd = 0, eid = 0;
+	size_t size;
+	uint32_t irq;
+	register int i;
+
+	irq = save_and_disable_interrupts();
+
+	/* direct mode, exit QPI mode in case it is still in it */
+	qmi_hw->direct_csr = 10 << QMI_DIRECT_CSR_CLKDIV_LSB |
+			     QMI_DIRECT_CSR_EN_BITS |
+			     QMI_DIRECT_CSR_AUTO_CS1N_BITS;
+	while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)
+		;
+	qmi_hw->direct_tx = QMI_DIRECT_TX_OE_BITS |
+			    QMI_DIRECT_TX_IWIDTH_VALUE_Q <<
+			    QMI_DIRECT_TX_IWIDTH_LSB | 0xf5;
+	while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)
+		;
+	(void) qmi_hw->direct_rx;
+	qmi_hw->direct_csr &= ~QMI_DIRECT_CSR_AUTO_CS1N_BITS;
+
+	/* read the ID, byte 5 is the known good die, 6 the density */
+	qmi_hw->direct_csr |= QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+	for (i = 0; i < 7; i++) {
+		qmi_hw->direct_tx = i == 0 ? 0x9f : 0xff;
+		while (!(qmi_hw->direct_csr & QMI_DIRECT_CSR_TXEMPTY_BITS))
+			;
+		while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)
+			;
+		if (i == 5)
+			kgd = qmi_hw->direct_rx;
+		else if (i == 6)
+			eid = qmi_hw->direct_rx;
+		else
+			(void) qmi_hw->direct_rx;
+	}
+	qmi_hw->direct_csr &= ~(QMI_DIRECT_CSR_ASSERT_CS1N_BITS |
+				QMI_DIRECT_CSR_EN_BITS);
+	if (kgd != 0x5d) {
+		restore_interrupts(irq);
+		return 0;
+	}
+	size = (size_t) (2 * 1024 * 1024) << (eid >> 5 < 2 ? eid >> 5 : 2);
+
+	/* reset enable, reset, enter QPI mode */
+	qmi_hw->direct_csr = 30 << QMI_DIRECT_CSR_CLKDIV_LSB |
+			     QMI_DIRECT_CSR_EN_BITS;
+	while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)
+		;
+	for (i = 0; i < 3; i++) {
+		qmi_hw->direct_csr |= QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+		qmi_hw->direct_tx = i == 0 ? 0x66 : i == 1 ? 0x99 : 0x35;
+		while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)
+			;
+		qmi_hw->direct_csr &= ~QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+		(void) qmi_hw->direct_rx;
+	}
+	qmi_hw->direct_csr &= ~QMI_DIRECT_CSR_EN_BITS;
+
+	/* memory window with quad fast read and quad write */
+	qmi_hw->m[1].timing = timing;
+	qmi_hw->m[1].rfmt = QMI_M1_RFMT_PREFIX_WIDTH_VALUE_Q <<
+			QMI_M1_RFMT_PREFIX_WIDTH_LSB |
+			QMI_M1_RFMT_ADDR_WIDTH_VALUE_Q <<
+			QMI_M1_RFMT_ADDR_WIDTH_LSB |
+			QMI_M1_RFMT_SUFFIX_WIDTH_VALUE_Q <<
+			QMI_M1_RFMT_SUFFIX_WIDTH_LSB |
+			QMI_M1_RFMT_DUMMY_WIDTH_VALUE_Q <<
+			QMI_M1_RFMT_DUMMY_WIDTH_LSB |
+			QMI_M1_RFMT_DATA_WIDTH_VALUE_Q <<
+			QMI_M1_RFMT_DATA_WIDTH_LSB |
+			QMI_M1_RFMT_PREFIX_LEN_VALUE_8 <<
+			QMI_M1_RFMT_PREFIX_LEN_LSB |
+			6 << QMI_M1_RFMT_DUMMY_LEN_LSB;
+	qmi_hw->m[1].rcmd = 0xeb;
+	qmi_hw->m[1].wfmt = QMI_M1_WFMT_PREFIX_WIDTH_VALUE_Q <<
+			QMI_M1_WFMT_PREFIX_WIDTH_LSB |
+			QMI_M1_WFMT_ADDR_WIDTH_VALUE_Q <<
+			QMI_M1_WFMT_ADDR_WIDTH_LSB |
+			QMI_M1_WFMT_SUFFIX_WIDTH_VALUE_Q <<
+			QMI_M1_WFMT_SUFFIX_WIDTH_LSB |
+			QMI_M1_WFMT_DUMMY_WIDTH_VALUE_Q <<
+			QMI_M1_WFMT_DUMMY_WIDTH_LSB |
+			QMI_M1_WFMT_DATA_WIDTH_VALUE_Q <<
+			QMI_M1_WFMT_DATA_WIDTH_LSB |
+			QMI_M1_WFMT_PREFIX_LEN_VALUE_8 <<
+			QMI_M1_WFMT_PREFIX_LEN_LSB;
+	qmi_hw->m[1].wcmd = 0x38;
+
+	restore_interrupts(irq);
+
+	return size;
+}
+
+/*
+ * initialize the PSRAM with chip select on GPIO cs_pin,
+ * returns its size, or 0 if there is none
+ */
+static size_t psram_init(uint cs_pin)
+{
+	const uint32_t max_hz = 133000000; /* max. clock of the PSRAM */
+	uint32_t clock_hz, divisor, rxdelay, period_fs;
+	uint32_t max_select, min_deselect;
+	size_t size;
+
+	gpio_set_function(cs_pin, GPIO_FUNC_XIP_CS1);
+
+	/* timing for the system clock, max. select 8 us, min. deselect 18 ns */
+	clock_hz = clock_get_hz(clk_sys);
+	divisor = (clock_hz + max_hz - 1) / max_hz;
+	if (divisor == 1 && clock_hz > 100000000)
+		divisor = 2;
+	rxdelay = divisor;
+	if (clock_hz / divisor > 100000000)
+		rxdelay++;
+	period_fs = 1000000000000000ULL / clock_hz;
+	max_select = (125 * 1000000) / period_fs;
+	min_deselect = (18 * 1000000 + period_fs - 1) / period_fs -
+		       (divisor + 1) / 2;
+
+	size = psram_setup(1 << QMI_M1_TIMING_COOLDOWN_LSB |
+			   QMI_M1_TIMING_PAGEBREAK_VALUE_1024 <<
+			   QMI_M1_TIMING_PAGEBREAK_LSB |
+			   max_select << QMI_M1_TIMING_MAX_SELECT_LSB |
+			   min_deselect << QMI_M1_TIMING_MIN_DESELECT_LSB |
+			   rxdelay << QMI_M1_TIMING_RXDELAY_LSB |
+			   divisor << QMI_M1_TIMING_CLKDIV_LSB);
+	if (size == 0)
+		return 0;
+
+	/* allow writes to the PSRAM window */
+	hw_set_bits(&xip_ctrl_hw->ctrl, XIP_CTRL_WRITABLE_M1_BITS);
+
+	return size > PSRAM_MAXSIZE ? PSRAM_MAXSIZE : size;
 }
+#endif /* PSRAM_BANKS */
@@ -11,32 +11,460 @@
  * 29-JUN-2024 implemented banked memory
  * 14-DEC-2024 added hardware breakpoint support
  * 12-MAR-2025 added more memory banks for RP2350
+ * 14-OCT-2026 added block transfers for DMA devices
+ * 14-OCT-2026 added direct memory pointer for DMA devices
+ * 14-OCT-2026 added dma_block_len()
+ * 14-OCT-2026 use page tables for the memory map
+ * 14-OCT-2026 update the front panel LEDs only while the panel is shown
+ * 14-OCT-2026 configurable number and size of the memory banks
+ * 14-OCT-2026 added banks in PSRAM on RP2350
+ * 14-OCT-2026 selectable memory fill at power on
+ * 14-OCT-2026 access to the memory of all banks for snapshots
+ * 14-OCT-2026 track the changed memory pages
+ * 14-OCT-2026 write watch range for video memory
+ * 14-OCT-2026 read only overlays in the memory map
+ * 14-OCT-2026 sampled access counters for the memory heat map
+ * 14-OCT-2026 opcode profiler
+ * 14-OCT-2026 opcode fetches in the trace stream
+ * 14-OCT-2026 always on branch trace for post-mortems
+ * 14-OCT-2026 handle the events of a replay on memory reads
+ * 14-OCT-2026 memory watchpoints with hit counters
+ * 14-OCT-2026 one attention word for the run time hooks of memory reads
+ * 14-OCT-2026 run the events of the T-state scheduler on memory reads
+ * 14-OCT-2026 two banks on RP2040 with the memory budget build
+ * 14-OCT-2026 packed banks without PSRAM
+ * 14-OCT-2026 front panel sampled by the LCD, no stores on memory accesses
+ * 14-OCT-2026 added bank_map()
+ * 14-OCT-2026 added bank_pages() for DMA into a latched bank
+ * 14-OCT-2026 added mem_overlay_remove() and print_overlays()
+ * 14-OCT-2026 raise the pending interrupts on CPU reads
  */
 
 #ifndef SIMMEM_INC
 #define SIMMEM_INC
 
+#include <string.h>
+
 #include "sim.h"
 #include "simdefs.h"
 #ifdef WANT_ICE
 #include "simice.h"
 #endif
 
-#if defined(SIMPLEPANEL) || defined(BUS_8080)
+#ifdef BUS_8080
 #include "simglb.h"
 #endif
+#include "trace.h"
+#include "replay.h"
+#include "sched.h"
+#include "simio.h"
 
+/*
+ * The memory for the banks is split into numseg banks of segsiz bytes,
+ * the addresses from segsiz up are the common segment from bnk0.
+ * The bank size can be configured in steps of SEGSTEP bytes.
+ */
+#ifndef MEM_BUDGET
+#define MEM_BUDGET	0	/* RP2040 build trimmed for a second bank */
+#endif
 #if PICO_RP2350
-#define NUMSEG 6
+#define BNKMEM	(6 * 49152)	/* memory for the banks */
+#elif MEM_BUDGET
+#define BNKMEM	(2 * 49152)	/* RP2040 with the memory budget build */
 #else
-#define NUMSEG 1
+#define BNKMEM	49152
+#endif
+#define DEF_SEGSIZ 49152	/* default size of a bank */
+#define SEGSTEP	4096		/* granularity of the bank size */
+#define MAXSEG	15		/* mmu_in() returns the banks in a nibble */
+#define MAX_SEGSIZ (BNKMEM < 65536 - SEGSTEP ? BNKMEM : 65536 - SEGSTEP)
+
+/*
+ * On RP2350 boards with QSPI PSRAM, build with PSRAM_CS_PIN set to
+ * the GPIO of its chip select, then all banks have their memory in
+ * PSRAM and the bank memory in SRAM caches the recently used banks.
+ */
+#if PICO_RP2350 && defined(PSRAM_CS_PIN)
+#define PSRAM_BANKS
+#endif
+
+/*
+ * Without PSRAM, build with BANK_PACK set, then BANK_PACK_BANKS more
+ * banks are kept packed in BANK_PACK_POOL bytes of SRAM, like the PSRAM
+ * banks the bank memory caches the recently used banks. Pages of a
+ * single byte value, like never used memory, take two bytes packed.
+ */
+#ifndef BANK_PACK
+#define BANK_PACK	0	/* packed banks */
+#endif
+#ifndef BANK_PACK_BANKS
+#define BANK_PACK_BANKS	2	/* banks kept packed */
+#endif
+#ifndef BANK_PACK_POOL
+#define BANK_PACK_POOL	8192	/* bytes for the packed banks */
+#endif
+#if BANK_PACK && defined(PSRAM_BANKS)
+#error "BANK_PACK can't be used with PSRAM banks"
 #endif
-#define SEGSIZ 49152
 
-extern BYTE bnk0[65536], bnks[NUMSEG][SEGSIZ];
+extern BYTE bnk0[65536], bnks[BNKMEM];
 extern BYTE selbnk, *curbnk;
+extern int numseg;
+extern unsigned segsiz;
+
+/*
+ * The memory map is a table of pointers to the 256 byte pages for
+ * reading and one for writing, rebuilt by map_memory() when the bank
+ * is switched, so that an access needs no tests. Writes to the ROM
+ * page go into a page which is never read.
+ */
+#define PAGESIZ	256
+#define NUMPAGE	(65536 / PAGESIZ)
+
+extern BYTE *rdmap[NUMPAGE], *wrmap[NUMPAGE];
+
+/*
+ * Read only overlays replace whole pages of the memory map of one bank
+ * or of all banks with memory elsewhere, for example a ROM in flash or
+ * a resident system image shared by all banks, writes to them go into
+ * the page which is never read. The boot ROM page is an overlay of all
+ * banks too. Overlays of a single bank must be below the common segment.
+ */
+#define MAXOVL		4	/* max. number of overlays */
+#define OVL_ALL		-1	/* overlay in all banks */
+
+extern bool mem_overlay(int bank, WORD addr, const BYTE *data, unsigned len);
+extern void mem_overlay_remove(const BYTE *data);
+extern void mem_overlay_clear(void);
+extern void print_overlays(void);
+
+/*
+ * Every page of bank 0 and the bank memory has a changed flag for
+ * each user of it, all are set with one store by the writes into
+ * the page, and each user clears only its own byte, so that the
+ * users on both cores don't need a read-modify-write of the flags.
+ * dirtymap[] points to the flags of the mapped pages, the ROM page
+ * has a flag which isn't used, so that writes to it need no test.
+ */
+#ifndef MEM_DIRTY
+#define MEM_DIRTY	1	/* track the changed memory pages */
+#endif
+
+#if MEM_DIRTY
+#define DIRTY_SNAP	0	/* changed since the last snapshot */
+#define DIRTY_LCD	1	/* changed since drawn by the memory display */
+
+typedef union page_dirty {
+	uint32_t all;
+	BYTE user[4];
+} page_dirty_t;
+
+#define NUMPHYS	((65536 + BNKMEM) / PAGESIZ) /* pages of bnk0 and bnks */
+
+extern volatile page_dirty_t page_dirty[NUMPHYS + 1];
+extern volatile page_dirty_t *dirtymap[NUMPAGE];
+
+extern void mem_dirty_all(void);
+
+/* mark len > 0 bytes @ addr changed, up to the end of memory */
+static inline void mem_dirty(WORD addr, unsigned len)
+{
+	register unsigned p, e;
+
+	e = addr + len - 1 < 0xffffU ? (addr + len - 1) >> 8 : NUMPAGE - 1;
+	for (p = addr >> 8; p <= e; p++)
+		dirtymap[p]->all = ~0U;
+}
+#endif
+
+/*
+ * Every MEM_HEAT_RATE-th memory access of the CPU counts up a counter
+ * of the physical page for reads, writes or the instruction stream,
+ * which are the reads at PC - 1, since the CPU reads with PC++. The
+ * page is found from its changed flags. Core 1 lets the counters decay
+ * while drawing them, an update lost between both cores doesn't matter.
+ */
+#ifndef MEM_HEAT
+#define MEM_HEAT	0	/* access counters for the memory heat map */
+#endif
+#if !MEM_DIRTY
+#undef MEM_HEAT
+#define MEM_HEAT	0
+#endif
+
+#if MEM_HEAT
+#include "simglb.h"
+
+#define MEM_HEAT_RATE	64	/* count every n-th access */
+
+#define HEAT_READ	0
+#define HEAT_WRITE	1
+#define HEAT_EXEC	2
+
+extern volatile BYTE mem_heat[3][NUMPHYS + 1];
+extern unsigned mem_heat_cnt;
+
+static inline void mem_heat_sample(WORD addr, int kind)
+{
+	register unsigned p;
+
+	if (--mem_heat_cnt)
+		return;
+	mem_heat_cnt = MEM_HEAT_RATE;
+	p = dirtymap[addr >> 8] - page_dirty;
+	if (mem_heat[kind][p] < 255)
+		mem_heat[kind][p]++;
+}
+#endif
+
+/*
+ * With OP_PROF the opcode fetches (M1 cycles) are counted for every
+ * opcode, in separate tables for the CB, DD, ED and FD prefixed ones,
+ * and the instructions for every page of the PC. The opcode after
+ * DD CB and FD CB is no M1 cycle, those count as CB in the DD/FD table.
+ * The M1 cycles are found with the bus status of BUS_8080.
+ */
+#ifndef OP_PROF
+#define OP_PROF		0	/* opcode profiler */
+#endif
+#ifndef BUS_8080
+#undef OP_PROF
+#define OP_PROF		0
+#endif
+
+#if OP_PROF
+#include "simglb.h"
+
+#define OP_PROF_TABS	5	/* no prefix, CB, DD, ED, FD */
+#define OP_PROF_TOP	32	/* opcodes and pages in the short list */
+
+extern uint32_t op_prof[OP_PROF_TABS][256];
+extern uint32_t op_prof_page[NUMPAGE];
+extern BYTE op_prof_pfx;
+
+extern void print_op_prof(int n, bool debug), clear_op_prof(void);
+
+static inline void op_prof_fetch(WORD addr, BYTE data)
+{
+	register BYTE t = op_prof_pfx;
+
+	op_prof[t][data]++;
+	op_prof_pfx = 0;
+	if (t)
+		return;		/* second opcode of a prefixed instruction */
+	op_prof_page[addr >> 8]++;
+	if (cpu != Z80)
+		return;
+	switch (data) {
+	case 0xcb:
+		op_prof_pfx = 1;
+		break;
+	case 0xdd:
+		op_prof_pfx = 2;
+		break;
+	case 0xed:
+		op_prof_pfx = 3;
+		break;
+	case 0xfd:
+		op_prof_pfx = 4;
+		break;
+	default:
+		break;
+	}
+}
+#endif
+
+/*
+ * With BRANCH_TRACE the last BRANCH_SIZE taken jumps, calls, returns,
+ * restarts and interrupts are kept in a ring, for a post-mortem when
+ * the machine stopped or hung without the ICE. Code is read at PC - 1
+ * by the CPU core, a code read not following the one before is the
+ * target of a branch, the entry is the address of the last byte of the
+ * instruction before and the target. Repeats of the same branch, like
+ * of LDIR or DJNZ, are only kept once. The ring is in RAM which isn't
+ * initialized at boot, so it still holds the trace after a watchdog
+ * reset. With BRANCH_WDOG_MS > 0 the watchdog resets the MCU if the
+ * timer interrupts of core 0 stop for so long while the CPU runs, and
+ * the trace is printed after the boot.
+ */
+#ifndef BRANCH_TRACE
+#define BRANCH_TRACE	1	/* branch trace */
+#endif
+#ifndef BRANCH_SIZE
+#define BRANCH_SIZE	64	/* entries of the branch trace, power of 2 */
+#endif
+#ifndef BRANCH_WDOG_MS
+#define BRANCH_WDOG_MS	0	/* watchdog timeout, 0 = no watchdog */
+#endif
+
+#if BRANCH_TRACE
+#include "simglb.h"
+
+#define BRANCH_MAGIC	0x42524e43	/* ring holds a trace */
+
+typedef struct branch_trace {
+	uint32_t magic;
+	uint32_t head;		/* entries written */
+	WORD last;		/* address of the last code read */
+	uint32_t ring[BRANCH_SIZE]; /* from << 16 | to */
+} branch_trace_t;
+
+extern branch_trace_t branch_trace;
+
+extern void init_branch_trace(void), print_branch_trace(void);
+
+static inline void branch_fetch(WORD addr)
+{
+	register branch_trace_t *b = &branch_trace;
+	register uint32_t e;
+
+	if (addr != (WORD) (b->last + 1)) {
+		e = (uint32_t) b->last << 16 | addr;
+		if (e != b->ring[(b->head - 1) & (BRANCH_SIZE - 1)])
+			b->ring[b->head++ & (BRANCH_SIZE - 1)] = e;
+	}
+	b->last = addr;
+}
+#endif
+
+/*
+ * A write watch range of up to 2048 bytes for video memory, writes
+ * into it set the flag for the 16 byte line written, so that core 1
+ * only draws the changed lines. The flags are set and cleared with
+ * single byte stores. A length of 0 switches the watch off.
+ */
+#ifndef MEM_WATCH
+#define MEM_WATCH	1	/* write watch range for video memory */
+#endif
+
+#if MEM_WATCH
+#define WATCH_LINE	16	/* bytes per line */
+#define WATCH_LINES	(2048 / WATCH_LINE)
+
+extern WORD watch_addr;
+extern unsigned watch_len;
+extern volatile BYTE watch_line[WATCH_LINES];
+
+extern void mem_watch(WORD addr, unsigned len);
+
+/* mark the lines of the watch range in len > 0 bytes @ addr changed */
+static inline void watch_range(WORD addr, unsigned len)
+{
+	register unsigned i;
+
+	for (i = 0; i < len; i += WATCH_LINE)
+		if ((WORD) (addr + i - watch_addr) < watch_len)
+			watch_line[(WORD) (addr + i - watch_addr) /
+				   WATCH_LINE] = 1;
+	if ((WORD) (addr + len - 1 - watch_addr) < watch_len)
+		watch_line[(WORD) (addr + len - 1 - watch_addr) /
+			   WATCH_LINE] = 1;
+}
+#endif
+
+/*
+ * With MEM_WP up to WP_RANGES watchpoint ranges count the reads and
+ * writes of the CPU into them, and can stop the CPU on a hit. The
+ * pages the ranges touch are flagged in wp_page[], which is indexed
+ * like the page tables, so the accesses of the other pages only test
+ * the flag and the ranges are searched for the flagged pages only.
+ */
+#ifndef MEM_WP
+#define MEM_WP		0	/* memory watchpoints */
+#endif
+
+#if MEM_WP
+#define WP_RANGES	8	/* number of watchpoint ranges */
+
+/* modes of a range, also the access kinds in wp_page[] */
+#define WP_READ		1	/* count reads */
+#define WP_WRITE	2	/* count writes */
+#define WP_BREAK	4	/* stop the CPU on a hit */
+
+typedef struct mem_wp {
+	WORD addr;		/* first address */
+	unsigned len;		/* length, 0 = unused */
+	BYTE mode;		/* WP_READ, WP_WRITE and WP_BREAK */
+	uint32_t reads;		/* reads counted */
+	uint32_t writes;	/* writes counted */
+} mem_wp_t;
+
+extern mem_wp_t mem_wp[WP_RANGES];
+extern BYTE wp_page[NUMPAGE];
+
+extern void wp_hit(WORD addr, BYTE kind);
+extern bool wp_set(WORD addr, unsigned len, BYTE mode);
+extern void wp_clear(void);
+extern void print_wp(void);
+#endif
+
+/*
+ * With BIOS_TRAP a BIOS can register up to MAXTRAP entries of its jump
+ * table with the hardware control port. When the CPU fetches the code
+ * at one of them, the host does the function and hands the CPU a RET
+ * instead, so that the BIOS code isn't emulated. A trap is in the bank
+ * selected when it was registered, or in all banks if it is in the
+ * common segment. The pages with a trap are flagged in trap_page[],
+ * the code reads of the other pages only test the flag.
+ */
+#ifndef BIOS_TRAP
+#define BIOS_TRAP	0	/* BIOS function traps */
+#endif
+
+#if BIOS_TRAP
+#include "simglb.h"
+
+#define MAXTRAP		8	/* number of traps */
+
+extern BYTE trap_page[NUMPAGE];
+
+extern BYTE bios_trap(WORD addr, BYTE data);
+#endif
+
+/* memory fill at power on */
+#define MEM_XORSHIFT	0	/* pseudo random words */
+#define MEM_RAND	1	/* random bytes with rand(), slow */
+#define MEM_ZERO	2	/* 00H with DMA */
+#define MEM_E5		3	/* E5H with DMA */
+#define MEM_FILL_MAX	MEM_E5
+
+extern int mem_fill;
 
 extern void init_memory(void), reset_memory(void);
+extern void fill_memory(void);
+extern void map_memory(void);
+extern void set_segsiz(unsigned size);
+extern void select_bank(BYTE bank);
+extern void bank_map(BYTE bank);
+extern BYTE *bank_addr(BYTE bank);
+extern void bank_move(BYTE sbank, WORD src, BYTE dbank, WORD dst,
+		      unsigned len);
+extern void bank_fill(BYTE bank, WORD dst, BYTE data, unsigned len);
+extern void bank_read(BYTE bank, WORD src, BYTE *p, unsigned len);
+extern void bank_write(BYTE bank, WORD dst, const BYTE *p, unsigned len);
+#if BANK_PACK
+extern bool banks_packed(void);
+extern void print_bank_pack(void);
+#endif
+
+/*
+ * The hooks of the CPU memory accesses which are switched on at run
+ * time each set their byte in mem_attn, so that a read of the CPU
+ * tests only one word while all of them are off. Every byte has one
+ * writer, or is written under a lock, so core 0 and core 1 can switch
+ * them without a read-modify-write of the word.
+ */
+typedef union mem_attn {
+	uint32_t all;		/* nonzero if any hook is on */
+	struct {
+		BYTE trap;	/* BIOS function traps are registered */
+		BYTE replay;	/* a run is recorded or replayed */
+		BYTE sched;	/* events on the T-states are pending */
+		BYTE intr;	/* interrupt sources are pending */
+	} on;
+} mem_attn_t;
+
+extern mem_attn_t mem_attn;
 
 /* Last page in memory is ROM and write protected. Some software */
 /* expects a ROM in upper memory, if not it will wrap arround to */
@@ -51,22 +479,50 @@ static inline void memwrt(WORD addr, BYTE data)
 	cpu_bus &= ~(CPU_M1 | CPU_WO | CPU_MEMR);
 #endif
 
-#ifdef SIMPLEPANEL
-	fp_led_address = addr;
-	fp_led_data = data;
-#endif
-
 #ifdef WANT_HB
 	if (hb_flag && hb_addr == addr && (hb_mode & HB_WRITE))
 		hb_trig = HB_WRITE;
 #endif
+#if MEM_WP
+	if (wp_page[addr >> 8] & WP_WRITE)
+		wp_hit(addr, WP_WRITE);
+#endif
 
-	if ((selbnk == 0) || (addr >= SEGSIZ)) {
-		if (addr < 0xff00)
-			bnk0[addr] = data;
-	} else {
-		curbnk[addr] = data;
-	}
+	wrmap[addr >> 8][addr & 0xff] = data;
+#if MEM_DIRTY
+	dirtymap[addr >> 8]->all = ~0U;
+#endif
+#if MEM_WATCH
+	if ((WORD) (addr - watch_addr) < watch_len)
+		watch_line[(WORD) (addr - watch_addr) / WATCH_LINE] = 1;
+#endif
+#if MEM_HEAT
+	mem_heat_sample(addr, HEAT_WRITE);
+#endif
+}
+
+/*
+ * the hooks of a CPU read switched on in mem_attn
+ */
+static inline BYTE memrdr_attn(WORD addr, BYTE data)
+{
+#if BIOS_TRAP
+	if (mem_attn.on.trap && trap_page[addr >> 8]
+	    && addr == (WORD) (PC - 1))
+		data = bios_trap(addr, data);
+#else
+	UNUSED(addr);
+#endif
+#if REPLAY80
+	if (mem_attn.on.replay)
+		replay_check();
+#endif
+	if (mem_attn.on.sched)
+		sched_check();
+	if (mem_attn.on.intr && !int_int)
+		int_service();
+
+	return data;
 }
 
 static inline BYTE memrdr(WORD addr)
@@ -85,21 +541,34 @@ static inline BYTE memrdr(WORD addr)
 	}
 #endif
 
-	if ((selbnk == 0) || (addr >= SEGSIZ))
-		data = bnk0[addr];
-	else
-		data = curbnk[addr];
+	data = rdmap[addr >> 8][addr & 0xff];
+	if (mem_attn.all)
+		data = memrdr_attn(addr, data);
+#if MEM_WP
+	if (wp_page[addr >> 8] & WP_READ)
+		wp_hit(addr, WP_READ);
+#endif
+#if BRANCH_TRACE
+	if (addr == (WORD) (PC - 1))
+		branch_fetch(addr);
+#endif
+#if OP_PROF
+	if (cpu_bus & CPU_M1)
+		op_prof_fetch(addr, data);
+#endif
+#if TRACE80 && defined(BUS_8080)
+	if (cpu_bus & CPU_M1)
+		trace_inst(addr, data);
+#endif
+#if MEM_HEAT
+	mem_heat_sample(addr, addr == (WORD) (PC - 1) ? HEAT_EXEC : HEAT_READ);
+#endif
 
 #ifdef BUS_8080
 	cpu_bus &= ~CPU_M1;
 	cpu_bus |= CPU_WO | CPU_MEMR;
 #endif
 
-#ifdef SIMPLEPANEL
-	fp_led_address = addr;
-	fp_led_data = data;
-#endif
-
 	return data;
 }
 
@@ -108,20 +577,162 @@ static inline BYTE memrdr(WORD addr)
  */
 static inline void dma_write(WORD addr, BYTE data)
 {
-	if ((selbnk == 0) || (addr >= SEGSIZ)) {
-		if (addr < 0xff00)
-			bnk0[addr] = data;
-	} else {
-		curbnk[addr] = data;
-	}
+	wrmap[addr >> 8][addr & 0xff] = data;
+#if MEM_DIRTY
+	dirtymap[addr >> 8]->all = ~0U;
+#endif
+#if MEM_WATCH
+	if ((WORD) (addr - watch_addr) < watch_len)
+		watch_line[(WORD) (addr - watch_addr) / WATCH_LINE] = 1;
+#endif
 }
 
 static inline BYTE dma_read(WORD addr)
 {
-	if ((selbnk == 0) || (addr >= SEGSIZ))
-		return bnk0[addr];
-	else
-		return curbnk[addr];
+	return rdmap[addr >> 8][addr & 0xff];
+}
+
+/*
+ * block memory access for DMA devices, the transfer is split
+ * at the pages, writes into a read only page are discarded
+ */
+static inline void dma_write_block(WORD addr, const BYTE *p, unsigned len)
+{
+	register unsigned n;
+
+#if MEM_DIRTY
+	if (len > 0)
+		mem_dirty(addr, len);
+#endif
+#if MEM_WATCH
+	if (len > 0 && watch_len)
+		watch_range(addr, len);
+#endif
+	while (len > 0) {
+		n = PAGESIZ - (addr & 0xff);
+		if (n > len)
+			n = len;
+		memcpy(&wrmap[addr >> 8][addr & 0xff], p, n);
+		addr += n;
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * returns the number of bytes @ addr which can be transferred with
+ * one block transfer, up to the end of the consecutive pages, which
+ * must be writable if the device writes into memory
+ */
+static inline unsigned dma_block_len(WORD addr, bool wr)
+{
+	register unsigned pg = addr >> 8;
+	register unsigned n = PAGESIZ - (addr & 0xff);
+
+	if (wr && wrmap[pg] != rdmap[pg])
+		return 0;
+	while (pg < NUMPAGE - 1 && rdmap[pg + 1] == rdmap[pg] + PAGESIZ &&
+	       (!wr || wrmap[pg + 1] == rdmap[pg + 1])) {
+		pg++;
+		n += PAGESIZ;
+	}
+	return n;
+}
+
+/*
+ * returns a pointer into the memory for a DMA transfer of len bytes
+ * @ addr, so that a device can transfer the data directly, or NULL if
+ * the range isn't in consecutive pages, or in writable pages if the
+ * device writes into memory
+ */
+static inline BYTE *dma_block_ptr(WORD addr, unsigned len, bool wr)
+{
+#if MEM_DIRTY
+	if (wr && len > 0)
+		mem_dirty(addr, len);
+#endif
+#if MEM_WATCH
+	if (wr && len > 0 && watch_len)
+		watch_range(addr, len);
+#endif
+	if (addr + len > 0x10000U ||
+	    (len > 0 && dma_block_len(addr, wr) < len))
+		return NULL;
+	return &rdmap[addr >> 8][addr & 0xff];
+}
+
+static inline void dma_read_block(WORD addr, BYTE *p, unsigned len)
+{
+	register unsigned n;
+
+	while (len > 0) {
+		n = PAGESIZ - (addr & 0xff);
+		if (n > len)
+			n = len;
+		memcpy(p, &rdmap[addr >> 8][addr & 0xff], n);
+		addr += n;
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * The page tables of one bank for a DMA device on core 1, which must
+ * transfer into the bank selected when its command was issued, not
+ * into the one the CPU has selected meanwhile. bank_pages() fills them
+ * and returns false if the memory of the bank isn't at a fixed place,
+ * with the banks moved between slots.
+ */
+typedef struct mem_map {
+	BYTE *rd[NUMPAGE], *wr[NUMPAGE];
+#if MEM_DIRTY
+	volatile page_dirty_t *dirty[NUMPAGE];
+#endif
+} mem_map_t;
+
+extern bool bank_pages(BYTE bank, mem_map_t *m);
+
+static inline void map_write(const mem_map_t *m, WORD addr, BYTE data)
+{
+	m->wr[addr >> 8][addr & 0xff] = data;
+#if MEM_DIRTY
+	m->dirty[addr >> 8]->all = ~0U;
+#endif
+}
+
+static inline void map_write_block(const mem_map_t *m, WORD addr,
+				   const BYTE *p, unsigned len)
+{
+	register unsigned n;
+
+	while (len > 0) {
+		n = PAGESIZ - (addr & 0xff);
+		if (n > len)
+			n = len;
+		memcpy(&m->wr[addr >> 8][addr & 0xff], p, n);
+#if MEM_DIRTY
+		m->dirty[addr >> 8]->all = ~0U;
+#endif
+		addr += n;
+		p += n;
+		len -= n;
+	}
+}
+
+static inline void map_read_block(const mem_map_t *m, WORD addr, BYTE *p,
+				  unsigned len)
+{
+	register unsigned n;
+
+	while (len > 0) {
+		n = PAGESIZ - (addr & 0xff);
+		if (n > len)
+			n = len;
+		memcpy(p, &m->rd[addr >> 8][addr & 0xff], n);
+		addr += n;
+		p += n;
+		len -= n;
+	}
 }
 
 /*
@@ -129,20 +740,19 @@ static inline BYTE dma_read(WORD addr)
  */
 static inline void putmem(WORD addr, BYTE data)
 {
-	if ((selbnk == 0) || (addr >= SEGSIZ)) {
-		if (addr < 0xff00)
-			bnk0[addr] = data;
-	} else {
-		curbnk[addr] = data;
-	}
+	wrmap[addr >> 8][addr & 0xff] = data;
+#if MEM_DIRTY
+	dirtymap[addr >> 8]->all = ~0U;
+#endif
+#if MEM_WATCH
+	if ((WORD) (addr - watch_addr) < watch_len)
+		watch_line[(WORD) (addr - watch_addr) / WATCH_LINE] = 1;
+#endif
 }
 
 static inline BYTE getmem(WORD addr)
 {
-	if ((selbnk == 0) || (addr >= SEGSIZ))
-		return bnk0[addr];
-	else
-		return curbnk[addr];
+	return rdmap[addr >> 8][addr & 0xff];
 }
 
 #endif /* !SIMMEM_INC */
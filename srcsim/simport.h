@@ -12,8 +12,13 @@
 #include "sim.h"
 #include "simdefs.h"
 
-static inline void sleep_for_us(unsigned long time) { sleep_us(time); }
-static inline void sleep_for_ms(unsigned time) { sleep_ms(time); }
+extern void throttle_sleep_us(unsigned long time);
+extern void halt_sleep_ms(unsigned time);
+
+/* the CPU cores sleep with this to throttle the CPU speed */
+static inline void sleep_for_us(unsigned long time) { throttle_sleep_us(time); }
+/* and with this while waiting for an interrupt in HALT */
+static inline void sleep_for_ms(unsigned time) { halt_sleep_ms(time); }
 
 static inline uint64_t get_clock_us(void)
 {
@@ -0,0 +1,222 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Sound output device, an 8-bit DAC at I/O port 20. A byte written to
+ * the port is the new output level, it is held until the next write.
+ * The levels are turned into samples at SOUND_RATE in emulated time,
+ * from the T-states and the CPU speed, so the pitch stays right with
+ * the CPU throttled or running at another speed. With an unlimited
+ * speed the host time is used instead. The samples go into a ring of
+ * chunks, which are sent by a DMA channel paced by a DMA timer to the
+ * level of a PWM slice on the SOUND_PIN GPIO, chained by the DMA
+ * interrupt like the chunks of the LCD pixmap. A low-pass filter of
+ * a resistor and a capacitor on the pin gives the analog signal.
+ *
+ * When the ring is full, with the CPU faster than real time, samples
+ * are dropped. When it runs empty the DMA stops and starts again with
+ * SOUND_START chunks, so a stopped CPU doesn't repeat old samples.
+ * Port 20 reads 00H, or 01H while samples are played, programs can
+ * check for the device with it.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+
+#include "gpio.h"
+#include "picosim.h"
+#include "sched.h"
+#include "sound.h"
+
+#if SOUND80
+
+#ifndef SOUND_RATE
+#define SOUND_RATE	22050	/* samples per second */
+#endif
+#define SOUND_CHUNK	256	/* samples sent by the DMA at once */
+#define SOUND_CHUNKS	8	/* chunks in the ring */
+#define SOUND_SIZE	(SOUND_CHUNK * SOUND_CHUNKS)
+#define SOUND_START	2	/* chunks buffered before playing starts */
+#define SOUND_DMA_IRQ	(DMA_IRQ_1)
+#define SOUND_IDLE_T	10000	/* T-states between fills, unlimited speed */
+
+static uint16_t ring[SOUND_SIZE]; /* the samples */
+static volatile uint32_t ring_wr; /* samples written by the CPU */
+static volatile uint32_t ring_rd; /* samples sent by the DMA */
+static volatile bool playing;	/* the DMA sends a chunk */
+
+static bool inited;		/* the hardware is set up */
+static uint sound_chan;		/* the DMA channel */
+static uint32_t rate;		/* actual samples per second */
+
+static bool active;		/* the port was written since the reset */
+static BYTE level;		/* the output level */
+static Tstates_t fill_T;	/* T-states of the last fill */
+static uint64_t fill_us;	/* host time of the last fill */
+static uint64_t fill_acc;	/* fraction of a sample not written yet */
+
+/*
+ * send the next chunk if there is one, with the interrupts disabled
+ */
+static void __not_in_flash_func(sound_play)(void)
+{
+	if (ring_wr - ring_rd >= SOUND_CHUNK) {
+		dma_channel_transfer_from_buffer_now(sound_chan,
+						     &ring[ring_rd % SOUND_SIZE],
+						     SOUND_CHUNK);
+		playing = true;
+	} else
+		playing = false;
+}
+
+static void __not_in_flash_func(sound_dma_irq_handler)(void)
+{
+	if (!dma_irqn_get_channel_status(SOUND_DMA_IRQ - DMA_IRQ_0,
+					 sound_chan))
+		return;
+	dma_irqn_acknowledge_channel(SOUND_DMA_IRQ - DMA_IRQ_0, sound_chan);
+	ring_rd += SOUND_CHUNK;
+	sound_play();
+}
+
+/*
+ * write the samples of the held level up to now into the ring
+ */
+static void sound_fill(void)
+{
+	uint64_t d, tps, now;
+	uint32_t n, wr, room;
+	uint16_t v = level;
+	uint32_t flags;
+
+	now = time_us_64();
+	if (speed) {
+		d = T - fill_T;
+		tps = (uint64_t) speed_khz * 1000;
+	} else {
+		d = now - fill_us;
+		tps = 1000000;
+	}
+	fill_T = T;
+	fill_us = now;
+
+	/* a long pause would overflow, it is silence anyway */
+	if (d > tps)
+		d = tps;
+	fill_acc += d * rate;
+	n = (uint32_t) (fill_acc / tps);
+	fill_acc -= (uint64_t) n * tps;
+
+	wr = ring_wr;
+	room = SOUND_SIZE - (wr - ring_rd);
+	if (n > room)
+		n = room;	/* faster than real time, drop them */
+	while (n--)
+		ring[wr++ % SOUND_SIZE] = v;
+	ring_wr = wr;
+
+	if (!playing && wr - ring_rd >= SOUND_START * SOUND_CHUNK) {
+		flags = save_and_disable_interrupts();
+		if (!playing)
+			sound_play();
+		restore_interrupts(flags);
+	}
+}
+
+/*
+ * event of the scheduler writing the held level, while the port is used
+ */
+static void sound_tick(void)
+{
+	sound_fill();
+	sched_post(T + (speed ? (Tstates_t) speed_khz * 1000 * SOUND_CHUNK
+			/ 2 / rate : SOUND_IDLE_T), sound_tick);
+}
+
+BYTE sound_in(void)
+{
+	return playing ? 0x01 : 0x00;
+}
+
+void sound_out(BYTE data)
+{
+	if (!active) {
+		/* start the timeline at the first write */
+		active = true;
+		fill_T = T;
+		fill_us = time_us_64();
+		fill_acc = 0;
+		sound_tick();
+	} else
+		sound_fill();
+	level = data;
+}
+
+/*
+ * stop writing samples, the ones in the ring are still played
+ */
+void sound_reset(void)
+{
+	if (active) {
+		sched_cancel(sound_tick);
+		active = false;
+	}
+	level = 0;
+}
+
+/*
+ * set up the PWM, DMA timer and DMA channel, called when the machine
+ * starts
+ */
+void sound_start(void)
+{
+	dma_channel_config c;
+	uint slice;
+	int timer;
+	uint32_t div;
+
+	if (!inited) {
+		gpio_set_function(SOUND_PIN, GPIO_FUNC_PWM);
+		slice = pwm_gpio_to_slice_num(SOUND_PIN);
+		pwm_set_wrap(slice, 255);
+		pwm_set_gpio_level(SOUND_PIN, 0);
+		pwm_set_enabled(slice, true);
+
+		div = clock_get_hz(clk_sys) / SOUND_RATE;
+		rate = clock_get_hz(clk_sys) / div;
+		timer = dma_claim_unused_timer(true);
+		dma_timer_set_fraction((uint) timer, 1, (uint16_t) div);
+
+		sound_chan = (uint) dma_claim_unused_channel(true);
+		c = dma_channel_get_default_config(sound_chan);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+		channel_config_set_read_increment(&c, true);
+		channel_config_set_write_increment(&c, false);
+		channel_config_set_dreq(&c, dma_get_timer_dreq((uint) timer));
+		dma_channel_set_config(sound_chan, &c, false);
+		dma_channel_set_write_addr(sound_chan,
+					   &pwm_hw->slice[slice].cc, false);
+		dma_irqn_set_channel_enabled(SOUND_DMA_IRQ - DMA_IRQ_0,
+					     sound_chan, true);
+		irq_add_shared_handler(SOUND_DMA_IRQ, sound_dma_irq_handler,
+				       PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+		irq_set_enabled(SOUND_DMA_IRQ, true);
+		inited = true;
+	}
+	sound_reset();
+}
+
+#endif /* SOUND80 */
@@ -0,0 +1,36 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Sound output device, an 8-bit DAC played by PWM on a GPIO
+ */
+
+#ifndef SOUND_INC
+#define SOUND_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#ifndef SOUND80
+#define SOUND80		0	/* sound output device */
+#endif
+
+#if SOUND80
+extern void sound_start(void);
+extern void sound_reset(void);
+extern BYTE sound_in(void);
+extern void sound_out(BYTE data);
+#else /* !SOUND80 */
+
+static inline void sound_start(void)
+{
+}
+
+static inline void sound_reset(void)
+{
+}
+
+#endif /* !SOUND80 */
+
+#endif /* !SOUND_INC */
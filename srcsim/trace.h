@@ -0,0 +1,111 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Binary trace stream on the DEBUG port
+ */
+
+#ifndef TRACE_INC
+#define TRACE_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+/*
+ * With TRACE80 the DEBUG port sends a binary stream of trace records
+ * at TRACE_BAUD instead of text. The records are put into a ring
+ * buffer, which a DMA channel moves to the PIO UART, so the CPU only
+ * stalls for copying the record. If the ring buffer is full the
+ * records are dropped and counted. The format of the records is
+ * described in debug.c, srctrace/trace80 decodes them on the host.
+ */
+#ifndef TRACE80
+#define TRACE80		0	/* binary trace stream */
+#endif
+
+#if TRACE80
+
+#ifndef TRACE_BAUD	/* baud rate of the trace stream */
+#define TRACE_BAUD 921600
+#endif
+#ifndef TRACE_MASK	/* events traced after reset */
+#define TRACE_MASK (TRACE_IO | TRACE_FDC | TRACE_MMU | TRACE_INT)
+#endif
+
+/* events, for trace_mask */
+#define TRACE_INST	0x01	/* opcode fetches, needs BUS_8080 */
+#define TRACE_IO	0x02	/* port I/O */
+#define TRACE_FDC	0x04	/* disk sector transfers */
+#define TRACE_MMU	0x08	/* bank switches */
+#define TRACE_INT	0x10	/* interrupt requests */
+#define TRACE_ALL	0x1f
+
+/* record types */
+#define TR_INST		0x01	/* PC (2), opcode */
+#define TR_IN		0x02	/* port, data */
+#define TR_OUT		0x03	/* port, data */
+#define TR_FDC_RD	0x04	/* drive, track, sector, count, status */
+#define TR_FDC_WR	0x05	/* drive, track, sector, count, status */
+#define TR_MMU		0x06	/* bank */
+#define TR_INT		0x07	/* source, vector */
+#define TR_TEXT		0x08	/* length, text */
+#define TR_LOST		0x09	/* records dropped (2) */
+#define TR_SYNC		0xa5	/* 5AH, time in us (4), T states (4) */
+#define TR_SYNC2	0x5a
+
+extern volatile BYTE trace_mask;
+
+extern void trace_write(const BYTE *rec, unsigned len);
+extern void trace_text(const char *s);
+
+static inline void trace_io(BYTE type, BYTE port, BYTE data)
+{
+	if (trace_mask & TRACE_IO) {
+		const BYTE rec[3] = { type, port, data };
+
+		trace_write(rec, sizeof(rec));
+	}
+}
+
+static inline void trace_inst(WORD addr, BYTE data)
+{
+	if (trace_mask & TRACE_INST) {
+		const BYTE rec[4] = { TR_INST, addr & 0xff, addr >> 8, data };
+
+		trace_write(rec, sizeof(rec));
+	}
+}
+
+static inline void trace_fdc(bool wr, int drive, int track, int sector,
+			     int count, BYTE stat)
+{
+	if (trace_mask & TRACE_FDC) {
+		const BYTE rec[6] = { wr ? TR_FDC_WR : TR_FDC_RD, drive,
+				      track, sector, count, stat };
+
+		trace_write(rec, sizeof(rec));
+	}
+}
+
+static inline void trace_mmu(BYTE bank)
+{
+	if (trace_mask & TRACE_MMU) {
+		const BYTE rec[2] = { TR_MMU, bank };
+
+		trace_write(rec, sizeof(rec));
+	}
+}
+
+static inline void trace_int(int src, BYTE vector)
+{
+	if (trace_mask & TRACE_INT) {
+		const BYTE rec[3] = { TR_INT, src, vector };
+
+		trace_write(rec, sizeof(rec));
+	}
+}
+
+#endif /* TRACE80 */
+
+#endif /* !TRACE_INC */
@@ -0,0 +1,378 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Extended DMA floppy disk controller, works like the SD-FDC but
+ * transfers a number of consecutive sectors with one command.
+ *
+ * Output to the port:
+ *	10H		next two bytes written are the address of the
+ *			command bytes, low byte first
+ *	20H + drive	read sectors
+ *	40H + drive	write sectors
+ *	30H		disable the command done interrupt
+ *	31H		enable the command done interrupt, next byte
+ *			written is the interrupt data (RST or IM 2 vector)
+ *	50H + drive	store the disk type into command byte 0,
+ *			sectors of the drive are not unskewed from now
+ *			on, the BIOS is expected to use logical sectors
+ *			for a disk type DISK_FDL
+ *	60H + drive	change the disk, command bytes 2 and 3 are the
+ *			address of the zero terminated file name of the
+ *			disk image without .DSK, an empty name unmounts
+ *			the drive, command byte 1 = 1 uses an overlay
+ *	A0H + drive	read sectors in the background
+ *	C0H + drive	write sectors in the background
+ *
+ * Command bytes:
+ *	0	track
+ *	1	sector
+ *	2	DMA address low
+ *	3	DMA address high
+ *	4	number of sectors, replaced with the number of
+ *		sectors transferred when the command is done
+ *
+ * The sectors continue with sector 1 of the next track. Input from
+ * the port returns the FDC status of the last command.
+ *
+ * Background commands are executed on core 1 between the LCD refreshes
+ * while the CPU continues. Until they are done the status is
+ * XFDC_STAT_BUSY and the command bytes and the DMA memory must not be
+ * touched. The command bytes and the bank selected are latched when
+ * the command is written, the sectors go into that bank even if the
+ * CPU switches the bank meanwhile. Any command written while busy
+ * waits for the background command to finish first. If core 1 doesn't
+ * take the command within XFDC_WAIT_MS it is executed by core 0, and
+ * the following ones in the foreground until core 1 runs again. With
+ * banks moved between slots (PSRAM, packed banks) they are executed
+ * in the foreground too, the memory of a bank has no fixed place.
+ * With the command done interrupt enabled an interrupt is requested
+ * after every read or write command. While a run is recorded or
+ * replayed the background commands are executed in the foreground,
+ * so that the command done interrupts come at the same T-states.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ * 14-OCT-2026 added background commands executed on core 1
+ * 14-OCT-2026 added get disk type command
+ * 14-OCT-2026 added change disk command
+ * 14-OCT-2026 request the interrupt through the interrupt controller
+ * 14-OCT-2026 background commands in the foreground for a replay
+ * 14-OCT-2026 latch the bank of background commands, wait with timeout
+ * 15-OCT-2026 save and restore the controller state for snapshots
+ */
+
+#include <ctype.h>
+#include "pico/sync.h"
+#include "pico/time.h"
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+#include "simio.h"
+
+#include "sd-fdc.h"
+#include "disks.h"
+#include "xfdc.h"
+
+#define XFDC_CMDLEN	5	/* number of command bytes */
+
+#ifndef XFDC_WAIT_MS
+#define XFDC_WAIT_MS	100	/* core 1 must take a background command */
+#endif
+
+static enum xfdc_port { XFDC_CMD, XFDC_ADRL, XFDC_ADRH, XFDC_INTD } state;
+static WORD cmd_addr;		/* address of the command bytes */
+static volatile BYTE status;	/* status of the last command (W0 W1 R0) */
+static bool int_enabled;	/* command done interrupt enabled */
+static BYTE int_vector;		/* interrupt data for command done */
+
+/* background command, written by core 0 and executed by core 1 */
+static struct {
+	BYTE cmd;		/* the command */
+	BYTE cb[XFDC_CMDLEN];	/* the command bytes */
+	WORD addr;		/* address of the command bytes */
+	bool irq;		/* request interrupt when done */
+	BYTE vector;		/* interrupt data */
+	mem_map_t map;		/* page tables of the bank selected */
+} bg;
+static volatile bool bg_busy;	/* background command pending (W0 W1 R0 R1) */
+static volatile bool bg_taken;	/* executed by a core, under bg_lock */
+static volatile bool bg_alive;	/* core 1 runs xfdc_task() (W1 R0) */
+static spin_lock_t *bg_lock;	/* one core takes the command */
+
+/*
+ * execute a command with the command bytes @ addr in the memory
+ * of map, or of the CPU with NULL, returns the FDC status
+ */
+static BYTE xfdc_exec(BYTE cmd, const BYTE *cb, WORD addr,
+		      const mem_map_t *map)
+{
+	BYTE stat;
+	int done;
+
+	if (cmd & 0x20)
+		stat = read_secs(map, cmd & 0x0f, cb[0], cb[1],
+				 (cb[3] << 8) | cb[2], cb[4], &done);
+	else
+		stat = write_secs(map, cmd & 0x0f, cb[0], cb[1],
+				  (cb[3] << 8) | cb[2], cb[4], &done);
+
+	if (map != NULL)
+		map_write(map, addr + 4, (BYTE) done);
+	else
+		dma_write(addr + 4, (BYTE) done);
+
+	return stat;
+}
+
+/*
+ * change the disk in drive to the image named in memory
+ */
+static BYTE xfdc_swap(int drive)
+{
+	char name[FNLEN+2];
+	WORD addr;
+	register int i;
+
+	addr = (dma_read(cmd_addr + 3) << 8) | dma_read(cmd_addr + 2);
+	for (i = 0; i < FNLEN + 1; i++)
+		if ((name[i] = toupper(dma_read(addr + i))) == '\0')
+			break;
+	name[i] = '\0';
+
+	if (name[0] == '\0') {
+		unmount_disk(drive);
+		return FDC_STAT_OK;
+	}
+
+	return swap_disk(drive, name, dma_read(cmd_addr + 1) == 1);
+}
+
+/*
+ * take the pending background command for execution by this core,
+ * false if the other one has it already
+ */
+static bool __not_in_flash_func(bg_take)(void)
+{
+	uint32_t save;
+	bool taken;
+
+	save = spin_lock_blocking(bg_lock);
+	taken = !bg_taken;
+	bg_taken = true;
+	spin_unlock(bg_lock, save);
+
+	return taken;
+}
+
+/*
+ * execute the pending background command with the latched
+ * command bytes and bank
+ */
+static void __not_in_flash_func(bg_exec)(void)
+{
+	status = xfdc_exec(bg.cmd, bg.cb, bg.addr, &bg.map);
+	if (bg.irq)
+		int_request(INT_FDC, bg.vector);
+
+	__mem_fence_release();
+	bg_busy = false;
+}
+
+/*
+ * called from core 1 to execute a pending background command
+ */
+void __not_in_flash_func(xfdc_task)(void)
+{
+	bg_alive = true;
+	if (!bg_busy)
+		return;
+	__mem_fence_acquire();
+
+	if (bg_take())
+		bg_exec();
+}
+
+/*
+ * wait until a pending background command is done, if core 1
+ * hasn't taken it in time core 0 executes it
+ */
+static void xfdc_wait(void)
+{
+	absolute_time_t t;
+
+	if (!bg_busy)
+		return;
+
+	t = make_timeout_time_ms(XFDC_WAIT_MS);
+	while (bg_busy) {
+		if (time_reached(t) && bg_take()) {
+			__mem_fence_acquire();
+			bg_alive = false;
+			bg_exec();
+			break;
+		}
+		tight_loop_contents();
+	}
+	__mem_fence_acquire();
+}
+
+/*
+ * finish a pending background command without touching the
+ * controller state, called before a snapshot is taken
+ */
+void xfdc_finish(void)
+{
+	xfdc_wait();
+}
+
+/*
+ * save the controller state into a snapshot, the background
+ * command must be finished with xfdc_finish() before
+ */
+void xfdc_save(xfdc_state_t *s)
+{
+	s->cmd_addr = cmd_addr;
+	s->state = (BYTE) state;
+	s->status = status;
+	s->int_enabled = int_enabled;
+	s->int_vector = int_vector;
+}
+
+/*
+ * restore the controller state from a snapshot
+ */
+void xfdc_restore(const xfdc_state_t *s)
+{
+	xfdc_wait();
+	cmd_addr = s->cmd_addr;
+	state = s->state <= XFDC_INTD ? (enum xfdc_port) s->state : XFDC_CMD;
+	status = s->status;
+	int_enabled = s->int_enabled;
+	int_vector = s->int_vector;
+}
+
+/*
+ * finish a pending background command and reset the controller,
+ * called on reset and exit of the CPU
+ */
+void xfdc_reset(void)
+{
+	register int i;
+
+	xfdc_wait();
+	state = XFDC_CMD;
+	int_enabled = false;
+	status = FDC_STAT_OK;
+	for (i = 0; i < NUMDISK; i++)
+		disk_linear[i] = false;
+}
+
+/*
+ * I/O handler for read extended FDC status
+ */
+BYTE xfdc_in(void)
+{
+	return bg_busy ? XFDC_STAT_BUSY : status;
+}
+
+/*
+ * I/O handler for write extended FDC command
+ */
+void xfdc_out(BYTE data)
+{
+	BYTE cb[XFDC_CMDLEN];
+	register int i;
+
+	xfdc_wait();
+
+	switch (state) {
+	case XFDC_ADRL:
+		cmd_addr = data;
+		state = XFDC_ADRH;
+		return;
+
+	case XFDC_ADRH:
+		cmd_addr |= data << 8;
+		state = XFDC_CMD;
+		return;
+
+	case XFDC_INTD:
+		int_vector = data;
+		int_enabled = true;
+		state = XFDC_CMD;
+		return;
+
+	default:
+		break;
+	}
+
+	switch (data & 0xf0) {
+	case 0x10:		/* set address of command bytes */
+		state = XFDC_ADRL;
+		return;
+
+	case 0x30:		/* command done interrupt */
+		if (data & 1)
+			state = XFDC_INTD;
+		else
+			int_enabled = false;
+		return;
+
+	case 0x20:		/* read sectors */
+	case 0x40:		/* write sectors */
+	case 0x50:		/* get disk type */
+	case 0x60:		/* change disk */
+	case 0xa0:		/* read sectors in the background */
+	case 0xc0:		/* write sectors in the background */
+		break;
+
+	default:		/* unknown command */
+		return;
+	}
+
+	if ((data & 0x0f) >= NUMDISK) {
+		status = FDC_STAT_DISK;
+		return;
+	}
+
+	if ((data & 0xf0) == 0x50) {
+		dma_write(cmd_addr, disk_type[data & 0x0f]);
+		disk_linear[data & 0x0f] = true;
+		status = FDC_STAT_OK;
+		return;
+	}
+
+	if ((data & 0xf0) == 0x60) {
+		status = xfdc_swap(data & 0x0f);
+		return;
+	}
+
+	if ((data & 0x80) && !replay_active() && bg_alive &&
+	    bank_pages(selbnk, &bg.map)) {
+		/* hand the command over to core 1 */
+		if (bg_lock == NULL)
+			bg_lock = spin_lock_init(spin_lock_claim_unused(true));
+		bg.cmd = data;
+		for (i = 0; i < XFDC_CMDLEN; i++)
+			bg.cb[i] = dma_read(cmd_addr + i);
+		bg.addr = cmd_addr;
+		bg.irq = int_enabled;
+		bg.vector = int_vector;
+		bg_taken = false;
+		__mem_fence_release();
+		bg_busy = true;
+		__sev();
+		return;
+	}
+
+	for (i = 0; i < XFDC_CMDLEN; i++)
+		cb[i] = dma_read(cmd_addr + i);
+
+	status = xfdc_exec(data, cb, cmd_addr, NULL);
+	if (int_enabled)
+		int_request(INT_FDC, int_vector);
+}
@@ -0,0 +1,32 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Extended DMA floppy disk controller with multi sector transfers
+ * and background commands executed on core 1
+ */
+
+#ifndef XFDC_INC
+#define XFDC_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define XFDC_STAT_BUSY	0x80	/* background command not done yet */
+
+/* controller state saved in a machine snapshot */
+typedef struct xfdc_state {
+	WORD cmd_addr;		/* address of the command bytes */
+	BYTE state;		/* state of the command port */
+	BYTE status;		/* status of the last command */
+	bool int_enabled;	/* command done interrupt enabled */
+	BYTE int_vector;	/* interrupt data for command done */
+} xfdc_state_t;
+
+extern void xfdc_task(void), xfdc_reset(void), xfdc_finish(void);
+extern void xfdc_save(xfdc_state_t *s), xfdc_restore(const xfdc_state_t *s);
+extern BYTE xfdc_in(void);
+extern void xfdc_out(BYTE data);
+
+#endif /* !XFDC_INC */
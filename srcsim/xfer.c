@@ -0,0 +1,239 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * DMA file transfer device, moves 128 byte records between memory
+ * and a file in /XFER80 on the MicroSD card. The files are copied
+ * from and to the host at USB speed with the mass storage mode of
+ * the configuration dialog, so that no XMODEM over the console is
+ * needed for importing and exporting files.
+ *
+ * Output to the port:
+ *	10H		next two bytes written are the address of the
+ *			command bytes, low byte first
+ *	20H		open the file for reading
+ *	21H		create the file for writing
+ *	30H		read records
+ *	40H		write records
+ *	50H		close the file
+ *	60H		search the first file matching the pattern
+ *	61H		search the next file matching the pattern
+ *
+ * Command bytes:
+ *	0	number of records, replaced with the number of
+ *		records transferred when the command is done
+ *	1	DMA address low
+ *	2	DMA address high
+ *
+ * For open and create the DMA address points to the zero terminated
+ * 8.3 file name, names with a path or which aren't 8.3 are not found.
+ * A partial last record read is padded with 1AH, for reading the end
+ * of the file is reached when less records than requested were
+ * transferred. Input from the port returns the status of the last
+ * command.
+ *
+ * For a search the DMA address points to the zero terminated pattern,
+ * the name of the file found is written there zero terminated, a
+ * CP/M style run of ? at the end of the name or extension matches
+ * any number of characters. If no more files are found the status
+ * is file not found.
+ *
+ * History:
+ * 14-OCT-2026 first version
+ * 14-OCT-2026 added directory search
+ * 14-OCT-2026 reject file names which aren't plain 8.3
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#include "disks.h"
+#include "xfer.h"
+
+#define XFER_RECLEN	128	/* CP/M record length */
+
+static enum { XFER_CMD, XFER_ADRL, XFER_ADRH } state;
+static WORD cmd_addr;		/* address of the command bytes */
+static BYTE status;		/* status of the last command */
+
+/*
+ * open or create the file named in memory
+ */
+static BYTE xfer_openfile(bool wr)
+{
+	char name[13];
+	WORD addr;
+	register int i;
+
+	addr = (dma_read(cmd_addr + 2) << 8) | dma_read(cmd_addr + 1);
+	for (i = 0; i < 12; i++)
+		if ((name[i] = toupper(dma_read(addr + i))) == '\0')
+			break;
+	name[i] = '\0';
+
+	/* no truncated names and no paths out of /XFER80 */
+	if ((i == 12 && dma_read(addr + 12) != '\0') || !xfer_name_ok(name))
+		return XFER_STAT_NOFILE;
+
+	return xfer_open(name, wr) ? XFER_STAT_OK : XFER_STAT_NOFILE;
+}
+
+/*
+ * search the first or next file, the CP/M pattern from memory is
+ * converted for FatFS, where a ? must match exactly one character
+ */
+static BYTE xfer_search(bool first)
+{
+	char buf[13], pat[13], name[13];
+	WORD addr;
+	register int i, j, k;
+
+	addr = (dma_read(cmd_addr + 2) << 8) | dma_read(cmd_addr + 1);
+
+	if (first) {
+		for (i = 0; i < 12; i++)
+			if ((buf[i] = toupper(dma_read(addr + i))) == '\0')
+				break;
+		buf[i] = '\0';
+
+		for (i = j = 0; buf[i]; i++) {
+			if (buf[i] == '?') {
+				for (k = i; buf[k] == '?'; k++)
+					;
+				if (buf[k] == '\0' || buf[k] == '.') {
+					pat[j++] = '*';
+					i = k - 1;
+					continue;
+				}
+			}
+			pat[j++] = buf[i];
+		}
+		pat[j] = '\0';
+		if (j == 0)
+			strcpy(pat, "*");
+	}
+
+	if (!xfer_find(first ? pat : NULL, name))
+		return XFER_STAT_NOFILE;
+
+	for (i = 0; name[i]; i++)
+		dma_write(addr + i, name[i]);
+	dma_write(addr + i, '\0');
+
+	return XFER_STAT_OK;
+}
+
+/*
+ * transfer the records from or to the file
+ */
+static BYTE xfer_records(bool wr)
+{
+	BYTE buf[XFER_RECLEN], stat = XFER_STAT_OK;
+	WORD addr;
+	int n, done, len;
+
+	n = dma_read(cmd_addr);
+	addr = (dma_read(cmd_addr + 2) << 8) | dma_read(cmd_addr + 1);
+
+	for (done = 0; done < n; done++, addr += XFER_RECLEN) {
+		if (wr) {
+			dma_read_block(addr, buf, XFER_RECLEN);
+			if (!xfer_write(buf, XFER_RECLEN)) {
+				stat = XFER_STAT_ERROR;
+				break;
+			}
+		} else {
+			if ((len = xfer_read(buf, XFER_RECLEN)) < 0) {
+				stat = XFER_STAT_ERROR;
+				break;
+			}
+			if (len == 0)
+				break;
+			memset(&buf[len], 0x1a, XFER_RECLEN - len);
+			dma_write_block(addr, buf, XFER_RECLEN);
+			if (len < XFER_RECLEN) {
+				done++;
+				break;
+			}
+		}
+	}
+
+	dma_write(cmd_addr, (BYTE) done);
+
+	return stat;
+}
+
+/*
+ * close the file and reset the device, called on reset and exit
+ */
+void xfer_reset(void)
+{
+	xfer_close();
+	state = XFER_CMD;
+	status = XFER_STAT_OK;
+}
+
+/*
+ * I/O handler for read file transfer status
+ */
+BYTE xfer_in(void)
+{
+	return status;
+}
+
+/*
+ * I/O handler for write file transfer command
+ */
+void xfer_out(BYTE data)
+{
+	switch (state) {
+	case XFER_ADRL:
+		cmd_addr = data;
+		state = XFER_ADRH;
+		return;
+
+	case XFER_ADRH:
+		cmd_addr |= data << 8;
+		state = XFER_CMD;
+		return;
+
+	default:
+		break;
+	}
+
+	switch (data) {
+	case 0x10:		/* set address of command bytes */
+		state = XFER_ADRL;
+		break;
+
+	case 0x20:		/* open file for reading */
+	case 0x21:		/* create file for writing */
+		status = xfer_openfile(data & 1);
+		break;
+
+	case 0x30:		/* read records */
+	case 0x40:		/* write records */
+		status = xfer_records(data == 0x40);
+		break;
+
+	case 0x50:		/* close file */
+		xfer_close();
+		status = XFER_STAT_OK;
+		break;
+
+	case 0x60:		/* search first file */
+	case 0x61:		/* search next file */
+		status = xfer_search(!(data & 1));
+		break;
+
+	default:		/* unknown command */
+		status = XFER_STAT_CMD;
+		break;
+	}
+}
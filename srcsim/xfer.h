@@ -0,0 +1,24 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * DMA file transfer device for files in /XFER80 on the MicroSD card
+ */
+
+#ifndef XFER_INC
+#define XFER_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define XFER_STAT_OK	0x00	/* command done */
+#define XFER_STAT_NOFILE 0x01	/* file not found */
+#define XFER_STAT_ERROR	0x02	/* no file open, read or write error */
+#define XFER_STAT_CMD	0x03	/* unknown command */
+
+extern void xfer_reset(void);
+extern BYTE xfer_in(void);
+extern void xfer_out(BYTE data);
+
+#endif /* !XFER_INC */
@@ -0,0 +1,247 @@
+/*
+ * Decoder on the host for the trace stream of picosim
+ *
+ * Copyright (C) 2026 by Udo Munk & Thomas Eberhardt
+ *
+ * Reads the binary trace stream from the DEBUG port of the Pico, or
+ * from a file it was saved to, and prints the events one per line.
+ * Records before the first sync record, or after a record type which
+ * is not known, are skipped until the next sync record. The format of
+ * the records is described in srcsim/debug.c.
+ *
+ * Usage: trace80 [-b baud] [-s] [-w file] device|file
+ *
+ * History:
+ * 14-OCT-2026 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#define TR_INST		0x01	/* PC (2), opcode */
+#define TR_IN		0x02	/* port, data */
+#define TR_OUT		0x03	/* port, data */
+#define TR_FDC_RD	0x04	/* drive, track, sector, count, status */
+#define TR_FDC_WR	0x05	/* drive, track, sector, count, status */
+#define TR_MMU		0x06	/* bank */
+#define TR_INT		0x07	/* source, vector */
+#define TR_TEXT		0x08	/* length, text */
+#define TR_LOST		0x09	/* records dropped (2) */
+#define TR_SYNC		0xa5	/* 5AH, time in us (4), T states (4) */
+#define TR_SYNC2	0x5a
+
+static const struct {
+	long baud;
+	speed_t speed;
+} bauds[] = {
+	{ 115200, B115200 },
+#ifdef B230400
+	{ 230400, B230400 },
+#endif
+#ifdef B460800
+	{ 460800, B460800 },
+#endif
+#ifdef B921600
+	{ 921600, B921600 },
+#endif
+#ifdef B1000000
+	{ 1000000, B1000000 },
+#endif
+#ifdef B2000000
+	{ 2000000, B2000000 },
+#endif
+#ifdef B3000000
+	{ 3000000, B3000000 },
+#endif
+};
+
+static FILE *in;		/* trace stream */
+static FILE *raw;		/* copy of the stream, or NULL */
+
+static void open_tty(const char *dev, long baud)
+{
+	struct termios t;
+	size_t i;
+	int fd;
+
+	for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+		if (bauds[i].baud == baud)
+			break;
+	if (i == sizeof(bauds) / sizeof(bauds[0])) {
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		exit(EXIT_FAILURE);
+	}
+
+	if ((fd = open(dev, O_RDONLY | O_NOCTTY)) < 0) {
+		perror(dev);
+		exit(EXIT_FAILURE);
+	}
+	if (tcgetattr(fd, &t) < 0) {
+		perror("tcgetattr");
+		exit(EXIT_FAILURE);
+	}
+	cfmakeraw(&t);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	cfsetispeed(&t, bauds[i].speed);
+	cfsetospeed(&t, bauds[i].speed);
+	if (tcsetattr(fd, TCSANOW, &t) < 0) {
+		perror("tcsetattr");
+		exit(EXIT_FAILURE);
+	}
+	in = fdopen(fd, "rb");
+}
+
+/*
+ * next byte of the stream, exits at the end
+ */
+static int get(void)
+{
+	int c;
+
+	if ((c = getc(in)) == EOF) {
+		if (raw != NULL)
+			fclose(raw);
+		exit(EXIT_SUCCESS);
+	}
+	if (raw != NULL)
+		putc(c, raw);
+	return c;
+}
+
+static void get_n(unsigned char *p, int n)
+{
+	while (n--)
+		*p++ = (unsigned char) get();
+}
+
+static unsigned long le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | ((unsigned long) p[2] << 16)
+	       | ((unsigned long) p[3] << 24);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b baud] [-s] [-w file] device|file\n",
+		prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char r[256];
+	unsigned long us = 0, us0 = 0, hi = 0;
+	double now = 0;
+	long baud = 0;
+	int c, synced = 0, started = 0, syncs = 0, skipped = 0;
+
+	while ((c = getopt(argc, argv, "b:sw:")) != -1) {
+		switch (c) {
+		case 'b':
+			baud = atol(optarg);
+			break;
+		case 's':
+			syncs = 1;
+			break;
+		case 'w':
+			if ((raw = fopen(optarg, "wb")) == NULL) {
+				perror(optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (baud)
+		open_tty(argv[optind], baud);
+	else if ((in = fopen(argv[optind], "rb")) == NULL) {
+		perror(argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		c = get();
+		if (!synced && c != TR_SYNC) {
+			skipped++;
+			continue;
+		}
+		if (c == TR_SYNC) {
+			if (get() != TR_SYNC2) {
+				synced = 0;
+				continue;
+			}
+			get_n(r, 8);
+			if (!started) {
+				us0 = us = le32(r);
+				started = 1;
+			}
+			if (le32(r) < us)
+				hi++;	/* the 32 bit us count wrapped */
+			us = le32(r);
+			now = (hi * 4294967296.0 + us - us0) / 1e6;
+			if (!synced && skipped)
+				fprintf(stderr, "synchronized, %d bytes "
+					"skipped\n", skipped);
+			synced = 1;
+			skipped = 0;
+			if (syncs)
+				printf("%12.6f SYNC T %lu\n", now, le32(&r[4]));
+			continue;
+		}
+
+		printf("%12.6f ", now);
+		switch (c) {
+		case TR_INST:
+			get_n(r, 3);
+			printf("INST %04X %02X\n", r[0] | (r[1] << 8), r[2]);
+			break;
+		case TR_IN:
+			get_n(r, 2);
+			printf("IN   %02X = %02X\n", r[0], r[1]);
+			break;
+		case TR_OUT:
+			get_n(r, 2);
+			printf("OUT  %02X = %02X\n", r[0], r[1]);
+			break;
+		case TR_FDC_RD:
+		case TR_FDC_WR:
+			get_n(r, 5);
+			printf("%s %c track %u sector %u count %u "
+			       "status %02X\n", c == TR_FDC_RD ? "READ" : "WRIT",
+			       'A' + r[0], r[1], r[2], r[3], r[4]);
+			break;
+		case TR_MMU:
+			get_n(r, 1);
+			printf("BANK %u\n", r[0]);
+			break;
+		case TR_INT:
+			get_n(r, 2);
+			printf("INT  source %u vector %02X\n", r[0], r[1]);
+			break;
+		case TR_TEXT:
+			get_n(r, 1);
+			c = r[0];
+			get_n(r, c);
+			printf("TEXT %.*s\n", c, (char *) r);
+			break;
+		case TR_LOST:
+			get_n(r, 2);
+			printf("LOST %u records\n", r[0] | (r[1] << 8));
+			break;
+		default:
+			printf("?? record type %02X, lost sync\n", c);
+			synced = 0;
+			break;
+		}
+	}
+}